@@ -0,0 +1,117 @@
+// Throughput of batch mode ("displaymode -") in commands per second,
+// compared with parsing each command with ParseArgs and with running each
+// one against a freshly enumerated catalog, as a separate process would.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "../displaymode_batch.h"
+#include "../displaymode_catalog.h"
+#include "../displaymode_commands.h"
+#include "../displaymode_parse.h"
+#include "../logging.h"
+#include "../tests/bench_util.h"
+#include "../tests/fake_backend.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum {
+    kDisplays = 4,
+    kModesPerDisplay = 48,
+    kCommands = 200000,
+    // Commands run one catalog each; far fewer, as they are far slower.
+    kOneShotCommands = 5000,
+};
+
+static void Report(const char *name, double elapsed_ns, size_t commands) {
+    printf("%-26s %14.0f %12.1f\n", name, commands / (elapsed_ns / 1e9),
+           elapsed_ns / commands);
+}
+
+// Splits "line" (NUL-terminated, modified) into words and parses them.
+static struct ParsedArgs ParseWords(char *line) {
+    const char *argv[32];
+    int argc = 0;
+    argv[argc++] = "displaymode";
+    char *save = NULL;
+    for (char *word = strtok_r(line, " \n", &save); word != NULL;
+         word = strtok_r(NULL, " \n", &save)) {
+        argv[argc++] = word;
+    }
+    argv[argc] = NULL;
+    return ParseArgs(argc, argv);
+}
+
+int main(void) {
+    setLogLevel(LOG_LEVEL_ERROR);
+    struct FakeBackend fake;
+    BenchInitFake(&fake, kDisplays, kModesPerDisplay);
+
+    // "t" commands cycling every display through its modes.
+    char *input = malloc((size_t)kCommands * 32);
+    size_t *starts = malloc((kCommands + 1) * sizeof(*starts));
+    size_t length = 0;
+    for (size_t i = 0; i < kCommands; ++i) {
+        const uint32_t display = i % kDisplays;
+        const struct DisplayMode *mode =
+            &fake.displays[display].modes[(i * 7) % kModesPerDisplay];
+        starts[i] = length;
+        length += (size_t)sprintf(input + length, "t %zu %zu @%g %u\n",
+                                  mode->width, mode->height,
+                                  mode->refresh_rate, display);
+    }
+    starts[kCommands] = length;
+    FILE *null_out = fopen("/dev/null", "w");
+
+    printf("%-26s %14s %12s\n", "path", "commands/s", "ns/command");
+
+    struct ParsedArgs parsed_args;
+    size_t sink = 0;
+    double start = NowNs();
+    for (size_t i = 0; i < kCommands; ++i) {
+        ParseCommandLine(input + starts[i], starts[i + 1] - starts[i] - 1,
+                         &parsed_args);
+        sink += parsed_args.width;
+    }
+    Report("parse: ParseCommandLine", NowNs() - start, kCommands);
+
+    char *copy = malloc(length + 1);
+    memcpy(copy, input, length + 1);
+    start = NowNs();
+    for (size_t i = 0; i < kCommands; ++i) {
+        copy[starts[i + 1] - 1] = '\0';
+        parsed_args = ParseWords(copy + starts[i]);
+        sink += parsed_args.width;
+    }
+    Report("parse: split + ParseArgs", NowNs() - start, kCommands);
+
+    FILE *in = fmemopen(input, length, "r");
+    struct DisplayCatalog catalog;
+    DisplayCatalogInit(&catalog, &fake.backend);
+    start = NowNs();
+    DisplayBatchRun(&catalog, in, null_out, null_out);
+    Report("batch: displaymode -", NowNs() - start, kCommands);
+    DisplayCatalogFree(&catalog);
+    fclose(in);
+
+    memcpy(copy, input, length + 1);
+    start = NowNs();
+    for (size_t i = 0; i < kOneShotCommands; ++i) {
+        copy[starts[i + 1] - 1] = '\0';
+        parsed_args = ParseWords(copy + starts[i]);
+        DisplayCatalogInit(&catalog, &fake.backend);
+        RunCommand(&catalog, &parsed_args, null_out, null_out);
+        DisplayCatalogFree(&catalog);
+    }
+    Report("one catalog per command", NowNs() - start, kOneShotCommands);
+
+    printf("(%zu display switches)\n", (size_t)fake.complete_calls +
+           (sink & 0));
+    fclose(null_out);
+    free(copy);
+    free(starts);
+    free(input);
+    FakeBackendFree(&fake);
+    return 0;
+}
@@ -0,0 +1,92 @@
+// Cost of loading a display's modes from the on-disk cache compared with
+// enumerating them.  The fake backend's enumeration is only a copy, so its
+// cold time is a lower bound; CGDisplayCopyAllDisplayModes takes
+// milliseconds.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "../displaymode_cache.h"
+#include "../displaymode_catalog.h"
+#include "../logging.h"
+#include "../tests/bench_util.h"
+#include "../tests/fake_backend.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+enum {
+    kIterations = 200,
+};
+
+// Loads the modes of display 0 "kIterations" times and returns the mean
+// time in microseconds.
+static double LoadModes(struct FakeBackend *fake, const char *cache_path) {
+    double total = 0.0;
+    for (int i = 0; i < kIterations; ++i) {
+        const double start = NowNs();
+        struct DisplayCatalog catalog;
+        DisplayCatalogInit(&catalog, &fake->backend);
+        struct DisplayCache cache;
+        if (cache_path != NULL) {
+            DisplayCacheOpen(&cache, cache_path);
+            DisplayCatalogSetCache(&catalog, &cache);
+        }
+        const struct DisplayModeList *list = NULL;
+        DisplayCatalogLoadDisplays(&catalog);
+        DisplayCatalogGetModes(&catalog, 0, &list);
+        if (cache_path != NULL) {
+            DisplayCatalogFlushCache(&catalog);
+            DisplayCacheClose(&cache);
+        }
+        DisplayCatalogFree(&catalog);
+        total += NowNs() - start;
+    }
+    return total / kIterations / 1e3;
+}
+
+int main(void) {
+    setLogLevel(LOG_LEVEL_ERROR);
+    char cache_path[64];
+    snprintf(cache_path, sizeof(cache_path), "/tmp/displaymode-bench-%ld.modes",
+             (long)getpid());
+    static const size_t kCatalogSizes[] = {1000, 10000, 100000};
+
+    printf("%-8s %16s %16s %16s\n", "modes", "enumerate us", "enum+store us",
+           "cached us");
+    for (size_t i = 0; i < sizeof(kCatalogSizes) / sizeof(kCatalogSizes[0]); ++i) {
+        struct FakeBackend fake;
+        BenchInitFake(&fake, 1, kCatalogSizes[i]);
+
+        const double cold = LoadModes(&fake, NULL);
+        // Every iteration misses: the file is removed before each load.
+        double store = 0.0;
+        for (int j = 0; j < kIterations / 10; ++j) {
+            unlink(cache_path);
+            const double start = NowNs();
+            struct DisplayCatalog catalog;
+            DisplayCatalogInit(&catalog, &fake.backend);
+            struct DisplayCache cache;
+            DisplayCacheOpen(&cache, cache_path);
+            DisplayCatalogSetCache(&catalog, &cache);
+            const struct DisplayModeList *list = NULL;
+            DisplayCatalogLoadDisplays(&catalog);
+            DisplayCatalogGetModes(&catalog, 0, &list);
+            DisplayCatalogFlushCache(&catalog);
+            DisplayCacheClose(&cache);
+            DisplayCatalogFree(&catalog);
+            store += NowNs() - start;
+        }
+        store = store / (kIterations / 10) / 1e3;
+        const unsigned copies = fake.copy_modes_calls;
+        const double cached = LoadModes(&fake, cache_path);
+        if (fake.copy_modes_calls != copies) {
+            fprintf(stderr, "cache missed\n");
+        }
+        printf("%-8zu %16.1f %16.1f %16.1f\n", kCatalogSizes[i], cold, store,
+               cached);
+        FakeBackendFree(&fake);
+    }
+    unlink(cache_path);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,188 @@
+// Cost of the DRM backend (displaymode_drm.h): parsing sysfs "modes" files
+// against sscanf line by line, and listing every display of a generated
+// sysfs tree with thousands of connectors.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "../displaymode_catalog.h"
+#include "../displaymode_drm.h"
+#include "../logging.h"
+#include "../tests/bench_util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+enum {
+    kParseLines = 100000,
+    kParseRounds = 20,
+    kCards = 8,
+    kConnectorsPerCard = 256,
+    kModesPerConnector = 64,
+    kListRounds = 5,
+};
+
+static const unsigned kSizes[][2] = {
+    {3840, 2160}, {2560, 1440}, {1920, 1200}, {1920, 1080}, {1680, 1050},
+    {1600, 900}, {1280, 1024}, {1280, 720}, {1024, 768}, {800, 600},
+    {720, 576}, {640, 480},
+};
+
+#define kNumSizes (sizeof(kSizes) / sizeof(kSizes[0]))
+
+// Writes "lines" mode lines like a "modes" file into "out" (to be freed).
+static size_t MakeModes(size_t lines, char **out) {
+    char *text = malloc(lines * 16 + 1);
+    size_t size = 0;
+    for (size_t i = 0, s = 0; i < lines; ++i) {
+        size += (size_t)sprintf(text + size, "%ux%u%s\n", kSizes[s][0],
+                                kSizes[s][1], i % 7 == 6 ? "i" : "");
+        s = s + 1 == kNumSizes ? 0 : s + 1;
+    }
+    *out = text;
+    return size;
+}
+
+// What a line-at-a-time parser does: find each line, then sscanf it.
+static size_t ParseSscanf(const char *data, size_t size,
+                          struct DisplayMode *modes) {
+    size_t count = 0;
+    const char *p = data;
+    const char *const end = data + size;
+    char line[32];
+    while (p < end) {
+        const char *newline = memchr(p, '\n', (size_t)(end - p));
+        const size_t length = (size_t)((newline ? newline : end) - p);
+        if (length < sizeof(line)) {
+            memcpy(line, p, length);
+            line[length] = '\0';
+            unsigned width, height;
+            char suffix = '\0';
+            if (sscanf(line, "%ux%u%c", &width, &height, &suffix) >= 2) {
+                modes[count].width = width;
+                modes[count].height = height;
+                modes[count].refresh_rate = 0.0;
+                modes[count].usable_for_desktop = suffix != 'i';
+                modes[count].mode_id = (int)count;
+                modes[count].handle = NULL;
+                ++count;
+            }
+        }
+        p = newline ? newline + 1 : end;
+    }
+    return count;
+}
+
+static void WriteFile(const char *path, const char *text, size_t size) {
+    FILE *f = fopen(path, "w");
+    fwrite(text, 1, size, f);
+    fclose(f);
+}
+
+// Builds a sysfs tree of kCards * kConnectorsPerCard connectors, three in
+// four connected.
+static void MakeTree(const char *root, const char *modes, size_t modes_size) {
+    char path[512];
+    for (int card = 0; card < kCards; ++card) {
+        for (int c = 0; c < kConnectorsPerCard; ++c) {
+            const int n = card * kConnectorsPerCard + c;
+            snprintf(path, sizeof(path), "%s/card%d-DP-%d", root, card, c + 1);
+            mkdir(path, 0755);
+            char text[32];
+            snprintf(path, sizeof(path), "%s/card%d-DP-%d/status", root, card,
+                     c + 1);
+            const char *status = n % 4 == 3 ? "disconnected\n" : "connected\n";
+            WriteFile(path, status, strlen(status));
+            snprintf(path, sizeof(path), "%s/card%d-DP-%d/connector_id", root,
+                     card, c + 1);
+            WriteFile(path, text, (size_t)snprintf(text, sizeof(text), "%d\n",
+                                                   100 + n));
+            snprintf(path, sizeof(path), "%s/card%d-DP-%d/modes", root, card,
+                     c + 1);
+            WriteFile(path, modes, n % 4 == 3 ? 0 : modes_size);
+        }
+    }
+}
+
+int main(void) {
+    setLogLevel(LOG_LEVEL_ERROR);
+    char *text = NULL;
+    const size_t size = MakeModes(kParseLines, &text);
+    struct DisplayMode *modes = malloc(DrmMaxModes(size) * sizeof(*modes));
+    printf("%-28s %10s %10s\n", "parsing modes files", "ns/mode", "MB/s");
+    size_t sink = 0;
+    double start = NowNs();
+    for (int round = 0; round < kParseRounds; ++round) {
+        sink += DrmParseModes(text, size, modes, DrmMaxModes(size));
+    }
+    double elapsed = NowNs() - start;
+    printf("%-28s %10.2f %10.1f\n", "DrmParseModes",
+           elapsed / ((double)kParseRounds * kParseLines),
+           (double)kParseRounds * size / elapsed * 1e3);
+    start = NowNs();
+    for (int round = 0; round < kParseRounds; ++round) {
+        sink += ParseSscanf(text, size, modes);
+    }
+    elapsed = NowNs() - start;
+    printf("%-28s %10.2f %10.1f\n", "line by line with sscanf",
+           elapsed / ((double)kParseRounds * kParseLines),
+           (double)kParseRounds * size / elapsed * 1e3);
+    free(text);
+
+    char root[] = "/tmp/displaymode-bench-drm-XXXXXX";
+    if (mkdtemp(root) == NULL) {
+        perror("mkdtemp");
+        return EXIT_FAILURE;
+    }
+    char *connector_modes = NULL;
+    const size_t connector_size = MakeModes(kModesPerConnector,
+                                            &connector_modes);
+    MakeTree(root, connector_modes, connector_size);
+    free(connector_modes);
+
+    struct DrmBackend drm;
+    DrmBackendInit(&drm, root);
+    start = NowNs();
+    for (int round = 0; round < kListRounds; ++round) {
+        DrmBackendScan(&drm);
+    }
+    const double scan_ns = (NowNs() - start) / kListRounds;
+    size_t displays = 0;
+    size_t listed_modes = 0;
+    start = NowNs();
+    for (int round = 0; round < kListRounds; ++round) {
+        struct DisplayCatalog catalog;
+        DisplayCatalogInit(&catalog, &drm.backend);
+        DisplayCatalogLoadDisplays(&catalog);
+        int *errors = malloc((catalog.num_displays + 1) * sizeof(*errors));
+        DisplayCatalogLoadAllModes(&catalog, errors);
+        displays = catalog.num_displays;
+        listed_modes = 0;
+        for (uint32_t i = 0; i < catalog.num_displays; ++i) {
+            listed_modes += catalog.modes[i].count;
+        }
+        free(errors);
+        DisplayCatalogFree(&catalog);
+    }
+    const double list_ns = (NowNs() - start) / kListRounds;
+    DrmBackendFree(&drm);
+
+    printf("\n%d connectors, %zu connected, %zu modes\n",
+           kCards * kConnectorsPerCard, displays, listed_modes);
+    printf("%-28s %10s %12s\n", "sysfs tree", "ms", "us/display");
+    printf("%-28s %10.2f %12.2f\n", "scan connectors", scan_ns / 1e6,
+           scan_ns / 1e3 / displays);
+    printf("%-28s %10.2f %12.2f\n", "load displays and modes", list_ns / 1e6,
+           list_ns / 1e3 / displays);
+
+    char command[128];
+    snprintf(command, sizeof(command), "rm -rf %s", root);
+    if (system(command) != 0) {
+        fprintf(stderr, "Could not remove %s\n", root);
+    }
+    free(modes);
+    printf("(checksum %zu)\n", sink);
+    return 0;
+}
@@ -0,0 +1,81 @@
+// Throughput of EDID decoding (displaymode_edid.h) over the fixture corpus
+// in tests/fixtures/edid, against looking the same blobs up in the EDID
+// cache as repeated listings do.  Run from the repository root.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "../displaymode_edid.h"
+#include "../tests/bench_util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum {
+    kRounds = 200000,
+};
+
+static const char *const kFiles[] = {
+    "dell-u2723qe.bin",   "boe-ne135fbm.bin",  "samsung-tv-cta.bin",
+    "lg-ultrafine-5k.bin", "hp-vga-analog.bin", "apple-studio-displayid.bin",
+};
+
+#define kNumFiles (sizeof(kFiles) / sizeof(kFiles[0]))
+
+struct Blob {
+    unsigned char data[512];
+    size_t size;
+};
+
+static void Report(const char *name, double elapsed_ns, size_t bytes) {
+    printf("%-28s %12.0f %10.1f %10.1f\n", name,
+           (double)kRounds * kNumFiles / elapsed_ns * 1e9,
+           elapsed_ns / ((double)kRounds * kNumFiles),
+           (double)kRounds * bytes / elapsed_ns * 1e3);
+}
+
+int main(void) {
+    struct Blob blobs[kNumFiles];
+    size_t bytes = 0;
+    for (size_t i = 0; i < kNumFiles; ++i) {
+        char path[256];
+        snprintf(path, sizeof(path), "tests/fixtures/edid/%s", kFiles[i]);
+        FILE *f = fopen(path, "rb");
+        if (f == NULL) {
+            fprintf(stderr, "Could not open %s\n", path);
+            return EXIT_FAILURE;
+        }
+        blobs[i].size = fread(blobs[i].data, 1, sizeof(blobs[i].data), f);
+        fclose(f);
+        bytes += blobs[i].size;
+    }
+
+    printf("%zu EDIDs, %zu bytes\n", kNumFiles, bytes);
+    printf("%-28s %12s %10s %10s\n", "", "blobs/s", "ns/blob", "MB/s");
+    struct EdidInfo info;
+    size_t sink = 0;
+    double start = NowNs();
+    for (int round = 0; round < kRounds; ++round) {
+        for (size_t i = 0; i < kNumFiles; ++i) {
+            sink += EdidDecode(blobs[i].data, blobs[i].size, &info) == 0;
+            sink += info.num_timings;
+        }
+    }
+    Report("EdidDecode", NowNs() - start, bytes);
+
+    struct EdidCache cache;
+    EdidCacheInit(&cache);
+    start = NowNs();
+    for (int round = 0; round < kRounds; ++round) {
+        for (size_t i = 0; i < kNumFiles; ++i) {
+            const struct EdidCacheEntry *entry =
+                EdidCacheGet(&cache, blobs[i].data, blobs[i].size);
+            sink += entry->info.num_timings;
+        }
+    }
+    Report("EdidCacheGet", NowNs() - start, bytes);
+    printf("(%u decodes, %u hits, checksum %zu)\n", cache.decodes, cache.hits,
+           sink);
+    EdidCacheFree(&cache);
+    return 0;
+}
@@ -0,0 +1,52 @@
+// Size and encode speed of the export formats (displaymode_export.h) for a
+// 10k-mode catalog, against the text listing and --ndjson: bytes per mode
+// and ns per mode for d with each flag, writing to an in-memory stream.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "../displaymode_catalog.h"
+#include "../displaymode_commands.h"
+#include "../displaymode_parse.h"
+#include "../logging.h"
+#include "../tests/bench_util.h"
+#include "../tests/fake_backend.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+enum {
+    kModes = 10000,
+    kRuns = 50,
+};
+
+// Lists the catalog "kRuns" times with "flag" (NULL for text) and prints
+// the size and cost per mode.
+static void Measure(const char *name, struct DisplayCatalog *catalog,
+                    const char *flag) {
+    const char *argv[] = {"displaymode", "d", flag, NULL};
+    const struct ParsedArgs parsed_args = ParseArgs(flag != NULL ? 3 : 2, argv);
+    size_t bytes = 0;
+    const double ns = BenchMeasureCommand(catalog, &parsed_args, kRuns, &bytes);
+    printf("%-10s %10zu %10.1f %10.1f %10.1f\n", name, bytes,
+           (double)bytes / kModes, ns / kModes, (double)bytes / ns * 1e3);
+}
+
+int main(void) {
+    setLogLevel(LOG_LEVEL_ERROR);
+    struct FakeBackend fake;
+    BenchInitFake(&fake, 1, kModes);
+    struct DisplayCatalog catalog;
+    BenchLoadCatalog(&catalog, &fake);
+
+    printf("%-10s %10s %10s %10s %10s\n", "d, 10000", "bytes", "bytes/mode",
+           "ns/mode", "MB/s");
+    Measure("text", &catalog, NULL);
+    Measure("--ndjson", &catalog, "--ndjson");
+    Measure("--csv", &catalog, "--csv");
+    Measure("--tsv", &catalog, "--tsv");
+    Measure("--cbor", &catalog, "--cbor");
+
+    DisplayCatalogFree(&catalog);
+    FakeBackendFree(&fake);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,136 @@
+// Filtering "d"'s modes: a per-mode loop over separately allocated mode
+// objects read through accessor calls (the way a loop over
+// CGDisplayModeRefs reads them), compared with the filter kernels over the
+// columnar mode table.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "../displaymode_filter.h"
+#include "../displaymode_table.h"
+#include "../tests/bench_util.h"
+#include "../tests/fake_backend.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum {
+    kQueries = 50,
+};
+
+// Stand-ins for CGDisplayModeGetWidth and friends: opaque calls.
+__attribute__((noinline)) static size_t GetWidth(const struct DisplayMode *mode) {
+    return mode->width;
+}
+__attribute__((noinline)) static size_t GetHeight(const struct DisplayMode *mode) {
+    return mode->height;
+}
+__attribute__((noinline)) static double GetRefreshRate(const struct DisplayMode *mode) {
+    return mode->refresh_rate;
+}
+__attribute__((noinline)) static int IsUsable(const struct DisplayMode *mode) {
+    return mode->usable_for_desktop;
+}
+
+static size_t FilterObjects(struct DisplayMode *const *objects, size_t count,
+                            const struct ModeFilter *filter, uint64_t *bitmap) {
+    size_t selected = 0;
+    memset(bitmap, 0, DisplayModeFilterWords(count) * sizeof(*bitmap));
+    for (size_t i = 0; i < count; ++i) {
+        const struct DisplayMode *mode = objects[i];
+        const size_t width = GetWidth(mode);
+        const size_t height = GetHeight(mode);
+        if (width < filter->min_width || width > filter->max_width ||
+            height < filter->min_height || height > filter->max_height) {
+            continue;
+        }
+        const double refresh = GetRefreshRate(mode);
+        if (refresh * 1000.0 < filter->min_refresh_mhz ||
+            refresh * 1000.0 > filter->max_refresh_mhz) {
+            continue;
+        }
+        if (filter->usable_only && !IsUsable(mode)) {
+            continue;
+        }
+        if (filter->aspect_w != 0 &&
+            (uint64_t)width * filter->aspect_h != (uint64_t)height * filter->aspect_w) {
+            continue;
+        }
+        bitmap[i / 64] |= (uint64_t)1 << (i % 64);
+        ++selected;
+    }
+    return selected;
+}
+
+int main(void) {
+    static const size_t kCatalogSizes[] = {1000, 10000, 100000, 1000000};
+
+    struct ModeFilter filter;
+    memset(&filter, 0, sizeof(filter));
+    filter.active = 1;
+    filter.min_width = 1280;
+    filter.max_width = 3840;
+    filter.max_height = 2160;
+    filter.min_refresh_mhz = 59000;
+    filter.max_refresh_mhz = 61000;
+    filter.aspect_w = 16;
+    filter.aspect_h = 9;
+    filter.usable_only = 1;
+
+    printf("best kernel: %s\n",
+           DisplayModeFilterKernelName(DisplayModeFilterBestKernel()));
+    printf("%-8s %14s %14s %14s   (ns per mode)\n", "modes", "objects",
+           "scalar", "avx2");
+    for (size_t i = 0; i < sizeof(kCatalogSizes) / sizeof(kCatalogSizes[0]); ++i) {
+        const size_t count = kCatalogSizes[i];
+        struct FakeBackend fake;
+        BenchInitFake(&fake, 1, count);
+        const struct DisplayModeList list = {
+            .modes = fake.displays[0].modes, .count = count,
+            .current_index = -1,
+        };
+        struct DisplayMode **objects = malloc(count * sizeof(*objects));
+        for (size_t j = 0; j < count; ++j) {
+            objects[j] = malloc(sizeof(**objects));
+            *objects[j] = list.modes[j];
+        }
+        struct DisplayModeTable table;
+        DisplayModeTableBuild(&table, &list);
+        uint64_t *bitmap = malloc(DisplayModeFilterWords(count) * sizeof(*bitmap));
+
+        size_t checksum = 0;
+        double start = NowNs();
+        for (int q = 0; q < kQueries; ++q) {
+            checksum += FilterObjects(objects, count, &filter, bitmap);
+        }
+        const double per_object = (NowNs() - start) / kQueries / count;
+
+        double per_kernel[2] = {-1.0, -1.0};
+        for (int k = 0; k < 2; ++k) {
+            if (DisplayModeFilterSelectWith((enum FilterKernel)k, &filter,
+                                            &table, bitmap)) {
+                continue;
+            }
+            start = NowNs();
+            for (int q = 0; q < kQueries; ++q) {
+                DisplayModeFilterSelectWith((enum FilterKernel)k, &filter,
+                                            &table, bitmap);
+                checksum += bitmap[0] & 1;
+            }
+            per_kernel[k] = (NowNs() - start) / kQueries / count;
+        }
+        printf("%-8zu %14.2f %14.2f %14.2f\n", count, per_object, per_kernel[0],
+               per_kernel[1]);
+        if (checksum == 42) {
+            fprintf(stderr, "\n");
+        }
+        free(bitmap);
+        DisplayModeTableFree(&table);
+        for (size_t j = 0; j < count; ++j) {
+            free(objects[j]);
+        }
+        free(objects);
+        FakeBackendFree(&fake);
+    }
+    return EXIT_SUCCESS;
+}
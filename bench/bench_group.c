@@ -0,0 +1,144 @@
+// Grouping of heavily duplicated catalogs (displaymode_group.h): ns per mode
+// to group 1k to 1M modes that fall into 24 resolutions and 8 refresh rates,
+// against sorting them by (resolution, rate) with qsort, and the bytes of
+// "d" against "d --grouped" for 10k modes.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "../displaymode_catalog.h"
+#include "../displaymode_commands.h"
+#include "../displaymode_group.h"
+#include "../displaymode_parse.h"
+#include "../displaymode_table.h"
+#include "../logging.h"
+#include "../tests/bench_util.h"
+#include "../tests/fake_backend.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum {
+    kResolutions = 24,
+    kRates = 8,
+    kListingModes = 10000,
+};
+
+static volatile size_t sink;
+
+// "count" modes in shuffled order, each a duplicate of one of
+// kResolutions * kRates distinct (resolution, rate) pairs.
+static struct DisplayMode *DuplicatedModes(size_t count) {
+    static const double kRefreshRates[kRates] = {
+        24.0, 30.0, 50.0, 59.94, 60.0, 75.0, 120.0, 144.0,
+    };
+    struct DisplayMode *modes = malloc(count * sizeof(*modes));
+    srand(1);
+    for (size_t i = 0; i < count; ++i) {
+        const size_t size_index = (size_t)rand() % kResolutions;
+        modes[i].width = 1024 + 128 * size_index;
+        modes[i].height = 576 + 72 * size_index;
+        modes[i].refresh_rate = kRefreshRates[rand() % kRates];
+        modes[i].usable_for_desktop = rand() % 4 != 0;
+        modes[i].mode_id = (int)i;
+        modes[i].handle = NULL;
+    }
+    return modes;
+}
+
+static int CompareRows(const void *a, const void *b) {
+    const uint64_t x = *(const uint64_t *)a;
+    const uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Groups "table" by sorting (resolution, rate) keys, as an O(n log n)
+// reference; returns the number of resolutions.
+static size_t GroupBySorting(const struct DisplayModeTable *table,
+                             uint64_t *keys) {
+    for (size_t i = 0; i < table->count; ++i) {
+        keys[i] = (uint64_t)table->resolution[i] << 32 | table->refresh_mhz[i];
+    }
+    qsort(keys, table->count, sizeof(*keys), CompareRows);
+    size_t groups = table->count > 0;
+    for (size_t i = 1; i < table->count; ++i) {
+        groups += keys[i] >> 32 != keys[i - 1] >> 32;
+    }
+    return groups;
+}
+
+static void MeasureGrouping(size_t count) {
+    struct DisplayMode *modes = DuplicatedModes(count);
+    struct DisplayModeList list;
+    memset(&list, 0, sizeof(list));
+    list.modes = modes;
+    list.count = count;
+    list.current_index = -1;
+    struct DisplayModeTable table;
+    DisplayModeTableBuild(&table, &list);
+    uint64_t *keys = malloc(count * sizeof(*keys));
+    const int runs = count >= 1000000 ? 5 : (int)(20000000 / count);
+
+    struct Arena arena;
+    ArenaInit(&arena);
+    double start = NowNs();
+    size_t groups = 0;
+    for (int i = 0; i < runs; ++i) {
+        struct DisplayModeGroups built;
+        DisplayModeGroupsBuild(&built, &table, NULL, &arena);
+        groups = built.count;
+        sink += built.num_rates;
+        ArenaReset(&arena);
+    }
+    const double hash_ns = (NowNs() - start) / runs / (double)count;
+    ArenaFree(&arena);
+
+    start = NowNs();
+    for (int i = 0; i < runs; ++i) {
+        sink += GroupBySorting(&table, keys);
+    }
+    const double sort_ns = (NowNs() - start) / runs / (double)count;
+    printf("%10zu %8zu %12.2f %12.2f\n", count, groups, hash_ns, sort_ns);
+
+    free(keys);
+    DisplayModeTableFree(&table);
+    free(modes);
+}
+
+// Prints the bytes and ns of "d" with "flags" over "catalog".
+static void MeasureListing(const char *name, struct DisplayCatalog *catalog,
+                           const char *flag, const char *format_flag) {
+    const char *argv[] = {"displaymode", "d", flag, format_flag, NULL};
+    const int argc = 2 + (flag != NULL) + (flag != NULL && format_flag != NULL);
+    const struct ParsedArgs parsed_args = ParseArgs(argc, argv);
+    size_t bytes = 0;
+    const double ns = BenchMeasureCommand(catalog, &parsed_args, 50, &bytes);
+    printf("%-20s %10zu %10.1f\n", name, bytes, ns / kListingModes);
+}
+
+int main(void) {
+    setLogLevel(LOG_LEVEL_ERROR);
+    printf("%10s %8s %12s %12s\n", "modes", "groups", "hash ns/mode",
+           "qsort ns/mode");
+    for (size_t count = 1000; count <= 1000000; count *= 10) {
+        MeasureGrouping(count);
+    }
+
+    struct FakeBackend fake;
+    FakeBackendInit(&fake);
+    struct DisplayMode *modes = DuplicatedModes(kListingModes);
+    FakeBackendAddDisplay(&fake, 1, modes, kListingModes, 0);
+    free(modes);
+    struct DisplayCatalog catalog;
+    BenchLoadCatalog(&catalog, &fake);
+
+    printf("\n%-20s %10s %10s\n", "d, 10000", "bytes", "ns/mode");
+    MeasureListing("text", &catalog, NULL, NULL);
+    MeasureListing("--grouped", &catalog, "--grouped", NULL);
+    MeasureListing("--ndjson", &catalog, "--ndjson", NULL);
+    MeasureListing("--grouped --ndjson", &catalog, "--grouped", "--ndjson");
+
+    DisplayCatalogFree(&catalog);
+    FakeBackendFree(&fake);
+    return EXIT_SUCCESS;
+}
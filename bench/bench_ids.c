@@ -0,0 +1,107 @@
+// Resolving displays by name (displaymode_ids.h): ns and identity reads per
+// lookup among 1 to 1024 displays, with the name in the display map, with
+// an empty map (the first use of a name), and by identity without a map,
+// which reads identities until it finds the display.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "../displaymode_catalog.h"
+#include "../displaymode_ids.h"
+#include "../logging.h"
+#include "../tests/bench_util.h"
+#include "../tests/fake_backend.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+static volatile uint32_t sink;
+
+static void Measure(uint32_t num_displays, const char *path) {
+    struct FakeBackend fake;
+    BenchInitFake(&fake, num_displays, 4);
+    struct DisplayCatalog catalog;
+    DisplayCatalogInit(&catalog, &fake.backend);
+    DisplayCatalogLoadDisplays(&catalog);
+
+    // Name every display, so the lookups below hit.
+    struct DisplayIdMap map;
+    unlink(path);
+    DisplayIdMapOpen(&map, path);
+    char (*names)[kDisplayIdMapMaxName] = malloc(num_displays * sizeof(*names));
+    char (*identities)[kDisplayIdentityMaxText] =
+        malloc(num_displays * sizeof(*identities));
+    for (uint32_t i = 0; i < num_displays; ++i) {
+        struct DisplayIdentity identity;
+        fake.backend.get_display_identity(&fake, catalog.displays[i], &identity);
+        snprintf(names[i], sizeof(names[i]), "display-%u", i);
+        DisplayIdentityFormat(&identity, identities[i], sizeof(identities[i]));
+        DisplayIdMapPut(&map, names[i], &identity, catalog.displays[i], i,
+                        kDisplayIdMapNamed);
+    }
+    DisplayIdMapFlush(&map);
+    DisplayIdMapClose(&map);
+    const int runs = (int)(2000000 / num_displays) + 100;
+
+    DisplayIdMapOpen(&map, path);
+    catalog.ids = &map;
+    fake.get_display_identity_calls = 0;
+    double start = NowNs();
+    for (int i = 0; i < runs; ++i) {
+        uint32_t index = 0;
+        DisplayCatalogFindDisplay(&catalog, names[(uint32_t)i * 7919 % num_displays], &index);
+        sink += index;
+    }
+    const double hit_ns = (NowNs() - start) / runs;
+    const double hit_reads = (double)fake.get_display_identity_calls / runs;
+    DisplayIdMapClose(&map);
+
+    // A first use reads every identity into the (unsaved) map.
+    const int cold_runs = runs / 16 + 10;
+    fake.get_display_identity_calls = 0;
+    start = NowNs();
+    for (int i = 0; i < cold_runs; ++i) {
+        DisplayIdMapOpen(&map, "/nonexistent/displaymode.displays");
+        catalog.ids = &map;
+        uint32_t index = 0;
+        DisplayCatalogFindDisplay(&catalog, identities[(uint32_t)i * 7919 % num_displays], &index);
+        sink += index;
+        DisplayIdMapClose(&map);
+    }
+    const double cold_ns = (NowNs() - start) / cold_runs;
+    const double cold_reads =
+        (double)fake.get_display_identity_calls / cold_runs;
+
+    catalog.ids = NULL;
+    fake.get_display_identity_calls = 0;
+    start = NowNs();
+    for (int i = 0; i < cold_runs; ++i) {
+        uint32_t index = 0;
+        DisplayCatalogFindDisplay(&catalog, identities[(uint32_t)i * 7919 % num_displays], &index);
+        sink += index;
+    }
+    const double scan_ns = (NowNs() - start) / cold_runs;
+    const double scan_reads =
+        (double)fake.get_display_identity_calls / cold_runs;
+
+    printf("%8u %10.0f %6.1f %10.0f %6.1f %10.0f %6.1f\n", num_displays,
+           hit_ns, hit_reads, cold_ns, cold_reads, scan_ns, scan_reads);
+    free(names);
+    free(identities);
+    DisplayCatalogFree(&catalog);
+    FakeBackendFree(&fake);
+}
+
+int main(void) {
+    setLogLevel(LOG_LEVEL_ERROR);
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/displaymode-bench-%ld.displays",
+             (long)getpid());
+    printf("%8s %10s %6s %10s %6s %10s %6s\n", "displays", "map ns", "reads",
+           "empty ns", "reads", "scan ns", "reads");
+    for (uint32_t count = 1; count <= 1024; count *= 4) {
+        Measure(count, path);
+    }
+    unlink(path);
+    return EXIT_SUCCESS;
+}
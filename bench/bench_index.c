@@ -0,0 +1,82 @@
+// Mode lookup for "t": a linear scan of the mode list compared with the
+// resolution index, which is built once per enumeration and reused by
+// later lookups (in server and batch mode).
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "../displaymode_index.h"
+#include "../displaymode_parse.h"
+#include "../tests/bench_util.h"
+#include "../tests/fake_backend.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+enum {
+    kLookups = 20000,
+};
+
+static ptrdiff_t LinearFind(const struct DisplayMode *modes, size_t count,
+                            size_t width, size_t height, double refresh_rate) {
+    for (size_t i = 0; i < count; ++i) {
+        if (modes[i].width == width && modes[i].height == height &&
+            MatchesRefreshRate(refresh_rate, modes[i].refresh_rate)) {
+            return (ptrdiff_t)i;
+        }
+    }
+    return -1;
+}
+
+int main(void) {
+    static const size_t kCatalogSizes[] = {10, 100, 1000, 10000, 100000};
+
+    printf("%-8s %14s %14s %14s\n", "modes", "linear ns", "indexed ns",
+           "build us");
+    for (size_t i = 0; i < sizeof(kCatalogSizes) / sizeof(kCatalogSizes[0]); ++i) {
+        struct FakeBackend fake;
+        BenchInitFake(&fake, 1, kCatalogSizes[i]);
+        const struct DisplayMode *modes = fake.displays[0].modes;
+        const size_t count = fake.displays[0].count;
+
+        // Query existing modes spread over the list, half of them with a
+        // refresh rate that doesn't match, so misses are measured too.
+        size_t *queries = malloc(kLookups * sizeof(*queries));
+        srand(1);
+        for (int j = 0; j < kLookups; ++j) {
+            queries[j] = (size_t)rand() % count;
+        }
+
+        // The linear scan is slow on large lists; sample fewer lookups.
+        const int linear_lookups = count >= 10000 ? kLookups / 100 : kLookups;
+        ptrdiff_t checksum = 0;
+        double start = NowNs();
+        for (int j = 0; j < linear_lookups; ++j) {
+            const struct DisplayMode *mode = &modes[queries[j]];
+            checksum += LinearFind(modes, count, mode->width, mode->height,
+                                   j % 2 ? mode->refresh_rate : 1.0);
+        }
+        const double linear = (NowNs() - start) / linear_lookups;
+
+        struct DisplayModeIndex index;
+        start = NowNs();
+        DisplayModeIndexBuild(&index, modes, count);
+        const double build = (NowNs() - start) / 1e3;
+
+        start = NowNs();
+        for (int j = 0; j < kLookups; ++j) {
+            const struct DisplayMode *mode = &modes[queries[j]];
+            checksum += DisplayModeIndexFind(&index, mode->width, mode->height,
+                                             j % 2 ? mode->refresh_rate : 1.0);
+        }
+        const double indexed = (NowNs() - start) / kLookups;
+
+        printf("%-8zu %14.1f %14.1f %14.1f\n", count, linear, indexed, build);
+        if (checksum == 42) {
+            fprintf(stderr, "\n");
+        }
+        DisplayModeIndexFree(&index);
+        free(queries);
+        FakeBackendFree(&fake);
+    }
+    return EXIT_SUCCESS;
+}
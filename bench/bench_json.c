@@ -0,0 +1,125 @@
+// JSON output of large catalogs: the old per-mode json-c DOM (when json-c
+// is installed) and snprintf formatting compared with the streaming writer.
+// The first three columns write the same three fields per mode; the last
+// is the full --json document with every DisplayModeInfo field.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "../displaymode_catalog.h"
+#include "../displaymode_commands.h"
+#include "../displaymode_json.h"
+#include "../displaymode_parse.h"
+#include "../logging.h"
+#include "../tests/bench_util.h"
+#include "../tests/fake_backend.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(__has_include)
+#if __has_include(<json-c/json.h>)
+#include <json-c/json.h>
+#define HAVE_JSON_C 1
+#endif
+#endif
+
+#ifdef HAVE_JSON_C
+// What PrintMode did before: one DOM per mode.
+static void WriteJsonC(const struct DisplayMode *modes, size_t count, FILE *out) {
+    for (size_t i = 0; i < count; ++i) {
+        struct json_object *object = json_object_new_object();
+        json_object_object_add(object, "width", json_object_new_int((int)modes[i].width));
+        json_object_object_add(object, "height", json_object_new_int((int)modes[i].height));
+        json_object_object_add(object, "refreshRate",
+                               json_object_new_double(modes[i].refresh_rate));
+        fputs(json_object_to_json_string(object), out);
+        fputc('\n', out);
+        json_object_put(object);
+    }
+}
+#endif
+
+static void WriteSnprintf(const struct DisplayMode *modes, size_t count, FILE *out) {
+    for (size_t i = 0; i < count; ++i) {
+        char line[128];
+        snprintf(line, sizeof(line),
+                 "{ \"width\": %zu, \"height\": %zu, \"refreshRate\": %.17g }\n",
+                 modes[i].width, modes[i].height, modes[i].refresh_rate);
+        fputs(line, out);
+    }
+}
+
+static void WriteStreaming(const struct DisplayMode *modes, size_t count, FILE *out) {
+    struct JsonWriter json;
+    JsonWriterInit(&json, out);
+    for (size_t i = 0; i < count; ++i) {
+        JsonWriterBeginObject(&json);
+        JsonWriterKey(&json, "width");
+        JsonWriterUint(&json, modes[i].width);
+        JsonWriterKey(&json, "height");
+        JsonWriterUint(&json, modes[i].height);
+        JsonWriterKey(&json, "refreshRate");
+        JsonWriterDouble(&json, modes[i].refresh_rate);
+        JsonWriterEndObject(&json);
+        JsonWriterEndLine(&json);
+    }
+    JsonWriterFlush(&json);
+}
+
+// Returns the mean nanoseconds per mode of "write" over a few runs.
+static double Measure(void (*write)(const struct DisplayMode *, size_t, FILE *),
+                      const struct DisplayMode *modes, size_t count, FILE *out) {
+    const int runs = count >= 100000 ? 3 : 20;
+    const double start = NowNs();
+    for (int i = 0; i < runs; ++i) {
+        write(modes, count, out);
+    }
+    return (NowNs() - start) / runs / (double)count;
+}
+
+int main(void) {
+    setLogLevel(LOG_LEVEL_ERROR);
+    FILE *out = fopen("/dev/null", "w");
+    static const size_t kCatalogSizes[] = {1000, 10000, 100000};
+    const char *argv[] = {"displaymode", "d", "--json", NULL};
+    const struct ParsedArgs parsed_args = ParseArgs(3, argv);
+
+    printf("%-8s %14s %14s %14s %14s\n", "modes", "json-c ns", "snprintf ns",
+           "writer ns", "--json ns");
+    for (size_t i = 0; i < sizeof(kCatalogSizes) / sizeof(kCatalogSizes[0]); ++i) {
+        struct FakeBackend fake;
+        BenchInitFake(&fake, 1, kCatalogSizes[i]);
+        const struct DisplayMode *modes = fake.displays[0].modes;
+        const size_t count = fake.displays[0].count;
+
+#ifdef HAVE_JSON_C
+        const double json_c = Measure(WriteJsonC, modes, count, out);
+#else
+        const double json_c = -1.0;
+#endif
+        const double formatted = Measure(WriteSnprintf, modes, count, out);
+        const double streaming = Measure(WriteStreaming, modes, count, out);
+
+        // The whole document, from an already enumerated catalog.
+        struct DisplayCatalog catalog;
+        BenchLoadCatalog(&catalog, &fake);
+        const int runs = count >= 100000 ? 3 : 20;
+        const double start = NowNs();
+        for (int j = 0; j < runs; ++j) {
+            RunCommand(&catalog, &parsed_args, out, stderr);
+        }
+        const double document = (NowNs() - start) / runs / (double)count;
+        DisplayCatalogFree(&catalog);
+
+        if (json_c < 0) {
+            printf("%-8zu %14s %14.1f %14.1f %14.1f\n", count, "n/a", formatted,
+                   streaming, document);
+        } else {
+            printf("%-8zu %14.1f %14.1f %14.1f %14.1f\n", count, json_c,
+                   formatted, streaming, document);
+        }
+        FakeBackendFree(&fake);
+    }
+    fclose(out);
+    return EXIT_SUCCESS;
+}
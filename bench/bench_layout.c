@@ -0,0 +1,110 @@
+// Applying layouts (displaymode_layout.h): ns per invocation to set 1 to 16
+// displays of 2000 modes each, as separate processes would (a new catalog
+// each time), with "t", with "l" and a compiled plan, and with "l" compiling
+// the layout every time.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "../displaymode_catalog.h"
+#include "../displaymode_commands.h"
+#include "../displaymode_layout.h"
+#include "../displaymode_parse.h"
+#include "../logging.h"
+#include "../tests/bench_util.h"
+#include "../tests/fake_backend.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+enum {
+    kModesPerDisplay = 2000,
+    kRuns = 2000,
+};
+
+// Runs "argv" against a new catalog "kRuns" times, with the layouts at
+// "config_path" and "plan_path", and returns the ns per run.
+static double Measure(struct FakeBackend *fake, int argc, const char **argv,
+                      const char *config_path, const char *plan_path,
+                      FILE *out) {
+    const double start = NowNs();
+    for (int i = 0; i < kRuns; ++i) {
+        struct DisplayCatalog catalog;
+        DisplayCatalogInit(&catalog, &fake->backend);
+        struct DisplayLayouts layouts;
+        DisplayLayoutsOpen(&layouts, config_path, plan_path);
+        catalog.layouts = &layouts;
+        const struct ParsedArgs parsed_args = ParseArgs(argc, argv);
+        if (RunCommand(&catalog, &parsed_args, out, stderr) != EXIT_SUCCESS) {
+            fprintf(stderr, "%s %s failed\n", argv[1], argv[2]);
+            exit(EXIT_FAILURE);
+        }
+        DisplayLayoutsClose(&layouts);
+        DisplayCatalogFree(&catalog);
+    }
+    return (NowNs() - start) / kRuns;
+}
+
+int main(void) {
+    setLogLevel(LOG_LEVEL_ERROR);
+    char config_path[64];
+    char plan_path[64];
+    snprintf(config_path, sizeof(config_path),
+             "/tmp/displaymode-bench-%ld.layouts", (long)getpid());
+    snprintf(plan_path, sizeof(plan_path), "/tmp/displaymode-bench-%ld.plans",
+             (long)getpid());
+    FILE *out = fopen("/dev/null", "w");
+    printf("%8s %12s %12s %12s\n", "displays", "t ns", "l plan ns",
+           "l compile ns");
+    for (uint32_t num_displays = 1; num_displays <= 16; num_displays *= 4) {
+        struct FakeBackend fake;
+        FakeBackendInit(&fake);
+        // Every display is set to its last mode.
+        static char words[kMaxModeSpecs][4][16];
+        const char *argv[2 + 4 * kMaxModeSpecs + 1] = {"displaymode", "t"};
+        int argc = 2;
+        FILE *config = fopen(config_path, "w");
+        fputs("desk:", config);
+        for (uint32_t i = 0; i < num_displays; ++i) {
+            FakeBackendAddSyntheticDisplay(&fake, i + 1, kModesPerDisplay);
+            const struct DisplayMode *last =
+                &fake.displays[i].modes[kModesPerDisplay - 1];
+            snprintf(words[i][0], sizeof(words[i][0]), "%zu", last->width);
+            snprintf(words[i][1], sizeof(words[i][1]), "%zu", last->height);
+            snprintf(words[i][2], sizeof(words[i][2]), "@%g", last->refresh_rate);
+            snprintf(words[i][3], sizeof(words[i][3]), "%u", i);
+            for (int w = 0; w < 4; ++w) {
+                argv[argc++] = words[i][w];
+                fprintf(config, " %s", words[i][w]);
+            }
+        }
+        fputc('\n', config);
+        fclose(config);
+
+        const double t_ns = Measure(&fake, argc, argv, config_path, plan_path, out);
+
+        // Compile the plan once, then apply it.
+        unlink(plan_path);
+        const char *apply[] = {"displaymode", "l", "desk", NULL};
+        struct DisplayCatalog catalog;
+        DisplayCatalogInit(&catalog, &fake.backend);
+        struct DisplayLayouts layouts;
+        DisplayLayoutsOpen(&layouts, config_path, plan_path);
+        DisplayLayoutsCompile(&layouts, &catalog, NULL, out, stderr);
+        DisplayLayoutsFlush(&layouts);
+        DisplayLayoutsClose(&layouts);
+        DisplayCatalogFree(&catalog);
+        const double plan_ns =
+            Measure(&fake, 3, apply, config_path, plan_path, out);
+        const double compile_ns = Measure(&fake, 3, apply, config_path,
+                                          "/nonexistent/displaymode.plans", out);
+        printf("%8u %12.0f %12.0f %12.0f\n", num_displays, t_ns, plan_ns,
+               compile_ns);
+        FakeBackendFree(&fake);
+    }
+    fclose(out);
+    unlink(config_path);
+    unlink(plan_path);
+    return EXIT_SUCCESS;
+}
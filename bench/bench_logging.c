@@ -0,0 +1,98 @@
+// Messages per second through logMessage: the previous implementation
+// (time, localtime and strftime plus three fprintf calls per message)
+// compared with the queued logger, from one and several threads.  stderr
+// goes to /dev/null.  "queued" is the rate callers see; "written" includes
+// waiting for the flusher to write everything.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "../logging.h"
+#include "../tests/bench_util.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+enum {
+    kMessages = 200000,
+};
+
+// logMessage as it was.
+static void LegacyLogMessage(LogLevel level, const char *format, ...) {
+    const char *levelStr;
+    switch (level) {
+        case LOG_LEVEL_DEBUG: levelStr = "DEBUG"; break;
+        case LOG_LEVEL_INFO:  levelStr = "INFO";  break;
+        case LOG_LEVEL_WARN:  levelStr = "WARN";  break;
+        case LOG_LEVEL_ERROR: levelStr = "ERROR"; break;
+        default:              levelStr = "UNKNOWN"; break;
+    }
+    time_t now = time(NULL);
+    char timeStr[20];
+    strftime(timeStr, sizeof(timeStr), "%Y-%m-%d %H:%M:%S", localtime(&now));
+    fprintf(stderr, "%s [%s] ", timeStr, levelStr);
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    fprintf(stderr, "\n");
+}
+
+struct Run {
+    int legacy;
+    int messages;
+};
+
+static void *Produce(void *arg) {
+    const struct Run *run = arg;
+    for (int i = 0; i < run->messages; ++i) {
+        if (run->legacy) {
+            LegacyLogMessage(LOG_LEVEL_INFO, "JSON Output: { \"width\": %d, \"height\": %d }",
+                             i, i / 2);
+        } else {
+            logMessage(LOG_LEVEL_INFO, "JSON Output: { \"width\": %d, \"height\": %d }",
+                       i, i / 2);
+        }
+    }
+    return NULL;
+}
+
+// Logs kMessages messages from "threads" threads; prints messages/second.
+static void Measure(const char *name, int legacy, int threads) {
+    struct Run run = {legacy, kMessages / threads};
+    pthread_t ids[16];
+    const double start = NowNs();
+    for (int i = 0; i < threads; ++i) {
+        pthread_create(&ids[i], NULL, Produce, &run);
+    }
+    for (int i = 0; i < threads; ++i) {
+        pthread_join(ids[i], NULL);
+    }
+    const double queued = NowNs() - start;
+    logFlush();
+    const double written = NowNs() - start;
+    const double total = (double)run.messages * threads;
+    printf("%-24s %8d %14.0f %14.0f\n", name, threads, total / queued * 1e9,
+           total / written * 1e9);
+}
+
+int main(void) {
+    const int null_fd = open("/dev/null", O_WRONLY);
+    dup2(null_fd, STDERR_FILENO);
+    close(null_fd);
+    setLogLevel(LOG_LEVEL_INFO);
+
+    printf("%-24s %8s %14s %14s\n", "logger", "threads", "queued msg/s",
+           "written msg/s");
+    Measure("previous", 1, 1);
+    Measure("previous", 1, 4);
+    Measure("queued", 0, 1);
+    Measure("queued", 0, 4);
+    setLogLevel(LOG_LEVEL_WARN);
+    Measure("queued, level disabled", 0, 1);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,119 @@
+// Write system calls and wall time of the "d" listing for a 10k-mode
+// catalog: the old per-mode stdio path (line-buffered, as on a terminal,
+// and fully buffered) compared with the single-buffer listing, with and
+// without the per-mode log lines.  Output and log go to /dev/null.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "../displaymode_catalog.h"
+#include "../displaymode_commands.h"
+#include "../displaymode_format.h"
+#include "../logging.h"
+#include "../tests/bench_util.h"
+#include "../tests/fake_backend.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum {
+    kModes = 10000,
+    kRuns = 10,
+};
+
+static long WriteSyscalls(void) {
+    FILE *io = fopen("/proc/self/io", "r");
+    if (io == NULL) {
+        return -1;
+    }
+    char line[128];
+    long count = -1;
+    while (fgets(line, sizeof(line), io) != NULL) {
+        if (sscanf(line, "syscw: %ld", &count) == 1) {
+            break;
+        }
+    }
+    fclose(io);
+    return count;
+}
+
+// The listing as it was written before: a printf per display, a formatted
+// line, a suffix and a log message per mode.
+static void PrintModesLegacy(struct DisplayCatalog *catalog, FILE *out) {
+    for (uint32_t i = 0; i < catalog->num_displays; ++i) {
+        fprintf(out, "%sDisplay %u%s:\n", i == 0 ? "" : "\n", i,
+                i == 0 ? " (MAIN)" : "");
+        const struct DisplayModeList *list = NULL;
+        DisplayCatalogGetModes(catalog, i, &list);
+        for (size_t j = 0; j < list->count; ++j) {
+            const struct DisplayMode *mode = &list->modes[j];
+            struct DisplayModeInfo info = {0};
+            info.width = mode->width;
+            info.height = mode->height;
+            info.refresh_rate = mode->refresh_rate;
+            info.usable_for_desktop = mode->usable_for_desktop;
+            info.mode_id = mode->mode_id;
+            snprintf(info.pixelEncodingStr, sizeof(info.pixelEncodingStr), "Unknown");
+            snprintf(info.displayName, sizeof(info.displayName), "Display");
+            strcpy(info.resCategory, "Standard");
+            char line[256];
+            FormatDisplayModeInfo(&info, line, sizeof(line));
+            fputs(line, out);
+            fputs((ptrdiff_t)j == list->current_index ? " *\n" : "\n", out);
+            logMessage(LOG_LEVEL_INFO,
+                       "JSON Output: { \"width\": %zu, \"height\": %zu, \"refreshRate\": %.17g }",
+                       info.width, info.height, info.refresh_rate);
+        }
+    }
+}
+
+// Runs one listing variant "kRuns" times and prints its cost per run.
+static void Measure(const char *name, struct DisplayCatalog *catalog,
+                    int legacy, int buffering, LogLevel level) {
+    FILE *out = fopen("/dev/null", "w");
+    setvbuf(out, NULL, buffering, BUFSIZ);
+    setLogLevel(level);
+    const long writes_before = WriteSyscalls();
+    const double start = NowNs();
+    for (int i = 0; i < kRuns; ++i) {
+        if (legacy) {
+            PrintModesLegacy(catalog, out);
+        } else {
+            PrintModesForAllDisplays(catalog, out, stderr);
+        }
+        fflush(out);
+    }
+    const double elapsed = (NowNs() - start) / kRuns / 1e6;
+    const long writes_after = WriteSyscalls();
+    fclose(out);
+    if (writes_before >= 0) {
+        printf("%-34s %10.2f %10ld\n", name, elapsed,
+               (writes_after - writes_before) / kRuns);
+    } else {
+        printf("%-34s %10.2f %10s\n", name, elapsed, "n/a");
+    }
+}
+
+int main(void) {
+    // Log lines go to stderr; keep them off the terminal, but unbuffered as
+    // stderr normally is.
+    if (freopen("/dev/null", "w", stderr) == NULL) {
+        return EXIT_FAILURE;
+    }
+    setvbuf(stderr, NULL, _IONBF, 0);
+    struct FakeBackend fake;
+    BenchInitFake(&fake, 1, kModes);
+    struct DisplayCatalog catalog;
+    BenchLoadCatalog(&catalog, &fake);
+
+    printf("%-34s %10s %10s\n", "d, 10000 modes", "ms/run", "writes/run");
+    Measure("old, line-buffered, logging", &catalog, 1, _IOLBF, LOG_LEVEL_INFO);
+    Measure("old, fully buffered, logging", &catalog, 1, _IOFBF, LOG_LEVEL_INFO);
+    Measure("old, fully buffered, quiet", &catalog, 1, _IOFBF, LOG_LEVEL_ERROR);
+    Measure("buffered listing, logging", &catalog, 0, _IOLBF, LOG_LEVEL_INFO);
+    Measure("buffered listing, quiet", &catalog, 0, _IOLBF, LOG_LEVEL_ERROR);
+
+    DisplayCatalogFree(&catalog);
+    FakeBackendFree(&fake);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,145 @@
+// Cost per mode of classifying modes for "d" (aspect ratio and category):
+// the GCD and size checks every mode used to go through, the perfect hash
+// lookup of displaymode_resolutions.h, and building the whole table.  Also
+// the cost of looking up a resolution's name for "t", against a linear scan
+// of the names.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "../displaymode_resolutions.h"
+#include "../displaymode_table.h"
+#include "../tests/bench_util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+enum {
+    kRounds = 2000,
+    kLookups = 10000000,
+};
+
+// Sizes a display might list, standard or not, each at several rates.
+static const uint16_t kSizes[][2] = {
+    {640, 480}, {800, 600}, {1024, 768}, {1280, 720}, {1280, 800},
+    {1280, 1024}, {1366, 768}, {1440, 900}, {1600, 900}, {1680, 1050},
+    {1920, 1080}, {1920, 1200}, {2048, 1152}, {2560, 1080}, {2560, 1440},
+    {2560, 1600}, {3008, 1692}, {3440, 1440}, {3840, 1600}, {3840, 2160},
+    {4096, 2160}, {5120, 2160}, {5120, 2880}, {6016, 3384},
+};
+static const double kRates[] = {144.0, 120.0, 60.0, 59.94, 50.0, 30.0};
+
+#define kNumSizes (sizeof(kSizes) / sizeof(kSizes[0]))
+#define kNumRates (sizeof(kRates) / sizeof(kRates[0]))
+
+// What SetRow did for every mode before the table of standard resolutions.
+static uint32_t ClassifyGcd(const struct DisplayMode *mode, uint8_t *category) {
+    int a = (int)mode->width, b = (int)mode->height;
+    while (b != 0) {
+        const int t = b;
+        b = a % b;
+        a = t;
+    }
+    const uint32_t aspect_w = a ? (uint32_t)((int)mode->width / a) : 0;
+    const uint32_t aspect_h = a ? (uint32_t)((int)mode->height / a) : 0;
+    *category = mode->width < 1024 || mode->height < 768 ? 3 : 2;
+    return aspect_w << 16 | aspect_h;
+}
+
+static uint32_t ClassifyHash(const struct DisplayMode *mode, uint8_t *category) {
+    const struct StandardResolution *standard =
+        StandardResolutionFind(mode->width, mode->height);
+    if (standard != NULL) {
+        *category = (uint8_t)(4 + (standard - kStandardResolutions));
+        return (uint32_t)standard->aspect_w << 16 | standard->aspect_h;
+    }
+    return ClassifyGcd(mode, category);
+}
+
+static const struct StandardResolution *LookupLinear(const char *name,
+                                                     size_t length) {
+    for (size_t i = 0; i < kNumResolutionNames; ++i) {
+        if (kResolutionNames[i].length == length &&
+            strncasecmp(kResolutionNames[i].name, name, length) == 0) {
+            return &kStandardResolutions[kResolutionNames[i].resolution];
+        }
+    }
+    return NULL;
+}
+
+int main(void) {
+    struct DisplayMode modes[kNumSizes * kNumRates];
+    size_t count = 0;
+    for (size_t s = 0; s < kNumSizes; ++s) {
+        for (size_t r = 0; r < kNumRates; ++r) {
+            modes[count] = (struct DisplayMode){
+                kSizes[s][0], kSizes[s][1], kRates[r], 1, (int32_t)count, NULL,
+            };
+            ++count;
+        }
+    }
+    size_t standard = 0;
+    for (size_t i = 0; i < count; ++i) {
+        standard += StandardResolutionFind(modes[i].width, modes[i].height) !=
+                    NULL;
+    }
+    printf("%zu modes, %zu of standard resolutions\n\n", count, standard);
+    printf("%-28s %10s\n", "classification", "ns/mode");
+
+    uint32_t sink = 0;
+    uint8_t category = 0;
+    double start = NowNs();
+    for (size_t round = 0; round < kRounds; ++round) {
+        for (size_t i = 0; i < count; ++i) {
+            sink += ClassifyGcd(&modes[i], &category) + category;
+        }
+    }
+    printf("%-28s %10.2f\n", "GCD + size checks",
+           (NowNs() - start) / ((double)kRounds * count));
+
+    start = NowNs();
+    for (size_t round = 0; round < kRounds; ++round) {
+        for (size_t i = 0; i < count; ++i) {
+            sink += ClassifyHash(&modes[i], &category) + category;
+        }
+    }
+    printf("%-28s %10.2f\n", "perfect hash, GCD on a miss",
+           (NowNs() - start) / ((double)kRounds * count));
+
+    struct DisplayModeList list;
+    memset(&list, 0, sizeof(list));
+    list.modes = modes;
+    list.count = count;
+    list.current_index = -1;
+    start = NowNs();
+    for (size_t round = 0; round < kRounds; ++round) {
+        struct DisplayModeTable table;
+        DisplayModeTableBuild(&table, &list);
+        sink += table.category[round % count];
+        DisplayModeTableFree(&table);
+    }
+    printf("%-28s %10.2f\n", "DisplayModeTableBuild",
+           (NowNs() - start) / ((double)kRounds * count));
+
+    printf("\n%-28s %10s\n", "name lookup", "ns/lookup");
+    start = NowNs();
+    for (size_t i = 0, n = 0; i < kLookups; ++i) {
+        const struct ResolutionName *name = &kResolutionNames[n];
+        n = n + 1 == kNumResolutionNames ? 0 : n + 1;
+        sink += StandardResolutionLookup(name->name, name->length)->width;
+    }
+    printf("%-28s %10.2f\n", "perfect hash",
+           (NowNs() - start) / kLookups);
+    start = NowNs();
+    for (size_t i = 0, n = 0; i < kLookups; ++i) {
+        const struct ResolutionName *name = &kResolutionNames[n];
+        n = n + 1 == kNumResolutionNames ? 0 : n + 1;
+        sink += LookupLinear(name->name, name->length)->width;
+    }
+    printf("%-28s %10.2f\n", "linear scan",
+           (NowNs() - start) / kLookups);
+
+    printf("(checksum %u)\n", sink);
+    return 0;
+}
@@ -0,0 +1,96 @@
+// Cost of enumerating, listing and looking up modes as the number of
+// displays grows to video-wall sizes.  Every column is per display (or per
+// lookup), so flat columns mean linear scaling.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "../displaymode_catalog.h"
+#include "../displaymode_commands.h"
+#include "../displaymode_parse.h"
+#include "../logging.h"
+#include "../tests/bench_util.h"
+#include "../tests/fake_backend.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+enum {
+    kModesPerDisplay = 24,
+    kRuns = 5,
+};
+
+static double Min(double a, double b) {
+    return a < b ? a : b;
+}
+
+int main(void) {
+    static const uint32_t kCounts[] = {16, 64, 256, 1024, 4096};
+    setLogLevel(LOG_LEVEL_ERROR);
+    FILE *null_out = fopen("/dev/null", "w");
+
+    printf("%8s %16s %16s %16s %16s\n", "displays", "enumerate ns/d",
+           "d ns/d", "cold t ns", "warm lookup ns");
+    for (size_t c = 0; c < sizeof(kCounts) / sizeof(kCounts[0]); ++c) {
+        const uint32_t n = kCounts[c];
+        struct FakeBackend fake;
+        BenchInitFake(&fake, n, kModesPerDisplay);
+        int *errors = malloc(n * sizeof(*errors));
+        char last[16];
+        snprintf(last, sizeof(last), "%u", n - 1);
+        const char *list_argv[] = {"prog", "d", NULL};
+        const char *set_argv[] = {"prog", "t", "656", "489", last, NULL};
+        const struct ParsedArgs list_args = ParseArgs(2, list_argv);
+        const struct ParsedArgs set_args = ParseArgs(5, set_argv);
+
+        double enumerate = 1e18;
+        double listing = 1e18;
+        double cold_set = 1e18;
+        for (int run = 0; run < kRuns; ++run) {
+            struct DisplayCatalog catalog;
+            DisplayCatalogInit(&catalog, &fake.backend);
+            catalog.max_threads = 1;
+            double start = NowNs();
+            DisplayCatalogLoadDisplays(&catalog);
+            DisplayCatalogLoadAllModes(&catalog, errors);
+            enumerate = Min(enumerate, NowNs() - start);
+            DisplayCatalogFree(&catalog);
+
+            DisplayCatalogInit(&catalog, &fake.backend);
+            catalog.max_threads = 1;
+            start = NowNs();
+            RunCommand(&catalog, &list_args, null_out, null_out);
+            listing = Min(listing, NowNs() - start);
+            DisplayCatalogFree(&catalog);
+
+            // A one-shot "t" on the last display: enumerates the displays
+            // but only the target's modes.
+            DisplayCatalogInit(&catalog, &fake.backend);
+            start = NowNs();
+            RunCommand(&catalog, &set_args, null_out, null_out);
+            cold_set = Min(cold_set, NowNs() - start);
+            DisplayCatalogFree(&catalog);
+        }
+
+        // Lookups on a warm catalog, as the server does them, across every
+        // display.
+        struct DisplayCatalog catalog;
+        BenchLoadCatalog(&catalog, &fake);
+        const int lookups = 1 << 20;
+        size_t sink = 0;
+        const double start = NowNs();
+        for (int i = 0; i < lookups; ++i) {
+            const uint32_t display = (uint32_t)(i * 2654435761u) % n;
+            sink += (size_t)DisplayCatalogFindMode(&catalog, display, 656, 489,
+                                                   60.0);
+        }
+        const double lookup = (NowNs() - start) / lookups;
+        DisplayCatalogFree(&catalog);
+
+        printf("%8u %16.0f %16.0f %16.0f %16.1f\n", n, enumerate / n,
+               listing / n, cold_set, lookup + (double)(sink & 0));
+        free(errors);
+        FakeBackendFree(&fake);
+    }
+    fclose(null_out);
+    return 0;
+}
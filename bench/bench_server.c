@@ -0,0 +1,124 @@
+// Latency and throughput of commands answered by a server compared with
+// running each command against a freshly enumerated catalog, as a separate
+// process would.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "../displaymode_commands.h"
+#include "../displaymode_server.h"
+#include "../logging.h"
+#include "../tests/bench_util.h"
+#include "../tests/fake_backend.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+enum {
+    kDisplays = 3,
+    kModesPerDisplay = 400,
+    kIterations = 500,
+    // Roughly what CGDisplayCopyAllDisplayModes costs per display.
+    kCopyModesDelayUs = 2000,
+};
+
+static int CompareDoubles(const void *a, const void *b) {
+    const double x = *(const double *)a;
+    const double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void Report(const char *name, double *samples, size_t n) {
+    qsort(samples, n, sizeof(samples[0]), CompareDoubles);
+    double total = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        total += samples[i];
+    }
+    printf("%-24s p50 %9.1f us  p99 %9.1f us  %9.0f cmd/s\n", name,
+           samples[n / 2] / 1e3, samples[n * 99 / 100] / 1e3,
+           (double)n / (total / 1e9));
+}
+
+static void *ServeThread(void *arg) {
+    DisplayServerRun(arg);
+    return NULL;
+}
+
+// Runs "command" against a new catalog each time.
+static void BenchCold(struct FakeBackend *fake, const char *name, int argc,
+                      const char *argv[], double *samples) {
+    FILE *sink = fopen("/dev/null", "w");
+    const struct ParsedArgs parsed_args = ParseArgs(argc, argv);
+    for (size_t i = 0; i < kIterations; ++i) {
+        const double start = NowNs();
+        struct DisplayCatalog catalog;
+        DisplayCatalogInit(&catalog, &fake->backend);
+        RunCommand(&catalog, &parsed_args, sink, sink);
+        DisplayCatalogFree(&catalog);
+        samples[i] = NowNs() - start;
+    }
+    fclose(sink);
+    Report(name, samples, kIterations);
+}
+
+// Sends "command" to the server over one connection.
+static void BenchServer(const char *socket_path, const char *name,
+                        const char *command, double *samples) {
+    struct DisplayClient client;
+    if (DisplayClientConnect(&client, socket_path)) {
+        perror("DisplayClientConnect");
+        return;
+    }
+    for (size_t i = 0; i < kIterations; ++i) {
+        struct DisplayReply reply;
+        const double start = NowNs();
+        if (DisplayClientRequest(&client, command, &reply)) {
+            perror("DisplayClientRequest");
+            break;
+        }
+        samples[i] = NowNs() - start;
+        DisplayReplyFree(&reply);
+    }
+    DisplayClientClose(&client);
+    Report(name, samples, kIterations);
+}
+
+int main(void) {
+    setLogLevel(LOG_LEVEL_ERROR);
+    struct FakeBackend fake;
+    BenchInitFake(&fake, kDisplays, kModesPerDisplay);
+    fake.copy_modes_delay_us = kCopyModesDelayUs;
+    double *samples = malloc(kIterations * sizeof(samples[0]));
+
+    printf("%d displays x %d modes, %d us per enumeration, %d iterations\n",
+           kDisplays, kModesPerDisplay, kCopyModesDelayUs, kIterations);
+    const char *list_argv[] = {"displaymode", "d", NULL};
+    const char *set_argv[] = {"displaymode", "t", "1280", "840", "@60", "2", NULL};
+    BenchCold(&fake, "cold d", 2, list_argv, samples);
+    BenchCold(&fake, "cold t", 6, set_argv, samples);
+
+    struct DisplayCatalog catalog;
+    DisplayCatalogInit(&catalog, &fake.backend);
+    char socket_path[64];
+    snprintf(socket_path, sizeof(socket_path), "/tmp/displaymode-bench-%ld.sock",
+             (long)getpid());
+    struct DisplayServer server;
+    if (DisplayServerOpen(&server, socket_path, &catalog)) {
+        perror("DisplayServerOpen");
+        return EXIT_FAILURE;
+    }
+    pthread_t thread;
+    pthread_create(&thread, NULL, ServeThread, &server);
+    BenchServer(socket_path, "server d", "d", samples);
+    BenchServer(socket_path, "server t", "t 1280 840 @60 2", samples);
+    DisplayServerStop(&server);
+    pthread_join(thread, NULL);
+    DisplayServerClose(&server);
+
+    DisplayCatalogFree(&catalog);
+    FakeBackendFree(&fake);
+    free(samples);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,175 @@
+// Throughput of readers of the shared catalog (displaymode_shm.h) with and
+// without a writer republishing it as fast as it can, against enumerating
+// the displays directly.  Each reader maps the segment itself, as separate
+// invocations would.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "../displaymode_catalog.h"
+#include "../displaymode_shm.h"
+#include "../logging.h"
+#include "../tests/bench_util.h"
+#include "../tests/fake_backend.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+enum {
+    kDisplays = 4,
+    kModesPerDisplay = 256,
+    kMaxReaders = 4,
+    kRunMillis = 300,
+};
+
+static char shm_name[64];
+
+struct Worker {
+    pthread_t thread;
+    const struct DisplayCatalog *catalog;  // the writer's
+    volatile int *stop;
+    unsigned long long reads;
+    unsigned long long fallbacks;
+    unsigned long long retries;
+    unsigned long long publishes;
+};
+
+static void *Read(void *arg) {
+    struct Worker *worker = arg;
+    struct DisplayShm shm;
+    if (DisplayShmOpen(&shm, shm_name, kDisplayShmDefaultSize)) {
+        return NULL;
+    }
+    struct DisplayShmSnapshot snapshot;
+    DisplayShmSnapshotInit(&snapshot);
+    while (!__atomic_load_n(worker->stop, __ATOMIC_RELAXED)) {
+        if (DisplayShmRead(&shm, DisplayShmNow(), kDisplayShmMaxAge,
+                           &snapshot) == kDisplayShmOk) {
+            ++worker->reads;
+        } else {
+            ++worker->fallbacks;
+        }
+        worker->retries += snapshot.retries;
+    }
+    DisplayShmSnapshotFree(&snapshot);
+    DisplayShmClose(&shm);
+    return NULL;
+}
+
+static void *Write(void *arg) {
+    struct Worker *worker = arg;
+    struct DisplayShm shm;
+    if (DisplayShmOpen(&shm, shm_name, kDisplayShmDefaultSize)) {
+        return NULL;
+    }
+    while (!__atomic_load_n(worker->stop, __ATOMIC_RELAXED)) {
+        worker->publishes += DisplayShmPublish(&shm, worker->catalog,
+                                               DisplayShmSequence(&shm),
+                                               DisplayShmNow()) == 0;
+    }
+    DisplayShmClose(&shm);
+    return NULL;
+}
+
+static void Run(const struct DisplayCatalog *catalog, int num_readers,
+                int writing) {
+    volatile int stop = 0;
+    struct Worker readers[kMaxReaders];
+    struct Worker writer;
+    memset(readers, 0, sizeof(readers));
+    memset(&writer, 0, sizeof(writer));
+    writer.catalog = catalog;
+    writer.stop = &stop;
+    if (writing) {
+        pthread_create(&writer.thread, NULL, Write, &writer);
+    }
+    for (int i = 0; i < num_readers; ++i) {
+        readers[i].stop = &stop;
+        pthread_create(&readers[i].thread, NULL, Read, &readers[i]);
+    }
+    const struct timespec run = {kRunMillis / 1000,
+                                 (kRunMillis % 1000) * 1000000L};
+    nanosleep(&run, NULL);
+    __atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+    unsigned long long reads = 0, fallbacks = 0, retries = 0;
+    for (int i = 0; i < num_readers; ++i) {
+        pthread_join(readers[i].thread, NULL);
+        reads += readers[i].reads;
+        fallbacks += readers[i].fallbacks;
+        retries += readers[i].retries;
+    }
+    if (writing) {
+        pthread_join(writer.thread, NULL);
+    }
+    const double seconds = kRunMillis / 1e3;
+    printf("%7d %7s %14.0f %12.2f %10.4f %12.0f\n", num_readers,
+           writing ? "yes" : "no", reads / seconds,
+           reads + fallbacks ? 100.0 * fallbacks / (reads + fallbacks) : 0.0,
+           reads ? (double)retries / reads : 0.0, writer.publishes / seconds);
+}
+
+int main(void) {
+    setLogLevel(LOG_LEVEL_ERROR);
+    snprintf(shm_name, sizeof(shm_name), "/displaymode-bench.%ld",
+             (long)getpid());
+    DisplayShmUnlink(shm_name);
+
+    struct FakeBackend fake;
+    BenchInitFake(&fake, kDisplays, kModesPerDisplay);
+    struct DisplayCatalog catalog;
+    BenchLoadCatalog(&catalog, &fake);
+    int errors[kDisplays];
+
+    // Direct enumeration, what a reader falls back to, without the cost of
+    // the real display APIs.
+    const int rounds = 2000;
+    double start = NowNs();
+    for (int i = 0; i < rounds; ++i) {
+        struct DisplayCatalog direct;
+        DisplayCatalogInit(&direct, &fake.backend);
+        DisplayCatalogLoadDisplays(&direct);
+        DisplayCatalogLoadAllModes(&direct, errors);
+        DisplayCatalogFree(&direct);
+    }
+    const double enumerate_ns = (NowNs() - start) / rounds;
+
+    struct DisplayShm shm;
+    if (DisplayShmOpen(&shm, shm_name, kDisplayShmDefaultSize) ||
+        DisplayShmPublish(&shm, &catalog, DisplayShmSequence(&shm),
+                          DisplayShmNow())) {
+        fprintf(stderr, "Could not publish to %s\n", shm_name);
+        return EXIT_FAILURE;
+    }
+    struct DisplayShmSnapshot snapshot;
+    DisplayShmSnapshotInit(&snapshot);
+    start = NowNs();
+    for (int i = 0; i < rounds * 10; ++i) {
+        DisplayShmRead(&shm, DisplayShmNow(), kDisplayShmMaxAge, &snapshot);
+    }
+    const double read_ns = (NowNs() - start) / (rounds * 10);
+    DisplayShmSnapshotFree(&snapshot);
+
+    printf("%d displays of %d modes (%zu bytes shared)\n", kDisplays,
+           kModesPerDisplay,
+           sizeof(struct DisplayShmHeader) +
+               kDisplays * sizeof(struct DisplayShmDisplay) +
+               kDisplays * kModesPerDisplay * sizeof(struct DisplayCacheMode));
+    printf("fake enumeration %.0f ns, snapshot read %.0f ns\n\n", enumerate_ns,
+           read_ns);
+    printf("%7s %7s %14s %12s %10s %12s\n", "readers", "writer", "reads/s",
+           "fallback %", "retries", "publishes/s");
+    for (int writing = 0; writing <= 1; ++writing) {
+        for (int readers = 1; readers <= kMaxReaders; readers *= 2) {
+            Run(&catalog, readers, writing);
+        }
+    }
+
+    DisplayShmClose(&shm);
+    DisplayShmUnlink(shm_name);
+    DisplayCatalogFree(&catalog);
+    FakeBackendFree(&fake);
+    return 0;
+}
@@ -0,0 +1,487 @@
+// Microbenchmarks of the hot paths: argument parsing, refresh rate
+// matching, line formatting, JSON serialization, trace spans and mode lookup
+// over synthetic catalogs of 10 to 100k modes.
+//
+// Usage: bench_suite [--filter=<substring>] [--samples=<n>]
+//                    [--output=<file>] [--baseline=<file>] [--threshold=<percent>]
+//
+// Prints a table, and with --output writes one JSON object per benchmark
+// and line:
+//   {"name":"...","iterations":n,"ns_per_op":x,"p50":x,"p90":x,"p99":x,"allocs_per_op":x}
+// where the percentiles are of per-sample ns/op.  With --baseline (a file
+// written by --output), each benchmark is compared with its baseline entry
+// and the exit status is 1 if any p50 got slower by more than the threshold
+// (10% by default; a baseline line may carry its own "threshold") or any
+// allocates more per op.  Allocation counts need glibc (and no sanitizer);
+// elsewhere they are reported as -1.
+
+#define _GNU_SOURCE
+
+#include "../displaymode_alloc.h"
+#include "../displaymode_catalog.h"
+#include "../displaymode_commands.h"
+#include "../displaymode_format.h"
+#include "../displaymode_index.h"
+#include "../displaymode_json.h"
+#include "../displaymode_parse.h"
+#include "../displaymode_table.h"
+#include "../displaymode_trace.h"
+#include "../logging.h"
+#include "../tests/bench_util.h"
+#include "../tests/fake_backend.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define kMaxBenchmarks 64
+#define kMaxSamples 1000
+// Each sample runs for roughly this long.
+#define kSampleNs 2000000.0
+
+// Keeps results alive so the compiler can't drop the benchmarked work.
+static volatile uintptr_t sink;
+
+// A catalog of "count" synthetic modes with its index.
+struct Catalog {
+    struct FakeBackend fake;
+    const struct DisplayMode *modes;
+    size_t count;
+    struct DisplayModeIndex index;
+    // Lookups cycle through these.
+    size_t queries[256];
+};
+
+static void CatalogInit(struct Catalog *catalog, size_t count) {
+    BenchInitFake(&catalog->fake, 1, count);
+    catalog->modes = catalog->fake.displays[0].modes;
+    catalog->count = count;
+    DisplayModeIndexBuild(&catalog->index, catalog->modes, count);
+    srand(7);
+    for (size_t i = 0; i < 256; ++i) {
+        catalog->queries[i] = (size_t)rand() % count;
+    }
+}
+
+static void CatalogFree(struct Catalog *catalog) {
+    DisplayModeIndexFree(&catalog->index);
+    FakeBackendFree(&catalog->fake);
+}
+
+// One benchmark: "run" performs "iterations" operations.
+struct Benchmark {
+    char name[64];
+    void (*run)(void *state, size_t iterations);
+    void *state;
+};
+
+static struct Benchmark benchmarks[kMaxBenchmarks];
+static size_t num_benchmarks;
+
+static void Register(const char *name, void (*run)(void *, size_t),
+                     void *state) {
+    struct Benchmark *b = &benchmarks[num_benchmarks++];
+    snprintf(b->name, sizeof(b->name), "%s", name);
+    b->run = run;
+    b->state = state;
+}
+
+static void RunParseConfigure(void *state, size_t iterations) {
+    (void)state;
+    const char *argv[] = {"displaymode", "t", "1920", "1080", "@59.94", "1", NULL};
+    for (size_t i = 0; i < iterations; ++i) {
+        const struct ParsedArgs parsed_args = ParseArgs(6, argv);
+        sink += parsed_args.width;
+    }
+}
+
+static void RunParseList(void *state, size_t iterations) {
+    (void)state;
+    const char *argv[] = {"displaymode", "d", "--json", "--no-cache", NULL};
+    for (size_t i = 0; i < iterations; ++i) {
+        const struct ParsedArgs parsed_args = ParseArgs(4, argv);
+        sink += (uintptr_t)parsed_args.option;
+    }
+}
+
+static void RunMatchesRefreshRate(void *state, size_t iterations) {
+    (void)state;
+    static const double kRates[] = {60.0, 59.94, 50.0, 75.0, 120.0, 144.0, 59.996, 0.0};
+    for (size_t i = 0; i < iterations; ++i) {
+        sink += (uintptr_t)MatchesRefreshRate(kRates[i & 7], kRates[(i >> 3) & 7]);
+    }
+}
+
+static void RunFormatDisplayModeInfo(void *state, size_t iterations) {
+    (void)state;
+    struct DisplayModeInfo info = {
+        .width = 2560, .height = 1440, .refresh_rate = 59.94,
+        .aspect_w = 16, .aspect_h = 9, .pixelEncodingStr = "Unknown",
+        .mode_id = 42, .isHiDPI = 0, .displayName = "Display",
+        .resCategory = "Standard", .usable_for_desktop = 1,
+    };
+    char line[256];
+    for (size_t i = 0; i < iterations; ++i) {
+        info.mode_id = (int)i;
+        sink += (uintptr_t)FormatDisplayModeInfo(&info, line, sizeof(line));
+    }
+}
+
+// The same line as above, from a mode table.
+static void RunFormatTableRow(void *state, size_t iterations) {
+    const struct DisplayModeTable *table = state;
+    char line[kModeTableMaxLine];
+    for (size_t i = 0; i < iterations; ++i) {
+        sink += (uintptr_t)DisplayModeTableFormatRow(table, i % table->count,
+                                                     line, sizeof(line));
+    }
+}
+
+// The JSON object PrintMode logs for each mode.
+static void RunJsonMode(void *state, size_t iterations) {
+    (void)state;
+    struct JsonWriter json;
+    for (size_t i = 0; i < iterations; ++i) {
+        JsonWriterInit(&json, NULL);
+        JsonWriterBeginObject(&json);
+        JsonWriterKey(&json, "width");
+        JsonWriterUint(&json, 1920 + (i & 15));
+        JsonWriterKey(&json, "height");
+        JsonWriterUint(&json, 1080);
+        JsonWriterKey(&json, "refreshRate");
+        JsonWriterDouble(&json, (i & 1) ? 60.0 : 59.94);
+        JsonWriterEndObject(&json);
+        sink += json.length;
+    }
+}
+
+// A span while no trace runs: the cost --trace adds when it isn't given.
+static void RunSpanDisabled(void *state, size_t iterations) {
+    (void)state;
+    for (size_t i = 0; i < iterations; ++i) {
+        struct TraceSpan span;
+        TraceSpanBegin(&span, "bench", "bench");
+        sink += span.start_ns;
+        TraceSpanEnd(&span);
+    }
+}
+
+// A recorded span, including writing it out.
+static void RunSpanEnabled(void *state, size_t iterations) {
+    (void)state;
+    TraceStart("/dev/null");
+    for (size_t i = 0; i < iterations; ++i) {
+        struct TraceSpan span;
+        TraceSpanBegin(&span, "bench", "bench");
+        TraceSpanEnd(&span);
+    }
+    TraceStop();
+}
+
+// "d" (text or JSON) over a 1000-mode catalog, to /dev/null, with a
+// scratch arena as the binary lists.
+struct ListState {
+    struct FakeBackend fake;
+    struct Arena scratch;
+    struct DisplayCatalog catalog;
+    struct ParsedArgs parsed_args;
+    FILE *out;
+};
+
+static void RunList(void *state, size_t iterations) {
+    struct ListState *list = state;
+    for (size_t i = 0; i < iterations; ++i) {
+        sink += (uintptr_t)RunCommand(&list->catalog, &list->parsed_args,
+                                      list->out, list->out);
+        ArenaReset(&list->scratch);
+    }
+}
+
+static void RunFindLinear(void *state, size_t iterations) {
+    const struct Catalog *catalog = state;
+    for (size_t i = 0; i < iterations; ++i) {
+        const struct DisplayMode *target =
+            &catalog->modes[catalog->queries[i & 255]];
+        for (size_t j = 0; j < catalog->count; ++j) {
+            const struct DisplayMode *mode = &catalog->modes[j];
+            if (mode->width == target->width && mode->height == target->height &&
+                MatchesRefreshRate(target->refresh_rate, mode->refresh_rate)) {
+                sink += j;
+                break;
+            }
+        }
+    }
+}
+
+static void RunFindIndexed(void *state, size_t iterations) {
+    const struct Catalog *catalog = state;
+    for (size_t i = 0; i < iterations; ++i) {
+        const struct DisplayMode *target =
+            &catalog->modes[catalog->queries[i & 255]];
+        sink += (uintptr_t)DisplayModeIndexFind(&catalog->index, target->width,
+                                                target->height,
+                                                target->refresh_rate);
+    }
+}
+
+struct Result {
+    size_t iterations;
+    double ns_per_op;
+    double p50;
+    double p90;
+    double p99;
+    double allocs_per_op;
+};
+
+static int CompareDoubles(const void *a, const void *b) {
+    const double x = *(const double *)a;
+    const double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void Measure(const struct Benchmark *b, int samples,
+                    struct Result *result) {
+    // Calibrate the iterations per sample.
+    size_t iterations = 1;
+    for (;;) {
+        const double start = NowNs();
+        b->run(b->state, iterations);
+        const double elapsed = NowNs() - start;
+        if (elapsed > kSampleNs / 4 || iterations >= ((size_t)1 << 30)) {
+            iterations = (size_t)((double)iterations * kSampleNs /
+                                  (elapsed > 1.0 ? elapsed : 1.0)) + 1;
+            break;
+        }
+        iterations *= 4;
+    }
+
+    static double per_op[kMaxSamples];
+    double total_ns = 0.0;
+    const uint64_t allocations_before = AllocHeapAllocations();
+    for (int i = 0; i < samples; ++i) {
+        const double start = NowNs();
+        b->run(b->state, iterations);
+        const double elapsed = NowNs() - start;
+        per_op[i] = elapsed / (double)iterations;
+        total_ns += elapsed;
+    }
+    const double ops = (double)iterations * samples;
+    // Allocations are counted by displaymode_alloc_heap.c, which interposes
+    // glibc's allocator.
+    struct AllocStats stats;
+    AllocGetStats(&stats);
+    result->allocs_per_op = stats.heap_tracked
+        ? (double)(AllocHeapAllocations() - allocations_before) / ops : -1.0;
+    result->iterations = (size_t)ops;
+    result->ns_per_op = total_ns / ops;
+    qsort(per_op, (size_t)samples, sizeof(per_op[0]), CompareDoubles);
+    result->p50 = per_op[samples / 2];
+    result->p90 = per_op[samples * 90 / 100];
+    result->p99 = per_op[samples * 99 / 100];
+}
+
+static void WriteResult(FILE *out, const char *name, const struct Result *r) {
+    struct JsonWriter json;
+    JsonWriterInit(&json, out);
+    JsonWriterBeginObject(&json);
+    JsonWriterKey(&json, "name");
+    JsonWriterString(&json, name);
+    JsonWriterKey(&json, "iterations");
+    JsonWriterUint(&json, r->iterations);
+    JsonWriterKey(&json, "ns_per_op");
+    JsonWriterDouble(&json, r->ns_per_op);
+    JsonWriterKey(&json, "p50");
+    JsonWriterDouble(&json, r->p50);
+    JsonWriterKey(&json, "p90");
+    JsonWriterDouble(&json, r->p90);
+    JsonWriterKey(&json, "p99");
+    JsonWriterDouble(&json, r->p99);
+    JsonWriterKey(&json, "allocs_per_op");
+    JsonWriterDouble(&json, r->allocs_per_op);
+    JsonWriterEndObject(&json);
+    JsonWriterEndLine(&json);
+    JsonWriterFlush(&json);
+}
+
+// Reads a number member from one line of --output.  Returns 0 or -1.
+static int ReadNumber(const char *line, const char *key, double *value) {
+    char pattern[64];
+    snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+    const char *p = strstr(line, pattern);
+    if (p == NULL) {
+        return -1;
+    }
+    char *end = NULL;
+    *value = strtod(p + strlen(pattern), &end);
+    return end == p + strlen(pattern) ? -1 : 0;
+}
+
+// Compares "result" with the baseline line for "name".  Returns non-zero
+// if it regressed.
+static int CompareWithBaseline(FILE *baseline, const char *name,
+                               const struct Result *result,
+                               double default_threshold) {
+    static const char kNameKey[] = "{\"name\":\"";
+    const size_t name_length = strlen(name);
+    char line[1024];
+    rewind(baseline);
+    while (fgets(line, sizeof(line), baseline) != NULL) {
+        const char *p = line + sizeof(kNameKey) - 1;
+        if (strncmp(line, kNameKey, sizeof(kNameKey) - 1) != 0 ||
+            strncmp(p, name, name_length) != 0 || p[name_length] != '"') {
+            continue;
+        }
+        double p50;
+        double allocs;
+        double threshold = default_threshold;
+        if (ReadNumber(line, "p50", &p50) ||
+            ReadNumber(line, "allocs_per_op", &allocs)) {
+            printf("  %s: unreadable baseline\n", name);
+            return 0;
+        }
+        ReadNumber(line, "threshold", &threshold);
+        const double change = (result->p50 - p50) / p50 * 100.0;
+        const int slower = change > threshold;
+        const int allocates_more = allocs >= 0 && result->allocs_per_op >= 0 &&
+                                   result->allocs_per_op > allocs + 1e-9;
+        if (slower || allocates_more) {
+            printf("REGRESSION %s: p50 %.1f -> %.1f ns (%+.1f%%, limit %.0f%%), "
+                   "allocs/op %.2f -> %.2f\n", name, p50, result->p50, change,
+                   threshold, allocs, result->allocs_per_op);
+            return 1;
+        }
+        return 0;
+    }
+    printf("  %s: not in baseline\n", name);
+    return 0;
+}
+
+int main(int argc, const char *argv[]) {
+    const char *filter = NULL;
+    const char *output_path = NULL;
+    const char *baseline_path = NULL;
+    double threshold = 10.0;
+    int samples = 30;
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "--filter=", 9) == 0) {
+            filter = argv[i] + 9;
+        } else if (strncmp(argv[i], "--output=", 9) == 0) {
+            output_path = argv[i] + 9;
+        } else if (strncmp(argv[i], "--baseline=", 11) == 0) {
+            baseline_path = argv[i] + 11;
+        } else if (strncmp(argv[i], "--threshold=", 12) == 0) {
+            threshold = atof(argv[i] + 12);
+        } else if (strncmp(argv[i], "--samples=", 10) == 0) {
+            samples = atoi(argv[i] + 10);
+            if (samples < 1 || samples > kMaxSamples) {
+                samples = 30;
+            }
+        } else {
+            fprintf(stderr, "Unknown argument: %s\n", argv[i]);
+            return 2;
+        }
+    }
+    setLogLevel(LOG_LEVEL_ERROR);
+
+    FILE *output = NULL;
+    if (output_path != NULL && (output = fopen(output_path, "w")) == NULL) {
+        perror(output_path);
+        return 2;
+    }
+    FILE *baseline = NULL;
+    if (baseline_path != NULL && (baseline = fopen(baseline_path, "r")) == NULL) {
+        perror(baseline_path);
+        return 2;
+    }
+
+    Register("parse_args/t", RunParseConfigure, NULL);
+    Register("parse_args/d", RunParseList, NULL);
+    Register("matches_refresh_rate", RunMatchesRefreshRate, NULL);
+    Register("format_display_mode_info", RunFormatDisplayModeInfo, NULL);
+    static struct FakeBackend table_fake;
+    static struct DisplayModeTable table;
+    BenchInitFake(&table_fake, 1, 1000);
+    const struct DisplayModeList table_list = {
+        .modes = table_fake.displays[0].modes, .count = 1000,
+        .current_index = -1,
+    };
+    DisplayModeTableBuild(&table, &table_list);
+    Register("format_table_row", RunFormatTableRow, &table);
+    Register("json/mode", RunJsonMode, NULL);
+    Register("trace/span_disabled", RunSpanDisabled, NULL);
+    Register("trace/span_enabled", RunSpanEnabled, NULL);
+
+    static struct ListState lists[2];
+    static const char *const kListFlags[] = {"--quiet", "--json"};
+    static const char *const kListNames[] = {"list/text/1000", "list/json/1000"};
+    for (int i = 0; i < 2; ++i) {
+        BenchInitFake(&lists[i].fake, 1, 1000);
+        DisplayCatalogInit(&lists[i].catalog, &lists[i].fake.backend);
+        ArenaInit(&lists[i].scratch);
+        lists[i].catalog.scratch = &lists[i].scratch;
+        const char *list_argv[] = {"displaymode", "d", kListFlags[i], NULL};
+        lists[i].parsed_args = ParseArgs(3, list_argv);
+        lists[i].out = fopen("/dev/null", "w");
+        Register(kListNames[i], RunList, &lists[i]);
+    }
+
+    static const size_t kCatalogSizes[] = {10, 100, 1000, 10000, 100000};
+    enum { kNumSizes = sizeof(kCatalogSizes) / sizeof(kCatalogSizes[0]) };
+    static struct Catalog catalogs[kNumSizes];
+    for (size_t i = 0; i < kNumSizes; ++i) {
+        char name[64];
+        CatalogInit(&catalogs[i], kCatalogSizes[i]);
+        snprintf(name, sizeof(name), "find_mode/linear/%zu", kCatalogSizes[i]);
+        Register(name, RunFindLinear, &catalogs[i]);
+        snprintf(name, sizeof(name), "find_mode/indexed/%zu", kCatalogSizes[i]);
+        Register(name, RunFindIndexed, &catalogs[i]);
+    }
+
+    printf("%-28s %12s %10s %10s %10s %10s\n", "benchmark", "ns/op", "p50",
+           "p90", "p99", "allocs/op");
+    int regressions = 0;
+    for (size_t i = 0; i < num_benchmarks; ++i) {
+        const struct Benchmark *b = &benchmarks[i];
+        if (filter != NULL && strstr(b->name, filter) == NULL) {
+            continue;
+        }
+        struct Result result;
+        Measure(b, samples, &result);
+        printf("%-28s %12.1f %10.1f %10.1f %10.1f %10.2f\n", b->name,
+               result.ns_per_op, result.p50, result.p90, result.p99,
+               result.allocs_per_op);
+        fflush(stdout);
+        if (output != NULL) {
+            WriteResult(output, b->name, &result);
+        }
+        if (baseline != NULL) {
+            regressions += CompareWithBaseline(baseline, b->name, &result,
+                                               threshold);
+        }
+    }
+
+    for (size_t i = 0; i < kNumSizes; ++i) {
+        CatalogFree(&catalogs[i]);
+    }
+    DisplayModeTableFree(&table);
+    FakeBackendFree(&table_fake);
+    for (int i = 0; i < 2; ++i) {
+        DisplayCatalogFree(&lists[i].catalog);
+        ArenaFree(&lists[i].scratch);
+        FakeBackendFree(&lists[i].fake);
+        fclose(lists[i].out);
+    }
+    if (output != NULL) {
+        fclose(output);
+    }
+    if (baseline != NULL) {
+        fclose(baseline);
+        if (regressions > 0) {
+            printf("%d benchmark(s) regressed.\n", regressions);
+            return 1;
+        }
+        printf("No regressions against %s.\n", baseline_path);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,130 @@
+// Memory and scan speed of the columnar mode table compared with an array
+// of DisplayModeInfo records (what "d" used to build per mode) and with the
+// backend's DisplayMode array, for catalogs of up to 100k modes.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "../displaymode_format.h"
+#include "../displaymode_parse.h"
+#include "../displaymode_resolutions.h"
+#include "../displaymode_table.h"
+#include "../tests/bench_util.h"
+#include "../tests/fake_backend.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum {
+    kScans = 200,
+};
+
+static void FillInfo(const struct DisplayMode *mode, struct DisplayModeInfo *info) {
+    memset(info, 0, sizeof(*info));
+    info->width = mode->width;
+    info->height = mode->height;
+    info->refresh_rate = mode->refresh_rate;
+    info->usable_for_desktop = mode->usable_for_desktop;
+    info->mode_id = mode->mode_id;
+    int a = (int)mode->width, b = (int)mode->height;
+    while (b != 0) {
+        const int t = b;
+        b = a % b;
+        a = t;
+    }
+    info->aspect_w = a ? (int)mode->width / a : 0;
+    info->aspect_h = a ? (int)mode->height / a : 0;
+    strcpy(info->pixelEncodingStr, "Unknown");
+    strcpy(info->displayName, "Display");
+    const struct StandardResolution *standard =
+        StandardResolutionFind(mode->width, mode->height);
+    strcpy(info->resCategory,
+           standard != NULL ? standard->name
+           : mode->width < 1024 || mode->height < 768 ? "LowRes" : "Standard");
+}
+
+int main(void) {
+    static const size_t kCatalogSizes[] = {1000, 10000, 100000};
+
+    printf("%-8s %10s %10s %10s | %9s %9s %9s | %9s %9s\n", "modes",
+           "info KiB", "mode KiB", "table KiB", "info ns", "mode ns",
+           "table ns", "info fmt", "table fmt");
+    for (size_t i = 0; i < sizeof(kCatalogSizes) / sizeof(kCatalogSizes[0]); ++i) {
+        const size_t count = kCatalogSizes[i];
+        struct FakeBackend fake;
+        BenchInitFake(&fake, 1, count);
+        struct DisplayModeList list;
+        memset(&list, 0, sizeof(list));
+        list.modes = fake.displays[0].modes;
+        list.count = count;
+        list.current_index = -1;
+
+        struct DisplayModeInfo *infos = malloc(count * sizeof(*infos));
+        for (size_t j = 0; j < count; ++j) {
+            FillInfo(&list.modes[j], &infos[j]);
+        }
+        struct DisplayModeTable table;
+        DisplayModeTableBuild(&table, &list);
+
+        // Scans for a mode that isn't there, so every row is visited.
+        size_t checksum = 0;
+        double start = NowNs();
+        for (int s = 0; s < kScans; ++s) {
+            for (size_t j = 0; j < count; ++j) {
+                if (infos[j].width == 4000 && infos[j].height == 3000 &&
+                    MatchesRefreshRate(60.0, infos[j].refresh_rate)) {
+                    ++checksum;
+                }
+            }
+        }
+        const double info_scan = (NowNs() - start) / kScans;
+
+        start = NowNs();
+        for (int s = 0; s < kScans; ++s) {
+            for (size_t j = 0; j < count; ++j) {
+                if (list.modes[j].width == 4000 && list.modes[j].height == 3000 &&
+                    MatchesRefreshRate(60.0, list.modes[j].refresh_rate)) {
+                    ++checksum;
+                }
+            }
+        }
+        const double mode_scan = (NowNs() - start) / kScans;
+
+        start = NowNs();
+        for (int s = 0; s < kScans; ++s) {
+            checksum += (size_t)DisplayModeTableFind(&table, 4000, 3000, 60.0);
+        }
+        const double table_scan = (NowNs() - start) / kScans;
+
+        // Formatting every mode, per mode.
+        char line[kModeTableMaxLine];
+        start = NowNs();
+        for (size_t j = 0; j < count; ++j) {
+            struct DisplayModeInfo info;
+            FillInfo(&list.modes[j], &info);
+            checksum += (size_t)FormatDisplayModeInfo(&info, line, sizeof(line));
+        }
+        const double info_format = (NowNs() - start) / count;
+
+        start = NowNs();
+        for (size_t j = 0; j < count; ++j) {
+            checksum += (size_t)DisplayModeTableFormatRow(&table, j, line,
+                                                          sizeof(line));
+        }
+        const double table_format = (NowNs() - start) / count;
+
+        printf("%-8zu %10.1f %10.1f %10.1f | %9.0f %9.0f %9.0f | %9.1f %9.1f\n",
+               count, count * sizeof(*infos) / 1024.0,
+               count * sizeof(list.modes[0]) / 1024.0,
+               DisplayModeTableBytes(&table) / 1024.0, info_scan,
+               mode_scan, table_scan, info_format, table_format);
+        if (checksum == 42) {
+            fprintf(stderr, "\n");
+        }
+        DisplayModeTableFree(&table);
+        free(infos);
+        FakeBackendFree(&fake);
+    }
+    printf("(scan ns are per full scan of the catalog; fmt ns are per mode)\n");
+    return EXIT_SUCCESS;
+}
@@ -1,4 +1,5 @@
-// displaymode - a utility for changing the display resolution on Mac OS X.
+// displaymode - a utility for changing the display resolution on Mac OS X
+// (and for listing display modes on Linux).
 //
 // Copyright 2019-2023 Dean Scarff.
 //
@@ -15,317 +16,392 @@
 // limitations under the License.
 //
 // Compilation:
-//   clang -std=c11 -lm -framework CoreFoundation -framework CoreGraphics -o displaymode displaymode.c
+//   make
 //
 // Usage (to change the resolution to 1440x900):
 //   displaymode t 1440 900
 
-#include <errno.h>
-#include <math.h>
+#define _POSIX_C_SOURCE 200809L
+
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <string.h>
-#include <stdbool.h>            // added for bool
-
-#include <CoreFoundation/CoreFoundation.h>
-#include <CoreGraphics/CoreGraphics.h>
-#include <MacTypes.h>
-#include <json-c/json.h>
+#include <unistd.h>
 
+#include "displaymode_alloc.h"
+#include "displaymode_batch.h"
+#include "displaymode_cache.h"
+#include "displaymode_catalog.h"
+#include "displaymode_commands.h"
+#include "displaymode_ids.h"
+#include "displaymode_layout.h"
 #include "displaymode_parse.h"  // <- new header exposing ParseArgs, MatchesRefreshRate, ParsedArgs
+#include "displaymode_server.h"
+#include "displaymode_shm.h"
+#include "displaymode_trace.h"
+#include "displaymode_watch.h"
 #include "logging.h"
 
-// Maximum number of displays to query at once (used with CGGetActiveDisplayList).
-#define kMaxDisplays 16
+#ifdef __APPLE__
+#include "displaymode_cg.h"
+#else
+#include "displaymode_drm.h"
+#endif
 
-// Name and version to display with "v" option.
-static const char kProgramVersion[] = "displaymode 1.4.0";
+// Scratch memory for formatting output, reset between the commands of a
+// server or batch and unmapped when the process exits.
+static struct Arena scratch;
 
-// Restore usage string referenced by ShowUsage.
-static const char kUsage[] =
-    "Usage:\n\n"
-    "  displaymode [options...]\n\n"
-    "Options:\n"
-    "  t <width> <height> [@<refresh>] [display]\n"
-    "      sets the display's width, height and (optionally) refresh rate\n\n"
-    "  d\n"
-    "      prints available resolutions for each display\n\n"
-    "  h, --help\n"
-    "      prints this message\n\n"
-    "  v, --version\n"
-    "      prints version and copyright notice\n\n"
-    "  --verbose\n"
-    "      enables verbose output\n";
-
-// Prints a message describing how to invoke the tool on the command line.
-static void ShowUsage(void) {
-    puts(kUsage);
+// Attaches the on-disk mode cache to "catalog" unless --no-cache was given.
+// Returns "cache" if it is in use.
+static struct DisplayCache *OpenCache(const struct ParsedArgs *parsed_args,
+                                      struct DisplayCatalog *catalog,
+                                      struct DisplayCache *cache) {
+    char path[1024];
+    if (parsed_args->no_cache || DisplayCacheDefaultPath(path, sizeof(path)) ||
+        DisplayCacheOpen(cache, path)) {
+        return NULL;
+    }
+    DisplayCatalogSetCache(catalog, cache);
+    return cache;
 }
 
+// Attaches the display map to "catalog", so that displays can be given by
+// name.  Unlike the mode cache it holds settings, so --no-cache doesn't skip
+// it.  Returns "ids" if it is in use.
+static struct DisplayIdMap *OpenIds(struct DisplayCatalog *catalog,
+                                    struct DisplayIdMap *ids) {
+    char path[1024];
+    if (DisplayIdMapDefaultPath(path, sizeof(path)) ||
+        DisplayIdMapOpen(ids, path)) {
+        return NULL;
+    }
+    catalog->ids = ids;
+    return ids;
+}
 
-#include "displaymode_format.h"
-
-// Extract info and print
-static void PrintMode(CGDisplayModeRef mode) {
-    if (mode == NULL) {
+// Writes the display map if it changed, and closes it.
+static void CloseIds(struct DisplayIdMap *ids) {
+    if (ids == NULL) {
         return;
     }
-    struct DisplayModeInfo info = {0};
-    info.width = CGDisplayModeGetWidth(mode);
-    info.height = CGDisplayModeGetHeight(mode);
-    info.refresh_rate = CGDisplayModeGetRefreshRate(mode);
-    info.usable_for_desktop = CGDisplayModeIsUsableForDesktopGUI(mode);
-    // Aspect ratio calculation
-    int gcd = 1;
-    int a = (int)info.width, b = (int)info.height;
-    while (b != 0) {
-        int t = b;
-        b = a % b;
-        a = t;
+    if (DisplayIdMapFlush(ids)) {
+        LOG_WARN("Could not write display map %s", ids->path);
     }
-    gcd = a;
-    info.aspect_w = (int)info.width / gcd;
-    info.aspect_h = (int)info.height / gcd;
-    // Pixel encoding (color depth) - Updated to remove deprecated function
-    CFStringRef pixelEncoding = CFSTR("Unknown"); // Placeholder for pixel encoding
-    CFStringGetCString(pixelEncoding, info.pixelEncodingStr, sizeof(info.pixelEncodingStr), kCFStringEncodingUTF8);
-
-    // Scaling/HiDPI info - Simplified logic
-    info.isHiDPI = 0; // Default to non-HiDPI
-    // HiDPI detection logic removed due to lack of valid API
-    // Display name/model
-    snprintf(info.displayName, sizeof(info.displayName), "Display");
-    // Resolution category
-    if (info.isHiDPI) strcpy(info.resCategory, "HiDPI");
-    else if (info.width < 1024 || info.height < 768) strcpy(info.resCategory, "LowRes");
-    else strcpy(info.resCategory, "Standard");
-    // Format and print
-    char out[256];
-    FormatDisplayModeInfo(&info, out, sizeof(out));
-    printf("%s", out);
+    DisplayIdMapClose(ids);
+}
 
-    // JSON output
-    struct json_object *jsonObj = json_object_new_object();
-    json_object_object_add(jsonObj, "width", json_object_new_int(info.width));
-    json_object_object_add(jsonObj, "height", json_object_new_int(info.height));
-    json_object_object_add(jsonObj, "refreshRate", json_object_new_double(info.refresh_rate));
+// Attaches the layouts and their plans to "catalog".  Returns "layouts" if
+// they are in use.
+static struct DisplayLayouts *OpenLayouts(struct DisplayCatalog *catalog,
+                                          struct DisplayLayouts *layouts) {
+    char config_path[1024];
+    char plan_path[1024];
+    if (DisplayLayoutsDefaultPaths(config_path, sizeof(config_path), plan_path,
+                                   sizeof(plan_path)) ||
+        DisplayLayoutsOpen(layouts, config_path, plan_path)) {
+        return NULL;
+    }
+    catalog->layouts = layouts;
+    return layouts;
+}
 
-    const char *jsonStr = json_object_to_json_string(jsonObj);
-    logMessage(LOG_LEVEL_INFO, "JSON Output: %s", jsonStr);
+// Writes the plans if any were compiled, and closes them.
+static void CloseLayouts(struct DisplayLayouts *layouts) {
+    if (layouts == NULL) {
+        return;
+    }
+    if (DisplayLayoutsFlush(layouts)) {
+        LOG_WARN("Could not write layout plans %s", layouts->plan_path);
+    }
+    DisplayLayoutsClose(layouts);
+}
 
-    json_object_put(jsonObj); // Free JSON object
+// Maps the shared catalog unless --no-cache was given.  Returns "shm" if it
+// is in use.
+static struct DisplayShm *OpenSharedCatalog(const struct ParsedArgs *parsed_args,
+                                            struct DisplayShm *shm) {
+    char name[64];
+    DisplayShmDefaultName(name, sizeof(name));
+    if (parsed_args->no_cache ||
+        DisplayShmOpen(shm, name, kDisplayShmDefaultSize)) {
+        return NULL;
+    }
+    return shm;
 }
 
-// Prints all display modes for the main display.  Returns 0 on success.
-static int PrintModes(CGDirectDisplayID display) {
-    CGDisplayModeRef current_mode = CGDisplayCopyDisplayMode(display);
-    CFArrayRef modes = CGDisplayCopyAllDisplayModes(display, NULL);
-    if (modes == NULL) {
-        // Fallback: if we have the current mode, print it; otherwise fail.
-        if (current_mode != NULL) {
-            PrintMode(current_mode);
-            puts(" *");
-            CGDisplayModeRelease(current_mode);
-            return EXIT_SUCCESS;
-        }
-        fprintf(stderr, "Failed to get display modes\n");
-        return EXIT_FAILURE;
+// Lists modes from the catalog another invocation published, without
+// querying the displays.  Returns 0 with the command's *status, or -1 if
+// there is no fresh, consistent catalog to list.
+static int ListSharedCatalog(const struct DisplayShm *shm,
+                             const struct ParsedArgs *parsed_args,
+                             int *status) {
+    struct DisplayShmSnapshot snapshot;
+    DisplayShmSnapshotInit(&snapshot);
+    const int e = DisplayShmRead(shm, DisplayShmNow(), kDisplayShmMaxAge,
+                                 &snapshot);
+    if (e != kDisplayShmOk) {
+        LOG_DEBUG("Shared catalog not used (%d); querying displays", e);
+        DisplayShmSnapshotFree(&snapshot);
+        return -1;
     }
+    struct DisplayCatalog catalog;
+    DisplayCatalogInit(&catalog, &snapshot.backend);
+    catalog.scratch = &scratch;
+    *status = RunCommand(&catalog, parsed_args, stdout, stderr);
+    AllocSetPhase(kAllocPhaseFinish);
+    DisplayCatalogFree(&catalog);
+    DisplayShmSnapshotFree(&snapshot);
+    return 0;
+}
 
-    const CFIndex count = CFArrayGetCount(modes);
-    Boolean has_current = 0;
-    for (size_t i = 0; i < (size_t)count; ++i) {
-        CGDisplayModeRef mode =
-            (CGDisplayModeRef)CFArrayGetValueAtIndex(modes, (CFIndex)i);
-        if (mode == NULL) {
-            continue;
+#ifndef __APPLE__
+// Returns the DRM backend over sysfs, or over the tree named by
+// DISPLAYMODE_DRM_ROOT (for testing against a fixture).
+static struct DrmBackend *Drm(void) {
+    static struct DrmBackend drm;
+    static int initialized;
+    if (!initialized) {
+        const char *root = getenv("DISPLAYMODE_DRM_ROOT");
+        if (root == NULL || root[0] == '\0') {
+            root = kDrmSysfsRoot;
         }
-        PrintMode(mode);
-        if (current_mode != NULL && CFEqual(mode, current_mode)) {
-            has_current = 1;
-            puts(" *");
-        } else {
-            puts("");
+        if (DrmBackendInit(&drm, root)) {
+            LOG_ERROR("Could not open %s", root);
         }
+        initialized = 1;
     }
-    if (!has_current && current_mode != NULL) {
-        PrintMode(current_mode);
-        puts(" *");
-    }
-    CFRelease(modes);
-    if (current_mode != NULL) {
-        CGDisplayModeRelease(current_mode);
-    }
-    return EXIT_SUCCESS;
+    return &drm;
 }
+#endif
 
-static int PrintModesForAllDisplays(void) {
-    CGDirectDisplayID displays[kMaxDisplays];
-    uint32_t num_displays = 0;
-    CGError e = CGGetActiveDisplayList(kMaxDisplays, &displays[0], &num_displays);
-    if (e) {
-        fprintf(stderr, "CGGetActiveDisplayList CGError: %d\n", e);
-        return e;
-    }
+// Returns the platform's display backend.
+static const struct DisplayBackend *PlatformBackend(void) {
+#ifdef __APPLE__
+    return CoreGraphicsBackend();
+#else
+    return &Drm()->backend;
+#endif
+}
 
-    for (uint32_t i = 0; i < num_displays; ++i) {
-        printf("%sDisplay %u%s:\n", i == 0 ? "" : "\n", i, i == 0 ? " (MAIN)" : "");
-        PrintModes(displays[i]);
-    }
+// Returns the platform's display reconfiguration events.
+static const struct DisplayEventSource *PlatformEventSource(void) {
+#ifdef __APPLE__
+    return CoreGraphicsEventSource();
+#else
+    return &Drm()->events;
+#endif
+}
 
-    return EXIT_SUCCESS;
+// Returns the platform backend, wrapped to time each call if a trace is
+// running.
+static const struct DisplayBackend *Backend(void) {
+    static struct TraceBackend traced_backend;
+    if (trace_enabled) {
+        return TraceBackendWrap(&traced_backend, PlatformBackend());
+    }
+    return PlatformBackend();
 }
 
-static CGError GetDisplayID(uint32_t display_index, CGDirectDisplayID *display) {
-    CGDirectDisplayID displays[kMaxDisplays];
-    uint32_t num_displays = 0;
-    CGError e = CGGetActiveDisplayList(kMaxDisplays, &displays[0], &num_displays);
-    if (e) {
-        fprintf(stderr, "CGGetActiveDisplayList CGError: %d\n", e);
-        return e;
+// Writes the trace, if one is running, and the allocation report if
+// --stats was given, and returns "status".
+static int Finish(const struct ParsedArgs *parsed_args, int status) {
+    if (TraceStop()) {
+        LOG_WARN("Could not write the trace");
     }
-    if (num_displays <= display_index) {
-        fprintf(stderr, "Display %u not supported; display must be < %u\n",
-                display_index, num_displays);
-        return kCGErrorRangeCheck;
+    if (parsed_args->stats) {
+        struct AllocStats stats;
+        AllocGetStats(&stats);
+        AllocWriteStats(&stats, stderr);
     }
-    *display = displays[display_index];
-    return kCGErrorSuccess;
+    return status;
 }
 
-static CGDisplayModeRef GetModeMatching(const struct ParsedArgs *parsed_args,
-                                        const CGDirectDisplayID display) {
-    CFArrayRef modes = CGDisplayCopyAllDisplayModes(display, NULL);
-    if (modes == NULL) {
-        return NULL;
+// The running server, stopped by SIGINT and SIGTERM.
+static struct DisplayServer server;
+
+static void StopServer(int signal_number) {
+    (void)signal_number;
+    DisplayServerStop(&server);
+}
+
+// Serves commands until interrupted.  The catalog stays enumerated between
+// commands, so only the first command pays for querying the displays.
+static int RunServer(const struct ParsedArgs *parsed_args) {
+    char default_path[104];
+    const char *socket_path = parsed_args->socket_path;
+    if (socket_path == NULL) {
+        DisplayServerDefaultPath(default_path, sizeof(default_path));
+        socket_path = default_path;
     }
-    const CFIndex count = CFArrayGetCount(modes);
 
-    CGDisplayModeRef matched_mode = NULL;
-    for (size_t i = 0; i < (size_t)count; ++i) {
-        CGDisplayModeRef mode =
-            (CGDisplayModeRef)CFArrayGetValueAtIndex(modes, (CFIndex)i);
-        if (mode == NULL) {
-            continue;
+    struct DisplayCatalog catalog;
+    DisplayCatalogInit(&catalog, Backend());
+    catalog.scratch = &scratch;
+    struct DisplayCache cache_storage;
+    struct DisplayCache *cache = OpenCache(parsed_args, &catalog, &cache_storage);
+    struct DisplayIdMap ids_storage;
+    struct DisplayIdMap *ids = OpenIds(&catalog, &ids_storage);
+    struct DisplayShm shm_storage;
+    struct DisplayShm *shm = OpenSharedCatalog(parsed_args, &shm_storage);
+    if (DisplayServerOpen(&server, socket_path, &catalog)) {
+        perror(socket_path);
+        if (shm != NULL) {
+            DisplayShmClose(shm);
         }
-        const size_t width = CGDisplayModeGetWidth(mode);
-        const size_t height = CGDisplayModeGetHeight(mode);
-        const double refresh_rate = CGDisplayModeGetRefreshRate(mode);
-        if (width == parsed_args->width &&
-            height == parsed_args->height &&
-            MatchesRefreshRate(parsed_args->refresh_rate, refresh_rate)) {
-            matched_mode = CGDisplayModeRetain(mode);
-            break;
+        CloseIds(ids);
+        if (cache != NULL) {
+            DisplayCacheClose(cache);
         }
+        return EXIT_FAILURE;
+    }
+    server.shm = shm;
+    signal(SIGINT, StopServer);
+    signal(SIGTERM, StopServer);
+    LOG_INFO("Serving on %s", socket_path);
+    const int e = DisplayServerRun(&server);
+    DisplayServerClose(&server);
+    if (shm != NULL) {
+        DisplayShmClose(shm);
     }
-    CFRelease(modes);
-    return matched_mode;
+    CloseIds(ids);
+    DisplayCatalogFree(&catalog);
+    if (cache != NULL) {
+        DisplayCacheClose(cache);
+    }
+    return e ? EXIT_FAILURE : EXIT_SUCCESS;
 }
 
-static int ConfigureMode(const struct ParsedArgs *parsed_args) {
-    CGDirectDisplayID display;
-    CGError e;
-    if ((e = GetDisplayID(parsed_args->display_index, &display))) {
-        return e;
+// Runs the commands of the file named by "-" (or standard input).
+static int RunBatch(struct DisplayCatalog *catalog,
+                    const struct ParsedArgs *parsed_args) {
+    FILE *in = stdin;
+    if (parsed_args->input_path != NULL &&
+        (in = fopen(parsed_args->input_path, "r")) == NULL) {
+        perror(parsed_args->input_path);
+        return EXIT_FAILURE;
     }
+    const int status = DisplayBatchRun(catalog, in, stdout, stderr);
+    if (in != stdin) {
+        fclose(in);
+    }
+    return status;
+}
 
-    CGDisplayModeRef mode = GetModeMatching(parsed_args, display);
-    if (mode == NULL) {
-        if (parsed_args->refresh_rate == 0.0) {
-            fprintf(stderr, "Could not find a mode for resolution %lux%lu\n",
-                    parsed_args->width, parsed_args->height);
-        } else {
-            fprintf(stderr, "Could not find a mode for resolution %lux%lu @%.1f\n",
-                    parsed_args->width, parsed_args->height,
-                    parsed_args->refresh_rate);
-        }
-        return -1;
+// Reports display changes until interrupted.
+static int RunWatch(const struct ParsedArgs *parsed_args) {
+    struct DisplayCatalog catalog;
+    DisplayCatalogInit(&catalog, Backend());
+    struct DisplayCache cache_storage;
+    struct DisplayCache *cache = OpenCache(parsed_args, &catalog, &cache_storage);
+    const int ndjson = parsed_args->output_format == kOutputJson ||
+                       parsed_args->output_format == kOutputNdjson;
+    const int coalesce_ms = parsed_args->coalesce_ms >= 0
+        ? parsed_args->coalesce_ms : kWatchCoalesceMs;
+    struct DisplayWatch watch;
+    int status = EXIT_FAILURE;
+    if (DisplayWatchInit(&watch, &catalog, ndjson, stdout, stderr) == 0) {
+        status = DisplayWatchRun(&watch, PlatformEventSource(),
+                                 coalesce_ms, stdout, stderr);
     }
+    DisplayWatchFree(&watch);
+    DisplayCatalogFree(&catalog);
+    if (cache != NULL) {
+        DisplayCacheClose(cache);
+    }
+    return status;
+}
 
-    CGDisplayModeRef original_mode = CGDisplayCopyDisplayMode(display);
-    size_t original_width = 0;
-    size_t original_height = 0;
-    double original_refresh_rate = 0.0;
-    if (original_mode != NULL) {
-        original_width = CGDisplayModeGetWidth(original_mode);
-        original_height = CGDisplayModeGetHeight(original_mode);
-        original_refresh_rate = CGDisplayModeGetRefreshRate(original_mode);
-        CGDisplayModeRelease(original_mode);
+int main(int argc, const char *argv[]) {
+    const uint64_t parse_start = TraceNow();
+    ArenaInit(&scratch);
+    // stdio would allocate stdout's buffer on the first write, in the middle
+    // of a listing.
+    static char stdout_buffer[BUFSIZ];
+    setvbuf(stdout, stdout_buffer, isatty(STDOUT_FILENO) ? _IOLBF : _IOFBF,
+            sizeof(stdout_buffer));
+    const struct ParsedArgs parsed_args = ParseArgs(argc, argv);
+    // Diagnostics, such as the per-mode log lines of "d", are only logged
+    // with --verbose; --quiet logs nothing but errors.
+    setLogLevel(parsed_args.quiet ? LOG_LEVEL_ERROR
+                : parsed_args.verbose ? LOG_LEVEL_DEBUG
+                : LOG_LEVEL_WARN);
+    LOG_INFO("Starting displaymode application");
+    if (parsed_args.trace_path != NULL) {
+        if (TraceStart(parsed_args.trace_path)) {
+            LOG_WARN("Could not create trace file %s", parsed_args.trace_path);
+        } else {
+            TraceRecord("parse", "phase", parse_start, TraceNow(), -1);
+        }
     }
 
-    CGDisplayConfigRef config = NULL;
-    if ((e = CGBeginDisplayConfiguration(&config))) {
-        fprintf(stderr, "CGBeginDisplayConfiguration CGError: %d\n", e);
-        CGDisplayModeRelease(mode);
-        return e;
+    if (parsed_args.option == kOptionServer) {
+        return Finish(&parsed_args, RunServer(&parsed_args));
     }
-    if ((e = CGConfigureDisplayWithDisplayMode(config, display, mode, NULL))) {
-        fprintf(stderr, "CGConfigureDisplayWithDisplayMode CGError: %d\n", e);
-        CGCancelDisplayConfiguration(config);
-        CGDisplayModeRelease(mode);
-        return e;
+    if (parsed_args.option == kOptionWatch) {
+        return Finish(&parsed_args, RunWatch(&parsed_args));
     }
-    if ((e = CGCompleteDisplayConfiguration(config, kCGConfigurePermanently))) {
-        fprintf(stderr, "CGCompleteDisplayConfiguration CGError: %d\n", e);
-        CGDisplayModeRelease(mode);
-        return e;
+    if (parsed_args.socket_path != NULL &&
+        (parsed_args.option == kOptionConfigureMode ||
+         parsed_args.option == kOptionSupportedModes)) {
+        int status;
+        if (DisplayClientRun(parsed_args.socket_path, argc, argv, stdout,
+                             stderr, &status) == 0) {
+            return Finish(&parsed_args, status);
+        }
+        LOG_WARN("No server at %s; querying displays directly",
+                 parsed_args.socket_path);
     }
-    CGDisplayModeRelease(mode);
 
-    if (parsed_args->refresh_rate == 0.0) {
-        printf("Changed display resolution from %zux%zu to %lux%lu\n",
-               original_width, original_height,
-               parsed_args->width, parsed_args->height);
-    } else {
-        printf("Changed display resolution from %zux%zu @%f to %lux%lu @%.1f\n",
-               original_width, original_height, original_refresh_rate,
-               parsed_args->width, parsed_args->height,
-               parsed_args->refresh_rate);
+    // "d" lists a fresh shared catalog if there is one; otherwise it
+    // publishes what it enumerates for the invocations that follow.
+    const int listing = parsed_args.option == kOptionSupportedModes;
+    const int configuring = CommandConfigures(parsed_args.option);
+    struct DisplayShm shm_storage;
+    struct DisplayShm *shm = listing || configuring
+        ? OpenSharedCatalog(&parsed_args, &shm_storage) : NULL;
+    const uint64_t sequence = shm != NULL ? DisplayShmSequence(shm) : 0;
+    int status;
+    if (shm != NULL && listing &&
+        ListSharedCatalog(shm, &parsed_args, &status) == 0) {
+        DisplayShmClose(shm);
+        return Finish(&parsed_args, status);
     }
-    return EXIT_SUCCESS;
-}
-
-int main(int argc, const char *argv[]) {
-    setLogLevel(LOG_LEVEL_DEBUG);
-    logMessage(LOG_LEVEL_INFO, "Starting displaymode application");
 
-    const struct ParsedArgs parsed_args = ParseArgs(argc, argv);
-    switch (parsed_args.option) {
-        case kOptionMissing: {
-            fputs("Missing option; server mode is not supported\n\n", stderr);
-            ShowUsage();
-            break;
+    struct DisplayCatalog catalog;
+    DisplayCatalogInit(&catalog, Backend());
+    catalog.scratch = &scratch;
+    struct DisplayCache cache_storage;
+    struct DisplayCache *cache = OpenCache(&parsed_args, &catalog, &cache_storage);
+    struct DisplayIdMap ids_storage;
+    struct DisplayIdMap *ids = configuring || parsed_args.option == kOptionName
+        ? OpenIds(&catalog, &ids_storage) : NULL;
+    struct DisplayLayouts layouts_storage;
+    struct DisplayLayouts *layouts = parsed_args.option == kOptionLayout ||
+                                     parsed_args.option == kOptionBatch
+        ? OpenLayouts(&catalog, &layouts_storage) : NULL;
+    status = parsed_args.option == kOptionBatch
+        ? RunBatch(&catalog, &parsed_args)
+        : RunCommand(&catalog, &parsed_args, stdout, stderr);
+    AllocSetPhase(kAllocPhaseFinish);
+    if (shm != NULL) {
+        if (listing && status == EXIT_SUCCESS) {
+            DisplayShmPublish(shm, &catalog, sequence, DisplayShmNow());
+        } else if (configuring && DisplayShmInvalidate(shm)) {
+            LOG_WARN("Could not invalidate the shared catalog %s", shm->name);
         }
-        case kOptionInvalid: {
-            fprintf(stderr, "Invalid option: '%s'\n\n",
-                    parsed_args.literal_option);
-            ShowUsage();
-            break;
-        }
-        case kOptionInvalidMode: {
-            fputs("Invalid mode\n", stderr);
-            break;
+        DisplayShmClose(shm);
+    }
+    CloseLayouts(layouts);
+    CloseIds(ids);
+    if (cache != NULL) {
+        if (DisplayCatalogFlushCache(&catalog)) {
+            LOG_WARN("Could not write mode cache %s", cache->path);
         }
-        case kOptionConfigureMode:
-            if (parsed_args.verbose) {
-                printf("[VERBOSE] Configuring display mode...\n");
-            }
-            return ConfigureMode(&parsed_args);
-        case kOptionHelp:
-        case kOptionLongHelp:
-            ShowUsage();
-            return EXIT_SUCCESS;
-        case kOptionSupportedModes:
-            if (parsed_args.verbose) {
-                printf("[VERBOSE] Printing supported display modes...\n");
-            }
-            return PrintModesForAllDisplays();
-        case kOptionVersion:
-        case kOptionLongVersion:
-            printf("%s\nCopyright 2019-2023 Dean Scarff\n", kProgramVersion);
-            return EXIT_SUCCESS;
-        default:
-            break;
     }
-    return EXIT_FAILURE;
+    DisplayCatalogFree(&catalog);
+    if (cache != NULL) {
+        DisplayCacheClose(cache);
+    }
+    return Finish(&parsed_args, status);
 }
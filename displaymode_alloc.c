@@ -0,0 +1,289 @@
+// For MAP_ANONYMOUS.
+#define _DEFAULT_SOURCE
+
+#include "displaymode_alloc.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+// Counters of one phase, updated from any thread.
+struct PhaseCounters {
+    atomic_uint_fast64_t allocations;
+    atomic_uint_fast64_t frees;
+    atomic_uint_fast64_t bytes;
+    atomic_uint_fast64_t arena_allocations;
+    atomic_uint_fast64_t arena_bytes;
+};
+
+static struct PhaseCounters counters[kAllocPhaseCount];
+static atomic_int current_phase;
+// General-heap bytes live now (by usable size, so that frees balance) and
+// the most there have been.
+static atomic_int_fast64_t live_bytes;
+static atomic_int_fast64_t peak_bytes;
+// Set once the heap-counting shim is linked in.
+static atomic_int heap_tracked;
+
+static const char *const kPhaseNames[kAllocPhaseCount] = {
+    "startup", "enumerate", "format", "write", "finish",
+};
+
+static struct PhaseCounters *Counters(void) {
+    return &counters[atomic_load_explicit(&current_phase,
+                                          memory_order_relaxed)];
+}
+
+static void Add(atomic_uint_fast64_t *counter, uint64_t value) {
+    atomic_fetch_add_explicit(counter, value, memory_order_relaxed);
+}
+
+void AllocSetPhase(enum AllocPhase phase) {
+    atomic_store_explicit(&current_phase, (int)phase, memory_order_relaxed);
+}
+
+enum AllocPhase AllocGetPhase(void) {
+    return (enum AllocPhase)atomic_load_explicit(&current_phase,
+                                                 memory_order_relaxed);
+}
+
+static void AddLive(int64_t delta) {
+    const int64_t live = atomic_fetch_add_explicit(&live_bytes, delta,
+                                                   memory_order_relaxed) + delta;
+    int64_t peak = atomic_load_explicit(&peak_bytes, memory_order_relaxed);
+    while (live > peak &&
+           !atomic_compare_exchange_weak_explicit(&peak_bytes, &peak, live,
+                                                  memory_order_relaxed,
+                                                  memory_order_relaxed)) {
+    }
+}
+
+void AllocTrackHeap(void) {
+    atomic_store_explicit(&heap_tracked, 1, memory_order_relaxed);
+}
+
+void AllocCountHeapAllocation(uint64_t bytes, int64_t live_delta) {
+    struct PhaseCounters *phase = Counters();
+    Add(&phase->allocations, 1);
+    Add(&phase->bytes, bytes);
+    AddLive(live_delta);
+}
+
+void AllocCountHeapFree(int64_t live_delta) {
+    Add(&Counters()->frees, 1);
+    AddLive(live_delta);
+}
+
+void AllocGetStats(struct AllocStats *stats) {
+    for (int i = 0; i < kAllocPhaseCount; ++i) {
+        struct AllocPhaseStats *out = &stats->phases[i];
+        out->allocations = atomic_load(&counters[i].allocations);
+        out->frees = atomic_load(&counters[i].frees);
+        out->bytes = atomic_load(&counters[i].bytes);
+        out->arena_allocations = atomic_load(&counters[i].arena_allocations);
+        out->arena_bytes = atomic_load(&counters[i].arena_bytes);
+    }
+    const int64_t peak = atomic_load(&peak_bytes);
+    stats->peak_bytes = peak > 0 ? (uint64_t)peak : 0;
+    stats->heap_tracked = atomic_load(&heap_tracked);
+}
+
+void AllocResetStats(void) {
+    for (int i = 0; i < kAllocPhaseCount; ++i) {
+        atomic_store(&counters[i].allocations, 0);
+        atomic_store(&counters[i].frees, 0);
+        atomic_store(&counters[i].bytes, 0);
+        atomic_store(&counters[i].arena_allocations, 0);
+        atomic_store(&counters[i].arena_bytes, 0);
+    }
+    atomic_store(&peak_bytes, atomic_load(&live_bytes));
+}
+
+uint64_t AllocHeapAllocations(void) {
+    uint64_t total = 0;
+    for (int i = 0; i < kAllocPhaseCount; ++i) {
+        total += atomic_load(&counters[i].allocations);
+    }
+    return total;
+}
+
+void AllocWriteStats(const struct AllocStats *stats, FILE *out) {
+    fprintf(out, "%-10s %12s %12s %14s %12s %14s\n", "phase", "allocs",
+            "frees", "bytes", "arena allocs", "arena bytes");
+    struct AllocPhaseStats total = {0, 0, 0, 0, 0};
+    for (int i = 0; i < kAllocPhaseCount; ++i) {
+        const struct AllocPhaseStats *phase = &stats->phases[i];
+        if (stats->heap_tracked) {
+            fprintf(out, "%-10s %12llu %12llu %14llu", kPhaseNames[i],
+                    (unsigned long long)phase->allocations,
+                    (unsigned long long)phase->frees,
+                    (unsigned long long)phase->bytes);
+        } else {
+            fprintf(out, "%-10s %12s %12s %14s", kPhaseNames[i], "-", "-",
+                    "-");
+        }
+        fprintf(out, " %12llu %14llu\n",
+                (unsigned long long)phase->arena_allocations,
+                (unsigned long long)phase->arena_bytes);
+        total.allocations += phase->allocations;
+        total.frees += phase->frees;
+        total.bytes += phase->bytes;
+        total.arena_allocations += phase->arena_allocations;
+        total.arena_bytes += phase->arena_bytes;
+    }
+    if (stats->heap_tracked) {
+        fprintf(out, "%-10s %12llu %12llu %14llu %12llu %14llu\n", "total",
+                (unsigned long long)total.allocations,
+                (unsigned long long)total.frees,
+                (unsigned long long)total.bytes,
+                (unsigned long long)total.arena_allocations,
+                (unsigned long long)total.arena_bytes);
+        fprintf(out, "peak heap bytes: %llu\n",
+                (unsigned long long)stats->peak_bytes);
+    } else {
+        fputs("(heap allocations are only counted in HEAP_STATS=1 builds with "
+              "glibc, so never on macOS)\n",
+              out);
+    }
+}
+
+// Arena
+
+struct ArenaChunk {
+    struct ArenaChunk *next;  // the chunk mapped before this one
+    size_t size;              // of "data"
+    atomic_size_t used;       // may run past "size" when a request overflows
+    unsigned char padding[8];
+    unsigned char data[];
+};
+
+#define kArenaAlignment 16
+
+static size_t RoundUp(size_t size) {
+    return (size + kArenaAlignment - 1) & ~(size_t)(kArenaAlignment - 1);
+}
+
+static struct ArenaChunk *MapChunk(size_t size) {
+    const size_t total = sizeof(struct ArenaChunk) + size;
+    void *p = mmap(NULL, total, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        return NULL;
+    }
+    struct ArenaChunk *chunk = p;
+    chunk->next = NULL;
+    chunk->size = size;
+    atomic_init(&chunk->used, 0);
+    return chunk;
+}
+
+static void UnmapChunk(struct ArenaChunk *chunk) {
+    munmap(chunk, sizeof(*chunk) + chunk->size);
+}
+
+void ArenaInit(struct Arena *arena) {
+    atomic_init(&arena->current, NULL);
+    pthread_mutex_init(&arena->lock, NULL);
+}
+
+void ArenaFree(struct Arena *arena) {
+    struct ArenaChunk *chunk = atomic_load(&arena->current);
+    while (chunk != NULL) {
+        struct ArenaChunk *next = chunk->next;
+        UnmapChunk(chunk);
+        chunk = next;
+    }
+    atomic_store(&arena->current, NULL);
+    pthread_mutex_destroy(&arena->lock);
+}
+
+void ArenaReset(struct Arena *arena) {
+    struct ArenaChunk *chunk = atomic_load(&arena->current);
+    if (chunk == NULL) {
+        return;
+    }
+    // Keep the oldest chunk, which has the standard size unless the first
+    // request was larger.
+    while (chunk->next != NULL) {
+        struct ArenaChunk *next = chunk->next;
+        UnmapChunk(chunk);
+        chunk = next;
+    }
+    atomic_store(&chunk->used, 0);
+    atomic_store(&arena->current, chunk);
+}
+
+void *ArenaAlloc(struct Arena *arena, size_t size) {
+    size = RoundUp(size ? size : 1);
+    for (;;) {
+        struct ArenaChunk *chunk = atomic_load(&arena->current);
+        if (chunk != NULL) {
+            const size_t offset = atomic_fetch_add(&chunk->used, size);
+            if (offset <= chunk->size && size <= chunk->size - offset) {
+                struct PhaseCounters *phase = Counters();
+                Add(&phase->arena_allocations, 1);
+                Add(&phase->arena_bytes, size);
+                return chunk->data + offset;
+            }
+        }
+        // Full (or no chunk yet): map another, unless a racing thread
+        // already has.
+        pthread_mutex_lock(&arena->lock);
+        if (atomic_load(&arena->current) == chunk) {
+            struct ArenaChunk *fresh =
+                MapChunk(size > kArenaChunkSize ? size : kArenaChunkSize);
+            if (fresh == NULL) {
+                pthread_mutex_unlock(&arena->lock);
+                return NULL;
+            }
+            fresh->next = chunk;
+            atomic_store(&arena->current, fresh);
+        }
+        pthread_mutex_unlock(&arena->lock);
+    }
+}
+
+void *ArenaCalloc(struct Arena *arena, size_t count, size_t size) {
+    if (size != 0 && count > SIZE_MAX / size) {
+        return NULL;
+    }
+    // Fresh chunks are zero, but reset ones aren't.
+    void *p = ArenaAlloc(arena, count * size);
+    if (p != NULL) {
+        memset(p, 0, count * size);
+    }
+    return p;
+}
+
+void *ArenaRealloc(struct Arena *arena, void *p, size_t old_size,
+                   size_t new_size) {
+    if (p == NULL) {
+        return ArenaAlloc(arena, new_size);
+    }
+    struct ArenaChunk *chunk = atomic_load(&arena->current);
+    const unsigned char *start = p;
+    const int in_chunk = chunk != NULL && start >= chunk->data &&
+                         start < chunk->data + chunk->size;
+    const size_t offset = in_chunk ? (size_t)(start - chunk->data) : 0;
+    size_t end = offset + RoundUp(old_size);
+    if (in_chunk && RoundUp(new_size) <= chunk->size - offset &&
+        atomic_compare_exchange_strong(&chunk->used, &end,
+                                       offset + RoundUp(new_size))) {
+        // The latest allocation grows (or shrinks) where it is.
+        if (new_size > old_size) {
+            struct PhaseCounters *phase = Counters();
+            Add(&phase->arena_allocations, 1);
+            Add(&phase->arena_bytes, RoundUp(new_size) - RoundUp(old_size));
+        }
+        return p;
+    }
+    void *q = ArenaAlloc(arena, new_size);
+    if (q != NULL) {
+        memcpy(q, p, old_size < new_size ? old_size : new_size);
+    }
+    return q;
+}
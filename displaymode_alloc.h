@@ -0,0 +1,110 @@
+#ifndef DISPLAYMODE_ALLOC_H
+#define DISPLAYMODE_ALLOC_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Steps of an invocation that allocations are counted for.
+enum AllocPhase {
+    kAllocPhaseStartup = 0,  // parsing, opening caches
+    kAllocPhaseEnumerate,    // reading displays and modes
+    kAllocPhaseFormat,       // building tables, formatting and serializing
+    kAllocPhaseWrite,        // writing the output
+    kAllocPhaseFinish,       // publishing, flushing caches, tearing down
+    kAllocPhaseCount,
+};
+
+// Allocations made during one phase.
+struct AllocPhaseStats {
+    // General-heap calls (malloc, calloc, realloc and the aligned variants)
+    // and frees, and the bytes they requested.
+    uint64_t allocations;
+    uint64_t frees;
+    uint64_t bytes;
+    // Allocations served by an Arena, and their bytes.
+    uint64_t arena_allocations;
+    uint64_t arena_bytes;
+};
+
+struct AllocStats {
+    struct AllocPhaseStats phases[kAllocPhaseCount];
+    // Most general-heap bytes live at once since the counters were reset.
+    uint64_t peak_bytes;
+    // Non-zero if general-heap calls are counted, which takes the shim in
+    // displaymode_alloc_heap.c; otherwise only arena allocations are.
+    int heap_tracked;
+};
+
+// Attributes the allocations that follow, from any thread, to "phase".
+void AllocSetPhase(enum AllocPhase phase);
+
+enum AllocPhase AllocGetPhase(void);
+
+// Copies the counters into "stats".
+void AllocGetStats(struct AllocStats *stats);
+
+// Zeroes the counters; the peak restarts from the bytes live now.
+void AllocResetStats(void);
+
+// Returns the general-heap allocations made so far in every phase.
+uint64_t AllocHeapAllocations(void);
+
+// Hooks for the shim that counts general-heap calls by interposing glibc's
+// allocator (displaymode_alloc_heap.c, linked in by HEAP_STATS=1 builds, the
+// allocation test and bench_suite).  AllocTrackHeap marks heap calls as
+// counted; the others record an allocation of "bytes" requested bytes, or a
+// free, and the change in live (usable) bytes.
+void AllocTrackHeap(void);
+void AllocCountHeapAllocation(uint64_t bytes, int64_t live_delta);
+void AllocCountHeapFree(int64_t live_delta);
+
+// Writes "stats" as a table of allocations per phase (the --stats report).
+void AllocWriteStats(const struct AllocStats *stats, FILE *out);
+
+// Size of the chunks an arena maps; larger requests get a chunk of their
+// own.
+#define kArenaChunkSize ((size_t)4 << 20)
+
+struct ArenaChunk;
+
+// Scratch memory for one command: allocations bump a pointer through chunks
+// mapped straight from the OS, so they never touch the general heap, and
+// are all released at once by ArenaReset.  ArenaAlloc may be called from
+// several threads at a time; ArenaReset and ArenaFree may not.
+struct Arena {
+    _Atomic(struct ArenaChunk *) current;
+    // Serializes mapping new chunks.
+    pthread_mutex_t lock;
+};
+
+void ArenaInit(struct Arena *arena);
+
+// Unmaps every chunk.
+void ArenaFree(struct Arena *arena);
+
+// Releases every allocation, keeping the first chunk for the next command.
+void ArenaReset(struct Arena *arena);
+
+// Returns "size" bytes aligned to 16, or NULL if out of memory.
+void *ArenaAlloc(struct Arena *arena, size_t size);
+
+// Like ArenaAlloc, but zeroed.
+void *ArenaCalloc(struct Arena *arena, size_t count, size_t size);
+
+// Resizes the "old_size" bytes at "p" (which may be NULL) to "new_size",
+// in place if "p" is the arena's latest allocation and its chunk has room.
+void *ArenaRealloc(struct Arena *arena, void *p, size_t old_size,
+                   size_t new_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DISPLAYMODE_ALLOC_H
@@ -0,0 +1,132 @@
+// Counts general-heap calls for displaymode_alloc.h by interposing glibc's
+// allocator, so that every library's allocations (stdio buffers, pthreads)
+// are counted too.  Replacing malloc is process-wide, so only builds that
+// ask for it link this in (HEAP_STATS=1, the allocation test and
+// bench_suite); elsewhere, and under sanitizers, which interpose the
+// allocator themselves, only arena allocations are counted.
+
+#define _DEFAULT_SOURCE
+
+#include "displaymode_alloc.h"
+
+#if defined(__has_feature)
+#if __has_feature(address_sanitizer) || __has_feature(memory_sanitizer) || \
+    __has_feature(thread_sanitizer)
+#define kSanitized 1
+#endif
+#endif
+#if defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_THREAD__)
+#define kSanitized 1
+#endif
+
+#if defined(__GLIBC__) && !defined(kSanitized)
+
+#include <errno.h>
+#include <stdlib.h>
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *p, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+extern void *__libc_valloc(size_t size);
+extern void *__libc_pvalloc(size_t size);
+extern void __libc_free(void *p);
+extern size_t malloc_usable_size(void *p);
+
+__attribute__((constructor)) static void TrackHeap(void) {
+    AllocTrackHeap();
+}
+
+// Records a new block "p" of "size" requested bytes (a failed allocation
+// counts, but adds no bytes).
+static void *Allocated(void *p, size_t size) {
+    if (p == NULL) {
+        AllocCountHeapAllocation(0, 0);
+    } else {
+        AllocCountHeapAllocation(size, (int64_t)malloc_usable_size(p));
+    }
+    return p;
+}
+
+static int IsPowerOfTwo(size_t n) {
+    return n != 0 && (n & (n - 1)) == 0;
+}
+
+void *malloc(size_t size) {
+    return Allocated(__libc_malloc(size), size);
+}
+
+void *calloc(size_t count, size_t size) {
+    if (size != 0 && count > SIZE_MAX / size) {
+        errno = ENOMEM;
+        return Allocated(NULL, 0);
+    }
+    return Allocated(__libc_calloc(count, size), count * size);
+}
+
+void *realloc(void *p, size_t size) {
+    const int64_t old_size = p != NULL ? (int64_t)malloc_usable_size(p) : 0;
+    void *q = __libc_realloc(p, size);
+    if (p != NULL && size == 0) {
+        // Frees "p".
+        AllocCountHeapFree(-old_size);
+        return q;
+    }
+    if (q == NULL) {
+        AllocCountHeapAllocation(0, 0);
+    } else {
+        AllocCountHeapAllocation(size,
+                                 (int64_t)malloc_usable_size(q) - old_size);
+    }
+    return q;
+}
+
+void *reallocarray(void *p, size_t count, size_t size) {
+    if (size != 0 && count > SIZE_MAX / size) {
+        errno = ENOMEM;
+        return Allocated(NULL, 0);
+    }
+    return realloc(p, count * size);
+}
+
+void *memalign(size_t alignment, size_t size) {
+    return Allocated(__libc_memalign(alignment, size), size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+    if (!IsPowerOfTwo(alignment)) {
+        errno = EINVAL;
+        return Allocated(NULL, 0);
+    }
+    return Allocated(__libc_memalign(alignment, size), size);
+}
+
+int posix_memalign(void **p, size_t alignment, size_t size) {
+    if (alignment % sizeof(void *) != 0 || !IsPowerOfTwo(alignment)) {
+        return EINVAL;
+    }
+    void *q = Allocated(__libc_memalign(alignment, size), size);
+    if (q == NULL) {
+        return ENOMEM;
+    }
+    *p = q;
+    return 0;
+}
+
+void *valloc(size_t size) {
+    return Allocated(__libc_valloc(size), size);
+}
+
+void *pvalloc(size_t size) {
+    return Allocated(__libc_pvalloc(size), size);
+}
+
+void free(void *p) {
+    if (p == NULL) {
+        return;
+    }
+    AllocCountHeapFree(-(int64_t)malloc_usable_size(p));
+    __libc_free(p);
+}
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef DISPLAYMODE_BACKEND_H
+#define DISPLAYMODE_BACKEND_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Error returned when a display index is out of range (matches
+// kCGErrorRangeCheck).
+#define kDisplayErrorRangeCheck 1007
+
+// Error returned when a backend call fails without a more specific code
+// (matches kCGErrorFailure).
+#define kDisplayErrorFailure 1000
+
+// A display mode as reported by a backend.
+struct DisplayMode {
+    size_t width;
+    size_t height;
+    double refresh_rate;
+    int usable_for_desktop;
+    int mode_id;
+    // Opaque backend reference (e.g. a CGDisplayModeRef), valid until the
+    // owning DisplayModeList is released.
+    const void *handle;
+};
+
+// Every mode of one display, plus the display's current mode.
+struct DisplayModeList {
+    struct DisplayMode *modes;
+    size_t count;
+    struct DisplayMode current;
+    int has_current;
+    // Index of the current mode in "modes", or -1 if it isn't listed.
+    ptrdiff_t current_index;
+    // Backend-private storage, freed by release_modes.
+    void *backend_data;
+};
+
+// Identifies a physical display across reconnections (like
+// CGDisplayVendorNumber, CGDisplayModelNumber and CGDisplaySerialNumber).
+struct DisplayIdentity {
+    uint32_t vendor;
+    uint32_t model;
+    uint32_t serial;
+};
+
+// The operations displaymode needs from the platform.  Functions return 0 on
+// success, or a backend-specific error code (a CGError for CoreGraphics).
+struct DisplayBackend {
+    void *context;
+    // Like CGGetActiveDisplayList: stores at most "max_displays" IDs, or with
+    // "displays" NULL, just the number of active displays.
+    int (*get_active_displays)(void *context, uint32_t max_displays,
+                               uint32_t *displays, uint32_t *num_displays);
+    // Fills "list" with the display's modes.  Succeeds if either the mode
+    // list or the current mode could be read.
+    int (*copy_modes)(void *context, uint32_t display,
+                      struct DisplayModeList *list);
+    void (*release_modes)(void *context, struct DisplayModeList *list);
+    // Optional: fills only the current mode of "list", leaving it with no
+    // other modes.  The list is released with release_modes.
+    int (*copy_current_mode)(void *context, uint32_t display,
+                             struct DisplayModeList *list);
+    // Optional: reads the display's identity.
+    int (*get_display_identity)(void *context, uint32_t display,
+                                struct DisplayIdentity *identity);
+    // Optional: points "*data" at the display's EDID (the base block and its
+    // extensions, or a DisplayID section) and stores its size in "*size".
+    // The bytes stay valid until the next call of the backend.
+    int (*get_edid)(void *context, uint32_t display, const unsigned char **data,
+                    size_t *size);
+    // Like CGBeginDisplayConfiguration and friends.
+    int (*begin_configuration)(void *context, void **config);
+    int (*configure_display)(void *context, void *config, uint32_t display,
+                             const struct DisplayMode *mode);
+    int (*complete_configuration)(void *context, void *config);
+    void (*cancel_configuration)(void *context, void *config);
+    // Non-zero if copy_modes may be called for different displays at the
+    // same time from different threads.
+    int concurrent_copy_modes;
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DISPLAYMODE_BACKEND_H
@@ -0,0 +1,231 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "displaymode_batch.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "displaymode_commands.h"
+#include "displaymode_json.h"
+#include "displaymode_parse.h"
+#include "logging.h"
+
+// Bytes read from the input at a time.  Must be more than
+// kMaxBatchLineLength, so that any line that fits can be seen whole.
+#define kBatchReadSize 65536
+
+// State shared by the commands of a batch.  The streams that collect each
+// command's output are reused, so that commands after the first allocate
+// nothing once the buffers have grown.
+struct Batch {
+    struct DisplayCatalog *catalog;
+    struct JsonWriter json;
+    char *command_out_text;
+    size_t command_out_len;
+    FILE *command_out;
+    char *command_err_text;
+    size_t command_err_len;
+    FILE *command_err;
+    unsigned long failures;
+    int read_error;
+};
+
+// Splits a copy of "line" into words and parses them with ParseArgs, for
+// the lines ParseCommandLine leaves to it.  "copy" must outlive the result.
+static int ParseWords(const char *line, size_t length,
+                      char copy[kMaxBatchLineLength + 1],
+                      struct ParsedArgs *parsed_args) {
+    const char *argv[kMaxBatchArgs + 2];
+    int argc = 0;
+    argv[argc++] = "displaymode";
+    memcpy(copy, line, length);
+    copy[length] = '\0';
+    char *save = NULL;
+    for (char *word = strtok_r(copy, " \t\r", &save); word != NULL;
+         word = strtok_r(NULL, " \t\r", &save)) {
+        if (argc == kMaxBatchArgs + 1) {
+            return -1;
+        }
+        argv[argc++] = word;
+    }
+    argv[argc] = NULL;
+    *parsed_args = ParseArgs(argc, argv);
+    return 0;
+}
+
+// Runs one command line, numbered "line_number", and writes its result.
+static void RunLine(struct Batch *batch, unsigned long line_number,
+                    const char *line, size_t length) {
+    while (length > 0 && (line[0] == ' ' || line[0] == '\t' ||
+                          line[0] == '\r')) {
+        ++line;
+        --length;
+    }
+    if (length == 0 || line[0] == '#') {
+        return;
+    }
+    rewind(batch->command_out);
+    rewind(batch->command_err);
+
+    struct ParsedArgs parsed_args;
+    char copy[kMaxBatchLineLength + 1];
+    int status = EXIT_FAILURE;
+    if (length > kMaxBatchLineLength) {
+        fputs("Line too long\n", batch->command_err);
+    } else if (ParseCommandLine(line, length, &parsed_args) &&
+               ParseWords(line, length, copy, &parsed_args)) {
+        fputs("Too many words\n", batch->command_err);
+    } else if (parsed_args.option == kOptionBatch ||
+               parsed_args.option == kOptionServer ||
+               parsed_args.option == kOptionWatch) {
+        fprintf(batch->command_err, "'%c' can't run in batch mode\n",
+                (char)parsed_args.option);
+    } else {
+        status = RunCommand(batch->catalog, &parsed_args, batch->command_out,
+                            batch->command_err);
+        if (batch->catalog->scratch != NULL) {
+            ArenaReset(batch->catalog->scratch);
+        }
+    }
+    if (status != EXIT_SUCCESS) {
+        ++batch->failures;
+    }
+    fflush(batch->command_out);
+    fflush(batch->command_err);
+
+    struct JsonWriter *json = &batch->json;
+    JsonWriterBeginObject(json);
+    JsonWriterKey(json, "line");
+    JsonWriterUint(json, line_number);
+    JsonWriterKey(json, "status");
+    JsonWriterInt(json, status);
+    if (batch->command_out_len > 0) {
+        JsonWriterKey(json, "output");
+        JsonWriterStringLength(json, batch->command_out_text,
+                               batch->command_out_len);
+    }
+    if (batch->command_err_len > 0) {
+        JsonWriterKey(json, "error");
+        JsonWriterStringLength(json, batch->command_err_text,
+                               batch->command_err_len);
+    }
+    JsonWriterEndObject(json);
+    JsonWriterEndLine(json);
+}
+
+// Reads up to "size" bytes of "in".  Streams backed by a file descriptor are
+// read directly, so that a command arriving on a pipe runs without waiting
+// for the buffer to fill.  Returns 0 at the end of the input or on error.
+static size_t ReadInput(struct Batch *batch, FILE *in, char *buffer,
+                        size_t size) {
+    const int fd = fileno(in);
+    if (fd < 0) {
+        const size_t n = fread(buffer, 1, size, in);
+        batch->read_error |= ferror(in);
+        return n;
+    }
+    for (;;) {
+        const ssize_t n = read(fd, buffer, size);
+        if (n >= 0) {
+            return (size_t)n;
+        }
+        if (errno != EINTR) {
+            batch->read_error = 1;
+            return 0;
+        }
+    }
+}
+
+// Reads "in" and runs each line.  Lines longer than kMaxBatchLineLength are
+// reported as errors without being buffered whole.
+static void RunLines(struct Batch *batch, FILE *in, char *buffer) {
+    size_t length = 0;
+    unsigned long line_number = 0;
+    int skipping = 0;  // in the rest of a line that was too long
+    for (;;) {
+        // Results of a batch read from a pipe are sent before blocking for
+        // more commands; from a file they go out a buffer at a time.
+        if (JsonWriterFlush(&batch->json) == 0) {
+            fflush(batch->json.out);
+        }
+        const size_t n =
+            ReadInput(batch, in, buffer + length, kBatchReadSize - length);
+        const int at_end = n == 0;
+        length += n;
+        size_t start = 0;
+        for (;;) {
+            const char *newline =
+                memchr(buffer + start, '\n', length - start);
+            if (newline == NULL) {
+                break;
+            }
+            const size_t line_length = (size_t)(newline - buffer) - start;
+            if (skipping) {
+                skipping = 0;
+            } else {
+                RunLine(batch, ++line_number, buffer + start, line_length);
+            }
+            start += line_length + 1;
+        }
+        memmove(buffer, buffer + start, length - start);
+        length -= start;
+        if (at_end) {
+            if (length > 0 && !skipping) {
+                RunLine(batch, ++line_number, buffer, length);
+            }
+            return;
+        }
+        if (length > kMaxBatchLineLength) {
+            if (!skipping) {
+                // Reported now; the rest of it is dropped as it arrives.
+                RunLine(batch, ++line_number, buffer, length);
+                skipping = 1;
+            }
+            length = 0;
+        }
+    }
+}
+
+int DisplayBatchRun(struct DisplayCatalog *catalog, FILE *in, FILE *out,
+                    FILE *err) {
+    struct Batch *batch = calloc(1, sizeof(*batch));
+    char *buffer = malloc(kBatchReadSize);
+    if (batch != NULL) {
+        batch->catalog = catalog;
+        JsonWriterInit(&batch->json, out);
+        batch->command_out = open_memstream(&batch->command_out_text,
+                                            &batch->command_out_len);
+        batch->command_err = open_memstream(&batch->command_err_text,
+                                            &batch->command_err_len);
+    }
+    int status = EXIT_FAILURE;
+    if (batch == NULL || buffer == NULL || batch->command_out == NULL ||
+        batch->command_err == NULL) {
+        fputs("Out of memory starting the batch\n", err);
+    } else {
+        RunLines(batch, in, buffer);
+        LOG_DEBUG("Batch finished with %lu failed commands", batch->failures);
+        if (batch->read_error) {
+            fputs("Failed to read commands\n", err);
+        } else if (JsonWriterFlush(&batch->json) || fflush(out)) {
+            fputs("Failed to write results\n", err);
+        } else if (batch->failures == 0) {
+            status = EXIT_SUCCESS;
+        }
+    }
+    if (batch != NULL) {
+        if (batch->command_out != NULL) {
+            fclose(batch->command_out);
+        }
+        if (batch->command_err != NULL) {
+            fclose(batch->command_err);
+        }
+        free(batch->command_out_text);
+        free(batch->command_err_text);
+    }
+    free(batch);
+    free(buffer);
+    return status;
+}
@@ -0,0 +1,33 @@
+#ifndef DISPLAYMODE_BATCH_H
+#define DISPLAYMODE_BATCH_H
+
+#include <stdio.h>
+
+#include "displaymode_catalog.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Longest command line accepted in batch mode, in bytes.
+#define kMaxBatchLineLength 4096
+
+// Most words in a command line that needs ParseArgs.
+#define kMaxBatchArgs 128
+
+// Runs the commands read from "in", one per line (like "t 1920 1080 @60 1"
+// or "d"), against "catalog", which enumerates the displays once for the
+// whole batch.  Blank lines and lines starting with '#' are skipped.  Each
+// command's result is written to "out" as one line of JSON:
+//   {"line":<n>,"status":<status>,"output":"...","error":"..."}
+// where "status" is what RunCommand returned (as sent by the server), and
+// "output" and "error" (left out if empty) are what the command printed.
+// Returns EXIT_SUCCESS if every command succeeded, or EXIT_FAILURE.
+int DisplayBatchRun(struct DisplayCatalog *catalog, FILE *in, FILE *out,
+                    FILE *err);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DISPLAYMODE_BATCH_H
@@ -0,0 +1,300 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "displaymode_cache.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char kMagic[8] = {'D', 'M', 'C', 'A', 'C', 'H', 'E', '\0'};
+
+uint64_t DisplayCacheHash(uint64_t hash, const void *data, size_t size) {
+    const unsigned char *bytes = data;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+int DisplayCacheDefaultPath(char *out, size_t out_size) {
+    const char *home = getenv("HOME");
+#ifdef __APPLE__
+    if (home == NULL || home[0] == '\0') {
+        return -1;
+    }
+    snprintf(out, out_size, "%s/Library/Caches/displaymode.modes", home);
+#else
+    const char *cache_home = getenv("XDG_CACHE_HOME");
+    if (cache_home != NULL && cache_home[0] != '\0') {
+        snprintf(out, out_size, "%s/displaymode.modes", cache_home);
+    } else if (home != NULL && home[0] != '\0') {
+        snprintf(out, out_size, "%s/.cache/displaymode.modes", home);
+    } else {
+        return -1;
+    }
+#endif
+    return 0;
+}
+
+// Checks that the mapped file is a complete cache.
+static int Validate(struct DisplayCache *cache) {
+    const struct DisplayCacheHeader *header =
+        (const struct DisplayCacheHeader *)cache->data;
+    const size_t expected = sizeof(*header) +
+        (size_t)header->num_entries * sizeof(struct DisplayCacheEntry) +
+        (size_t)header->num_modes * sizeof(struct DisplayCacheMode);
+    if (cache->size != expected) {
+        return -1;
+    }
+    const struct DisplayCacheEntry *entries =
+        (const struct DisplayCacheEntry *)(header + 1);
+    for (uint32_t i = 0; i < header->num_entries; ++i) {
+        if (entries[i].first_mode > header->num_modes ||
+            entries[i].mode_count > header->num_modes - entries[i].first_mode ||
+            (i > 0 && entries[i - 1].key >= entries[i].key)) {
+            return -1;
+        }
+    }
+    cache->header = header;
+    cache->entries = entries;
+    cache->modes = (const struct DisplayCacheMode *)(entries + header->num_entries);
+    return 0;
+}
+
+static void Unmap(struct DisplayCache *cache) {
+    DisplayFileUnmap(&cache->data, &cache->size);
+    cache->header = NULL;
+    cache->entries = NULL;
+    cache->modes = NULL;
+}
+
+int DisplayCacheOpen(struct DisplayCache *cache, const char *path) {
+    memset(cache, 0, sizeof(*cache));
+    if (strlen(path) >= sizeof(cache->path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(cache->path, path);
+
+    if (DisplayFileMap(path, kMagic, kDisplayCacheVersion,
+                       sizeof(struct DisplayCacheHeader), &cache->data,
+                       &cache->size) == 0 &&
+        Validate(cache)) {
+        Unmap(cache);
+    }
+    return 0;
+}
+
+// Returns the entry for "key", or NULL.
+static const struct DisplayCacheEntry *FindEntry(const struct DisplayCache *cache,
+                                                 uint64_t key) {
+    if (cache->header == NULL) {
+        return NULL;
+    }
+    size_t low = 0;
+    size_t high = cache->header->num_entries;
+    while (low < high) {
+        const size_t mid = low + (high - low) / 2;
+        if (cache->entries[mid].key < key) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    if (low < cache->header->num_entries && cache->entries[low].key == key) {
+        return &cache->entries[low];
+    }
+    return NULL;
+}
+
+static int IsFresh(const struct DisplayCacheEntry *entry, int64_t now) {
+    return entry->stored_at <= now && now - entry->stored_at <= kDisplayCacheMaxAge;
+}
+
+size_t DisplayCacheLookup(const struct DisplayCache *cache, uint64_t key,
+                          uint64_t fingerprint, int64_t now,
+                          const struct DisplayCacheMode **modes) {
+    const struct DisplayCacheEntry *entry = FindEntry(cache, key);
+    if (entry == NULL || entry->fingerprint != fingerprint ||
+        !IsFresh(entry, now) || entry->mode_count == 0) {
+        return 0;
+    }
+    *modes = &cache->modes[entry->first_mode];
+    return entry->mode_count;
+}
+
+int DisplayCacheStore(struct DisplayCache *cache, uint64_t key,
+                      uint64_t fingerprint, int64_t now,
+                      const struct DisplayMode *modes, size_t count) {
+    if (count == 0 || count > UINT32_MAX) {
+        return -1;
+    }
+    // Duplicate keys are resolved by DisplayCacheFlush, so that storing
+    // every display costs the same per display however many there are.
+    if (cache->num_pending == cache->pending_capacity) {
+        const size_t capacity = cache->pending_capacity > 0
+            ? cache->pending_capacity * 2 : 8;
+        struct DisplayCachePending *grown = realloc(
+            cache->pending, capacity * sizeof(*grown));
+        if (grown == NULL) {
+            return -1;
+        }
+        cache->pending = grown;
+        cache->pending_capacity = capacity;
+    }
+    struct DisplayCachePending *pending = &cache->pending[cache->num_pending++];
+    pending->entry.key = key;
+    pending->entry.fingerprint = fingerprint;
+    pending->entry.first_mode = 0;
+    pending->entry.mode_count = (uint32_t)count;
+    pending->entry.stored_at = now;
+    pending->modes = malloc(count * sizeof(pending->modes[0]));
+    if (pending->modes == NULL) {
+        pending->entry.mode_count = 0;
+        return -1;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        struct DisplayCacheMode *cached = &pending->modes[i];
+        memset(cached, 0, sizeof(*cached));
+        cached->width = (uint32_t)modes[i].width;
+        cached->height = (uint32_t)modes[i].height;
+        cached->refresh_rate = modes[i].refresh_rate;
+        cached->mode_id = modes[i].mode_id;
+        cached->flags = modes[i].usable_for_desktop ? kDisplayCacheModeUsable : 0;
+    }
+    return 0;
+}
+
+void DisplayCacheModeToDisplayMode(const struct DisplayCacheMode *cached,
+                                   struct DisplayMode *mode) {
+    mode->width = cached->width;
+    mode->height = cached->height;
+    mode->refresh_rate = cached->refresh_rate;
+    mode->usable_for_desktop = (cached->flags & kDisplayCacheModeUsable) != 0;
+    mode->mode_id = cached->mode_id;
+    mode->handle = NULL;
+}
+
+// An entry to write, with the modes it refers to.
+struct OutputEntry {
+    struct DisplayCacheEntry entry;
+    const struct DisplayCacheMode *modes;
+    // Position among the pending entries, so the latest store wins.
+    size_t order;
+};
+
+// Orders by key, then by when the entry was stored.
+static int CompareOutputEntries(const void *a, const void *b) {
+    const struct OutputEntry *x = a;
+    const struct OutputEntry *y = b;
+    if (x->entry.key != y->entry.key) {
+        return (x->entry.key > y->entry.key) - (x->entry.key < y->entry.key);
+    }
+    return (x->order > y->order) - (x->order < y->order);
+}
+
+int DisplayCacheFlush(struct DisplayCache *cache, int64_t now) {
+    if (cache->num_pending == 0) {
+        return 0;
+    }
+    const size_t old_entries = cache->header ? cache->header->num_entries : 0;
+    struct OutputEntry *out = malloc((old_entries + cache->num_pending) * sizeof(*out));
+    if (out == NULL) {
+        return -1;
+    }
+    // Sort the new entries, keeping the latest for each key, at the end of
+    // "out"; then merge them with the old entries (already sorted) at the
+    // front.
+    struct OutputEntry *new_entries = out + old_entries;
+    size_t num_new = 0;
+    for (size_t i = 0; i < cache->num_pending; ++i) {
+        new_entries[num_new].entry = cache->pending[i].entry;
+        new_entries[num_new].modes = cache->pending[i].modes;
+        new_entries[num_new].order = i;
+        ++num_new;
+    }
+    qsort(new_entries, num_new, sizeof(new_entries[0]), CompareOutputEntries);
+    size_t num_latest = 0;
+    for (size_t i = 0; i < num_new; ++i) {
+        if (i + 1 < num_new &&
+            new_entries[i + 1].entry.key == new_entries[i].entry.key) {
+            continue;
+        }
+        if (new_entries[i].entry.mode_count > 0) {
+            new_entries[num_latest++] = new_entries[i];
+        }
+    }
+    size_t num_out = 0;
+    size_t next_new = 0;
+    for (size_t i = 0; i < old_entries; ++i) {
+        const struct DisplayCacheEntry *entry = &cache->entries[i];
+        while (next_new < num_latest &&
+               new_entries[next_new].entry.key < entry->key) {
+            out[num_out++] = new_entries[next_new++];
+        }
+        const int replaced = next_new < num_latest &&
+            new_entries[next_new].entry.key == entry->key;
+        if (!replaced && IsFresh(entry, now)) {
+            out[num_out].entry = *entry;
+            out[num_out].modes = &cache->modes[entry->first_mode];
+            ++num_out;
+        }
+    }
+    while (next_new < num_latest) {
+        out[num_out++] = new_entries[next_new++];
+    }
+
+    struct DisplayCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    DisplayFileHeaderInit(&header.file, kMagic, kDisplayCacheVersion);
+    header.num_entries = (uint32_t)num_out;
+    header.created = now;
+    for (size_t i = 0; i < num_out; ++i) {
+        out[i].entry.first_mode = header.num_modes;
+        header.num_modes += out[i].entry.mode_count;
+    }
+
+    struct DisplayFileWriter writer;
+    int e = DisplayFileCreate(&writer, cache->path);
+    if (!e) {
+        DisplayFileWrite(&writer, &header, sizeof(header));
+        for (size_t i = 0; i < num_out; ++i) {
+            DisplayFileWrite(&writer, &out[i].entry, sizeof(out[i].entry));
+        }
+        for (size_t i = 0; i < num_out; ++i) {
+            DisplayFileWrite(&writer, out[i].modes,
+                             out[i].entry.mode_count * sizeof(out[i].modes[0]));
+        }
+        e = DisplayFileReplace(&writer);
+    }
+    free(out);
+    if (e) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < cache->num_pending; ++i) {
+        free(cache->pending[i].modes);
+    }
+    free(cache->pending);
+    cache->pending = NULL;
+    cache->num_pending = 0;
+    cache->pending_capacity = 0;
+    // Pick up the file just written.
+    char path[sizeof(cache->path)];
+    strcpy(path, cache->path);
+    Unmap(cache);
+    return DisplayCacheOpen(cache, path);
+}
+
+void DisplayCacheClose(struct DisplayCache *cache) {
+    Unmap(cache);
+    for (size_t i = 0; i < cache->num_pending; ++i) {
+        free(cache->pending[i].modes);
+    }
+    free(cache->pending);
+    cache->pending = NULL;
+    cache->num_pending = 0;
+    cache->pending_capacity = 0;
+}
@@ -0,0 +1,119 @@
+#ifndef DISPLAYMODE_CACHE_H
+#define DISPLAYMODE_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "displaymode_backend.h"
+#include "displaymode_file.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Version of the cache file layout; files with another version are ignored.
+#define kDisplayCacheVersion 1
+
+// Entries older than this are treated as missing (seconds).
+#define kDisplayCacheMaxAge (7 * 24 * 60 * 60)
+
+// The cache file holds each display's mode list so that listing modes
+// doesn't need a full enumeration.  It is a displaymode_file.h file.
+//
+// Layout (native byte order):
+//   struct DisplayCacheHeader
+//   struct DisplayCacheEntry[num_entries], sorted by key
+//   struct DisplayCacheMode[num_modes]
+//
+// An entry is used only if its key (the display's identity) and fingerprint
+// (the display configuration it was enumerated under) both match and it is
+// younger than kDisplayCacheMaxAge.  Files with the wrong magic, version,
+// byte order or size are ignored and rewritten on the next flush.
+
+struct DisplayCacheHeader {
+    struct DisplayFileHeader file;
+    uint32_t num_entries;
+    uint32_t num_modes;
+    int64_t created;
+};
+
+struct DisplayCacheEntry {
+    uint64_t key;
+    uint64_t fingerprint;
+    uint32_t first_mode;
+    uint32_t mode_count;
+    int64_t stored_at;
+};
+
+// Flags in DisplayCacheMode.
+enum {
+    kDisplayCacheModeUsable = 1u << 0,
+};
+
+struct DisplayCacheMode {
+    uint32_t width;
+    uint32_t height;
+    double refresh_rate;
+    int32_t mode_id;
+    uint32_t flags;
+};
+
+// Mode lists waiting to be written by DisplayCacheFlush.
+struct DisplayCachePending {
+    struct DisplayCacheEntry entry;
+    struct DisplayCacheMode *modes;
+};
+
+// An open cache file.
+struct DisplayCache {
+    char path[1024];
+    const unsigned char *data;
+    size_t size;
+    const struct DisplayCacheHeader *header;
+    const struct DisplayCacheEntry *entries;
+    const struct DisplayCacheMode *modes;
+    // Stored in order; a later store for a key replaces earlier ones.
+    struct DisplayCachePending *pending;
+    size_t num_pending;
+    size_t pending_capacity;
+};
+
+// Writes the per-user default cache path into "out".  Returns 0, or -1 if
+// there is no home directory.
+int DisplayCacheDefaultPath(char *out, size_t out_size);
+
+// Maps the cache file at "path".  A missing or invalid file yields an empty
+// cache.  Returns 0, or -1 if "path" is too long.
+int DisplayCacheOpen(struct DisplayCache *cache, const char *path);
+
+// Finds the modes stored for "key".  Returns the number of modes and sets
+// "*modes", or returns 0 if there is no usable entry.
+size_t DisplayCacheLookup(const struct DisplayCache *cache, uint64_t key,
+                          uint64_t fingerprint, int64_t now,
+                          const struct DisplayCacheMode **modes);
+
+// Queues "modes" to replace the entry for "key" on the next flush.
+int DisplayCacheStore(struct DisplayCache *cache, uint64_t key,
+                      uint64_t fingerprint, int64_t now,
+                      const struct DisplayMode *modes, size_t count);
+
+// Rewrites the file with the queued entries plus the still-valid existing
+// ones.  Does nothing if nothing was stored.  Returns 0, or -1 with errno set.
+int DisplayCacheFlush(struct DisplayCache *cache, int64_t now);
+
+void DisplayCacheClose(struct DisplayCache *cache);
+
+// Converts a cached mode back to a DisplayMode (without a backend handle).
+void DisplayCacheModeToDisplayMode(const struct DisplayCacheMode *cached,
+                                   struct DisplayMode *mode);
+
+// 64-bit FNV-1a, used for cache keys and fingerprints.
+uint64_t DisplayCacheHash(uint64_t hash, const void *data, size_t size);
+
+#define kDisplayCacheHashSeed 14695981039346656037ULL
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DISPLAYMODE_CACHE_H
@@ -0,0 +1,773 @@
+#include "displaymode_catalog.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/utsname.h>
+#include <time.h>
+
+#include "displaymode_parse.h"
+#include "displaymode_pool.h"
+#include "displaymode_trace.h"
+
+// Most tables DisplayCatalogLoadAllModes builds per worker pool run, so that
+// their indices fit on the stack.
+#define kDisplayCatalogTableBatch 64
+
+static void ResetModeList(struct DisplayModeList *list) {
+    memset(list, 0, sizeof(*list));
+    list->current_index = -1;
+}
+
+void DisplayCatalogInit(struct DisplayCatalog *catalog,
+                        const struct DisplayBackend *backend) {
+    memset(catalog, 0, sizeof(*catalog));
+    catalog->backend = backend;
+    catalog->max_threads = kDisplayCatalogThreads;
+}
+
+// Grows "*array" of "size"-byte elements to "capacity" elements, zeroing the
+// new ones.  Returns 0, or -1 if out of memory.
+static int GrowArray(void *array, size_t size, uint32_t old_capacity,
+                     uint32_t capacity) {
+    void **p = array;
+    char *grown = realloc(*p, (size_t)capacity * size);
+    if (grown == NULL) {
+        return -1;
+    }
+    memset(grown + (size_t)old_capacity * size, 0,
+           (size_t)(capacity - old_capacity) * size);
+    *p = grown;
+    return 0;
+}
+
+// Makes room for "num_displays" displays in the per-display arrays.
+// Returns 0, or -1 if out of memory.
+static int ReserveDisplays(struct DisplayCatalog *catalog,
+                           uint32_t num_displays) {
+    if (num_displays <= catalog->capacity) {
+        return 0;
+    }
+    const uint32_t old = catalog->capacity;
+    uint32_t capacity = old > 0 ? old : 4;
+    while (capacity < num_displays) {
+        capacity *= 2;
+    }
+    if (GrowArray(&catalog->displays, sizeof(*catalog->displays), old,
+                  capacity) ||
+        GrowArray(&catalog->modes, sizeof(*catalog->modes), old, capacity) ||
+        GrowArray(&catalog->has_modes, sizeof(*catalog->has_modes), old,
+                  capacity) ||
+        GrowArray(&catalog->from_cache, sizeof(*catalog->from_cache), old,
+                  capacity) ||
+        GrowArray(&catalog->index, sizeof(*catalog->index), old, capacity) ||
+        GrowArray(&catalog->has_index, sizeof(*catalog->has_index), old,
+                  capacity) ||
+        GrowArray(&catalog->table, sizeof(*catalog->table), old, capacity) ||
+        GrowArray(&catalog->has_table, sizeof(*catalog->has_table), old,
+                  capacity) ||
+        GrowArray(&catalog->edid, sizeof(*catalog->edid), old, capacity)) {
+        // Arrays that did grow keep their new size; capacity stays the
+        // smallest.
+        return -1;
+    }
+    for (uint32_t i = old; i < capacity; ++i) {
+        ResetModeList(&catalog->modes[i]);
+    }
+    catalog->capacity = capacity;
+    return 0;
+}
+
+static void ReleaseDisplayModes(struct DisplayCatalog *catalog, uint32_t index) {
+    struct DisplayModeList *list = &catalog->modes[index];
+    if (catalog->has_modes[index]) {
+        if (catalog->from_cache[index]) {
+            // Only the current mode belongs to the backend.
+            free(list->modes);
+            list->modes = NULL;
+            list->count = 0;
+        }
+        catalog->backend->release_modes(catalog->backend->context, list);
+        catalog->has_modes[index] = 0;
+        catalog->from_cache[index] = 0;
+    }
+    if (catalog->has_index[index]) {
+        DisplayModeIndexFree(&catalog->index[index]);
+        catalog->has_index[index] = 0;
+    }
+    if (catalog->has_table[index]) {
+        DisplayModeTableFree(&catalog->table[index]);
+        catalog->has_table[index] = 0;
+    }
+    catalog->edid[index] = NULL;
+    ResetModeList(list);
+}
+
+// Releases the mode lists but keeps the display list.
+static void ReleaseModes(struct DisplayCatalog *catalog) {
+    for (uint32_t i = 0; i < catalog->num_displays; ++i) {
+        ReleaseDisplayModes(catalog, i);
+    }
+}
+
+void DisplayCatalogInvalidate(struct DisplayCatalog *catalog) {
+    ReleaseModes(catalog);
+    catalog->num_displays = 0;
+    catalog->has_displays = 0;
+}
+
+void DisplayCatalogInvalidateDisplay(struct DisplayCatalog *catalog,
+                                     uint32_t index) {
+    if (index < catalog->num_displays) {
+        ReleaseDisplayModes(catalog, index);
+    }
+}
+
+void DisplayCatalogFree(struct DisplayCatalog *catalog) {
+    DisplayCatalogInvalidate(catalog);
+    free(catalog->displays);
+    free(catalog->modes);
+    free(catalog->has_modes);
+    free(catalog->from_cache);
+    free(catalog->index);
+    free(catalog->has_index);
+    free(catalog->table);
+    free(catalog->has_table);
+    free(catalog->edid);
+    EdidCacheFree(&catalog->edid_cache);
+    catalog->displays = NULL;
+    catalog->modes = NULL;
+    catalog->has_modes = NULL;
+    catalog->from_cache = NULL;
+    catalog->index = NULL;
+    catalog->has_index = NULL;
+    catalog->table = NULL;
+    catalog->has_table = NULL;
+    catalog->edid = NULL;
+    catalog->capacity = 0;
+}
+
+// Reads the active display list into a new array (to be freed) by asking
+// for the number of displays and then the list.  Returns 0, the backend's
+// error, or kDisplayErrorFailure if out of memory.
+static int ListDisplays(const struct DisplayBackend *backend,
+                        uint32_t **displays, uint32_t *num_displays) {
+    *displays = NULL;
+    *num_displays = 0;
+    for (;;) {
+        uint32_t count = 0;
+        int e = backend->get_active_displays(backend->context, 0, NULL, &count);
+        if (e) {
+            return e;
+        }
+        // One spare slot shows whether a display was added in between.
+        uint32_t *listed = malloc(((size_t)count + 1) * sizeof(*listed));
+        if (listed == NULL) {
+            return kDisplayErrorFailure;
+        }
+        uint32_t num_listed = 0;
+        e = backend->get_active_displays(backend->context, count + 1, listed,
+                                         &num_listed);
+        if (e) {
+            free(listed);
+            return e;
+        }
+        if (num_listed <= count) {
+            *displays = listed;
+            *num_displays = num_listed;
+            return 0;
+        }
+        free(listed);
+    }
+}
+
+// Replaces the display list with the "num_displays" IDs at "displays" and
+// drops the modes of the old one.  Returns 0, or -1 if out of memory.
+static int SetDisplays(struct DisplayCatalog *catalog, const uint32_t *displays,
+                       uint32_t num_displays) {
+    ReleaseModes(catalog);
+    catalog->num_displays = 0;
+    if (ReserveDisplays(catalog, num_displays)) {
+        return -1;
+    }
+    if (num_displays > 0) {
+        memcpy(catalog->displays, displays, num_displays * sizeof(displays[0]));
+    }
+    catalog->num_displays = num_displays;
+    // Arrangement changes (displays added, removed or reordered) can change
+    // the modes a display offers, e.g. when mirroring.
+    const uint64_t hash = DisplayCacheHash(kDisplayCacheHashSeed, &num_displays,
+                                           sizeof(num_displays));
+    catalog->arrangement_fingerprint =
+        DisplayCacheHash(hash, displays, num_displays * sizeof(displays[0]));
+    return 0;
+}
+
+int DisplayCatalogLoadDisplays(struct DisplayCatalog *catalog) {
+    if (catalog->has_displays) {
+        return 0;
+    }
+    struct TraceSpan span;
+    TraceSpanBegin(&span, "enumerate displays", "phase");
+    uint32_t *displays = NULL;
+    uint32_t num_displays = 0;
+    int e = ListDisplays(catalog->backend, &displays, &num_displays);
+    if (e == 0 && SetDisplays(catalog, displays, num_displays)) {
+        e = kDisplayErrorFailure;
+    }
+    free(displays);
+    TraceSpanEnd(&span);
+    if (e) {
+        return e;
+    }
+    catalog->has_displays = 1;
+    return 0;
+}
+
+int DisplayCatalogRevalidate(struct DisplayCatalog *catalog) {
+    if (!catalog->has_displays) {
+        return DisplayCatalogLoadDisplays(catalog);
+    }
+    uint32_t *displays = NULL;
+    uint32_t num_displays = 0;
+    int e = ListDisplays(catalog->backend, &displays, &num_displays);
+    if (e == 0 && (num_displays != catalog->num_displays ||
+                   memcmp(displays, catalog->displays,
+                          num_displays * sizeof(displays[0])) != 0) &&
+        SetDisplays(catalog, displays, num_displays)) {
+        e = kDisplayErrorFailure;
+    }
+    free(displays);
+    if (e) {
+        DisplayCatalogInvalidate(catalog);
+        return e;
+    }
+    return 0;
+}
+
+int DisplayModesEqual(const struct DisplayMode *a, const struct DisplayMode *b) {
+    return a->width == b->width && a->height == b->height &&
+        a->refresh_rate == b->refresh_rate && a->mode_id == b->mode_id &&
+        a->usable_for_desktop == b->usable_for_desktop;
+}
+
+void DisplayCatalogSetCache(struct DisplayCatalog *catalog,
+                            struct DisplayCache *cache) {
+    catalog->cache = cache;
+}
+
+int DisplayCatalogFlushCache(struct DisplayCatalog *catalog) {
+    if (catalog->cache == NULL) {
+        return 0;
+    }
+    return DisplayCacheFlush(catalog->cache, (int64_t)time(NULL));
+}
+
+// Computes the cache key (which display) and fingerprint (under which
+// configuration) for the display at "index".  Returns -1 if the backend
+// can't identify displays.
+static int GetCacheKey(struct DisplayCatalog *catalog, uint32_t index,
+                       uint64_t *key, uint64_t *fingerprint) {
+    const struct DisplayBackend *backend = catalog->backend;
+    struct DisplayIdentity identity;
+    if (backend->get_display_identity == NULL ||
+        backend->copy_current_mode == NULL ||
+        backend->get_display_identity(backend->context,
+                                      catalog->displays[index], &identity)) {
+        return -1;
+    }
+    if (catalog->environment_fingerprint == 0) {
+        // An OS update may change the modes a display offers.
+        struct utsname name;
+        const uint32_t version = kDisplayCacheVersion;
+        uint64_t hash = DisplayCacheHash(kDisplayCacheHashSeed, &version,
+                                         sizeof(version));
+        if (uname(&name) >= 0) {
+            hash = DisplayCacheHash(hash, name.sysname, strlen(name.sysname));
+            hash = DisplayCacheHash(hash, name.release, strlen(name.release));
+            hash = DisplayCacheHash(hash, name.version, strlen(name.version));
+        }
+        catalog->environment_fingerprint = hash;
+    }
+
+    uint64_t hash = DisplayCacheHash(kDisplayCacheHashSeed, &identity.vendor,
+                                     sizeof(identity.vendor));
+    hash = DisplayCacheHash(hash, &identity.model, sizeof(identity.model));
+    hash = DisplayCacheHash(hash, &identity.serial, sizeof(identity.serial));
+    *key = DisplayCacheHash(hash, &catalog->displays[index],
+                            sizeof(catalog->displays[index]));
+
+    // The arrangement is hashed once per display list, so that keys cost the
+    // same however many displays there are.
+    hash = DisplayCacheHash(catalog->environment_fingerprint,
+                            &catalog->arrangement_fingerprint,
+                            sizeof(catalog->arrangement_fingerprint));
+    *fingerprint = DisplayCacheHash(hash, &index, sizeof(index));
+    return 0;
+}
+
+// Reads the display's EDID and looks it up in the EDID cache, which only
+// decodes it if it hasn't seen these bytes before.  Not thread-safe.
+static void LoadEdid(struct DisplayCatalog *catalog, uint32_t index) {
+    const struct DisplayBackend *backend = catalog->backend;
+    const unsigned char *data = NULL;
+    size_t size = 0;
+    catalog->edid[index] = NULL;
+    if (backend->get_edid == NULL ||
+        backend->get_edid(backend->context, catalog->displays[index], &data,
+                          &size)) {
+        return;
+    }
+    const struct EdidCacheEntry *entry =
+        EdidCacheGet(&catalog->edid_cache, data, size);
+    if (entry != NULL && entry->valid) {
+        catalog->edid[index] = entry;
+    }
+}
+
+// Fills the display's modes from the cache, reading only its current mode
+// from the backend.  Returns -1 on a cache miss.
+static int LoadCachedModes(struct DisplayCatalog *catalog, uint32_t index) {
+    uint64_t key;
+    uint64_t fingerprint;
+    if (GetCacheKey(catalog, index, &key, &fingerprint)) {
+        return -1;
+    }
+    const struct DisplayCacheMode *cached = NULL;
+    const size_t count = DisplayCacheLookup(catalog->cache, key, fingerprint,
+                                            (int64_t)time(NULL), &cached);
+    if (count == 0) {
+        return -1;
+    }
+
+    const struct DisplayBackend *backend = catalog->backend;
+    struct DisplayModeList *list = &catalog->modes[index];
+    if (backend->copy_current_mode(backend->context, catalog->displays[index],
+                                   list)) {
+        ResetModeList(list);
+        return -1;
+    }
+    struct DisplayMode *modes = malloc(count * sizeof(modes[0]));
+    if (modes == NULL) {
+        backend->release_modes(backend->context, list);
+        ResetModeList(list);
+        return -1;
+    }
+    list->current_index = -1;
+    for (size_t i = 0; i < count; ++i) {
+        DisplayCacheModeToDisplayMode(&cached[i], &modes[i]);
+        if (list->has_current && list->current_index < 0 &&
+            DisplayModesEqual(&modes[i], &list->current)) {
+            list->current_index = (ptrdiff_t)i;
+        }
+    }
+    if (list->has_current && list->current_index < 0) {
+        // The display is in a mode the cache doesn't know about, so the
+        // cached list is stale.
+        free(modes);
+        backend->release_modes(backend->context, list);
+        ResetModeList(list);
+        return -1;
+    }
+    list->modes = modes;
+    list->count = count;
+    catalog->has_modes[index] = 1;
+    catalog->from_cache[index] = 1;
+    LoadEdid(catalog, index);
+    return 0;
+}
+
+// Records the outcome "e" of copy_modes into modes[index] and queues the
+// modes for the cache.  Not thread-safe.
+static int CommitLiveModes(struct DisplayCatalog *catalog, uint32_t index,
+                           int e) {
+    struct DisplayModeList *list = &catalog->modes[index];
+    if (e) {
+        ResetModeList(list);
+        return e;
+    }
+    catalog->has_modes[index] = 1;
+    catalog->from_cache[index] = 0;
+    LoadEdid(catalog, index);
+
+    uint64_t key;
+    uint64_t fingerprint;
+    if (catalog->cache != NULL && list->count > 0 &&
+        GetCacheKey(catalog, index, &key, &fingerprint) == 0) {
+        DisplayCacheStore(catalog->cache, key, fingerprint, (int64_t)time(NULL),
+                          list->modes, list->count);
+    }
+    return 0;
+}
+
+// Enumerates the display's modes through the backend and queues them for
+// the cache.
+static int LoadLiveModes(struct DisplayCatalog *catalog, uint32_t index) {
+    const int e = catalog->backend->copy_modes(
+        catalog->backend->context, catalog->displays[index],
+        &catalog->modes[index]);
+    return CommitLiveModes(catalog, index, e);
+}
+
+int DisplayCatalogGetModes(struct DisplayCatalog *catalog, uint32_t index,
+                           const struct DisplayModeList **list) {
+    *list = &catalog->modes[index];
+    if (catalog->has_modes[index]) {
+        return 0;
+    }
+    struct TraceSpan span;
+    TraceSpanBegin(&span, "enumerate modes", "phase");
+    span.display = catalog->displays[index];
+    int e = 0;
+    if (catalog->cache == NULL || LoadCachedModes(catalog, index) != 0) {
+        e = LoadLiveModes(catalog, index);
+    }
+    TraceSpanEnd(&span);
+    return e;
+}
+
+// Displays whose modes DisplayCatalogLoadAllModes reads from the backend.
+struct ModeLoad {
+    struct DisplayCatalog *catalog;
+    uint32_t *indices;
+    int *errors;
+};
+
+// Enumerates the modes of one display of a ModeLoad; runs on a pool thread.
+// Only touches that display's mode list.
+static void LoadModesTask(void *context, size_t task) {
+    struct ModeLoad *load = context;
+    struct DisplayCatalog *catalog = load->catalog;
+    const uint32_t index = load->indices[task];
+    struct TraceSpan span;
+    TraceSpanBegin(&span, "enumerate modes", "phase");
+    span.display = catalog->displays[index];
+    load->errors[task] = catalog->backend->copy_modes(
+        catalog->backend->context, catalog->displays[index],
+        &catalog->modes[index]);
+    TraceSpanEnd(&span);
+}
+
+// Loads the modes for DisplayCatalogLoadAllModes.
+static int LoadAllModes(struct DisplayCatalog *catalog, int *errors) {
+    if (!catalog->backend->concurrent_copy_modes || catalog->max_threads <= 1) {
+        int first_error = 0;
+        for (uint32_t i = 0; i < catalog->num_displays; ++i) {
+            const struct DisplayModeList *list = NULL;
+            errors[i] = DisplayCatalogGetModes(catalog, i, &list);
+            if (first_error == 0) {
+                first_error = errors[i];
+            }
+        }
+        return first_error;
+    }
+
+    // Nothing to do once every display is loaded, as when the catalog is
+    // listed again.
+    uint32_t loaded = 0;
+    while (loaded < catalog->num_displays && catalog->has_modes[loaded]) {
+        errors[loaded++] = 0;
+    }
+    if (loaded == catalog->num_displays) {
+        return 0;
+    }
+
+    // The cache isn't thread-safe, so look up and store serially and only
+    // enumerate the misses concurrently.
+    struct ModeLoad load;
+    uint32_t num_misses = 0;
+    load.catalog = catalog;
+    load.indices = malloc(((size_t)catalog->num_displays + 1) *
+                          sizeof(*load.indices));
+    load.errors = malloc(((size_t)catalog->num_displays + 1) *
+                         sizeof(*load.errors));
+    if (load.indices == NULL || load.errors == NULL) {
+        free(load.indices);
+        free(load.errors);
+        for (uint32_t i = 0; i < catalog->num_displays; ++i) {
+            errors[i] = kDisplayErrorFailure;
+        }
+        return kDisplayErrorFailure;
+    }
+    for (uint32_t i = 0; i < catalog->num_displays; ++i) {
+        errors[i] = 0;
+        if (catalog->has_modes[i]) {
+            continue;
+        }
+        if (catalog->cache != NULL) {
+            struct TraceSpan span;
+            TraceSpanBegin(&span, "enumerate modes", "phase");
+            span.display = catalog->displays[i];
+            const int e = LoadCachedModes(catalog, i);
+            TraceSpanEnd(&span);
+            if (e == 0) {
+                continue;
+            }
+        }
+        load.indices[num_misses++] = i;
+    }
+    WorkerPoolRun(num_misses, catalog->max_threads, LoadModesTask, &load);
+
+    int first_error = 0;
+    for (uint32_t i = 0; i < num_misses; ++i) {
+        const uint32_t index = load.indices[i];
+        errors[index] = CommitLiveModes(catalog, index, load.errors[i]);
+    }
+    free(load.indices);
+    free(load.errors);
+    for (uint32_t i = 0; i < catalog->num_displays && first_error == 0; ++i) {
+        first_error = errors[i];
+    }
+    return first_error;
+}
+
+// Displays whose tables DisplayCatalogLoadAllModes builds.
+struct TableBuild {
+    struct DisplayCatalog *catalog;
+    uint32_t *indices;
+};
+
+// Builds the table of one display of a TableBuild; runs on a pool thread.
+// Only touches that display's table.
+static void BuildTableTask(void *context, size_t task) {
+    struct TableBuild *build = context;
+    const struct DisplayModeTable *table = NULL;
+    DisplayCatalogGetTable(build->catalog, build->indices[task], &table);
+}
+
+int DisplayCatalogLoadAllModes(struct DisplayCatalog *catalog, int *errors) {
+    const int first_error = LoadAllModes(catalog, errors);
+
+    // Listings format from the tables; building them with the modes keeps
+    // the first listing of an enumerated catalog off the heap.  Displays
+    // whose table can't be built get another try when they are listed.
+    uint32_t indices[kDisplayCatalogTableBatch];
+    struct TableBuild build = {catalog, indices};
+    for (uint32_t first = 0; first < catalog->num_displays;) {
+        uint32_t count = 0;
+        for (; first < catalog->num_displays &&
+               count < kDisplayCatalogTableBatch; ++first) {
+            if (errors[first] == 0 && !catalog->has_table[first]) {
+                indices[count++] = first;
+            }
+        }
+        WorkerPoolRun(count, catalog->max_threads, BuildTableTask, &build);
+    }
+    return first_error;
+}
+
+int DisplayCatalogGetLiveModes(struct DisplayCatalog *catalog, uint32_t index,
+                               const struct DisplayModeList **list) {
+    *list = &catalog->modes[index];
+    if (catalog->has_modes[index] && !catalog->from_cache[index]) {
+        return 0;
+    }
+    struct TraceSpan span;
+    TraceSpanBegin(&span, "enumerate modes", "phase");
+    span.display = catalog->displays[index];
+    ReleaseDisplayModes(catalog, index);
+    const int e = LoadLiveModes(catalog, index);
+    TraceSpanEnd(&span);
+    return e;
+}
+
+ptrdiff_t DisplayCatalogFindMode(struct DisplayCatalog *catalog, uint32_t index,
+                                 size_t width, size_t height,
+                                 double refresh_rate) {
+    const struct DisplayModeList *list = &catalog->modes[index];
+    if (!catalog->has_index[index]) {
+        if (DisplayModeIndexBuild(&catalog->index[index], list->modes,
+                                  list->count) == 0) {
+            catalog->has_index[index] = 1;
+        } else {
+            // Out of memory: fall back to scanning.
+            const struct DisplayModeTable *table = NULL;
+            if (DisplayCatalogGetTable(catalog, index, &table) == 0) {
+                return DisplayModeTableFind(table, width, height, refresh_rate);
+            }
+            for (size_t i = 0; i < list->count; ++i) {
+                const struct DisplayMode *mode = &list->modes[i];
+                if (mode->width == width && mode->height == height &&
+                    MatchesRefreshRate(refresh_rate, mode->refresh_rate)) {
+                    return (ptrdiff_t)i;
+                }
+            }
+            return -1;
+        }
+    }
+    return DisplayModeIndexFind(&catalog->index[index], width, height,
+                                refresh_rate);
+}
+
+int DisplayCatalogGetTable(struct DisplayCatalog *catalog, uint32_t index,
+                           const struct DisplayModeTable **table) {
+    *table = &catalog->table[index];
+    if (catalog->has_table[index]) {
+        return 0;
+    }
+    if (DisplayModeTableBuild(&catalog->table[index], &catalog->modes[index])) {
+        return -1;
+    }
+    if (catalog->edid[index] != NULL) {
+        DisplayModeTableDescribe(&catalog->table[index],
+                                 &catalog->edid[index]->info);
+    }
+    catalog->has_table[index] = 1;
+    return 0;
+}
+
+// Returns non-zero if the display at "index" has "identity".
+static int HasIdentity(const struct DisplayCatalog *catalog, uint32_t index,
+                       const struct DisplayIdentity *identity) {
+    const struct DisplayBackend *backend = catalog->backend;
+    struct DisplayIdentity actual;
+    return backend->get_display_identity(backend->context,
+                                         catalog->displays[index], &actual) == 0 &&
+           DisplayIdentityEqual(&actual, identity);
+}
+
+// Returns the index of the display with backend ID "display", trying "hint"
+// first, or -1.
+static ptrdiff_t FindDisplayId(const struct DisplayCatalog *catalog,
+                               uint32_t display, uint32_t hint) {
+    if (hint < catalog->num_displays && catalog->displays[hint] == display) {
+        return hint;
+    }
+    for (uint32_t i = 0; i < catalog->num_displays; ++i) {
+        if (catalog->displays[i] == display) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int DisplayCatalogReadIdentities(struct DisplayCatalog *catalog,
+                                 struct DisplayIdentity *identities,
+                                 unsigned char *known) {
+    const struct DisplayBackend *backend = catalog->backend;
+    struct TraceSpan span;
+    TraceSpanBegin(&span, "identify displays", "phase");
+    for (uint32_t i = 0; i < catalog->num_displays; ++i) {
+        known[i] = backend->get_display_identity(
+                       backend->context, catalog->displays[i],
+                       &identities[i]) == 0;
+    }
+    int e = 0;
+    for (uint32_t i = 0; i < catalog->num_displays && e == 0; ++i) {
+        if (catalog->ids != NULL && known[i] &&
+            !DisplayIdentityShared(identities, known, catalog->num_displays,
+                                   i) &&
+            DisplayIdMapRecord(catalog->ids, &identities[i],
+                               catalog->displays[i], i)) {
+            e = kDisplayErrorFailure;
+        }
+    }
+    TraceSpanEnd(&span);
+    return e;
+}
+
+// Re-reads the display list and each display's identity.  Records them in
+// catalog->ids if there is one; otherwise returns in *found the index of the
+// display whose identity is "name", if any (or leaves it alone).
+static int ReadIdentities(struct DisplayCatalog *catalog, const char *name,
+                          ptrdiff_t *found) {
+    int e = DisplayCatalogRevalidate(catalog);
+    if (e) {
+        return e;
+    }
+    const uint32_t count = catalog->num_displays;
+    struct DisplayIdentity *identities =
+        malloc((count ? count : 1) * sizeof(*identities));
+    unsigned char *known = malloc(count ? count : 1);
+    if (identities == NULL || known == NULL) {
+        e = kDisplayErrorFailure;
+    } else {
+        e = DisplayCatalogReadIdentities(catalog, identities, known);
+    }
+    for (uint32_t i = 0; i < count && e == 0 && catalog->ids == NULL; ++i) {
+        char text[kDisplayIdentityMaxText];
+        DisplayIdentityFormat(&identities[i], text, sizeof(text));
+        if (known[i] && strcmp(text, name) == 0) {
+            *found = i;
+            break;
+        }
+    }
+    free(identities);
+    free(known);
+    return e;
+}
+
+int DisplayCatalogFindDisplay(struct DisplayCatalog *catalog, const char *name,
+                              uint32_t *index) {
+    if (catalog->backend->get_display_identity == NULL) {
+        return kDisplayErrorRangeCheck;
+    }
+    int e = DisplayCatalogLoadDisplays(catalog);
+    if (e) {
+        return e;
+    }
+    ptrdiff_t found = -1;
+    if (catalog->ids == NULL) {
+        e = ReadIdentities(catalog, name, &found);
+    } else {
+        // Check the display the map expects; recording it where it moved
+        // to keeps the next lookup to the first probe.
+        const struct DisplayIdMapEntry *entry =
+            DisplayIdMapLookup(catalog->ids, name);
+        if (entry != NULL) {
+            const struct DisplayIdMapEntry expected = *entry;
+            found = FindDisplayId(catalog, expected.display, expected.index);
+            if (found >= 0 &&
+                HasIdentity(catalog, (uint32_t)found, &expected.identity)) {
+                // Only this entry moves: another display may share the
+                // identity, and its names are checked when they are used.
+                if ((uint32_t)found != expected.index &&
+                    DisplayIdMapPut(catalog->ids, expected.name,
+                                    &expected.identity, expected.display,
+                                    (uint32_t)found, expected.flags)) {
+                    return kDisplayErrorFailure;
+                }
+                *index = (uint32_t)found;
+                return 0;
+            }
+            found = -1;
+        }
+        // Missed, or out of date: identify the displays again.
+        e = ReadIdentities(catalog, name, &found);
+        entry = e == 0 ? DisplayIdMapLookup(catalog->ids, name) : NULL;
+        if (entry != NULL) {
+            // Names of displays that aren't attached keep where they were
+            // last seen, which may now be another display.
+            const struct DisplayIdMapEntry expected = *entry;
+            found = FindDisplayId(catalog, expected.display, expected.index);
+            if (found >= 0 &&
+                !HasIdentity(catalog, (uint32_t)found, &expected.identity)) {
+                found = -1;
+            }
+        }
+    }
+    if (e) {
+        return e;
+    }
+    if (found < 0) {
+        return kDisplayErrorRangeCheck;
+    }
+    *index = (uint32_t)found;
+    return 0;
+}
+
+void DisplayCatalogSetCurrentMode(struct DisplayCatalog *catalog,
+                                  uint32_t index, size_t mode_index) {
+    struct DisplayModeList *modes = &catalog->modes[index];
+    if (!catalog->has_modes[index] || catalog->from_cache[index] ||
+        mode_index >= modes->count) {
+        return;
+    }
+    modes->current = modes->modes[mode_index];
+    modes->has_current = 1;
+    modes->current_index = (ptrdiff_t)mode_index;
+    // The table's current flag is stale; rebuild it when next needed.
+    if (catalog->has_table[index]) {
+        DisplayModeTableFree(&catalog->table[index]);
+        catalog->has_table[index] = 0;
+    }
+}
@@ -0,0 +1,162 @@
+#ifndef DISPLAYMODE_CATALOG_H
+#define DISPLAYMODE_CATALOG_H
+
+#include <stdint.h>
+
+#include "displaymode_alloc.h"
+#include "displaymode_backend.h"
+#include "displaymode_cache.h"
+#include "displaymode_edid.h"
+#include "displaymode_ids.h"
+#include "displaymode_index.h"
+#include "displaymode_table.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Default number of threads that enumerate and format displays at once.
+#define kDisplayCatalogThreads 4
+
+// The active displays and their modes, enumerated lazily and kept until
+// invalidated so that repeated commands don't query the backend again.  The
+// per-display arrays are sized for the displays found, and have room for
+// "capacity" displays.
+struct DisplayCatalog {
+    const struct DisplayBackend *backend;
+    uint32_t *displays;
+    uint32_t num_displays;
+    uint32_t capacity;
+    int has_displays;
+    struct DisplayModeList *modes;
+    int *has_modes;
+    // Non-zero if the modes came from the cache and have no backend handles.
+    int *from_cache;
+    // Lookup index over modes[i], built on first search.
+    struct DisplayModeIndex *index;
+    int *has_index;
+    // Columnar copy of modes[i] for formatting and scanning, built on first
+    // use.
+    struct DisplayModeTable *table;
+    int *has_table;
+    // Decoded EDID of each display, or NULL if it has none (or it didn't
+    // decode); read along with the display's modes.  Entries of edid_cache.
+    const struct EdidCacheEntry **edid;
+    // Every EDID decoded, by content, kept across invalidations so that
+    // listing the same displays again doesn't decode them again.
+    struct EdidCache edid_cache;
+    // Optional mode cache (not owned).
+    struct DisplayCache *cache;
+    // Optional map of display names and identities (not owned), updated as
+    // displays are found where the map didn't expect them.
+    struct DisplayIdMap *ids;
+    // Optional layouts and their plans (not owned), for "l".
+    struct DisplayLayouts *layouts;
+    // Hash of the OS version the cached modes were enumerated under.
+    uint64_t environment_fingerprint;
+    // Hash of the display list, part of every display's cache fingerprint.
+    uint64_t arrangement_fingerprint;
+    // Most threads to use per listing; 1 enumerates serially.
+    unsigned max_threads;
+    // Scratch memory for formatting a command's output (not owned), or NULL
+    // to use the heap.  Whoever runs the commands resets it between them.
+    struct Arena *scratch;
+};
+
+void DisplayCatalogInit(struct DisplayCatalog *catalog,
+                        const struct DisplayBackend *backend);
+
+// Releases all enumerated state.  The catalog can be reused afterwards.
+void DisplayCatalogInvalidate(struct DisplayCatalog *catalog);
+
+void DisplayCatalogFree(struct DisplayCatalog *catalog);
+
+// Releases the modes of the display at "index" only, so that they are read
+// again on next use; the other displays keep theirs.
+void DisplayCatalogInvalidateDisplay(struct DisplayCatalog *catalog,
+                                     uint32_t index);
+
+// Enumerates the active displays unless they are already known, however many
+// there are.  Returns 0, the backend's error, or kDisplayErrorFailure if out
+// of memory.
+int DisplayCatalogLoadDisplays(struct DisplayCatalog *catalog);
+
+// Re-reads the active display list and drops cached modes if the list has
+// changed.  Cheaper than a full invalidation when nothing was re-plugged.
+int DisplayCatalogRevalidate(struct DisplayCatalog *catalog);
+
+// Returns the modes of the display at "index" (which must be less than
+// num_displays), enumerating them on first use.  Returns 0 or the backend's
+// error; on error "*list" is still valid but empty.
+int DisplayCatalogGetModes(struct DisplayCatalog *catalog, uint32_t index,
+                           const struct DisplayModeList **list);
+
+// Loads the modes of every active display, like DisplayCatalogGetModes for
+// each in turn, but enumerates the displays that miss the cache concurrently
+// (if the backend allows it) on up to max_threads threads.  Stores each
+// display's error (or 0) in errors[i], which must have room for
+// num_displays entries.  Also builds the mode table of each display that
+// loaded, as listings use them.  Returns the first error, or 0.
+int DisplayCatalogLoadAllModes(struct DisplayCatalog *catalog, int *errors);
+
+// Like DisplayCatalogGetModes, but guarantees that the modes carry backend
+// handles (re-enumerating if they came from the cache), as needed to
+// configure the display.
+int DisplayCatalogGetLiveModes(struct DisplayCatalog *catalog, uint32_t index,
+                               const struct DisplayModeList **list);
+
+// Uses "cache" (which may be NULL) for mode lists.  Enumerated modes are
+// queued in the cache, to be written by DisplayCatalogFlushCache.
+void DisplayCatalogSetCache(struct DisplayCatalog *catalog,
+                            struct DisplayCache *cache);
+
+// Writes newly enumerated modes to the cache, if any.
+int DisplayCatalogFlushCache(struct DisplayCatalog *catalog);
+
+// Returns non-zero if two modes have the same properties (ignoring handles).
+int DisplayModesEqual(const struct DisplayMode *a, const struct DisplayMode *b);
+
+// Returns the index in the display's mode list of the first mode with the
+// given resolution whose refresh rate matches "refresh_rate" (0.0 for any),
+// or -1.  The modes must already be loaded.  The lookup index is built on
+// first use and kept with the mode list, so repeated lookups (server and
+// batch mode) don't scan the list.
+ptrdiff_t DisplayCatalogFindMode(struct DisplayCatalog *catalog, uint32_t index,
+                                 size_t width, size_t height,
+                                 double refresh_rate);
+
+// Returns the mode table of the display at "index", whose modes must already
+// be loaded.  Its display names, pixel encodings and HiDPI flags come from
+// the display's EDID, if it has one.  Returns 0, or -1 if out of memory.
+int DisplayCatalogGetTable(struct DisplayCatalog *catalog, uint32_t index,
+                           const struct DisplayModeTable **table);
+
+// Reads the identity of each of the catalog->num_displays displays into
+// "identities", setting "known" where the backend gave one, and records
+// them in catalog->ids if there is one.  An identity that several displays
+// share isn't recorded, so that names stay with the displays they were
+// given to.  Returns 0, or kDisplayErrorFailure if out of memory.
+int DisplayCatalogReadIdentities(struct DisplayCatalog *catalog,
+                                 struct DisplayIdentity *identities,
+                                 unsigned char *known);
+
+// Finds the active display that "name" refers to (a name given with "n", or
+// an identity as DisplayIdentityFormat writes it) and stores its index in
+// "*index".  A name in catalog->ids costs one identity check of the display
+// it names; only if the map has no entry, or its display was unplugged,
+// moved or replaced, is the display list read again, along with every
+// display's identity, which are recorded in the map.  Returns 0,
+// kDisplayErrorRangeCheck if no active display has that name, or the
+// backend's error.
+int DisplayCatalogFindDisplay(struct DisplayCatalog *catalog, const char *name,
+                              uint32_t *index);
+
+// Records that the display at "index" now uses modes[mode_index].
+void DisplayCatalogSetCurrentMode(struct DisplayCatalog *catalog,
+                                  uint32_t index, size_t mode_index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DISPLAYMODE_CATALOG_H
@@ -0,0 +1,271 @@
+// CoreGraphics implementation of the display backend.
+
+#include "displaymode_cg.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <CoreFoundation/CoreFoundation.h>
+#include <CoreGraphics/CoreGraphics.h>
+
+// Keeps the CoreGraphics objects that back a DisplayModeList alive.
+struct ModeStorage {
+    CFArrayRef modes;
+    // The current mode, retained only if it isn't in "modes".
+    CGDisplayModeRef unlisted_current;
+};
+
+static void FillMode(CGDisplayModeRef mode, struct DisplayMode *out) {
+    out->width = CGDisplayModeGetWidth(mode);
+    out->height = CGDisplayModeGetHeight(mode);
+    out->refresh_rate = CGDisplayModeGetRefreshRate(mode);
+    out->usable_for_desktop = CGDisplayModeIsUsableForDesktopGUI(mode);
+    out->mode_id = CGDisplayModeGetIODisplayModeID(mode);
+    out->handle = mode;
+}
+
+static int GetActiveDisplays(void *context, uint32_t max_displays,
+                             uint32_t *displays, uint32_t *num_displays) {
+    (void)context;
+    return CGGetActiveDisplayList(max_displays, displays, num_displays);
+}
+
+static int CopyModes(void *context, uint32_t display,
+                     struct DisplayModeList *list) {
+    (void)context;
+    memset(list, 0, sizeof(*list));
+    list->current_index = -1;
+
+    CGDisplayModeRef current_mode = CGDisplayCopyDisplayMode(display);
+    CFArrayRef modes = CGDisplayCopyAllDisplayModes(display, NULL);
+    if (modes == NULL && current_mode == NULL) {
+        return kCGErrorFailure;
+    }
+
+    const CFIndex count = modes != NULL ? CFArrayGetCount(modes) : 0;
+    struct ModeStorage *storage = calloc(1, sizeof(*storage));
+    list->modes = calloc(count > 0 ? (size_t)count : 1, sizeof(list->modes[0]));
+    if (storage == NULL || list->modes == NULL) {
+        free(storage);
+        free(list->modes);
+        list->modes = NULL;
+        if (modes != NULL) {
+            CFRelease(modes);
+        }
+        if (current_mode != NULL) {
+            CGDisplayModeRelease(current_mode);
+        }
+        return kCGErrorFailure;
+    }
+    storage->modes = modes;
+
+    for (CFIndex i = 0; i < count; ++i) {
+        CGDisplayModeRef mode =
+            (CGDisplayModeRef)CFArrayGetValueAtIndex(modes, i);
+        if (mode == NULL) {
+            continue;
+        }
+        if (current_mode != NULL && list->current_index < 0 &&
+            CFEqual(mode, current_mode)) {
+            list->current_index = (ptrdiff_t)list->count;
+        }
+        FillMode(mode, &list->modes[list->count++]);
+    }
+
+    if (current_mode != NULL) {
+        list->has_current = 1;
+        if (list->current_index >= 0) {
+            list->current = list->modes[list->current_index];
+            CGDisplayModeRelease(current_mode);
+        } else {
+            FillMode(current_mode, &list->current);
+            storage->unlisted_current = current_mode;
+        }
+    }
+    list->backend_data = storage;
+    return kCGErrorSuccess;
+}
+
+static int CopyCurrentMode(void *context, uint32_t display,
+                           struct DisplayModeList *list) {
+    (void)context;
+    memset(list, 0, sizeof(*list));
+    list->current_index = -1;
+    CGDisplayModeRef current_mode = CGDisplayCopyDisplayMode(display);
+    if (current_mode == NULL) {
+        return kCGErrorFailure;
+    }
+    struct ModeStorage *storage = calloc(1, sizeof(*storage));
+    if (storage == NULL) {
+        CGDisplayModeRelease(current_mode);
+        return kCGErrorFailure;
+    }
+    storage->unlisted_current = current_mode;
+    FillMode(current_mode, &list->current);
+    list->has_current = 1;
+    list->backend_data = storage;
+    return kCGErrorSuccess;
+}
+
+static int GetDisplayIdentity(void *context, uint32_t display,
+                              struct DisplayIdentity *identity) {
+    (void)context;
+    identity->vendor = CGDisplayVendorNumber(display);
+    identity->model = CGDisplayModelNumber(display);
+    identity->serial = CGDisplaySerialNumber(display);
+    return kCGErrorSuccess;
+}
+
+static void ReleaseModes(void *context, struct DisplayModeList *list) {
+    (void)context;
+    struct ModeStorage *storage = list->backend_data;
+    if (storage != NULL) {
+        if (storage->modes != NULL) {
+            CFRelease(storage->modes);
+        }
+        if (storage->unlisted_current != NULL) {
+            CGDisplayModeRelease(storage->unlisted_current);
+        }
+        free(storage);
+    }
+    free(list->modes);
+    memset(list, 0, sizeof(*list));
+    list->current_index = -1;
+}
+
+static int BeginConfiguration(void *context, void **config) {
+    (void)context;
+    CGDisplayConfigRef cg_config = NULL;
+    const CGError e = CGBeginDisplayConfiguration(&cg_config);
+    *config = cg_config;
+    return e;
+}
+
+static int ConfigureDisplay(void *context, void *config, uint32_t display,
+                            const struct DisplayMode *mode) {
+    (void)context;
+    return CGConfigureDisplayWithDisplayMode(
+        (CGDisplayConfigRef)config, display, (CGDisplayModeRef)mode->handle,
+        NULL);
+}
+
+static int CompleteConfiguration(void *context, void *config) {
+    (void)context;
+    return CGCompleteDisplayConfiguration((CGDisplayConfigRef)config,
+                                          kCGConfigurePermanently);
+}
+
+static void CancelConfiguration(void *context, void *config) {
+    (void)context;
+    CGCancelDisplayConfiguration((CGDisplayConfigRef)config);
+}
+
+static const struct DisplayBackend kCoreGraphicsBackend = {
+    .context = NULL,
+    .get_active_displays = GetActiveDisplays,
+    .copy_modes = CopyModes,
+    .release_modes = ReleaseModes,
+    .copy_current_mode = CopyCurrentMode,
+    .get_display_identity = GetDisplayIdentity,
+    .begin_configuration = BeginConfiguration,
+    .configure_display = ConfigureDisplay,
+    .complete_configuration = CompleteConfiguration,
+    .cancel_configuration = CancelConfiguration,
+    // Each call only reads its own display's modes.
+    .concurrent_copy_modes = 1,
+};
+
+const struct DisplayBackend *CoreGraphicsBackend(void) {
+    return &kCoreGraphicsBackend;
+}
+
+// Events received by the reconfiguration callback and not yet waited for.
+// The callback runs on the waiting thread, from its run loop.
+#define kMaxQueuedEvents 256
+
+struct EventQueue {
+    int registered;
+    // Set if events were dropped because the queue was full.
+    int overflowed;
+    size_t count;
+    struct DisplayEvent events[kMaxQueuedEvents];
+};
+
+static struct EventQueue event_queue;
+
+static void ReconfigurationCallback(CGDirectDisplayID display,
+                                    CGDisplayChangeSummaryFlags flags,
+                                    void *user_info) {
+    struct EventQueue *queue = user_info;
+    // Every change is announced twice; the second call has the outcome.
+    if (flags & kCGDisplayBeginConfigurationFlag) {
+        return;
+    }
+    uint32_t event_flags = kDisplayEventModeChanged;
+    if (flags & (kCGDisplayAddFlag | kCGDisplayEnabledFlag)) {
+        event_flags = kDisplayEventAdded;
+    } else if (flags & (kCGDisplayRemoveFlag | kCGDisplayDisabledFlag)) {
+        event_flags = kDisplayEventRemoved;
+    }
+    if (queue->count == kMaxQueuedEvents) {
+        queue->overflowed = 1;
+        return;
+    }
+    queue->events[queue->count].display = display;
+    queue->events[queue->count].flags = event_flags;
+    ++queue->count;
+}
+
+static int WaitForEvents(void *context, int timeout_ms,
+                         struct DisplayEvent *events, size_t max_events) {
+    struct EventQueue *queue = context;
+    if (!queue->registered) {
+        if (CGDisplayRegisterReconfigurationCallback(ReconfigurationCallback,
+                                                     queue) !=
+            kCGErrorSuccess) {
+            return -1;
+        }
+        queue->registered = 1;
+    }
+    const CFAbsoluteTime deadline =
+        CFAbsoluteTimeGetCurrent() + timeout_ms / 1000.0;
+    while (queue->count == 0 && !queue->overflowed) {
+        CFTimeInterval seconds = 1.0;
+        if (timeout_ms >= 0) {
+            seconds = deadline - CFAbsoluteTimeGetCurrent();
+            if (seconds <= 0) {
+                return 0;
+            }
+        }
+        if (CFRunLoopRunInMode(kCFRunLoopDefaultMode, seconds, true) ==
+            kCFRunLoopRunFinished) {
+            // Nothing to run yet; don't spin.
+            const struct timespec pause = {0, 10 * 1000 * 1000};
+            nanosleep(&pause, NULL);
+        }
+    }
+    size_t n = 0;
+    if (queue->overflowed && max_events > 0) {
+        events[n].display = 0;
+        events[n].flags = kDisplayEventRescan;
+        ++n;
+        queue->overflowed = 0;
+    }
+    const size_t taken = queue->count < max_events - n ? queue->count
+                                                       : max_events - n;
+    memcpy(events + n, queue->events, taken * sizeof(events[0]));
+    memmove(queue->events, queue->events + taken,
+            (queue->count - taken) * sizeof(queue->events[0]));
+    queue->count -= taken;
+    return (int)(n + taken);
+}
+
+static const struct DisplayEventSource kCoreGraphicsEventSource = {
+    .context = &event_queue,
+    .wait = WaitForEvents,
+};
+
+const struct DisplayEventSource *CoreGraphicsEventSource(void) {
+    return &kCoreGraphicsEventSource;
+}
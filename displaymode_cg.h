@@ -0,0 +1,23 @@
+#ifndef DISPLAYMODE_CG_H
+#define DISPLAYMODE_CG_H
+
+#include "displaymode_backend.h"
+#include "displaymode_watch.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Returns the backend that talks to CoreGraphics (macOS only).
+const struct DisplayBackend *CoreGraphicsBackend(void);
+
+// Returns the display reconfiguration events of CoreGraphics (macOS only).
+// The callback is registered on first wait, and events are delivered while
+// waiting, by running the current thread's run loop.
+const struct DisplayEventSource *CoreGraphicsEventSource(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DISPLAYMODE_CG_H
@@ -0,0 +1,1125 @@
+#include "displaymode_commands.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "displaymode_alloc.h"
+#include "displaymode_export.h"
+#include "displaymode_filter.h"
+#include "displaymode_group.h"
+#include "displaymode_json.h"
+#include "displaymode_layout.h"
+#include "displaymode_output.h"
+#include "displaymode_pool.h"
+#include "displaymode_profile.h"
+#include "displaymode_trace.h"
+#include "logging.h"
+
+const char kProgramVersion[] = "displaymode 1.4.0";
+
+static const char kUsage[] =
+    "Usage:\n\n"
+    "  displaymode [options...]\n\n"
+    "Options:\n"
+    "  t <width> <height> [@<refresh>] [display] [<width> <height> [@<refresh>] <display>...]\n"
+    "      sets the display's width, height and (optionally) refresh rate;\n"
+    "      several displays given together are changed at once, or not at\n"
+    "      all if any of them fails; <width> <height> may be a standard\n"
+    "      resolution's name: 720p (HD), 1080p (FHD), WQHD (1440p, QHD),\n"
+    "      4K (UHD, 2160p), DCI4K, 5K, 6K, UWFHD, UWQHD, UWQHD+, UW5K, DQHD\n\n"
+    "  d [filters...]\n"
+    "      prints available resolutions for each display; the filters\n"
+    "      --min-width=<n>, --max-width=<n>, --min-height=<n>,\n"
+    "      --max-height=<n>, --min-refresh=<hz>, --max-refresh=<hz>,\n"
+    "      --aspect=<w>:<h>, --usable and --hidpi limit it to matching modes;\n"
+    "      with --grouped, prints one line per resolution with all of its\n"
+    "      refresh rates (also with --json and --ndjson)\n\n"
+    "  l [layout]\n"
+    "      sets the displays to the named layout from the layouts file, each\n"
+    "      a line like \"desk: 4K @60 0 1440 900 1\" (the modes as for t); the\n"
+    "      layout is compiled into a plan, kept until the displays change, so\n"
+    "      applying it again searches nothing; without a layout, compiles\n"
+    "      and checks every layout\n\n"
+    "  n [<display> <name>]\n"
+    "      lists each display's identity (vendor:model:serial) and names, or\n"
+    "      names a display; t and p accept a name or identity wherever they\n"
+    "      take a display index, and find the display even after it moves\n\n"
+    "  p <mode> <display> <mode> <display>... [--iterations=<n>]\n"
+    "      switches between the given modes (<width> <height> [@<refresh>]\n"
+    "      or a name, as for t) <n> times (default 10) and prints the\n"
+    "      min/p50/p99/max time of each phase of a switch (also with --json);\n"
+    "      the displays are switched back to their modes afterwards\n\n"
+    "  s [socket]\n"
+    "      serves t and d commands over a Unix socket, keeping the display\n"
+    "      list and modes in memory between commands\n\n"
+    "  - [file]\n"
+    "      runs the commands in <file> (or read from standard input), one per\n"
+    "      line, enumerating the displays once, and prints each command's\n"
+    "      result as a line of JSON\n\n"
+    "  w [--coalesce=<ms>]\n"
+    "      prints each display, then a line whenever a display is added,\n"
+    "      removed or changes mode; events closer together than <ms>\n"
+    "      (default 200) are reported together\n\n"
+    "  h, --help\n"
+    "      prints this message\n\n"
+    "  v, --version\n"
+    "      prints version and copyright notice\n\n"
+    "  --socket=<path>\n"
+    "      sends the command to a running server instead of querying the\n"
+    "      displays directly\n\n"
+    "  --no-cache\n"
+    "      enumerates modes instead of reading them from the mode cache\n\n"
+    "  --json, --ndjson\n"
+    "      prints d's output as one JSON document, or as one JSON object per\n"
+    "      mode and line; w prints one JSON object per change with either\n"
+    "      flag\n\n"
+    "  --csv, --tsv, --cbor\n"
+    "      prints d's output as a header and one row per mode (comma or tab\n"
+    "      separated), or as one binary CBOR document; rows include each\n"
+    "      display's EDID vendor, model, serial and size\n\n"
+    "  --stats\n"
+    "      prints the heap and arena allocations of each phase (startup,\n"
+    "      enumerate, format, write, finish) and the peak heap use; heap\n"
+    "      use is only counted in HEAP_STATS=1 builds with glibc, so not on\n"
+    "      macOS\n\n"
+    "  --quiet\n"
+    "      logs only errors\n\n"
+    "  --trace=<file>\n"
+    "      writes the time spent in each step and display API call to <file>\n"
+    "      as Chrome trace-event JSON (for chrome://tracing or Perfetto)\n\n"
+    "  --verbose\n"
+    "      enables verbose output and debug logging\n";
+
+void ShowUsage(FILE *out) {
+    fputs(kUsage, out);
+    fputc('\n', out);
+}
+
+// Appends the line of the table's row "row" to "output".  With "log_json",
+// also logs the mode as JSON (at debug level).
+static void PrintMode(const struct DisplayModeTable *table, size_t row,
+                      struct OutputBuffer *output, int log_json) {
+    // Format straight into the output.
+    char *line = OutputBufferReserve(output, kModeTableMaxLine);
+    if (line != NULL) {
+        int length = DisplayModeTableFormatRow(table, row, line,
+                                               kModeTableMaxLine);
+        if (length > kModeTableMaxLine - 1) {
+            length = kModeTableMaxLine - 1;
+        }
+        output->length += (size_t)length;
+    }
+    const int is_current = (table->flags[row] & kModeFlagCurrent) != 0;
+    OutputBufferAppend(output, is_current ? " *\n" : "\n", is_current ? 3 : 1);
+
+    if (!log_json) {
+        return;
+    }
+    // The mode as JSON, as the tool has always logged it (with the rate at
+    // full precision).
+    struct JsonWriter json;
+    JsonWriterInit(&json, NULL);
+    JsonWriterBeginObject(&json);
+    JsonWriterKey(&json, "width");
+    JsonWriterUint(&json, table->resolution[row] >> 16);
+    JsonWriterKey(&json, "height");
+    JsonWriterUint(&json, table->resolution[row] & 0xffff);
+    JsonWriterKey(&json, "refreshRate");
+    JsonWriterDouble(&json, table->refresh_rate[row]);
+    JsonWriterEndObject(&json);
+    LOG_DEBUG("JSON Output: %.*s", (int)json.length, json.buffer);
+}
+
+// Writes the fields of the table's row "row" as the members of an object.
+// The refresh rate is passed in at full precision.
+static void WriteModeMembers(struct JsonWriter *json,
+                             const struct DisplayModeTable *table, size_t row,
+                             double refresh_rate) {
+    const uint8_t flags = table->flags[row];
+    JsonWriterKey(json, "width");
+    JsonWriterUint(json, table->resolution[row] >> 16);
+    JsonWriterKey(json, "height");
+    JsonWriterUint(json, table->resolution[row] & 0xffff);
+    JsonWriterKey(json, "refreshRate");
+    JsonWriterDouble(json, refresh_rate);
+    JsonWriterKey(json, "aspectWidth");
+    JsonWriterInt(json, table->aspect[row] >> 16);
+    JsonWriterKey(json, "aspectHeight");
+    JsonWriterInt(json, table->aspect[row] & 0xffff);
+    JsonWriterKey(json, "pixelEncoding");
+    JsonWriterString(json, table->strings[table->encoding[row]]);
+    JsonWriterKey(json, "modeId");
+    JsonWriterInt(json, table->mode_id[row]);
+    JsonWriterKey(json, "isHiDPI");
+    JsonWriterBool(json, flags & kModeFlagHiDPI);
+    JsonWriterKey(json, "displayName");
+    JsonWriterString(json, table->strings[table->display_name[row]]);
+    JsonWriterKey(json, "resCategory");
+    JsonWriterString(json, table->strings[table->category[row]]);
+    JsonWriterKey(json, "usableForDesktop");
+    JsonWriterBool(json, flags & kModeFlagUsable);
+    JsonWriterKey(json, "current");
+    JsonWriterBool(json, flags & kModeFlagCurrent);
+}
+
+// Writes the fields of group "index" as the members of an object.
+static void WriteGroupMembers(struct JsonWriter *json,
+                              const struct DisplayModeGroups *groups,
+                              const struct DisplayModeTable *table,
+                              size_t index) {
+    const struct DisplayModeGroup *group = &groups->groups[index];
+    const size_t row = group->first_row;
+    JsonWriterKey(json, "width");
+    JsonWriterUint(json, group->resolution >> 16);
+    JsonWriterKey(json, "height");
+    JsonWriterUint(json, group->resolution & 0xffff);
+    JsonWriterKey(json, "refreshRates");
+    JsonWriterBeginArray(json);
+    for (uint32_t i = 0; i < group->num_rates; ++i) {
+        JsonWriterDouble(json,
+                         groups->refresh_mhz[group->first_rate + i] / 1000.0);
+    }
+    JsonWriterEndArray(json);
+    JsonWriterKey(json, "aspectWidth");
+    JsonWriterInt(json, table->aspect[row] >> 16);
+    JsonWriterKey(json, "aspectHeight");
+    JsonWriterInt(json, table->aspect[row] & 0xffff);
+    JsonWriterKey(json, "resCategory");
+    JsonWriterString(json, table->strings[table->category[row]]);
+    JsonWriterKey(json, "modes");
+    JsonWriterUint(json, group->num_modes);
+    JsonWriterKey(json, "isHiDPI");
+    JsonWriterBool(json, group->flags & kModeFlagHiDPI);
+    JsonWriterKey(json, "usableForDesktop");
+    JsonWriterBool(json, group->flags & kModeFlagUsable);
+    JsonWriterKey(json, "current");
+    JsonWriterBool(json, group->flags & kModeFlagCurrent);
+}
+
+// Allocates memory for one listing: in the catalog's scratch arena if it has
+// one, so that a listing of an enumerated catalog doesn't touch the heap, or
+// else on the heap.  Release it with ScratchFree.
+static void *ScratchAlloc(struct DisplayCatalog *catalog, size_t size) {
+    return catalog->scratch != NULL ? ArenaAlloc(catalog->scratch, size)
+                                    : malloc(size);
+}
+
+static void *ScratchCalloc(struct DisplayCatalog *catalog, size_t count,
+                           size_t size) {
+    return catalog->scratch != NULL ? ArenaCalloc(catalog->scratch, count, size)
+                                    : calloc(count, size);
+}
+
+// Frees what ScratchAlloc returned; arena memory goes with the arena.
+static void ScratchFree(struct DisplayCatalog *catalog, void *p) {
+    if (catalog->scratch == NULL) {
+        free(p);
+    }
+}
+
+// Selects the rows of "table" that pass "filter" into *selected, a bitmap
+// for the caller to release with ScratchFree; with no active filter,
+// *selected is NULL (for all rows).  Returns 0, or -1 if out of memory.
+static int SelectRows(struct DisplayCatalog *catalog,
+                      const struct ModeFilter *filter,
+                      const struct DisplayModeTable *table,
+                      uint64_t **selected) {
+    *selected = NULL;
+    if (filter == NULL || !filter->active) {
+        return 0;
+    }
+    *selected = ScratchAlloc(catalog,
+                             (DisplayModeFilterWords(table->count) + 1) *
+                             sizeof(**selected));
+    if (*selected == NULL) {
+        return -1;
+    }
+    DisplayModeFilterSelect(filter, table, *selected);
+    return 0;
+}
+
+// Returns the first row at or after "row" that is set in "selected" (or
+// "row" itself if "selected" is NULL), or "count" if there is none.
+static size_t NextSelectedRow(const uint64_t *selected, size_t row,
+                              size_t count) {
+    if (selected == NULL) {
+        return row;
+    }
+    while (row < count) {
+        const uint64_t word = selected[row / 64] >> (row % 64);
+        if (word != 0) {
+            return row + (size_t)__builtin_ctzll(word);
+        }
+        row = (row / 64 + 1) * 64;
+    }
+    return count;
+}
+
+// Writes the selected modes of the display at "index": as objects in the
+// current array, or (for NDJSON) as one line each.
+static void WriteModesJson(struct JsonWriter *json, uint32_t index,
+                           const struct DisplayModeList *list,
+                           const struct DisplayModeTable *table,
+                           const uint64_t *selected, int ndjson) {
+    // The table ends with the current mode if it isn't in the list.
+    const size_t count = table->count;
+    for (size_t i = NextSelectedRow(selected, 0, count); i < count;
+         i = NextSelectedRow(selected, i + 1, count)) {
+        const struct DisplayMode *mode = i < list->count ? &list->modes[i]
+                                                         : &list->current;
+        JsonWriterBeginObject(json);
+        if (ndjson) {
+            JsonWriterKey(json, "display");
+            JsonWriterUint(json, index);
+        }
+        WriteModeMembers(json, table, i, mode->refresh_rate);
+        JsonWriterEndObject(json);
+        if (ndjson) {
+            JsonWriterEndLine(json);
+        }
+    }
+}
+
+// Writes the selected modes of the display at "index" grouped by
+// resolution, like WriteModesJson.  Returns 0, or -1 if out of memory.
+static int WriteGroupsJson(struct DisplayCatalog *catalog,
+                           struct JsonWriter *json, uint32_t index,
+                           const struct DisplayModeTable *table,
+                           const uint64_t *selected, int ndjson) {
+    struct DisplayModeGroups groups;
+    if (DisplayModeGroupsBuild(&groups, table, selected, catalog->scratch)) {
+        return -1;
+    }
+    for (size_t i = 0; i < groups.count; ++i) {
+        JsonWriterBeginObject(json);
+        if (ndjson) {
+            JsonWriterKey(json, "display");
+            JsonWriterUint(json, index);
+        }
+        WriteGroupMembers(json, &groups, table, i);
+        JsonWriterEndObject(json);
+        if (ndjson) {
+            JsonWriterEndLine(json);
+        }
+    }
+    DisplayModeGroupsFree(&groups);
+    return 0;
+}
+
+// Prints the modes of every display that pass "filter" (which may be NULL)
+// as one JSON document or as NDJSON; with "grouped", one object per
+// resolution rather than per mode.
+static int PrintModesJson(struct DisplayCatalog *catalog,
+                          const struct ModeFilter *filter, int grouped,
+                          int ndjson, FILE *out, FILE *err) {
+    AllocSetPhase(kAllocPhaseEnumerate);
+    const int e = DisplayCatalogLoadDisplays(catalog);
+    if (e) {
+        fprintf(err, "CGGetActiveDisplayList CGError: %d\n", e);
+        return e;
+    }
+    int *load_errors = ScratchAlloc(
+        catalog, ((size_t)catalog->num_displays + 1) * sizeof(*load_errors));
+    if (load_errors == NULL) {
+        fprintf(err, "Out of memory listing display modes\n");
+        return EXIT_FAILURE;
+    }
+    DisplayCatalogLoadAllModes(catalog, load_errors);
+
+    AllocSetPhase(kAllocPhaseFormat);
+    struct TraceSpan span;
+    TraceSpanBegin(&span, "format", "phase");
+    struct JsonWriter json;
+    JsonWriterInit(&json, out);
+    if (!ndjson) {
+        JsonWriterBeginObject(&json);
+        JsonWriterKey(&json, "displays");
+        JsonWriterBeginArray(&json);
+    }
+    for (uint32_t i = 0; i < catalog->num_displays; ++i) {
+        const struct DisplayModeList *list = &catalog->modes[i];
+        const struct DisplayModeTable *table = NULL;
+        if (load_errors[i]) {
+            fprintf(err, "Failed to get display modes\n");
+        }
+        uint64_t *selected = NULL;
+        if (DisplayCatalogGetTable(catalog, i, &table) ||
+            SelectRows(catalog, filter, table, &selected)) {
+            fprintf(err, "Out of memory listing display modes\n");
+            TraceSpanEnd(&span);
+            ScratchFree(catalog, load_errors);
+            return EXIT_FAILURE;
+        }
+        if (!ndjson) {
+            JsonWriterBeginObject(&json);
+            JsonWriterKey(&json, "display");
+            JsonWriterUint(&json, i);
+            JsonWriterKey(&json, "main");
+            JsonWriterBool(&json, i == 0);
+            JsonWriterKey(&json, grouped ? "groups" : "modes");
+            JsonWriterBeginArray(&json);
+        }
+        int group_error = 0;
+        if (grouped) {
+            group_error = WriteGroupsJson(catalog, &json, i, table, selected,
+                                          ndjson);
+        } else {
+            WriteModesJson(&json, i, list, table, selected, ndjson);
+        }
+        ScratchFree(catalog, selected);
+        if (group_error) {
+            fprintf(err, "Out of memory listing display modes\n");
+            TraceSpanEnd(&span);
+            ScratchFree(catalog, load_errors);
+            return EXIT_FAILURE;
+        }
+        if (!ndjson) {
+            JsonWriterEndArray(&json);
+            JsonWriterEndObject(&json);
+        }
+    }
+    if (!ndjson) {
+        JsonWriterEndArray(&json);
+        JsonWriterEndObject(&json);
+        JsonWriterEndLine(&json);
+    }
+    ScratchFree(catalog, load_errors);
+    AllocSetPhase(kAllocPhaseWrite);
+    const int write_error = JsonWriterFlush(&json);
+    TraceSpanEnd(&span);
+    if (write_error) {
+        fprintf(err, "Failed to write JSON output\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+// Prints the modes of every display that pass "filter" (which may be NULL)
+// as CSV or TSV rows, or as one CBOR document, encoding them as they are
+// visited.
+static int PrintModesExport(struct DisplayCatalog *catalog,
+                            const struct ModeFilter *filter,
+                            enum OutputFormat format, FILE *out, FILE *err) {
+    AllocSetPhase(kAllocPhaseEnumerate);
+    const int e = DisplayCatalogLoadDisplays(catalog);
+    if (e) {
+        fprintf(err, "CGGetActiveDisplayList CGError: %d\n", e);
+        return e;
+    }
+    int *load_errors = ScratchAlloc(
+        catalog, ((size_t)catalog->num_displays + 1) * sizeof(*load_errors));
+    if (load_errors == NULL) {
+        fprintf(err, "Out of memory listing display modes\n");
+        return EXIT_FAILURE;
+    }
+    DisplayCatalogLoadAllModes(catalog, load_errors);
+
+    AllocSetPhase(kAllocPhaseFormat);
+    struct TraceSpan span;
+    TraceSpanBegin(&span, "format", "phase");
+    // Only one of the writers is used; both are too big for the stack.
+    struct CsvWriter *csv = NULL;
+    struct CborWriter *cbor = NULL;
+    if (format == kOutputCbor) {
+        cbor = ScratchAlloc(catalog, sizeof(*cbor));
+    } else {
+        csv = ScratchAlloc(catalog, sizeof(*csv));
+    }
+    if (csv == NULL && cbor == NULL) {
+        fprintf(err, "Out of memory listing display modes\n");
+        TraceSpanEnd(&span);
+        ScratchFree(catalog, load_errors);
+        return EXIT_FAILURE;
+    }
+    if (cbor != NULL) {
+        CborWriterInit(cbor, out);
+        ExportCborBegin(cbor, catalog->num_displays);
+    } else {
+        CsvWriterInit(csv, out, format == kOutputTsv ? '\t' : ',');
+        ExportCsvHeader(csv);
+    }
+    int status = EXIT_SUCCESS;
+    for (uint32_t i = 0; i < catalog->num_displays; ++i) {
+        const struct DisplayModeList *list = &catalog->modes[i];
+        const struct DisplayModeTable *table = NULL;
+        if (load_errors[i]) {
+            fprintf(err, "Failed to get display modes\n");
+        }
+        uint64_t *selected = NULL;
+        if (DisplayCatalogGetTable(catalog, i, &table) ||
+            SelectRows(catalog, filter, table, &selected)) {
+            fprintf(err, "Out of memory listing display modes\n");
+            status = EXIT_FAILURE;
+            break;
+        }
+        const struct EdidInfo *edid =
+            catalog->edid[i] != NULL ? &catalog->edid[i]->info : NULL;
+        if (cbor != NULL) {
+            ExportCborBeginDisplay(cbor, i, edid, table);
+        }
+        // The table ends with the current mode if it isn't in the list.
+        const size_t count = table->count;
+        for (size_t row = NextSelectedRow(selected, 0, count); row < count;
+             row = NextSelectedRow(selected, row + 1, count)) {
+            const struct DisplayMode *mode = row < list->count
+                                                 ? &list->modes[row]
+                                                 : &list->current;
+            if (cbor != NULL) {
+                ExportCborMode(cbor, table, row, mode->refresh_rate);
+            } else {
+                ExportCsvMode(csv, i, edid, table, row, mode->refresh_rate);
+            }
+        }
+        ScratchFree(catalog, selected);
+        if (cbor != NULL) {
+            ExportCborEndDisplay(cbor);
+        }
+    }
+    ScratchFree(catalog, load_errors);
+    AllocSetPhase(kAllocPhaseWrite);
+    const int write_error = cbor != NULL ? CborWriterFlush(cbor)
+                                         : CsvWriterFlush(csv);
+    ScratchFree(catalog, cbor);
+    ScratchFree(catalog, csv);
+    TraceSpanEnd(&span);
+    if (status == EXIT_SUCCESS && write_error) {
+        fprintf(err, "Failed to write the mode listing\n");
+        return EXIT_FAILURE;
+    }
+    return status;
+}
+
+// Appends one line per resolution of the rows of "table" set in "selected"
+// (or of every row if it's NULL).  Returns 0, or -1 if out of memory.
+static int PrintGroups(struct DisplayCatalog *catalog,
+                       const struct DisplayModeTable *table,
+                       const uint64_t *selected, struct OutputBuffer *output) {
+    struct DisplayModeGroups groups;
+    if (DisplayModeGroupsBuild(&groups, table, selected, catalog->scratch)) {
+        return -1;
+    }
+    for (size_t i = 0; i < groups.count; ++i) {
+        // Lines with many refresh rates may not fit the usual reservation.
+        char *line = OutputBufferReserve(output, kModeTableMaxLine);
+        int length = line != NULL ? DisplayModeGroupFormat(
+                                        &groups, table, i, line,
+                                        kModeTableMaxLine)
+                                  : 0;
+        if (length >= kModeTableMaxLine) {
+            line = OutputBufferReserve(output, (size_t)length + 1);
+            if (line != NULL) {
+                DisplayModeGroupFormat(&groups, table, i, line,
+                                       (size_t)length + 1);
+            }
+        }
+        if (line == NULL) {
+            break;
+        }
+        output->length += (size_t)length;
+        const int is_current = (groups.groups[i].flags & kModeFlagCurrent) != 0;
+        OutputBufferAppend(output, is_current ? " *\n" : "\n",
+                           is_current ? 3 : 1);
+    }
+    DisplayModeGroupsFree(&groups);
+    return output->error ? -1 : 0;
+}
+
+// Appends the display modes of one display that pass "filter" (which may be
+// NULL), one line per mode or, with "grouped", per resolution.  The modes
+// must already be loaded.  Only touches the display's own state, so displays
+// can be formatted concurrently.  Returns 0, or -1 if out of memory.
+static int PrintModes(struct DisplayCatalog *catalog, uint32_t index,
+                      const struct ModeFilter *filter, int grouped,
+                      struct OutputBuffer *output) {
+    const struct DisplayModeTable *table = NULL;
+    uint64_t *selected = NULL;
+    if (DisplayCatalogGetTable(catalog, index, &table) ||
+        SelectRows(catalog, filter, table, &selected)) {
+        return -1;
+    }
+    if (grouped) {
+        const int e = PrintGroups(catalog, table, selected, output);
+        ScratchFree(catalog, selected);
+        return e;
+    }
+
+    // Decide once per listing whether the per-mode diagnostics are wanted.
+    // The table ends with the current mode if it isn't in the list (e.g.
+    // when the list couldn't be read), so that it's printed anyway.
+    const int log_json = LOG_ENABLED(LOG_LEVEL_DEBUG);
+    const size_t count = table->count;
+    for (size_t i = NextSelectedRow(selected, 0, count); i < count;
+         i = NextSelectedRow(selected, i + 1, count)) {
+        PrintMode(table, i, output, log_json);
+    }
+    ScratchFree(catalog, selected);
+    return output->error ? -1 : 0;
+}
+
+// A text listing whose displays are formatted on a worker pool, each into
+// its own buffer.
+struct TextListing {
+    struct DisplayCatalog *catalog;
+    const struct ModeFilter *filter;
+    int grouped;
+    // One entry per display, allocated with the listing.
+    struct OutputBuffer *outputs;
+    int *load_errors;
+    int *format_errors;
+};
+
+static void PrintModesTask(void *context, size_t index) {
+    struct TextListing *listing = context;
+    if (listing->load_errors[index] == 0) {
+        listing->format_errors[index] =
+            PrintModes(listing->catalog, (uint32_t)index, listing->filter,
+                       listing->grouped, &listing->outputs[index]);
+    }
+}
+
+// Prints the display modes that pass "filter" (which may be NULL) for every
+// active display, grouped by resolution if "grouped".  The displays are
+// enumerated and formatted concurrently, then merged in display order, so
+// the output matches a serial listing.
+static int PrintModesText(struct DisplayCatalog *catalog,
+                          const struct ModeFilter *filter, int grouped,
+                          FILE *out, FILE *err) {
+    AllocSetPhase(kAllocPhaseEnumerate);
+    const int e = DisplayCatalogLoadDisplays(catalog);
+    if (e) {
+        fprintf(err, "CGGetActiveDisplayList CGError: %d\n", e);
+        return e;
+    }
+    const uint32_t num_displays = catalog->num_displays;
+    struct TextListing *listing =
+        ScratchCalloc(catalog, 1,
+                      sizeof(*listing) +
+                      (size_t)num_displays * (sizeof(*listing->outputs) +
+                                              2 * sizeof(*listing->load_errors)));
+    if (listing == NULL) {
+        fprintf(err, "Out of memory listing display modes\n");
+        return EXIT_FAILURE;
+    }
+    listing->catalog = catalog;
+    listing->filter = filter;
+    listing->grouped = grouped;
+    listing->outputs = (struct OutputBuffer *)(listing + 1);
+    listing->load_errors = (int *)(listing->outputs + num_displays);
+    listing->format_errors = listing->load_errors + num_displays;
+    DisplayCatalogLoadAllModes(catalog, listing->load_errors);
+
+    // Collect the whole listing and write it at once.
+    AllocSetPhase(kAllocPhaseFormat);
+    struct TraceSpan span;
+    TraceSpanBegin(&span, "format", "phase");
+    for (uint32_t i = 0; i < num_displays; ++i) {
+        OutputBufferInitArena(&listing->outputs[i], catalog->scratch);
+    }
+    WorkerPoolRun(num_displays, catalog->max_threads, PrintModesTask, listing);
+    struct OutputBuffer output;
+    OutputBufferInitArena(&output, catalog->scratch);
+    for (uint32_t i = 0; i < num_displays; ++i) {
+        OutputBufferPrintf(&output, "%sDisplay %u%s:\n", i == 0 ? "" : "\n",
+                           i, i == 0 ? " (MAIN)" : "");
+        if (listing->load_errors[i]) {
+            fprintf(err, "Failed to get display modes\n");
+        } else if (listing->format_errors[i]) {
+            fprintf(err, "Out of memory listing display modes\n");
+        }
+        if (listing->outputs[i].length > 0) {
+            OutputBufferAppend(&output, listing->outputs[i].data,
+                               listing->outputs[i].length);
+        }
+        OutputBufferFree(&listing->outputs[i]);
+    }
+    ScratchFree(catalog, listing);
+    TraceSpanEnd(&span);
+    AllocSetPhase(kAllocPhaseWrite);
+    TraceSpanBegin(&span, "write", "phase");
+    const int write_error = OutputBufferWrite(&output, out);
+    TraceSpanEnd(&span);
+    OutputBufferFree(&output);
+    if (write_error) {
+        fprintf(err, "Failed to write the mode listing\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int PrintModesForAllDisplays(struct DisplayCatalog *catalog, FILE *out,
+                             FILE *err) {
+    return PrintModesText(catalog, NULL, 0, out, err);
+}
+
+// Checks that "display_index" names an active display.
+static int CheckDisplayIndex(struct DisplayCatalog *catalog,
+                             uint32_t display_index, FILE *err) {
+    const int e = DisplayCatalogLoadDisplays(catalog);
+    if (e) {
+        fprintf(err, "CGGetActiveDisplayList CGError: %d\n", e);
+        return e;
+    }
+    if (catalog->num_displays <= display_index) {
+        fprintf(err, "Display %u not supported; display must be < %u\n",
+                display_index, catalog->num_displays);
+        return kDisplayErrorRangeCheck;
+    }
+    return 0;
+}
+
+// Finds the mode of "spec" on its display, with a backend handle so that it
+// can be applied.  Returns 0 and sets *matched, or a non-zero error.
+static int ResolveModeSpec(struct DisplayCatalog *catalog,
+                           const struct ModeSpec *spec, ptrdiff_t *matched,
+                           FILE *err) {
+    const uint32_t index = spec->display_index;
+    int e;
+    if ((e = CheckDisplayIndex(catalog, index, err))) {
+        return e;
+    }
+
+    struct TraceSpan span;
+    TraceSpanBegin(&span, "match", "phase");
+    span.display = catalog->displays[index];
+    const struct DisplayModeList *list = NULL;
+    DisplayCatalogGetModes(catalog, index, &list);
+    *matched = DisplayCatalogFindMode(catalog, index, spec->width,
+                                      spec->height, spec->refresh_rate);
+    if (*matched >= 0 && list->modes[*matched].handle == NULL) {
+        // Cached modes can't be applied; enumerate to get the backend's mode.
+        DisplayCatalogGetLiveModes(catalog, index, &list);
+        *matched = DisplayCatalogFindMode(catalog, index, spec->width,
+                                          spec->height, spec->refresh_rate);
+    }
+    TraceSpanEnd(&span);
+    if (*matched < 0) {
+        if (spec->refresh_rate == 0.0) {
+            fprintf(err, "Could not find a mode for resolution %lux%lu\n",
+                    spec->width, spec->height);
+        } else {
+            fprintf(err, "Could not find a mode for resolution %lux%lu @%.1f\n",
+                    spec->width, spec->height, spec->refresh_rate);
+        }
+        return -1;
+    }
+    return 0;
+}
+
+// Sets the display at indices[i] to its live mode matched[i], for each of
+// the "count" displays, in one transaction so that the displays reconfigure
+// once.  Returns 0, or the backend's error.
+static int ApplyModes(struct DisplayCatalog *catalog, const uint32_t *indices,
+                      const ptrdiff_t *matched, size_t count, FILE *err) {
+    const struct DisplayBackend *backend = catalog->backend;
+    struct TraceSpan span;
+    TraceSpanBegin(&span, "apply", "phase");
+    void *config = NULL;
+    int e;
+    if ((e = backend->begin_configuration(backend->context, &config))) {
+        TraceSpanEnd(&span);
+        fprintf(err, "CGBeginDisplayConfiguration CGError: %d\n", e);
+        return e;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        const uint32_t index = indices[i];
+        if ((e = backend->configure_display(
+                 backend->context, config, catalog->displays[index],
+                 &catalog->modes[index].modes[matched[i]]))) {
+            backend->cancel_configuration(backend->context, config);
+            TraceSpanEnd(&span);
+            fprintf(err, "CGConfigureDisplayWithDisplayMode CGError: %d\n", e);
+            return e;
+        }
+    }
+    e = backend->complete_configuration(backend->context, config);
+    TraceSpanEnd(&span);
+    if (e) {
+        fprintf(err, "CGCompleteDisplayConfiguration CGError: %d\n", e);
+        return e;
+    }
+    return 0;
+}
+
+// Copies the "num_specs" specifications to "resolved", with the displays
+// given by name or identity looked up.  Returns 0, or a non-zero error.
+static int ResolveDisplayNames(struct DisplayCatalog *catalog,
+                               const struct ModeSpec *specs, size_t num_specs,
+                               struct ModeSpec *resolved, FILE *err) {
+    for (size_t i = 0; i < num_specs; ++i) {
+        resolved[i] = specs[i];
+        if (specs[i].display_name == NULL) {
+            continue;
+        }
+        const int e = DisplayCatalogFindDisplay(catalog, specs[i].display_name,
+                                                &resolved[i].display_index);
+        if (e == kDisplayErrorRangeCheck) {
+            fprintf(err, "Unknown display '%s'\n", specs[i].display_name);
+            return e;
+        }
+        if (e) {
+            fprintf(err, "CGGetActiveDisplayList CGError: %d\n", e);
+            return e;
+        }
+        resolved[i].display_name = NULL;
+    }
+    return 0;
+}
+
+int ConfigureMode(struct DisplayCatalog *catalog,
+                  const struct ParsedArgs *parsed_args, FILE *out, FILE *err) {
+    const size_t num_specs = parsed_args->num_specs;
+    struct ModeSpec specs[kMaxModeSpecs];
+    ptrdiff_t matched[kMaxModeSpecs] = {0};
+    int e;
+
+    AllocSetPhase(kAllocPhaseEnumerate);
+    if ((e = ResolveDisplayNames(catalog, parsed_args->specs, num_specs, specs,
+                                 err))) {
+        return e;
+    }
+    // Resolve every specification before touching any display, so that a
+    // bad one leaves all displays as they were.
+    for (size_t i = 0; i < num_specs; ++i) {
+        const uint32_t index = specs[i].display_index;
+        for (size_t j = 0; j < i; ++j) {
+            if (specs[j].display_index == index) {
+                fprintf(err, "Display %u specified more than once\n", index);
+                return -1;
+            }
+        }
+        if ((e = ResolveModeSpec(catalog, &specs[i], &matched[i],
+                                 err))) {
+            return e;
+        }
+    }
+
+    size_t original_width[kMaxModeSpecs];
+    size_t original_height[kMaxModeSpecs];
+    double original_refresh_rate[kMaxModeSpecs];
+    for (size_t i = 0; i < num_specs; ++i) {
+        const struct DisplayModeList *list =
+            &catalog->modes[specs[i].display_index];
+        original_width[i] = list->has_current ? list->current.width : 0;
+        original_height[i] = list->has_current ? list->current.height : 0;
+        original_refresh_rate[i] =
+            list->has_current ? list->current.refresh_rate : 0.0;
+    }
+
+    uint32_t indices[kMaxModeSpecs] = {0};
+    for (size_t i = 0; i < num_specs; ++i) {
+        indices[i] = specs[i].display_index;
+    }
+    if ((e = ApplyModes(catalog, indices, matched, num_specs, err))) {
+        return e;
+    }
+
+    for (size_t i = 0; i < num_specs; ++i) {
+        const struct ModeSpec *spec = &specs[i];
+        DisplayCatalogSetCurrentMode(catalog, spec->display_index,
+                                     (size_t)matched[i]);
+        if (num_specs > 1) {
+            fprintf(out, "Display %u: ", spec->display_index);
+        }
+        if (spec->refresh_rate == 0.0) {
+            fprintf(out, "Changed display resolution from %zux%zu to %lux%lu\n",
+                    original_width[i], original_height[i],
+                    spec->width, spec->height);
+        } else {
+            fprintf(out, "Changed display resolution from %zux%zu @%f to %lux%lu @%.1f\n",
+                    original_width[i], original_height[i],
+                    original_refresh_rate[i], spec->width, spec->height,
+                    spec->refresh_rate);
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+// Times switches between the modes described by "parsed_args" (the "p"
+// option) and prints the report.
+static int ProfileModeSwitches(struct DisplayCatalog *catalog,
+                               const struct ParsedArgs *parsed_args, FILE *out,
+                               FILE *err) {
+    struct ModeSpec specs[kMaxModeSpecs];
+    struct ProfileReport report;
+    int e = ResolveDisplayNames(catalog, parsed_args->specs,
+                                parsed_args->num_specs, specs, err);
+    if (e) {
+        return e;
+    }
+    e = DisplayProfileRun(catalog, specs, parsed_args->num_specs,
+                          parsed_args->iterations, NULL, &report, err);
+    if (report.switches > 0 &&
+        DisplayProfileWrite(&report, parsed_args->output_format, out)) {
+        fprintf(err, "Failed to write the profile\n");
+        return e ? e : EXIT_FAILURE;
+    }
+    return e ? e : EXIT_SUCCESS;
+}
+
+// Prints each display's identity and names, recording the identities in
+// the display map.
+static int ListDisplayNames(struct DisplayCatalog *catalog, FILE *out,
+                            FILE *err) {
+    const struct DisplayIdMap *ids = catalog->ids;
+    int e = DisplayCatalogRevalidate(catalog);
+    if (e) {
+        fprintf(err, "CGGetActiveDisplayList CGError: %d\n", e);
+        return e;
+    }
+    const uint32_t count = catalog->num_displays;
+    struct DisplayIdentity *identities =
+        malloc((count ? count : 1) * sizeof(*identities));
+    unsigned char *known = calloc(count ? count : 1, 1);
+    if (identities == NULL || known == NULL ||
+        (catalog->backend->get_display_identity != NULL &&
+         DisplayCatalogReadIdentities(catalog, identities, known))) {
+        free(identities);
+        free(known);
+        fputs("Out of memory\n", err);
+        return EXIT_FAILURE;
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+        fprintf(out, "Display %u", i);
+        if (!known[i]) {
+            fputs(": unknown\n", out);
+            continue;
+        }
+        char text[kDisplayIdentityMaxText];
+        DisplayIdentityFormat(&identities[i], text, sizeof(text));
+        fprintf(out, ": %s", text);
+        // Of an identity several displays share, only the names given to
+        // this display are its own.
+        const int shared = DisplayIdentityShared(identities, known, count, i);
+        for (size_t slot = 0; ids != NULL && slot < ids->capacity; ++slot) {
+            const struct DisplayIdMapEntry *entry = &ids->slots[slot];
+            if (entry->key != 0 && (entry->flags & kDisplayIdMapNamed) &&
+                DisplayIdentityEqual(&entry->identity, &identities[i]) &&
+                (!shared || entry->display == catalog->displays[i])) {
+                fprintf(out, " %s", entry->name);
+            }
+        }
+        fputs("\n", out);
+    }
+    free(identities);
+    free(known);
+    return EXIT_SUCCESS;
+}
+
+// Lists the displays' names (the "n" option), or gives the display
+// "parsed_args->display_name" (an index, name or identity) a name.
+static int NameDisplay(struct DisplayCatalog *catalog,
+                       const struct ParsedArgs *parsed_args, FILE *out,
+                       FILE *err) {
+    if (parsed_args->name == NULL) {
+        return ListDisplayNames(catalog, out, err);
+    }
+    const char *name = parsed_args->name;
+    if (!DisplayIdMapValidName(name)) {
+        fprintf(err, "Invalid display name '%s'\n", name);
+        return EXIT_FAILURE;
+    }
+    if (catalog->ids == NULL) {
+        fputs("No display map to keep names in\n", err);
+        return EXIT_FAILURE;
+    }
+
+    struct ModeSpec spec;
+    memset(&spec, 0, sizeof(spec));
+    const char *display = parsed_args->display_name;
+    if (display[0] != '\0' && display[strspn(display, "0123456789")] == '\0') {
+        spec.display_index = (uint32_t)strtoul(display, NULL, 10);
+    } else {
+        spec.display_name = display;
+    }
+    int e;
+    if ((e = ResolveDisplayNames(catalog, &spec, 1, &spec, err)) ||
+        (e = CheckDisplayIndex(catalog, spec.display_index, err))) {
+        return e;
+    }
+    const uint32_t index = spec.display_index;
+    const uint32_t id = catalog->displays[index];
+    const uint32_t count = catalog->num_displays;
+    if (catalog->backend->get_display_identity == NULL) {
+        fprintf(err, "Display %u has no identity to name\n", index);
+        return EXIT_FAILURE;
+    }
+    // Every display's identity is read, to tell whether this one is unique.
+    struct DisplayIdentity *identities =
+        malloc((count ? count : 1) * sizeof(*identities));
+    unsigned char *known = malloc(count ? count : 1);
+    if (identities == NULL || known == NULL ||
+        DisplayCatalogReadIdentities(catalog, identities, known)) {
+        free(identities);
+        free(known);
+        fputs("Out of memory\n", err);
+        return EXIT_FAILURE;
+    }
+    const struct DisplayIdentity identity = identities[index];
+    const int has_identity = known[index];
+    const int shared = has_identity &&
+                       DisplayIdentityShared(identities, known, count, index);
+    free(identities);
+    free(known);
+    if (!has_identity) {
+        fprintf(err, "Display %u has no identity to name\n", index);
+        return EXIT_FAILURE;
+    }
+    char text[kDisplayIdentityMaxText];
+    DisplayIdentityFormat(&identity, text, sizeof(text));
+    // A name of an identity another display also has couldn't tell them
+    // apart once they move.
+    if (shared) {
+        fprintf(err,
+                "Display %u (%s) can't be named: another display has the "
+                "same identity\n",
+                index, text);
+        return EXIT_FAILURE;
+    }
+    if (DisplayIdMapPut(catalog->ids, name, &identity, id, index,
+                        kDisplayIdMapNamed)) {
+        fputs("Out of memory\n", err);
+        return EXIT_FAILURE;
+    }
+    // Saved before reporting success, so that a name that couldn't be kept
+    // isn't reported as given.
+    if (DisplayIdMapFlush(catalog->ids)) {
+        fprintf(err, "Could not write display map %s: %s\n",
+                catalog->ids->path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    fprintf(out, "Display %u (%s) is now '%s'\n", index, text, name);
+    return EXIT_SUCCESS;
+}
+
+// Applies the layout "parsed_args->name" (the "l" option), compiling it
+// first if it has no plan or its plan no longer holds; without a name,
+// compiles every layout.
+static int ApplyLayout(struct DisplayCatalog *catalog,
+                       const struct ParsedArgs *parsed_args, FILE *out,
+                       FILE *err) {
+    struct DisplayLayouts *layouts = catalog->layouts;
+    const char *name = parsed_args->name;
+    if (layouts == NULL) {
+        fputs("No layouts to apply\n", err);
+        return EXIT_FAILURE;
+    }
+    AllocSetPhase(kAllocPhaseEnumerate);
+    if (name == NULL) {
+        return DisplayLayoutsCompile(layouts, catalog, NULL, out, err)
+            ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    struct TraceSpan span;
+    TraceSpanBegin(&span, "check plan", "phase");
+    const struct DisplayLayoutPlan *plan = DisplayLayoutsFind(layouts, name);
+    int e = plan != NULL ? DisplayLayoutCheck(catalog, plan) : 1;
+    TraceSpanEnd(&span);
+    if (e == 1) {
+        LOG_DEBUG("Compiling layout '%s'", name);
+        e = DisplayLayoutsCompile(layouts, catalog, name, out, err);
+        if (e == kDisplayErrorRangeCheck) {
+            fprintf(err, "Unknown layout '%s'\n", name);
+            return e;
+        }
+        if (e) {
+            return EXIT_FAILURE;
+        }
+        plan = DisplayLayoutsFind(layouts, name);
+    } else if (e) {
+        fprintf(err, "CGDisplayCopyAllDisplayModes CGError: %d\n", e);
+        return e;
+    }
+
+    uint32_t indices[kMaxModeSpecs];
+    ptrdiff_t matched[kMaxModeSpecs];
+    for (uint32_t i = 0; i < plan->num_displays; ++i) {
+        indices[i] = plan->displays[i].index;
+        matched[i] = plan->displays[i].mode_index;
+    }
+    if ((e = ApplyModes(catalog, indices, matched, plan->num_displays, err))) {
+        return e;
+    }
+    for (uint32_t i = 0; i < plan->num_displays; ++i) {
+        DisplayCatalogSetCurrentMode(catalog, indices[i], (size_t)matched[i]);
+    }
+    fprintf(out, "Applied layout '%s' to %u display%s\n", name,
+            plan->num_displays, plan->num_displays == 1 ? "" : "s");
+    return EXIT_SUCCESS;
+}
+
+int CommandConfigures(enum Option option) {
+    return option == kOptionConfigureMode || option == kOptionProfile ||
+           option == kOptionLayout || option == kOptionBatch;
+}
+
+int RunCommand(struct DisplayCatalog *catalog,
+               const struct ParsedArgs *parsed_args, FILE *out, FILE *err) {
+    switch (parsed_args->option) {
+        case kOptionMissing: {
+            fputs("Missing option\n\n", err);
+            ShowUsage(out);
+            break;
+        }
+        case kOptionInvalid: {
+            fprintf(err, "Invalid option: '%s'\n\n",
+                    parsed_args->literal_option);
+            ShowUsage(out);
+            break;
+        }
+        case kOptionInvalidMode: {
+            fputs("Invalid mode\n", err);
+            break;
+        }
+        case kOptionConfigureMode:
+            if (parsed_args->verbose) {
+                fprintf(out, "[VERBOSE] Configuring display mode...\n");
+            }
+            return ConfigureMode(catalog, parsed_args, out, err);
+        case kOptionHelp:
+        case kOptionLongHelp:
+            ShowUsage(out);
+            return EXIT_SUCCESS;
+        case kOptionSupportedModes:
+            if (parsed_args->verbose) {
+                fprintf(out, "[VERBOSE] Printing supported display modes...\n");
+            }
+            switch (parsed_args->output_format) {
+                case kOutputJson:
+                case kOutputNdjson:
+                    return PrintModesJson(catalog, &parsed_args->filter,
+                                          parsed_args->grouped,
+                                          parsed_args->output_format == kOutputNdjson,
+                                          out, err);
+                case kOutputCsv:
+                case kOutputTsv:
+                case kOutputCbor:
+                    return PrintModesExport(catalog, &parsed_args->filter,
+                                            parsed_args->output_format, out,
+                                            err);
+                default:
+                    return PrintModesText(catalog, &parsed_args->filter,
+                                          parsed_args->grouped, out, err);
+            }
+        case kOptionVersion:
+        case kOptionLongVersion:
+            fprintf(out, "%s\nCopyright 2019-2023 Dean Scarff\n", kProgramVersion);
+            return EXIT_SUCCESS;
+        case kOptionProfile:
+            return ProfileModeSwitches(catalog, parsed_args, out, err);
+        case kOptionName:
+            return NameDisplay(catalog, parsed_args, out, err);
+        case kOptionLayout:
+            return ApplyLayout(catalog, parsed_args, out, err);
+        case kOptionWatch:
+            fputs("Watch mode only runs from the command line\n", err);
+            break;
+        case kOptionBatch:
+            fputs("Batch mode only runs from the command line\n", err);
+            break;
+        default:
+            break;
+    }
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,42 @@
+#ifndef DISPLAYMODE_COMMANDS_H
+#define DISPLAYMODE_COMMANDS_H
+
+#include <stdio.h>
+
+#include "displaymode_catalog.h"
+#include "displaymode_parse.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Name and version to display with "v" option.
+extern const char kProgramVersion[];
+
+// Prints a message describing how to invoke the tool on the command line.
+void ShowUsage(FILE *out);
+
+// Prints all display modes for every active display (the "d" option).
+int PrintModesForAllDisplays(struct DisplayCatalog *catalog, FILE *out,
+                             FILE *err);
+
+// Switches the displays to the modes described by "parsed_args" (the "t"
+// option).  All displays are changed in one configuration transaction: if
+// any mode can't be found or applied, none of the displays change.
+int ConfigureMode(struct DisplayCatalog *catalog,
+                  const struct ParsedArgs *parsed_args, FILE *out, FILE *err);
+
+// Returns non-zero if commands with "option" may change display modes, so
+// that catalogs shared with other invocations must be emptied after them.
+int CommandConfigures(enum Option option);
+
+// Runs the command described by "parsed_args" and returns its exit status.
+// Server mode is not handled here.
+int RunCommand(struct DisplayCatalog *catalog,
+               const struct ParsedArgs *parsed_args, FILE *out, FILE *err);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DISPLAYMODE_COMMANDS_H
@@ -0,0 +1,429 @@
+// Linux DRM implementation of the display backend, read from sysfs.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "displaymode_drm.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "displaymode_cache.h"
+
+// Width or height digits beyond which a mode line is malformed.
+#define kMaxDimensionDigits 5
+
+static int IsDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+size_t DrmParseModes(const char *data, size_t size, struct DisplayMode *modes,
+                     size_t max_modes) {
+    const char *p = data;
+    const char *const end = data + size;
+    size_t count = 0;
+    while (p < end && count < max_modes) {
+        size_t width = 0;
+        size_t height = 0;
+        const char *start = p;
+        while (p < end && IsDigit(*p)) {
+            width = width * 10 + (size_t)(*p++ - '0');
+        }
+        int valid = p > start && p - start <= kMaxDimensionDigits && p < end &&
+                    *p == 'x';
+        if (valid) {
+            start = ++p;
+            while (p < end && IsDigit(*p)) {
+                height = height * 10 + (size_t)(*p++ - '0');
+            }
+            valid = p > start && p - start <= kMaxDimensionDigits;
+        }
+        int interlaced = 0;
+        if (valid && p < end && *p == 'i') {
+            interlaced = 1;
+            ++p;
+        }
+        valid = valid && (p == end || *p == '\n');
+        if (!valid) {
+            const char *newline = memchr(p, '\n', (size_t)(end - p));
+            p = newline != NULL ? newline : end;
+        }
+        if (p < end) {
+            ++p;
+        }
+        if (valid) {
+            struct DisplayMode *mode = &modes[count];
+            mode->width = width;
+            mode->height = height;
+            mode->refresh_rate = 0.0;
+            mode->usable_for_desktop = !interlaced;
+            mode->mode_id = (int)count;
+            mode->handle = NULL;
+            ++count;
+        }
+    }
+    return count;
+}
+
+// Returns non-zero for connector directories ("card<N>-<connector>"), as
+// opposed to the cards themselves, render nodes and other entries.
+static int IsConnectorName(const char *name) {
+    if (strncmp(name, "card", 4) != 0 || !IsDigit(name[4]) ||
+        strlen(name) >= kDrmMaxConnectorName) {
+        return 0;
+    }
+    name += 4;
+    while (IsDigit(*name)) {
+        ++name;
+    }
+    return name[0] == '-' && name[1] != '\0';
+}
+
+static int CompareConnectors(const void *a, const void *b) {
+    return strcmp(((const struct DrmConnector *)a)->name,
+                  ((const struct DrmConnector *)b)->name);
+}
+
+// Reads at most "size" - 1 bytes of the connector's attribute "file" into
+// "out", NUL-terminated.  Returns the number of bytes read, or -1.
+static ssize_t ReadAttribute(const struct DrmBackend *drm,
+                             const struct DrmConnector *connector,
+                             const char *file, char *out, size_t size) {
+    char path[kDrmMaxConnectorName + 32];
+    snprintf(path, sizeof(path), "%s/%s", connector->name, file);
+    const int fd = openat(drm->root_fd, path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    ssize_t n;
+    do {
+        n = read(fd, out, size - 1);
+    } while (n < 0 && errno == EINTR);
+    close(fd);
+    out[n > 0 ? n : 0] = '\0';
+    return n;
+}
+
+// Reads all of the connector's attribute "file" into drm->buffer.  Returns
+// the number of bytes read, or -1.
+static ssize_t ReadFile(struct DrmBackend *drm,
+                        const struct DrmConnector *connector,
+                        const char *file) {
+    char path[kDrmMaxConnectorName + 32];
+    snprintf(path, sizeof(path), "%s/%s", connector->name, file);
+    const int fd = openat(drm->root_fd, path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    // sysfs attributes fit in a page, so this is usually one read plus the
+    // one that finds the end.
+    size_t size = 0;
+    for (;;) {
+        if (size == drm->buffer_size) {
+            const size_t grown_size = drm->buffer_size ? drm->buffer_size * 2
+                                                       : 4096;
+            char *grown = realloc(drm->buffer, grown_size);
+            if (grown == NULL) {
+                close(fd);
+                return -1;
+            }
+            drm->buffer = grown;
+            drm->buffer_size = grown_size;
+        }
+        const ssize_t n = read(fd, drm->buffer + size, drm->buffer_size - size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            close(fd);
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        size += (size_t)n;
+    }
+    close(fd);
+    return (ssize_t)size;
+}
+
+// Reads the connector's state and kernel object ID; "position" gives the
+// fallback ID.
+static void ReadConnector(const struct DrmBackend *drm,
+                          struct DrmConnector *connector, uint32_t position) {
+    char text[32];
+    connector->connected =
+        ReadAttribute(drm, connector, "status", text, sizeof(text)) > 0 &&
+        strncmp(text, "connected", 9) == 0 &&
+        (text[9] == '\n' || text[9] == '\0');
+    char *end = NULL;
+    unsigned long id = 0;
+    if (ReadAttribute(drm, connector, "connector_id", text, sizeof(text)) > 0) {
+        id = strtoul(text, &end, 10);
+    }
+    connector->id = end != NULL && end != text && id < kDrmFallbackIdBase
+        ? (uint32_t)id : kDrmFallbackIdBase + position;
+}
+
+int DrmBackendScan(struct DrmBackend *drm) {
+    drm->counted = 0;
+    if (drm->root_fd < 0) {
+        errno = EBADF;
+        return -1;
+    }
+    const int fd = openat(drm->root_fd, ".", O_RDONLY | O_DIRECTORY);
+    if (fd < 0) {
+        return -1;
+    }
+    DIR *dir = fdopendir(fd);
+    if (dir == NULL) {
+        close(fd);
+        return -1;
+    }
+    drm->num_connectors = 0;
+    const struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (!IsConnectorName(entry->d_name)) {
+            continue;
+        }
+        if (drm->num_connectors == drm->capacity) {
+            const uint32_t capacity = drm->capacity ? drm->capacity * 2 : 16;
+            struct DrmConnector *grown = realloc(
+                drm->connectors, capacity * sizeof(*grown));
+            if (grown == NULL) {
+                closedir(dir);
+                errno = ENOMEM;
+                return -1;
+            }
+            drm->connectors = grown;
+            drm->capacity = capacity;
+        }
+        strcpy(drm->connectors[drm->num_connectors++].name, entry->d_name);
+    }
+    closedir(dir);
+    // Directory order is arbitrary; sort so that display order is stable.
+    qsort(drm->connectors, drm->num_connectors, sizeof(drm->connectors[0]),
+          CompareConnectors);
+    uint64_t hash = kDisplayCacheHashSeed;
+    for (uint32_t i = 0; i < drm->num_connectors; ++i) {
+        struct DrmConnector *connector = &drm->connectors[i];
+        ReadConnector(drm, connector, i);
+        if (connector->connected) {
+            hash = DisplayCacheHash(hash, &connector->id, sizeof(connector->id));
+        }
+    }
+    drm->connected_hash = hash;
+    return 0;
+}
+
+// Finds the connector with the given ID, first after the last one found,
+// since the catalog asks for displays in order.
+static const struct DrmConnector *FindConnector(struct DrmBackend *drm,
+                                                uint32_t id) {
+    const uint32_t start =
+        drm->next_connector < drm->num_connectors ? drm->next_connector : 0;
+    for (uint32_t n = 0; n < drm->num_connectors; ++n) {
+        uint32_t i = start + n;
+        if (i >= drm->num_connectors) {
+            i -= drm->num_connectors;
+        }
+        if (drm->connectors[i].id == id) {
+            drm->next_connector = i + 1;
+            return &drm->connectors[i];
+        }
+    }
+    return NULL;
+}
+
+static int DrmGetActiveDisplays(void *context, uint32_t max_displays,
+                                uint32_t *displays, uint32_t *num_displays) {
+    struct DrmBackend *drm = context;
+    *num_displays = 0;
+    if (!drm->counted && DrmBackendScan(drm)) {
+        return kDisplayErrorFailure;
+    }
+    // Counting is followed by listing; both use this scan.
+    drm->counted = displays == NULL;
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < drm->num_connectors; ++i) {
+        if (!drm->connectors[i].connected) {
+            continue;
+        }
+        if (displays != NULL) {
+            if (n == max_displays) {
+                break;
+            }
+            displays[n] = drm->connectors[i].id;
+        }
+        ++n;
+    }
+    *num_displays = n;
+    return 0;
+}
+
+static int DrmCopyModes(void *context, uint32_t display,
+                        struct DisplayModeList *list) {
+    struct DrmBackend *drm = context;
+    memset(list, 0, sizeof(*list));
+    list->current_index = -1;
+    const struct DrmConnector *connector = FindConnector(drm, display);
+    const ssize_t size =
+        connector != NULL ? ReadFile(drm, connector, "modes") : -1;
+    if (size < 0) {
+        return kDisplayErrorFailure;
+    }
+    const size_t max_modes = DrmMaxModes((size_t)size);
+    list->modes = malloc(max_modes * sizeof(list->modes[0]));
+    if (list->modes == NULL) {
+        return kDisplayErrorFailure;
+    }
+    list->count = DrmParseModes(drm->buffer, (size_t)size, list->modes,
+                                max_modes);
+    for (size_t i = 0; i < list->count; ++i) {
+        // Handles are 1-based mode indices.
+        list->modes[i].handle = (const void *)(uintptr_t)(i + 1);
+    }
+    return 0;
+}
+
+static void DrmReleaseModes(void *context, struct DisplayModeList *list) {
+    (void)context;
+    free(list->modes);
+    memset(list, 0, sizeof(*list));
+    list->current_index = -1;
+}
+
+// Reads the manufacturer, product code and serial number from the EDID
+// header.
+static int DrmGetDisplayIdentity(void *context, uint32_t display,
+                                 struct DisplayIdentity *identity) {
+    static const unsigned char kEdidHeader[8] = {
+        0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x00,
+    };
+    struct DrmBackend *drm = context;
+    const struct DrmConnector *connector = FindConnector(drm, display);
+    unsigned char edid[17];
+    if (connector == NULL ||
+        ReadAttribute(drm, connector, "edid", (char *)edid, sizeof(edid)) < 16 ||
+        memcmp(edid, kEdidHeader, sizeof(kEdidHeader)) != 0) {
+        return kDisplayErrorFailure;
+    }
+    identity->vendor = (uint32_t)edid[8] << 8 | edid[9];
+    identity->model = (uint32_t)edid[11] << 8 | edid[10];
+    identity->serial = (uint32_t)edid[15] << 24 | (uint32_t)edid[14] << 16 |
+                       (uint32_t)edid[13] << 8 | edid[12];
+    return 0;
+}
+
+// Reads the connector's whole EDID, extensions included, into the buffer.
+static int DrmGetEdid(void *context, uint32_t display,
+                      const unsigned char **data, size_t *size) {
+    struct DrmBackend *drm = context;
+    const struct DrmConnector *connector = FindConnector(drm, display);
+    const ssize_t n = connector != NULL ? ReadFile(drm, connector, "edid") : -1;
+    if (n <= 0) {
+        return kDisplayErrorFailure;
+    }
+    *data = (const unsigned char *)drm->buffer;
+    *size = (size_t)n;
+    return 0;
+}
+
+// sysfs is read-only: setting a mode takes a DRM master (a compositor or X
+// server), so configuration always fails.
+static int DrmBeginConfiguration(void *context, void **config) {
+    (void)context;
+    *config = NULL;
+    return kDisplayErrorFailure;
+}
+
+static int DrmConfigureDisplay(void *context, void *config, uint32_t display,
+                               const struct DisplayMode *mode) {
+    (void)context;
+    (void)config;
+    (void)display;
+    (void)mode;
+    return kDisplayErrorFailure;
+}
+
+static int DrmCompleteConfiguration(void *context, void *config) {
+    (void)context;
+    (void)config;
+    return kDisplayErrorFailure;
+}
+
+static void DrmCancelConfiguration(void *context, void *config) {
+    (void)context;
+    (void)config;
+}
+
+static void SleepMs(int ms) {
+    struct timespec delay = {ms / 1000, (long)(ms % 1000) * 1000000};
+    while (nanosleep(&delay, &delay) != 0 && errno == EINTR) {
+    }
+}
+
+// Rescans every kDrmPollMs and reports a rescan whenever the connected
+// connectors differ from those last reported.
+static int DrmWait(void *context, int timeout_ms, struct DisplayEvent *events,
+                   size_t max_events) {
+    struct DrmBackend *drm = context;
+    for (;;) {
+        if (DrmBackendScan(drm)) {
+            return -1;
+        }
+        if (!drm->has_reported) {
+            drm->has_reported = 1;
+            drm->reported_hash = drm->connected_hash;
+        }
+        if (drm->connected_hash != drm->reported_hash && max_events > 0) {
+            drm->reported_hash = drm->connected_hash;
+            events[0].display = 0;
+            events[0].flags = kDisplayEventRescan;
+            return 1;
+        }
+        if (timeout_ms == 0) {
+            return 0;
+        }
+        const int wait_ms = timeout_ms > 0 && timeout_ms < kDrmPollMs
+            ? timeout_ms : kDrmPollMs;
+        SleepMs(wait_ms);
+        if (timeout_ms > 0) {
+            timeout_ms -= wait_ms;
+        }
+    }
+}
+
+int DrmBackendInit(struct DrmBackend *drm, const char *root) {
+    memset(drm, 0, sizeof(*drm));
+    drm->backend.context = drm;
+    drm->backend.get_active_displays = DrmGetActiveDisplays;
+    drm->backend.copy_modes = DrmCopyModes;
+    drm->backend.release_modes = DrmReleaseModes;
+    drm->backend.get_display_identity = DrmGetDisplayIdentity;
+    drm->backend.get_edid = DrmGetEdid;
+    drm->backend.begin_configuration = DrmBeginConfiguration;
+    drm->backend.configure_display = DrmConfigureDisplay;
+    drm->backend.complete_configuration = DrmCompleteConfiguration;
+    drm->backend.cancel_configuration = DrmCancelConfiguration;
+    drm->events.context = drm;
+    drm->events.wait = DrmWait;
+    drm->root_fd = open(root, O_RDONLY | O_DIRECTORY);
+    return drm->root_fd < 0 ? -1 : 0;
+}
+
+void DrmBackendFree(struct DrmBackend *drm) {
+    if (drm->root_fd >= 0) {
+        close(drm->root_fd);
+    }
+    free(drm->connectors);
+    free(drm->buffer);
+    drm->connectors = NULL;
+    drm->buffer = NULL;
+    drm->root_fd = -1;
+}
@@ -0,0 +1,88 @@
+#ifndef DISPLAYMODE_DRM_H
+#define DISPLAYMODE_DRM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "displaymode_backend.h"
+#include "displaymode_watch.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Where the kernel lists DRM connectors.
+#define kDrmSysfsRoot "/sys/class/drm"
+
+// How often the event source re-reads the connector states (ms).
+#define kDrmPollMs 1000
+
+// Longest connector directory name kept (like "card0-HDMI-A-1").
+#define kDrmMaxConnectorName 64
+
+// Connectors that don't have a connector_id file get IDs from here up, by
+// position, so they can't collide with the kernel's object IDs.
+#define kDrmFallbackIdBase 0x10000u
+
+// One connector directory of the sysfs tree.
+struct DrmConnector {
+    char name[kDrmMaxConnectorName];
+    uint32_t id;
+    int connected;
+};
+
+// The displays of the Linux DRM subsystem, as described in sysfs: every
+// connected connector (<root>/card<N>-<connector>/status) is a display, and
+// its "modes" file lists the resolutions it supports.  sysfs tells neither
+// the refresh rates nor the current mode, and can't set modes, so modes
+// have a refresh rate of 0, no display has a current mode, and configuring
+// fails.  Identities and EDIDs come from each connector's "edid" file.  The backend
+// isn't thread-safe: files are read into one reused buffer.
+struct DrmBackend {
+    struct DisplayBackend backend;
+    // Polls the connector states, reporting any change as a rescan.
+    struct DisplayEventSource events;
+    int root_fd;
+    // Every connector, sorted by name.
+    struct DrmConnector *connectors;
+    uint32_t num_connectors;
+    uint32_t capacity;
+    // Non-zero if the connectors were just read to count them, so that the
+    // list that follows can use the same scan.
+    int counted;
+    // Where the next connector lookup starts.
+    uint32_t next_connector;
+    // Hash of the connected connectors, and the one last reported.
+    uint64_t connected_hash;
+    uint64_t reported_hash;
+    int has_reported;
+    char *buffer;
+    size_t buffer_size;
+};
+
+// Sets up the backend for the sysfs tree at "root" (kDrmSysfsRoot, or a
+// fixture in tests).  Returns 0, or -1 with errno set if "root" can't be
+// opened, in which case every call of the backend fails.
+int DrmBackendInit(struct DrmBackend *drm, const char *root);
+
+void DrmBackendFree(struct DrmBackend *drm);
+
+// Re-reads the connectors and their states.  Returns 0, or -1 with errno
+// set.
+int DrmBackendScan(struct DrmBackend *drm);
+
+// Parses the "size" bytes of a sysfs "modes" file at "data" ("1920x1080",
+// one mode per line, with an "i" suffix if interlaced) into at most
+// "max_modes" modes, in one pass and without allocating.  Malformed lines
+// are skipped.  Returns the number of modes stored.
+size_t DrmParseModes(const char *data, size_t size, struct DisplayMode *modes,
+                     size_t max_modes);
+
+// The most modes DrmParseModes can find in "size" bytes.
+#define DrmMaxModes(size) ((size) / 4 + 1)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DISPLAYMODE_DRM_H
@@ -0,0 +1,528 @@
+#include "displaymode_edid.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const unsigned char kEdidHeader[8] = {
+    0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x00,
+};
+
+// Size of an EDID display descriptor (a detailed timing or a tagged one).
+#define kDescriptorSize 18
+
+// Size of a DisplayID type I or VII timing.
+#define kDisplayIdTimingSize 20
+
+// Slots of a new EdidCache; a power of two.
+#define kEdidCacheInitialSlots 16
+
+static int Checksum(const unsigned char *data, size_t size) {
+    unsigned sum = 0;
+    for (size_t i = 0; i < size; ++i) {
+        sum += data[i];
+    }
+    return (int)(sum & 0xff);
+}
+
+static uint32_t Uint16(const unsigned char *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8;
+}
+
+static uint32_t Uint24(const unsigned char *p) {
+    return Uint16(p) | (uint32_t)p[2] << 16;
+}
+
+static uint32_t Uint32(const unsigned char *p) {
+    return Uint24(p) | (uint32_t)p[3] << 24;
+}
+
+// Copies a descriptor or DisplayID string of at most "size" bytes, which
+// ends at a newline and may be padded with spaces, keeping printable ASCII.
+static void CopyString(char *out, const unsigned char *string, size_t size) {
+    size_t length = 0;
+    for (size_t i = 0; i < size && string[i] != '\n' &&
+                       length < kEdidMaxString - 1; ++i) {
+        if (string[i] >= 0x20 && string[i] < 0x7f) {
+            out[length++] = (char)string[i];
+        }
+    }
+    while (length > 0 && out[length - 1] == ' ') {
+        --length;
+    }
+    out[length] = '\0';
+}
+
+// Fills "timing" from the active and blanking sizes.  Returns -1 if they
+// don't make a timing.
+static int MakeTiming(uint32_t pixel_clock_khz, uint32_t width,
+                      uint32_t h_blank, uint32_t height, uint32_t v_blank,
+                      int interlaced, struct EdidTiming *timing) {
+    const uint64_t total = (uint64_t)(width + h_blank) * (height + v_blank);
+    if (pixel_clock_khz == 0 || width == 0 || height == 0 || total == 0) {
+        return -1;
+    }
+    timing->width = width;
+    // Interlaced timings give the size of a field.
+    timing->height = interlaced ? height * 2 : height;
+    timing->refresh_mhz =
+        (uint32_t)(((uint64_t)pixel_clock_khz * 1000000 + total / 2) / total);
+    timing->pixel_clock_khz = pixel_clock_khz;
+    timing->interlaced = interlaced != 0;
+    return 0;
+}
+
+static int SameTiming(const struct EdidTiming *a, const struct EdidTiming *b) {
+    return a->width == b->width && a->height == b->height &&
+           a->refresh_mhz == b->refresh_mhz && a->interlaced == b->interlaced;
+}
+
+// Adds "timing" unless it's known, first if it's the native one.
+static void AddTiming(struct EdidInfo *info, const struct EdidTiming *timing,
+                      int native) {
+    size_t found = info->num_timings;
+    for (size_t i = 0; i < info->num_timings; ++i) {
+        if (SameTiming(&info->timings[i], timing)) {
+            found = i;
+            break;
+        }
+    }
+    if (!native) {
+        if (found == info->num_timings && found < kEdidMaxTimings) {
+            info->timings[info->num_timings++] = *timing;
+        }
+        return;
+    }
+    // Move it (or the new one, dropping the last if full) to the front.
+    if (found == info->num_timings) {
+        if (found < kEdidMaxTimings) {
+            ++info->num_timings;
+        } else {
+            --found;
+        }
+    }
+    memmove(&info->timings[1], &info->timings[0],
+            found * sizeof(info->timings[0]));
+    info->timings[0] = *timing;
+    info->has_native = 1;
+}
+
+// Decodes an 18-byte detailed timing descriptor.  Returns -1 if it isn't a
+// timing.
+static int DecodeDetailedTiming(const unsigned char *d,
+                                struct EdidTiming *timing) {
+    return MakeTiming(Uint16(d) * 10,
+                      d[2] | (uint32_t)(d[4] & 0xf0) << 4,
+                      d[3] | (uint32_t)(d[4] & 0x0f) << 8,
+                      d[5] | (uint32_t)(d[7] & 0xf0) << 4,
+                      d[6] | (uint32_t)(d[7] & 0x0f) << 8,
+                      d[17] & 0x80, timing);
+}
+
+// Display descriptors (those with a zero pixel clock), by tag.
+
+static void DecodeName(const unsigned char *d, struct EdidInfo *info) {
+    CopyString(info->name, d + 5, 13);
+}
+
+static void DecodeSerialString(const unsigned char *d, struct EdidInfo *info) {
+    CopyString(info->serial_string, d + 5, 13);
+}
+
+static void (*const kDescriptorDecoders[256])(const unsigned char *,
+                                              struct EdidInfo *) = {
+    [0xfc] = DecodeName,
+    [0xff] = DecodeSerialString,
+};
+
+// DisplayID data blocks, by tag.  "revision" is the block's revision byte.
+
+// Product identification (0x00, and 0x20 in DisplayID 2): the vendor, the
+// product code, the serial number and the name.  The base EDID block's take
+// precedence.
+static void DecodeProductId(const unsigned char *p, size_t length,
+                            uint8_t tag, uint8_t revision,
+                            struct EdidInfo *info) {
+    (void)revision;
+    if (info->vendor == 0) {
+        if (tag == 0x00) {
+            // Three ASCII letters.
+            for (int i = 0; i < 3; ++i) {
+                info->vendor_id[i] = p[i] >= 'A' && p[i] <= 'Z' ? (char)p[i]
+                                                                 : '?';
+                info->vendor = info->vendor << 5 |
+                               (uint32_t)((p[i] - '@') & 0x1f);
+            }
+            info->vendor_id[3] = '\0';
+        } else {
+            // An IEEE OUI.
+            info->vendor = (uint32_t)p[0] << 16 | (uint32_t)p[1] << 8 | p[2];
+        }
+        info->model = Uint16(p + 3);
+        info->serial = Uint32(p + 5);
+    }
+    const size_t name_length = p[11];
+    if (info->name[0] == '\0' && name_length <= length - 12) {
+        CopyString(info->name, p + 12, name_length);
+    }
+}
+
+// Display parameters (0x01, and 0x21 in DisplayID 2): the image size in
+// tenths of a millimeter, or millimeters if bit 7 of a 0x21 block's
+// revision is set.  Only used if the base block gave no size.
+static void DecodeDisplayParameters(const unsigned char *p, size_t length,
+                                    uint8_t tag, uint8_t revision,
+                                    struct EdidInfo *info) {
+    (void)length;
+    if (info->width_mm != 0 && info->height_mm != 0) {
+        return;
+    }
+    const uint32_t width = Uint16(p);
+    const uint32_t height = Uint16(p + 2);
+    if (tag == 0x21 && (revision & 0x80)) {
+        info->width_mm = width;
+        info->height_mm = height;
+    } else {
+        info->width_mm = (width + 5) / 10;
+        info->height_mm = (height + 5) / 10;
+    }
+}
+
+// Type I (0x03) and type VII (0x22) detailed timings, 20 bytes each, whose
+// pixel clocks count 10 kHz and 1 kHz respectively.  Sizes are stored minus
+// one.  The EDID's detailed timings can't be wider or taller than 4095
+// pixels, so displays beyond that give their native timing here: a
+// preferred timing larger than the native one so far replaces it.
+static void DecodeDisplayIdTimings(const unsigned char *p, size_t length,
+                                   uint8_t tag, uint8_t revision,
+                                   struct EdidInfo *info) {
+    (void)revision;
+    const uint32_t clock_unit_khz = tag == 0x03 ? 10 : 1;
+    for (size_t offset = 0; offset + kDisplayIdTimingSize <= length;
+         offset += kDisplayIdTimingSize) {
+        const unsigned char *t = p + offset;
+        struct EdidTiming timing;
+        if (MakeTiming((Uint24(t) + 1) * clock_unit_khz, Uint16(t + 4) + 1,
+                       Uint16(t + 6) + 1, Uint16(t + 12) + 1,
+                       Uint16(t + 14) + 1, t[3] & 0x10, &timing)) {
+            continue;
+        }
+        const int larger = !info->has_native ||
+            (uint64_t)timing.width * timing.height >
+                (uint64_t)info->timings[0].width * info->timings[0].height;
+        AddTiming(info, &timing, (t[3] & 0x80) && larger);
+    }
+}
+
+// A DisplayID data block decoder and the shortest payload it reads.
+struct DataBlockDecoder {
+    size_t min_length;
+    void (*decode)(const unsigned char *payload, size_t length, uint8_t tag,
+                   uint8_t revision, struct EdidInfo *info);
+};
+
+static const struct DataBlockDecoder kDataBlockDecoders[256] = {
+    [0x00] = {12, DecodeProductId},
+    [0x01] = {8, DecodeDisplayParameters},
+    [0x03] = {kDisplayIdTimingSize, DecodeDisplayIdTimings},
+    [0x20] = {12, DecodeProductId},
+    [0x21] = {8, DecodeDisplayParameters},
+    [0x22] = {kDisplayIdTimingSize, DecodeDisplayIdTimings},
+};
+
+// Decodes the data blocks of the DisplayID section at "section", of which
+// "size" bytes are available.
+static void DecodeDisplayIdSection(const unsigned char *section, size_t size,
+                                   struct EdidInfo *info) {
+    if (size < 5) {
+        return;
+    }
+    const unsigned char *p = section + 4;
+    const unsigned char *end = p + (section[1] < size - 5 ? section[1]
+                                                          : size - 5);
+    while (end - p >= 3) {
+        const uint8_t tag = p[0];
+        const size_t length = p[2];
+        if (length > (size_t)(end - p) - 3) {
+            break;
+        }
+        const struct DataBlockDecoder *decoder = &kDataBlockDecoders[tag];
+        if (decoder->decode != NULL && length >= decoder->min_length) {
+            decoder->decode(p + 3, length, tag, p[1], info);
+        }
+        p += 3 + length;
+    }
+}
+
+// Extension blocks, by tag.
+
+// CTA-861: detailed timings from the offset in byte 2 up to the checksum.
+static void DecodeCtaExtension(const unsigned char *block,
+                               struct EdidInfo *info) {
+    const size_t first = block[2];
+    if (first < 4) {
+        return;
+    }
+    for (size_t offset = first; offset + kDescriptorSize < kEdidBlockSize;
+         offset += kDescriptorSize) {
+        struct EdidTiming timing;
+        if (Uint16(block + offset) == 0) {
+            break;
+        }
+        if (DecodeDetailedTiming(block + offset, &timing) == 0) {
+            AddTiming(info, &timing, 0);
+        }
+    }
+}
+
+// DisplayID: a section from byte 1, before the block's checksum.
+static void DecodeDisplayIdExtension(const unsigned char *block,
+                                     struct EdidInfo *info) {
+    DecodeDisplayIdSection(block + 1, kEdidBlockSize - 2, info);
+}
+
+static void (*const kExtensionDecoders[256])(const unsigned char *,
+                                             struct EdidInfo *) = {
+    [0x02] = DecodeCtaExtension,
+    [0x70] = DecodeDisplayIdExtension,
+};
+
+static int DecodeBaseBlock(const unsigned char *data, size_t size,
+                           struct EdidInfo *info) {
+    if (size < kEdidBlockSize || Checksum(data, kEdidBlockSize) != 0) {
+        return -1;
+    }
+    const uint32_t vendor = (uint32_t)data[8] << 8 | data[9];
+    const char letters[3] = {
+        (char)('@' + ((vendor >> 10) & 0x1f)),
+        (char)('@' + ((vendor >> 5) & 0x1f)),
+        (char)('@' + (vendor & 0x1f)),
+    };
+    if (letters[0] > '@' && letters[0] <= 'Z' && letters[1] > '@' &&
+        letters[1] <= 'Z' && letters[2] > '@' && letters[2] <= 'Z') {
+        memcpy(info->vendor_id, letters, 3);
+        info->vendor_id[3] = '\0';
+    }
+    info->vendor = vendor;
+    info->model = (uint32_t)data[11] << 8 | data[10];
+    info->serial = Uint32(data + 12);
+    info->version = data[18];
+    info->revision = data[19];
+    info->digital = (data[20] & 0x80) != 0;
+    const int v14 = data[18] > 1 || (data[18] == 1 && data[19] >= 4);
+    if (info->digital && v14) {
+        // 6 to 16 bits per color; 0 and 7 leave it unknown.
+        const int depth = (data[20] >> 4) & 0x07;
+        info->bits_per_color = depth >= 1 && depth <= 6
+                               ? (uint8_t)(4 + 2 * depth) : 0;
+    }
+
+    // From 1.4 on, the first detailed timing is always the preferred one.
+    const int first_preferred = v14 || (data[24] & 0x02);
+    int first = 1;
+    for (size_t offset = 54; offset + kDescriptorSize <= 126;
+         offset += kDescriptorSize) {
+        const unsigned char *d = data + offset;
+        if (Uint16(d) == 0) {
+            void (*const decode)(const unsigned char *, struct EdidInfo *) =
+                kDescriptorDecoders[d[3]];
+            if (decode != NULL) {
+                decode(d, info);
+            }
+            continue;
+        }
+        struct EdidTiming timing;
+        if (DecodeDetailedTiming(d, &timing) == 0) {
+            AddTiming(info, &timing, first && first_preferred);
+            // The image size in millimeters, more precise than bytes 21
+            // and 22.
+            const uint32_t width_mm = d[12] | (uint32_t)(d[14] & 0xf0) << 4;
+            const uint32_t height_mm = d[13] | (uint32_t)(d[14] & 0x0f) << 8;
+            if (info->width_mm == 0 && width_mm != 0 && height_mm != 0) {
+                info->width_mm = width_mm;
+                info->height_mm = height_mm;
+            }
+        }
+        first = 0;
+    }
+    // Both zero or one zero (an aspect ratio) means no size.
+    if (info->width_mm == 0 && data[21] != 0 && data[22] != 0) {
+        info->width_mm = data[21] * 10u;
+        info->height_mm = data[22] * 10u;
+    }
+
+    // Extensions that are missing (say, a truncated read) are skipped like
+    // those with a bad checksum.
+    const size_t num_extensions = data[126];
+    for (size_t i = 1; i <= num_extensions &&
+                       (i + 1) * kEdidBlockSize <= size; ++i) {
+        const unsigned char *block = data + i * kEdidBlockSize;
+        void (*const decode)(const unsigned char *, struct EdidInfo *) =
+            kExtensionDecoders[block[0]];
+        if (decode != NULL && Checksum(block, kEdidBlockSize) == 0) {
+            decode(block, info);
+        }
+    }
+    return 0;
+}
+
+int EdidDecode(const unsigned char *data, size_t size, struct EdidInfo *info) {
+    memset(info, 0, sizeof(*info));
+    if (size >= sizeof(kEdidHeader) &&
+        memcmp(data, kEdidHeader, sizeof(kEdidHeader)) == 0) {
+        return DecodeBaseBlock(data, size, info);
+    }
+    // A bare DisplayID section: versions 1.x and 2.x, a length that fits,
+    // and a checksum over the whole section.
+    if (size < 5 || data[0] < 0x10 || data[0] >= 0x30 ||
+        (size_t)data[1] + 5 > size ||
+        Checksum(data, (size_t)data[1] + 5) != 0) {
+        return -1;
+    }
+    info->version = data[0] >> 4;
+    info->revision = data[0] & 0x0f;
+    info->digital = 1;
+    DecodeDisplayIdSection(data, (size_t)data[1] + 5, info);
+    return 0;
+}
+
+void EdidDisplayName(const struct EdidInfo *info, char *out, size_t out_size) {
+    if (info->name[0] != '\0') {
+        snprintf(out, out_size, "%s", info->name);
+    } else if (info->vendor_id[0] != '\0') {
+        snprintf(out, out_size, "%s %04X", info->vendor_id,
+                 (unsigned)info->model);
+    } else {
+        snprintf(out, out_size, "Display");
+    }
+}
+
+void EdidPixelEncoding(const struct EdidInfo *info, char *out,
+                       size_t out_size) {
+    const size_t bits = info->bits_per_color;
+    // Channels are padded to 32 bits, as in "--RRRRRRRRRRGGGGGGGGGGBBBBBBBBBB".
+    const size_t padding = 3 * bits < 32 ? 32 - 3 * bits : 0;
+    if (bits == 0 || padding + 3 * bits >= out_size) {
+        snprintf(out, out_size, "Unknown");
+        return;
+    }
+    memset(out, '-', padding);
+    memset(out + padding, 'R', bits);
+    memset(out + padding + bits, 'G', bits);
+    memset(out + padding + 2 * bits, 'B', bits);
+    out[padding + 3 * bits] = '\0';
+}
+
+double EdidDpi(const struct EdidInfo *info, size_t width) {
+    if (info->width_mm == 0) {
+        return 0.0;
+    }
+    return (double)width * 25.4 / info->width_mm;
+}
+
+int EdidIsHiDpi(const struct EdidInfo *info, size_t width) {
+    return EdidDpi(info, width) >= kEdidHiDpiMinDpi;
+}
+
+// Hashes eight bytes at a time.  Byte-wise FNV-1a (DisplayCacheHash) costs
+// more than decoding the EDID would; this doesn't.
+static uint64_t HashBytes(const unsigned char *data, size_t size) {
+    const uint64_t kMultiplier = 0x9e3779b97f4a7c15ULL;
+    uint64_t hash = 0xcbf29ce484222325ULL ^ size;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * kMultiplier;
+        hash ^= hash >> 29;
+    }
+    uint64_t word = 0;
+    memcpy(&word, data + i, size - i);
+    hash = (hash ^ word) * kMultiplier;
+    return hash ^ hash >> 32;
+}
+
+void EdidCacheInit(struct EdidCache *cache) {
+    memset(cache, 0, sizeof(*cache));
+}
+
+void EdidCacheFree(struct EdidCache *cache) {
+    for (size_t i = 0; i < cache->capacity; ++i) {
+        if (cache->slots[i] != NULL) {
+            free(cache->slots[i]->data);
+            free(cache->slots[i]);
+        }
+    }
+    free(cache->slots);
+    memset(cache, 0, sizeof(*cache));
+}
+
+// Doubles the slots (or allocates the first ones).  Returns 0, or -1 if out
+// of memory.
+static int GrowCache(struct EdidCache *cache) {
+    const size_t capacity = cache->capacity ? cache->capacity * 2
+                                            : kEdidCacheInitialSlots;
+    struct EdidCacheEntry **slots = calloc(capacity, sizeof(*slots));
+    if (slots == NULL) {
+        return -1;
+    }
+    for (size_t i = 0; i < cache->capacity; ++i) {
+        struct EdidCacheEntry *entry = cache->slots[i];
+        if (entry != NULL) {
+            size_t slot = (size_t)entry->hash & (capacity - 1);
+            while (slots[slot] != NULL) {
+                slot = (slot + 1) & (capacity - 1);
+            }
+            slots[slot] = entry;
+        }
+    }
+    free(cache->slots);
+    cache->slots = slots;
+    cache->capacity = capacity;
+    return 0;
+}
+
+const struct EdidCacheEntry *EdidCacheGet(struct EdidCache *cache,
+                                          const unsigned char *data,
+                                          size_t size) {
+    const uint64_t hash = HashBytes(data, size);
+    if (cache->capacity > 0) {
+        // The bytes are compared too, so that a collision only costs a probe.
+        for (size_t slot = (size_t)hash & (cache->capacity - 1);
+             cache->slots[slot] != NULL;
+             slot = (slot + 1) & (cache->capacity - 1)) {
+            const struct EdidCacheEntry *entry = cache->slots[slot];
+            if (entry->hash == hash && entry->size == size &&
+                memcmp(entry->data, data, size) == 0) {
+                ++cache->hits;
+                return entry;
+            }
+        }
+    }
+    // At most three in four slots are used.
+    if ((cache->count + 1) * 4 > cache->capacity * 3 && GrowCache(cache)) {
+        return NULL;
+    }
+    struct EdidCacheEntry *entry = malloc(sizeof(*entry));
+    unsigned char *copy = malloc(size ? size : 1);
+    if (entry == NULL || copy == NULL) {
+        free(entry);
+        free(copy);
+        return NULL;
+    }
+    if (size > 0) {
+        memcpy(copy, data, size);
+    }
+    entry->hash = hash;
+    entry->data = copy;
+    entry->size = size;
+    entry->valid = EdidDecode(data, size, &entry->info) == 0;
+    ++cache->decodes;
+    size_t slot = (size_t)hash & (cache->capacity - 1);
+    while (cache->slots[slot] != NULL) {
+        slot = (slot + 1) & (cache->capacity - 1);
+    }
+    cache->slots[slot] = entry;
+    ++cache->count;
+    return entry;
+}
@@ -0,0 +1,127 @@
+#ifndef DISPLAYMODE_EDID_H
+#define DISPLAYMODE_EDID_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Size of an EDID block (the base block and each extension).
+#define kEdidBlockSize 128
+
+// Most detailed timings kept per display.
+#define kEdidMaxTimings 16
+
+// Longest name or serial string kept, plus the terminator.  EDID strings
+// hold 13 characters; DisplayID product names can be longer.
+#define kEdidMaxString 64
+
+// Pixel density (dots per inch) from which a mode counts as HiDPI.  A 27"
+// 4K display (163 dpi) and every Retina panel qualify; a 27" 1440p display
+// (109 dpi) doesn't.
+#define kEdidHiDpiMinDpi 150
+
+// One detailed timing (an EDID detailed timing descriptor or a DisplayID
+// type I or VII timing).
+struct EdidTiming {
+    uint32_t width;
+    uint32_t height;  // of the frame, for interlaced timings too
+    uint32_t refresh_mhz;
+    uint32_t pixel_clock_khz;
+    int interlaced;
+};
+
+// What displaymode uses of a display's EDID.  Fields the EDID doesn't
+// provide are zero or empty.
+struct EdidInfo {
+    // PNP manufacturer ID, like "DEL".
+    char vendor_id[4];
+    // As in DisplayIdentity.
+    uint32_t vendor;
+    uint32_t model;
+    uint32_t serial;
+    // The monitor name, and serial number string.
+    char name[kEdidMaxString];
+    char serial_string[kEdidMaxString];
+    // EDID version and revision (like 1 and 4), or the DisplayID version
+    // (like 2 and 0) of a bare DisplayID section.
+    uint8_t version;
+    uint8_t revision;
+    int digital;
+    // Bits per color channel, or 0 if not given.
+    uint8_t bits_per_color;
+    // Physical size of the image.
+    uint32_t width_mm;
+    uint32_t height_mm;
+    // Non-zero if timings[0] is the native (preferred) timing.
+    int has_native;
+    // The detailed timings, native first, without duplicates.
+    struct EdidTiming timings[kEdidMaxTimings];
+    size_t num_timings;
+};
+
+// Decodes the "size" bytes at "data": an EDID base block with its
+// extensions (CTA-861 and DisplayID), or a bare DisplayID section.  The
+// decoding is table-driven by descriptor, extension and data block tag;
+// unknown tags and extensions with a bad checksum are skipped.  Returns 0,
+// or -1 if "data" isn't an EDID or DisplayID, or the base block's checksum
+// is wrong.
+int EdidDecode(const unsigned char *data, size_t size, struct EdidInfo *info);
+
+// Writes the display's name into "out": the monitor name, or the vendor and
+// model (like "DEL A0C4") if it has none.
+void EdidDisplayName(const struct EdidInfo *info, char *out, size_t out_size);
+
+// Writes the pixel encoding into "out", in the notation of CoreGraphics
+// (like "--------RRRRRRRRGGGGGGGGBBBBBBBB" for 8 bits per color), or
+// "Unknown" if the EDID doesn't give the color depth.
+void EdidPixelEncoding(const struct EdidInfo *info, char *out,
+                       size_t out_size);
+
+// Returns the pixel density of a mode "width" pixels wide across the
+// display's image, or 0.0 if its physical size is unknown.
+double EdidDpi(const struct EdidInfo *info, size_t width);
+
+// Returns non-zero if a mode "width" pixels wide has at least
+// kEdidHiDpiMinDpi on the display.
+int EdidIsHiDpi(const struct EdidInfo *info, size_t width);
+
+// A decoded EDID, keyed by a hash of its bytes.
+struct EdidCacheEntry {
+    uint64_t hash;
+    unsigned char *data;
+    size_t size;
+    // Zero if the bytes didn't decode.
+    int valid;
+    struct EdidInfo info;
+};
+
+// Decoded EDIDs by content, so that listing the same displays again only
+// hashes their EDIDs.  Entries stay put until the cache is freed.
+struct EdidCache {
+    // Open addressing with linear probing; capacity is a power of two.
+    struct EdidCacheEntry **slots;
+    size_t capacity;
+    size_t count;
+    // Blobs decoded, and lookups that found them already decoded.
+    unsigned decodes;
+    unsigned hits;
+};
+
+void EdidCacheInit(struct EdidCache *cache);
+
+void EdidCacheFree(struct EdidCache *cache);
+
+// Returns the entry for the "size" bytes at "data", decoding them the first
+// time they are seen, or NULL if out of memory.
+const struct EdidCacheEntry *EdidCacheGet(struct EdidCache *cache,
+                                          const unsigned char *data,
+                                          size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DISPLAYMODE_EDID_H
@@ -0,0 +1,484 @@
+#include "displaymode_export.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+const char *const kExportDisplayColumnNames[kExportDisplayColumns] = {
+    "display", "main", "vendorId", "vendor", "model",
+    "serial", "serialString", "widthMm", "heightMm",
+};
+
+const char *const kExportModeColumnNames[kExportModeColumns] = {
+    "width", "height", "refreshRate", "aspectWidth", "aspectHeight",
+    "pixelEncoding", "modeId", "isHiDPI", "displayName", "resCategory",
+    "usableForDesktop", "current",
+};
+
+// Both writers buffer the same way as JsonWriter: the buffer goes to the
+// stream when full, and a write error (or overflowing a stream-less
+// buffer) sets "error" for good.
+static int FlushBuffer(FILE *out, const void *buffer, size_t *length,
+                       int *error) {
+    if (out != NULL && *length > 0 && !*error) {
+        if (fwrite(buffer, 1, *length, out) != *length) {
+            *error = 1;
+        }
+        *length = 0;
+    }
+    return *error ? -1 : 0;
+}
+
+// Copies "size" bytes into "buffer", flushing it (in chunks, for data
+// longer than the buffer) as needed.
+static void AppendBytes(FILE *out, unsigned char *buffer, size_t *length,
+                        int *error, const void *data, size_t size) {
+    const unsigned char *p = data;
+    while (!*error && *length + size > kExportBufferSize) {
+        if (out == NULL) {
+            *error = 1;
+            return;
+        }
+        const size_t chunk = kExportBufferSize - *length;
+        memcpy(buffer + *length, p, chunk);
+        *length += chunk;
+        p += chunk;
+        size -= chunk;
+        FlushBuffer(out, buffer, length, error);
+    }
+    if (!*error) {
+        memcpy(buffer + *length, p, size);
+        *length += size;
+    }
+}
+
+// Formats "value" backwards into the end of "digits"; returns the start.
+static char *FormatUint(uint64_t value, char *end) {
+    char *p = end;
+    do {
+        *--p = (char)('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    return p;
+}
+
+// CSV and TSV
+
+void CsvWriterInit(struct CsvWriter *writer, FILE *out, char separator) {
+    writer->out = out;
+    writer->length = 0;
+    writer->separator = separator;
+    writer->in_row = 0;
+    writer->error = 0;
+}
+
+int CsvWriterFlush(struct CsvWriter *writer) {
+    return FlushBuffer(writer->out, writer->buffer, &writer->length,
+                       &writer->error);
+}
+
+static void CsvAppend(struct CsvWriter *writer, const char *text,
+                      size_t size) {
+    // Fields are short; most fit in what is left of the buffer.
+    if (writer->length + size <= kExportBufferSize && !writer->error) {
+        memcpy(writer->buffer + writer->length, text, size);
+        writer->length += size;
+        return;
+    }
+    AppendBytes(writer->out, (unsigned char *)writer->buffer, &writer->length,
+                &writer->error, text, size);
+}
+
+// Writes the separator due before a field.
+static void CsvBeginField(struct CsvWriter *writer) {
+    if (writer->in_row) {
+        CsvAppend(writer, &writer->separator, 1);
+    }
+    writer->in_row = 1;
+}
+
+void CsvWriterString(struct CsvWriter *writer, const char *value) {
+    CsvBeginField(writer);
+    // Find the end, and whether anything in between needs quoting.
+    const char separator = writer->separator;
+    int plain = 1;
+    const char *end = value;
+    for (; *end != '\0'; ++end) {
+        const char c = *end;
+        if (c == separator || c == '"' || c == '\n' || c == '\r') {
+            plain = 0;
+        }
+    }
+    if (plain) {
+        CsvAppend(writer, value, (size_t)(end - value));
+        return;
+    }
+    const int tsv = separator == '\t';
+    if (!tsv) {
+        CsvAppend(writer, "\"", 1);
+    }
+    const char *run = value;
+    for (const char *p = value; p < end; ++p) {
+        if (tsv && (*p == '\t' || *p == '\n' || *p == '\r')) {
+            CsvAppend(writer, run, (size_t)(p - run));
+            CsvAppend(writer, " ", 1);
+            run = p + 1;
+        } else if (!tsv && *p == '"') {
+            // Quotes are doubled: copy through this one, then repeat it.
+            CsvAppend(writer, run, (size_t)(p + 1 - run));
+            run = p;
+        }
+    }
+    CsvAppend(writer, run, (size_t)(end - run));
+    if (!tsv) {
+        CsvAppend(writer, "\"", 1);
+    }
+}
+
+void CsvWriterUint(struct CsvWriter *writer, uint64_t value) {
+    CsvBeginField(writer);
+    char digits[20];
+    char *end = digits + sizeof(digits);
+    char *start = FormatUint(value, end);
+    CsvAppend(writer, start, (size_t)(end - start));
+}
+
+void CsvWriterInt(struct CsvWriter *writer, int64_t value) {
+    CsvBeginField(writer);
+    char digits[21];
+    char *end = digits + sizeof(digits);
+    const uint64_t magnitude =
+        value < 0 ? (uint64_t)0 - (uint64_t)value : (uint64_t)value;
+    char *start = FormatUint(magnitude, end);
+    if (value < 0) {
+        *--start = '-';
+    }
+    CsvAppend(writer, start, (size_t)(end - start));
+}
+
+void CsvWriterDouble(struct CsvWriter *writer, double value) {
+    CsvBeginField(writer);
+    char text[32];
+    if (fabs(value) < 1e15 && value == (double)(int64_t)value &&
+        !(value == 0.0 && signbit(value))) {
+        // Integral values are by far the most common refresh rates.
+        char *end = text + sizeof(text);
+        const int64_t integral = (int64_t)value;
+        char *start = FormatUint(integral < 0 ? (uint64_t)-integral
+                                              : (uint64_t)integral, end);
+        if (integral < 0) {
+            *--start = '-';
+        }
+        CsvAppend(writer, start, (size_t)(end - start));
+        return;
+    }
+    int size = snprintf(text, sizeof(text), "%.15g", value);
+    if (isfinite(value) && strtod(text, NULL) != value) {
+        size = snprintf(text, sizeof(text), "%.17g", value);
+    }
+    CsvAppend(writer, text, (size_t)size);
+}
+
+void CsvWriterBool(struct CsvWriter *writer, int value) {
+    CsvBeginField(writer);
+    CsvAppend(writer, value ? "1" : "0", 1);
+}
+
+void CsvWriterEndRow(struct CsvWriter *writer) {
+    CsvAppend(writer, "\n", 1);
+    writer->in_row = 0;
+}
+
+// CBOR
+
+enum {
+    kCborUint = 0 << 5,
+    kCborNegative = 1 << 5,
+    kCborText = 3 << 5,
+    kCborArray = 4 << 5,
+    kCborMap = 5 << 5,
+    kCborSimple = 7 << 5,
+};
+
+// Simple values and the heads of floats and the break code.
+enum {
+    kCborFalse = kCborSimple | 20,
+    kCborTrue = kCborSimple | 21,
+    kCborNull = kCborSimple | 22,
+    kCborHalf = kCborSimple | 25,
+    kCborSingle = kCborSimple | 26,
+    kCborDouble = kCborSimple | 27,
+    kCborBreak = kCborSimple | 31,
+};
+
+void CborWriterInit(struct CborWriter *writer, FILE *out) {
+    writer->out = out;
+    writer->length = 0;
+    writer->error = 0;
+}
+
+int CborWriterFlush(struct CborWriter *writer) {
+    return FlushBuffer(writer->out, writer->buffer, &writer->length,
+                       &writer->error);
+}
+
+static void CborAppend(struct CborWriter *writer, const void *data,
+                       size_t size) {
+    AppendBytes(writer->out, writer->buffer, &writer->length, &writer->error,
+                data, size);
+}
+
+// Writes "value" big-endian in "size" bytes after "head".
+static void CborAppendHead(struct CborWriter *writer, unsigned char head,
+                           uint64_t value, size_t size) {
+    unsigned char bytes[9];
+    bytes[0] = head;
+    for (size_t i = size; i > 0; --i) {
+        bytes[i] = (unsigned char)value;
+        value >>= 8;
+    }
+    CborAppend(writer, bytes, size + 1);
+}
+
+// Writes the head of a data item of major type "major" with argument
+// "value", in the shortest form.
+static void CborAppendArgument(struct CborWriter *writer, unsigned char major,
+                               uint64_t value) {
+    if (value < 24) {
+        CborAppendHead(writer, (unsigned char)(major | value), 0, 0);
+    } else if (value <= 0xff) {
+        CborAppendHead(writer, major | 24, value, 1);
+    } else if (value <= 0xffff) {
+        CborAppendHead(writer, major | 25, value, 2);
+    } else if (value <= 0xffffffff) {
+        CborAppendHead(writer, major | 26, value, 4);
+    } else {
+        CborAppendHead(writer, major | 27, value, 8);
+    }
+}
+
+void CborWriterBeginArray(struct CborWriter *writer, size_t count) {
+    if (count == kCborIndefinite) {
+        CborAppendHead(writer, kCborArray | 31, 0, 0);
+    } else {
+        CborAppendArgument(writer, kCborArray, count);
+    }
+}
+
+void CborWriterBeginMap(struct CborWriter *writer, size_t count) {
+    if (count == kCborIndefinite) {
+        CborAppendHead(writer, kCborMap | 31, 0, 0);
+    } else {
+        CborAppendArgument(writer, kCborMap, count);
+    }
+}
+
+void CborWriterEnd(struct CborWriter *writer) {
+    CborAppendHead(writer, kCborBreak, 0, 0);
+}
+
+void CborWriterString(struct CborWriter *writer, const char *value) {
+    const size_t length = strlen(value);
+    CborAppendArgument(writer, kCborText, length);
+    CborAppend(writer, value, length);
+}
+
+void CborWriterUint(struct CborWriter *writer, uint64_t value) {
+    CborAppendArgument(writer, kCborUint, value);
+}
+
+void CborWriterInt(struct CborWriter *writer, int64_t value) {
+    if (value >= 0) {
+        CborAppendArgument(writer, kCborUint, (uint64_t)value);
+    } else {
+        // -1 - value, without overflowing for INT64_MIN.
+        CborAppendArgument(writer, kCborNegative, ~(uint64_t)value);
+    }
+}
+
+// Returns non-zero and stores the half-precision bits of "value" in *half
+// if it is exactly representable as one.  "value" must be a finite float.
+static int ToHalf(float value, uint16_t *half) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    const uint16_t sign = (uint16_t)((bits >> 16) & 0x8000);
+    const int exponent = (int)((bits >> 23) & 0xff) - 127;
+    const uint32_t mantissa = bits & 0x7fffff;
+    if ((bits & 0x7fffffff) == 0) {
+        *half = sign;
+        return 1;
+    }
+    if (exponent >= -14 && exponent <= 15) {
+        if (mantissa & 0x1fff) {
+            return 0;
+        }
+        *half = (uint16_t)(sign | (exponent + 15) << 10 | mantissa >> 13);
+        return 1;
+    }
+    if (exponent >= -24 && exponent < -14) {
+        // A subnormal half: a multiple of 2^-24.
+        const uint32_t full = mantissa | 0x800000;
+        const int shift = -exponent - 1;
+        if (full & ((1u << shift) - 1)) {
+            return 0;
+        }
+        *half = (uint16_t)(sign | full >> shift);
+        return 1;
+    }
+    return 0;
+}
+
+void CborWriterDouble(struct CborWriter *writer, double value) {
+    if (isnan(value)) {
+        CborAppendHead(writer, kCborHalf, 0x7e00, 2);
+        return;
+    }
+    if (isinf(value)) {
+        CborAppendHead(writer, kCborHalf, value < 0 ? 0xfc00 : 0x7c00, 2);
+        return;
+    }
+    const float single = (float)value;
+    if ((double)single != value) {
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        CborAppendHead(writer, kCborDouble, bits, 8);
+        return;
+    }
+    uint16_t half;
+    if (ToHalf(single, &half)) {
+        CborAppendHead(writer, kCborHalf, half, 2);
+        return;
+    }
+    uint32_t bits;
+    memcpy(&bits, &single, sizeof(bits));
+    CborAppendHead(writer, kCborSingle, bits, 4);
+}
+
+void CborWriterBool(struct CborWriter *writer, int value) {
+    CborAppendHead(writer, value ? kCborTrue : kCborFalse, 0, 0);
+}
+
+void CborWriterNull(struct CborWriter *writer) {
+    CborAppendHead(writer, kCborNull, 0, 0);
+}
+
+// Catalog export
+
+void ExportCsvHeader(struct CsvWriter *writer) {
+    for (size_t i = 0; i < kExportDisplayColumns; ++i) {
+        CsvWriterString(writer, kExportDisplayColumnNames[i]);
+    }
+    for (size_t i = 0; i < kExportModeColumns; ++i) {
+        CsvWriterString(writer, kExportModeColumnNames[i]);
+    }
+    CsvWriterEndRow(writer);
+}
+
+void ExportCsvMode(struct CsvWriter *writer, uint32_t index,
+                   const struct EdidInfo *edid,
+                   const struct DisplayModeTable *table, size_t row,
+                   double refresh_rate) {
+    CsvWriterUint(writer, index);
+    CsvWriterBool(writer, index == 0);
+    if (edid != NULL) {
+        CsvWriterString(writer, edid->vendor_id);
+        CsvWriterUint(writer, edid->vendor);
+        CsvWriterUint(writer, edid->model);
+        CsvWriterUint(writer, edid->serial);
+        CsvWriterString(writer, edid->serial_string);
+        CsvWriterUint(writer, edid->width_mm);
+        CsvWriterUint(writer, edid->height_mm);
+    } else {
+        // Empty fields for what only the EDID tells.
+        for (size_t i = 2; i < kExportDisplayColumns; ++i) {
+            CsvWriterString(writer, "");
+        }
+    }
+    const uint8_t flags = table->flags[row];
+    CsvWriterUint(writer, table->resolution[row] >> 16);
+    CsvWriterUint(writer, table->resolution[row] & 0xffff);
+    CsvWriterDouble(writer, refresh_rate);
+    CsvWriterUint(writer, table->aspect[row] >> 16);
+    CsvWriterUint(writer, table->aspect[row] & 0xffff);
+    CsvWriterString(writer, table->strings[table->encoding[row]]);
+    CsvWriterInt(writer, table->mode_id[row]);
+    CsvWriterBool(writer, flags & kModeFlagHiDPI);
+    CsvWriterString(writer, table->strings[table->display_name[row]]);
+    CsvWriterString(writer, table->strings[table->category[row]]);
+    CsvWriterBool(writer, flags & kModeFlagUsable);
+    CsvWriterBool(writer, flags & kModeFlagCurrent);
+    CsvWriterEndRow(writer);
+}
+
+void ExportCborBegin(struct CborWriter *writer, uint32_t num_displays) {
+    CborWriterBeginMap(writer, 1);
+    CborWriterString(writer, "displays");
+    CborWriterBeginArray(writer, num_displays);
+}
+
+void ExportCborBeginDisplay(struct CborWriter *writer, uint32_t index,
+                            const struct EdidInfo *edid,
+                            const struct DisplayModeTable *table) {
+    const char *const *names = kExportDisplayColumnNames;
+    CborWriterBeginMap(writer, kExportDisplayColumns + 3);
+    CborWriterString(writer, names[0]);
+    CborWriterUint(writer, index);
+    CborWriterString(writer, names[1]);
+    CborWriterBool(writer, index == 0);
+    if (edid != NULL) {
+        CborWriterString(writer, names[2]);
+        CborWriterString(writer, edid->vendor_id);
+        CborWriterString(writer, names[3]);
+        CborWriterUint(writer, edid->vendor);
+        CborWriterString(writer, names[4]);
+        CborWriterUint(writer, edid->model);
+        CborWriterString(writer, names[5]);
+        CborWriterUint(writer, edid->serial);
+        CborWriterString(writer, names[6]);
+        CborWriterString(writer, edid->serial_string);
+        CborWriterString(writer, names[7]);
+        CborWriterUint(writer, edid->width_mm);
+        CborWriterString(writer, names[8]);
+        CborWriterUint(writer, edid->height_mm);
+    } else {
+        for (size_t i = 2; i < kExportDisplayColumns; ++i) {
+            CborWriterString(writer, names[i]);
+            CborWriterNull(writer);
+        }
+    }
+    CborWriterString(writer, "strings");
+    CborWriterBeginArray(writer, table->num_strings);
+    for (size_t i = 0; i < table->num_strings; ++i) {
+        CborWriterString(writer, table->strings[i]);
+    }
+    CborWriterString(writer, "columns");
+    CborWriterBeginArray(writer, kExportModeColumns);
+    for (size_t i = 0; i < kExportModeColumns; ++i) {
+        CborWriterString(writer, kExportModeColumnNames[i]);
+    }
+    CborWriterString(writer, "modes");
+    CborWriterBeginArray(writer, kCborIndefinite);
+}
+
+void ExportCborMode(struct CborWriter *writer,
+                    const struct DisplayModeTable *table, size_t row,
+                    double refresh_rate) {
+    const uint8_t flags = table->flags[row];
+    CborWriterBeginArray(writer, kExportModeColumns);
+    CborWriterUint(writer, table->resolution[row] >> 16);
+    CborWriterUint(writer, table->resolution[row] & 0xffff);
+    CborWriterDouble(writer, refresh_rate);
+    CborWriterUint(writer, table->aspect[row] >> 16);
+    CborWriterUint(writer, table->aspect[row] & 0xffff);
+    CborWriterUint(writer, table->encoding[row]);
+    CborWriterInt(writer, table->mode_id[row]);
+    CborWriterBool(writer, flags & kModeFlagHiDPI);
+    CborWriterUint(writer, table->display_name[row]);
+    CborWriterUint(writer, table->category[row]);
+    CborWriterBool(writer, flags & kModeFlagUsable);
+    CborWriterBool(writer, flags & kModeFlagCurrent);
+}
+
+void ExportCborEndDisplay(struct CborWriter *writer) {
+    CborWriterEnd(writer);
+}
@@ -0,0 +1,127 @@
+#ifndef DISPLAYMODE_EXPORT_H
+#define DISPLAYMODE_EXPORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "displaymode_edid.h"
+#include "displaymode_table.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Size of each writer's buffer; it is flushed to the stream when full.
+#define kExportBufferSize 8192
+
+// Passed as the count of a CBOR array or map whose length isn't known up
+// front; it is then ended by CborWriterEnd.
+#define kCborIndefinite ((size_t)-1)
+
+// Number of columns in an exported mode row.
+#define kExportModeColumns 12
+
+// Number of per-display columns that precede them in CSV and TSV rows, and
+// of per-display members in the CBOR encoding.
+#define kExportDisplayColumns 9
+
+// Writes CSV (RFC 4180, with "\n" line ends) or TSV rows field by field
+// into a fixed buffer, like JsonWriter.  CSV fields that hold the separator,
+// a quote or a line break are quoted; TSV can't quote, so tabs and line
+// breaks in its fields become spaces.  Write errors set "error", after
+// which nothing more is written.
+struct CsvWriter {
+    FILE *out;
+    size_t length;
+    char separator;  // ',' for CSV, '\t' for TSV
+    int in_row;      // non-zero once the current row has a field
+    int error;
+    char buffer[kExportBufferSize];
+};
+
+// Prepares "writer" to write to "out" (which may be NULL, in which case the
+// text must fit in the buffer) with fields separated by "separator".
+void CsvWriterInit(struct CsvWriter *writer, FILE *out, char separator);
+
+void CsvWriterString(struct CsvWriter *writer, const char *value);
+void CsvWriterUint(struct CsvWriter *writer, uint64_t value);
+void CsvWriterInt(struct CsvWriter *writer, int64_t value);
+// Writes the shortest of "%.15g" and "%.17g" that reads back as "value".
+void CsvWriterDouble(struct CsvWriter *writer, double value);
+// Writes 1 or 0.
+void CsvWriterBool(struct CsvWriter *writer, int value);
+void CsvWriterEndRow(struct CsvWriter *writer);
+
+// Writes the buffered text to the stream.  Returns 0, or -1 on error.
+int CsvWriterFlush(struct CsvWriter *writer);
+
+// Writes CBOR (RFC 8949) data items into a fixed buffer, like JsonWriter.
+// Arrays and maps are given their number of items (or pairs) up front, or
+// kCborIndefinite; nesting isn't checked.  Write errors set "error", after
+// which nothing more is written.
+struct CborWriter {
+    FILE *out;
+    size_t length;
+    int error;
+    unsigned char buffer[kExportBufferSize];
+};
+
+void CborWriterInit(struct CborWriter *writer, FILE *out);
+
+void CborWriterBeginArray(struct CborWriter *writer, size_t count);
+void CborWriterBeginMap(struct CborWriter *writer, size_t count);
+// Ends an array or map begun with kCborIndefinite.
+void CborWriterEnd(struct CborWriter *writer);
+
+void CborWriterString(struct CborWriter *writer, const char *value);
+void CborWriterUint(struct CborWriter *writer, uint64_t value);
+void CborWriterInt(struct CborWriter *writer, int64_t value);
+// Writes the shortest of a half, single and double precision float that
+// holds "value" exactly.
+void CborWriterDouble(struct CborWriter *writer, double value);
+void CborWriterBool(struct CborWriter *writer, int value);
+void CborWriterNull(struct CborWriter *writer);
+
+int CborWriterFlush(struct CborWriter *writer);
+
+// Column names of the per-display metadata, then of the modes, in the order
+// they are written.
+extern const char *const kExportDisplayColumnNames[kExportDisplayColumns];
+extern const char *const kExportModeColumnNames[kExportModeColumns];
+
+// Writes the CSV or TSV header row.
+void ExportCsvHeader(struct CsvWriter *writer);
+
+// Writes the table's row "row" of the display at "index" as a CSV or TSV
+// row: the display's metadata from "edid" (which may be NULL), then the
+// mode's fields, with the refresh rate at full precision.
+void ExportCsvMode(struct CsvWriter *writer, uint32_t index,
+                   const struct EdidInfo *edid,
+                   const struct DisplayModeTable *table, size_t row,
+                   double refresh_rate);
+
+// Begins the CBOR document: a map whose "displays" member is an array of
+// "num_displays" displays.
+void ExportCborBegin(struct CborWriter *writer, uint32_t num_displays);
+
+// Begins the display at "index": a map of its metadata (from "edid", which
+// may be NULL), its "strings", its "columns", and "modes", an indefinite
+// array that ExportCborMode adds rows to and ExportCborEndDisplay ends.  A
+// row is an array in column order whose string columns are indices into
+// "strings".
+void ExportCborBeginDisplay(struct CborWriter *writer, uint32_t index,
+                            const struct EdidInfo *edid,
+                            const struct DisplayModeTable *table);
+
+void ExportCborMode(struct CborWriter *writer,
+                    const struct DisplayModeTable *table, size_t row,
+                    double refresh_rate);
+
+void ExportCborEndDisplay(struct CborWriter *writer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DISPLAYMODE_EXPORT_H
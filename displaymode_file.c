@@ -0,0 +1,129 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "displaymode_file.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const uint32_t kByteOrder = 0x01020304;
+
+void DisplayFileHeaderInit(struct DisplayFileHeader *header,
+                           const char magic[8], uint32_t version) {
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, magic, sizeof(header->magic));
+    header->version = version;
+    header->byte_order = kByteOrder;
+}
+
+int DisplayFileMap(const char *path, const char magic[8], uint32_t version,
+                   size_t header_size, const unsigned char **data,
+                   size_t *size) {
+    *data = NULL;
+    *size = 0;
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    void *mapped = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0 &&
+        (size_t)st.st_size >= header_size &&
+        (size_t)st.st_size >= sizeof(struct DisplayFileHeader)) {
+        mapped = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        return -1;
+    }
+    const struct DisplayFileHeader *header = mapped;
+    if (memcmp(header->magic, magic, sizeof(header->magic)) != 0 ||
+        header->version != version || header->byte_order != kByteOrder) {
+        munmap(mapped, (size_t)st.st_size);
+        return -1;
+    }
+    *data = mapped;
+    *size = (size_t)st.st_size;
+    return 0;
+}
+
+void DisplayFileUnmap(const unsigned char **data, size_t *size) {
+    if (*data != NULL) {
+        munmap((void *)*data, *size);
+    }
+    *data = NULL;
+    *size = 0;
+}
+
+// Creates the directories leading to "path" that are missing.
+static int MakeParents(const char *path) {
+    char dir[kDisplayFileMaxPath];
+    strcpy(dir, path);
+    for (char *slash = strchr(dir + 1, '/'); slash != NULL;
+         slash = strchr(slash + 1, '/')) {
+        *slash = '\0';
+        if (mkdir(dir, 0700) != 0 && errno != EEXIST) {
+            return -1;
+        }
+        *slash = '/';
+    }
+    return 0;
+}
+
+int DisplayFileCreate(struct DisplayFileWriter *writer, const char *path) {
+    memset(writer, 0, sizeof(*writer));
+    writer->fd = -1;
+    if (strlen(path) >= sizeof(writer->path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(writer->path, path);
+    snprintf(writer->temp_path, sizeof(writer->temp_path), "%s.%ld.tmp", path,
+             (long)getpid());
+    writer->fd = open(writer->temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (writer->fd < 0 && errno == ENOENT && MakeParents(path) == 0) {
+        writer->fd = open(writer->temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    return writer->fd < 0 ? -1 : 0;
+}
+
+void DisplayFileWrite(struct DisplayFileWriter *writer, const void *data,
+                      size_t size) {
+    const char *p = data;
+    while (!writer->failed && size > 0) {
+        const ssize_t n = write(writer->fd, p, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            writer->failed = 1;
+            writer->saved_errno = errno;
+            return;
+        }
+        p += n;
+        size -= (size_t)n;
+    }
+}
+
+int DisplayFileReplace(struct DisplayFileWriter *writer) {
+    if (close(writer->fd) && !writer->failed) {
+        writer->failed = 1;
+        writer->saved_errno = errno;
+    }
+    writer->fd = -1;
+    // Renaming keeps concurrent readers' mappings of the old file valid.
+    if (!writer->failed && rename(writer->temp_path, writer->path)) {
+        writer->failed = 1;
+        writer->saved_errno = errno;
+    }
+    if (writer->failed) {
+        unlink(writer->temp_path);
+        errno = writer->saved_errno;
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,67 @@
+#ifndef DISPLAYMODE_FILE_H
+#define DISPLAYMODE_FILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Files the tool keeps between runs (the mode cache, the display id map and
+// the layout plans) are memory-mapped read-only and only ever replaced
+// atomically (by rename), so readers never see partial files.  Each starts
+// with a DisplayFileHeader, so a file from another version or machine is
+// recognized and ignored.
+
+// Longest path of such a file.
+#define kDisplayFileMaxPath 1024
+
+struct DisplayFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+};
+
+// Fills in "header" for a file written on this machine.
+void DisplayFileHeaderInit(struct DisplayFileHeader *header,
+                           const char magic[8], uint32_t version);
+
+// Maps the file at "path" if it is at least "header_size" bytes long and
+// starts with the given magic and version in this machine's byte order.
+// Returns 0 and sets "*data" and "*size", or -1 (with "*data" NULL) if the
+// file is missing or doesn't match.
+int DisplayFileMap(const char *path, const char magic[8], uint32_t version,
+                   size_t header_size, const unsigned char **data,
+                   size_t *size);
+
+// Unmaps a file mapped by DisplayFileMap, if any, and clears "*data" and
+// "*size".
+void DisplayFileUnmap(const unsigned char **data, size_t *size);
+
+// A replacement for a file, written next to it before taking its place.
+struct DisplayFileWriter {
+    char path[kDisplayFileMaxPath];
+    char temp_path[kDisplayFileMaxPath + 32];
+    int fd;
+    int failed;
+    int saved_errno;
+};
+
+// Starts replacing the file at "path", creating its directory (private to
+// the user) if needed.  Returns 0, or -1 with errno set.
+int DisplayFileCreate(struct DisplayFileWriter *writer, const char *path);
+
+// Appends to the replacement.  Errors are reported by DisplayFileReplace.
+void DisplayFileWrite(struct DisplayFileWriter *writer, const void *data,
+                      size_t size);
+
+// Puts the replacement in place of the file, or removes it if any write
+// failed.  Returns 0, or -1 with errno set.
+int DisplayFileReplace(struct DisplayFileWriter *writer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
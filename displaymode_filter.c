@@ -0,0 +1,215 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "displaymode_filter.h"
+
+#include <pthread.h>
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__GNUC__) || defined(__clang__))
+#define HAVE_AVX2_KERNEL 1
+#include <immintrin.h>
+#endif
+
+// The filter in the table's units: bounds clamped to 16 bits where the
+// columns are, the aspect ratio packed in lowest terms, and the flags
+// every selected row must have.
+struct CompiledFilter {
+    uint32_t min_width, max_width;
+    uint32_t min_height, max_height;
+    uint32_t min_refresh, max_refresh;
+    uint32_t aspect;
+    uint32_t any_aspect;  // all ones if any aspect ratio passes, else 0
+    uint32_t flags;
+};
+
+static uint32_t Clamp16(uint32_t value) {
+    return value < 0xffff ? value : 0xffff;
+}
+
+static void Compile(const struct ModeFilter *filter,
+                    struct CompiledFilter *compiled) {
+    compiled->min_width = filter->min_width;
+    compiled->max_width = Clamp16(filter->max_width);
+    compiled->min_height = filter->min_height;
+    compiled->max_height = Clamp16(filter->max_height);
+    compiled->min_refresh = filter->min_refresh_mhz;
+    compiled->max_refresh = filter->max_refresh_mhz;
+    uint32_t a = filter->aspect_w, b = filter->aspect_h;
+    while (b != 0) {
+        const uint32_t t = b;
+        b = a % b;
+        a = t;
+    }
+    compiled->aspect = a ? (filter->aspect_w / a) << 16 | filter->aspect_h / a
+                         : 0;
+    compiled->any_aspect = a ? 0 : UINT32_MAX;
+    compiled->flags = (filter->usable_only ? kModeFlagUsable : 0) |
+                      (filter->hidpi_only ? kModeFlagHiDPI : 0);
+}
+
+// Returns 1 if row i passes, without branches.
+static inline uint64_t RowPasses(const struct CompiledFilter *f,
+                                 const struct DisplayModeTable *table,
+                                 size_t i) {
+    const uint32_t resolution = table->resolution[i];
+    const uint32_t width = resolution >> 16;
+    const uint32_t height = resolution & 0xffff;
+    const uint32_t refresh = table->refresh_mhz[i];
+    return (uint64_t)((width >= f->min_width) & (width <= f->max_width) &
+                      (height >= f->min_height) & (height <= f->max_height) &
+                      (refresh >= f->min_refresh) & (refresh <= f->max_refresh) &
+                      ((table->aspect[i] == f->aspect) | (f->any_aspect != 0)) &
+                      ((table->flags[i] & f->flags) == f->flags));
+}
+
+// Evaluates 64 rows into bytes first, which compilers can vectorize, then
+// packs eight bytes at a time into bits with a multiply.
+static void SelectScalar(const struct CompiledFilter *f,
+                         const struct DisplayModeTable *table,
+                         uint64_t *bitmap) {
+    const size_t count = table->count;
+    for (size_t base = 0; base < count; base += 64) {
+        const size_t n = count - base < 64 ? count - base : 64;
+        uint8_t passes[64] = {0};
+        if (n == 64) {
+            // A constant trip count lets even cautious vectorizers in.
+            for (size_t j = 0; j < 64; ++j) {
+                passes[j] = (uint8_t)RowPasses(f, table, base + j);
+            }
+        } else {
+            for (size_t j = 0; j < n; ++j) {
+                passes[j] = (uint8_t)RowPasses(f, table, base + j);
+            }
+        }
+        uint64_t word = 0;
+        for (size_t j = 0; j < 64; j += 8) {
+            uint64_t bytes;
+            memcpy(&bytes, &passes[j], sizeof(bytes));
+            // Moves the low bit of byte k to bit 56 + k.  Assumes a
+            // little-endian layout, as on every supported CPU.
+            word |= ((bytes * 0x0102040810204080ULL) >> 56) << j;
+        }
+        bitmap[base / 64] = word;
+    }
+}
+
+#ifdef HAVE_AVX2_KERNEL
+// Lanes of "x" that are >= "min" and <= "max", as unsigned numbers.
+__attribute__((target("avx2")))
+static inline __m256i InRange(__m256i x, __m256i min, __m256i max) {
+    return _mm256_and_si256(
+        _mm256_cmpeq_epi32(_mm256_max_epu32(x, min), x),
+        _mm256_cmpeq_epi32(_mm256_min_epu32(x, max), x));
+}
+
+__attribute__((target("avx2")))
+static void SelectAvx2(const struct CompiledFilter *f,
+                       const struct DisplayModeTable *table,
+                       uint64_t *bitmap) {
+    const size_t count = table->count;
+    const __m256i low16 = _mm256_set1_epi32(0xffff);
+    const __m256i min_width = _mm256_set1_epi32((int)f->min_width);
+    const __m256i max_width = _mm256_set1_epi32((int)f->max_width);
+    const __m256i min_height = _mm256_set1_epi32((int)f->min_height);
+    const __m256i max_height = _mm256_set1_epi32((int)f->max_height);
+    const __m256i min_refresh = _mm256_set1_epi32((int)f->min_refresh);
+    const __m256i max_refresh = _mm256_set1_epi32((int)f->max_refresh);
+    const __m256i aspect = _mm256_set1_epi32((int)f->aspect);
+    const __m256i any_aspect = _mm256_set1_epi32((int)f->any_aspect);
+    const __m256i flags = _mm256_set1_epi32((int)f->flags);
+
+    for (size_t base = 0; base < count; base += 64) {
+        const size_t n = count - base < 64 ? count - base : 64;
+        uint64_t word = 0;
+        size_t j = 0;
+        for (; j + 8 <= n; j += 8) {
+            const size_t i = base + j;
+            const __m256i resolution =
+                _mm256_loadu_si256((const __m256i *)&table->resolution[i]);
+            const __m256i width = _mm256_srli_epi32(resolution, 16);
+            const __m256i height = _mm256_and_si256(resolution, low16);
+            const __m256i refresh =
+                _mm256_loadu_si256((const __m256i *)&table->refresh_mhz[i]);
+            const __m256i row_aspect =
+                _mm256_loadu_si256((const __m256i *)&table->aspect[i]);
+            const __m256i row_flags = _mm256_cvtepu8_epi32(
+                _mm_loadl_epi64((const __m128i *)&table->flags[i]));
+
+            __m256i pass = InRange(width, min_width, max_width);
+            pass = _mm256_and_si256(pass, InRange(height, min_height, max_height));
+            pass = _mm256_and_si256(pass, InRange(refresh, min_refresh, max_refresh));
+            pass = _mm256_and_si256(
+                pass, _mm256_or_si256(_mm256_cmpeq_epi32(row_aspect, aspect),
+                                      any_aspect));
+            pass = _mm256_and_si256(
+                pass, _mm256_cmpeq_epi32(_mm256_and_si256(row_flags, flags),
+                                         flags));
+            const uint32_t bits =
+                (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(pass));
+            word |= (uint64_t)bits << j;
+        }
+        for (; j < n; ++j) {
+            word |= RowPasses(f, table, base + j) << j;
+        }
+        bitmap[base / 64] = word;
+    }
+}
+#endif
+
+static enum FilterKernel best_kernel = kFilterKernelScalar;
+static pthread_once_t best_kernel_once = PTHREAD_ONCE_INIT;
+
+static void ChooseKernel(void) {
+#ifdef HAVE_AVX2_KERNEL
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        best_kernel = kFilterKernelAvx2;
+    }
+#endif
+}
+
+enum FilterKernel DisplayModeFilterBestKernel(void) {
+    pthread_once(&best_kernel_once, ChooseKernel);
+    return best_kernel;
+}
+
+const char *DisplayModeFilterKernelName(enum FilterKernel kernel) {
+    switch (kernel) {
+        case kFilterKernelAvx2:
+            return "avx2";
+        case kFilterKernelScalar:
+        default:
+            return "scalar";
+    }
+}
+
+int DisplayModeFilterSelectWith(enum FilterKernel kernel,
+                                const struct ModeFilter *filter,
+                                const struct DisplayModeTable *table,
+                                uint64_t *bitmap) {
+    struct CompiledFilter compiled;
+    Compile(filter, &compiled);
+    switch (kernel) {
+        case kFilterKernelScalar:
+            SelectScalar(&compiled, table, bitmap);
+            return 0;
+        case kFilterKernelAvx2:
+#ifdef HAVE_AVX2_KERNEL
+            if (DisplayModeFilterBestKernel() == kFilterKernelAvx2) {
+                SelectAvx2(&compiled, table, bitmap);
+                return 0;
+            }
+#endif
+            return -1;
+        default:
+            return -1;
+    }
+}
+
+void DisplayModeFilterSelect(const struct ModeFilter *filter,
+                             const struct DisplayModeTable *table,
+                             uint64_t *bitmap) {
+    DisplayModeFilterSelectWith(DisplayModeFilterBestKernel(), filter, table,
+                                bitmap);
+}
@@ -0,0 +1,52 @@
+#ifndef DISPLAYMODE_FILTER_H
+#define DISPLAYMODE_FILTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "displaymode_parse.h"
+#include "displaymode_table.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Implementations of DisplayModeFilterSelect.
+enum FilterKernel {
+    // Portable and branch-free, 64 rows per bitmap word, so compilers can
+    // vectorize it for the target (e.g. NEON on arm64).
+    kFilterKernelScalar = 0,
+    // Eight rows per step with AVX2, on x86 CPUs that have it.
+    kFilterKernelAvx2,
+};
+
+// Returns the number of 64-bit words in the bitmap of "count" rows.
+static inline size_t DisplayModeFilterWords(size_t count) {
+    return (count + 63) / 64;
+}
+
+// Returns the kernel DisplayModeFilterSelect uses on this CPU.
+enum FilterKernel DisplayModeFilterBestKernel(void);
+
+// Returns the name of "kernel", e.g. "avx2".
+const char *DisplayModeFilterKernelName(enum FilterKernel kernel);
+
+// Sets bit i % 64 of bitmap[i / 64] if row i of "table" passes "filter",
+// for every row (listed or not), and clears the rest of the last word.
+// "bitmap" has DisplayModeFilterWords(table->count) words.
+void DisplayModeFilterSelect(const struct ModeFilter *filter,
+                             const struct DisplayModeTable *table,
+                             uint64_t *bitmap);
+
+// Like DisplayModeFilterSelect with the given kernel.  Returns 0, or -1 if
+// this CPU can't run it.
+int DisplayModeFilterSelectWith(enum FilterKernel kernel,
+                                const struct ModeFilter *filter,
+                                const struct DisplayModeTable *table,
+                                uint64_t *bitmap);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DISPLAYMODE_FILTER_H
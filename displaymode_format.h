@@ -16,6 +16,8 @@ struct DisplayModeInfo {
     int usable_for_desktop;
 };
 
-void FormatDisplayModeInfo(const struct DisplayModeInfo *info, char *out, size_t out_size);
+// Formats "info" as one line of the "d" listing (without the newline).
+// Returns the length of the full line, like snprintf.
+int FormatDisplayModeInfo(const struct DisplayModeInfo *info, char *out, size_t out_size);
 
 #endif // DISPLAYMODE_FORMAT_H
@@ -0,0 +1,287 @@
+#include "displaymode_group.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "displaymode_line.h"
+
+// Allocates in "arena", or on the heap if it's NULL.
+static void *GroupAlloc(struct Arena *arena, size_t size) {
+    return arena != NULL ? ArenaAlloc(arena, size) : malloc(size);
+}
+
+static void *GroupCalloc(struct Arena *arena, size_t count, size_t size) {
+    return arena != NULL ? ArenaCalloc(arena, count, size)
+                         : calloc(count, size);
+}
+
+static void GroupFree(struct Arena *arena, void *p) {
+    if (arena == NULL) {
+        free(p);
+    }
+}
+
+static size_t Hash(uint64_t key) {
+    uint64_t h = key * 0x9E3779B97F4A7C15ULL;
+    h ^= h >> 29;
+    return (size_t)h;
+}
+
+// Sorts the "count" keys by their low 32 bits, keeping equal ones in order:
+// one pass per byte that differs between keys.  "scratch" has room for
+// "count" keys.  Returns whichever of "keys" and "scratch" ends up sorted.
+static uint64_t *SortByLowWord(uint64_t *keys, uint64_t *scratch,
+                               size_t count) {
+    for (unsigned shift = 0; shift < 32; shift += 8) {
+        size_t offsets[256] = {0};
+        for (size_t i = 0; i < count; ++i) {
+            ++offsets[(keys[i] >> shift) & 0xff];
+        }
+        // Skip bytes that are the same in every key.
+        if (count == 0 || offsets[(keys[0] >> shift) & 0xff] == count) {
+            continue;
+        }
+        size_t next = 0;
+        for (size_t b = 0; b < 256; ++b) {
+            const size_t n = offsets[b];
+            offsets[b] = next;
+            next += n;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            scratch[offsets[(keys[i] >> shift) & 0xff]++] = keys[i];
+        }
+        uint64_t *sorted = scratch;
+        scratch = keys;
+        keys = sorted;
+    }
+    return keys;
+}
+
+// Initial slots of each hash; they double whenever they'd be more than half
+// full, so that they stay as small as the distinct keys allow.
+#define kInitialSlots 64
+
+// Returns the slot of "resolution" in "slots" (group index + 1 for each
+// slot, 0 if empty), or the empty slot where it belongs.
+static size_t FindGroupSlot(const uint32_t *slots, size_t mask,
+                            const struct DisplayModeGroup *groups,
+                            uint32_t resolution) {
+    size_t slot = Hash(resolution) & mask;
+    while (slots[slot] != 0 && groups[slots[slot] - 1].resolution != resolution) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+// Returns the slot of "key" in "slots" (a key for each slot, 0 if empty),
+// or the empty slot where it belongs.
+static size_t FindRateSlot(const uint64_t *slots, size_t mask, uint64_t key) {
+    size_t slot = Hash(key) & mask;
+    while (slots[slot] != 0 && slots[slot] != key) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+// Doubles the capacity of the group hash, which holds "count" groups.
+// Returns 0, or -1 if out of memory.
+static int GrowGroupSlots(struct Arena *arena, uint32_t **slots,
+                          size_t *capacity,
+                          const struct DisplayModeGroup *groups, size_t count) {
+    const size_t grown = *capacity * 2;
+    uint32_t *grown_slots = GroupCalloc(arena, grown, sizeof(*grown_slots));
+    if (grown_slots == NULL) {
+        return -1;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        grown_slots[FindGroupSlot(grown_slots, grown - 1, groups,
+                                  groups[i].resolution)] = (uint32_t)i + 1;
+    }
+    GroupFree(arena, *slots);
+    *slots = grown_slots;
+    *capacity = grown;
+    return 0;
+}
+
+// Doubles the capacity of the rate hash, which holds the "count" pairs.
+// Returns 0, or -1 if out of memory.
+static int GrowRateSlots(struct Arena *arena, uint64_t **slots,
+                         size_t *capacity, const uint64_t *pairs,
+                         size_t count) {
+    const size_t grown = *capacity * 2;
+    uint64_t *grown_slots = GroupCalloc(arena, grown, sizeof(*grown_slots));
+    if (grown_slots == NULL) {
+        return -1;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        const uint64_t key = pairs[i] + ((uint64_t)1 << 32);
+        grown_slots[FindRateSlot(grown_slots, grown - 1, key)] = key;
+    }
+    GroupFree(arena, *slots);
+    *slots = grown_slots;
+    *capacity = grown;
+    return 0;
+}
+
+int DisplayModeGroupsBuild(struct DisplayModeGroups *groups,
+                           const struct DisplayModeTable *table,
+                           const uint64_t *selected, struct Arena *arena) {
+    memset(groups, 0, sizeof(*groups));
+    groups->arena = arena;
+    const size_t count = table->count;
+    if (count > UINT32_MAX - 1) {
+        return -1;
+    }
+    size_t group_capacity = kInitialSlots;
+    size_t rate_capacity = kInitialSlots;
+    // Group index + 1 for each resolution slot, 0 if empty.
+    uint32_t *group_slots =
+        GroupCalloc(arena, group_capacity, sizeof(*group_slots));
+    // (group + 1) << 32 | millihertz for each rate slot, 0 if empty.
+    uint64_t *rate_slots = GroupCalloc(arena, rate_capacity, sizeof(*rate_slots));
+    // The distinct (group, rate) pairs, as group << 32 | millihertz.
+    uint64_t *pairs = GroupAlloc(arena, (count + 1) * sizeof(*pairs));
+    uint64_t *scratch = GroupAlloc(arena, (count + 1) * sizeof(*scratch));
+    groups->groups = GroupAlloc(arena, (count + 1) * sizeof(*groups->groups));
+    groups->refresh_mhz =
+        GroupAlloc(arena, (count + 1) * sizeof(*groups->refresh_mhz));
+    int error = group_slots == NULL || rate_slots == NULL || pairs == NULL ||
+                scratch == NULL || groups->groups == NULL ||
+                groups->refresh_mhz == NULL;
+
+    // Bucket the rows and their distinct refresh rates.
+    size_t num_pairs = 0;
+    for (size_t row = 0; row < count && !error; ++row) {
+        if (selected != NULL && !(selected[row / 64] >> (row % 64) & 1)) {
+            continue;
+        }
+        const uint32_t resolution = table->resolution[row];
+        size_t slot = FindGroupSlot(group_slots, group_capacity - 1,
+                                    groups->groups, resolution);
+        if (group_slots[slot] == 0) {
+            struct DisplayModeGroup *group = &groups->groups[groups->count];
+            memset(group, 0, sizeof(*group));
+            group->resolution = resolution;
+            group->first_row = (uint32_t)row;
+            group_slots[slot] = (uint32_t)++groups->count;
+        }
+        const uint32_t index = group_slots[slot] - 1;
+        if (2 * groups->count > group_capacity &&
+            GrowGroupSlots(arena, &group_slots, &group_capacity,
+                           groups->groups, groups->count)) {
+            error = 1;
+            break;
+        }
+        struct DisplayModeGroup *group = &groups->groups[index];
+        ++group->num_modes;
+        group->flags |= table->flags[row];
+
+        const uint64_t key = (uint64_t)(index + 1) << 32 | table->refresh_mhz[row];
+        slot = FindRateSlot(rate_slots, rate_capacity - 1, key);
+        if (rate_slots[slot] == 0) {
+            rate_slots[slot] = key;
+            pairs[num_pairs++] = key - ((uint64_t)1 << 32);
+            ++group->num_rates;
+            if (2 * num_pairs > rate_capacity &&
+                GrowRateSlots(arena, &rate_slots, &rate_capacity, pairs,
+                              num_pairs)) {
+                error = 1;
+            }
+        }
+    }
+    if (error) {
+        GroupFree(arena, group_slots);
+        GroupFree(arena, rate_slots);
+        GroupFree(arena, pairs);
+        GroupFree(arena, scratch);
+        DisplayModeGroupsFree(groups);
+        return -1;
+    }
+
+    // Order the rates, then lay them out by group; the scatter keeps each
+    // group's rates in order.
+    const uint64_t *sorted = SortByLowWord(pairs, scratch, num_pairs);
+    uint32_t next = 0;
+    for (size_t i = 0; i < groups->count; ++i) {
+        groups->groups[i].first_rate = next;
+        next += groups->groups[i].num_rates;
+    }
+    // "first_rate" is used as a cursor, then restored.
+    for (size_t i = 0; i < num_pairs; ++i) {
+        struct DisplayModeGroup *group = &groups->groups[sorted[i] >> 32];
+        groups->refresh_mhz[group->first_rate++] = (uint32_t)sorted[i];
+    }
+    for (size_t i = 0; i < groups->count; ++i) {
+        groups->groups[i].first_rate -= groups->groups[i].num_rates;
+    }
+    groups->num_rates = num_pairs;
+
+    GroupFree(arena, group_slots);
+    GroupFree(arena, rate_slots);
+    GroupFree(arena, pairs);
+    GroupFree(arena, scratch);
+    return 0;
+}
+
+// Writes a refresh rate in hertz with as few decimals as it needs, e.g.
+// "60", "59.94" or "23.976".
+static void PutMillihertz(struct LineWriter *w, uint32_t mhz) {
+    LineWriterPutUint(w, mhz / 1000);
+    uint32_t fraction = mhz % 1000;
+    if (fraction == 0) {
+        return;
+    }
+    char digits[4] = {'.', (char)('0' + fraction / 100),
+                      (char)('0' + fraction / 10 % 10),
+                      (char)('0' + fraction % 10)};
+    size_t n = sizeof(digits);
+    while (digits[n - 1] == '0') {
+        --n;
+    }
+    LineWriterPut(w, digits, n);
+}
+
+int DisplayModeGroupFormat(const struct DisplayModeGroups *groups,
+                           const struct DisplayModeTable *table, size_t index,
+                           char *out, size_t out_size) {
+    struct LineWriter w = {out, out_size, 0};
+    const struct DisplayModeGroup *group = &groups->groups[index];
+    const uint32_t aspect = table->aspect[group->first_row];
+    const char *category = table->strings[table->category[group->first_row]];
+
+    LineWriterPutUint(&w, group->resolution >> 16);
+    LineWriterPut(&w, " x ", 3);
+    LineWriterPutUint(&w, group->resolution & 0xffff);
+    LineWriterPut(&w, " @ ", 3);
+    const uint32_t *rates = &groups->refresh_mhz[group->first_rate];
+    for (uint32_t i = 0; i < group->num_rates; ++i) {
+        if (i > 0) {
+            LineWriterPut(&w, "/", 1);
+        }
+        PutMillihertz(&w, rates[i]);
+    }
+    LineWriterPut(&w, "Hz AR:", 6);
+    LineWriterPutUint(&w, aspect >> 16);
+    LineWriterPut(&w, ":", 1);
+    LineWriterPutUint(&w, aspect & 0xffff);
+    LineWriterPut(&w, " Cat:", 5);
+    LineWriterPut(&w, category, strlen(category));
+    LineWriterPut(&w, " Modes:", 7);
+    LineWriterPutUint(&w, group->num_modes);
+    if (group->flags & kModeFlagHiDPI) {
+        LineWriterPut(&w, " HiDPI", 6);
+    }
+    if (!(group->flags & kModeFlagUsable)) {
+        LineWriterPut(&w, " !", 2);
+    }
+    if (out_size > 0) {
+        out[w.length < out_size ? w.length : out_size - 1] = '\0';
+    }
+    return (int)w.length;
+}
+
+void DisplayModeGroupsFree(struct DisplayModeGroups *groups) {
+    GroupFree(groups->arena, groups->groups);
+    GroupFree(groups->arena, groups->refresh_mhz);
+    memset(groups, 0, sizeof(*groups));
+}
@@ -0,0 +1,66 @@
+#ifndef DISPLAYMODE_GROUP_H
+#define DISPLAYMODE_GROUP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "displaymode_alloc.h"
+#include "displaymode_table.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The rows of a table that share one resolution, as "d --grouped" lists
+// them.
+struct DisplayModeGroup {
+    uint32_t resolution;  // as in DisplayModeTable
+    uint32_t first_row;   // the group's first row, which gives its aspect
+                          // ratio and category
+    uint32_t num_modes;   // rows folded into the group
+    // The group's distinct refresh rates are refresh_mhz[first_rate] to
+    // refresh_mhz[first_rate + num_rates - 1], ascending.
+    uint32_t first_rate;
+    uint32_t num_rates;
+    uint8_t flags;  // the union of the rows' kModeFlag bits
+};
+
+// A table's rows aggregated by resolution: scaled and HiDPI variants and
+// other pixel encodings of a mode fold into one group, and their refresh
+// rates into one list.
+struct DisplayModeGroups {
+    // In the order of their first rows.
+    struct DisplayModeGroup *groups;
+    size_t count;
+    uint32_t *refresh_mhz;
+    size_t num_rates;
+    // Where the arrays are allocated, or NULL for the heap.
+    struct Arena *arena;
+};
+
+// Groups the rows of "table" set in "selected" (a DisplayModeFilterSelect
+// bitmap, or NULL for every row), in time linear in the rows: rows are
+// bucketed with an open-addressing hash on the resolution and distinct
+// refresh rates with one on (group, rate), and the rates are put in order
+// with a radix sort.  Allocates in "arena", or on the heap if it's NULL.
+// Returns 0, or -1 if out of memory.
+int DisplayModeGroupsBuild(struct DisplayModeGroups *groups,
+                           const struct DisplayModeTable *table,
+                           const uint64_t *selected, struct Arena *arena);
+
+// Formats group "index" as one line of "d --grouped", e.g.
+// "1920 x 1080 @ 50/59.94/60/120Hz AR:16:9 Cat:FHD Modes:6 HiDPI" (without
+// the current marker and newline); " HiDPI" if any of its modes is, and
+// " !" if none is usable.  Returns the length of the full line, like
+// snprintf.
+int DisplayModeGroupFormat(const struct DisplayModeGroups *groups,
+                           const struct DisplayModeTable *table, size_t index,
+                           char *out, size_t out_size);
+
+void DisplayModeGroupsFree(struct DisplayModeGroups *groups);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DISPLAYMODE_GROUP_H
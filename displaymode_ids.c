@@ -0,0 +1,280 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "displaymode_ids.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "displaymode_cache.h"
+
+static const char kMagic[8] = {'D', 'M', 'I', 'D', 'M', 'A', 'P', '\0'};
+
+// Slots of a new map.
+#define kInitialCapacity 16
+
+int DisplayIdMapDefaultPath(char *out, size_t out_size) {
+    const char *home = getenv("HOME");
+#ifdef __APPLE__
+    if (home == NULL || home[0] == '\0') {
+        return -1;
+    }
+    snprintf(out, out_size, "%s/Library/Preferences/displaymode.displays", home);
+#else
+    // Names are settings rather than a cache, so they live with the config.
+    const char *config_home = getenv("XDG_CONFIG_HOME");
+    if (config_home != NULL && config_home[0] != '\0') {
+        snprintf(out, out_size, "%s/displaymode.displays", config_home);
+    } else if (home != NULL && home[0] != '\0') {
+        snprintf(out, out_size, "%s/.config/displaymode.displays", home);
+    } else {
+        return -1;
+    }
+#endif
+    return 0;
+}
+
+uint64_t DisplayIdMapKey(const char *name) {
+    const uint64_t key = DisplayCacheHash(kDisplayCacheHashSeed, name,
+                                          strlen(name));
+    return key != 0 ? key : 1;
+}
+
+// Returns the first slot to probe for "key".
+static size_t HomeSlot(uint64_t key, size_t capacity) {
+    return (size_t)(key ^ key >> 32) & (capacity - 1);
+}
+
+// Checks that the mapped file is a complete map.
+static int Validate(struct DisplayIdMap *map) {
+    const struct DisplayIdMapHeader *header =
+        (const struct DisplayIdMapHeader *)map->data;
+    if (header->capacity == 0 ||
+        (header->capacity & (header->capacity - 1)) != 0 ||
+        header->count > header->capacity / 2 ||
+        map->size != sizeof(*header) +
+                     (size_t)header->capacity * sizeof(struct DisplayIdMapEntry)) {
+        return -1;
+    }
+    const struct DisplayIdMapEntry *slots =
+        (const struct DisplayIdMapEntry *)(header + 1);
+    size_t count = 0;
+    size_t named = 0;
+    for (uint32_t i = 0; i < header->capacity; ++i) {
+        if (slots[i].key == 0) {
+            continue;
+        }
+        if (slots[i].name[kDisplayIdMapMaxName - 1] != '\0' ||
+            slots[i].key != DisplayIdMapKey(slots[i].name)) {
+            return -1;
+        }
+        ++count;
+        named += (slots[i].flags & kDisplayIdMapNamed) != 0;
+    }
+    if (count != header->count) {
+        return -1;
+    }
+    map->slots = slots;
+    map->capacity = header->capacity;
+    map->count = count;
+    map->named = named;
+    return 0;
+}
+
+static void Unmap(struct DisplayIdMap *map) {
+    DisplayFileUnmap(&map->data, &map->size);
+    if (map->owned == NULL) {
+        map->slots = NULL;
+        map->capacity = 0;
+        map->count = 0;
+        map->named = 0;
+    }
+}
+
+int DisplayIdMapOpen(struct DisplayIdMap *map, const char *path) {
+    memset(map, 0, sizeof(*map));
+    if (strlen(path) >= sizeof(map->path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(map->path, path);
+
+    if (DisplayFileMap(path, kMagic, kDisplayIdMapVersion,
+                       sizeof(struct DisplayIdMapHeader), &map->data,
+                       &map->size) == 0 &&
+        Validate(map)) {
+        Unmap(map);
+    }
+    return 0;
+}
+
+// Returns the slot holding "name" (whose key is "key"), or the empty slot
+// where it belongs.  The table must have a slot.
+static size_t Probe(const struct DisplayIdMapEntry *slots, size_t capacity,
+                    uint64_t key, const char *name) {
+    size_t slot = HomeSlot(key, capacity);
+    while (slots[slot].key != 0 &&
+           (slots[slot].key != key || strcmp(slots[slot].name, name) != 0)) {
+        slot = (slot + 1) & (capacity - 1);
+    }
+    return slot;
+}
+
+const struct DisplayIdMapEntry *DisplayIdMapLookup(const struct DisplayIdMap *map,
+                                                   const char *name) {
+    if (map->count == 0 || strlen(name) >= kDisplayIdMapMaxName) {
+        return NULL;
+    }
+    const struct DisplayIdMapEntry *entry =
+        &map->slots[Probe(map->slots, map->capacity, DisplayIdMapKey(name), name)];
+    return entry->key != 0 ? entry : NULL;
+}
+
+int DisplayIdMapValidName(const char *name) {
+    const size_t length = strlen(name);
+    if (length == 0 || length >= kDisplayIdMapMaxName || name[0] == '@' ||
+        name[0] == '-') {
+        return 0;
+    }
+    int all_digits = 1;
+    for (size_t i = 0; i < length; ++i) {
+        const unsigned char c = (unsigned char)name[i];
+        if (c <= ' ' || c >= 0x7f || c == ':') {
+            return 0;
+        }
+        all_digits = all_digits && c >= '0' && c <= '9';
+    }
+    return !all_digits;
+}
+
+// Makes the table owned, with room for one more entry at a load factor of
+// at most one half.  Returns 0, or -1 if out of memory.
+static int Reserve(struct DisplayIdMap *map) {
+    if (map->owned != NULL && 2 * (map->count + 1) <= map->capacity) {
+        return 0;
+    }
+    size_t capacity = map->capacity > 0 ? map->capacity : kInitialCapacity;
+    while (2 * (map->count + 1) > capacity) {
+        capacity *= 2;
+    }
+    struct DisplayIdMapEntry *owned = calloc(capacity, sizeof(*owned));
+    if (owned == NULL) {
+        return -1;
+    }
+    for (size_t i = 0; i < map->capacity; ++i) {
+        const struct DisplayIdMapEntry *entry = &map->slots[i];
+        if (entry->key != 0) {
+            owned[Probe(owned, capacity, entry->key, entry->name)] = *entry;
+        }
+    }
+    free(map->owned);
+    map->owned = owned;
+    map->slots = owned;
+    map->capacity = capacity;
+    return 0;
+}
+
+int DisplayIdMapPut(struct DisplayIdMap *map, const char *name,
+                    const struct DisplayIdentity *identity, uint32_t display,
+                    uint32_t index, uint32_t flags) {
+    if (strlen(name) >= kDisplayIdMapMaxName || Reserve(map)) {
+        return -1;
+    }
+    const uint64_t key = DisplayIdMapKey(name);
+    struct DisplayIdMapEntry *entry =
+        &map->owned[Probe(map->owned, map->capacity, key, name)];
+    if (entry->key == 0) {
+        memset(entry, 0, sizeof(*entry));
+        entry->key = key;
+        strcpy(entry->name, name);
+        ++map->count;
+    } else if (DisplayIdentityEqual(&entry->identity, identity) &&
+               entry->display == display && entry->index == index &&
+               entry->flags == flags) {
+        return 0;
+    }
+    map->named += (flags & kDisplayIdMapNamed) != 0;
+    map->named -= (entry->flags & kDisplayIdMapNamed) != 0;
+    entry->identity = *identity;
+    entry->display = display;
+    entry->index = index;
+    entry->flags = flags;
+    map->dirty = 1;
+    return 0;
+}
+
+int DisplayIdMapRecord(struct DisplayIdMap *map,
+                       const struct DisplayIdentity *identity,
+                       uint32_t display, uint32_t index) {
+    char text[kDisplayIdentityMaxText];
+    DisplayIdentityFormat(identity, text, sizeof(text));
+    if (DisplayIdMapPut(map, text, identity, display, index, 0)) {
+        return -1;
+    }
+    // The table is owned now.  Names are few, so rather than index them by
+    // identity, they are only looked for if there are any.
+    for (size_t i = 0; i < map->capacity && map->named > 0; ++i) {
+        struct DisplayIdMapEntry *entry = &map->owned[i];
+        if (entry->key != 0 && (entry->flags & kDisplayIdMapNamed) &&
+            DisplayIdentityEqual(&entry->identity, identity) &&
+            (entry->display != display || entry->index != index)) {
+            entry->display = display;
+            entry->index = index;
+            map->dirty = 1;
+        }
+    }
+    return 0;
+}
+
+int DisplayIdMapFlush(struct DisplayIdMap *map) {
+    if (!map->dirty) {
+        return 0;
+    }
+    struct DisplayIdMapHeader header;
+    memset(&header, 0, sizeof(header));
+    DisplayFileHeaderInit(&header.file, kMagic, kDisplayIdMapVersion);
+    header.capacity = (uint32_t)map->capacity;
+    header.count = (uint32_t)map->count;
+
+    struct DisplayFileWriter writer;
+    if (DisplayFileCreate(&writer, map->path)) {
+        return -1;
+    }
+    DisplayFileWrite(&writer, &header, sizeof(header));
+    DisplayFileWrite(&writer, map->slots, map->capacity * sizeof(map->slots[0]));
+    if (DisplayFileReplace(&writer)) {
+        return -1;
+    }
+    map->dirty = 0;
+    return 0;
+}
+
+void DisplayIdMapClose(struct DisplayIdMap *map) {
+    free(map->owned);
+    map->owned = NULL;
+    Unmap(map);
+}
+
+void DisplayIdentityFormat(const struct DisplayIdentity *identity, char *out,
+                           size_t out_size) {
+    snprintf(out, out_size, "%x:%x:%x", (unsigned)identity->vendor,
+             (unsigned)identity->model, (unsigned)identity->serial);
+}
+
+int DisplayIdentityEqual(const struct DisplayIdentity *a,
+                         const struct DisplayIdentity *b) {
+    return a->vendor == b->vendor && a->model == b->model &&
+           a->serial == b->serial;
+}
+
+int DisplayIdentityShared(const struct DisplayIdentity *identities,
+                          const unsigned char *known, size_t count, size_t i) {
+    for (size_t j = 0; j < count; ++j) {
+        if (j != i && known[j] && DisplayIdentityEqual(&identities[j],
+                                                       &identities[i])) {
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,140 @@
+#ifndef DISPLAYMODE_IDS_H
+#define DISPLAYMODE_IDS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "displaymode_backend.h"
+#include "displaymode_file.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Version of the display map layout; files with another version are ignored.
+#define kDisplayIdMapVersion 1
+
+// Longest name, plus the terminator.
+#define kDisplayIdMapMaxName 32
+
+// Longest identity DisplayIdentityFormat writes, plus the terminator.
+#define kDisplayIdentityMaxText 27
+
+// The display map lets "t" and "p" address displays by what they are
+// rather than where they are in the display list: by an identity such as
+// "10ac:a0c4:4c4c3042" (vendor:model:serial, in hex) or a name given with
+// "n".  Each name or identity maps to the identity of a display, and to the
+// display ID and list position it was last seen at, so that resolving it
+// takes one hash probe and one identity check instead of reading every
+// display's identity.
+//
+// The file is the hash table itself, so loading it is one mmap: an
+// open-addressing table of "capacity" slots (a power of two), at most half
+// full, probed linearly from DisplayIdMapKey(name).  It is a
+// displaymode_file.h file.
+//
+// Layout (native byte order):
+//   struct DisplayIdMapHeader
+//   struct DisplayIdMapEntry[capacity]
+//
+// Files with the wrong magic, version, byte order or size are ignored and
+// rewritten on the next flush.
+
+struct DisplayIdMapHeader {
+    struct DisplayFileHeader file;
+    uint32_t capacity;
+    uint32_t count;
+};
+
+// Flags in DisplayIdMapEntry.
+enum {
+    // The entry's name was given with "n"; otherwise it is the identity.
+    kDisplayIdMapNamed = 1u << 0,
+};
+
+struct DisplayIdMapEntry {
+    uint64_t key;  // DisplayIdMapKey(name), or 0 for an empty slot
+    char name[kDisplayIdMapMaxName];
+    struct DisplayIdentity identity;
+    // Where the display was last seen: its backend ID and its index in the
+    // display list.
+    uint32_t display;
+    uint32_t index;
+    uint32_t flags;
+};
+
+// An open display map.  Changes are made to a copy of the mapped table and
+// written by DisplayIdMapFlush.
+struct DisplayIdMap {
+    char path[1024];
+    const unsigned char *data;
+    size_t size;
+    // The mapped slots, or "owned" once changed.
+    const struct DisplayIdMapEntry *slots;
+    struct DisplayIdMapEntry *owned;
+    size_t capacity;
+    size_t count;
+    // Entries with kDisplayIdMapNamed, which DisplayIdMapRecord must update.
+    size_t named;
+    int dirty;
+};
+
+// Writes the per-user default map path into "out".  Returns 0, or -1 if
+// there is no home directory.
+int DisplayIdMapDefaultPath(char *out, size_t out_size);
+
+// Maps the file at "path".  A missing or invalid file yields an empty map.
+// Returns 0, or -1 if "path" is too long.
+int DisplayIdMapOpen(struct DisplayIdMap *map, const char *path);
+
+// Returns the key "name" is hashed to.
+uint64_t DisplayIdMapKey(const char *name);
+
+// Returns the entry for "name", or NULL.
+const struct DisplayIdMapEntry *DisplayIdMapLookup(const struct DisplayIdMap *map,
+                                                   const char *name);
+
+// Returns non-zero if "name" can be given to a display: 1 to
+// kDisplayIdMapMaxName - 1 printable characters, not all digits (those are
+// display indices), not starting with '@' or '-', and without spaces or
+// ':' (which identities have).
+int DisplayIdMapValidName(const char *name);
+
+// Makes "name" refer to the display with "identity", last seen as
+// "display" at "index".  Returns 0, or -1 if the name is too long or out of
+// memory.
+int DisplayIdMapPut(struct DisplayIdMap *map, const char *name,
+                    const struct DisplayIdentity *identity, uint32_t display,
+                    uint32_t index, uint32_t flags);
+
+// Records that the display with "identity" is now "display" at "index":
+// adds its identity and moves every name of it there.  Returns 0, or -1 if
+// out of memory.
+int DisplayIdMapRecord(struct DisplayIdMap *map,
+                       const struct DisplayIdentity *identity,
+                       uint32_t display, uint32_t index);
+
+// Rewrites the file if anything changed.  Returns 0, or -1 with errno set.
+int DisplayIdMapFlush(struct DisplayIdMap *map);
+
+void DisplayIdMapClose(struct DisplayIdMap *map);
+
+// Writes "identity" as "vendor:model:serial" in lower-case hex.
+void DisplayIdentityFormat(const struct DisplayIdentity *identity, char *out,
+                           size_t out_size);
+
+// Returns non-zero if "a" and "b" are the same display.
+int DisplayIdentityEqual(const struct DisplayIdentity *a,
+                         const struct DisplayIdentity *b);
+
+// Returns non-zero if another of the "count" identities whose "known" is
+// set equals identities[i] (identical monitors, or panels that report no
+// serial number), so that the identity doesn't tell the displays apart.
+int DisplayIdentityShared(const struct DisplayIdentity *identities,
+                          const unsigned char *known, size_t count, size_t i);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DISPLAYMODE_IDS_H
@@ -0,0 +1,155 @@
+#include "displaymode_index.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "displaymode_parse.h"
+
+static size_t HashResolution(size_t width, size_t height) {
+    uint64_t h = (uint64_t)width * 0x9E3779B97F4A7C15ULL;
+    h ^= (uint64_t)height + 0x632BE59BD9B4E019ULL + (h << 6) + (h >> 2);
+    h ^= h >> 29;
+    return (size_t)h;
+}
+
+// Returns the slot holding the resolution, or the empty slot where it
+// belongs.
+static struct DisplayModeBucket *Probe(const struct DisplayModeIndex *index,
+                                       size_t width, size_t height) {
+    const size_t mask = index->capacity - 1;
+    size_t slot = HashResolution(width, height) & mask;
+    for (;;) {
+        struct DisplayModeBucket *bucket = &index->slots[slot];
+        if (bucket->count == 0 ||
+            (bucket->width == width && bucket->height == height)) {
+            return bucket;
+        }
+        slot = (slot + 1) & mask;
+    }
+}
+
+// Orders entries by refresh rate (NaN last), then by mode index.
+static int CompareEntries(const void *a, const void *b) {
+    const struct DisplayModeIndexEntry *x = a;
+    const struct DisplayModeIndexEntry *y = b;
+    const int x_nan = x->refresh_rate != x->refresh_rate;
+    const int y_nan = y->refresh_rate != y->refresh_rate;
+    if (x_nan != y_nan) {
+        return x_nan - y_nan;
+    }
+    if (!x_nan && x->refresh_rate != y->refresh_rate) {
+        return x->refresh_rate < y->refresh_rate ? -1 : 1;
+    }
+    return (x->mode_index > y->mode_index) - (x->mode_index < y->mode_index);
+}
+
+int DisplayModeIndexBuild(struct DisplayModeIndex *index,
+                          const struct DisplayMode *modes, size_t count) {
+    memset(index, 0, sizeof(*index));
+    if (count > UINT32_MAX) {
+        return -1;
+    }
+    // Keep the load factor at or below one half.
+    index->capacity = 8;
+    while (index->capacity < 2 * count) {
+        index->capacity *= 2;
+    }
+    index->slots = calloc(index->capacity, sizeof(index->slots[0]));
+    index->entries = malloc((count ? count : 1) * sizeof(index->entries[0]));
+    if (index->slots == NULL || index->entries == NULL) {
+        DisplayModeIndexFree(index);
+        return -1;
+    }
+    index->count = count;
+
+    // Count the modes of each resolution.
+    for (size_t i = 0; i < count; ++i) {
+        struct DisplayModeBucket *bucket =
+            Probe(index, modes[i].width, modes[i].height);
+        if (bucket->count == 0) {
+            bucket->width = modes[i].width;
+            bucket->height = modes[i].height;
+            bucket->min_index = (uint32_t)i;
+        }
+        ++bucket->count;
+    }
+    // Lay the buckets out contiguously.  "first" starts at each bucket's end
+    // and is decremented as entries are filled in, so the counts that Probe
+    // relies on stay intact.
+    uint32_t next = 0;
+    for (size_t slot = 0; slot < index->capacity; ++slot) {
+        struct DisplayModeBucket *bucket = &index->slots[slot];
+        if (bucket->count > 0) {
+            next += bucket->count;
+            bucket->first = next;
+        }
+    }
+    for (size_t i = count; i-- > 0;) {
+        struct DisplayModeBucket *bucket =
+            Probe(index, modes[i].width, modes[i].height);
+        struct DisplayModeIndexEntry *entry = &index->entries[--bucket->first];
+        entry->refresh_rate = modes[i].refresh_rate;
+        entry->mode_index = (uint32_t)i;
+    }
+    for (size_t slot = 0; slot < index->capacity; ++slot) {
+        const struct DisplayModeBucket *bucket = &index->slots[slot];
+        if (bucket->count > 1) {
+            qsort(&index->entries[bucket->first], bucket->count,
+                  sizeof(index->entries[0]), CompareEntries);
+        }
+    }
+    return 0;
+}
+
+const struct DisplayModeBucket *DisplayModeIndexFindBucket(
+    const struct DisplayModeIndex *index, size_t width, size_t height) {
+    if (index->capacity == 0) {
+        return NULL;
+    }
+    const struct DisplayModeBucket *bucket = Probe(index, width, height);
+    return bucket->count > 0 ? bucket : NULL;
+}
+
+ptrdiff_t DisplayModeIndexFind(const struct DisplayModeIndex *index,
+                               size_t width, size_t height,
+                               double refresh_rate) {
+    const struct DisplayModeBucket *bucket =
+        DisplayModeIndexFindBucket(index, width, height);
+    if (bucket == NULL) {
+        return -1;
+    }
+    if (refresh_rate == 0.0) {
+        return bucket->min_index;
+    }
+
+    // Search a window slightly wider than the tolerance and let
+    // MatchesRefreshRate decide, so rounding at the window's edges can't
+    // make the result differ from a linear scan.
+    const double low = refresh_rate - 2 * kRefreshRateTolerance;
+    const double high = refresh_rate + 2 * kRefreshRateTolerance;
+    const struct DisplayModeIndexEntry *entries = &index->entries[bucket->first];
+    size_t lo = 0;
+    size_t hi = bucket->count;
+    while (lo < hi) {
+        const size_t mid = lo + (hi - lo) / 2;
+        if (entries[mid].refresh_rate <= low) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    ptrdiff_t best = -1;
+    for (size_t i = lo; i < bucket->count && entries[i].refresh_rate < high; ++i) {
+        if (MatchesRefreshRate(refresh_rate, entries[i].refresh_rate) &&
+            (best < 0 || entries[i].mode_index < (size_t)best)) {
+            best = entries[i].mode_index;
+        }
+    }
+    return best;
+}
+
+void DisplayModeIndexFree(struct DisplayModeIndex *index) {
+    free(index->slots);
+    free(index->entries);
+    memset(index, 0, sizeof(*index));
+}
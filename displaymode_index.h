@@ -0,0 +1,59 @@
+#ifndef DISPLAYMODE_INDEX_H
+#define DISPLAYMODE_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "displaymode_backend.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// All modes of one resolution.  Its entries are sorted by refresh rate.
+struct DisplayModeBucket {
+    size_t width;
+    size_t height;
+    uint32_t first;
+    uint32_t count;  // 0 for an empty slot
+    // Smallest mode index in the bucket, the answer for "any refresh rate".
+    uint32_t min_index;
+};
+
+struct DisplayModeIndexEntry {
+    double refresh_rate;
+    uint32_t mode_index;
+};
+
+// Finds modes by resolution and refresh rate without scanning the whole
+// mode list: an open-addressing hash table on (width, height) leads to a
+// bucket, which is binary-searched by refresh rate.
+struct DisplayModeIndex {
+    struct DisplayModeBucket *slots;
+    size_t capacity;  // a power of two
+    struct DisplayModeIndexEntry *entries;
+    size_t count;
+};
+
+// Indexes "modes".  Returns 0, or -1 if out of memory.
+int DisplayModeIndexBuild(struct DisplayModeIndex *index,
+                          const struct DisplayMode *modes, size_t count);
+
+// Returns the bucket for a resolution, or NULL.
+const struct DisplayModeBucket *DisplayModeIndexFindBucket(
+    const struct DisplayModeIndex *index, size_t width, size_t height);
+
+// Returns the index of the first mode (in list order) with the given
+// resolution whose refresh rate satisfies MatchesRefreshRate(refresh_rate,
+// ...), or -1.  Equivalent to a linear scan of the indexed list.
+ptrdiff_t DisplayModeIndexFind(const struct DisplayModeIndex *index,
+                               size_t width, size_t height,
+                               double refresh_rate);
+
+void DisplayModeIndexFree(struct DisplayModeIndex *index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DISPLAYMODE_INDEX_H
@@ -0,0 +1,286 @@
+#include "displaymode_json.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+void JsonWriterInit(struct JsonWriter *writer, FILE *out) {
+    writer->out = out;
+    writer->length = 0;
+    writer->depth = 0;
+    writer->has_items = 0;
+    writer->in_object = 0;
+    writer->after_key = 0;
+    writer->error = 0;
+}
+
+int JsonWriterFlush(struct JsonWriter *writer) {
+    if (writer->out != NULL && writer->length > 0 && !writer->error) {
+        if (fwrite(writer->buffer, 1, writer->length, writer->out) !=
+            writer->length) {
+            writer->error = 1;
+        }
+        writer->length = 0;
+    }
+    return writer->error ? -1 : 0;
+}
+
+// Makes room for "size" bytes.  Returns the write position, or NULL.
+static char *Reserve(struct JsonWriter *writer, size_t size) {
+    if (writer->error) {
+        return NULL;
+    }
+    if (writer->length + size > sizeof(writer->buffer)) {
+        if (writer->out == NULL || size > sizeof(writer->buffer) ||
+            JsonWriterFlush(writer)) {
+            writer->error = 1;
+            return NULL;
+        }
+    }
+    return writer->buffer + writer->length;
+}
+
+static void Append(struct JsonWriter *writer, const char *text, size_t size) {
+    // Text longer than the buffer (only possible in strings) goes in chunks.
+    while (size > sizeof(writer->buffer) && writer->out != NULL) {
+        const size_t chunk = sizeof(writer->buffer) - writer->length;
+        char *p = Reserve(writer, chunk);
+        if (p == NULL) {
+            return;
+        }
+        memcpy(p, text, chunk);
+        writer->length += chunk;
+        text += chunk;
+        size -= chunk;
+        if (JsonWriterFlush(writer)) {
+            return;
+        }
+    }
+    char *p = Reserve(writer, size);
+    if (p != NULL) {
+        memcpy(p, text, size);
+        writer->length += size;
+    }
+}
+
+static void AppendChar(struct JsonWriter *writer, char c) {
+    char *p = Reserve(writer, 1);
+    if (p != NULL) {
+        *p = c;
+        ++writer->length;
+    }
+}
+
+// Writes the separator due before a value (or key).
+static void BeginValue(struct JsonWriter *writer) {
+    const uint64_t bit = 1ULL << writer->depth;
+    if (writer->after_key) {
+        writer->after_key = 0;
+        return;
+    }
+    if (writer->in_object & bit) {
+        // A value without a key.
+        writer->error = 1;
+        return;
+    }
+    if (writer->has_items & bit) {
+        AppendChar(writer, ',');
+    }
+    writer->has_items |= bit;
+}
+
+static void Open(struct JsonWriter *writer, char c, int is_object) {
+    BeginValue(writer);
+    if (writer->depth + 1 >= kJsonMaxDepth) {
+        writer->error = 1;
+        return;
+    }
+    AppendChar(writer, c);
+    ++writer->depth;
+    const uint64_t bit = 1ULL << writer->depth;
+    writer->has_items &= ~bit;
+    if (is_object) {
+        writer->in_object |= bit;
+    } else {
+        writer->in_object &= ~bit;
+    }
+}
+
+static void Close(struct JsonWriter *writer, char c, int is_object) {
+    const uint64_t bit = 1ULL << writer->depth;
+    if (writer->depth == 0 || writer->after_key ||
+        !!(writer->in_object & bit) != is_object) {
+        writer->error = 1;
+        return;
+    }
+    --writer->depth;
+    AppendChar(writer, c);
+}
+
+void JsonWriterBeginObject(struct JsonWriter *writer) {
+    Open(writer, '{', 1);
+}
+
+void JsonWriterEndObject(struct JsonWriter *writer) {
+    Close(writer, '}', 1);
+}
+
+void JsonWriterBeginArray(struct JsonWriter *writer) {
+    Open(writer, '[', 0);
+}
+
+void JsonWriterEndArray(struct JsonWriter *writer) {
+    Close(writer, ']', 0);
+}
+
+static void AppendString(struct JsonWriter *writer, const char *value,
+                         size_t length) {
+    static const char kHex[] = "0123456789abcdef";
+    AppendChar(writer, '"');
+    const char *run = value;
+    const char *end = value + length;
+    for (const char *p = value; p < end; ++p) {
+        const unsigned char c = (unsigned char)*p;
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        // Copy the unescaped run before this character in one go.
+        Append(writer, run, (size_t)(p - run));
+        run = p + 1;
+        char escape[6] = {'\\', 0, 0, 0, 0, 0};
+        size_t size = 2;
+        switch (c) {
+            case '"': escape[1] = '"'; break;
+            case '\\': escape[1] = '\\'; break;
+            case '\b': escape[1] = 'b'; break;
+            case '\f': escape[1] = 'f'; break;
+            case '\n': escape[1] = 'n'; break;
+            case '\r': escape[1] = 'r'; break;
+            case '\t': escape[1] = 't'; break;
+            default:
+                escape[1] = 'u';
+                escape[2] = '0';
+                escape[3] = '0';
+                escape[4] = kHex[c >> 4];
+                escape[5] = kHex[c & 0xf];
+                size = 6;
+                break;
+        }
+        Append(writer, escape, size);
+    }
+    Append(writer, run, (size_t)(end - run));
+    AppendChar(writer, '"');
+}
+
+void JsonWriterKey(struct JsonWriter *writer, const char *key) {
+    const uint64_t bit = 1ULL << writer->depth;
+    if (!(writer->in_object & bit) || writer->after_key) {
+        writer->error = 1;
+        return;
+    }
+    if (writer->has_items & bit) {
+        AppendChar(writer, ',');
+    }
+    writer->has_items |= bit;
+    AppendString(writer, key, strlen(key));
+    AppendChar(writer, ':');
+    writer->after_key = 1;
+}
+
+void JsonWriterString(struct JsonWriter *writer, const char *value) {
+    BeginValue(writer);
+    AppendString(writer, value, strlen(value));
+}
+
+void JsonWriterStringLength(struct JsonWriter *writer, const char *value,
+                            size_t length) {
+    BeginValue(writer);
+    AppendString(writer, value, length);
+}
+
+// Formats "value" backwards into the end of "digits"; returns the start.
+static char *FormatUint(uint64_t value, char *end) {
+    char *p = end;
+    do {
+        *--p = (char)('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    return p;
+}
+
+void JsonWriterUint(struct JsonWriter *writer, uint64_t value) {
+    BeginValue(writer);
+    char digits[20];
+    char *end = digits + sizeof(digits);
+    char *start = FormatUint(value, end);
+    Append(writer, start, (size_t)(end - start));
+}
+
+void JsonWriterInt(struct JsonWriter *writer, int64_t value) {
+    BeginValue(writer);
+    char digits[21];
+    char *end = digits + sizeof(digits);
+    const uint64_t magnitude =
+        value < 0 ? (uint64_t)0 - (uint64_t)value : (uint64_t)value;
+    char *start = FormatUint(magnitude, end);
+    if (value < 0) {
+        *--start = '-';
+    }
+    Append(writer, start, (size_t)(end - start));
+}
+
+void JsonWriterDouble(struct JsonWriter *writer, double value) {
+    if (!isfinite(value)) {
+        JsonWriterNull(writer);
+        return;
+    }
+    BeginValue(writer);
+    char text[32];
+    int size;
+    if (fabs(value) < 1e15 && value == (double)(int64_t)value) {
+        // Integral values are by far the most common refresh rates.
+        char *end = text + sizeof(text) - 2;
+        const int64_t integral = (int64_t)value;
+        char *start = FormatUint(integral < 0 ? (uint64_t)-integral
+                                              : (uint64_t)integral, end);
+        if (integral < 0 || (integral == 0 && signbit(value))) {
+            *--start = '-';
+        }
+        memcpy(end, ".0", 2);
+        Append(writer, start, (size_t)(end + 2 - start));
+        return;
+    }
+    size = snprintf(text, sizeof(text), "%.15g", value);
+    if (strtod(text, NULL) != value) {
+        size = snprintf(text, sizeof(text), "%.17g", value);
+    }
+    if (strpbrk(text, ".eE") == NULL) {
+        text[size++] = '.';
+        text[size++] = '0';
+    }
+    Append(writer, text, (size_t)size);
+}
+
+void JsonWriterBool(struct JsonWriter *writer, int value) {
+    BeginValue(writer);
+    if (value) {
+        Append(writer, "true", 4);
+    } else {
+        Append(writer, "false", 5);
+    }
+}
+
+void JsonWriterNull(struct JsonWriter *writer) {
+    BeginValue(writer);
+    Append(writer, "null", 4);
+}
+
+void JsonWriterEndLine(struct JsonWriter *writer) {
+    if (writer->depth != 0 || writer->after_key) {
+        writer->error = 1;
+        return;
+    }
+    AppendChar(writer, '\n');
+    // The next line is a new top-level value.
+    writer->has_items = 0;
+}
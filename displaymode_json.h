@@ -0,0 +1,71 @@
+#ifndef DISPLAYMODE_JSON_H
+#define DISPLAYMODE_JSON_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Size of the writer's buffer; it is flushed to the stream when full.
+#define kJsonWriterBufferSize 8192
+
+// Maximum nesting of arrays and objects.
+#define kJsonMaxDepth 32
+
+// Writes JSON text into a fixed buffer without allocating, inserting commas
+// and colons as values are added.  With a stream, the buffer is written out
+// whenever it fills up (and by JsonWriterFlush); without one, the text must
+// fit in the buffer and is read from "buffer" and "length".
+//
+// Misuse (too deep, a value where a key is expected) and write errors set
+// "error", after which nothing more is written.
+struct JsonWriter {
+    FILE *out;
+    size_t length;
+    uint32_t depth;
+    // Bit d is set once a value has been written at depth d.
+    uint64_t has_items;
+    // Bit d is set if depth d is an object.
+    uint64_t in_object;
+    int after_key;
+    int error;
+    char buffer[kJsonWriterBufferSize];
+};
+
+// Prepares "writer" to write to "out", which may be NULL.
+void JsonWriterInit(struct JsonWriter *writer, FILE *out);
+
+void JsonWriterBeginObject(struct JsonWriter *writer);
+void JsonWriterEndObject(struct JsonWriter *writer);
+void JsonWriterBeginArray(struct JsonWriter *writer);
+void JsonWriterEndArray(struct JsonWriter *writer);
+
+// Writes an object key; the next call must write its value.
+void JsonWriterKey(struct JsonWriter *writer, const char *key);
+
+void JsonWriterString(struct JsonWriter *writer, const char *value);
+// Writes the "length" bytes at "value", which may include NULs, as a string.
+void JsonWriterStringLength(struct JsonWriter *writer, const char *value,
+                            size_t length);
+void JsonWriterUint(struct JsonWriter *writer, uint64_t value);
+void JsonWriterInt(struct JsonWriter *writer, int64_t value);
+// Writes the shortest of "%.15g" and "%.17g" that reads back as "value"
+// (with ".0" appended to integral values), or null if it isn't finite.
+void JsonWriterDouble(struct JsonWriter *writer, double value);
+void JsonWriterBool(struct JsonWriter *writer, int value);
+void JsonWriterNull(struct JsonWriter *writer);
+
+// Ends a top-level value with a newline, as in NDJSON.
+void JsonWriterEndLine(struct JsonWriter *writer);
+
+// Writes the buffered text to the stream.  Returns 0, or -1 on error.
+int JsonWriterFlush(struct JsonWriter *writer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DISPLAYMODE_JSON_H
@@ -0,0 +1,495 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "displaymode_layout.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "displaymode_cache.h"
+#include "displaymode_catalog.h"
+#include "displaymode_ids.h"
+#include "displaymode_table.h"
+#include "displaymode_trace.h"
+
+static const char kMagic[8] = {'D', 'M', 'P', 'L', 'A', 'N', '\0', '\0'};
+
+// Largest config file read.
+#define kMaxConfigSize (1 << 20)
+
+// Times the config is read before giving up on it changing meanwhile.
+#define kMaxReadAttempts 3
+
+// Most words after a layout's name: a full "t" command line.
+#define kMaxLayoutWords (4 * kMaxModeSpecs)
+
+int DisplayLayoutsDefaultPaths(char *config_path, size_t config_size,
+                               char *plan_path, size_t plan_size) {
+    const char *home = getenv("HOME");
+#ifdef __APPLE__
+    if (home == NULL || home[0] == '\0') {
+        return -1;
+    }
+    snprintf(config_path, config_size,
+             "%s/Library/Preferences/displaymode.layouts", home);
+    snprintf(plan_path, plan_size, "%s/Library/Caches/displaymode.plans", home);
+#else
+    // Layouts are settings; their plans can be compiled again, so they are
+    // a cache.
+    const char *config_home = getenv("XDG_CONFIG_HOME");
+    const char *cache_home = getenv("XDG_CACHE_HOME");
+    if ((config_home == NULL || config_home[0] == '\0' ||
+         cache_home == NULL || cache_home[0] == '\0') &&
+        (home == NULL || home[0] == '\0')) {
+        return -1;
+    }
+    if (config_home != NULL && config_home[0] != '\0') {
+        snprintf(config_path, config_size, "%s/displaymode.layouts", config_home);
+    } else {
+        snprintf(config_path, config_size, "%s/.config/displaymode.layouts", home);
+    }
+    if (cache_home != NULL && cache_home[0] != '\0') {
+        snprintf(plan_path, plan_size, "%s/displaymode.plans", cache_home);
+    } else {
+        snprintf(plan_path, plan_size, "%s/.cache/displaymode.plans", home);
+    }
+#endif
+    return 0;
+}
+
+// Returns a stamp of the file "st" describes that changes whenever it is
+// written or replaced.  Times are taken to the nanosecond, since an edit
+// within the same second needn't change the size; the change time also
+// catches an edit that kept the old modification time.
+static uint64_t StampOf(const struct stat *st) {
+#ifdef __APPLE__
+    const struct timespec modified = st->st_mtimespec;
+    const struct timespec changed = st->st_ctimespec;
+#else
+    const struct timespec modified = st->st_mtim;
+    const struct timespec changed = st->st_ctim;
+#endif
+    const int64_t fields[] = {
+        (int64_t)st->st_size,      (int64_t)st->st_ino,
+        (int64_t)modified.tv_sec,  (int64_t)modified.tv_nsec,
+        (int64_t)changed.tv_sec,   (int64_t)changed.tv_nsec,
+    };
+    const uint64_t stamp =
+        DisplayCacheHash(kDisplayCacheHashSeed, fields, sizeof(fields));
+    return stamp != 0 ? stamp : 1;
+}
+
+// Returns the stamp of the file at "path", or 0 if there is no file.
+static uint64_t Stamp(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? StampOf(&st) : 0;
+}
+
+// Checks that the mapped file holds complete plans compiled from the
+// current config.
+static int Validate(struct DisplayLayouts *layouts) {
+    const struct DisplayLayoutPlanHeader *header =
+        (const struct DisplayLayoutPlanHeader *)layouts->data;
+    if (header->source == 0 ||
+        header->source != layouts->source ||
+        layouts->size != sizeof(*header) +
+                         (size_t)header->count * sizeof(struct DisplayLayoutPlan)) {
+        return -1;
+    }
+    const struct DisplayLayoutPlan *plans =
+        (const struct DisplayLayoutPlan *)(header + 1);
+    for (uint32_t i = 0; i < header->count; ++i) {
+        if (plans[i].name[kDisplayLayoutMaxName - 1] != '\0' ||
+            plans[i].num_displays > kMaxModeSpecs) {
+            return -1;
+        }
+    }
+    layouts->plans = plans;
+    layouts->count = header->count;
+    return 0;
+}
+
+static void Unmap(struct DisplayLayouts *layouts) {
+    DisplayFileUnmap(&layouts->data, &layouts->size);
+    if (layouts->owned == NULL) {
+        layouts->plans = NULL;
+        layouts->count = 0;
+    }
+}
+
+int DisplayLayoutsOpen(struct DisplayLayouts *layouts, const char *config_path,
+                       const char *plan_path) {
+    memset(layouts, 0, sizeof(*layouts));
+    if (strlen(config_path) >= sizeof(layouts->config_path) ||
+        strlen(plan_path) >= sizeof(layouts->plan_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(layouts->config_path, config_path);
+    strcpy(layouts->plan_path, plan_path);
+    layouts->source = Stamp(config_path);
+
+    if (DisplayFileMap(plan_path, kMagic, kDisplayLayoutPlanVersion,
+                       sizeof(struct DisplayLayoutPlanHeader), &layouts->data,
+                       &layouts->size) == 0 &&
+        Validate(layouts)) {
+        Unmap(layouts);
+    }
+    return 0;
+}
+
+const struct DisplayLayoutPlan *DisplayLayoutsFind(
+    const struct DisplayLayouts *layouts, const char *name) {
+    // There are a handful of layouts, so they are scanned.
+    for (size_t i = 0; i < layouts->count; ++i) {
+        if (strcmp(layouts->plans[i].name, name) == 0) {
+            return &layouts->plans[i];
+        }
+    }
+    return NULL;
+}
+
+// Stores "plan" in place of the plan of the same name, if any.  Returns 0,
+// or -1 if out of memory.
+static int PutPlan(struct DisplayLayouts *layouts,
+                   const struct DisplayLayoutPlan *plan) {
+    size_t i = 0;
+    while (i < layouts->count && strcmp(layouts->plans[i].name, plan->name) != 0) {
+        ++i;
+    }
+    if (layouts->owned == NULL || i == layouts->capacity) {
+        const size_t capacity = layouts->count + 4;
+        struct DisplayLayoutPlan *owned = malloc(capacity * sizeof(*owned));
+        if (owned == NULL) {
+            return -1;
+        }
+        if (layouts->count > 0) {
+            memcpy(owned, layouts->plans, layouts->count * sizeof(*owned));
+        }
+        free(layouts->owned);
+        layouts->owned = owned;
+        layouts->plans = owned;
+        layouts->capacity = capacity;
+    }
+    layouts->owned[i] = *plan;
+    if (i == layouts->count) {
+        ++layouts->count;
+    }
+    layouts->dirty = 1;
+    return 0;
+}
+
+// Hashes what a plan depends on besides its modes: the display list, and the
+// identity and number of modes of each of the plan's displays.  The modes
+// must be loaded.
+static uint64_t Fingerprint(const struct DisplayCatalog *catalog,
+                            const struct DisplayLayoutPlan *plan) {
+    uint64_t hash = DisplayCacheHash(kDisplayCacheHashSeed,
+                                     &catalog->arrangement_fingerprint,
+                                     sizeof(catalog->arrangement_fingerprint));
+    for (uint32_t i = 0; i < plan->num_displays; ++i) {
+        const struct DisplayLayoutPlanDisplay *display = &plan->displays[i];
+        const uint64_t count = catalog->modes[display->index].count;
+        hash = DisplayCacheHash(hash, &display->identity,
+                                sizeof(display->identity));
+        hash = DisplayCacheHash(hash, &count, sizeof(count));
+    }
+    return hash;
+}
+
+// Reads the identity of the display at "index"; displays the backend can't
+// identify all have the zero identity.
+static void ReadIdentity(const struct DisplayCatalog *catalog, uint32_t index,
+                         struct DisplayIdentity *identity) {
+    const struct DisplayBackend *backend = catalog->backend;
+    if (backend->get_display_identity == NULL ||
+        backend->get_display_identity(backend->context,
+                                      catalog->displays[index], identity)) {
+        memset(identity, 0, sizeof(*identity));
+    }
+}
+
+int DisplayLayoutCheck(struct DisplayCatalog *catalog,
+                       const struct DisplayLayoutPlan *plan) {
+    int e = DisplayCatalogLoadDisplays(catalog);
+    if (e) {
+        return e;
+    }
+    for (uint32_t i = 0; i < plan->num_displays; ++i) {
+        const struct DisplayLayoutPlanDisplay *planned = &plan->displays[i];
+        if (planned->index >= catalog->num_displays ||
+            catalog->displays[planned->index] != planned->display) {
+            return 1;
+        }
+        struct DisplayIdentity identity;
+        ReadIdentity(catalog, planned->index, &identity);
+        if (!DisplayIdentityEqual(&identity, &planned->identity)) {
+            return 1;
+        }
+        // Only live modes carry the handles needed to set them.
+        const struct DisplayModeList *list = NULL;
+        if ((e = DisplayCatalogGetLiveModes(catalog, planned->index, &list))) {
+            return e;
+        }
+        if (planned->mode_index >= list->count) {
+            return 1;
+        }
+        const struct DisplayMode *mode = &list->modes[planned->mode_index];
+        if (mode->mode_id != planned->mode_id || mode->width != planned->width ||
+            mode->height != planned->height ||
+            DisplayModeTableMillihertz(mode->refresh_rate) !=
+                planned->refresh_mhz) {
+            return 1;
+        }
+    }
+    return Fingerprint(catalog, plan) != plan->fingerprint;
+}
+
+// Resolves the specifications of the layout "name" into "*plan".  Reports
+// problems to "err" after "where".  Returns 0, or -1.
+static int CompilePlan(struct DisplayCatalog *catalog, const char *name,
+                       const struct ModeSpec *specs, size_t num_specs,
+                       struct DisplayLayoutPlan *plan, const char *where,
+                       FILE *err) {
+    memset(plan, 0, sizeof(*plan));
+    strcpy(plan->name, name);
+    for (size_t i = 0; i < num_specs; ++i) {
+        const struct ModeSpec *spec = &specs[i];
+        uint32_t index = spec->display_index;
+        int e;
+        if (spec->display_name != NULL &&
+            (e = DisplayCatalogFindDisplay(catalog, spec->display_name, &index))) {
+            fprintf(err, "%sUnknown display '%s'\n", where, spec->display_name);
+            return -1;
+        }
+        if ((e = DisplayCatalogLoadDisplays(catalog))) {
+            fprintf(err, "%sCGGetActiveDisplayList CGError: %d\n", where, e);
+            return -1;
+        }
+        if (index >= catalog->num_displays) {
+            fprintf(err, "%sDisplay %u not supported; display must be < %u\n",
+                    where, index, catalog->num_displays);
+            return -1;
+        }
+        for (size_t j = 0; j < i; ++j) {
+            if (plan->displays[j].index == index) {
+                fprintf(err, "%sDisplay %u specified more than once\n", where,
+                        index);
+                return -1;
+            }
+        }
+        const struct DisplayModeList *list = NULL;
+        if ((e = DisplayCatalogGetLiveModes(catalog, index, &list))) {
+            fprintf(err, "%sCGDisplayCopyAllDisplayModes CGError: %d\n", where,
+                    e);
+            return -1;
+        }
+        const ptrdiff_t matched = DisplayCatalogFindMode(
+            catalog, index, spec->width, spec->height, spec->refresh_rate);
+        if (matched < 0) {
+            fprintf(err, "%sCould not find a mode for resolution %lux%lu on "
+                    "display %u\n", where, spec->width, spec->height, index);
+            return -1;
+        }
+        const struct DisplayMode *mode = &list->modes[matched];
+        struct DisplayLayoutPlanDisplay *planned = &plan->displays[i];
+        ReadIdentity(catalog, index, &planned->identity);
+        planned->display = catalog->displays[index];
+        planned->index = index;
+        planned->mode_index = (uint32_t)matched;
+        planned->mode_id = mode->mode_id;
+        planned->width = (uint32_t)mode->width;
+        planned->height = (uint32_t)mode->height;
+        planned->refresh_mhz = DisplayModeTableMillihertz(mode->refresh_rate);
+        plan->num_displays = (uint32_t)i + 1;
+    }
+    // Resolving a later display may re-read the display list.
+    for (uint32_t i = 0; i < plan->num_displays; ++i) {
+        if (plan->displays[i].index >= catalog->num_displays ||
+            catalog->displays[plan->displays[i].index] !=
+                plan->displays[i].display) {
+            fprintf(err, "%sThe displays changed while compiling\n", where);
+            return -1;
+        }
+    }
+    plan->fingerprint = Fingerprint(catalog, plan);
+    return 0;
+}
+
+// Reads the whole file at "path" into a NUL-terminated buffer, and its
+// stamp into "*stamp".  The stamp is that of the file read, taken before
+// reading it; a read during which the file changed is taken again.
+// Returns the buffer, or NULL.
+static char *ReadConfig(const char *path, uint64_t *stamp) {
+    char *text = malloc(kMaxConfigSize + 1);
+    if (text == NULL) {
+        return NULL;
+    }
+    for (int attempt = 0; attempt < kMaxReadAttempts; ++attempt) {
+        FILE *f = fopen(path, "r");
+        if (f == NULL) {
+            break;
+        }
+        struct stat before;
+        struct stat after;
+        int failed = fstat(fileno(f), &before) != 0;
+        const size_t length =
+            failed ? 0 : fread(text, 1, kMaxConfigSize + 1, f);
+        failed = failed || ferror(f) || length > kMaxConfigSize ||
+                 fstat(fileno(f), &after) != 0;
+        fclose(f);
+        if (failed) {
+            break;
+        }
+        *stamp = StampOf(&before);
+        if (*stamp == StampOf(&after)) {
+            text[length] = '\0';
+            return text;
+        }
+    }
+    free(text);
+    return NULL;
+}
+
+static char *Trim(char *s) {
+    while (*s == ' ' || *s == '\t' || *s == '\r') {
+        ++s;
+    }
+    char *end = s + strlen(s);
+    while (end > s && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r')) {
+        *--end = '\0';
+    }
+    return s;
+}
+
+int DisplayLayoutsCompile(struct DisplayLayouts *layouts,
+                          struct DisplayCatalog *catalog, const char *name,
+                          FILE *out, FILE *err) {
+    struct TraceSpan span;
+    TraceSpanBegin(&span, "compile layouts", "phase");
+    uint64_t source = 0;
+    char *text = ReadConfig(layouts->config_path, &source);
+    if (text == NULL) {
+        TraceSpanEnd(&span);
+        fprintf(err, "Could not read layouts from %s\n", layouts->config_path);
+        return -1;
+    }
+    if (name == NULL || source != layouts->source) {
+        // The plans are replaced by those of the layouts compiled now; those
+        // of an older config can't be kept under the new stamp.
+        layouts->count = 0;
+        layouts->dirty = 1;
+    }
+    layouts->source = source;
+
+    int status = name != NULL ? kDisplayErrorRangeCheck : 0;
+    unsigned long line_number = 0;
+    char *save = NULL;
+    for (char *line = text; line != NULL; line = save) {
+        ++line_number;
+        char *newline = strchr(line, '\n');
+        save = newline != NULL ? newline + 1 : NULL;
+        if (newline != NULL) {
+            *newline = '\0';
+        }
+        char *comment = strchr(line, '#');
+        if (comment != NULL) {
+            *comment = '\0';
+        }
+        line = Trim(line);
+        if (line[0] == '\0') {
+            continue;
+        }
+        char where[1100];
+        snprintf(where, sizeof(where), "%s:%lu: ", layouts->config_path,
+                 line_number);
+        char *colon = strchr(line, ':');
+        if (colon == NULL) {
+            if (name == NULL) {
+                fprintf(err, "%sExpected <name>: <modes>\n", where);
+                status = -1;
+            }
+            continue;
+        }
+        *colon = '\0';
+        const char *layout_name = Trim(line);
+        if (name != NULL && strcmp(layout_name, name) != 0) {
+            continue;
+        }
+        if (!DisplayIdMapValidName(layout_name)) {
+            fprintf(err, "%sInvalid layout name '%s'\n", where, layout_name);
+            status = -1;
+            continue;
+        }
+
+        // The specifications are those of "t".
+        const char *argv[kMaxLayoutWords + 3] = {"displaymode", "t"};
+        int argc = 2;
+        int too_long = 0;
+        char *word_save = NULL;
+        for (char *word = strtok_r(colon + 1, " \t\r", &word_save);
+             word != NULL; word = strtok_r(NULL, " \t\r", &word_save)) {
+            if (argc == kMaxLayoutWords + 2) {
+                too_long = 1;
+                break;
+            }
+            argv[argc++] = word;
+        }
+        const struct ParsedArgs parsed_args = ParseArgs(argc, argv);
+        struct DisplayLayoutPlan plan;
+        if (too_long || parsed_args.option != kOptionConfigureMode) {
+            fprintf(err, "%sInvalid mode\n", where);
+            status = -1;
+        } else if (CompilePlan(catalog, layout_name, parsed_args.specs,
+                               parsed_args.num_specs, &plan, where, err)) {
+            status = -1;
+        } else if (PutPlan(layouts, &plan)) {
+            fprintf(err, "%sOut of memory\n", where);
+            status = -1;
+        } else if (name != NULL) {
+            status = 0;
+        } else {
+            fprintf(out, "Layout '%s': %u display%s\n", plan.name,
+                    plan.num_displays, plan.num_displays == 1 ? "" : "s");
+        }
+        if (name != NULL) {
+            break;
+        }
+    }
+    free(text);
+    TraceSpanEnd(&span);
+    return status;
+}
+
+int DisplayLayoutsFlush(struct DisplayLayouts *layouts) {
+    if (!layouts->dirty) {
+        return 0;
+    }
+    struct DisplayLayoutPlanHeader header;
+    memset(&header, 0, sizeof(header));
+    DisplayFileHeaderInit(&header.file, kMagic, kDisplayLayoutPlanVersion);
+    header.source = layouts->source;
+    header.count = (uint32_t)layouts->count;
+
+    struct DisplayFileWriter writer;
+    if (DisplayFileCreate(&writer, layouts->plan_path)) {
+        return -1;
+    }
+    DisplayFileWrite(&writer, &header, sizeof(header));
+    if (layouts->count > 0) {
+        DisplayFileWrite(&writer, layouts->plans,
+                         layouts->count * sizeof(layouts->plans[0]));
+    }
+    if (DisplayFileReplace(&writer)) {
+        return -1;
+    }
+    layouts->dirty = 0;
+    return 0;
+}
+
+void DisplayLayoutsClose(struct DisplayLayouts *layouts) {
+    free(layouts->owned);
+    layouts->owned = NULL;
+    Unmap(layouts);
+}
@@ -0,0 +1,133 @@
+#ifndef DISPLAYMODE_LAYOUT_H
+#define DISPLAYMODE_LAYOUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "displaymode_backend.h"
+#include "displaymode_file.h"
+#include "displaymode_parse.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct DisplayCatalog;
+
+// Version of the plan file layout; files with another version are ignored.
+#define kDisplayLayoutPlanVersion 1
+
+// Longest layout name, plus the terminator.
+#define kDisplayLayoutMaxName 32
+
+// Layouts are named sets of "t" specifications, one per line of a config
+// file, with blank lines and '#' comments ignored:
+//
+//   desk: 4K @60 desk 1440 900 0
+//   presenter: 1080p 0 1080p 1
+//
+// Compiling a layout resolves it against the catalog into a plan: for each
+// of its displays, the display's ID, position and identity, and the index
+// and properties of the mode to set, with a fingerprint of the displays it
+// was resolved against (their arrangement, identities and mode counts).
+// Plans are kept in a file beside the mode cache, so that applying a layout
+// again reads no config, parses nothing and searches no mode list: it
+// checks the fingerprint and the planned modes and configures them.  A plan
+// that no longer matches is compiled again; editing the config drops them
+// all.
+//
+// Plan file layout (native byte order):
+//   struct DisplayLayoutPlanHeader
+//   struct DisplayLayoutPlan[count]
+
+struct DisplayLayoutPlanHeader {
+    struct DisplayFileHeader file;
+    // DisplayLayoutsOpen's stamp of the config the plans were compiled from.
+    uint64_t source;
+    uint32_t count;
+    uint32_t reserved;
+};
+
+// One display of a plan and the mode to set it to.
+struct DisplayLayoutPlanDisplay {
+    struct DisplayIdentity identity;
+    uint32_t display;  // backend ID
+    uint32_t index;    // position in the display list
+    // Position of the mode in the display's live mode list, and enough of
+    // it to tell that the mode there is still the one planned.
+    uint32_t mode_index;
+    int32_t mode_id;
+    uint32_t width;
+    uint32_t height;
+    uint32_t refresh_mhz;
+};
+
+struct DisplayLayoutPlan {
+    char name[kDisplayLayoutMaxName];
+    uint64_t fingerprint;
+    uint32_t num_displays;
+    uint32_t reserved;
+    struct DisplayLayoutPlanDisplay displays[kMaxModeSpecs];
+};
+
+// The config and plans of the layouts.  Changed plans are kept in a copy of
+// the mapped ones and written by DisplayLayoutsFlush.
+struct DisplayLayouts {
+    char config_path[1024];
+    char plan_path[1024];
+    // Stamp of the config file (its size, inode, and modification and change
+    // times), or 0 if there is none.
+    uint64_t source;
+    const unsigned char *data;
+    size_t size;
+    // The mapped plans, or "owned" once changed.
+    const struct DisplayLayoutPlan *plans;
+    struct DisplayLayoutPlan *owned;
+    size_t count;
+    size_t capacity;
+    int dirty;
+};
+
+// Writes the per-user default config and plan paths.  Returns 0, or -1 if
+// there is no home directory.
+int DisplayLayoutsDefaultPaths(char *config_path, size_t config_size,
+                               char *plan_path, size_t plan_size);
+
+// Stamps the config at "config_path" and maps the plans at "plan_path".
+// Missing or invalid plans, or plans of another config, are ignored.
+// Returns 0, or -1 if a path is too long.
+int DisplayLayoutsOpen(struct DisplayLayouts *layouts, const char *config_path,
+                       const char *plan_path);
+
+// Returns the plan of the layout "name", or NULL.
+const struct DisplayLayoutPlan *DisplayLayoutsFind(
+    const struct DisplayLayouts *layouts, const char *name);
+
+// Compiles the layout "name" from the config, or every layout if "name" is
+// NULL (then replacing all plans, and printing a line for each layout to
+// "out").  Reports problems to "err", prefixed with the config's path and
+// line.  Returns 0, kDisplayErrorRangeCheck if there is no layout "name",
+// or -1 if a layout doesn't fit the displays or the config couldn't be read.
+int DisplayLayoutsCompile(struct DisplayLayouts *layouts,
+                          struct DisplayCatalog *catalog, const char *name,
+                          FILE *out, FILE *err);
+
+// Checks that "plan" still holds: that its displays are where and what it
+// expects and offer the planned modes in the planned places, loading their
+// live modes.  Returns 0 if it holds, 1 if it must be compiled again, or
+// the backend's error.
+int DisplayLayoutCheck(struct DisplayCatalog *catalog,
+                       const struct DisplayLayoutPlan *plan);
+
+// Rewrites the plan file if any plan changed.  Returns 0, or -1 with errno
+// set.
+int DisplayLayoutsFlush(struct DisplayLayouts *layouts);
+
+void DisplayLayoutsClose(struct DisplayLayouts *layouts);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DISPLAYMODE_LAYOUT_H
@@ -0,0 +1,34 @@
+#include "displaymode_line.h"
+
+#include <string.h>
+
+void LineWriterPut(struct LineWriter *w, const char *s, size_t n) {
+    if (w->length < w->size) {
+        const size_t room = w->size - w->length;
+        memcpy(w->out + w->length, s, n < room ? n : room);
+    }
+    w->length += n;
+}
+
+void LineWriterPutString(struct LineWriter *w, const char *s) {
+    LineWriterPut(w, s, strlen(s));
+}
+
+void LineWriterPutUint(struct LineWriter *w, uint64_t value) {
+    char digits[20];
+    size_t n = 0;
+    do {
+        digits[sizeof(digits) - ++n] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    LineWriterPut(w, digits + sizeof(digits) - n, n);
+}
+
+void LineWriterPutInt(struct LineWriter *w, int64_t value) {
+    if (value < 0) {
+        LineWriterPut(w, "-", 1);
+        LineWriterPutUint(w, (uint64_t)0 - (uint64_t)value);
+    } else {
+        LineWriterPutUint(w, (uint64_t)value);
+    }
+}
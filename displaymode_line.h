@@ -0,0 +1,33 @@
+#ifndef DISPLAYMODE_LINE_H
+#define DISPLAYMODE_LINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Appends to a line without overrunning "size", counting the full length,
+// so that a caller can tell how long a buffer the line needs.
+struct LineWriter {
+    char *out;
+    size_t size;
+    size_t length;
+};
+
+// Appends the "n" bytes at "s".
+void LineWriterPut(struct LineWriter *w, const char *s, size_t n);
+
+// Appends the NUL-terminated "s".
+void LineWriterPutString(struct LineWriter *w, const char *s);
+
+// Appends "value" in decimal.
+void LineWriterPutUint(struct LineWriter *w, uint64_t value);
+void LineWriterPutInt(struct LineWriter *w, int64_t value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
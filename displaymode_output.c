@@ -0,0 +1,114 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "displaymode_output.h"
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Initial capacity; a listing needs roughly 100 bytes per mode.
+#define kOutputBufferInitialCapacity 16384
+
+void OutputBufferInit(struct OutputBuffer *buffer) {
+    memset(buffer, 0, sizeof(*buffer));
+}
+
+void OutputBufferInitArena(struct OutputBuffer *buffer, struct Arena *arena) {
+    memset(buffer, 0, sizeof(*buffer));
+    buffer->arena = arena;
+}
+
+void OutputBufferFree(struct OutputBuffer *buffer) {
+    // Arena memory goes with the arena.
+    if (buffer->arena == NULL) {
+        free(buffer->data);
+    }
+    memset(buffer, 0, sizeof(*buffer));
+}
+
+char *OutputBufferReserve(struct OutputBuffer *buffer, size_t size) {
+    if (buffer->error) {
+        return NULL;
+    }
+    if (buffer->capacity - buffer->length < size) {
+        size_t capacity = buffer->capacity ? buffer->capacity
+                                           : kOutputBufferInitialCapacity;
+        while (capacity - buffer->length < size) {
+            capacity *= 2;
+        }
+        char *data = buffer->arena != NULL
+            ? ArenaRealloc(buffer->arena, buffer->data, buffer->capacity,
+                           capacity)
+            : realloc(buffer->data, capacity);
+        if (data == NULL) {
+            buffer->error = 1;
+            return NULL;
+        }
+        buffer->data = data;
+        buffer->capacity = capacity;
+    }
+    return buffer->data + buffer->length;
+}
+
+void OutputBufferAppend(struct OutputBuffer *buffer, const char *text,
+                        size_t size) {
+    char *p = OutputBufferReserve(buffer, size);
+    if (p != NULL) {
+        memcpy(p, text, size);
+        buffer->length += size;
+    }
+}
+
+void OutputBufferPrintf(struct OutputBuffer *buffer, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    char *p = OutputBufferReserve(buffer, 128);
+    const size_t available = buffer->capacity - buffer->length;
+    int size = p != NULL ? vsnprintf(p, available, format, args) : -1;
+    va_end(args);
+    if (size >= 0 && (size_t)size >= available) {
+        // Didn't fit; retry with enough room.
+        va_start(args, format);
+        p = OutputBufferReserve(buffer, (size_t)size + 1);
+        size = p != NULL ? vsnprintf(p, (size_t)size + 1, format, args) : -1;
+        va_end(args);
+    }
+    if (size < 0) {
+        buffer->error = 1;
+        return;
+    }
+    buffer->length += (size_t)size;
+}
+
+int OutputBufferWrite(struct OutputBuffer *buffer, FILE *out) {
+    int e = buffer->error ? -1 : 0;
+    const char *p = buffer->data;
+    size_t remaining = buffer->error ? 0 : buffer->length;
+    const int fd = fileno(out);
+    if (fd < 0 || remaining < BUFSIZ) {
+        // Not a file, or small enough for the stream's own buffer.
+        if (remaining > 0 && fwrite(p, 1, remaining, out) != remaining) {
+            e = -1;
+        }
+    } else if (fflush(out) == 0) {
+        while (remaining > 0) {
+            const ssize_t written = write(fd, p, remaining);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                e = -1;
+                break;
+            }
+            p += written;
+            remaining -= (size_t)written;
+        }
+    } else {
+        e = -1;
+    }
+    buffer->length = 0;
+    buffer->error = 0;
+    return e;
+}
@@ -0,0 +1,53 @@
+#ifndef DISPLAYMODE_OUTPUT_H
+#define DISPLAYMODE_OUTPUT_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "displaymode_alloc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// A growable buffer that collects a command's whole output so that it can
+// be written with a single write instead of many small stdio calls.  Once
+// an allocation fails, "error" is set and further appends are ignored.
+struct OutputBuffer {
+    char *data;
+    size_t length;
+    size_t capacity;
+    int error;
+    // Where "data" is allocated, or NULL for the heap.
+    struct Arena *arena;
+};
+
+void OutputBufferInit(struct OutputBuffer *buffer);
+
+// Like OutputBufferInit, but grows the buffer in "arena" (which may be NULL)
+// rather than on the heap.
+void OutputBufferInitArena(struct OutputBuffer *buffer, struct Arena *arena);
+
+void OutputBufferFree(struct OutputBuffer *buffer);
+
+// Returns space for at least "size" more bytes at data + length, or NULL.
+// Callers add what they wrote to "length".
+char *OutputBufferReserve(struct OutputBuffer *buffer, size_t size);
+
+void OutputBufferAppend(struct OutputBuffer *buffer, const char *text,
+                        size_t size);
+
+void OutputBufferPrintf(struct OutputBuffer *buffer, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+// Writes the buffer to "out" and empties it.  Streams backed by a file
+// descriptor are flushed and then written with as few write calls as the
+// kernel allows; others (e.g. memory streams) get one fwrite.  Returns 0,
+// or -1 on error.
+int OutputBufferWrite(struct OutputBuffer *buffer, FILE *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DISPLAYMODE_OUTPUT_H
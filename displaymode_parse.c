@@ -2,99 +2,288 @@
 
 #include <errno.h>
 #include <math.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
 
+#include "displaymode_resolutions.h"
+
+// Prefix of the flag naming a server socket to send the command to.
+static const char kSocketFlag[] = "--socket=";
+
+// Prefix of the flag naming the file to write a trace to.
+static const char kTraceFlag[] = "--trace=";
+
+// Prefix of the flag setting how long "w" waits for a burst to end.
+static const char kCoalesceFlag[] = "--coalesce=";
+
+// Prefix of the flag setting how many times "p" cycles through its modes.
+static const char kIterationsFlag[] = "--iterations=";
+
 // Returns non-zero if "actual" is acceptable for the given specification.
 int MatchesRefreshRate(double specified, double actual) {
-    static const double kRefreshTolerance = 0.005;
-    return specified == 0.0 || fabs(specified - actual) < kRefreshTolerance;
+    return specified == 0.0 || fabs(specified - actual) < kRefreshRateTolerance;
 }
 
-// Parses the "width height [display]" mode specification.
-static void ParseModeInternal(const int argc, const char * argv[],
-                              struct ParsedArgs * parsed_args) {
-    if (argc <= kArgvHeightIndex) {
-        parsed_args->option = kOptionInvalidMode;
-        return;
+// Parses the unsigned decimal "s" (all of it) into *value.  Returns 0, or
+// -1 if it's invalid or above "max".
+static int ParseUint32(const char *s, uint32_t max, uint32_t *value) {
+    errno = 0;
+    char *end = NULL;
+    const unsigned long parsed = strtoul(s, &end, 10);
+    if (end == s || *end != '\0' || errno != 0 || s[0] == '-' || parsed > max) {
+        errno = 0;
+        return -1;
     }
+    *value = (uint32_t)parsed;
+    return 0;
+}
 
-    // Parse width.
+// Parses the refresh rate "s" (in Hz, all of it) into millihertz.  Returns
+// 0, or -1 if it's invalid.
+static int ParseMillihertz(const char *s, uint32_t *value) {
     errno = 0;
-    char *endptr = NULL;
-    const unsigned long width =
-        strtoul(argv[kArgvWidthIndex], &endptr, 10);
-    if (endptr == argv[kArgvWidthIndex] || errno != 0) {
-        parsed_args->option = kOptionInvalidMode;
+    char *end = NULL;
+    const double parsed = strtod(s, &end);
+    if (end == s || *end != '\0' || errno != 0 || !(parsed >= 0.0) ||
+        parsed >= UINT32_MAX / 1000.0) {
         errno = 0;
-        return;
+        return -1;
     }
+    *value = (uint32_t)lround(parsed * 1000.0);
+    return 0;
+}
 
-    // Parse height.
-    errno = 0;
-    endptr = NULL;
-    const unsigned long height =
-        strtoul(argv[kArgvHeightIndex], &endptr, 10);
-    if (endptr == argv[kArgvHeightIndex] || errno != 0) {
-        parsed_args->option = kOptionInvalidMode;
+// Parses "arg" if it's one of the filter flags of "d".  Returns 1 if it
+// was, 0 if it isn't a filter flag, or -1 if its value is invalid.
+static int ParseFilterFlag(const char *arg, struct ModeFilter *filter) {
+    static const struct {
+        const char *prefix;
+        size_t offset;
+    } kBounds[] = {
+        {"--min-width=", offsetof(struct ModeFilter, min_width)},
+        {"--max-width=", offsetof(struct ModeFilter, max_width)},
+        {"--min-height=", offsetof(struct ModeFilter, min_height)},
+        {"--max-height=", offsetof(struct ModeFilter, max_height)},
+    };
+    for (size_t i = 0; i < sizeof(kBounds) / sizeof(kBounds[0]); ++i) {
+        const size_t length = strlen(kBounds[i].prefix);
+        if (strncmp(arg, kBounds[i].prefix, length) == 0) {
+            filter->active = 1;
+            return ParseUint32(arg + length, UINT32_MAX,
+                               (uint32_t *)((char *)filter + kBounds[i].offset))
+                   ? -1 : 1;
+        }
+    }
+    if (strncmp(arg, "--min-refresh=", 14) == 0) {
+        filter->active = 1;
+        return ParseMillihertz(arg + 14, &filter->min_refresh_mhz) ? -1 : 1;
+    }
+    if (strncmp(arg, "--max-refresh=", 14) == 0) {
+        filter->active = 1;
+        return ParseMillihertz(arg + 14, &filter->max_refresh_mhz) ? -1 : 1;
+    }
+    if (strncmp(arg, "--aspect=", 9) == 0) {
+        filter->active = 1;
+        char w[16];
+        const char *colon = strchr(arg + 9, ':');
+        const size_t length = colon ? (size_t)(colon - (arg + 9)) : 0;
+        if (length == 0 || length >= sizeof(w)) {
+            return -1;
+        }
+        memcpy(w, arg + 9, length);
+        w[length] = '\0';
+        if (ParseUint32(w, 0xffff, &filter->aspect_w) ||
+            ParseUint32(colon + 1, 0xffff, &filter->aspect_h) ||
+            filter->aspect_w == 0 || filter->aspect_h == 0) {
+            return -1;
+        }
+        return 1;
+    }
+    if (strcmp(arg, "--usable") == 0) {
+        filter->active = 1;
+        filter->usable_only = 1;
+        return 1;
+    }
+    if (strcmp(arg, "--hidpi") == 0) {
+        filter->active = 1;
+        filter->hidpi_only = 1;
+        return 1;
+    }
+    return 0;
+}
+
+// Parses one "width height [@refresh] [display]" specification starting at
+// argv[*next], where "width height" may instead be the name of a standard
+// resolution (like "4K"), advancing *next past it and setting *has_display
+// if the display index was given.  Returns 0, or -1 if it's invalid.
+static int ParseModeSpec(const int argc, const char * argv[], int *next,
+                         struct ModeSpec *spec, int *has_display) {
+    int i = *next;
+    unsigned long width;
+    unsigned long height;
+    // Names are checked first: strtoul would read "1440p" as 1440.
+    const struct StandardResolution *standard =
+        StandardResolutionLookup(argv[i], strlen(argv[i]));
+    if (standard != NULL) {
+        width = standard->width;
+        height = standard->height;
+        ++i;
+    } else {
+        if (i + 1 >= argc) {
+            return -1;
+        }
+
+        // Parse width.
         errno = 0;
-        return;
+        char *endptr = NULL;
+        width = strtoul(argv[i], &endptr, 10);
+        if (endptr == argv[i] || errno != 0) {
+            errno = 0;
+            return -1;
+        }
+        ++i;
+
+        // Parse height.
+        errno = 0;
+        endptr = NULL;
+        height = strtoul(argv[i], &endptr, 10);
+        if (endptr == argv[i] || errno != 0) {
+            errno = 0;
+            return -1;
+        }
+        ++i;
     }
 
-    size_t next_index = kArgvRefreshOrDisplayIndex;
-    parsed_args->refresh_rate = 0.0;
+    spec->refresh_rate = 0.0;
 
     // Optional refresh rate in form "@<value>"
-    if (next_index < (size_t)argc && argv[next_index][0] == '@') {
-        const char *s = argv[next_index] + 1;
+    if (i < argc && argv[i][0] == '@') {
+        const char *s = argv[i] + 1;
         char *end = NULL;
         errno = 0;
         const double refresh = strtod(s, &end);
         if (end == s || errno != 0 || refresh < 0.0) {
-            parsed_args->option = kOptionInvalidMode;
             errno = 0;
-            return;
+            return -1;
         }
-        parsed_args->refresh_rate = refresh;
-        ++next_index;
+        spec->refresh_rate = refresh;
+        ++i;
     }
 
-    // Optional display index
-    if (next_index < (size_t)argc) {
+    // Optional display index, or name
+    spec->display_index = 0;
+    spec->display_name = NULL;
+    *has_display = i < argc;
+    if (i < argc && argv[i][strspn(argv[i], "0123456789")] != '\0') {
+        spec->display_name = argv[i];
+        ++i;
+    } else if (i < argc) {
         errno = 0;
         char *end = NULL;
-        unsigned long di = strtoul(argv[next_index], &end, 10);
-        if (end == argv[next_index] || errno != 0 || di > UINT32_MAX) {
-            parsed_args->option = kOptionInvalidMode;
+        unsigned long di = strtoul(argv[i], &end, 10);
+        if (end == argv[i] || errno != 0 || di > UINT32_MAX) {
             errno = 0;
-            return;
+            return -1;
         }
-        parsed_args->display_index = (uint32_t)di;
-    } else {
-        parsed_args->display_index = 0;
+        spec->display_index = (uint32_t)di;
+        ++i;
     }
 
     if (width == 0 || height == 0) {
+        return -1;
+    }
+
+    spec->width = width;
+    spec->height = height;
+    *next = i;
+    return 0;
+}
+
+// Parses the mode specifications of "t".  Each one ends at its display
+// index, which may only be left out when there is a single specification.
+static void ParseModeInternal(const int argc, const char * argv[],
+                              struct ParsedArgs * parsed_args) {
+    int next = kArgvWidthIndex;
+    while (next < argc) {
+        int has_display = 0;
+        if (parsed_args->num_specs == kMaxModeSpecs ||
+            ParseModeSpec(argc, argv, &next,
+                          &parsed_args->specs[parsed_args->num_specs],
+                          &has_display)) {
+            parsed_args->option = kOptionInvalidMode;
+            return;
+        }
+        ++parsed_args->num_specs;
+        // A specification without a display index must be the only one.
+        if (!has_display && (next < argc || parsed_args->num_specs > 1)) {
+            parsed_args->option = kOptionInvalidMode;
+            return;
+        }
+    }
+    if (parsed_args->num_specs == 0) {
         parsed_args->option = kOptionInvalidMode;
         return;
     }
 
-    parsed_args->width = width;
-    parsed_args->height = height;
+    parsed_args->width = parsed_args->specs[0].width;
+    parsed_args->height = parsed_args->specs[0].height;
+    parsed_args->refresh_rate = parsed_args->specs[0].refresh_rate;
+    parsed_args->display_index = parsed_args->specs[0].display_index;
+}
+
+// "p" switches between modes, so it needs at least two.
+static void CheckProfileSpecs(struct ParsedArgs *parsed_args) {
+    if (parsed_args->option == kOptionProfile && parsed_args->num_specs < 2) {
+        parsed_args->option = kOptionInvalidMode;
+    }
+}
+
+// "n" lists the displays' names; "n <display> <name>" names a display.
+static void ParseName(const int argc, const char * argv[],
+                      struct ParsedArgs * parsed_args) {
+    if (argc == kArgvOptionIndex + 3) {
+        parsed_args->display_name = argv[kArgvOptionIndex + 1];
+        parsed_args->name = argv[kArgvOptionIndex + 2];
+    } else if (argc != kArgvOptionIndex + 1) {
+        parsed_args->option = kOptionInvalidMode;
+    }
+}
+
+// Sets every field of "parsed_args" to its default.
+static void InitParsedArgs(struct ParsedArgs *parsed_args) {
+    parsed_args->option = kOptionMissing;
+    parsed_args->literal_option = NULL;
+    parsed_args->width = 0;
+    parsed_args->height = 0;
+    parsed_args->refresh_rate = 0.0;
+    parsed_args->display_index = 0;
+    parsed_args->num_specs = 0;
+    parsed_args->verbose = 0;
+    parsed_args->socket_path = NULL;
+    parsed_args->no_cache = 0;
+    parsed_args->output_format = kOutputText;
+    parsed_args->quiet = 0;
+    parsed_args->trace_path = NULL;
+    parsed_args->coalesce_ms = -1;
+    parsed_args->input_path = NULL;
+    parsed_args->iterations = kDefaultProfileIterations;
+    parsed_args->stats = 0;
+    parsed_args->grouped = 0;
+    parsed_args->display_name = NULL;
+    parsed_args->name = NULL;
+    memset(&parsed_args->filter, 0, sizeof(parsed_args->filter));
+    parsed_args->filter.max_width = UINT32_MAX;
+    parsed_args->filter.max_height = UINT32_MAX;
+    parsed_args->filter.max_refresh_mhz = UINT32_MAX;
 }
 
 // Parses the command-line arguments and returns them.
 struct ParsedArgs ParseArgs(int argc, const char * argv[]) {
     struct ParsedArgs parsed_args;
-    parsed_args.option = kOptionMissing;
-    parsed_args.literal_option = NULL;
-    parsed_args.width = 0;
-    parsed_args.height = 0;
-    parsed_args.refresh_rate = 0.0;
-    parsed_args.display_index = 0;
-    parsed_args.verbose = 0;
+    InitParsedArgs(&parsed_args);
 
     if (argc <= 1) {
         return parsed_args;
@@ -103,6 +292,7 @@ struct ParsedArgs ParseArgs(int argc, const char * argv[]) {
     // Check for long options (flags) and build filtered positional args
     const char *positional[argc];
     int pos_count = 0;
+    const char *invalid_flag = NULL;
     for (int i = 0; i < argc; ++i) {
         if (argv[i] == NULL) continue;
         if (strcmp(argv[i], "--help") == 0) {
@@ -117,6 +307,82 @@ struct ParsedArgs ParseArgs(int argc, const char * argv[]) {
             parsed_args.verbose = 1;
             continue;
         }
+        if (strcmp(argv[i], "--no-cache") == 0) {
+            parsed_args.no_cache = 1;
+            continue;
+        }
+        if (strcmp(argv[i], "--quiet") == 0) {
+            parsed_args.quiet = 1;
+            continue;
+        }
+        if (strcmp(argv[i], "--stats") == 0) {
+            parsed_args.stats = 1;
+            continue;
+        }
+        if (strcmp(argv[i], "--grouped") == 0) {
+            parsed_args.grouped = 1;
+            continue;
+        }
+        if (strcmp(argv[i], "--json") == 0) {
+            parsed_args.output_format = kOutputJson;
+            continue;
+        }
+        if (strcmp(argv[i], "--ndjson") == 0) {
+            parsed_args.output_format = kOutputNdjson;
+            continue;
+        }
+        if (strcmp(argv[i], "--csv") == 0) {
+            parsed_args.output_format = kOutputCsv;
+            continue;
+        }
+        if (strcmp(argv[i], "--tsv") == 0) {
+            parsed_args.output_format = kOutputTsv;
+            continue;
+        }
+        if (strcmp(argv[i], "--cbor") == 0) {
+            parsed_args.output_format = kOutputCbor;
+            continue;
+        }
+        if (strncmp(argv[i], kSocketFlag, sizeof(kSocketFlag) - 1) == 0) {
+            parsed_args.socket_path = argv[i] + sizeof(kSocketFlag) - 1;
+            continue;
+        }
+        if (strncmp(argv[i], kTraceFlag, sizeof(kTraceFlag) - 1) == 0) {
+            parsed_args.trace_path = argv[i] + sizeof(kTraceFlag) - 1;
+            continue;
+        }
+        if (strncmp(argv[i], kCoalesceFlag, sizeof(kCoalesceFlag) - 1) == 0) {
+            uint32_t coalesce_ms;
+            if (ParseUint32(argv[i] + sizeof(kCoalesceFlag) - 1, 60000,
+                            &coalesce_ms)) {
+                if (invalid_flag == NULL) {
+                    invalid_flag = argv[i];
+                }
+            } else {
+                parsed_args.coalesce_ms = (int)coalesce_ms;
+            }
+            continue;
+        }
+        if (strncmp(argv[i], kIterationsFlag, sizeof(kIterationsFlag) - 1) == 0) {
+            uint32_t iterations;
+            if (ParseUint32(argv[i] + sizeof(kIterationsFlag) - 1,
+                            kMaxProfileIterations, &iterations) ||
+                iterations == 0) {
+                if (invalid_flag == NULL) {
+                    invalid_flag = argv[i];
+                }
+            } else {
+                parsed_args.iterations = iterations;
+            }
+            continue;
+        }
+        const int filter_flag = ParseFilterFlag(argv[i], &parsed_args.filter);
+        if (filter_flag != 0) {
+            if (filter_flag < 0 && invalid_flag == NULL) {
+                invalid_flag = argv[i];
+            }
+            continue;
+        }
         positional[pos_count++] = argv[i];
     }
 
@@ -131,19 +397,266 @@ struct ParsedArgs ParseArgs(int argc, const char * argv[]) {
             case kOptionHelp:
                 parsed_args.option = kOptionHelp;
                 break;
+            case kOptionLayout:
+                parsed_args.option = kOptionLayout;
+                if (pos_count == kArgvOptionIndex + 2) {
+                    parsed_args.name = positional[kArgvOptionIndex + 1];
+                } else if (pos_count > kArgvOptionIndex + 2) {
+                    parsed_args.option = kOptionInvalidMode;
+                }
+                break;
+            case kOptionName:
+                parsed_args.option = kOptionName;
+                break;
             case kOptionConfigureMode:
                 parsed_args.option = kOptionConfigureMode;
                 break;
+            case kOptionServer:
+                parsed_args.option = kOptionServer;
+                if (pos_count > kArgvOptionIndex + 1) {
+                    parsed_args.socket_path = positional[kArgvOptionIndex + 1];
+                }
+                break;
+            case kOptionProfile:
+                parsed_args.option = kOptionProfile;
+                break;
             case kOptionVersion:
                 parsed_args.option = kOptionVersion;
                 break;
+            case kOptionWatch:
+                parsed_args.option = kOptionWatch;
+                break;
+            case kOptionBatch:
+                parsed_args.option = kOptionBatch;
+                if (pos_count > kArgvOptionIndex + 1) {
+                    parsed_args.input_path = positional[kArgvOptionIndex + 1];
+                }
+                break;
             default:
                 // Leave parsed_args.option as kOptionMissing (0) to match original behavior.
                 break;
         }
-        if (option == kOptionConfigureMode) {
+        if (option == kOptionConfigureMode || option == kOptionProfile) {
             ParseModeInternal(pos_count, positional, &parsed_args);
+            CheckProfileSpecs(&parsed_args);
+        }
+        if (option == kOptionName) {
+            ParseName(pos_count, positional, &parsed_args);
         }
     }
+    // Groups are listed as text or JSON only.
+    if (parsed_args.grouped && parsed_args.output_format >= kOutputCsv &&
+        invalid_flag == NULL) {
+        invalid_flag = "--grouped";
+    }
+    if (invalid_flag != NULL) {
+        parsed_args.option = kOptionInvalid;
+        parsed_args.literal_option = invalid_flag;
+    }
     return parsed_args;
 }
+
+// Parsing of single command lines for batch mode.  The line is scanned once,
+// token by token, in place: nothing is copied or allocated, and numbers are
+// accumulated digit by digit instead of with strtoul.
+
+// Most digits accepted in a number; longer ones (and anything else unusual)
+// are left to ParseArgs, so that both parsers agree on every line.
+#define kMaxFastDigits 9
+
+// Most digits in a refresh rate parsed without strtod: 10^15 < 2^53, so
+// they make an exact double.
+#define kMaxExactDigits 15
+
+static int IsSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+// Moves *token past the next token of [*cursor, end), setting *token_end.
+// Returns 0 if there is no token left.
+static int NextToken(const char **cursor, const char *end, const char **token,
+                     const char **token_end) {
+    const char *p = *cursor;
+    while (p < end && IsSpace(*p)) {
+        ++p;
+    }
+    if (p == end) {
+        *cursor = p;
+        return 0;
+    }
+    *token = p;
+    while (p < end && !IsSpace(*p)) {
+        ++p;
+    }
+    *token_end = p;
+    *cursor = p;
+    return 1;
+}
+
+// Parses the digits [s, end) into *value.  Returns 0, or -1 unless they are
+// 1 to kMaxFastDigits decimal digits.
+static int ScanDigits(const char *s, const char *end, uint64_t *value) {
+    if (s == end || end - s > kMaxFastDigits) {
+        return -1;
+    }
+    uint64_t parsed = 0;
+    for (; s < end; ++s) {
+        const unsigned digit = (unsigned)(*s - '0');
+        if (digit > 9) {
+            return -1;
+        }
+        parsed = parsed * 10 + digit;
+    }
+    *value = parsed;
+    return 0;
+}
+
+// Parses "<digits>[.<digits>]" into *value, exactly as strtod would: with
+// at most kMaxExactDigits digits the digits without the point are an exact
+// double, as is the power of ten, so one division rounds correctly.
+// Returns 0, or -1 for anything else, longer rates included.
+static int ScanRefreshRate(const char *s, const char *end, double *value) {
+    static const double kPowersOfTen[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,
+    };
+    static const uint64_t kIntegerPowersOfTen[] = {
+        1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000,
+        1000000000,
+    };
+    const char *dot = s;
+    while (dot < end && *dot != '.') {
+        ++dot;
+    }
+    uint64_t integral = 0;
+    uint64_t fraction = 0;
+    const ptrdiff_t fraction_digits = dot < end ? end - dot - 1 : 0;
+    if ((dot - s) + fraction_digits > kMaxExactDigits ||
+        (dot == s && fraction_digits == 0) ||
+        (dot > s && ScanDigits(s, dot, &integral)) ||
+        (fraction_digits > 0 && ScanDigits(dot + 1, end, &fraction))) {
+        return -1;
+    }
+    const uint64_t digits =
+        integral * kIntegerPowersOfTen[fraction_digits] + fraction;
+    *value = (double)digits / kPowersOfTen[fraction_digits];
+    return 0;
+}
+
+// Parses the "t" specifications in [cursor, end) like ParseModeInternal.
+// Returns 0, or 1 if a number needs ParseArgs.
+static int ScanModeSpecs(const char *cursor, const char *end,
+                         struct ParsedArgs *parsed_args) {
+    const char *token;
+    const char *token_end;
+    int have_token = NextToken(&cursor, end, &token, &token_end);
+    while (have_token) {
+        if (parsed_args->num_specs == kMaxModeSpecs) {
+            parsed_args->option = kOptionInvalidMode;
+            return 0;
+        }
+        struct ModeSpec *spec = &parsed_args->specs[parsed_args->num_specs];
+        uint64_t width;
+        uint64_t height;
+        if (ScanDigits(token, token_end, &width)) {
+            const struct StandardResolution *standard =
+                StandardResolutionLookup(token, (size_t)(token_end - token));
+            if (standard == NULL) {
+                return 1;
+            }
+            width = standard->width;
+            height = standard->height;
+        } else {
+            if (!NextToken(&cursor, end, &token, &token_end)) {
+                parsed_args->option = kOptionInvalidMode;
+                return 0;
+            }
+            if (ScanDigits(token, token_end, &height)) {
+                return 1;
+            }
+        }
+        spec->refresh_rate = 0.0;
+        have_token = NextToken(&cursor, end, &token, &token_end);
+        if (have_token && *token == '@') {
+            if (ScanRefreshRate(token + 1, token_end, &spec->refresh_rate)) {
+                return 1;
+            }
+            have_token = NextToken(&cursor, end, &token, &token_end);
+        }
+        spec->display_index = 0;
+        spec->display_name = NULL;
+        const int has_display = have_token;
+        if (has_display) {
+            uint64_t display_index;
+            if (ScanDigits(token, token_end, &display_index)) {
+                return 1;
+            }
+            spec->display_index = (uint32_t)display_index;
+            have_token = NextToken(&cursor, end, &token, &token_end);
+        }
+        if (width == 0 || height == 0) {
+            parsed_args->option = kOptionInvalidMode;
+            return 0;
+        }
+        spec->width = width;
+        spec->height = height;
+        ++parsed_args->num_specs;
+        // A specification without a display index must be the only one.
+        if (!has_display && parsed_args->num_specs > 1) {
+            parsed_args->option = kOptionInvalidMode;
+            return 0;
+        }
+    }
+    if (parsed_args->num_specs == 0) {
+        parsed_args->option = kOptionInvalidMode;
+        return 0;
+    }
+    parsed_args->width = parsed_args->specs[0].width;
+    parsed_args->height = parsed_args->specs[0].height;
+    parsed_args->refresh_rate = parsed_args->specs[0].refresh_rate;
+    parsed_args->display_index = parsed_args->specs[0].display_index;
+    return 0;
+}
+
+int ParseCommandLine(const char *line, size_t length,
+                     struct ParsedArgs *parsed_args) {
+    InitParsedArgs(parsed_args);
+    const char *cursor = line;
+    const char *end = line + length;
+    const char *token;
+    const char *token_end;
+    // Flags may appear anywhere; leave lines with any to ParseArgs.
+    for (const char *p = line; p + 1 < end; ++p) {
+        if (p[0] == '-' && p[1] == '-' && (p == line || IsSpace(p[-1]))) {
+            return 1;
+        }
+    }
+    if (!NextToken(&cursor, end, &token, &token_end) ||
+        token_end - token != 1) {
+        // ParseArgs ignores options that aren't a single letter.
+        return 0;
+    }
+    switch (*token) {
+        case kOptionSupportedModes:
+        case kOptionHelp:
+        case kOptionVersion:
+        case kOptionWatch:
+            parsed_args->option = (enum Option)*token;
+            return 0;
+        case kOptionConfigureMode:
+        case kOptionProfile: {
+            parsed_args->option = (enum Option)*token;
+            const int deferred = ScanModeSpecs(cursor, end, parsed_args);
+            CheckProfileSpecs(parsed_args);
+            return deferred;
+        }
+        case kOptionServer:
+        case kOptionBatch:
+        case kOptionName:
+        case kOptionLayout:
+            // These take a path or a name, which would have to be
+            // NUL-terminated.
+            return 1;
+        default:
+            return 0;
+    }
+}
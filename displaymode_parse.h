@@ -2,6 +2,7 @@
 #ifndef DISPLAYMODE_PARSE_H
 #define DISPLAYMODE_PARSE_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 #ifdef __cplusplus
@@ -16,10 +17,16 @@ enum Option {
     kOptionMissing = 0,
     kOptionInvalid = 1,
     kOptionInvalidMode = 2,
+    kOptionBatch = '-',
     kOptionSupportedModes = 'd',
     kOptionHelp = 'h',
+    kOptionLayout = 'l',
+    kOptionName = 'n',
+    kOptionProfile = 'p',
+    kOptionServer = 's',
     kOptionConfigureMode = 't',
     kOptionVersion = 'v',
+    kOptionWatch = 'w',
     kOptionLongHelp,      // --help
     kOptionLongVersion,   // --version
     kOptionLongVerbose,   // --verbose
@@ -33,6 +40,45 @@ enum {
     kArgvRefreshOrDisplayIndex = 4,
 };
 
+// How "d" prints the modes.
+enum OutputFormat {
+    kOutputText = 0,
+    kOutputJson,    // --json: one document with every display
+    kOutputNdjson,  // --ndjson: one JSON object per mode and line
+    kOutputCsv,     // --csv: a header, then one row per mode
+    kOutputTsv,     // --tsv: as --csv, separated by tabs
+    kOutputCbor,    // --cbor: one binary CBOR document with every display
+};
+
+// Maximum number of mode specifications accepted by "t".
+#define kMaxModeSpecs 16
+
+// One "<width> <height> [@<refresh>] [display]" specification of "t", where
+// "<width> <height>" may be a standard resolution's name, like "4K", and the
+// display an index, or a name or identity (see displaymode_ids.h).
+struct ModeSpec {
+    unsigned long width;
+    unsigned long height;
+    double refresh_rate;  // 0.0 for any
+    uint32_t display_index;
+    // The display's name or identity, which display_index is resolved from,
+    // or NULL.  Points into the parsed arguments.
+    const char *display_name;
+};
+
+// Restricts the modes "d" lists.  Bounds are inclusive.
+struct ModeFilter {
+    int active;  // non-zero if any restriction is set
+    uint32_t min_width, max_width;
+    uint32_t min_height, max_height;
+    // Refresh rates in millihertz.
+    uint32_t min_refresh_mhz, max_refresh_mhz;
+    // Aspect ratio, e.g. 16:9 (not necessarily in lowest terms); 0:0 for any.
+    uint32_t aspect_w, aspect_h;
+    int usable_only;
+    int hidpi_only;
+};
+
 // Parsed command-line arguments
 struct ParsedArgs {
     enum Option option;
@@ -41,9 +87,37 @@ struct ParsedArgs {
     unsigned long height;
     double refresh_rate;  // 0.0 for any
     uint32_t display_index;
+    // Every specification given to "t"; the fields above mirror specs[0].
+    struct ModeSpec specs[kMaxModeSpecs];
+    size_t num_specs;
     int verbose; // 0 = false, 1 = true
+    const char * socket_path;  // NULL unless given with "s" or --socket
+    int no_cache;  // non-zero to bypass the mode cache (--no-cache)
+    enum OutputFormat output_format;
+    int quiet;  // non-zero to log only errors (--quiet)
+    const char * trace_path;  // NULL unless given with --trace
+    struct ModeFilter filter;  // --min-width=... and friends, for "d"
+    int coalesce_ms;  // --coalesce=<ms> for "w", or -1 for the default
+    const char * input_path;  // file of commands for "-", or NULL for stdin
+    uint32_t iterations;  // --iterations=<n>: times "p" cycles through modes
+    int stats;  // non-zero to report allocations per phase (--stats)
+    int grouped;  // non-zero for "d" to list one line per resolution (--grouped)
+    // For "n <display> <name>", the name to give the display in
+    // "display_name" (an index, name or identity); both NULL for "n" alone.
+    // For "l <layout>", the layout in "name", or NULL for "l" alone.
+    const char * display_name;
+    const char * name;
 };
 
+// Times "p" cycles through its modes unless --iterations is given.
+#define kDefaultProfileIterations 10
+
+// Most --iterations accepted.
+#define kMaxProfileIterations 100000
+
+// Refresh rates closer than this to the specified rate are accepted (Hz).
+#define kRefreshRateTolerance 0.005
+
 // Returns non-zero if "actual" is acceptable for the given specification.
 int MatchesRefreshRate(double specified, double actual);
 
@@ -51,6 +125,14 @@ int MatchesRefreshRate(double specified, double actual);
 // Handles both legacy single-letter options and long flags (e.g., --help).
 struct ParsedArgs ParseArgs(int argc, const char * argv[]);
 
+// Parses one command line such as "t 1920 1080 @60 1" (options only, without
+// the program name) into *parsed_args, as ParseArgs would parse its words,
+// without allocating or copying.  "line" need not be NUL-terminated.  Returns
+// 0, or 1 if the line has flags or numbers that only ParseArgs handles; the
+// caller must then split the line and call ParseArgs.
+int ParseCommandLine(const char *line, size_t length,
+                     struct ParsedArgs *parsed_args);
+
 #ifdef __cplusplus
 }
 #endif
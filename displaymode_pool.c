@@ -0,0 +1,52 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "displaymode_pool.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+// Most threads one WorkerPoolRun starts.
+#define kMaxWorkers 64
+
+struct WorkerPool {
+    void (*task)(void *context, size_t index);
+    void *context;
+    size_t num_tasks;
+    atomic_size_t next_task;
+};
+
+// Runs tasks until there are none left.
+static void *Work(void *arg) {
+    struct WorkerPool *pool = arg;
+    for (;;) {
+        const size_t index = atomic_fetch_add(&pool->next_task, 1);
+        if (index >= pool->num_tasks) {
+            return NULL;
+        }
+        pool->task(pool->context, index);
+    }
+}
+
+void WorkerPoolRun(size_t num_tasks, unsigned max_threads,
+                   void (*task)(void *context, size_t index), void *context) {
+    struct WorkerPool pool = {task, context, num_tasks, 0};
+    size_t num_workers = max_threads > 1 ? max_threads - 1 : 0;
+    if (num_workers > kMaxWorkers) {
+        num_workers = kMaxWorkers;
+    }
+    if (num_workers >= num_tasks) {
+        num_workers = num_tasks > 0 ? num_tasks - 1 : 0;
+    }
+
+    pthread_t workers[kMaxWorkers];
+    size_t started = 0;
+    for (; started < num_workers; ++started) {
+        if (pthread_create(&workers[started], NULL, Work, &pool) != 0) {
+            break;
+        }
+    }
+    Work(&pool);
+    for (size_t i = 0; i < started; ++i) {
+        pthread_join(workers[i], NULL);
+    }
+}
@@ -0,0 +1,21 @@
+#ifndef DISPLAYMODE_POOL_H
+#define DISPLAYMODE_POOL_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Calls task(context, i) for every i below "num_tasks", on up to
+// "max_threads" threads (the caller's included), and returns when all calls
+// have returned.  Tasks are handed out in index order.  If threads can't be
+// started, the remaining tasks run on the calling thread.
+void WorkerPoolRun(size_t num_tasks, unsigned max_threads,
+                   void (*task)(void *context, size_t index), void *context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DISPLAYMODE_POOL_H
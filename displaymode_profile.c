@@ -0,0 +1,299 @@
+#include "displaymode_profile.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "displaymode_json.h"
+#include "displaymode_trace.h"
+
+const char *const kProfilePhaseNames[kProfileNumPhases] = {
+    "begin", "configure", "complete", "readback", "total",
+};
+
+static uint64_t MonotonicNow(void *context) {
+    (void)context;
+    return TraceNow();
+}
+
+static const struct ProfileClock kMonotonicClock = {NULL, MonotonicNow};
+
+static int CompareDurations(const void *a, const void *b) {
+    const uint64_t x = *(const uint64_t *)a;
+    const uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Index of the nearest-rank percentile "permille" / 10 of "count" sorted
+// samples.
+static size_t Rank(size_t permille, size_t count) {
+    return (permille * count + 999) / 1000 - 1;
+}
+
+void ProfileStatsCompute(uint64_t *samples, size_t count,
+                         struct ProfileStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    if (count == 0) {
+        return;
+    }
+    qsort(samples, count, sizeof(*samples), CompareDurations);
+    stats->count = count;
+    stats->min_ns = samples[0];
+    stats->p50_ns = samples[Rank(500, count)];
+    stats->p99_ns = samples[Rank(990, count)];
+    stats->max_ns = samples[count - 1];
+}
+
+// A display being switched, and the mode it is switched back to.
+struct ProfiledDisplay {
+    uint32_t index;
+    size_t original;
+};
+
+// Reads the display's current mode until it is "expected".  Returns 0, or
+// -1 if it still isn't after kProfileMaxReadbacks reads.
+static int WaitForMode(const struct DisplayBackend *backend, uint32_t id,
+                       const struct DisplayMode *expected) {
+    for (int i = 0; i < kProfileMaxReadbacks; ++i) {
+        struct DisplayModeList list;
+        const int e =
+            backend->copy_current_mode != NULL
+                ? backend->copy_current_mode(backend->context, id, &list)
+                : backend->copy_modes(backend->context, id, &list);
+        const int matched =
+            e == 0 && list.has_current && DisplayModesEqual(&list.current,
+                                                            expected);
+        backend->release_modes(backend->context, &list);
+        if (matched) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Switches every display in "displays" back to its original mode in one
+// transaction.  Returns 0 or the backend's error.
+static int RestoreModes(struct DisplayCatalog *catalog,
+                        const struct ProfiledDisplay *displays,
+                        size_t num_displays, FILE *err) {
+    const struct DisplayBackend *backend = catalog->backend;
+    void *config = NULL;
+    int e = backend->begin_configuration(backend->context, &config);
+    for (size_t i = 0; i < num_displays && e == 0; ++i) {
+        const uint32_t index = displays[i].index;
+        e = backend->configure_display(
+            backend->context, config, catalog->displays[index],
+            &catalog->modes[index].modes[displays[i].original]);
+        if (e) {
+            backend->cancel_configuration(backend->context, config);
+        }
+    }
+    if (e == 0) {
+        e = backend->complete_configuration(backend->context, config);
+    }
+    if (e) {
+        fprintf(err, "Could not restore the original modes, CGError: %d\n", e);
+        return e;
+    }
+    for (size_t i = 0; i < num_displays; ++i) {
+        DisplayCatalogSetCurrentMode(catalog, displays[i].index,
+                                     displays[i].original);
+    }
+    return 0;
+}
+
+// Finds the mode of "spec" (with a backend handle) and records its display
+// in "displays" if it isn't there yet.  Returns 0 and sets *matched, or a
+// non-zero error.
+static int ResolveSpec(struct DisplayCatalog *catalog,
+                       const struct ModeSpec *spec, ptrdiff_t *matched,
+                       struct ProfiledDisplay *displays, size_t *num_displays,
+                       FILE *err) {
+    const uint32_t index = spec->display_index;
+    if (catalog->num_displays <= index) {
+        fprintf(err, "Display %u not supported; display must be < %u\n",
+                index, catalog->num_displays);
+        return kDisplayErrorRangeCheck;
+    }
+    const struct DisplayModeList *list = NULL;
+    const int e = DisplayCatalogGetLiveModes(catalog, index, &list);
+    if (e) {
+        fprintf(err, "Failed to get display modes\n");
+        return e;
+    }
+    *matched = DisplayCatalogFindMode(catalog, index, spec->width,
+                                      spec->height, spec->refresh_rate);
+    if (*matched < 0) {
+        if (spec->refresh_rate == 0.0) {
+            fprintf(err, "Could not find a mode for resolution %lux%lu\n",
+                    spec->width, spec->height);
+        } else {
+            fprintf(err, "Could not find a mode for resolution %lux%lu @%.1f\n",
+                    spec->width, spec->height, spec->refresh_rate);
+        }
+        return -1;
+    }
+    for (size_t i = 0; i < *num_displays; ++i) {
+        if (displays[i].index == index) {
+            return 0;
+        }
+    }
+    if (list->current_index < 0) {
+        fprintf(err, "Display %u's current mode is not listed, so it could "
+                "not be restored\n", index);
+        return -1;
+    }
+    displays[*num_displays].index = index;
+    displays[*num_displays].original = (size_t)list->current_index;
+    ++*num_displays;
+    return 0;
+}
+
+// Switches the display at "index" to modes[mode_index] and stores the time
+// at the start and at the end of each phase in times[0..4].  Returns 0, or
+// a non-zero error.
+static int TimeSwitch(struct DisplayCatalog *catalog, uint32_t index,
+                      size_t mode_index, const struct ProfileClock *clock,
+                      uint64_t times[kProfileNumPhases], FILE *err) {
+    const struct DisplayBackend *backend = catalog->backend;
+    const uint32_t id = catalog->displays[index];
+    const struct DisplayMode *mode = &catalog->modes[index].modes[mode_index];
+    void *config = NULL;
+    times[0] = clock->now_ns(clock->context);
+    int e = backend->begin_configuration(backend->context, &config);
+    times[1] = clock->now_ns(clock->context);
+    if (e) {
+        fprintf(err, "CGBeginDisplayConfiguration CGError: %d\n", e);
+        return e;
+    }
+    e = backend->configure_display(backend->context, config, id, mode);
+    times[2] = clock->now_ns(clock->context);
+    if (e) {
+        backend->cancel_configuration(backend->context, config);
+        fprintf(err, "CGConfigureDisplayWithDisplayMode CGError: %d\n", e);
+        return e;
+    }
+    e = backend->complete_configuration(backend->context, config);
+    times[3] = clock->now_ns(clock->context);
+    if (e) {
+        fprintf(err, "CGCompleteDisplayConfiguration CGError: %d\n", e);
+        return e;
+    }
+    DisplayCatalogSetCurrentMode(catalog, index, mode_index);
+    if (WaitForMode(backend, id, mode)) {
+        fprintf(err, "Display %u did not report the new mode after %d "
+                "reads\n", index, kProfileMaxReadbacks);
+        return -1;
+    }
+    times[4] = clock->now_ns(clock->context);
+    return 0;
+}
+
+int DisplayProfileRun(struct DisplayCatalog *catalog,
+                      const struct ModeSpec *specs, size_t num_specs,
+                      uint32_t iterations, const struct ProfileClock *clock,
+                      struct ProfileReport *report, FILE *err) {
+    memset(report, 0, sizeof(*report));
+    report->num_modes = num_specs;
+    report->iterations = iterations;
+    if (clock == NULL) {
+        clock = &kMonotonicClock;
+    }
+    int e = DisplayCatalogLoadDisplays(catalog);
+    if (e) {
+        fprintf(err, "CGGetActiveDisplayList CGError: %d\n", e);
+        return e;
+    }
+    if (num_specs > kMaxModeSpecs) {
+        return -1;
+    }
+
+    // Resolve every mode before switching any.
+    ptrdiff_t matched[kMaxModeSpecs];
+    struct ProfiledDisplay displays[kMaxModeSpecs];
+    size_t num_displays = 0;
+    for (size_t i = 0; i < num_specs; ++i) {
+        if ((e = ResolveSpec(catalog, &specs[i], &matched[i], displays,
+                             &num_displays, err))) {
+            return e;
+        }
+    }
+
+    const size_t switches = num_specs * iterations;
+    uint64_t *samples = malloc((switches ? switches : 1) * kProfileNumPhases *
+                               sizeof(*samples));
+    if (samples == NULL) {
+        fprintf(err, "Out of memory profiling mode switches\n");
+        return EXIT_FAILURE;
+    }
+    size_t done = 0;
+    for (; done < switches; ++done) {
+        const struct ModeSpec *spec = &specs[done % num_specs];
+        uint64_t times[kProfileNumPhases];
+        if ((e = TimeSwitch(catalog, spec->display_index,
+                            (size_t)matched[done % num_specs], clock, times,
+                            err))) {
+            break;
+        }
+        for (int phase = 0; phase < kProfilePhaseTotal; ++phase) {
+            samples[phase * switches + done] = times[phase + 1] - times[phase];
+        }
+        samples[kProfilePhaseTotal * switches + done] = times[4] - times[0];
+    }
+    const int restore_error = RestoreModes(catalog, displays, num_displays,
+                                           err);
+
+    report->switches = done;
+    for (int phase = 0; phase < kProfileNumPhases; ++phase) {
+        ProfileStatsCompute(samples + phase * switches, done,
+                            &report->phases[phase]);
+    }
+    free(samples);
+    return e ? e : restore_error;
+}
+
+int DisplayProfileWrite(const struct ProfileReport *report,
+                        enum OutputFormat format, FILE *out) {
+    if (format == kOutputJson || format == kOutputNdjson) {
+        struct JsonWriter json;
+        JsonWriterInit(&json, out);
+        JsonWriterBeginObject(&json);
+        JsonWriterKey(&json, "modes");
+        JsonWriterUint(&json, report->num_modes);
+        JsonWriterKey(&json, "iterations");
+        JsonWriterUint(&json, report->iterations);
+        JsonWriterKey(&json, "switches");
+        JsonWriterUint(&json, report->switches);
+        JsonWriterKey(&json, "phases");
+        JsonWriterBeginObject(&json);
+        for (int phase = 0; phase < kProfileNumPhases; ++phase) {
+            const struct ProfileStats *stats = &report->phases[phase];
+            JsonWriterKey(&json, kProfilePhaseNames[phase]);
+            JsonWriterBeginObject(&json);
+            JsonWriterKey(&json, "min_ns");
+            JsonWriterUint(&json, stats->min_ns);
+            JsonWriterKey(&json, "p50_ns");
+            JsonWriterUint(&json, stats->p50_ns);
+            JsonWriterKey(&json, "p99_ns");
+            JsonWriterUint(&json, stats->p99_ns);
+            JsonWriterKey(&json, "max_ns");
+            JsonWriterUint(&json, stats->max_ns);
+            JsonWriterEndObject(&json);
+        }
+        JsonWriterEndObject(&json);
+        JsonWriterEndObject(&json);
+        JsonWriterEndLine(&json);
+        return JsonWriterFlush(&json) ? -1 : 0;
+    }
+
+    fprintf(out, "%zu switches (%u iterations of %zu modes)\n",
+            report->switches, report->iterations, report->num_modes);
+    fprintf(out, "%-10s %10s %10s %10s %10s\n", "phase", "min ms", "p50 ms",
+            "p99 ms", "max ms");
+    for (int phase = 0; phase < kProfileNumPhases; ++phase) {
+        const struct ProfileStats *stats = &report->phases[phase];
+        fprintf(out, "%-10s %10.3f %10.3f %10.3f %10.3f\n",
+                kProfilePhaseNames[phase], stats->min_ns / 1e6,
+                stats->p50_ns / 1e6, stats->p99_ns / 1e6, stats->max_ns / 1e6);
+    }
+    return fflush(out) != 0 || ferror(out) ? -1 : 0;
+}
@@ -0,0 +1,83 @@
+#ifndef DISPLAYMODE_PROFILE_H
+#define DISPLAYMODE_PROFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "displaymode_catalog.h"
+#include "displaymode_parse.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Reads of the current mode after a switch before giving up on the display
+// reporting the new mode.
+#define kProfileMaxReadbacks 1000
+
+// The phases of one mode switch that "p" times.
+enum ProfilePhase {
+    kProfilePhaseBegin,      // begin_configuration
+    kProfilePhaseConfigure,  // configure_display
+    kProfilePhaseComplete,   // complete_configuration
+    // From completion until the display reports the new mode (like
+    // CGDisplayCopyDisplayMode).
+    kProfilePhaseReadback,
+    kProfilePhaseTotal,      // all of the above
+    kProfileNumPhases,
+};
+
+// Names of the phases, as reported.
+extern const char *const kProfilePhaseNames[kProfileNumPhases];
+
+// Where "p" reads the time from.
+struct ProfileClock {
+    void *context;
+    // Returns the time in nanoseconds.
+    uint64_t (*now_ns)(void *context);
+};
+
+// Distribution of one phase's durations.  Percentiles are nearest-rank.
+struct ProfileStats {
+    size_t count;
+    uint64_t min_ns;
+    uint64_t p50_ns;
+    uint64_t p99_ns;
+    uint64_t max_ns;
+};
+
+struct ProfileReport {
+    size_t num_modes;
+    uint32_t iterations;
+    size_t switches;  // num_modes * iterations, unless a switch failed
+    struct ProfileStats phases[kProfileNumPhases];
+};
+
+// Sorts the "count" durations at "samples" and fills in *stats (all zero if
+// there are none).
+void ProfileStatsCompute(uint64_t *samples, size_t count,
+                         struct ProfileStats *stats);
+
+// Switches each display named in "specs" to each of its modes in turn,
+// cycling through all "num_specs" of them "iterations" times, one switch per
+// configuration transaction, and times each phase with "clock" (NULL for
+// the monotonic clock).  Every display is switched back to the mode it had
+// before, even if a switch fails.  Returns 0 with *report filled in, or the
+// first error (the report then covers the switches made until it).
+int DisplayProfileRun(struct DisplayCatalog *catalog,
+                      const struct ModeSpec *specs, size_t num_specs,
+                      uint32_t iterations, const struct ProfileClock *clock,
+                      struct ProfileReport *report, FILE *err);
+
+// Writes "report" as a table of milliseconds, or as one line of JSON (in
+// nanoseconds) for kOutputJson and kOutputNdjson.  Returns 0, or -1 if it
+// couldn't be written.
+int DisplayProfileWrite(const struct ProfileReport *report,
+                        enum OutputFormat format, FILE *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DISPLAYMODE_PROFILE_H
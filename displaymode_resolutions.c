@@ -0,0 +1,47 @@
+#include "displaymode_resolutions.h"
+
+#include "displaymode_resolutions_table.h"
+
+static int LowerAscii(int c) {
+    return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+}
+
+const struct StandardResolution *StandardResolutionFind(size_t width,
+                                                        size_t height) {
+    if (width > 0xffff || height > 0xffff) {
+        return NULL;
+    }
+    const uint8_t slot = kResolutionSlotTable[ResolutionHash(
+        (uint32_t)width, (uint32_t)height, kResolutionHashSeed)];
+    if (slot == 0) {
+        return NULL;
+    }
+    const struct StandardResolution *resolution =
+        &kStandardResolutions[slot - 1];
+    return resolution->width == width && resolution->height == height
+               ? resolution
+               : NULL;
+}
+
+const struct StandardResolution *StandardResolutionLookup(const char *name,
+                                                          size_t length) {
+    if (length == 0 || length > kMaxResolutionName) {
+        return NULL;
+    }
+    const uint8_t slot = kResolutionNameSlotTable[ResolutionNameHash(
+        name, length, kResolutionNameHashSeed)];
+    if (slot == 0) {
+        return NULL;
+    }
+    const struct ResolutionName *entry = &kResolutionNames[slot - 1];
+    if (entry->length != length) {
+        return NULL;
+    }
+    for (size_t i = 0; i < length; ++i) {
+        if (LowerAscii((unsigned char)name[i]) !=
+            LowerAscii((unsigned char)entry->name[i])) {
+            return NULL;
+        }
+    }
+    return &kStandardResolutions[entry->resolution];
+}
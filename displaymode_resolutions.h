@@ -0,0 +1,84 @@
+#ifndef DISPLAYMODE_RESOLUTIONS_H
+#define DISPLAYMODE_RESOLUTIONS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Standard resolutions (720p, 1080p, 4K, ultrawides...) and their names,
+// listed in displaymode_resolutions.def.  Both lookups go through perfect
+// hash tables generated ahead of time by tools/gen_resolutions.c, so each
+// costs one hash and one comparison.
+
+// Slots in the hash tables (powers of two).
+#define kResolutionHashBits 6
+#define kResolutionSlots (1u << kResolutionHashBits)
+#define kResolutionNameHashBits 7
+#define kResolutionNameSlots (1u << kResolutionNameHashBits)
+
+// Longest name, in bytes.
+#define kMaxResolutionName 15
+
+struct StandardResolution {
+    const char *name;
+    uint16_t width;
+    uint16_t height;
+    // Aspect ratio in lowest terms (not necessarily the marketed one: 64:27
+    // for 2560 x 1080).
+    uint16_t aspect_w;
+    uint16_t aspect_h;
+};
+
+// A name "t" accepts, and the index of its resolution.
+struct ResolutionName {
+    const char *name;
+    uint8_t length;
+    uint8_t resolution;
+};
+
+extern const struct StandardResolution kStandardResolutions[];
+extern const size_t kNumStandardResolutions;
+extern const struct ResolutionName kResolutionNames[];
+extern const size_t kNumResolutionNames;
+
+// Slot tables: 0 for an empty slot, else 1 + the index of the entry.
+extern const uint8_t kResolutionSlotTable[kResolutionSlots];
+extern const uint8_t kResolutionNameSlotTable[kResolutionNameSlots];
+extern const uint32_t kResolutionHashSeed;
+extern const uint32_t kResolutionNameHashSeed;
+
+// The slot of a width and height.
+static inline uint32_t ResolutionHash(uint32_t width, uint32_t height,
+                                      uint32_t seed) {
+    const uint32_t key = (width << 16 | (height & 0xffff)) * seed;
+    return (key ^ key >> 15) * 0x2c1b3c6du >> (32 - kResolutionHashBits);
+}
+
+// The slot of a name, ignoring ASCII case: setting bit 5 lowers letters and
+// leaves digits, '+' and '-' as they are.
+static inline uint32_t ResolutionNameHash(const char *name, size_t length,
+                                          uint32_t seed) {
+    uint32_t hash = seed;
+    for (size_t i = 0; i < length; ++i) {
+        hash = (hash ^ ((unsigned char)name[i] | 0x20)) * 16777619u;
+    }
+    return (hash ^ hash >> 16) * 0x45d9f3bu >> (32 - kResolutionNameHashBits);
+}
+
+// Returns the standard resolution "width" x "height", or NULL.
+const struct StandardResolution *StandardResolutionFind(size_t width,
+                                                        size_t height);
+
+// Returns the resolution named by the "length" bytes at "name" (which need
+// not be NUL-terminated), ignoring ASCII case, or NULL.
+const struct StandardResolution *StandardResolutionLookup(const char *name,
+                                                          size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DISPLAYMODE_RESOLUTIONS_H
@@ -0,0 +1,62 @@
+// Generated by tools/gen_resolutions.c from displaymode_resolutions.def;
+// do not edit.  Regenerate with "make resolutions".
+
+const uint32_t kResolutionHashSeed = 0xe02e553fu;
+const uint32_t kResolutionNameHashSeed = 0xf918a8b5u;
+
+const struct StandardResolution kStandardResolutions[] = {
+    {"720p", 1280, 720, 16, 9},
+    {"1080p", 1920, 1080, 16, 9},
+    {"WQHD", 2560, 1440, 16, 9},
+    {"4K", 3840, 2160, 16, 9},
+    {"DCI4K", 4096, 2160, 256, 135},
+    {"5K", 5120, 2880, 16, 9},
+    {"6K", 6016, 3384, 16, 9},
+    {"UWFHD", 2560, 1080, 64, 27},
+    {"UWQHD", 3440, 1440, 43, 18},
+    {"UWQHD+", 3840, 1600, 12, 5},
+    {"UW5K", 5120, 2160, 64, 27},
+    {"DQHD", 5120, 1440, 32, 9},
+};
+const size_t kNumStandardResolutions = 12;
+
+const struct ResolutionName kResolutionNames[] = {
+    {"720p", 4, 0},
+    {"HD", 2, 0},
+    {"1080p", 5, 1},
+    {"FHD", 3, 1},
+    {"FullHD", 6, 1},
+    {"WQHD", 4, 2},
+    {"1440p", 5, 2},
+    {"QHD", 3, 2},
+    {"4K", 2, 3},
+    {"UHD", 3, 3},
+    {"2160p", 5, 3},
+    {"DCI4K", 5, 4},
+    {"5K", 2, 5},
+    {"6K", 2, 6},
+    {"UWFHD", 5, 7},
+    {"UWQHD", 5, 8},
+    {"UWQHD+", 6, 9},
+    {"UW5K", 4, 10},
+    {"DQHD", 4, 11},
+};
+const size_t kNumResolutionNames = 19;
+
+const uint8_t kResolutionSlotTable[kResolutionSlots] = {
+    6, 0, 0, 11, 0, 0, 0, 0, 0, 0, 0, 0, 0, 10, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 12, 0, 0, 0, 0, 0, 2, 0,
+    3, 8, 9, 0, 0, 0, 5, 0, 7, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 4, 0, 0, 0,
+};
+
+const uint8_t kResolutionNameSlotTable[kResolutionNameSlots] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 6, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 8, 0, 0, 0, 0,
+    0, 0, 13, 0, 0, 0, 0, 0, 0, 14, 16, 0, 19, 0, 5, 0,
+    0, 0, 0, 1, 0, 0, 18, 9, 0, 0, 0, 0, 3, 0, 0, 0,
+    0, 0, 10, 0, 0, 0, 15, 0, 0, 0, 0, 7, 0, 0, 11, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 4, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 17, 0, 0, 0, 0, 12,
+    0, 0, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+};
@@ -0,0 +1,614 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "displaymode_server.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "displaymode_commands.h"
+#include "displaymode_parse.h"
+#include "displaymode_shm.h"
+#include "logging.h"
+
+// Most words in one command line: a "t" command for kMaxModeSpecs displays
+// (four words each), with room for options.
+#define kMaxCommandArgs (1 + 4 * kMaxModeSpecs + 16)
+
+#ifdef MSG_NOSIGNAL
+static const int kSendFlags = MSG_NOSIGNAL;
+#else
+static const int kSendFlags = 0;
+#endif
+
+// Stops writes to a closed peer from raising SIGPIPE where MSG_NOSIGNAL
+// isn't available.
+static void DisableSigpipe(int fd) {
+#ifdef SO_NOSIGPIPE
+    const int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#else
+    (void)fd;
+#endif
+}
+
+// Sends as much of "*iov" as the socket takes, retrying after partial
+// writes, and advances "*iov" and "*iov_count" past what was sent.
+static int SendAvailable(int fd, struct iovec **iov, int *iov_count) {
+    while (*iov_count > 0) {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = *iov;
+        msg.msg_iovlen = *iov_count;
+        ssize_t sent = sendmsg(fd, &msg, kSendFlags);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        }
+        while (*iov_count > 0 && (size_t)sent >= (*iov)->iov_len) {
+            sent -= (ssize_t)(*iov)->iov_len;
+            ++*iov;
+            --*iov_count;
+        }
+        if (*iov_count > 0) {
+            (*iov)->iov_base = (char *)(*iov)->iov_base + sent;
+            (*iov)->iov_len -= (size_t)sent;
+        }
+    }
+    return 0;
+}
+
+// Sends every byte of "iov" on a blocking socket.
+static int SendAll(int fd, struct iovec *iov, int iov_count) {
+    if (SendAvailable(fd, &iov, &iov_count)) {
+        return -1;
+    }
+    return iov_count > 0 ? -1 : 0;
+}
+
+static int FillAddress(struct sockaddr_un *address, const char *socket_path) {
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address->sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(address->sun_path, socket_path);
+    return 0;
+}
+
+void DisplayServerDefaultPath(char *out, size_t out_size) {
+    snprintf(out, out_size, "/tmp/displaymode-%u.sock", (unsigned)getuid());
+}
+
+int DisplayServerOpen(struct DisplayServer *server, const char *socket_path,
+                      struct DisplayCatalog *catalog) {
+    memset(server, 0, sizeof(*server));
+    server->listen_fd = -1;
+    server->wake_fds[0] = server->wake_fds[1] = -1;
+    server->catalog = catalog;
+
+    struct sockaddr_un address;
+    if (FillAddress(&address, socket_path) ||
+        strlen(socket_path) >= sizeof(server->socket_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(server->socket_path, socket_path);
+
+    server->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server->listen_fd < 0) {
+        return -1;
+    }
+    // Only the owner may talk to the server.
+    const mode_t old_mask = umask(0077);
+    int e = bind(server->listen_fd, (struct sockaddr *)&address, sizeof(address));
+    if (e && errno == EADDRINUSE) {
+        // Replace the socket file unless a live server is behind it.
+        const int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+        const int live = probe >= 0 &&
+            connect(probe, (struct sockaddr *)&address, sizeof(address)) == 0;
+        if (probe >= 0) {
+            close(probe);
+        }
+        if (!live && unlink(socket_path) == 0) {
+            e = bind(server->listen_fd, (struct sockaddr *)&address,
+                     sizeof(address));
+        } else {
+            errno = EADDRINUSE;
+        }
+    }
+    umask(old_mask);
+    if (e || listen(server->listen_fd, kMaxServerConnections) ||
+        pipe(server->wake_fds)) {
+        const int saved_errno = errno;
+        DisplayServerClose(server);
+        errno = saved_errno;
+        return -1;
+    }
+    fcntl(server->wake_fds[1], F_SETFL, O_NONBLOCK);
+    return 0;
+}
+
+// A connected client, its partially received commands, and the part of
+// its replies it hasn't read yet.
+struct Connection {
+    int fd;
+    size_t len;
+    char buffer[kMaxCommandLength];
+    // While a reply is pending, no more commands are read or run, so that a
+    // client that stops reading holds up only itself.
+    char *pending;
+    size_t pending_len;
+    size_t pending_sent;
+    // Close the connection once the pending reply is sent.
+    int closing;
+};
+
+// Sends what the socket takes of "iov" without blocking, and keeps the rest
+// as the connection's pending reply.  Returns -1 if the connection should
+// be closed.
+static int SendOrQueue(struct Connection *connection, struct iovec *iov,
+                       int iov_count) {
+    if (SendAvailable(connection->fd, &iov, &iov_count)) {
+        return -1;
+    }
+    size_t rest = 0;
+    for (int i = 0; i < iov_count; ++i) {
+        rest += iov[i].iov_len;
+    }
+    if (rest == 0) {
+        return 0;
+    }
+    connection->pending = malloc(rest);
+    if (connection->pending == NULL) {
+        return -1;
+    }
+    connection->pending_len = 0;
+    connection->pending_sent = 0;
+    for (int i = 0; i < iov_count; ++i) {
+        memcpy(connection->pending + connection->pending_len, iov[i].iov_base,
+               iov[i].iov_len);
+        connection->pending_len += iov[i].iov_len;
+    }
+    return 0;
+}
+
+// Sends more of the pending reply, as the socket takes it.  Returns -1 if
+// the connection should be closed.
+static int SendPending(struct Connection *connection) {
+    while (connection->pending_sent < connection->pending_len) {
+        const ssize_t sent =
+            send(connection->fd, connection->pending + connection->pending_sent,
+                 connection->pending_len - connection->pending_sent, kSendFlags);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        }
+        connection->pending_sent += (size_t)sent;
+    }
+    free(connection->pending);
+    connection->pending = NULL;
+    connection->pending_len = connection->pending_sent = 0;
+    return 0;
+}
+
+static void CloseConnection(struct Connection *connection) {
+    close(connection->fd);
+    free(connection->pending);
+    connection->pending = NULL;
+}
+
+// Runs one command line and sends (or queues) the reply.
+static int ExecuteCommand(struct DisplayServer *server, char *line,
+                          struct Connection *connection) {
+    const char *argv[kMaxCommandArgs + 2];
+    int argc = 0;
+    argv[argc++] = "displaymode";
+    int too_many = 0;
+    char *save = NULL;
+    for (char *token = strtok_r(line, " \t", &save); token != NULL;
+         token = strtok_r(NULL, " \t", &save)) {
+        if (argc == kMaxCommandArgs + 1) {
+            too_many = 1;
+            break;
+        }
+        argv[argc++] = token;
+    }
+    argv[argc] = NULL;
+
+    char *out_text = NULL;
+    size_t out_len = 0;
+    char *err_text = NULL;
+    size_t err_len = 0;
+    FILE *out = open_memstream(&out_text, &out_len);
+    FILE *err = open_memstream(&err_text, &err_len);
+    int status = EXIT_FAILURE;
+    if (out != NULL && err != NULL && too_many) {
+        fputs("Too many words\n", err);
+    } else if (out != NULL && err != NULL) {
+        const struct ParsedArgs parsed_args = ParseArgs(argc, argv);
+        if (parsed_args.option == kOptionServer) {
+            fputs("Already running as a server\n", err);
+        } else {
+            // Any command may read the display list, which a hotplug since
+            // the last command may have changed.  Modes are only enumerated
+            // again for displays that were (un)plugged, and a list that was
+            // never loaded is loaded by the command that needs it.
+            if (server->catalog->has_displays) {
+                DisplayCatalogRevalidate(server->catalog);
+            }
+            status = RunCommand(server->catalog, &parsed_args, out, err);
+            // Invocations listing from the shared catalog would otherwise
+            // show the old modes until it expires.
+            if (server->shm != NULL && CommandConfigures(parsed_args.option) &&
+                DisplayShmInvalidate(server->shm)) {
+                LOG_WARN("Could not invalidate the shared catalog %s",
+                         server->shm->name);
+            }
+            DisplayCatalogFlushCache(server->catalog);
+            if (server->catalog->scratch != NULL) {
+                ArenaReset(server->catalog->scratch);
+            }
+        }
+    }
+    if (out != NULL) {
+        fclose(out);
+    }
+    if (err != NULL) {
+        fclose(err);
+    }
+    ++server->commands_served;
+
+    char header[64];
+    const int header_len = snprintf(header, sizeof(header), "%d %zu %zu\n",
+                                    status, out_len, err_len);
+    struct iovec iov[3] = {
+        {header, (size_t)header_len},
+        {out_text, out_len},
+        {err_text, err_len},
+    };
+    const int e = SendOrQueue(connection, iov, 3);
+    free(out_text);
+    free(err_text);
+    return e;
+}
+
+// Answers the complete lines received so far, stopping at a reply the
+// client hasn't taken yet.  Returns -1 if the connection should be closed.
+static int RunCommands(struct DisplayServer *server,
+                       struct Connection *connection) {
+    size_t begin = 0;
+    char *newline;
+    while (connection->pending == NULL &&
+           (newline = memchr(connection->buffer + begin, '\n',
+                             connection->len - begin)) != NULL) {
+        *newline = '\0';
+        if (newline > connection->buffer + begin && newline[-1] == '\r') {
+            newline[-1] = '\0';
+        }
+        if (ExecuteCommand(server, connection->buffer + begin, connection)) {
+            return -1;
+        }
+        begin = (size_t)(newline - connection->buffer) + 1;
+    }
+    if (connection->pending == NULL && begin == 0 &&
+        connection->len == sizeof(connection->buffer)) {
+        static const char kTooLong[] = "Command too long\n";
+        char header[64];
+        const int header_len = snprintf(header, sizeof(header), "%d 0 %zu\n",
+                                        EXIT_FAILURE, sizeof(kTooLong) - 1);
+        struct iovec iov[2] = {
+            {header, (size_t)header_len},
+            {(char *)kTooLong, sizeof(kTooLong) - 1},
+        };
+        if (SendOrQueue(connection, iov, 2) || connection->pending == NULL) {
+            return -1;
+        }
+        connection->closing = 1;
+        return 0;
+    }
+    memmove(connection->buffer, connection->buffer + begin,
+            connection->len - begin);
+    connection->len -= begin;
+    return 0;
+}
+
+// Reads from a readable connection and answers each complete line.  Returns
+// -1 if the connection should be closed.
+static int ServeConnection(struct DisplayServer *server,
+                           struct Connection *connection) {
+    const ssize_t n = recv(connection->fd, connection->buffer + connection->len,
+                           sizeof(connection->buffer) - connection->len, 0);
+    if (n <= 0) {
+        return n < 0 && (errno == EINTR || errno == EAGAIN ||
+                         errno == EWOULDBLOCK) ? 0 : -1;
+    }
+    connection->len += (size_t)n;
+    return RunCommands(server, connection);
+}
+
+// Sends more of a writable connection's pending reply and, once it is all
+// sent, answers the commands that arrived meanwhile.  Returns -1 if the
+// connection should be closed.
+static int ResumeConnection(struct DisplayServer *server,
+                            struct Connection *connection) {
+    if (SendPending(connection)) {
+        return -1;
+    }
+    if (connection->pending != NULL) {
+        return 0;
+    }
+    return connection->closing ? -1 : RunCommands(server, connection);
+}
+
+int DisplayServerRun(struct DisplayServer *server) {
+    struct Connection *connections =
+        calloc(kMaxServerConnections, sizeof(*connections));
+    if (connections == NULL) {
+        return -1;
+    }
+    size_t num_connections = 0;
+    struct pollfd fds[kMaxServerConnections + 2];
+    int result = 0;
+
+    for (;;) {
+        fds[0].fd = server->listen_fd;
+        fds[0].events = POLLIN;
+        fds[1].fd = server->wake_fds[0];
+        fds[1].events = POLLIN;
+        for (size_t i = 0; i < num_connections; ++i) {
+            fds[i + 2].fd = connections[i].fd;
+            fds[i + 2].events =
+                connections[i].pending != NULL ? POLLOUT : POLLIN;
+        }
+        if (poll(fds, (nfds_t)(num_connections + 2), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            result = -1;
+            break;
+        }
+        if (fds[1].revents) {
+            break;
+        }
+
+        // Serve existing connections first so that indices in "fds" stay
+        // valid while closed connections are removed.
+        for (size_t i = num_connections; i-- > 0;) {
+            if (fds[i + 2].revents == 0) {
+                continue;
+            }
+            struct Connection *connection = &connections[i];
+            const int e = connection->pending != NULL
+                ? ResumeConnection(server, connection)
+                : ServeConnection(server, connection);
+            if (e) {
+                CloseConnection(connection);
+                connections[i] = connections[--num_connections];
+            }
+        }
+
+        if (fds[0].revents & POLLIN) {
+            const int fd = accept(server->listen_fd, NULL, NULL);
+            if (fd >= 0) {
+                if (num_connections == kMaxServerConnections) {
+                    close(fd);
+                } else {
+                    DisableSigpipe(fd);
+                    // Replies go out as the client takes them.
+                    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+                    struct Connection *connection =
+                        &connections[num_connections++];
+                    memset(connection, 0, sizeof(*connection));
+                    connection->fd = fd;
+                }
+            }
+        }
+    }
+
+    for (size_t i = 0; i < num_connections; ++i) {
+        CloseConnection(&connections[i]);
+    }
+    free(connections);
+    // Drain the wake-up so the server can run again.
+    char drain[16];
+    while (read(server->wake_fds[0], drain, sizeof(drain)) == (ssize_t)sizeof(drain)) {
+    }
+    return result;
+}
+
+void DisplayServerStop(struct DisplayServer *server) {
+    const char wake = 'q';
+    const ssize_t ignored = write(server->wake_fds[1], &wake, 1);
+    (void)ignored;
+}
+
+void DisplayServerClose(struct DisplayServer *server) {
+    if (server->listen_fd >= 0) {
+        close(server->listen_fd);
+        unlink(server->socket_path);
+        server->listen_fd = -1;
+    }
+    for (int i = 0; i < 2; ++i) {
+        if (server->wake_fds[i] >= 0) {
+            close(server->wake_fds[i]);
+            server->wake_fds[i] = -1;
+        }
+    }
+}
+
+int DisplayClientConnect(struct DisplayClient *client, const char *socket_path) {
+    client->fd = -1;
+    client->begin = client->end = 0;
+    struct sockaddr_un address;
+    if (FillAddress(&address, socket_path)) {
+        return -1;
+    }
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address))) {
+        const int saved_errno = errno;
+        close(fd);
+        errno = saved_errno;
+        return -1;
+    }
+    DisableSigpipe(fd);
+    client->fd = fd;
+    return 0;
+}
+
+// Reads at least one more byte into the client's buffer.
+static int FillBuffer(struct DisplayClient *client) {
+    if (client->begin > 0) {
+        memmove(client->buffer, client->buffer + client->begin,
+                client->end - client->begin);
+        client->end -= client->begin;
+        client->begin = 0;
+    }
+    for (;;) {
+        const ssize_t n = recv(client->fd, client->buffer + client->end,
+                               sizeof(client->buffer) - client->end, 0);
+        if (n > 0) {
+            client->end += (size_t)n;
+            return 0;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n == 0) {
+            errno = ECONNRESET;
+        }
+        return -1;
+    }
+}
+
+// Reads exactly "len" bytes of the reply body into a new buffer.
+static int ReadBody(struct DisplayClient *client, size_t len, char **body) {
+    *body = malloc(len + 1);
+    if (*body == NULL) {
+        return -1;
+    }
+    size_t filled = 0;
+    while (filled < len) {
+        if (client->begin == client->end) {
+            client->begin = client->end = 0;
+            if (FillBuffer(client)) {
+                return -1;
+            }
+        }
+        size_t chunk = client->end - client->begin;
+        if (chunk > len - filled) {
+            chunk = len - filled;
+        }
+        memcpy(*body + filled, client->buffer + client->begin, chunk);
+        client->begin += chunk;
+        filled += chunk;
+    }
+    (*body)[len] = '\0';
+    return 0;
+}
+
+int DisplayClientRequest(struct DisplayClient *client, const char *command,
+                         struct DisplayReply *reply) {
+    memset(reply, 0, sizeof(*reply));
+    const size_t command_len = strlen(command);
+    if (command_len + 1 >= kMaxCommandLength || memchr(command, '\n', command_len)) {
+        errno = EINVAL;
+        return -1;
+    }
+    struct iovec iov[2] = {
+        {(char *)command, command_len},
+        {"\n", 1},
+    };
+    if (SendAll(client->fd, iov, 2)) {
+        return -1;
+    }
+
+    char *newline;
+    while ((newline = memchr(client->buffer + client->begin, '\n',
+                             client->end - client->begin)) == NULL) {
+        if (client->end - client->begin == sizeof(client->buffer) ||
+            FillBuffer(client)) {
+            return -1;
+        }
+    }
+    *newline = '\0';
+    if (sscanf(client->buffer + client->begin, "%d %zu %zu", &reply->status,
+               &reply->out_len, &reply->err_len) != 3) {
+        errno = EPROTO;
+        return -1;
+    }
+    client->begin = (size_t)(newline - client->buffer) + 1;
+    if (ReadBody(client, reply->out_len, &reply->out) ||
+        ReadBody(client, reply->err_len, &reply->err)) {
+        DisplayReplyFree(reply);
+        return -1;
+    }
+    return 0;
+}
+
+void DisplayReplyFree(struct DisplayReply *reply) {
+    free(reply->out);
+    free(reply->err);
+    memset(reply, 0, sizeof(*reply));
+}
+
+void DisplayClientClose(struct DisplayClient *client) {
+    if (client->fd >= 0) {
+        close(client->fd);
+        client->fd = -1;
+    }
+}
+
+int DisplayClientRun(const char *socket_path, int argc, const char *argv[],
+                     FILE *out, FILE *err, int *status) {
+    char command[kMaxCommandLength];
+    size_t len = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (argv[i] == NULL || strncmp(argv[i], "--socket=", 9) == 0) {
+            continue;
+        }
+        const size_t arg_len = strlen(argv[i]);
+        if (arg_len == 0 || strpbrk(argv[i], " \t\r\n") != NULL ||
+            len + arg_len + 2 > sizeof(command)) {
+            return -1;
+        }
+        if (len > 0) {
+            command[len++] = ' ';
+        }
+        memcpy(command + len, argv[i], arg_len);
+        len += arg_len;
+    }
+    command[len] = '\0';
+
+    struct DisplayClient client;
+    if (DisplayClientConnect(&client, socket_path)) {
+        return -1;
+    }
+    struct DisplayReply reply;
+    const int e = DisplayClientRequest(&client, command, &reply);
+    DisplayClientClose(&client);
+    if (e) {
+        return -1;
+    }
+    fwrite(reply.out, 1, reply.out_len, out);
+    fwrite(reply.err, 1, reply.err_len, err);
+    *status = reply.status;
+    DisplayReplyFree(&reply);
+    return 0;
+}
@@ -0,0 +1,100 @@
+#ifndef DISPLAYMODE_SERVER_H
+#define DISPLAYMODE_SERVER_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "displaymode_catalog.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct DisplayShm;
+
+// Maximum length of one command line, including the newline.
+#define kMaxCommandLength 1024
+
+// Maximum number of simultaneously connected clients.
+#define kMaxServerConnections 32
+
+// Protocol: a client sends commands as single lines of space-separated
+// arguments, exactly as they would follow "displaymode" on the command line
+// (e.g. "t 1440 900 @60 1").  For each line the server answers with a header
+// line "<exit status> <stdout bytes> <stderr bytes>" followed by the command's
+// stdout and stderr.
+
+// A server answering commands from one catalog, which stays enumerated
+// between commands.
+struct DisplayServer {
+    int listen_fd;
+    // Writing to wake_fds[1] makes DisplayServerRun return.
+    int wake_fds[2];
+    char socket_path[104];
+    struct DisplayCatalog *catalog;
+    // Shared catalog to empty after each command that may change modes (not
+    // owned), or NULL.
+    struct DisplayShm *shm;
+    unsigned long commands_served;
+};
+
+// Writes the per-user default socket path into "out".
+void DisplayServerDefaultPath(char *out, size_t out_size);
+
+// Binds the server to "socket_path" (replacing a stale socket file).  Returns
+// 0, or -1 with errno set.
+int DisplayServerOpen(struct DisplayServer *server, const char *socket_path,
+                      struct DisplayCatalog *catalog);
+
+// Serves clients until DisplayServerStop is called.  Returns 0, or -1 with
+// errno set.
+int DisplayServerRun(struct DisplayServer *server);
+
+// Asks DisplayServerRun to return.  Safe to call from signal handlers and
+// other threads.
+void DisplayServerStop(struct DisplayServer *server);
+
+// Closes the socket and removes the socket file.
+void DisplayServerClose(struct DisplayServer *server);
+
+// A connection to a server.
+struct DisplayClient {
+    int fd;
+    size_t begin;
+    size_t end;
+    char buffer[4096];
+};
+
+// The server's answer to one command.
+struct DisplayReply {
+    int status;
+    char *out;
+    size_t out_len;
+    char *err;
+    size_t err_len;
+};
+
+// Connects to the server at "socket_path".  Returns 0, or -1 with errno set.
+int DisplayClientConnect(struct DisplayClient *client, const char *socket_path);
+
+// Sends one command line (without the newline) and waits for the reply.
+// Returns 0, or -1 with errno set.  The reply must be freed with
+// DisplayReplyFree.
+int DisplayClientRequest(struct DisplayClient *client, const char *command,
+                         struct DisplayReply *reply);
+
+void DisplayReplyFree(struct DisplayReply *reply);
+
+void DisplayClientClose(struct DisplayClient *client);
+
+// Forwards the command in argv (minus any --socket flag) to the server and
+// copies its output to "out" and "err".  Returns 0 and sets "*status" if the
+// server answered, or -1 if the command should be run locally instead.
+int DisplayClientRun(const char *socket_path, int argc, const char *argv[],
+                     FILE *out, FILE *err, int *status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DISPLAYMODE_SERVER_H
@@ -0,0 +1,537 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "displaymode_shm.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+static const char kMagic[8] = {'D', 'M', 'S', 'H', 'A', 'R', 'E', '\0'};
+static const uint32_t kByteOrder = 0x01020304;
+
+void DisplayShmDefaultName(char *out, size_t out_size) {
+    // macOS limits names to 31 characters.
+    snprintf(out, out_size, "/displaymode.%u", (unsigned)getuid());
+}
+
+int64_t DisplayShmNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// The magic is stored last, in one atomic store, so that a process mapping
+// a segment being set up sees either no magic or a complete header.
+static uint64_t LoadMagic(const struct DisplayShmHeader *header) {
+    return __atomic_load_n((const uint64_t *)(const void *)header->magic,
+                           __ATOMIC_ACQUIRE);
+}
+
+// Returns 1 if the header was valid or has just been set up, 0 if it belongs
+// to an incompatible layout.
+static int SetUpHeader(struct DisplayShm *shm) {
+    struct DisplayShmHeader *header = shm->header;
+    uint64_t magic;
+    memcpy(&magic, kMagic, sizeof(magic));
+    const uint64_t found = LoadMagic(header);
+    if (found == 0) {
+        // A new segment; concurrent openers all write the same values.
+        header->version = kDisplayShmVersion;
+        header->byte_order = kByteOrder;
+        header->size = shm->size;
+        __atomic_store_n((uint64_t *)(void *)header->magic, magic,
+                         __ATOMIC_RELEASE);
+        return 1;
+    }
+    return found == magic && header->version == kDisplayShmVersion &&
+           header->byte_order == kByteOrder && header->size == shm->size;
+}
+
+// Maps the segment "name", creating it if need be.  Returns 0, 1 if it has
+// an incompatible layout, or -1 with errno set.
+static int Map(struct DisplayShm *shm, const char *name, size_t size) {
+    const int fd = shm_open(name, O_RDWR | O_CREAT, 0600);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return -1;
+    }
+    if (st.st_size == 0) {
+        // macOS only lets a segment be sized once: if another opener just
+        // did, use its size.
+        if ((ftruncate(fd, (off_t)size) != 0 && errno != EINVAL) ||
+            fstat(fd, &st) != 0) {
+            close(fd);
+            return -1;
+        }
+    }
+    if (st.st_size < (off_t)sizeof(struct DisplayShmHeader)) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    void *data = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return -1;
+    }
+    shm->data = data;
+    shm->size = (size_t)st.st_size;
+    shm->header = data;
+    if (!SetUpHeader(shm)) {
+        DisplayShmClose(shm);
+        return 1;
+    }
+    return 0;
+}
+
+int DisplayShmOpen(struct DisplayShm *shm, const char *name, size_t size) {
+    memset(shm, 0, sizeof(*shm));
+    if (strlen(name) >= sizeof(shm->name) ||
+        size < sizeof(struct DisplayShmHeader)) {
+        errno = EINVAL;
+        return -1;
+    }
+    strcpy(shm->name, name);
+    int e = Map(shm, name, size);
+    if (e == 1) {
+        // Left by another version: start over with a segment of our own.
+        // Processes still using the old one keep their mapping.
+        shm_unlink(name);
+        e = Map(shm, name, size);
+        if (e == 1) {
+            errno = EEXIST;
+            e = -1;
+        }
+    }
+    if (e) {
+        memset(shm, 0, sizeof(*shm));
+    }
+    return e;
+}
+
+void DisplayShmClose(struct DisplayShm *shm) {
+    if (shm->data != NULL) {
+        munmap(shm->data, shm->size);
+    }
+    shm->data = NULL;
+    shm->size = 0;
+    shm->header = NULL;
+}
+
+int DisplayShmUnlink(const char *name) {
+    return shm_unlink(name);
+}
+
+uint64_t DisplayShmSequence(const struct DisplayShm *shm) {
+    if (shm->header == NULL) {
+        return 0;
+    }
+    return __atomic_load_n(&shm->header->sequence, __ATOMIC_ACQUIRE);
+}
+
+// Returns non-zero if the process "pid" may still be writing.
+static int WriterAlive(int64_t pid) {
+    if (pid <= 0) {
+        return 0;
+    }
+    if (pid == (int64_t)getpid()) {
+        // Another thread of this process.
+        return 1;
+    }
+    return kill((pid_t)pid, 0) == 0 || errno == EPERM;
+}
+
+// Claims "writer_pid" for this process, from no owner or from a dead one.
+// Returns 0 if it had no owner, 1 if its owner was dead, or -1 if a live
+// writer owns it.
+static int ClaimWriter(struct DisplayShmHeader *header, int64_t self) {
+    int64_t owner = 0;
+    if (__atomic_compare_exchange_n(&header->writer_pid, &owner, self, 0,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return 0;
+    }
+    if (WriterAlive(owner) ||
+        !__atomic_compare_exchange_n(&header->writer_pid, &owner, self, 0,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return -1;
+    }
+    return 1;
+}
+
+// Takes the write side of the sequence lock if it still holds "expected".
+// Only the process that owns "writer_pid" changes the sequence, so two
+// writers never both hold it.  A writer that died owning it is taken over,
+// and the catalog it left half written replaced whatever "expected" was.
+// Returns 0 and sets *sequence to the odd value now held, or -1.
+static int BeginWrite(struct DisplayShm *shm, uint64_t expected,
+                      uint64_t *sequence) {
+    struct DisplayShmHeader *header = shm->header;
+    const int took_over = ClaimWriter(header, (int64_t)getpid());
+    if (took_over < 0) {
+        return -1;
+    }
+    uint64_t held = __atomic_load_n(&header->sequence, __ATOMIC_RELAXED);
+    uint64_t next = held + 1;
+    if (held & 1) {
+        // Odd without an owner is never left by a writer of this version:
+        // treat it as busy rather than guess.
+        next = took_over ? held + 2 : held;
+    } else if (held != expected) {
+        next = held;
+    }
+    if (next == held ||
+        !__atomic_compare_exchange_n(&header->sequence, &held, next, 0,
+                                     __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&header->writer_pid, 0, __ATOMIC_RELEASE);
+        return -1;
+    }
+    // Readers that see any of the stores below also see the odd sequence.
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    *sequence = next;
+    return 0;
+}
+
+// Releases the write side, then "writer_pid".  Returns -1 if another writer
+// took this one for dead and overtook it.
+static int EndWrite(struct DisplayShm *shm, uint64_t sequence) {
+    struct DisplayShmHeader *header = shm->header;
+    uint64_t expected = sequence;
+    const int ended = __atomic_compare_exchange_n(
+        &header->sequence, &expected, sequence + 1, 0, __ATOMIC_RELEASE,
+        __ATOMIC_RELAXED);
+    int64_t self = (int64_t)getpid();
+    __atomic_compare_exchange_n(&header->writer_pid, &self, 0, 0,
+                                __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+    return ended ? 0 : -1;
+}
+
+static void ToSharedMode(const struct DisplayMode *mode,
+                         struct DisplayCacheMode *shared) {
+    memset(shared, 0, sizeof(*shared));
+    shared->width = (uint32_t)mode->width;
+    shared->height = (uint32_t)mode->height;
+    shared->refresh_rate = mode->refresh_rate;
+    shared->mode_id = mode->mode_id;
+    shared->flags = mode->usable_for_desktop ? kDisplayCacheModeUsable : 0;
+}
+
+int DisplayShmPublish(struct DisplayShm *shm,
+                      const struct DisplayCatalog *catalog, uint64_t sequence,
+                      int64_t now_ns) {
+    if (shm->header == NULL || !catalog->has_displays) {
+        return -1;
+    }
+    size_t num_modes = 0;
+    for (uint32_t i = 0; i < catalog->num_displays; ++i) {
+        if (!catalog->has_modes[i]) {
+            return -1;
+        }
+        num_modes += catalog->modes[i].count;
+    }
+    const size_t capacity = shm->size - sizeof(struct DisplayShmHeader);
+    const size_t max_modes = capacity / sizeof(struct DisplayCacheMode);
+    if (num_modes > UINT32_MAX || num_modes > max_modes ||
+        catalog->num_displays >
+            (capacity - num_modes * sizeof(struct DisplayCacheMode)) /
+                sizeof(struct DisplayShmDisplay)) {
+        return -1;
+    }
+
+    uint64_t held;
+    if (BeginWrite(shm, sequence, &held)) {
+        return -1;
+    }
+    struct DisplayShmHeader *header = shm->header;
+    struct DisplayShmDisplay *displays = (struct DisplayShmDisplay *)(header + 1);
+    struct DisplayCacheMode *modes =
+        (struct DisplayCacheMode *)(displays + catalog->num_displays);
+    uint32_t first_mode = 0;
+    for (uint32_t i = 0; i < catalog->num_displays; ++i) {
+        const struct DisplayModeList *list = &catalog->modes[i];
+        struct DisplayShmDisplay *display = &displays[i];
+        memset(display, 0, sizeof(*display));
+        display->id = catalog->displays[i];
+        display->first_mode = first_mode;
+        display->mode_count = (uint32_t)list->count;
+        display->current_index = (int32_t)list->current_index;
+        display->has_current = list->has_current != 0;
+        if (list->has_current) {
+            ToSharedMode(&list->current, &display->current);
+        }
+        for (size_t m = 0; m < list->count; ++m) {
+            ToSharedMode(&list->modes[m], &modes[first_mode + m]);
+        }
+        const struct EdidCacheEntry *edid = catalog->edid[i];
+        if (edid != NULL) {
+            display->edid_size = (uint32_t)(edid->size < kDisplayShmMaxEdid
+                                            ? edid->size : kDisplayShmMaxEdid);
+            memcpy(display->edid, edid->data, display->edid_size);
+        }
+        first_mode += (uint32_t)list->count;
+    }
+    header->published_ns = now_ns;
+    header->num_displays = catalog->num_displays;
+    header->num_modes = first_mode;
+    return EndWrite(shm, held);
+}
+
+int DisplayShmInvalidate(struct DisplayShm *shm) {
+    if (shm->header == NULL) {
+        return -1;
+    }
+    for (int attempt = 0; attempt < kDisplayShmReadAttempts; ++attempt) {
+        uint64_t held;
+        if (BeginWrite(shm, DisplayShmSequence(shm), &held) == 0) {
+            shm->header->published_ns = 0;
+            shm->header->num_displays = 0;
+            shm->header->num_modes = 0;
+            if (EndWrite(shm, held) == 0) {
+                return 0;
+            }
+        }
+        sched_yield();
+    }
+    return -1;
+}
+
+static struct DisplayShmSnapshot *SnapshotOf(void *context) {
+    return context;
+}
+
+// Finds a display of the snapshot, first where the previous lookup left
+// off and then at the display it found, since the catalog asks for the
+// modes and then the EDID of one display after the other.
+static const struct DisplayShmDisplay *FindSnapshotDisplay(
+    struct DisplayShmSnapshot *snapshot, uint32_t id) {
+    const uint32_t hint = snapshot->next_display;
+    if (hint < snapshot->num_displays && snapshot->displays[hint].id == id) {
+        snapshot->next_display = hint + 1;
+        return &snapshot->displays[hint];
+    }
+    if (hint > 0 && hint <= snapshot->num_displays &&
+        snapshot->displays[hint - 1].id == id) {
+        return &snapshot->displays[hint - 1];
+    }
+    for (uint32_t i = 0; i < snapshot->num_displays; ++i) {
+        if (snapshot->displays[i].id == id) {
+            snapshot->next_display = i + 1;
+            return &snapshot->displays[i];
+        }
+    }
+    return NULL;
+}
+
+static int SnapshotGetActiveDisplays(void *context, uint32_t max_displays,
+                                     uint32_t *displays,
+                                     uint32_t *num_displays) {
+    const struct DisplayShmSnapshot *snapshot = SnapshotOf(context);
+    if (displays == NULL) {
+        *num_displays = snapshot->num_displays;
+        return 0;
+    }
+    uint32_t n = 0;
+    for (; n < snapshot->num_displays && n < max_displays; ++n) {
+        displays[n] = snapshot->displays[n].id;
+    }
+    *num_displays = n;
+    return 0;
+}
+
+static int SnapshotCopyModes(void *context, uint32_t id,
+                             struct DisplayModeList *list) {
+    struct DisplayShmSnapshot *snapshot = SnapshotOf(context);
+    memset(list, 0, sizeof(*list));
+    list->current_index = -1;
+    const struct DisplayShmDisplay *display = FindSnapshotDisplay(snapshot, id);
+    if (display == NULL) {
+        return kDisplayErrorFailure;
+    }
+    list->modes = malloc((display->mode_count ? display->mode_count : 1) *
+                         sizeof(list->modes[0]));
+    if (list->modes == NULL) {
+        return kDisplayErrorFailure;
+    }
+    const struct DisplayCacheMode *modes = &snapshot->modes[display->first_mode];
+    for (uint32_t i = 0; i < display->mode_count; ++i) {
+        DisplayCacheModeToDisplayMode(&modes[i], &list->modes[i]);
+    }
+    list->count = display->mode_count;
+    if (display->has_current) {
+        DisplayCacheModeToDisplayMode(&display->current, &list->current);
+        list->has_current = 1;
+        list->current_index = display->current_index;
+    }
+    return 0;
+}
+
+static int SnapshotGetEdid(void *context, uint32_t id,
+                           const unsigned char **data, size_t *size) {
+    struct DisplayShmSnapshot *snapshot = SnapshotOf(context);
+    const struct DisplayShmDisplay *display = FindSnapshotDisplay(snapshot, id);
+    if (display == NULL || display->edid_size == 0) {
+        return kDisplayErrorFailure;
+    }
+    *data = display->edid;
+    *size = display->edid_size;
+    return 0;
+}
+
+static void SnapshotReleaseModes(void *context, struct DisplayModeList *list) {
+    (void)context;
+    free(list->modes);
+    memset(list, 0, sizeof(*list));
+    list->current_index = -1;
+}
+
+// The snapshot can't configure anything: "t" always goes to the system.
+static int SnapshotBeginConfiguration(void *context, void **config) {
+    (void)context;
+    *config = NULL;
+    return kDisplayErrorFailure;
+}
+
+static int SnapshotConfigureDisplay(void *context, void *config,
+                                    uint32_t display,
+                                    const struct DisplayMode *mode) {
+    (void)context;
+    (void)config;
+    (void)display;
+    (void)mode;
+    return kDisplayErrorFailure;
+}
+
+static int SnapshotCompleteConfiguration(void *context, void *config) {
+    (void)context;
+    (void)config;
+    return kDisplayErrorFailure;
+}
+
+static void SnapshotCancelConfiguration(void *context, void *config) {
+    (void)context;
+    (void)config;
+}
+
+void DisplayShmSnapshotInit(struct DisplayShmSnapshot *snapshot) {
+    memset(snapshot, 0, sizeof(*snapshot));
+    snapshot->backend.context = snapshot;
+    snapshot->backend.get_active_displays = SnapshotGetActiveDisplays;
+    snapshot->backend.copy_modes = SnapshotCopyModes;
+    snapshot->backend.release_modes = SnapshotReleaseModes;
+    snapshot->backend.get_edid = SnapshotGetEdid;
+    snapshot->backend.begin_configuration = SnapshotBeginConfiguration;
+    snapshot->backend.configure_display = SnapshotConfigureDisplay;
+    snapshot->backend.complete_configuration = SnapshotCompleteConfiguration;
+    snapshot->backend.cancel_configuration = SnapshotCancelConfiguration;
+}
+
+void DisplayShmSnapshotFree(struct DisplayShmSnapshot *snapshot) {
+    free(snapshot->buffer);
+    DisplayShmSnapshotInit(snapshot);
+}
+
+// Checks the copied catalog's internal references, which a consistent read
+// of an uncorrupted segment always satisfies.
+static int ValidateSnapshot(const struct DisplayShmSnapshot *snapshot) {
+    for (uint32_t i = 0; i < snapshot->num_displays; ++i) {
+        const struct DisplayShmDisplay *display = &snapshot->displays[i];
+        if (display->first_mode > snapshot->num_modes ||
+            display->mode_count > snapshot->num_modes - display->first_mode ||
+            display->current_index < -1 ||
+            display->edid_size > kDisplayShmMaxEdid ||
+            (display->current_index >= 0 &&
+             (uint32_t)display->current_index >= display->mode_count)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int DisplayShmRead(const struct DisplayShm *shm, int64_t now_ns,
+                   int64_t max_age_ns, struct DisplayShmSnapshot *snapshot) {
+    if (shm->header == NULL) {
+        return kDisplayShmEmpty;
+    }
+    const struct DisplayShmHeader *header = shm->header;
+    const unsigned char *data = (const unsigned char *)(header + 1);
+    const size_t capacity = shm->size - sizeof(*header);
+    snapshot->retries = 0;
+    for (int attempt = 0; attempt < kDisplayShmReadAttempts; ++attempt) {
+        if (attempt > 0) {
+            ++snapshot->retries;
+        }
+        const uint64_t before =
+            __atomic_load_n(&header->sequence, __ATOMIC_ACQUIRE);
+        if (before == 0) {
+            return kDisplayShmEmpty;
+        }
+        if (before & 1) {
+            sched_yield();
+            continue;
+        }
+        const int64_t published_ns =
+            __atomic_load_n(&header->published_ns, __ATOMIC_RELAXED);
+        const uint32_t num_displays =
+            __atomic_load_n(&header->num_displays, __ATOMIC_RELAXED);
+        const uint32_t num_modes =
+            __atomic_load_n(&header->num_modes, __ATOMIC_RELAXED);
+        // The counts may be torn; bound them before copying.
+        const size_t size =
+            (size_t)num_displays * sizeof(struct DisplayShmDisplay) +
+            (size_t)num_modes * sizeof(struct DisplayCacheMode);
+        const int fits = size <= capacity;
+        if (fits && size > snapshot->buffer_size) {
+            unsigned char *grown = realloc(snapshot->buffer, size);
+            if (grown == NULL) {
+                return kDisplayShmFailed;
+            }
+            snapshot->buffer = grown;
+            snapshot->buffer_size = size;
+        }
+        if (fits) {
+            memcpy(snapshot->buffer, data, size);
+        }
+        // Order the copy before the second read of the sequence.
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&header->sequence, __ATOMIC_RELAXED) != before) {
+            continue;
+        }
+        if (!fits) {
+            return kDisplayShmFailed;
+        }
+        if (published_ns == 0) {
+            return kDisplayShmEmpty;
+        }
+        snapshot->sequence = before;
+        snapshot->published_ns = published_ns;
+        snapshot->num_displays = num_displays;
+        snapshot->num_modes = num_modes;
+        snapshot->displays = (const struct DisplayShmDisplay *)snapshot->buffer;
+        snapshot->modes = (const struct DisplayCacheMode *)(
+            snapshot->displays + num_displays);
+        snapshot->next_display = 0;
+        if (ValidateSnapshot(snapshot)) {
+            snapshot->num_displays = 0;
+            snapshot->num_modes = 0;
+            return kDisplayShmFailed;
+        }
+        if (published_ns > now_ns + max_age_ns ||
+            now_ns - published_ns > max_age_ns) {
+            return kDisplayShmStale;
+        }
+        return kDisplayShmOk;
+    }
+    return kDisplayShmBusy;
+}
@@ -0,0 +1,160 @@
+#ifndef DISPLAYMODE_SHM_H
+#define DISPLAYMODE_SHM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "displaymode_backend.h"
+#include "displaymode_cache.h"
+#include "displaymode_catalog.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Version of the shared catalog layout; segments with another version are
+// recreated by the next writer.
+#define kDisplayShmVersion 3
+
+// Default size of the shared segment (bytes), enough for about 40k modes.
+#define kDisplayShmDefaultSize (1u << 20)
+
+// A published catalog older than this is stale (nanoseconds).
+#define kDisplayShmMaxAge (2 * 1000000000LL)
+
+// Most EDID bytes shared per display: the base block and one extension.
+#define kDisplayShmMaxEdid 256
+
+// Torn reads retried before a reader gives up and enumerates directly.
+#define kDisplayShmReadAttempts 64
+
+// The shared catalog lets concurrent invocations (say, a burst of "d" from
+// login scripts) list modes without each one enumerating the displays.  The
+// last invocation that enumerated publishes what it found in a shared memory
+// segment; readers copy it out without locks or display API calls.
+//
+// Layout (native byte order):
+//   struct DisplayShmHeader
+//   struct DisplayShmDisplay[num_displays]
+//   struct DisplayCacheMode[num_modes]
+//
+// Consistency is a sequence lock: a writer makes "sequence" odd, updates
+// everything after it, then makes it even again.  A reader copies the
+// catalog between two reads of the sequence and retries if they differ or
+// are odd, so it never uses a half-written catalog.  Writers are serialized
+// by "writer_pid", which a writer claims by compare-and-swap before making
+// the sequence odd and clears after making it even; a writer that died
+// holding it is detected by its PID and overtaken.
+
+struct DisplayShmHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t size;  // of the whole segment
+    // Odd while a writer is updating the catalog.  Only accessed atomically.
+    uint64_t sequence;
+    // Process allowed to change the sequence, or 0.  Only accessed
+    // atomically.
+    int64_t writer_pid;
+    // The rest is only valid between two equal, even reads of "sequence".
+    // Wall-clock time of publication, or 0 if invalidated (nanoseconds).
+    int64_t published_ns;
+    uint32_t num_displays;
+    uint32_t num_modes;
+};
+
+struct DisplayShmDisplay {
+    uint32_t id;
+    uint32_t first_mode;
+    uint32_t mode_count;
+    int32_t current_index;  // -1 if the current mode isn't listed
+    struct DisplayCacheMode current;
+    uint32_t has_current;
+    // The first edid_size bytes of the display's EDID, so that readers name
+    // the display as the writer did.
+    uint32_t edid_size;
+    unsigned char edid[kDisplayShmMaxEdid];
+};
+
+// Results of DisplayShmRead.
+enum DisplayShmStatus {
+    kDisplayShmOk = 0,
+    kDisplayShmEmpty,   // nothing published, or invalidated since
+    kDisplayShmBusy,    // a writer kept the catalog changing while reading
+    kDisplayShmStale,   // older than the maximum age
+    kDisplayShmFailed,  // out of memory, or a corrupt segment
+};
+
+// A mapped shared catalog segment.
+struct DisplayShm {
+    char name[64];
+    unsigned char *data;
+    size_t size;
+    struct DisplayShmHeader *header;
+};
+
+// A private copy of a published catalog.  "backend" serves it like a
+// display backend that can't configure displays, so a catalog initialized
+// with it lists the published modes.
+struct DisplayShmSnapshot {
+    uint64_t sequence;
+    int64_t published_ns;
+    uint32_t num_displays;
+    uint32_t num_modes;
+    const struct DisplayShmDisplay *displays;
+    const struct DisplayCacheMode *modes;
+    // Torn reads retried before this snapshot was taken.
+    unsigned retries;
+    // Where the backend looks for the next display first.
+    uint32_t next_display;
+    unsigned char *buffer;
+    size_t buffer_size;
+    struct DisplayBackend backend;
+};
+
+// Writes the per-user default segment name into "out".
+void DisplayShmDefaultName(char *out, size_t out_size);
+
+// Maps the segment "name" (like "/displaymode.501"), creating it with
+// "size" bytes if it doesn't exist.  Returns 0, or -1 with errno set.
+int DisplayShmOpen(struct DisplayShm *shm, const char *name, size_t size);
+
+void DisplayShmClose(struct DisplayShm *shm);
+
+// Removes the segment "name"; mappings stay valid until closed.
+int DisplayShmUnlink(const char *name);
+
+// Returns the current sequence, to pass to DisplayShmPublish.
+uint64_t DisplayShmSequence(const struct DisplayShm *shm);
+
+// Publishes the modes of every display of "catalog", all of which must be
+// loaded, unless the shared catalog changed since "sequence" was read (so
+// that modes enumerated before someone else's update don't overwrite it).
+// Returns 0, or -1 if not published: it changed, another writer is busy,
+// the modes aren't loaded, or they don't fit.
+int DisplayShmPublish(struct DisplayShm *shm,
+                      const struct DisplayCatalog *catalog, uint64_t sequence,
+                      int64_t now_ns);
+
+// Marks the shared catalog empty, as after configuring a display, waiting
+// for a busy writer if need be.  Returns 0, or -1 if it stayed busy.
+int DisplayShmInvalidate(struct DisplayShm *shm);
+
+void DisplayShmSnapshotInit(struct DisplayShmSnapshot *snapshot);
+
+void DisplayShmSnapshotFree(struct DisplayShmSnapshot *snapshot);
+
+// Copies the published catalog into "snapshot" if it is no older than
+// "max_age_ns" at "now_ns".  Returns a DisplayShmStatus; anything but
+// kDisplayShmOk means the displays must be enumerated directly.
+int DisplayShmRead(const struct DisplayShm *shm, int64_t now_ns,
+                   int64_t max_age_ns, struct DisplayShmSnapshot *snapshot);
+
+// Wall-clock time in nanoseconds, comparable across processes.
+int64_t DisplayShmNow(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DISPLAYMODE_SHM_H
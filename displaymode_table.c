@@ -0,0 +1,294 @@
+#include "displaymode_table.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "displaymode_line.h"
+#include "displaymode_parse.h"
+#include "displaymode_resolutions.h"
+
+// Strings every table starts with.
+static const char kUnknown[] = "Unknown";
+static const char kDisplay[] = "Display";
+
+// Interned strings are cut to fit DisplayModeInfo.resCategory and friends.
+#define kMaxStringLength 127
+
+uint32_t DisplayModeTableMillihertz(double refresh_rate) {
+    if (!(refresh_rate > 0.0)) {
+        return 0;
+    }
+    if (refresh_rate >= UINT32_MAX / 1000.0) {
+        return UINT32_MAX;
+    }
+    return (uint32_t)lround(refresh_rate * 1000.0);
+}
+
+uint8_t DisplayModeTableIntern(struct DisplayModeTable *table,
+                               const char *string) {
+    size_t length = strlen(string);
+    if (length > kMaxStringLength) {
+        length = kMaxStringLength;
+    }
+    for (size_t i = 0; i < table->num_strings; ++i) {
+        if (strncmp(table->strings[i], string, length) == 0 &&
+            table->strings[i][length] == '\0') {
+            return (uint8_t)i;
+        }
+    }
+    if (table->num_strings == kModeTableMaxStrings) {
+        return 0;
+    }
+    char *copy = malloc(length + 1);
+    if (copy == NULL) {
+        return 0;
+    }
+    memcpy(copy, string, length);
+    copy[length] = '\0';
+    table->strings[table->num_strings] = copy;
+    return (uint8_t)table->num_strings++;
+}
+
+// What SetRow remembers between rows of one table.
+struct RowClassifier {
+    uint8_t standard;
+    uint8_t low_res;
+    // ID of each standard resolution's name, interned on first use (0 until
+    // then).
+    uint8_t names[kResolutionSlots];
+    // The last resolution that isn't standard and its aspect ratio: lists
+    // give each resolution's refresh rates one after another.
+    size_t last_width;
+    size_t last_height;
+    uint32_t last_aspect;
+};
+
+static uint32_t PackAspect(uint32_t aspect_w, uint32_t aspect_h) {
+    return (aspect_w < 0xffff ? aspect_w : 0xffff) << 16 |
+           (aspect_h < 0xffff ? aspect_h : 0xffff);
+}
+
+// Fills in row "row" from "mode".
+static void SetRow(struct DisplayModeTable *table, size_t row,
+                   const struct DisplayMode *mode, int is_current,
+                   struct RowClassifier *classifier) {
+    table->resolution[row] =
+        DisplayModeTablePackResolution(mode->width, mode->height);
+    table->refresh_rate[row] = mode->refresh_rate;
+    table->refresh_mhz[row] = DisplayModeTableMillihertz(mode->refresh_rate);
+    const struct StandardResolution *standard =
+        StandardResolutionFind(mode->width, mode->height);
+    if (standard != NULL) {
+        const size_t index = (size_t)(standard - kStandardResolutions);
+        if (classifier->names[index] == 0) {
+            classifier->names[index] =
+                DisplayModeTableIntern(table, standard->name);
+        }
+        table->aspect[row] = PackAspect(standard->aspect_w, standard->aspect_h);
+        table->category[row] = classifier->names[index];
+    } else {
+        if (mode->width != classifier->last_width ||
+            mode->height != classifier->last_height) {
+            // Aspect ratio in lowest terms.
+            int a = (int)mode->width, b = (int)mode->height;
+            while (b != 0) {
+                const int t = b;
+                b = a % b;
+                a = t;
+            }
+            const uint32_t aspect_w = a ? (uint32_t)((int)mode->width / a) : 0;
+            const uint32_t aspect_h = a ? (uint32_t)((int)mode->height / a) : 0;
+            classifier->last_width = mode->width;
+            classifier->last_height = mode->height;
+            classifier->last_aspect = PackAspect(aspect_w, aspect_h);
+        }
+        table->aspect[row] = classifier->last_aspect;
+        table->category[row] = mode->width < 1024 || mode->height < 768
+                               ? classifier->low_res : classifier->standard;
+    }
+    table->mode_id[row] = mode->mode_id;
+    // HiDPI needs the display's size; see DisplayModeTableDescribe.
+    table->flags[row] = (uint8_t)((mode->usable_for_desktop ? kModeFlagUsable : 0) |
+                                  (is_current ? kModeFlagCurrent : 0));
+    // The display APIs don't give the pixel encoding (color depth); the EDID
+    // may.
+    table->encoding[row] = 0;
+    table->display_name[row] = 1;
+}
+
+int DisplayModeTableBuild(struct DisplayModeTable *table,
+                          const struct DisplayModeList *list) {
+    memset(table, 0, sizeof(*table));
+    const int unlisted_current = list->current_index < 0 && list->has_current;
+    const size_t count = list->count + (size_t)unlisted_current;
+
+    // One block holds the string table and every column, widest first so
+    // each stays aligned.
+    const size_t wide_columns =
+        sizeof(double) + 3 * sizeof(uint32_t) + sizeof(int32_t);
+    const size_t narrow_columns = 4 * sizeof(uint8_t);
+    const size_t strings_size = kModeTableMaxStrings * sizeof(char *);
+    unsigned char *block = malloc(strings_size + (count ? count : 1) *
+                                  (wide_columns + narrow_columns));
+    if (block == NULL) {
+        return -1;
+    }
+    table->strings = (char **)block;
+    table->refresh_rate = (double *)(block + strings_size);
+    table->resolution = (uint32_t *)(table->refresh_rate + count);
+    table->refresh_mhz = table->resolution + count;
+    table->aspect = table->refresh_mhz + count;
+    table->mode_id = (int32_t *)(table->aspect + count);
+    table->flags = (uint8_t *)(table->mode_id + count);
+    table->encoding = table->flags + count;
+    table->display_name = table->encoding + count;
+    table->category = table->display_name + count;
+    table->count = count;
+    table->num_listed = list->count;
+
+    // IDs 0 and 1 are the encoding and display name of every mode.
+    DisplayModeTableIntern(table, kUnknown);
+    DisplayModeTableIntern(table, kDisplay);
+    if (table->num_strings != 2) {
+        DisplayModeTableFree(table);
+        return -1;
+    }
+    // Modes of standard resolutions are categorized by name (like "1080p"),
+    // others as "Standard" or "LowRes".
+    struct RowClassifier classifier = {
+        .standard = DisplayModeTableIntern(table, "Standard"),
+        .low_res = DisplayModeTableIntern(table, "LowRes"),
+        .last_width = SIZE_MAX,
+    };
+
+    for (size_t i = 0; i < list->count; ++i) {
+        SetRow(table, i, &list->modes[i], (ptrdiff_t)i == list->current_index,
+               &classifier);
+    }
+    if (unlisted_current) {
+        SetRow(table, list->count, &list->current, 1, &classifier);
+    }
+    return 0;
+}
+
+void DisplayModeTableDescribe(struct DisplayModeTable *table,
+                              const struct EdidInfo *edid) {
+    char string[kEdidMaxString];
+    EdidDisplayName(edid, string, sizeof(string));
+    const uint8_t name = DisplayModeTableIntern(table, string);
+    EdidPixelEncoding(edid, string, sizeof(string));
+    const uint8_t encoding = DisplayModeTableIntern(table, string);
+    const uint8_t hidpi = DisplayModeTableIntern(table, "HiDPI");
+    for (size_t row = 0; row < table->count; ++row) {
+        table->display_name[row] = name;
+        table->encoding[row] = encoding;
+        // As in the original listing, a HiDPI mode's category is "HiDPI".
+        if (EdidIsHiDpi(edid, table->resolution[row] >> 16)) {
+            table->flags[row] |= kModeFlagHiDPI;
+            table->category[row] = hidpi;
+        }
+    }
+}
+
+// Appends "rate" with one decimal, rounded as "%.1f" rounds it.
+static void PutRefreshRate(struct LineWriter *w, double rate) {
+    // printf rounds the exact binary value; only a rate within a hair of a
+    // half tenth needs that, and the product below is off by far less.
+    const double scaled = rate * 10.0;
+    if (scaled >= 0.0 && scaled < 1e9) {
+        const double whole = floor(scaled);
+        const double fraction = scaled - whole;
+        if (fabs(fraction - 0.5) > 1e-6) {
+            const uint64_t tenths = (uint64_t)whole + (fraction > 0.5);
+            LineWriterPutUint(w, tenths / 10);
+            const char digits[2] = {'.', (char)('0' + tenths % 10)};
+            LineWriterPut(w, digits, 2);
+            return;
+        }
+    }
+    char text[32];
+    const int n = snprintf(text, sizeof(text), "%.1f", rate);
+    LineWriterPut(w, text, n > 0 && (size_t)n < sizeof(text) ? (size_t)n : 0);
+}
+
+int DisplayModeTableFormatRow(const struct DisplayModeTable *table, size_t row,
+                              char *out, size_t out_size) {
+    struct LineWriter w = {out, out_size, 0};
+    const uint32_t resolution = table->resolution[row];
+    const uint32_t aspect = table->aspect[row];
+    const uint8_t flags = table->flags[row];
+
+    LineWriterPutUint(&w, resolution >> 16);
+    LineWriterPut(&w, " x ", 3);
+    LineWriterPutUint(&w, resolution & 0xffff);
+    LineWriterPut(&w, " @", 2);
+    PutRefreshRate(&w, table->refresh_rate[row]);
+    LineWriterPut(&w, "Hz AR:", 6);
+    LineWriterPutUint(&w, aspect >> 16);
+    LineWriterPut(&w, ":", 1);
+    LineWriterPutUint(&w, aspect & 0xffff);
+    LineWriterPut(&w, " Enc:", 5);
+    LineWriterPutString(&w, table->strings[table->encoding[row]]);
+    LineWriterPut(&w, " ModeID:", 8);
+    LineWriterPutInt(&w, table->mode_id[row]);
+    LineWriterPutString(&w, flags & kModeFlagHiDPI ? " HiDPI " : " Std ");
+    LineWriterPutString(&w, table->strings[table->display_name[row]]);
+    LineWriterPut(&w, " Cat:", 5);
+    LineWriterPutString(&w, table->strings[table->category[row]]);
+    if (!(flags & kModeFlagUsable)) {
+        LineWriterPut(&w, " !", 2);
+    }
+    if (out_size > 0) {
+        out[w.length < out_size ? w.length : out_size - 1] = '\0';
+    }
+    return (int)w.length;
+}
+
+ptrdiff_t DisplayModeTableFind(const struct DisplayModeTable *table,
+                               size_t width, size_t height,
+                               double refresh_rate) {
+    if (width > 0xffff || height > 0xffff) {
+        return -1;
+    }
+    const uint32_t resolution = DisplayModeTablePackResolution(width, height);
+    const uint32_t *resolutions = table->resolution;
+    const size_t count = table->num_listed;
+    if (refresh_rate == 0.0) {
+        for (size_t i = 0; i < count; ++i) {
+            if (resolutions[i] == resolution) {
+                return (ptrdiff_t)i;
+            }
+        }
+        return -1;
+    }
+    const int64_t mhz = DisplayModeTableMillihertz(refresh_rate);
+    const int64_t tolerance = (int64_t)(kRefreshRateTolerance * 1000.0 + 0.5);
+    for (size_t i = 0; i < count; ++i) {
+        if (resolutions[i] == resolution) {
+            const int64_t difference = (int64_t)table->refresh_mhz[i] - mhz;
+            if (difference > -tolerance && difference < tolerance) {
+                return (ptrdiff_t)i;
+            }
+        }
+    }
+    return -1;
+}
+
+size_t DisplayModeTableBytes(const struct DisplayModeTable *table) {
+    size_t bytes = table->count * (sizeof(double) + 3 * sizeof(uint32_t) +
+                                   sizeof(int32_t) + 4 * sizeof(uint8_t));
+    for (size_t i = 0; i < table->num_strings; ++i) {
+        bytes += strlen(table->strings[i]) + 1;
+    }
+    return bytes;
+}
+
+void DisplayModeTableFree(struct DisplayModeTable *table) {
+    for (size_t i = 0; i < table->num_strings; ++i) {
+        free(table->strings[i]);
+    }
+    free(table->strings);
+    memset(table, 0, sizeof(*table));
+}
@@ -0,0 +1,102 @@
+#ifndef DISPLAYMODE_TABLE_H
+#define DISPLAYMODE_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "displaymode_backend.h"
+#include "displaymode_edid.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Bits of DisplayModeTable.flags.
+enum {
+    kModeFlagHiDPI = 1 << 0,
+    kModeFlagUsable = 1 << 1,
+    kModeFlagCurrent = 1 << 2,
+};
+
+// Most distinct strings in one table; string IDs are one byte.
+#define kModeTableMaxStrings 256
+
+// Longest line DisplayModeTableFormatRow writes, plus the terminator.
+#define kModeTableMaxLine 256
+
+// A display's modes in columns, as "d" lists and "t" searches them: about
+// 28 bytes per mode instead of a ~250-byte DisplayModeInfo, most of which
+// would be the same few strings.  Row i is modes[i] of the list it was
+// built from; if the current mode isn't listed, it follows as one more row.
+struct DisplayModeTable {
+    size_t count;       // rows, including an unlisted current mode
+    size_t num_listed;  // rows that are in the mode list
+    // (width << 16) | height, each clamped to 65535.
+    uint32_t *resolution;
+    // Refresh rate as the backend gave it (Hz), for formatting.
+    double *refresh_rate;
+    // Refresh rate in millihertz, for searching and grouping.
+    uint32_t *refresh_mhz;
+    // (aspect width << 16) | aspect height, in lowest terms.
+    uint32_t *aspect;
+    int32_t *mode_id;
+    uint8_t *flags;
+    // String IDs, indices into "strings".
+    uint8_t *encoding;
+    uint8_t *display_name;
+    uint8_t *category;
+    // Room for kModeTableMaxStrings, allocated with the columns so that an
+    // unbuilt table stays small.
+    char **strings;
+    size_t num_strings;
+};
+
+static inline uint32_t DisplayModeTablePackResolution(size_t width,
+                                                      size_t height) {
+    return (uint32_t)(width < 0xffff ? width : 0xffff) << 16 |
+           (uint32_t)(height < 0xffff ? height : 0xffff);
+}
+
+// Converts "refresh_rate" (Hz) to millihertz, rounding to nearest.
+uint32_t DisplayModeTableMillihertz(double refresh_rate);
+
+// Builds the table for "list".  Returns 0, or -1 if out of memory.
+int DisplayModeTableBuild(struct DisplayModeTable *table,
+                          const struct DisplayModeList *list);
+
+// Fills in what the display's EDID tells about every row: the display name,
+// the pixel encoding, and whether the mode is HiDPI (has at least
+// kEdidHiDpiMinDpi across the display).  Without it, rows have the display
+// name "Display", an "Unknown" encoding and no HiDPI flag.
+void DisplayModeTableDescribe(struct DisplayModeTable *table,
+                              const struct EdidInfo *edid);
+
+// Returns the ID of "string", adding it if it's new (and there's room; if
+// not, or if out of memory, returns the ID of "Unknown").  Strings longer
+// than 127 bytes are truncated.
+uint8_t DisplayModeTableIntern(struct DisplayModeTable *table,
+                               const char *string);
+
+// Formats row "row" as one line of the "d" listing (without the current
+// marker and newline), byte for byte as FormatDisplayModeInfo formats the
+// same mode.  Returns the length of the full line, like snprintf.
+int DisplayModeTableFormatRow(const struct DisplayModeTable *table, size_t row,
+                              char *out, size_t out_size);
+
+// Returns the first listed row with the given resolution whose refresh rate
+// is within kRefreshRateTolerance of "refresh_rate" (compared in whole
+// millihertz; 0.0 matches any), or -1.
+ptrdiff_t DisplayModeTableFind(const struct DisplayModeTable *table,
+                               size_t width, size_t height,
+                               double refresh_rate);
+
+// Returns the bytes used by the table's columns and strings.
+size_t DisplayModeTableBytes(const struct DisplayModeTable *table);
+
+void DisplayModeTableFree(struct DisplayModeTable *table);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DISPLAYMODE_TABLE_H
@@ -0,0 +1,310 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "displaymode_trace.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "displaymode_json.h"
+#include "logging.h"
+
+int trace_enabled;
+
+struct TraceEvent {
+    const char *name;
+    const char *category;
+    uint64_t start_ns;
+    uint64_t duration_ns;
+    int64_t display;
+    uint32_t thread;
+};
+
+// The running trace.  Recording takes the lock; spans are coarse (one per
+// backend call or phase), so it is rarely contended.
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static FILE *trace_file;
+static struct TraceEvent *events;
+static size_t num_events;
+static size_t events_capacity;
+static size_t dropped_events;
+
+// Small per-thread IDs, so the trace viewer shows one row per thread.
+static atomic_uint next_thread_id = 1;
+static _Thread_local uint32_t thread_id;
+
+uint64_t TraceNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    const uint64_t now = (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+    return now != 0 ? now : 1;
+}
+
+int TraceStart(const char *path) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        return -1;
+    }
+    pthread_mutex_lock(&trace_lock);
+    if (trace_file != NULL) {
+        fclose(trace_file);
+    }
+    trace_file = file;
+    num_events = 0;
+    dropped_events = 0;
+    trace_enabled = 1;
+    pthread_mutex_unlock(&trace_lock);
+    return 0;
+}
+
+void TraceRecord(const char *name, const char *category, uint64_t start_ns,
+                 uint64_t end_ns, int64_t display) {
+    if (thread_id == 0) {
+        thread_id = atomic_fetch_add(&next_thread_id, 1);
+    }
+    pthread_mutex_lock(&trace_lock);
+    if (!trace_enabled) {
+        pthread_mutex_unlock(&trace_lock);
+        return;
+    }
+    if (num_events == events_capacity) {
+        const size_t capacity = events_capacity ? 2 * events_capacity : 256;
+        struct TraceEvent *grown = capacity <= kTraceMaxEvents
+            ? realloc(events, capacity * sizeof(events[0])) : NULL;
+        if (grown == NULL) {
+            ++dropped_events;
+            pthread_mutex_unlock(&trace_lock);
+            return;
+        }
+        events = grown;
+        events_capacity = capacity;
+    }
+    struct TraceEvent *event = &events[num_events++];
+    event->name = name;
+    event->category = category;
+    event->start_ns = start_ns;
+    event->duration_ns = end_ns > start_ns ? end_ns - start_ns : 0;
+    event->display = display;
+    event->thread = thread_id;
+    pthread_mutex_unlock(&trace_lock);
+}
+
+size_t TraceEventCount(void) {
+    pthread_mutex_lock(&trace_lock);
+    const size_t count = num_events;
+    pthread_mutex_unlock(&trace_lock);
+    return count;
+}
+
+// Writes the events as a JSON object with "traceEvents" of complete ("X")
+// events, timed in microseconds from the earliest span.
+static int WriteTrace(FILE *file) {
+    uint64_t origin = UINT64_MAX;
+    for (size_t i = 0; i < num_events; ++i) {
+        if (events[i].start_ns < origin) {
+            origin = events[i].start_ns;
+        }
+    }
+    const int pid = (int)getpid();
+
+    struct JsonWriter json;
+    JsonWriterInit(&json, file);
+    JsonWriterBeginObject(&json);
+    JsonWriterKey(&json, "traceEvents");
+    JsonWriterBeginArray(&json);
+    JsonWriterBeginObject(&json);
+    JsonWriterKey(&json, "name");
+    JsonWriterString(&json, "process_name");
+    JsonWriterKey(&json, "ph");
+    JsonWriterString(&json, "M");
+    JsonWriterKey(&json, "pid");
+    JsonWriterInt(&json, pid);
+    JsonWriterKey(&json, "args");
+    JsonWriterBeginObject(&json);
+    JsonWriterKey(&json, "name");
+    JsonWriterString(&json, "displaymode");
+    JsonWriterEndObject(&json);
+    JsonWriterEndObject(&json);
+    for (size_t i = 0; i < num_events; ++i) {
+        const struct TraceEvent *event = &events[i];
+        JsonWriterBeginObject(&json);
+        JsonWriterKey(&json, "name");
+        JsonWriterString(&json, event->name);
+        JsonWriterKey(&json, "cat");
+        JsonWriterString(&json, event->category);
+        JsonWriterKey(&json, "ph");
+        JsonWriterString(&json, "X");
+        JsonWriterKey(&json, "ts");
+        JsonWriterDouble(&json, (double)(event->start_ns - origin) / 1000.0);
+        JsonWriterKey(&json, "dur");
+        JsonWriterDouble(&json, (double)event->duration_ns / 1000.0);
+        JsonWriterKey(&json, "pid");
+        JsonWriterInt(&json, pid);
+        JsonWriterKey(&json, "tid");
+        JsonWriterUint(&json, event->thread);
+        if (event->display >= 0) {
+            JsonWriterKey(&json, "args");
+            JsonWriterBeginObject(&json);
+            JsonWriterKey(&json, "display");
+            JsonWriterInt(&json, event->display);
+            JsonWriterEndObject(&json);
+        }
+        JsonWriterEndObject(&json);
+    }
+    JsonWriterEndArray(&json);
+    JsonWriterKey(&json, "displayTimeUnit");
+    JsonWriterString(&json, "ns");
+    JsonWriterEndObject(&json);
+    JsonWriterEndLine(&json);
+    return JsonWriterFlush(&json);
+}
+
+int TraceStop(void) {
+    pthread_mutex_lock(&trace_lock);
+    if (trace_file == NULL) {
+        pthread_mutex_unlock(&trace_lock);
+        return 0;
+    }
+    trace_enabled = 0;
+    if (dropped_events > 0) {
+        LOG_WARN("Trace full; dropped %zu spans", dropped_events);
+    }
+    int e = WriteTrace(trace_file);
+    if (fclose(trace_file) != 0) {
+        e = -1;
+    }
+    trace_file = NULL;
+    free(events);
+    events = NULL;
+    num_events = 0;
+    events_capacity = 0;
+    pthread_mutex_unlock(&trace_lock);
+    return e ? -1 : 0;
+}
+
+// The backend wrapper.  Each function times the call it forwards.
+
+static int TracedGetActiveDisplays(void *context, uint32_t max_displays,
+                                   uint32_t *displays, uint32_t *num_displays) {
+    const struct DisplayBackend *inner = ((struct TraceBackend *)context)->inner;
+    struct TraceSpan span;
+    TraceSpanBegin(&span, "get_active_displays", "backend");
+    const int e = inner->get_active_displays(inner->context, max_displays,
+                                             displays, num_displays);
+    TraceSpanEnd(&span);
+    return e;
+}
+
+static int TracedCopyModes(void *context, uint32_t display,
+                           struct DisplayModeList *list) {
+    const struct DisplayBackend *inner = ((struct TraceBackend *)context)->inner;
+    struct TraceSpan span;
+    TraceSpanBegin(&span, "copy_modes", "backend");
+    span.display = display;
+    const int e = inner->copy_modes(inner->context, display, list);
+    TraceSpanEnd(&span);
+    return e;
+}
+
+static void TracedReleaseModes(void *context, struct DisplayModeList *list) {
+    const struct DisplayBackend *inner = ((struct TraceBackend *)context)->inner;
+    struct TraceSpan span;
+    TraceSpanBegin(&span, "release_modes", "backend");
+    inner->release_modes(inner->context, list);
+    TraceSpanEnd(&span);
+}
+
+static int TracedCopyCurrentMode(void *context, uint32_t display,
+                                 struct DisplayModeList *list) {
+    const struct DisplayBackend *inner = ((struct TraceBackend *)context)->inner;
+    struct TraceSpan span;
+    TraceSpanBegin(&span, "copy_current_mode", "backend");
+    span.display = display;
+    const int e = inner->copy_current_mode(inner->context, display, list);
+    TraceSpanEnd(&span);
+    return e;
+}
+
+static int TracedGetDisplayIdentity(void *context, uint32_t display,
+                                    struct DisplayIdentity *identity) {
+    const struct DisplayBackend *inner = ((struct TraceBackend *)context)->inner;
+    struct TraceSpan span;
+    TraceSpanBegin(&span, "get_display_identity", "backend");
+    span.display = display;
+    const int e = inner->get_display_identity(inner->context, display, identity);
+    TraceSpanEnd(&span);
+    return e;
+}
+
+static int TracedGetEdid(void *context, uint32_t display,
+                         const unsigned char **data, size_t *size) {
+    const struct DisplayBackend *inner = ((struct TraceBackend *)context)->inner;
+    struct TraceSpan span;
+    TraceSpanBegin(&span, "get_edid", "backend");
+    span.display = display;
+    const int e = inner->get_edid(inner->context, display, data, size);
+    TraceSpanEnd(&span);
+    return e;
+}
+
+static int TracedBeginConfiguration(void *context, void **config) {
+    const struct DisplayBackend *inner = ((struct TraceBackend *)context)->inner;
+    struct TraceSpan span;
+    TraceSpanBegin(&span, "begin_configuration", "backend");
+    const int e = inner->begin_configuration(inner->context, config);
+    TraceSpanEnd(&span);
+    return e;
+}
+
+static int TracedConfigureDisplay(void *context, void *config, uint32_t display,
+                                  const struct DisplayMode *mode) {
+    const struct DisplayBackend *inner = ((struct TraceBackend *)context)->inner;
+    struct TraceSpan span;
+    TraceSpanBegin(&span, "configure_display", "backend");
+    span.display = display;
+    const int e = inner->configure_display(inner->context, config, display, mode);
+    TraceSpanEnd(&span);
+    return e;
+}
+
+static int TracedCompleteConfiguration(void *context, void *config) {
+    const struct DisplayBackend *inner = ((struct TraceBackend *)context)->inner;
+    struct TraceSpan span;
+    TraceSpanBegin(&span, "complete_configuration", "backend");
+    const int e = inner->complete_configuration(inner->context, config);
+    TraceSpanEnd(&span);
+    return e;
+}
+
+static void TracedCancelConfiguration(void *context, void *config) {
+    const struct DisplayBackend *inner = ((struct TraceBackend *)context)->inner;
+    struct TraceSpan span;
+    TraceSpanBegin(&span, "cancel_configuration", "backend");
+    inner->cancel_configuration(inner->context, config);
+    TraceSpanEnd(&span);
+}
+
+const struct DisplayBackend *TraceBackendWrap(struct TraceBackend *wrapper,
+                                              const struct DisplayBackend *inner) {
+    struct DisplayBackend *backend = &wrapper->backend;
+    wrapper->inner = inner;
+    backend->context = wrapper;
+    backend->get_active_displays = TracedGetActiveDisplays;
+    backend->copy_modes = TracedCopyModes;
+    backend->release_modes = TracedReleaseModes;
+    // Optional functions stay optional.
+    backend->copy_current_mode =
+        inner->copy_current_mode ? TracedCopyCurrentMode : NULL;
+    backend->get_display_identity =
+        inner->get_display_identity ? TracedGetDisplayIdentity : NULL;
+    backend->get_edid = inner->get_edid ? TracedGetEdid : NULL;
+    backend->begin_configuration = TracedBeginConfiguration;
+    backend->configure_display = TracedConfigureDisplay;
+    backend->complete_configuration = TracedCompleteConfiguration;
+    backend->cancel_configuration = TracedCancelConfiguration;
+    backend->concurrent_copy_modes = inner->concurrent_copy_modes;
+    return backend;
+}
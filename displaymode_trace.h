@@ -0,0 +1,80 @@
+#ifndef DISPLAYMODE_TRACE_H
+#define DISPLAYMODE_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "displaymode_backend.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Most events kept by one trace; later ones are dropped.
+#define kTraceMaxEvents (1 << 20)
+
+// Spans of time recorded for --trace and written as Chrome trace-event JSON,
+// which chrome://tracing and ui.perfetto.dev can show.  While no trace is
+// running, a span costs a load and a branch at each end.
+
+// Non-zero while a trace is running.  Read by the inline span functions.
+extern int trace_enabled;
+
+// One span being timed.  Spans on one thread must nest.
+struct TraceSpan {
+    const char *name;      // a string literal, as it isn't copied
+    const char *category;  // likewise
+    uint64_t start_ns;     // 0 if no trace was running when it began
+    int64_t display;       // display ID recorded with the span, or -1
+};
+
+// Returns the monotonic clock in nanoseconds (never 0).
+uint64_t TraceNow(void);
+
+// Starts a trace to be written to "path" by TraceStop.  Returns 0, or -1 if
+// the file can't be created (and then no trace runs).
+int TraceStart(const char *path);
+
+// Writes the trace and stops it.  Returns 0, or -1 if the file couldn't be
+// written.  Does nothing if no trace is running.
+int TraceStop(void);
+
+// Records a span that has already ended, e.g. one that began before the
+// trace was started.  "display" is -1 unless the span concerns one display.
+void TraceRecord(const char *name, const char *category, uint64_t start_ns,
+                 uint64_t end_ns, int64_t display);
+
+// Returns the number of spans recorded by the running trace.
+size_t TraceEventCount(void);
+
+static inline void TraceSpanBegin(struct TraceSpan *span, const char *name,
+                                  const char *category) {
+    span->name = name;
+    span->category = category;
+    span->display = -1;
+    span->start_ns = trace_enabled ? TraceNow() : 0;
+}
+
+static inline void TraceSpanEnd(const struct TraceSpan *span) {
+    if (span->start_ns != 0) {
+        TraceRecord(span->name, span->category, span->start_ns, TraceNow(),
+                    span->display);
+    }
+}
+
+// A backend whose every call is recorded as a span (category "backend")
+// before being passed on to "inner".
+struct TraceBackend {
+    struct DisplayBackend backend;
+    const struct DisplayBackend *inner;
+};
+
+// Sets up "wrapper" around "inner" and returns its backend.
+const struct DisplayBackend *TraceBackendWrap(struct TraceBackend *wrapper,
+                                              const struct DisplayBackend *inner);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DISPLAYMODE_TRACE_H
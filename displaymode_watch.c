@@ -0,0 +1,409 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "displaymode_watch.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "displaymode_json.h"
+#include "displaymode_output.h"
+#include "logging.h"
+
+// Events read from the source per call.
+#define kEventsPerWait 64
+
+// Collected events are merged once there are this many, so that a storm of
+// events for a few displays doesn't grow the burst without bound.
+#define kEventsBeforeMerge 4096
+
+static int64_t NowMs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int CompareEvents(const void *a, const void *b) {
+    const uint32_t x = ((const struct DisplayEvent *)a)->display;
+    const uint32_t y = ((const struct DisplayEvent *)b)->display;
+    return (x > y) - (x < y);
+}
+
+// Sorts "events" by display and merges the events of each display into one.
+// Returns the number of events left.
+static size_t MergeEvents(struct DisplayEvent *events, size_t count) {
+    qsort(events, count, sizeof(events[0]), CompareEvents);
+    size_t merged = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (merged > 0 && events[merged - 1].display == events[i].display) {
+            events[merged - 1].flags |= events[i].flags;
+        } else {
+            events[merged++] = events[i];
+        }
+    }
+    return merged;
+}
+
+// A display ID and its position in a display list, for matching two lists
+// by ID in linear time after sorting.
+struct IdIndex {
+    uint32_t id;
+    uint32_t index;
+};
+
+static int CompareIdIndex(const void *a, const void *b) {
+    const uint32_t x = ((const struct IdIndex *)a)->id;
+    const uint32_t y = ((const struct IdIndex *)b)->id;
+    return (x > y) - (x < y);
+}
+
+// Returns the IDs of "known" sorted, with their positions (to be freed), or
+// NULL if out of memory.
+static struct IdIndex *SortKnown(const struct WatchedDisplay *known,
+                                 uint32_t count) {
+    struct IdIndex *sorted = malloc(((size_t)count + 1) * sizeof(*sorted));
+    if (sorted == NULL) {
+        return NULL;
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+        sorted[i].id = known[i].id;
+        sorted[i].index = i;
+    }
+    qsort(sorted, count, sizeof(sorted[0]), CompareIdIndex);
+    return sorted;
+}
+
+// Returns the position in "sorted" of "id", or -1.
+static ptrdiff_t FindId(const struct IdIndex *sorted, uint32_t count,
+                        uint32_t id) {
+    size_t low = 0;
+    size_t high = count;
+    while (low < high) {
+        const size_t mid = low + (high - low) / 2;
+        if (sorted[mid].id < id) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low < count && sorted[low].id == id ? (ptrdiff_t)low : -1;
+}
+
+// Re-reads the current mode of the catalog's display at "index" into
+// "display", dropping whatever the catalog knew about the display.
+static void ReadCurrentMode(struct DisplayWatch *watch, uint32_t index,
+                            struct WatchedDisplay *display, FILE *err) {
+    const struct DisplayModeList *list = NULL;
+    DisplayCatalogInvalidateDisplay(watch->catalog, index);
+    if (DisplayCatalogGetModes(watch->catalog, index, &list)) {
+        fprintf(err, "Failed to get display modes\n");
+    }
+    display->has_mode = list->has_current;
+    memset(&display->mode, 0, sizeof(display->mode));
+    if (list->has_current) {
+        display->mode = list->current;
+        // The handle dies with the catalog's mode list.
+        display->mode.handle = NULL;
+    }
+}
+
+static int SameMode(const struct WatchedDisplay *a,
+                    const struct WatchedDisplay *b) {
+    return a->has_mode == b->has_mode &&
+           (!a->has_mode || DisplayModesEqual(&a->mode, &b->mode));
+}
+
+// The kinds of change reported.
+enum DeltaKind {
+    kDeltaAdded,
+    kDeltaModeChanged,
+    kDeltaRemoved,
+};
+
+static const char *const kDeltaNames[] = {"added", "modeChanged", "removed"};
+static const char kDeltaSymbols[] = "+~-";
+
+static void AppendMode(struct OutputBuffer *output,
+                       const struct WatchedDisplay *display) {
+    if (display->has_mode) {
+        OutputBufferPrintf(output, "%zu x %zu @%.1fHz", display->mode.width,
+                           display->mode.height, display->mode.refresh_rate);
+    } else {
+        OutputBufferAppend(output, "unknown mode", 12);
+    }
+}
+
+static void WriteModeMembers(struct JsonWriter *json,
+                             const struct WatchedDisplay *display) {
+    if (!display->has_mode) {
+        return;
+    }
+    JsonWriterKey(json, "width");
+    JsonWriterUint(json, display->mode.width);
+    JsonWriterKey(json, "height");
+    JsonWriterUint(json, display->mode.height);
+    JsonWriterKey(json, "refreshRate");
+    JsonWriterDouble(json, display->mode.refresh_rate);
+}
+
+// Reports one change.  "previous" is only used for kDeltaModeChanged, and
+// "display" only for additions and mode changes.
+static void ReportDelta(struct DisplayWatch *watch, enum DeltaKind kind,
+                        uint32_t index, uint32_t id,
+                        const struct WatchedDisplay *previous,
+                        const struct WatchedDisplay *display,
+                        struct OutputBuffer *output, struct JsonWriter *json) {
+    if (watch->ndjson) {
+        JsonWriterBeginObject(json);
+        JsonWriterKey(json, "event");
+        JsonWriterString(json, kDeltaNames[kind]);
+        JsonWriterKey(json, "display");
+        JsonWriterUint(json, index);
+        JsonWriterKey(json, "id");
+        JsonWriterUint(json, id);
+        if (kind != kDeltaRemoved) {
+            WriteModeMembers(json, display);
+        }
+        if (kind == kDeltaModeChanged && previous->has_mode) {
+            JsonWriterKey(json, "from");
+            JsonWriterBeginObject(json);
+            WriteModeMembers(json, previous);
+            JsonWriterEndObject(json);
+        }
+        JsonWriterEndObject(json);
+        JsonWriterEndLine(json);
+        return;
+    }
+    OutputBufferPrintf(output, "%c display %u (id %u)", kDeltaSymbols[kind],
+                       index, id);
+    if (kind != kDeltaRemoved) {
+        OutputBufferAppend(output, ": ", 2);
+        if (kind == kDeltaModeChanged) {
+            AppendMode(output, previous);
+            OutputBufferAppend(output, " -> ", 4);
+        }
+        AppendMode(output, display);
+    }
+    OutputBufferAppend(output, "\n", 1);
+}
+
+int DisplayWatchApply(struct DisplayWatch *watch,
+                      const struct DisplayEvent *events, size_t count,
+                      FILE *out, FILE *err) {
+    struct DisplayCatalog *catalog = watch->catalog;
+    ++watch->bursts;
+    struct DisplayEvent *merged = malloc((count + 1) * sizeof(*merged));
+    struct IdIndex *old_sorted = SortKnown(watch->known, watch->num_known);
+    if (merged == NULL || old_sorted == NULL) {
+        free(merged);
+        free(old_sorted);
+        fprintf(err, "Out of memory watching displays\n");
+        return kDisplayErrorFailure;
+    }
+    if (count > 0) {
+        memcpy(merged, events, count * sizeof(*merged));
+    }
+    count = MergeEvents(merged, count);
+
+    // Displays coming or going, or unknown ones, need a new display list.
+    int rescan = 0;
+    int list_changed = 0;
+    for (size_t i = 0; i < count; ++i) {
+        rescan |= (merged[i].flags & kDisplayEventRescan) != 0;
+        list_changed |= (merged[i].flags &
+                         (kDisplayEventAdded | kDisplayEventRemoved)) != 0 ||
+            FindId(old_sorted, watch->num_known, merged[i].display) < 0;
+    }
+    int e = 0;
+    if ((rescan || list_changed) && (e = DisplayCatalogRevalidate(catalog))) {
+        fprintf(err, "CGGetActiveDisplayList CGError: %d\n", e);
+        free(merged);
+        free(old_sorted);
+        return e;
+    }
+
+    const uint32_t num_displays = catalog->num_displays;
+    struct WatchedDisplay *known =
+        malloc(((size_t)num_displays + 1) * sizeof(*known));
+    // Old position of each display, or -1 for new ones.
+    ptrdiff_t *old_index = malloc(((size_t)num_displays + 1) * sizeof(*old_index));
+    // Set for the old displays that are still there.
+    unsigned char *kept = calloc((size_t)watch->num_known + 1, 1);
+    if (known == NULL || old_index == NULL || kept == NULL) {
+        free(known);
+        free(old_index);
+        free(kept);
+        free(merged);
+        free(old_sorted);
+        fprintf(err, "Out of memory watching displays\n");
+        return kDisplayErrorFailure;
+    }
+
+    struct OutputBuffer output;
+    OutputBufferInit(&output);
+    struct JsonWriter *json = NULL;
+    if (watch->ndjson) {
+        json = malloc(sizeof(*json));
+        if (json != NULL) {
+            JsonWriterInit(json, out);
+        }
+    }
+
+    for (uint32_t i = 0; i < num_displays; ++i) {
+        const uint32_t id = catalog->displays[i];
+        const ptrdiff_t found = FindId(old_sorted, watch->num_known, id);
+        old_index[i] = found >= 0 ? (ptrdiff_t)old_sorted[found].index : -1;
+        if (old_index[i] >= 0) {
+            kept[old_index[i]] = 1;
+            known[i] = watch->known[old_index[i]];
+        }
+    }
+    for (uint32_t i = 0; i < watch->num_known; ++i) {
+        if (!kept[i]) {
+            ReportDelta(watch, kDeltaRemoved, i, watch->known[i].id, NULL,
+                        NULL, &output, json);
+        }
+    }
+    for (uint32_t i = 0; i < num_displays; ++i) {
+        const uint32_t id = catalog->displays[i];
+        if (old_index[i] < 0) {
+            known[i].id = id;
+            ReadCurrentMode(watch, i, &known[i], err);
+            ReportDelta(watch, kDeltaAdded, i, id, NULL, &known[i], &output,
+                        json);
+            continue;
+        }
+        // Only displays that events name are read again.
+        const struct DisplayEvent key = {id, 0};
+        if (!rescan &&
+            bsearch(&key, merged, count, sizeof(merged[0]), CompareEvents) ==
+            NULL) {
+            continue;
+        }
+        const struct WatchedDisplay previous = known[i];
+        ReadCurrentMode(watch, i, &known[i], err);
+        if (!SameMode(&previous, &known[i])) {
+            ReportDelta(watch, kDeltaModeChanged, i, id, &previous, &known[i],
+                        &output, json);
+        }
+    }
+
+    free(watch->known);
+    watch->known = known;
+    watch->num_known = num_displays;
+    free(old_index);
+    free(kept);
+    free(merged);
+    free(old_sorted);
+
+    int write_error;
+    if (watch->ndjson) {
+        write_error = json == NULL || JsonWriterFlush(json) || fflush(out);
+        free(json);
+    } else {
+        write_error = output.error || OutputBufferWrite(&output, out);
+    }
+    OutputBufferFree(&output);
+    if (write_error) {
+        fprintf(err, "Failed to write display changes\n");
+        return kDisplayErrorFailure;
+    }
+    return 0;
+}
+
+int DisplayWatchInit(struct DisplayWatch *watch, struct DisplayCatalog *catalog,
+                     int ndjson, FILE *out, FILE *err) {
+    memset(watch, 0, sizeof(*watch));
+    watch->catalog = catalog;
+    watch->ndjson = ndjson;
+    const int e = DisplayCatalogLoadDisplays(catalog);
+    if (e) {
+        fprintf(err, "CGGetActiveDisplayList CGError: %d\n", e);
+        return e;
+    }
+    // Every display is new to an empty watch.
+    const struct DisplayEvent rescan = {0, kDisplayEventRescan};
+    const int apply_error = DisplayWatchApply(watch, &rescan, 1, out, err);
+    watch->bursts = 0;
+    return apply_error;
+}
+
+void DisplayWatchFree(struct DisplayWatch *watch) {
+    free(watch->known);
+    free(watch->events);
+    memset(watch, 0, sizeof(*watch));
+}
+
+// Reads the events that arrive within "timeout_ms" into the burst.  Returns
+// the number read, -1 if the source ended, or -2 if memory ran out.
+static int CollectEvents(struct DisplayWatch *watch,
+                         const struct DisplayEventSource *source,
+                         int timeout_ms) {
+    if (watch->num_events >= kEventsBeforeMerge) {
+        watch->num_events = MergeEvents(watch->events, watch->num_events);
+    }
+    if (watch->events_capacity - watch->num_events < kEventsPerWait) {
+        const size_t capacity = watch->events_capacity * 2 + kEventsPerWait;
+        struct DisplayEvent *events =
+            realloc(watch->events, capacity * sizeof(*events));
+        if (events == NULL) {
+            return -2;
+        }
+        watch->events = events;
+        watch->events_capacity = capacity;
+    }
+    const int n = source->wait(source->context, timeout_ms,
+                               watch->events + watch->num_events,
+                               kEventsPerWait);
+    if (n > 0) {
+        watch->num_events += (size_t)n;
+    }
+    return n;
+}
+
+int DisplayWatchRun(struct DisplayWatch *watch,
+                    const struct DisplayEventSource *source, int coalesce_ms,
+                    FILE *out, FILE *err) {
+    for (;;) {
+        watch->num_events = 0;
+        int n = CollectEvents(watch, source, -1);
+        if (n == -2) {
+            fputs("Out of memory\n", err);
+            return EXIT_FAILURE;
+        }
+        if (n < 0) {
+            return EXIT_SUCCESS;
+        }
+        // Keep collecting until the burst goes quiet.
+        const int64_t start = NowMs();
+        int ended = 0;
+        for (;;) {
+            const int64_t remaining = kWatchMaxBurstMs - (NowMs() - start);
+            if (remaining <= 0) {
+                break;
+            }
+            n = CollectEvents(
+                watch, source,
+                coalesce_ms < remaining ? coalesce_ms : (int)remaining);
+            if (n == -2) {
+                fputs("Out of memory\n", err);
+                return EXIT_FAILURE;
+            }
+            if (n < 0) {
+                ended = 1;
+                break;
+            }
+            if (n == 0) {
+                break;
+            }
+        }
+        LOG_DEBUG("Applying %zu display events", watch->num_events);
+        if (DisplayWatchApply(watch, watch->events, watch->num_events, out,
+                              err)) {
+            return EXIT_FAILURE;
+        }
+        if (ended) {
+            return EXIT_SUCCESS;
+        }
+    }
+}
@@ -0,0 +1,98 @@
+#ifndef DISPLAYMODE_WATCH_H
+#define DISPLAYMODE_WATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "displaymode_backend.h"
+#include "displaymode_catalog.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Events of a burst closer together than this are applied together (ms).
+#define kWatchCoalesceMs 200
+
+// A burst is applied after this long even if events keep coming (ms).
+#define kWatchMaxBurstMs 2000
+
+// What changed about a display (like CGDisplayChangeSummaryFlags).
+enum {
+    kDisplayEventAdded = 1u << 0,
+    kDisplayEventRemoved = 1u << 1,
+    kDisplayEventModeChanged = 1u << 2,
+    // Events were lost; every display must be re-read.
+    kDisplayEventRescan = 1u << 3,
+};
+
+struct DisplayEvent {
+    uint32_t display;  // display ID
+    uint32_t flags;
+};
+
+// A stream of display reconfiguration events (like the callbacks registered
+// with CGDisplayRegisterReconfigurationCallback).
+struct DisplayEventSource {
+    void *context;
+    // Waits up to "timeout_ms" (forever if negative) for events and stores
+    // at most "max_events" of them.  Returns the number stored (0 if the
+    // timeout passed), or -1 once the stream has ended.
+    int (*wait)(void *context, int timeout_ms, struct DisplayEvent *events,
+                size_t max_events);
+};
+
+// The last reported state of one display.
+struct WatchedDisplay {
+    uint32_t id;
+    int has_mode;
+    struct DisplayMode mode;
+};
+
+// Follows the displays of a catalog, re-reading only the displays that
+// events name, and reports what changed.
+struct DisplayWatch {
+    struct DisplayCatalog *catalog;
+    int ndjson;
+    // Displays in catalog order.
+    struct WatchedDisplay *known;
+    uint32_t num_known;
+    // Events of the burst being collected.
+    struct DisplayEvent *events;
+    size_t num_events;
+    size_t events_capacity;
+    unsigned long bursts;
+};
+
+// Reads the current displays into "watch" and reports each as added.
+// Returns 0, or the backend's error.
+int DisplayWatchInit(struct DisplayWatch *watch, struct DisplayCatalog *catalog,
+                     int ndjson, FILE *out, FILE *err);
+
+void DisplayWatchFree(struct DisplayWatch *watch);
+
+// Applies one burst of events: re-reads the display list if displays came
+// or went, and the current mode of each display named, then reports the
+// differences, one line each, as
+//   + display <index> (id <id>): <width> x <height> @<refresh>Hz
+//   ~ display <index> (id <id>): <old mode> -> <new mode>
+//   - display <old index> (id <id>)
+// or as NDJSON objects with "event" set to "added", "modeChanged" or
+// "removed".  Returns 0, or the backend's error.
+int DisplayWatchApply(struct DisplayWatch *watch,
+                      const struct DisplayEvent *events, size_t count,
+                      FILE *out, FILE *err);
+
+// Collects events from "source" into bursts that end once no event has
+// arrived for "coalesce_ms" (or after kWatchMaxBurstMs), and applies each
+// burst.  Returns EXIT_SUCCESS when the source ends, or EXIT_FAILURE.
+int DisplayWatchRun(struct DisplayWatch *watch,
+                    const struct DisplayEventSource *source, int coalesce_ms,
+                    FILE *out, FILE *err);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DISPLAYMODE_WATCH_H
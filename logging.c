@@ -1,37 +1,285 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "logging.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stdarg.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <time.h>
+#include <unistd.h>
+
+// Number of queued messages (a power of two) and the longest message kept.
+#define kLogQueueSize 512
+#define kLogMessageSize 512
+
+// Size of the flusher's output batch.
+#define kLogBatchSize 65536
+
+// One queued message.  "sequence" implements a bounded multi-producer queue
+// (after Dmitry Vyukov's): a slot at position p is free for the producer
+// claiming p when sequence == p, and holds a message for the consumer when
+// sequence == p + 1.
+struct LogSlot {
+    atomic_size_t sequence;
+    LogLevel level;
+    time_t time;
+    size_t length;
+    char text[kLogMessageSize];
+};
+
+static atomic_int currentLogLevel = LOG_LEVEL_INFO;
 
-static LogLevel currentLogLevel = LOG_LEVEL_INFO;
+static struct LogSlot slots[kLogQueueSize];
+static atomic_size_t enqueue_position;
+static atomic_size_t dequeue_position;
+// Messages before this position have been written out.
+static atomic_size_t written_position;
+
+static pthread_once_t start_once = PTHREAD_ONCE_INIT;
+// Non-zero once the flusher thread runs; otherwise messages are written
+// synchronously.
+static int async_logging;
+static atomic_int flusher_sleeping;
+static pthread_mutex_t wake_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake_cond = PTHREAD_COND_INITIALIZER;
 
 void setLogLevel(LogLevel level) {
-    currentLogLevel = level;
+    atomic_store_explicit(&currentLogLevel, level, memory_order_relaxed);
+}
+
+int logIsEnabled(LogLevel level) {
+    return (int)level >= atomic_load_explicit(&currentLogLevel,
+                                              memory_order_relaxed);
+}
+
+static const char *LevelName(LogLevel level) {
+    switch (level) {
+        case LOG_LEVEL_DEBUG: return "DEBUG";
+        case LOG_LEVEL_INFO:  return "INFO";
+        case LOG_LEVEL_WARN:  return "WARN";
+        case LOG_LEVEL_ERROR: return "ERROR";
+        default:              return "UNKNOWN";
+    }
+}
+
+static void WriteAll(const char *data, size_t size) {
+    while (size > 0) {
+        const ssize_t written = write(STDERR_FILENO, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        data += written;
+        size -= (size_t)written;
+    }
+}
+
+// Formats "timestamp [LEVEL] text\n" into "out" (which has room for it).
+// The timestamp is only reformatted when the second changes.
+static size_t FormatLine(LogLevel level, time_t when, const char *text,
+                         size_t length, char *out) {
+    static time_t cached_second = (time_t)-1;
+    static char cached_time[20];
+    static size_t cached_time_length;
+    if (when != cached_second) {
+        struct tm local;
+        localtime_r(&when, &local);
+        cached_time_length = strftime(cached_time, sizeof(cached_time),
+                                      "%Y-%m-%d %H:%M:%S", &local);
+        cached_second = when;
+    }
+    const char *name = LevelName(level);
+    const size_t name_length = strlen(name);
+    char *p = out;
+    memcpy(p, cached_time, cached_time_length);
+    p += cached_time_length;
+    memcpy(p, " [", 2);
+    p += 2;
+    memcpy(p, name, name_length);
+    p += name_length;
+    memcpy(p, "] ", 2);
+    p += 2;
+    memcpy(p, text, length);
+    p += length;
+    *p++ = '\n';
+    return (size_t)(p - out);
+}
+
+// Longest line FormatLine produces.
+#define kLogLineSize (kLogMessageSize + 40)
+
+// Writes every queued message in batches.  Only the flusher thread calls
+// this.
+static void Drain(void) {
+    static char batch[kLogBatchSize];
+    size_t batch_length = 0;
+    size_t position = atomic_load_explicit(&dequeue_position,
+                                           memory_order_relaxed);
+    for (;;) {
+        struct LogSlot *slot = &slots[position & (kLogQueueSize - 1)];
+        const size_t sequence = atomic_load_explicit(&slot->sequence,
+                                                     memory_order_acquire);
+        if (sequence != position + 1) {
+            break;
+        }
+        if (batch_length + kLogLineSize > sizeof(batch)) {
+            WriteAll(batch, batch_length);
+            batch_length = 0;
+        }
+        batch_length += FormatLine(slot->level, slot->time, slot->text,
+                                   slot->length, batch + batch_length);
+        // Hand the slot back to producers, one lap later.
+        atomic_store_explicit(&slot->sequence, position + kLogQueueSize,
+                              memory_order_release);
+        ++position;
+        atomic_store_explicit(&dequeue_position, position,
+                              memory_order_relaxed);
+    }
+    WriteAll(batch, batch_length);
+    atomic_store_explicit(&written_position, position, memory_order_release);
+}
+
+static void WakeFlusher(void) {
+    if (atomic_load_explicit(&flusher_sleeping, memory_order_seq_cst)) {
+        pthread_mutex_lock(&wake_mutex);
+        pthread_cond_signal(&wake_cond);
+        pthread_mutex_unlock(&wake_mutex);
+    }
+}
+
+static void *FlusherMain(void *arg) {
+    (void)arg;
+    for (;;) {
+        Drain();
+        pthread_mutex_lock(&wake_mutex);
+        atomic_store_explicit(&flusher_sleeping, 1, memory_order_seq_cst);
+        // A message queued before the flag was set wouldn't wake us.
+        const size_t position = atomic_load_explicit(&dequeue_position,
+                                                     memory_order_relaxed);
+        const struct LogSlot *slot = &slots[position & (kLogQueueSize - 1)];
+        if (atomic_load_explicit(&slot->sequence, memory_order_seq_cst) !=
+            position + 1) {
+            // Wake up periodically anyway, in case of a missed signal.
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += 50 * 1000 * 1000;
+            if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_nsec -= 1000000000L;
+                ++deadline.tv_sec;
+            }
+            pthread_cond_timedwait(&wake_cond, &wake_mutex, &deadline);
+        }
+        atomic_store_explicit(&flusher_sleeping, 0, memory_order_relaxed);
+        pthread_mutex_unlock(&wake_mutex);
+    }
+    return NULL;
+}
+
+static void StartLogging(void) {
+    for (size_t i = 0; i < kLogQueueSize; ++i) {
+        atomic_init(&slots[i].sequence, i);
+    }
+    pthread_attr_t attributes;
+    pthread_t thread;
+    if (pthread_attr_init(&attributes) == 0) {
+        pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+        async_logging = pthread_create(&thread, &attributes, FlusherMain,
+                                       NULL) == 0;
+        pthread_attr_destroy(&attributes);
+    }
+    atexit(logFlush);
+}
+
+// Writes one message directly, for when there is no flusher thread.
+static void WriteSynchronously(LogLevel level, time_t when, const char *text,
+                               size_t length) {
+    static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    char line[kLogLineSize];
+    pthread_mutex_lock(&mutex);
+    const size_t line_length = FormatLine(level, when, text, length, line);
+    WriteAll(line, line_length);
+    pthread_mutex_unlock(&mutex);
 }
 
 void logMessage(LogLevel level, const char *format, ...) {
-    if (level < currentLogLevel) {
+    if (!logIsEnabled(level)) {
         return;
     }
+    pthread_once(&start_once, StartLogging);
+    const time_t now = time(NULL);
 
-    const char *levelStr;
-    switch (level) {
-        case LOG_LEVEL_DEBUG: levelStr = "DEBUG"; break;
-        case LOG_LEVEL_INFO:  levelStr = "INFO";  break;
-        case LOG_LEVEL_WARN:  levelStr = "WARN";  break;
-        case LOG_LEVEL_ERROR: levelStr = "ERROR"; break;
-        default:              levelStr = "UNKNOWN"; break;
+    if (!async_logging) {
+        char text[kLogMessageSize];
+        va_list args;
+        va_start(args, format);
+        const int length = vsnprintf(text, sizeof(text), format, args);
+        va_end(args);
+        if (length >= 0) {
+            WriteSynchronously(level, now, text,
+                               (size_t)length < sizeof(text) ? (size_t)length
+                                                             : sizeof(text) - 1);
+        }
+        return;
     }
 
-    time_t now = time(NULL);
-    char timeStr[20];
-    strftime(timeStr, sizeof(timeStr), "%Y-%m-%d %H:%M:%S", localtime(&now));
-
-    fprintf(stderr, "%s [%s] ", timeStr, levelStr);
+    // Claim a slot.  If the queue is full, wait for the flusher.
+    size_t position = atomic_load_explicit(&enqueue_position,
+                                           memory_order_relaxed);
+    struct LogSlot *slot;
+    for (;;) {
+        slot = &slots[position & (kLogQueueSize - 1)];
+        const size_t sequence = atomic_load_explicit(&slot->sequence,
+                                                     memory_order_acquire);
+        const intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+        if (difference == 0) {
+            if (atomic_compare_exchange_weak_explicit(
+                    &enqueue_position, &position, position + 1,
+                    memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (difference < 0) {
+            WakeFlusher();
+            sched_yield();
+            position = atomic_load_explicit(&enqueue_position,
+                                            memory_order_relaxed);
+        } else {
+            position = atomic_load_explicit(&enqueue_position,
+                                            memory_order_relaxed);
+        }
+    }
 
     va_list args;
     va_start(args, format);
-    vfprintf(stderr, format, args);
+    const int length = vsnprintf(slot->text, sizeof(slot->text), format, args);
     va_end(args);
+    slot->level = level;
+    slot->time = now;
+    slot->length = length < 0 ? 0
+        : (size_t)length < sizeof(slot->text) ? (size_t)length
+                                              : sizeof(slot->text) - 1;
+    atomic_store_explicit(&slot->sequence, position + 1, memory_order_seq_cst);
+    WakeFlusher();
+}
 
-    fprintf(stderr, "\n");
-}
\ No newline at end of file
+void logFlush(void) {
+    if (!async_logging) {
+        return;
+    }
+    const size_t target = atomic_load_explicit(&enqueue_position,
+                                               memory_order_acquire);
+    while (atomic_load_explicit(&written_position, memory_order_acquire) <
+           target) {
+        pthread_mutex_lock(&wake_mutex);
+        pthread_cond_signal(&wake_cond);
+        pthread_mutex_unlock(&wake_mutex);
+        const struct timespec pause = {0, 100 * 1000};
+        nanosleep(&pause, NULL);
+    }
+}
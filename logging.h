@@ -11,10 +11,48 @@ typedef enum {
     LOG_LEVEL_ERROR
 } LogLevel;
 
+// Messages below this level (0 = debug ... 3 = error) are compiled out of
+// the LOG_* macros entirely, e.g. with -DLOG_MIN_LEVEL=2.
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL 0
+#endif
+
+// Non-zero if messages at "level" are both compiled in and enabled.  Use it
+// to skip building expensive diagnostics.
+#define LOG_ENABLED(level) (LOG_MIN_LEVEL <= (int)(level) && logIsEnabled(level))
+
+#if LOG_MIN_LEVEL <= 0
+#define LOG_DEBUG(...) logMessage(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) ((void)0)
+#endif
+#if LOG_MIN_LEVEL <= 1
+#define LOG_INFO(...) logMessage(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) ((void)0)
+#endif
+#if LOG_MIN_LEVEL <= 2
+#define LOG_WARN(...) logMessage(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...) ((void)0)
+#endif
+#define LOG_ERROR(...) logMessage(LOG_LEVEL_ERROR, __VA_ARGS__)
+
 // Set the current log level
 void setLogLevel(LogLevel level);
 
-// Log a message
-void logMessage(LogLevel level, const char *format, ...);
+// Returns non-zero if messages at "level" are logged, so that callers can
+// skip building expensive diagnostics.
+int logIsEnabled(LogLevel level);
+
+// Log a message.  Safe to call from any thread: the message is formatted by
+// the caller into a lock-free queue, and a background thread timestamps the
+// queued messages and writes them to stderr in batches.
+void logMessage(LogLevel level, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+// Waits until every message logged so far has been written.  Called
+// automatically at exit.
+void logFlush(void);
 
-#endif // LOGGING_H
\ No newline at end of file
+#endif // LOGGING_H
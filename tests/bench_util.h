@@ -0,0 +1,74 @@
+#ifndef BENCH_UTIL_H
+#define BENCH_UTIL_H
+
+// Clock, fake-backend setup and measure loop shared by the benchmarks in
+// bench/ and the timing tests.  Needs _POSIX_C_SOURCE 200809L for
+// clock_gettime and open_memstream.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../displaymode_catalog.h"
+#include "../displaymode_commands.h"
+#include "../displaymode_parse.h"
+#include "fake_backend.h"
+
+// Monotonic time in nanoseconds.
+static inline double NowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+// Initializes "fake" with "num_displays" synthetic displays (IDs 1 up) of
+// "modes_per_display" modes each.
+static inline void BenchInitFake(struct FakeBackend *fake,
+                                 uint32_t num_displays,
+                                 size_t modes_per_display) {
+    FakeBackendInit(fake);
+    for (uint32_t i = 0; i < num_displays; ++i) {
+        FakeBackendAddSyntheticDisplay(fake, i + 1, modes_per_display);
+    }
+}
+
+// Initializes "catalog" over "fake" with every display's modes and mode
+// table loaded, so that what is measured next starts warm.
+static inline void BenchLoadCatalog(struct DisplayCatalog *catalog,
+                                    struct FakeBackend *fake) {
+    DisplayCatalogInit(catalog, &fake->backend);
+    DisplayCatalogLoadDisplays(catalog);
+    int *errors = malloc((catalog->num_displays + 1) * sizeof(*errors));
+    if (errors != NULL) {
+        DisplayCatalogLoadAllModes(catalog, errors);
+    }
+    free(errors);
+}
+
+// Runs "parsed_args" against "catalog" "runs" times into an in-memory
+// stream.  Returns the ns per run, and stores in "*bytes" (if not NULL) the
+// size of the output of one run.
+static inline double BenchMeasureCommand(struct DisplayCatalog *catalog,
+                                         const struct ParsedArgs *parsed_args,
+                                         int runs, size_t *bytes) {
+    char *text = NULL;
+    size_t length = 0;
+    double elapsed = 0.0;
+    for (int i = 0; i < runs; ++i) {
+        FILE *out = open_memstream(&text, &length);
+        const double start = NowNs();
+        RunCommand(catalog, parsed_args, out, stderr);
+        fflush(out);
+        elapsed += NowNs() - start;
+        fclose(out);
+        free(text);
+        text = NULL;
+    }
+    if (bytes != NULL) {
+        *bytes = length;
+    }
+    return elapsed / runs;
+}
+
+#endif
@@ -0,0 +1,332 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "fake_backend.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// A pending configuration: the requested mode index for each display.
+struct FakeConfig {
+    ptrdiff_t *mode_index;
+};
+
+static struct FakeDisplay *FindDisplay(struct FakeBackend *fake, uint32_t id) {
+    // Displays are usually added with consecutive IDs; try that first so that
+    // lookups stay constant-time with hundreds of displays.
+    if (fake->num_displays > 0 && id >= fake->displays[0].id &&
+        id - fake->displays[0].id < fake->num_displays &&
+        fake->displays[id - fake->displays[0].id].id == id) {
+        return &fake->displays[id - fake->displays[0].id];
+    }
+    for (uint32_t i = 0; i < fake->num_displays; ++i) {
+        if (fake->displays[i].id == id) {
+            return &fake->displays[i];
+        }
+    }
+    return NULL;
+}
+
+static void SleepMicroseconds(struct FakeBackend *fake, unsigned us) {
+    if (us == 0) {
+        return;
+    }
+    if (fake->use_virtual_time) {
+        __atomic_add_fetch(&fake->virtual_time_ns, (uint64_t)us * 1000,
+                           __ATOMIC_RELAXED);
+        return;
+    }
+    struct timespec delay = {us / 1000000, (long)(us % 1000000) * 1000};
+    while (nanosleep(&delay, &delay) != 0) {
+    }
+}
+
+static int FakeGetActiveDisplays(void *context, uint32_t max_displays,
+                                 uint32_t *displays, uint32_t *num_displays) {
+    struct FakeBackend *fake = context;
+    if (displays == NULL) {
+        // Like CGGetActiveDisplayList, only count the displays.
+        *num_displays = fake->num_displays;
+        return 0;
+    }
+    ++fake->get_active_displays_calls;
+    SleepMicroseconds(fake, fake->get_active_displays_delay_us);
+    uint32_t n = 0;
+    for (; n < fake->num_displays && n < max_displays; ++n) {
+        displays[n] = fake->displays[n].id;
+    }
+    *num_displays = n;
+    return 0;
+}
+
+static int FakeCopyModes(void *context, uint32_t id,
+                         struct DisplayModeList *list) {
+    struct FakeBackend *fake = context;
+    __atomic_add_fetch(&fake->copy_modes_calls, 1, __ATOMIC_RELAXED);
+    memset(list, 0, sizeof(*list));
+    list->current_index = -1;
+    const struct FakeDisplay *display = FindDisplay(fake, id);
+    SleepMicroseconds(fake, fake->copy_modes_delay_us +
+                      (display != NULL ? display->copy_modes_delay_us : 0));
+    if (display == NULL) {
+        return kDisplayErrorFailure;
+    }
+    list->modes = malloc((display->count ? display->count : 1) *
+                         sizeof(list->modes[0]));
+    if (list->modes == NULL) {
+        return kDisplayErrorFailure;
+    }
+    for (size_t i = 0; i < display->count; ++i) {
+        list->modes[i] = display->modes[i];
+        // Handles are 1-based mode indices.
+        list->modes[i].handle = (const void *)(uintptr_t)(i + 1);
+    }
+    list->count = display->count;
+    if (display->current_index >= 0) {
+        list->current_index = display->current_index;
+        list->current = list->modes[display->current_index];
+        list->has_current = 1;
+    }
+    return 0;
+}
+
+static int FakeCopyCurrentMode(void *context, uint32_t id,
+                               struct DisplayModeList *list) {
+    struct FakeBackend *fake = context;
+    __atomic_add_fetch(&fake->copy_current_mode_calls, 1, __ATOMIC_RELAXED);
+    SleepMicroseconds(fake, fake->copy_current_mode_delay_us);
+    memset(list, 0, sizeof(*list));
+    list->current_index = -1;
+    const struct FakeDisplay *display = FindDisplay(fake, id);
+    if (display == NULL || display->current_index < 0) {
+        return kDisplayErrorFailure;
+    }
+    ptrdiff_t index = display->current_index;
+    unsigned lag = __atomic_load_n(&fake->lagging_reads, __ATOMIC_RELAXED);
+    while (lag > 0 && !__atomic_compare_exchange_n(
+                          &fake->lagging_reads, &lag, lag - 1, 0,
+                          __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+    if (lag > 0 && display->previous_index >= 0) {
+        index = display->previous_index;
+    }
+    list->current = display->modes[index];
+    list->current.handle = (const void *)(uintptr_t)(index + 1);
+    list->has_current = 1;
+    return 0;
+}
+
+// Identities are derived from the display ID unless one was set.
+static int FakeGetDisplayIdentity(void *context, uint32_t id,
+                                  struct DisplayIdentity *identity) {
+    struct FakeBackend *fake = context;
+    __atomic_add_fetch(&fake->get_display_identity_calls, 1, __ATOMIC_RELAXED);
+    SleepMicroseconds(fake, fake->get_display_identity_delay_us);
+    const struct FakeDisplay *display = FindDisplay(fake, id);
+    if (display == NULL) {
+        return kDisplayErrorFailure;
+    }
+    if (display->has_identity) {
+        *identity = display->identity;
+        return 0;
+    }
+    identity->vendor = 0x610;
+    identity->model = 0xa000 + id;
+    identity->serial = id * 7919;
+    return 0;
+}
+
+static int FakeGetEdid(void *context, uint32_t id, const unsigned char **data,
+                       size_t *size) {
+    struct FakeBackend *fake = context;
+    ++fake->get_edid_calls;
+    const struct FakeDisplay *display = FindDisplay(fake, id);
+    if (display == NULL || display->edid == NULL) {
+        return kDisplayErrorFailure;
+    }
+    *data = display->edid;
+    *size = display->edid_size;
+    return 0;
+}
+
+static void FakeReleaseModes(void *context, struct DisplayModeList *list) {
+    (void)context;
+    free(list->modes);
+    memset(list, 0, sizeof(*list));
+    list->current_index = -1;
+}
+
+static int FakeBeginConfiguration(void *context, void **config) {
+    struct FakeBackend *fake = context;
+    ++fake->begin_calls;
+    SleepMicroseconds(fake, fake->begin_delay_us);
+    struct FakeConfig *fake_config = malloc(sizeof(*fake_config));
+    if (fake_config == NULL) {
+        return kDisplayErrorFailure;
+    }
+    fake_config->mode_index = malloc(((size_t)fake->num_displays + 1) *
+                                     sizeof(fake_config->mode_index[0]));
+    if (fake_config->mode_index == NULL) {
+        free(fake_config);
+        return kDisplayErrorFailure;
+    }
+    for (size_t i = 0; i < fake->num_displays; ++i) {
+        fake_config->mode_index[i] = -1;
+    }
+    *config = fake_config;
+    return 0;
+}
+
+static int FakeConfigureDisplay(void *context, void *config, uint32_t id,
+                                const struct DisplayMode *mode) {
+    struct FakeBackend *fake = context;
+    struct FakeConfig *fake_config = config;
+    ++fake->configure_calls;
+    SleepMicroseconds(fake, fake->configure_delay_us);
+    if (fake->configure_error && (fake->configure_error_display == 0 ||
+                                  fake->configure_error_display == id)) {
+        return fake->configure_error;
+    }
+    const struct FakeDisplay *display = FindDisplay(fake, id);
+    const uintptr_t handle = (uintptr_t)mode->handle;
+    if (display == NULL || handle == 0 || handle > display->count) {
+        return kDisplayErrorFailure;
+    }
+    fake_config->mode_index[display - fake->displays] = (ptrdiff_t)handle - 1;
+    return 0;
+}
+
+static int FakeCompleteConfiguration(void *context, void *config) {
+    struct FakeBackend *fake = context;
+    struct FakeConfig *fake_config = config;
+    ++fake->complete_calls;
+    SleepMicroseconds(fake, fake->complete_delay_us);
+    if (fake->complete_error) {
+        free(fake_config->mode_index);
+        free(fake_config);
+        return fake->complete_error;
+    }
+    for (uint32_t i = 0; i < fake->num_displays; ++i) {
+        fake->displays[i].previous_index = fake->displays[i].current_index;
+        if (fake_config->mode_index[i] >= 0) {
+            fake->displays[i].current_index = fake_config->mode_index[i];
+        }
+    }
+    fake->lagging_reads = fake->current_mode_lag;
+    free(fake_config->mode_index);
+    free(fake_config);
+    return 0;
+}
+
+static void FakeCancelConfiguration(void *context, void *config) {
+    struct FakeBackend *fake = context;
+    struct FakeConfig *fake_config = config;
+    ++fake->cancel_calls;
+    free(fake_config->mode_index);
+    free(fake_config);
+}
+
+void FakeBackendInit(struct FakeBackend *fake) {
+    memset(fake, 0, sizeof(*fake));
+    fake->backend.context = fake;
+    fake->backend.get_active_displays = FakeGetActiveDisplays;
+    fake->backend.copy_modes = FakeCopyModes;
+    fake->backend.release_modes = FakeReleaseModes;
+    fake->backend.copy_current_mode = FakeCopyCurrentMode;
+    fake->backend.get_display_identity = FakeGetDisplayIdentity;
+    fake->backend.get_edid = FakeGetEdid;
+    fake->backend.begin_configuration = FakeBeginConfiguration;
+    fake->backend.configure_display = FakeConfigureDisplay;
+    fake->backend.complete_configuration = FakeCompleteConfiguration;
+    fake->backend.cancel_configuration = FakeCancelConfiguration;
+    fake->backend.concurrent_copy_modes = 1;
+}
+
+void FakeBackendFree(struct FakeBackend *fake) {
+    for (uint32_t i = 0; i < fake->num_displays; ++i) {
+        free(fake->displays[i].modes);
+    }
+    free(fake->displays);
+    fake->displays = NULL;
+    fake->num_displays = 0;
+    fake->capacity = 0;
+}
+
+uint64_t FakeBackendNow(void *context) {
+    struct FakeBackend *fake = context;
+    return __atomic_load_n(&fake->virtual_time_ns, __ATOMIC_RELAXED);
+}
+
+void FakeBackendAddDisplay(struct FakeBackend *fake, uint32_t id,
+                           const struct DisplayMode *modes, size_t count,
+                           ptrdiff_t current_index) {
+    if (fake->num_displays == fake->capacity) {
+        const uint32_t capacity = fake->capacity > 0 ? fake->capacity * 2 : 4;
+        struct FakeDisplay *displays =
+            realloc(fake->displays, capacity * sizeof(displays[0]));
+        if (displays == NULL) {
+            return;
+        }
+        fake->displays = displays;
+        fake->capacity = capacity;
+    }
+    struct FakeDisplay *display = &fake->displays[fake->num_displays++];
+    display->id = id;
+    display->modes = malloc((count ? count : 1) * sizeof(modes[0]));
+    memcpy(display->modes, modes, count * sizeof(modes[0]));
+    display->count = count;
+    display->current_index = current_index;
+    display->previous_index = -1;
+    display->copy_modes_delay_us = 0;
+    display->edid = NULL;
+    display->edid_size = 0;
+    display->has_identity = 0;
+}
+
+void FakeBackendSetEdid(struct FakeBackend *fake, uint32_t id,
+                        const unsigned char *edid, size_t size) {
+    struct FakeDisplay *display = FindDisplay(fake, id);
+    if (display != NULL) {
+        display->edid = edid;
+        display->edid_size = size;
+    }
+}
+
+void FakeBackendSetIdentity(struct FakeBackend *fake, uint32_t id,
+                            const struct DisplayIdentity *identity) {
+    struct FakeDisplay *display = FindDisplay(fake, id);
+    if (display != NULL) {
+        display->identity = *identity;
+        display->has_identity = 1;
+    }
+}
+
+void FakeBackendRemoveDisplay(struct FakeBackend *fake, uint32_t id) {
+    struct FakeDisplay *display = FindDisplay(fake, id);
+    if (display == NULL) {
+        return;
+    }
+    free(display->modes);
+    const size_t after =
+        (size_t)(fake->displays + fake->num_displays - display) - 1;
+    memmove(display, display + 1, after * sizeof(*display));
+    --fake->num_displays;
+}
+
+void FakeBackendAddSyntheticDisplay(struct FakeBackend *fake, uint32_t id,
+                                    size_t count) {
+    static const double kRefreshRates[] = {60.0, 59.94, 50.0, 75.0, 120.0, 144.0};
+    const size_t num_rates = sizeof(kRefreshRates) / sizeof(kRefreshRates[0]);
+    struct DisplayMode *modes = malloc((count ? count : 1) * sizeof(modes[0]));
+    for (size_t i = 0; i < count; ++i) {
+        const size_t size_index = i / num_rates;
+        modes[i].width = 640 + 16 * size_index;
+        modes[i].height = 480 + 9 * size_index;
+        modes[i].refresh_rate = kRefreshRates[i % num_rates];
+        modes[i].usable_for_desktop = (i % 7) != 0;
+        modes[i].mode_id = (int)i;
+        modes[i].handle = NULL;
+    }
+    FakeBackendAddDisplay(fake, id, modes, count, count > 0 ? 0 : -1);
+    free(modes);
+}
@@ -0,0 +1,106 @@
+#ifndef FAKE_BACKEND_H
+#define FAKE_BACKEND_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../displaymode_backend.h"
+
+// One simulated display.
+struct FakeDisplay {
+    uint32_t id;
+    struct DisplayMode *modes;
+    size_t count;
+    ptrdiff_t current_index;
+    // The current mode before the last completed configuration.
+    ptrdiff_t previous_index;
+    // Simulated cost of copy_modes for this display, in microseconds, on
+    // top of the backend-wide copy_modes_delay_us.
+    unsigned copy_modes_delay_us;
+    // EDID returned by get_edid (not owned), or NULL if it has none.
+    const unsigned char *edid;
+    size_t edid_size;
+    // Identity returned by get_display_identity if has_identity is set;
+    // otherwise it is derived from the ID.
+    int has_identity;
+    struct DisplayIdentity identity;
+};
+
+// An in-memory display backend for tests and benchmarks.  Counts every call
+// so tests can check how often displays are enumerated and configured.
+// copy_modes, copy_current_mode and get_display_identity may be called from
+// several threads.
+struct FakeBackend {
+    struct DisplayBackend backend;
+    struct FakeDisplay *displays;
+    uint32_t num_displays;
+    uint32_t capacity;
+
+    // Calls that read the display list (not just its length).
+    unsigned get_active_displays_calls;
+    unsigned copy_modes_calls;
+    unsigned copy_current_mode_calls;
+    unsigned get_edid_calls;
+    unsigned get_display_identity_calls;
+    unsigned begin_calls;
+    unsigned configure_calls;
+    unsigned complete_calls;
+    unsigned cancel_calls;
+
+    // Error returned by configure_display, or 0.
+    int configure_error;
+    // If non-zero, configure_error only applies to this display.
+    uint32_t configure_error_display;
+    // Error returned by complete_configuration (which then applies nothing),
+    // or 0.
+    int complete_error;
+    // Simulated cost of each call, in microseconds.
+    unsigned get_active_displays_delay_us;
+    unsigned copy_modes_delay_us;
+    unsigned copy_current_mode_delay_us;
+    unsigned get_display_identity_delay_us;
+    unsigned begin_delay_us;
+    unsigned configure_delay_us;
+    unsigned complete_delay_us;
+    // If non-zero, the delays advance virtual_time_ns instead of sleeping,
+    // so that timings are exact and tests don't wait.
+    int use_virtual_time;
+    uint64_t virtual_time_ns;
+    // Reads of the current mode after a configuration completes that still
+    // report the mode from before it, as a display may while it settles.
+    unsigned current_mode_lag;
+    unsigned lagging_reads;
+};
+
+void FakeBackendInit(struct FakeBackend *fake);
+
+void FakeBackendFree(struct FakeBackend *fake);
+
+// Adds a display with a copy of "modes"; "current_index" may be -1.
+void FakeBackendAddDisplay(struct FakeBackend *fake, uint32_t id,
+                           const struct DisplayMode *modes, size_t count,
+                           ptrdiff_t current_index);
+
+// Makes get_edid return the "size" bytes at "edid" (not copied) for the
+// display with the given ID.
+void FakeBackendSetEdid(struct FakeBackend *fake, uint32_t id,
+                        const unsigned char *edid, size_t size);
+
+// Makes get_display_identity return "identity" for the display with the
+// given ID, as if another monitor were plugged in under that ID.
+void FakeBackendSetIdentity(struct FakeBackend *fake, uint32_t id,
+                            const struct DisplayIdentity *identity);
+
+// Unplugs the display with the given ID, if there is one.
+void FakeBackendRemoveDisplay(struct FakeBackend *fake, uint32_t id);
+
+// Returns fake->virtual_time_ns for "context" a struct FakeBackend, as a
+// clock for code being timed against virtual delays.
+uint64_t FakeBackendNow(void *context);
+
+// Adds a display with "count" distinct, deterministic modes; the first one
+// is current.
+void FakeBackendAddSyntheticDisplay(struct FakeBackend *fake, uint32_t id,
+                                    size_t count);
+
+#endif // FAKE_BACKEND_H
@@ -0,0 +1,296 @@
+#define _DEFAULT_SOURCE
+
+#include "../displaymode_alloc.h"
+#include "../displaymode_catalog.h"
+#include "../displaymode_commands.h"
+#include "../displaymode_parse.h"
+#include "../logging.h"
+#include "fake_backend.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int tests_run = 0;
+static int tests_failed = 0;
+
+#define ASSERT(expr, msg) do { \
+    tests_run++; \
+    if (!(expr)) { \
+        fprintf(stderr, "FAIL: %s (test %d)\n", msg, tests_run); \
+        tests_failed++; \
+    } \
+} while (0)
+
+static void test_arena(void) {
+    struct Arena arena;
+    ArenaInit(&arena);
+    char *a = ArenaAlloc(&arena, 3);
+    char *b = ArenaAlloc(&arena, 40);
+    ASSERT(a != NULL && b != NULL, "allocates");
+    ASSERT((uintptr_t)a % 16 == 0 && (uintptr_t)b % 16 == 0, "aligned to 16");
+    ASSERT(b >= a + 16, "allocations don't overlap");
+    memset(b, 'x', 40);
+
+    // The latest allocation grows in place; others move.
+    char *grown = ArenaRealloc(&arena, b, 40, 4000);
+    ASSERT(grown == b && grown[39] == 'x', "latest allocation grows in place");
+    char *moved = ArenaRealloc(&arena, a, 3, 100);
+    ASSERT(moved != a, "older allocation moves");
+
+    // Requests larger than a chunk get their own.
+    char *huge = ArenaAlloc(&arena, kArenaChunkSize + 1);
+    ASSERT(huge != NULL, "larger than a chunk");
+    huge[kArenaChunkSize] = 'y';
+    char *after = ArenaAlloc(&arena, 16);
+    ASSERT(after != NULL, "allocates after a large chunk");
+
+    int *zeroed = ArenaCalloc(&arena, 100, sizeof(int));
+    int all_zero = zeroed != NULL;
+    for (int i = 0; all_zero && i < 100; ++i) {
+        all_zero = zeroed[i] == 0;
+    }
+    ASSERT(all_zero, "calloc zeroes");
+
+    // After a reset, memory is reused (and calloc still zeroes it).
+    ArenaReset(&arena);
+    memset(ArenaAlloc(&arena, 400), 0xff, 400);
+    ArenaReset(&arena);
+    zeroed = ArenaCalloc(&arena, 100, sizeof(int));
+    all_zero = 1;
+    for (int i = 0; i < 100; ++i) {
+        all_zero = all_zero && zeroed[i] == 0;
+    }
+    ASSERT(all_zero, "calloc zeroes reused memory");
+    ArenaFree(&arena);
+}
+
+enum {
+    kThreads = 4,
+    kAllocationsPerThread = 20000,
+};
+
+struct ThreadAllocations {
+    struct Arena *arena;
+    uint32_t id;
+    uint32_t *blocks[kAllocationsPerThread];
+};
+
+static void *AllocateMany(void *arg) {
+    struct ThreadAllocations *t = arg;
+    for (uint32_t i = 0; i < kAllocationsPerThread; ++i) {
+        // Sizes that cross several chunks in total.
+        t->blocks[i] = ArenaAlloc(t->arena, 64 + (i % 7) * 48);
+        if (t->blocks[i] != NULL) {
+            t->blocks[i][0] = t->id;
+            t->blocks[i][15] = i;
+        }
+    }
+    return NULL;
+}
+
+static void test_arena_threads(void) {
+    struct Arena arena;
+    ArenaInit(&arena);
+    static struct ThreadAllocations threads[kThreads];
+    pthread_t ids[kThreads];
+    for (uint32_t i = 0; i < kThreads; ++i) {
+        threads[i].arena = &arena;
+        threads[i].id = i;
+        pthread_create(&ids[i], NULL, AllocateMany, &threads[i]);
+    }
+    for (uint32_t i = 0; i < kThreads; ++i) {
+        pthread_join(ids[i], NULL);
+    }
+    int intact = 1;
+    for (uint32_t i = 0; i < kThreads; ++i) {
+        for (uint32_t j = 0; j < kAllocationsPerThread; ++j) {
+            const uint32_t *block = threads[i].blocks[j];
+            intact = intact && block != NULL && block[0] == i && block[15] == j;
+        }
+    }
+    ASSERT(intact, "concurrent allocations don't overlap");
+    ArenaFree(&arena);
+}
+
+static void test_counters(void) {
+    struct AllocStats stats;
+    AllocGetStats(&stats);
+    if (!stats.heap_tracked) {
+        return;
+    }
+    AllocResetStats();
+    AllocSetPhase(kAllocPhaseFormat);
+    void *volatile p = malloc(1000);
+    p = realloc(p, 3000);
+    free(p);
+    AllocSetPhase(kAllocPhaseWrite);
+    p = calloc(10, 10);
+    free(p);
+    AllocSetPhase(kAllocPhaseStartup);
+    AllocGetStats(&stats);
+    const struct AllocPhaseStats *format = &stats.phases[kAllocPhaseFormat];
+    const struct AllocPhaseStats *write = &stats.phases[kAllocPhaseWrite];
+    ASSERT(format->allocations == 2 && format->frees == 1 &&
+           format->bytes == 4000, "format phase counted");
+    ASSERT(write->allocations == 1 && write->frees == 1 && write->bytes == 100,
+           "write phase counted");
+    ASSERT(stats.peak_bytes >= 3000, "peak counted");
+
+#ifdef __GLIBC__
+    // The other entry points are counted, and fail as glibc's would.
+    AllocResetStats();
+    AllocSetPhase(kAllocPhaseFormat);
+    const volatile size_t huge = SIZE_MAX / 2;
+    const volatile size_t bad_alignment = 24;
+    ASSERT(calloc(huge, 4) == NULL, "calloc overflow fails");
+    ASSERT(aligned_alloc(bad_alignment, 48) == NULL,
+           "aligned_alloc checks the alignment");
+    p = reallocarray(NULL, 10, 30);
+    free(p);
+    p = aligned_alloc(64, 128);
+    ASSERT(p != NULL && (uintptr_t)p % 64 == 0, "aligned_alloc aligns");
+    free(p);
+    AllocSetPhase(kAllocPhaseStartup);
+    AllocGetStats(&stats);
+    ASSERT(format->allocations == 4 && format->frees == 2 &&
+           format->bytes == 300 + 128, "other entry points counted");
+#endif
+
+    char *text = NULL;
+    size_t length = 0;
+    FILE *out = open_memstream(&text, &length);
+    AllocWriteStats(&stats, out);
+    fclose(out);
+    ASSERT(strstr(text, "format") != NULL && strstr(text, "peak") != NULL,
+           "report written");
+    free(text);
+}
+
+// The "d" variants the guarantee covers.
+static const char *const kListings[][2] = {
+    {"d", NULL},
+    {"--json", NULL},
+    {"--ndjson", NULL},
+    {"--csv", NULL},
+    {"--tsv", NULL},
+    {"--cbor", NULL},
+    {"--min-width=1000", "--usable"},
+    {"--json", "--max-refresh=60"},
+    {"--grouped", NULL},
+    {"--grouped", "--ndjson"},
+};
+
+#define kNumListings (sizeof(kListings) / sizeof(kListings[0]))
+
+// Lists "catalog" with the given flags.  Returns the heap allocations made.
+static uint64_t List(struct DisplayCatalog *catalog, const char *const *flags,
+                     FILE *out) {
+    const char *argv[] = {"displaymode", "d", flags[0], flags[1], NULL};
+    int argc = 2;
+    if (strcmp(flags[0], "d") != 0) {
+        argc = flags[1] != NULL ? 4 : 3;
+    }
+    const struct ParsedArgs parsed_args = ParseArgs(argc, argv);
+    if (catalog->scratch != NULL) {
+        ArenaReset(catalog->scratch);
+    }
+    const uint64_t before = AllocHeapAllocations();
+    const int status = RunCommand(catalog, &parsed_args, out, stderr);
+    const uint64_t allocations = AllocHeapAllocations() - before;
+    ASSERT(status == 0, "d succeeds");
+    return allocations;
+}
+
+// Enumerates a new catalog of "num_displays" displays of 10k modes, as a
+// command would before listing, then lists it with "flags" once.  Returns
+// the heap allocations the listing made.
+static uint64_t ListEnumerated(uint32_t num_displays,
+                               const char *const *flags, FILE *out) {
+    struct FakeBackend fake;
+    FakeBackendInit(&fake);
+    for (uint32_t i = 0; i < num_displays; ++i) {
+        FakeBackendAddSyntheticDisplay(&fake, i + 1, 10000);
+    }
+    struct Arena arena;
+    ArenaInit(&arena);
+    struct DisplayCatalog catalog;
+    DisplayCatalogInit(&catalog, &fake.backend);
+    catalog.scratch = &arena;
+    int errors[4];
+    ASSERT(DisplayCatalogLoadDisplays(&catalog) == 0 &&
+           DisplayCatalogLoadAllModes(&catalog, errors) == 0, "enumerates");
+    const uint64_t allocations = List(&catalog, flags, out);
+    DisplayCatalogFree(&catalog);
+    ArenaFree(&arena);
+    FakeBackendFree(&fake);
+    return allocations;
+}
+
+static void test_listing_without_heap(void) {
+    struct AllocStats stats;
+    AllocGetStats(&stats);
+    if (!stats.heap_tracked) {
+        return;
+    }
+    // Fully buffered in memory the stream owns, as stdout is once written.
+    static char stream_buffer[BUFSIZ];
+    FILE *out = fopen("/dev/null", "w");
+    setvbuf(out, stream_buffer, _IOFBF, sizeof(stream_buffer));
+
+    // The first listing of a freshly enumerated catalog, as one invocation
+    // makes, with one display and with several (formatted on threads).
+    for (uint32_t num_displays = 1; num_displays <= 3; num_displays += 2) {
+        for (size_t i = 0; i < kNumListings; ++i) {
+            AllocResetStats();
+            const uint64_t allocations =
+                ListEnumerated(num_displays, kListings[i], out);
+            AllocGetStats(&stats);
+            if (allocations != 0) {
+                fprintf(stderr, "%u displays, %s %s: %llu allocations\n",
+                        num_displays, kListings[i][0],
+                        kListings[i][1] != NULL ? kListings[i][1] : "",
+                        (unsigned long long)allocations);
+            }
+            ASSERT(allocations == 0,
+                   "listing an enumerated catalog doesn't touch the heap");
+            ASSERT(stats.phases[kAllocPhaseFormat].arena_allocations > 0 ||
+                   stats.phases[kAllocPhaseEnumerate].arena_allocations > 0,
+                   "listing uses the arena");
+        }
+    }
+
+    // Without an arena, the same listing does allocate.
+    struct FakeBackend fake;
+    FakeBackendInit(&fake);
+    FakeBackendAddSyntheticDisplay(&fake, 1, 10000);
+    struct DisplayCatalog catalog;
+    DisplayCatalogInit(&catalog, &fake.backend);
+    int errors[1];
+    DisplayCatalogLoadDisplays(&catalog);
+    DisplayCatalogLoadAllModes(&catalog, errors);
+    ASSERT(List(&catalog, kListings[0], out) > 0, "heap listing allocates");
+
+    fclose(out);
+    DisplayCatalogFree(&catalog);
+    FakeBackendFree(&fake);
+}
+
+int main(void) {
+    setLogLevel(LOG_LEVEL_ERROR);
+    // First, so that no earlier test has started threads.
+    test_listing_without_heap();
+    test_arena();
+    test_arena_threads();
+    test_counters();
+
+    if (tests_failed == 0) {
+        printf("All %d allocation tests passed.\n", tests_run);
+        return EXIT_SUCCESS;
+    } else {
+        fprintf(stderr, "%d of %d allocation tests failed.\n", tests_failed, tests_run);
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,182 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "../displaymode_batch.h"
+#include "../displaymode_catalog.h"
+#include "../logging.h"
+#include "fake_backend.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static int tests_run = 0;
+static int tests_failed = 0;
+
+#define ASSERT(expr, msg) do { \
+    tests_run++; \
+    if (!(expr)) { \
+        fprintf(stderr, "FAIL: %s (test %d)\n", msg, tests_run); \
+        tests_failed++; \
+    } \
+} while (0)
+
+static size_t Count(const char *text, const char *needle) {
+    size_t n = 0;
+    for (const char *p = strstr(text, needle); p != NULL;
+         p = strstr(p + 1, needle)) {
+        ++n;
+    }
+    return n;
+}
+
+// Runs the batch "input" (of "length" bytes) against "fake" and returns the
+// results (to be freed).
+static char *RunBatch(struct FakeBackend *fake, const char *input,
+                      size_t length, int *status) {
+    char *buffer = NULL;
+    size_t len = 0;
+    FILE *out = open_memstream(&buffer, &len);
+    FILE *in = fmemopen((void *)input, length, "r");
+    struct DisplayCatalog catalog;
+    DisplayCatalogInit(&catalog, &fake->backend);
+    *status = DisplayBatchRun(&catalog, in, out, out);
+    DisplayCatalogFree(&catalog);
+    fclose(in);
+    fclose(out);
+    return buffer;
+}
+
+static void InitFake(struct FakeBackend *fake) {
+    FakeBackendInit(fake);
+    FakeBackendAddSyntheticDisplay(fake, 1, 12);
+    FakeBackendAddSyntheticDisplay(fake, 2, 12);
+}
+
+static void test_mixed_batch(void) {
+    struct FakeBackend fake;
+    InitFake(&fake);
+    static const char kInput[] =
+        "t 656 489 @60 1\n"
+        "\n"
+        "# set the main display back\n"
+        "t 640 480 0\n"
+        "d --min-width=700\n"
+        "t 1 1\n"
+        "foo\n"
+        "v\n";
+    int status;
+    char *results = RunBatch(&fake, kInput, sizeof(kInput) - 1, &status);
+    ASSERT(status == EXIT_FAILURE, "a failed command fails the batch");
+    ASSERT(Count(results, "\n") == 6, "one result per command");
+    ASSERT(strstr(results, "{\"line\":1,\"status\":0,\"output\":\"Changed "
+                  "display resolution from 640x480 @60.000000 to 656x489 "
+                  "@60.0\\n\"}\n") != NULL, "mode set on display 1");
+    ASSERT(fake.displays[1].current_index == 6, "display 1 switched");
+    ASSERT(strstr(results, "{\"line\":4,\"status\":0,") != NULL,
+           "line numbers count skipped lines");
+    ASSERT(strstr(results, "{\"line\":5,\"status\":0,\"output\":\"Display 0 "
+                  "(MAIN):\\n") != NULL, "d with a filter flag");
+    ASSERT(strstr(results, "{\"line\":6,\"status\":-1,\"error\":\"Could not "
+                  "find a mode for resolution 1x1\\n\"}\n") != NULL,
+           "failed command reports its error");
+    ASSERT(strstr(results, "{\"line\":7,\"status\":1,") != NULL,
+           "unknown command fails");
+    ASSERT(strstr(results, "{\"line\":8,\"status\":0,\"output\":\"displaymode")
+           != NULL, "later commands still run");
+    ASSERT(fake.get_active_displays_calls == 1, "displays enumerated once");
+    ASSERT(fake.copy_modes_calls == 2, "each display's modes read once");
+    free(results);
+    FakeBackendFree(&fake);
+}
+
+static void test_successful_batch(void) {
+    struct FakeBackend fake;
+    InitFake(&fake);
+    // CRLF line endings and no final newline.
+    static const char kInput[] = "t 656 489 1\r\nt 640 480 @60 1\r\nv";
+    int status;
+    char *results = RunBatch(&fake, kInput, sizeof(kInput) - 1, &status);
+    ASSERT(status == EXIT_SUCCESS, "batch succeeds");
+    ASSERT(Count(results, "\"status\":0") == 3, "every command succeeds");
+    ASSERT(strstr(results, "{\"line\":3,") != NULL, "last line without newline");
+    free(results);
+    FakeBackendFree(&fake);
+}
+
+static void test_long_lines(void) {
+    struct FakeBackend fake;
+    InitFake(&fake);
+    // Longer than the line limit, then longer than the read buffer.
+    const size_t lengths[] = {kMaxBatchLineLength + 10, 200000};
+    for (size_t i = 0; i < 2; ++i) {
+        const size_t length = lengths[i];
+        char *input = malloc(length + 16);
+        memset(input, 'x', length);
+        memcpy(input + length, "\nv\n", 3);
+        int status;
+        char *results = RunBatch(&fake, input, length + 3, &status);
+        ASSERT(strncmp(results, "{\"line\":1,\"status\":1,\"error\":\"Line too "
+                       "long\\n\"}\n{\"line\":2,\"status\":0,", 59) == 0,
+               "long line reported once and skipped");
+        ASSERT(Count(results, "\n") == 2, "two results");
+        free(results);
+        free(input);
+    }
+    FakeBackendFree(&fake);
+}
+
+static void test_modes_rejected(void) {
+    struct FakeBackend fake;
+    InitFake(&fake);
+    static const char kInput[] = "s\nw\n- other.txt\n";
+    int status;
+    char *results = RunBatch(&fake, kInput, sizeof(kInput) - 1, &status);
+    ASSERT(Count(results, "can't run in batch mode") == 3,
+           "server, watch and nested batches rejected");
+    free(results);
+    FakeBackendFree(&fake);
+}
+
+static void test_pipe_input(void) {
+    struct FakeBackend fake;
+    InitFake(&fake);
+    int fds[2];
+    ASSERT(pipe(fds) == 0, "pipe");
+    static const char kInput[] = "v\nt 656 489 0\n";
+    ASSERT(write(fds[1], kInput, sizeof(kInput) - 1) ==
+           (ssize_t)sizeof(kInput) - 1, "write commands");
+    close(fds[1]);
+    FILE *in = fdopen(fds[0], "r");
+    char *results = NULL;
+    size_t len = 0;
+    FILE *out = open_memstream(&results, &len);
+    struct DisplayCatalog catalog;
+    DisplayCatalogInit(&catalog, &fake.backend);
+    ASSERT(DisplayBatchRun(&catalog, in, out, out) == EXIT_SUCCESS,
+           "batch from a pipe succeeds");
+    fclose(out);
+    ASSERT(Count(results, "\"status\":0") == 2, "both commands run");
+    DisplayCatalogFree(&catalog);
+    fclose(in);
+    free(results);
+    FakeBackendFree(&fake);
+}
+
+int main(void) {
+    setLogLevel(LOG_LEVEL_ERROR);
+    test_mixed_batch();
+    test_successful_batch();
+    test_long_lines();
+    test_modes_rejected();
+    test_pipe_input();
+
+    if (tests_failed == 0) {
+        printf("All %d batch tests passed.\n", tests_run);
+        return EXIT_SUCCESS;
+    } else {
+        fprintf(stderr, "%d of %d batch tests failed.\n", tests_failed,
+                tests_run);
+        return EXIT_FAILURE;
+    }
+}
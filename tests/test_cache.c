@@ -0,0 +1,211 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "../displaymode_cache.h"
+#include "../displaymode_catalog.h"
+#include "../displaymode_commands.h"
+#include "../logging.h"
+#include "fake_backend.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static int tests_run = 0;
+static int tests_failed = 0;
+
+#define ASSERT(expr, msg) do { \
+    tests_run++; \
+    if (!(expr)) { \
+        fprintf(stderr, "FAIL: %s (test %d)\n", msg, tests_run); \
+        tests_failed++; \
+    } \
+} while (0)
+
+static const struct DisplayMode kModes[] = {
+    {1920, 1080, 60.0, 1, 1, NULL},
+    {1920, 1080, 50.0, 1, 2, NULL},
+    {1280, 720, 60.0, 1, 3, NULL},
+    {640, 480, 59.94, 0, 4, NULL},
+};
+
+static char cache_path[64];
+
+static void test_cache_round_trip(void) {
+    struct DisplayCache cache;
+    unlink(cache_path);
+    ASSERT(DisplayCacheOpen(&cache, cache_path) == 0, "open missing file");
+    const struct DisplayCacheMode *modes = NULL;
+    ASSERT(DisplayCacheLookup(&cache, 1, 2, 100, &modes) == 0, "empty cache misses");
+    ASSERT(DisplayCacheStore(&cache, 1, 2, 100, kModes, 4) == 0, "store");
+    ASSERT(DisplayCacheStore(&cache, 5, 6, 100, kModes, 2) == 0, "store second");
+    ASSERT(DisplayCacheFlush(&cache, 100) == 0, "flush");
+    DisplayCacheClose(&cache);
+
+    ASSERT(DisplayCacheOpen(&cache, cache_path) == 0, "reopen");
+    ASSERT(DisplayCacheLookup(&cache, 1, 2, 100, &modes) == 4, "lookup hits");
+    struct DisplayMode mode;
+    DisplayCacheModeToDisplayMode(&modes[3], &mode);
+    ASSERT(mode.width == 640 && mode.height == 480 && mode.refresh_rate == 59.94 &&
+           mode.mode_id == 4 && !mode.usable_for_desktop && mode.handle == NULL,
+           "mode round-trips");
+    ASSERT(DisplayCacheLookup(&cache, 5, 6, 100, &modes) == 2, "second entry hits");
+    ASSERT(DisplayCacheLookup(&cache, 1, 3, 100, &modes) == 0,
+           "fingerprint mismatch misses");
+    ASSERT(DisplayCacheLookup(&cache, 7, 2, 100, &modes) == 0, "unknown key misses");
+    ASSERT(DisplayCacheLookup(&cache, 1, 2, 100 + kDisplayCacheMaxAge + 1, &modes) == 0,
+           "expired entry misses");
+    ASSERT(DisplayCacheLookup(&cache, 1, 2, 99, &modes) == 0,
+           "entry from the future misses");
+
+    // Replacing one entry keeps the other.
+    ASSERT(DisplayCacheStore(&cache, 5, 8, 200, kModes, 3) == 0, "store replacement");
+    ASSERT(DisplayCacheFlush(&cache, 200) == 0, "flush replacement");
+    ASSERT(DisplayCacheLookup(&cache, 5, 8, 200, &modes) == 3, "replacement hits");
+    ASSERT(DisplayCacheLookup(&cache, 5, 6, 200, &modes) == 0, "old entry replaced");
+    ASSERT(DisplayCacheLookup(&cache, 1, 2, 200, &modes) == 4, "other entry kept");
+    DisplayCacheClose(&cache);
+}
+
+// Overwrites "size" bytes at "offset" of the cache file.
+static void CorruptFile(long offset, const void *bytes, size_t size) {
+    FILE *f = fopen(cache_path, "r+b");
+    fseek(f, offset, SEEK_SET);
+    fwrite(bytes, 1, size, f);
+    fclose(f);
+}
+
+static void test_cache_rejects_invalid_files(void) {
+    struct DisplayCache cache;
+    const struct DisplayCacheMode *modes = NULL;
+
+    const uint32_t version = kDisplayCacheVersion + 1;
+    CorruptFile(offsetof(struct DisplayCacheHeader, file.version), &version, sizeof(version));
+    DisplayCacheOpen(&cache, cache_path);
+    ASSERT(DisplayCacheLookup(&cache, 1, 2, 200, &modes) == 0, "version mismatch ignored");
+    DisplayCacheClose(&cache);
+
+    FILE *f = fopen(cache_path, "wb");
+    fputs("DMCACHE", f);
+    fclose(f);
+    DisplayCacheOpen(&cache, cache_path);
+    ASSERT(cache.header == NULL, "truncated file ignored");
+    ASSERT(DisplayCacheStore(&cache, 1, 2, 300, kModes, 4) == 0, "store over invalid");
+    ASSERT(DisplayCacheFlush(&cache, 300) == 0, "flush over invalid");
+    ASSERT(DisplayCacheLookup(&cache, 1, 2, 300, &modes) == 4, "invalid file rewritten");
+    DisplayCacheClose(&cache);
+
+    // Truncate the mode table.
+    ASSERT(truncate(cache_path, sizeof(struct DisplayCacheHeader) +
+                    sizeof(struct DisplayCacheEntry) + 8) == 0, "truncate");
+    DisplayCacheOpen(&cache, cache_path);
+    ASSERT(cache.header == NULL, "short mode table ignored");
+    DisplayCacheClose(&cache);
+}
+
+// Runs "d" against a new catalog using the cache file.
+static void ListModes(struct FakeBackend *fake, int use_cache, char **text) {
+    size_t len = 0;
+    FILE *out = open_memstream(text, &len);
+    struct DisplayCatalog catalog;
+    DisplayCatalogInit(&catalog, &fake->backend);
+    struct DisplayCache cache;
+    if (use_cache) {
+        DisplayCacheOpen(&cache, cache_path);
+        DisplayCatalogSetCache(&catalog, &cache);
+    }
+    PrintModesForAllDisplays(&catalog, out, stderr);
+    if (use_cache) {
+        DisplayCatalogFlushCache(&catalog);
+        DisplayCacheClose(&cache);
+    }
+    DisplayCatalogFree(&catalog);
+    fclose(out);
+}
+
+static void test_catalog_uses_cache(void) {
+    unlink(cache_path);
+    struct FakeBackend fake;
+    FakeBackendInit(&fake);
+    FakeBackendAddDisplay(&fake, 1, kModes, 4, 1);
+    FakeBackendAddSyntheticDisplay(&fake, 2, 500);
+
+    char *uncached = NULL;
+    ListModes(&fake, 0, &uncached);
+    char *first = NULL;
+    ListModes(&fake, 1, &first);
+    ASSERT(fake.copy_modes_calls == 4, "cold listing enumerates");
+    char *second = NULL;
+    ListModes(&fake, 1, &second);
+    ASSERT(fake.copy_modes_calls == 4, "cached listing doesn't enumerate");
+    ASSERT(fake.copy_current_mode_calls == 2, "cached listing reads current modes");
+    ASSERT(strcmp(uncached, first) == 0 && strcmp(first, second) == 0,
+           "cached listing is identical");
+    free(uncached);
+    free(first);
+    free(second);
+
+    // A mode the cache doesn't list makes the entry stale.
+    const struct DisplayMode extra = {3840, 2160, 30.0, 1, 9, NULL};
+    struct DisplayMode *grown = realloc(fake.displays[0].modes, 5 * sizeof(*grown));
+    grown[4] = extra;
+    fake.displays[0].modes = grown;
+    fake.displays[0].count = 5;
+    fake.displays[0].current_index = 4;
+    char *text = NULL;
+    ListModes(&fake, 1, &text);
+    ASSERT(fake.copy_modes_calls == 5, "stale entry re-enumerated");
+    ASSERT(strstr(text, "3840 x 2160 @30.0Hz") != NULL, "new mode listed");
+    free(text);
+    ListModes(&fake, 1, &text);
+    ASSERT(fake.copy_modes_calls == 5, "refreshed entry cached");
+    free(text);
+
+    // Re-plugging changes the fingerprint.
+    FakeBackendAddDisplay(&fake, 3, kModes, 2, 0);
+    ListModes(&fake, 1, &text);
+    ASSERT(fake.copy_modes_calls == 8, "display set change re-enumerates");
+    free(text);
+
+    // Applying a cached mode needs the backend's mode.
+    struct DisplayCatalog catalog;
+    DisplayCatalogInit(&catalog, &fake.backend);
+    struct DisplayCache cache;
+    DisplayCacheOpen(&cache, cache_path);
+    DisplayCatalogSetCache(&catalog, &cache);
+    const char *argv[] = {"displaymode", "t", "1280", "720", "0", NULL};
+    const struct ParsedArgs parsed_args = ParseArgs(5, argv);
+    FILE *sink = fopen("/dev/null", "w");
+    ASSERT(ConfigureMode(&catalog, &parsed_args, sink, sink) == 0, "t with cache");
+    ASSERT(fake.copy_modes_calls == 9, "t enumerates once to apply");
+    ASSERT(fake.displays[0].current_index == 2, "t applied");
+    const char *missing_argv[] = {"displaymode", "t", "1", "1", "0", NULL};
+    const struct ParsedArgs missing = ParseArgs(5, missing_argv);
+    DisplayCatalogInvalidate(&catalog);
+    ASSERT(ConfigureMode(&catalog, &missing, sink, sink) != 0, "unknown mode fails");
+    ASSERT(fake.copy_modes_calls == 9, "unknown mode fails without enumerating");
+    fclose(sink);
+    DisplayCatalogFree(&catalog);
+    DisplayCacheClose(&cache);
+    FakeBackendFree(&fake);
+}
+
+int main(void) {
+    setLogLevel(LOG_LEVEL_ERROR);
+    snprintf(cache_path, sizeof(cache_path), "/tmp/displaymode-test-%ld.modes",
+             (long)getpid());
+    test_cache_round_trip();
+    test_cache_rejects_invalid_files();
+    test_catalog_uses_cache();
+    unlink(cache_path);
+
+    if (tests_failed == 0) {
+        printf("All %d cache tests passed.\n", tests_run);
+        return EXIT_SUCCESS;
+    } else {
+        fprintf(stderr, "%d of %d cache tests failed.\n", tests_failed, tests_run);
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,175 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "../displaymode_catalog.h"
+#include "../displaymode_commands.h"
+#include "../displaymode_parse.h"
+#include "../logging.h"
+#include "fake_backend.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int tests_run = 0;
+static int tests_failed = 0;
+
+#define ASSERT(expr, msg) do { \
+    tests_run++; \
+    if (!(expr)) { \
+        fprintf(stderr, "FAIL: %s (test %d)\n", msg, tests_run); \
+        tests_failed++; \
+    } \
+} while (0)
+
+static const struct DisplayMode kModes[] = {
+    {1920, 1080, 60.0, 1, 1, NULL},
+    {1920, 1080, 50.0, 1, 2, NULL},
+    {1280, 720, 60.0, 1, 3, NULL},
+    {640, 480, 59.94, 0, 4, NULL},
+};
+
+static void AddDisplays(struct FakeBackend *fake) {
+    FakeBackendInit(fake);
+    FakeBackendAddDisplay(fake, 1, kModes, 4, 0);
+    FakeBackendAddDisplay(fake, 2, kModes, 4, 0);
+    FakeBackendAddDisplay(fake, 3, kModes, 4, 0);
+}
+
+// Runs "t" with the given arguments against a new catalog; the output is
+// returned in *text (if not NULL).
+static int Configure(struct FakeBackend *fake, int argc, const char *argv[],
+                     char **text) {
+    char *buffer = NULL;
+    size_t len = 0;
+    FILE *out = open_memstream(&buffer, &len);
+    struct DisplayCatalog catalog;
+    DisplayCatalogInit(&catalog, &fake->backend);
+    const struct ParsedArgs parsed_args = ParseArgs(argc, argv);
+    const int e = RunCommand(&catalog, &parsed_args, out, out);
+    DisplayCatalogFree(&catalog);
+    fclose(out);
+    if (text != NULL) {
+        *text = buffer;
+    } else {
+        free(buffer);
+    }
+    return e;
+}
+
+static void test_parse_multiple_specs(void) {
+    const char *argv[] = {"prog", "t", "1920", "1080", "@60", "0",
+                          "1280", "720", "2", NULL};
+    const struct ParsedArgs p = ParseArgs(9, argv);
+    ASSERT(p.option == kOptionConfigureMode, "multiple specs parsed");
+    ASSERT(p.num_specs == 2, "two specs");
+    ASSERT(p.specs[0].width == 1920 && p.specs[0].height == 1080 &&
+           p.specs[0].refresh_rate == 60.0 && p.specs[0].display_index == 0,
+           "first spec");
+    ASSERT(p.specs[1].width == 1280 && p.specs[1].height == 720 &&
+           p.specs[1].refresh_rate == 0.0 && p.specs[1].display_index == 2,
+           "second spec");
+    ASSERT(p.width == 1920 && p.display_index == 0, "first spec mirrored");
+
+    const char *single[] = {"prog", "t", "800", "600", NULL};
+    ASSERT(ParseArgs(4, single).num_specs == 1, "single spec without display");
+
+    // Only a lone specification may leave out its display.
+    const char *no_display[] = {"prog", "t", "1920", "1080", "1280", "720", "1", NULL};
+    ASSERT(ParseArgs(7, no_display).option == kOptionInvalidMode,
+           "later spec without display is invalid");
+    const char *trailing[] = {"prog", "t", "1920", "1080", "0", "1280", NULL};
+    ASSERT(ParseArgs(6, trailing).option == kOptionInvalidMode,
+           "incomplete trailing spec is invalid");
+}
+
+static void test_single_transaction(void) {
+    struct FakeBackend fake;
+    AddDisplays(&fake);
+    const char *argv[] = {"prog", "t", "1280", "720", "0", "640", "480",
+                          "@59.94", "1", "1920", "1080", "@50", "2", NULL};
+    char *text = NULL;
+    ASSERT(Configure(&fake, 13, argv, &text) == 0, "three displays configured");
+    ASSERT(fake.get_active_displays_calls == 1, "displays enumerated once");
+    ASSERT(fake.begin_calls == 1 && fake.complete_calls == 1 &&
+           fake.cancel_calls == 0, "one transaction");
+    ASSERT(fake.configure_calls == 3, "every display configured");
+    ASSERT(fake.displays[0].current_index == 2 &&
+           fake.displays[1].current_index == 3 &&
+           fake.displays[2].current_index == 1, "all modes applied");
+    ASSERT(strstr(text, "Display 0: Changed display resolution from 1920x1080 to 1280x720\n") != NULL &&
+           strstr(text, "Display 2: ") != NULL, "each display reported");
+    free(text);
+    FakeBackendFree(&fake);
+}
+
+static void test_all_or_nothing(void) {
+    struct FakeBackend fake;
+    AddDisplays(&fake);
+
+    // An unknown mode fails before the transaction starts.
+    const char *missing[] = {"prog", "t", "1280", "720", "0", "800", "600", "1", NULL};
+    ASSERT(Configure(&fake, 8, missing, NULL) != 0, "unknown mode fails");
+    ASSERT(fake.begin_calls == 0, "no transaction for an unknown mode");
+
+    const char *range[] = {"prog", "t", "1280", "720", "0", "1280", "720", "7", NULL};
+    ASSERT(Configure(&fake, 8, range, NULL) == kDisplayErrorRangeCheck,
+           "display out of range fails");
+    ASSERT(fake.begin_calls == 0, "no transaction for a bad display");
+
+    const char *twice[] = {"prog", "t", "1280", "720", "1", "640", "480", "1", NULL};
+    ASSERT(Configure(&fake, 8, twice, NULL) != 0, "repeated display fails");
+    ASSERT(fake.begin_calls == 0, "no transaction for a repeated display");
+
+    // A failure configuring the second display cancels the first.
+    const char *argv[] = {"prog", "t", "1280", "720", "0", "640", "480", "1", NULL};
+    fake.configure_error = kDisplayErrorFailure;
+    fake.configure_error_display = 2;
+    ASSERT(Configure(&fake, 8, argv, NULL) == kDisplayErrorFailure,
+           "configure error reported");
+    ASSERT(fake.begin_calls == 1 && fake.cancel_calls == 1 &&
+           fake.complete_calls == 0, "transaction cancelled");
+    ASSERT(fake.displays[0].current_index == 0 &&
+           fake.displays[1].current_index == 0, "no display changed");
+
+    fake.configure_error = 0;
+    fake.complete_error = kDisplayErrorFailure;
+    ASSERT(Configure(&fake, 8, argv, NULL) == kDisplayErrorFailure,
+           "complete error reported");
+    ASSERT(fake.displays[0].current_index == 0 &&
+           fake.displays[1].current_index == 0, "failed transaction applies nothing");
+
+    fake.complete_error = 0;
+    ASSERT(Configure(&fake, 8, argv, NULL) == 0, "retry succeeds");
+    ASSERT(fake.displays[0].current_index == 2 &&
+           fake.displays[1].current_index == 3, "retry applied");
+    FakeBackendFree(&fake);
+}
+
+static void test_single_display_output_unchanged(void) {
+    struct FakeBackend fake;
+    AddDisplays(&fake);
+    const char *argv[] = {"prog", "t", "1920", "1080", "@50", "1", NULL};
+    char *text = NULL;
+    ASSERT(Configure(&fake, 6, argv, &text) == 0, "single display configured");
+    ASSERT(strcmp(text, "Changed display resolution from 1920x1080 @60.000000 "
+                        "to 1920x1080 @50.0\n") == 0, "single display output");
+    ASSERT(fake.begin_calls == 1 && fake.complete_calls == 1, "one transaction");
+    free(text);
+    FakeBackendFree(&fake);
+}
+
+int main(void) {
+    setLogLevel(LOG_LEVEL_ERROR);
+    test_parse_multiple_specs();
+    test_single_transaction();
+    test_all_or_nothing();
+    test_single_display_output_unchanged();
+
+    if (tests_failed == 0) {
+        printf("All %d configure tests passed.\n", tests_run);
+        return EXIT_SUCCESS;
+    } else {
+        fprintf(stderr, "%d of %d configure tests failed.\n", tests_failed, tests_run);
+        return EXIT_FAILURE;
+    }
+}
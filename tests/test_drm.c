@@ -0,0 +1,219 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "../displaymode_catalog.h"
+#include "../displaymode_commands.h"
+#include "../displaymode_drm.h"
+#include "../displaymode_parse.h"
+#include "../logging.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static int tests_run = 0;
+static int tests_failed = 0;
+
+#define ASSERT(expr, msg) do { \
+    tests_run++; \
+    if (!(expr)) { \
+        fprintf(stderr, "FAIL: %s (test %d)\n", msg, tests_run); \
+        tests_failed++; \
+    } \
+} while (0)
+
+// The fixture tree: card0-DP-1 (ID 95) and card0-eDP-1 (ID 77) are
+// connected, card0-HDMI-A-1 isn't, and card1-DP-2 has no connector_id or
+// EDID.
+static const char kFixture[] = "tests/fixtures/drm";
+
+static size_t Parse(const char *text, struct DisplayMode *modes,
+                    size_t max_modes) {
+    return DrmParseModes(text, strlen(text), modes, max_modes);
+}
+
+static void test_parse_modes(void) {
+    struct DisplayMode modes[16];
+    ASSERT(Parse("1920x1080\n1280x720\n", modes, 16) == 2 &&
+           modes[0].width == 1920 && modes[0].height == 1080 &&
+           modes[1].width == 1280 && modes[1].height == 720 &&
+           modes[1].mode_id == 1 && modes[0].refresh_rate == 0.0 &&
+           modes[0].usable_for_desktop && modes[0].handle == NULL,
+           "one mode per line");
+    ASSERT(Parse("1920x1080i\n", modes, 16) == 1 &&
+           modes[0].height == 1080 && !modes[0].usable_for_desktop,
+           "interlaced modes aren't for the desktop");
+    ASSERT(Parse("800x600", modes, 16) == 1 && modes[0].width == 800,
+           "last line without a newline");
+    ASSERT(Parse("", modes, 16) == 0 && Parse("\n\n", modes, 16) == 0,
+           "no modes");
+    ASSERT(Parse("x600\n800x\n800y600\n800x600p\n123456x1\n1x123456\n"
+                 "640x480\n", modes, 16) == 1 && modes[0].width == 640,
+           "malformed lines skipped");
+    ASSERT(Parse("1920x1080\r\n640x480\n", modes, 16) == 1 &&
+           modes[0].width == 640, "no carriage returns in sysfs");
+    ASSERT(Parse("1x1\n2x2\n3x3\n", modes, 2) == 2 && modes[1].width == 2,
+           "at most max_modes");
+    const char kShortest[] = "1x1\n1x1\n1x1";
+    ASSERT(Parse(kShortest, modes, 16) == DrmMaxModes(strlen(kShortest)),
+           "DrmMaxModes bounds the count");
+}
+
+static void test_fixture_displays(void) {
+    struct DrmBackend drm;
+    ASSERT(DrmBackendInit(&drm, kFixture) == 0, "fixture opened");
+    struct DisplayCatalog catalog;
+    DisplayCatalogInit(&catalog, &drm.backend);
+    ASSERT(DisplayCatalogLoadDisplays(&catalog) == 0, "displays listed");
+    ASSERT(catalog.num_displays == 3 && catalog.displays[0] == 95 &&
+           catalog.displays[1] == 77 &&
+           catalog.displays[2] == kDrmFallbackIdBase + 3,
+           "connected connectors in name order");
+    ASSERT(drm.num_connectors == 4, "cards and render nodes ignored");
+
+    const struct DisplayModeList *list = NULL;
+    ASSERT(DisplayCatalogGetModes(&catalog, 0, &list) == 0 &&
+           list->count == 6 && list->modes[0].width == 3840 &&
+           list->modes[1].width == 3840 && !list->modes[4].usable_for_desktop &&
+           !list->has_current && list->current_index == -1,
+           "DP-1 modes, duplicates kept");
+    ASSERT(DisplayCatalogGetModes(&catalog, 2, &list) == 0 &&
+           list->count == 3 && list->modes[2].width == 640 &&
+           list->modes[2].height == 480, "DP-2 modes, garbage skipped");
+    ASSERT(DisplayCatalogGetModes(&catalog, 1, &list) == 0 &&
+           DisplayCatalogFindMode(&catalog, 1, 1920, 1200, 0.0) == 1,
+           "modes found for t");
+
+    struct DisplayIdentity identity;
+    ASSERT(drm.backend.get_display_identity(drm.backend.context, 95,
+                                            &identity) == 0 &&
+           identity.vendor == 0x10ac && identity.model == 0xa0c4 &&
+           identity.serial == 0x4c4b3033, "identity from the EDID header");
+    ASSERT(drm.backend.get_display_identity(drm.backend.context,
+                                            kDrmFallbackIdBase + 3,
+                                            &identity) != 0,
+           "no EDID, no identity");
+    void *config = NULL;
+    ASSERT(drm.backend.begin_configuration(drm.backend.context, &config) != 0,
+           "sysfs can't set modes");
+    DisplayCatalogFree(&catalog);
+    DrmBackendFree(&drm);
+
+    ASSERT(DrmBackendInit(&drm, "tests/fixtures/missing") != 0,
+           "missing tree reported");
+    uint32_t count = 1;
+    ASSERT(drm.backend.get_active_displays(drm.backend.context, 0, NULL,
+                                           &count) != 0 && count == 0,
+           "missing tree has no displays");
+    DrmBackendFree(&drm);
+}
+
+static void test_list_command(void) {
+    struct DrmBackend drm;
+    DrmBackendInit(&drm, kFixture);
+    struct DisplayCatalog catalog;
+    DisplayCatalogInit(&catalog, &drm.backend);
+    const char *argv[] = {"displaymode", "d", NULL};
+    const struct ParsedArgs parsed_args = ParseArgs(2, argv);
+    char *text = NULL;
+    size_t length = 0;
+    FILE *out = open_memstream(&text, &length);
+    ASSERT(RunCommand(&catalog, &parsed_args, out, stderr) == EXIT_SUCCESS,
+           "d runs");
+    fclose(out);
+    ASSERT(strncmp(text, "Display 0 (MAIN):\n3840 x 2160 @0.0Hz ", 37) == 0 &&
+           strstr(text, "\nDisplay 1:\n2560 x 1600 @0.0Hz ") != NULL &&
+           strstr(text, "\nDisplay 2:\n1024 x 768 @0.0Hz ") != NULL &&
+           strstr(text, "Display 3") == NULL, "connected displays listed");
+    ASSERT(strstr(text, "3840 x 2160 @0.0Hz AR:16:9 "
+                        "Enc:--------RRRRRRRRGGGGGGGGBBBBBBBB ModeID:0 HiDPI "
+                        "DELL U2723QE Cat:") != NULL &&
+           strstr(text, " Std DELL U2723QE ") != NULL &&
+           strstr(text, " HiDPI NE135FBM-N41 ") != NULL &&
+           strstr(text, "ModeID:0 Std Display ") != NULL,
+           "names, encodings and HiDPI from the EDIDs");
+    free(text);
+    DisplayCatalogFree(&catalog);
+    DrmBackendFree(&drm);
+}
+
+static void WriteFile(const char *root, const char *path, const char *text) {
+    char full[256];
+    snprintf(full, sizeof(full), "%s/%s", root, path);
+    FILE *f = fopen(full, "w");
+    fputs(text, f);
+    fclose(f);
+}
+
+static void AddConnector(const char *root, const char *name, const char *id,
+                         const char *status, const char *modes) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s", root, name);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/connector_id", name);
+    WriteFile(root, path, id);
+    snprintf(path, sizeof(path), "%s/status", name);
+    WriteFile(root, path, status);
+    snprintf(path, sizeof(path), "%s/modes", name);
+    WriteFile(root, path, modes);
+}
+
+static void test_hotplug(void) {
+    char root[] = "/tmp/displaymode-drm-XXXXXX";
+    ASSERT(mkdtemp(root) != NULL, "temporary tree");
+    AddConnector(root, "card0-DP-1", "40\n", "connected\n", "1920x1080\n");
+    AddConnector(root, "card0-DP-2", "41\n", "disconnected\n", "");
+    struct DrmBackend drm;
+    DrmBackendInit(&drm, root);
+    struct DisplayCatalog catalog;
+    DisplayCatalogInit(&catalog, &drm.backend);
+    DisplayCatalogLoadDisplays(&catalog);
+    ASSERT(catalog.num_displays == 1, "one display");
+    struct DisplayEvent events[4];
+    ASSERT(drm.events.wait(drm.events.context, 0, events, 4) == 0,
+           "no change yet");
+
+    AddConnector(root, "card0-DP-2", "41\n", "connected\n", "2560x1440\n");
+    ASSERT(drm.events.wait(drm.events.context, 0, events, 4) == 1 &&
+           events[0].flags == kDisplayEventRescan, "plug reported");
+    ASSERT(drm.events.wait(drm.events.context, 0, events, 4) == 0,
+           "reported once");
+    ASSERT(DisplayCatalogRevalidate(&catalog) == 0 &&
+           catalog.num_displays == 2 && catalog.displays[1] == 41,
+           "plugged display listed");
+
+    WriteFile(root, "card0-DP-1/status", "disconnected\n");
+    ASSERT(drm.events.wait(drm.events.context, 0, events, 4) == 1,
+           "unplug reported");
+    ASSERT(DisplayCatalogRevalidate(&catalog) == 0 &&
+           catalog.num_displays == 1 && catalog.displays[0] == 41,
+           "unplugged display dropped");
+    const struct DisplayModeList *list = NULL;
+    ASSERT(DisplayCatalogGetModes(&catalog, 0, &list) == 0 &&
+           list->count == 1 && list->modes[0].width == 2560,
+           "remaining display's modes");
+    DisplayCatalogFree(&catalog);
+    DrmBackendFree(&drm);
+
+    char command[128];
+    snprintf(command, sizeof(command), "rm -rf %s", root);
+    ASSERT(system(command) == 0, "temporary tree removed");
+}
+
+int main(void) {
+    setLogLevel(LOG_LEVEL_ERROR);
+    test_parse_modes();
+    test_fixture_displays();
+    test_list_command();
+    test_hotplug();
+
+    if (tests_failed == 0) {
+        printf("All %d DRM tests passed.\n", tests_run);
+        return EXIT_SUCCESS;
+    } else {
+        fprintf(stderr, "%d of %d DRM tests failed.\n", tests_failed,
+                tests_run);
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,307 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "../displaymode_catalog.h"
+#include "../displaymode_commands.h"
+#include "../displaymode_edid.h"
+#include "../displaymode_parse.h"
+#include "../displaymode_table.h"
+#include "../logging.h"
+#include "fake_backend.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int tests_run = 0;
+static int tests_failed = 0;
+
+#define ASSERT(expr, msg) do { \
+    tests_run++; \
+    if (!(expr)) { \
+        fprintf(stderr, "FAIL: %s (test %d)\n", msg, tests_run); \
+        tests_failed++; \
+    } \
+} while (0)
+
+static const char kFixtures[] = "tests/fixtures/edid";
+
+// Reads the fixture "name" into "data".  Returns its size, or 0.
+static size_t ReadFixture(const char *name, unsigned char *data, size_t size) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s", kFixtures, name);
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return 0;
+    }
+    const size_t n = fread(data, 1, size, f);
+    fclose(f);
+    return n;
+}
+
+// Fixes the checksum of the 128-byte block at "block".
+static void FixChecksum(unsigned char *block) {
+    unsigned sum = 0;
+    for (size_t i = 0; i < kEdidBlockSize - 1; ++i) {
+        sum += block[i];
+    }
+    block[kEdidBlockSize - 1] = (unsigned char)(0x100 - (sum & 0xff));
+}
+
+// What each EDID of the corpus decodes to.
+struct Expected {
+    const char *file;
+    int valid;
+    const char *name;  // from EdidDisplayName
+    uint32_t vendor;
+    uint32_t width_mm;
+    uint32_t height_mm;
+    uint8_t bits_per_color;
+    size_t num_timings;
+    uint32_t native_width;
+    uint32_t native_height;
+    uint32_t native_mhz;
+};
+
+static const struct Expected kCorpus[] = {
+    // EDID 1.4, one detailed timing.
+    {"dell-u2723qe.bin", 1, "DELL U2723QE", 0x10ac, 597, 336, 8, 1, 3840,
+     2160, 59997},
+    {"boe-ne135fbm.bin", 1, "NE135FBM-N41", 0x09e5, 286, 179, 8, 1, 2560,
+     1600, 59972},
+    // EDID 1.3 with CTA-861 timings, one of them interlaced and one the
+    // same as the native timing.
+    {"samsung-tv-cta.bin", 1, "SAMSUNG", 0x4c2d, 1218, 685, 0, 3, 1920, 1080,
+     60000},
+    // The native timing comes from a DisplayID extension.
+    {"lg-ultrafine-5k.bin", 1, "LG UltraFine", 0x1e6d, 597, 336, 10, 2, 5120,
+     2880, 60442},
+    // Analog, no name, the size only in centimeters.
+    {"hp-vga-analog.bin", 1, "HWP 3124", 0x22f0, 340, 270, 0, 1, 1280, 1024,
+     60020},
+    // A bare DisplayID 2.0 section.
+    {"apple-studio-displayid.bin", 1, "Studio Display", 0x0010fa, 597, 336, 0,
+     1, 5120, 2880, 60442},
+    {"bad-checksum.bin", 0, NULL, 0, 0, 0, 0, 0, 0, 0, 0},
+    {"truncated.bin", 0, NULL, 0, 0, 0, 0, 0, 0, 0, 0},
+};
+
+static void test_corpus(void) {
+    for (size_t i = 0; i < sizeof(kCorpus) / sizeof(kCorpus[0]); ++i) {
+        const struct Expected *expected = &kCorpus[i];
+        unsigned char data[1024];
+        const size_t size = ReadFixture(expected->file, data, sizeof(data));
+        char msg[128];
+        snprintf(msg, sizeof(msg), "%s read", expected->file);
+        ASSERT(size > 0, msg);
+        struct EdidInfo info;
+        const int e = EdidDecode(data, size, &info);
+        snprintf(msg, sizeof(msg), "%s decodes: %s", expected->file,
+                 expected->valid ? "yes" : "no");
+        ASSERT((e == 0) == expected->valid, msg);
+        if (!expected->valid) {
+            continue;
+        }
+        char name[kEdidMaxString];
+        EdidDisplayName(&info, name, sizeof(name));
+        snprintf(msg, sizeof(msg), "%s identity", expected->file);
+        ASSERT(strcmp(name, expected->name) == 0 &&
+               info.vendor == expected->vendor, msg);
+        snprintf(msg, sizeof(msg), "%s size and depth", expected->file);
+        ASSERT(info.width_mm == expected->width_mm &&
+               info.height_mm == expected->height_mm &&
+               info.bits_per_color == expected->bits_per_color, msg);
+        snprintf(msg, sizeof(msg), "%s timings", expected->file);
+        ASSERT(info.has_native && info.num_timings == expected->num_timings &&
+               info.timings[0].width == expected->native_width &&
+               info.timings[0].height == expected->native_height &&
+               info.timings[0].refresh_mhz == expected->native_mhz, msg);
+    }
+}
+
+static void test_details(void) {
+    unsigned char data[1024];
+    struct EdidInfo info;
+    size_t size = ReadFixture("dell-u2723qe.bin", data, sizeof(data));
+    EdidDecode(data, size, &info);
+    ASSERT(strcmp(info.vendor_id, "DEL") == 0 && info.model == 0xa0c4 &&
+           info.serial == 0x4c4b3033 &&
+           strcmp(info.serial_string, "7XKQ3L3") == 0 && info.version == 1 &&
+           info.revision == 4 && info.digital &&
+           info.timings[0].pixel_clock_khz == 533250,
+           "header, serial string and pixel clock");
+
+    size = ReadFixture("samsung-tv-cta.bin", data, sizeof(data));
+    EdidDecode(data, size, &info);
+    ASSERT(info.timings[1].width == 1280 && info.timings[1].height == 720 &&
+           info.timings[2].width == 1920 && info.timings[2].height == 1080 &&
+           info.timings[2].interlaced && !info.timings[0].interlaced,
+           "CTA timings, interlaced frames at full height");
+
+    size = ReadFixture("lg-ultrafine-5k.bin", data, sizeof(data));
+    EdidDecode(data, size, &info);
+    ASSERT(info.timings[1].width == 2560 && info.timings[1].height == 1440,
+           "base timing follows the larger DisplayID one");
+    data[kEdidBlockSize + 10] ^= 0xff;
+    EdidDecode(data, size, &info);
+    ASSERT(info.num_timings == 1 && info.timings[0].width == 2560,
+           "extension with a bad checksum skipped");
+    ASSERT(EdidDecode(data, kEdidBlockSize, &info) == 0 &&
+           info.num_timings == 1, "missing extension skipped");
+
+    size = ReadFixture("apple-studio-displayid.bin", data, sizeof(data));
+    EdidDecode(data, size, &info);
+    ASSERT(info.version == 2 && info.revision == 0 && info.model == 0xae31 &&
+           info.serial == 1234 && info.vendor_id[0] == '\0',
+           "DisplayID product identification");
+    data[1] += 1;
+    ASSERT(EdidDecode(data, size, &info) != 0,
+           "DisplayID section longer than the data");
+    ASSERT(EdidDecode(data, 0, &info) != 0, "no data");
+}
+
+static void test_names_and_encodings(void) {
+    struct EdidInfo info;
+    memset(&info, 0, sizeof(info));
+    char out[kEdidMaxString];
+    EdidDisplayName(&info, out, sizeof(out));
+    ASSERT(strcmp(out, "Display") == 0, "no name or vendor");
+    EdidPixelEncoding(&info, out, sizeof(out));
+    ASSERT(strcmp(out, "Unknown") == 0, "unknown depth");
+    info.bits_per_color = 6;
+    EdidPixelEncoding(&info, out, sizeof(out));
+    ASSERT(strcmp(out, "--------------RRRRRRGGGGGGBBBBBB") == 0,
+           "6 bits per color, padded to 32");
+    info.bits_per_color = 16;
+    EdidPixelEncoding(&info, out, sizeof(out));
+    ASSERT(strlen(out) == 48 && out[0] == 'R' && out[47] == 'B',
+           "16 bits per color, no padding");
+    EdidPixelEncoding(&info, out, 40);
+    ASSERT(strcmp(out, "Unknown") == 0, "encoding that doesn't fit");
+
+    ASSERT(EdidDpi(&info, 3840) == 0.0 && !EdidIsHiDpi(&info, 3840),
+           "no size, no HiDPI");
+    info.width_mm = 597;
+    ASSERT(EdidIsHiDpi(&info, 3840) && !EdidIsHiDpi(&info, 2560),
+           "HiDPI from the pixel density");
+}
+
+static void test_cache(void) {
+    unsigned char dell[1024];
+    unsigned char copy[1024];
+    unsigned char boe[1024];
+    const size_t dell_size = ReadFixture("dell-u2723qe.bin", dell, sizeof(dell));
+    const size_t boe_size = ReadFixture("boe-ne135fbm.bin", boe, sizeof(boe));
+    memcpy(copy, dell, dell_size);
+
+    struct EdidCache cache;
+    EdidCacheInit(&cache);
+    const struct EdidCacheEntry *first = EdidCacheGet(&cache, dell, dell_size);
+    ASSERT(first != NULL && first->valid && cache.decodes == 1 &&
+           strcmp(first->info.name, "DELL U2723QE") == 0, "decoded once");
+    ASSERT(EdidCacheGet(&cache, copy, dell_size) == first &&
+           cache.decodes == 1 && cache.hits == 1, "same bytes, cached");
+    ASSERT(EdidCacheGet(&cache, boe, boe_size) != first &&
+           cache.decodes == 2, "other bytes decoded");
+    const struct EdidCacheEntry *bad = EdidCacheGet(&cache, dell, 100);
+    ASSERT(bad != NULL && !bad->valid && cache.decodes == 3,
+           "undecodable bytes cached too");
+    ASSERT(EdidCacheGet(&cache, dell, 100) == bad && cache.decodes == 3,
+           "and not decoded again");
+
+    // Enough distinct EDIDs (different serial numbers) to grow the cache;
+    // entries stay put.
+    for (unsigned serial = 0; serial < 100; ++serial) {
+        copy[12] = (unsigned char)serial;
+        FixChecksum(copy);
+        EdidCacheGet(&cache, copy, dell_size);
+    }
+    ASSERT(cache.count == 102 && cache.capacity >= 128 &&
+           EdidCacheGet(&cache, dell, dell_size) == first &&
+           first->info.serial == 0x4c4b3033, "cache grown");
+    copy[12] = 42;
+    FixChecksum(copy);
+    const struct EdidCacheEntry *entry = EdidCacheGet(&cache, copy, dell_size);
+    ASSERT(entry != NULL && entry->info.serial == 0x4c4b302a &&
+           cache.decodes == 102, "grown cache still finds entries");
+    EdidCacheFree(&cache);
+}
+
+static void test_table(void) {
+    unsigned char data[1024];
+    struct EdidInfo info;
+    EdidDecode(data, ReadFixture("dell-u2723qe.bin", data, sizeof(data)),
+               &info);
+    struct DisplayMode modes[] = {
+        {3840, 2160, 60.0, 1, 1, NULL},
+        {2560, 1440, 60.0, 1, 2, NULL},
+    };
+    struct DisplayModeList list = {modes, 2, modes[0], 1, 0, NULL};
+    struct DisplayModeTable table;
+    DisplayModeTableBuild(&table, &list);
+    char line[kModeTableMaxLine];
+    DisplayModeTableFormatRow(&table, 0, line, sizeof(line));
+    ASSERT(strstr(line, "Enc:Unknown ") && strstr(line, " Std Display "),
+           "undescribed rows");
+    DisplayModeTableDescribe(&table, &info);
+    DisplayModeTableFormatRow(&table, 0, line, sizeof(line));
+    ASSERT(strstr(line, "Enc:--------RRRRRRRRGGGGGGGGBBBBBBBB ") &&
+           strstr(line, " HiDPI DELL U2723QE Cat:HiDPI"), "described HiDPI row");
+    DisplayModeTableFormatRow(&table, 1, line, sizeof(line));
+    ASSERT(strstr(line, " Std DELL U2723QE Cat:") &&
+           strstr(line, "Cat:HiDPI") == NULL &&
+           (table.flags[0] & kModeFlagCurrent) &&
+           (table.flags[1] & kModeFlagUsable), "described standard row");
+    DisplayModeTableFree(&table);
+}
+
+static void test_catalog(void) {
+    unsigned char dell[1024];
+    const size_t size = ReadFixture("dell-u2723qe.bin", dell, sizeof(dell));
+    struct FakeBackend fake;
+    FakeBackendInit(&fake);
+    FakeBackendAddSyntheticDisplay(&fake, 1, 4);
+    FakeBackendAddSyntheticDisplay(&fake, 2, 4);
+    FakeBackendSetEdid(&fake, 1, dell, size);
+    struct DisplayCatalog catalog;
+    DisplayCatalogInit(&catalog, &fake.backend);
+    const char *argv[] = {"displaymode", "d", NULL};
+    const struct ParsedArgs parsed_args = ParseArgs(2, argv);
+
+    for (int round = 0; round < 2; ++round) {
+        char *text = NULL;
+        size_t length = 0;
+        FILE *out = open_memstream(&text, &length);
+        RunCommand(&catalog, &parsed_args, out, stderr);
+        fclose(out);
+        const char *second = strstr(text, "Display 1:");
+        ASSERT(second != NULL && strstr(text, " DELL U2723QE Cat:") < second &&
+               strstr(second, "DELL") == NULL &&
+               strstr(second, " Display Cat:") != NULL,
+               round == 0 ? "names from the EDID" : "names listed again");
+        free(text);
+        DisplayCatalogInvalidate(&catalog);
+    }
+    ASSERT(fake.get_edid_calls == 4 && catalog.edid_cache.decodes == 1 &&
+           catalog.edid_cache.hits == 1, "EDID decoded once");
+    DisplayCatalogFree(&catalog);
+    FakeBackendFree(&fake);
+}
+
+int main(void) {
+    setLogLevel(LOG_LEVEL_ERROR);
+    test_corpus();
+    test_details();
+    test_names_and_encodings();
+    test_cache();
+    test_table();
+    test_catalog();
+
+    if (tests_failed == 0) {
+        printf("All %d EDID tests passed.\n", tests_run);
+        return EXIT_SUCCESS;
+    } else {
+        fprintf(stderr, "%d of %d EDID tests failed.\n", tests_failed,
+                tests_run);
+        return EXIT_FAILURE;
+    }
+}
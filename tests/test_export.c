@@ -0,0 +1,645 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "../displaymode_catalog.h"
+#include "../displaymode_commands.h"
+#include "../displaymode_export.h"
+#include "../displaymode_parse.h"
+#include "../displaymode_table.h"
+#include "../logging.h"
+#include "fake_backend.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int tests_run = 0;
+static int tests_failed = 0;
+
+#define ASSERT(expr, msg) do { \
+    tests_run++; \
+    if (!(expr)) { \
+        fprintf(stderr, "FAIL: %s (test %d)\n", msg, tests_run); \
+        tests_failed++; \
+    } \
+} while (0)
+
+// A minimal CBOR decoder for the subset the writer produces.  Any mismatch
+// sets "error".
+struct CborReader {
+    const unsigned char *p;
+    const unsigned char *end;
+    int error;
+};
+
+// Reads a head: its major type (0-7), its argument and whether it is
+// indefinite (additional information 31).
+static void ReadHead(struct CborReader *reader, int *major, uint64_t *value,
+                     int *indefinite) {
+    *major = -1;
+    *value = 0;
+    *indefinite = 0;
+    if (reader->error || reader->p >= reader->end) {
+        reader->error = 1;
+        return;
+    }
+    const unsigned char head = *reader->p++;
+    *major = head >> 5;
+    const unsigned info = head & 0x1f;
+    if (info < 24) {
+        *value = info;
+        return;
+    }
+    if (info == 31) {
+        *indefinite = 1;
+        return;
+    }
+    if (info > 27) {
+        reader->error = 1;
+        return;
+    }
+    const size_t size = (size_t)1 << (info - 24);
+    if ((size_t)(reader->end - reader->p) < size) {
+        reader->error = 1;
+        return;
+    }
+    for (size_t i = 0; i < size; ++i) {
+        *value = *value << 8 | *reader->p++;
+    }
+}
+
+static uint64_t ReadUint(struct CborReader *reader) {
+    int major, indefinite;
+    uint64_t value;
+    ReadHead(reader, &major, &value, &indefinite);
+    if (major != 0 || indefinite) {
+        reader->error = 1;
+    }
+    return value;
+}
+
+static int64_t ReadInt(struct CborReader *reader) {
+    int major, indefinite;
+    uint64_t value;
+    ReadHead(reader, &major, &value, &indefinite);
+    if ((major != 0 && major != 1) || indefinite) {
+        reader->error = 1;
+    }
+    return major == 1 ? (int64_t)~value : (int64_t)value;
+}
+
+// Reads the count of an array (major 4) or map (5); kCborIndefinite for an
+// indefinite one.
+static size_t ReadContainer(struct CborReader *reader, int expected_major) {
+    int major, indefinite;
+    uint64_t value;
+    ReadHead(reader, &major, &value, &indefinite);
+    if (major != expected_major) {
+        reader->error = 1;
+    }
+    return indefinite ? kCborIndefinite : (size_t)value;
+}
+
+// Reads a text string into "out" (truncated to fit).
+static void ReadString(struct CborReader *reader, char *out, size_t out_size) {
+    int major, indefinite;
+    uint64_t length;
+    ReadHead(reader, &major, &length, &indefinite);
+    if (major != 3 || indefinite ||
+        (uint64_t)(reader->end - reader->p) < length) {
+        reader->error = 1;
+        out[0] = '\0';
+        return;
+    }
+    const size_t n = length < out_size - 1 ? (size_t)length : out_size - 1;
+    memcpy(out, reader->p, n);
+    out[n] = '\0';
+    reader->p += length;
+}
+
+// Returns non-zero if the next string is "expected".
+static int ReadKey(struct CborReader *reader, const char *expected) {
+    char key[64];
+    ReadString(reader, key, sizeof(key));
+    return !reader->error && strcmp(key, expected) == 0;
+}
+
+static double HalfToDouble(uint16_t half) {
+    const int exponent = (half >> 10) & 0x1f;
+    const int mantissa = half & 0x3ff;
+    double value;
+    if (exponent == 0) {
+        value = ldexp(mantissa, -24);
+    } else if (exponent == 31) {
+        value = mantissa == 0 ? INFINITY : NAN;
+    } else {
+        value = ldexp(mantissa + 1024, exponent - 25);
+    }
+    return half & 0x8000 ? -value : value;
+}
+
+static double ReadDouble(struct CborReader *reader) {
+    int major, indefinite;
+    uint64_t bits;
+    const unsigned char head = reader->p < reader->end ? *reader->p : 0;
+    ReadHead(reader, &major, &bits, &indefinite);
+    if (major != 7) {
+        reader->error = 1;
+        return 0.0;
+    }
+    switch (head & 0x1f) {
+        case 25:
+            return HalfToDouble((uint16_t)bits);
+        case 26: {
+            const uint32_t bits32 = (uint32_t)bits;
+            float value;
+            memcpy(&value, &bits32, sizeof(value));
+            return value;
+        }
+        case 27: {
+            double value;
+            memcpy(&value, &bits, sizeof(value));
+            return value;
+        }
+        default:
+            reader->error = 1;
+            return 0.0;
+    }
+}
+
+// Reads a bool, or null (returned as -1).
+static int ReadSimple(struct CborReader *reader) {
+    int major, indefinite;
+    uint64_t value;
+    ReadHead(reader, &major, &value, &indefinite);
+    if (major != 7 || value < 20 || value > 22) {
+        reader->error = 1;
+        return -1;
+    }
+    return value == 22 ? -1 : (int)(value - 20);
+}
+
+static int AtBreak(struct CborReader *reader) {
+    return reader->p < reader->end && *reader->p == 0xff;
+}
+
+// Writes one item with "write" and compares the bytes with "expected".
+#define EXPECT_CBOR(write, expected, msg) do { \
+    struct CborWriter cbor; \
+    CborWriterInit(&cbor, NULL); \
+    write; \
+    ASSERT(!cbor.error && cbor.length == sizeof(expected) - 1 && \
+           memcmp(cbor.buffer, expected, cbor.length) == 0, msg); \
+} while (0)
+
+static void test_cbor_values(void) {
+    // Examples from RFC 8949, appendix A.
+    EXPECT_CBOR(CborWriterUint(&cbor, 0), "\x00", "0");
+    EXPECT_CBOR(CborWriterUint(&cbor, 23), "\x17", "23");
+    EXPECT_CBOR(CborWriterUint(&cbor, 24), "\x18\x18", "24");
+    EXPECT_CBOR(CborWriterUint(&cbor, 1000), "\x19\x03\xe8", "1000");
+    EXPECT_CBOR(CborWriterUint(&cbor, 1000000), "\x1a\x00\x0f\x42\x40", "1000000");
+    EXPECT_CBOR(CborWriterUint(&cbor, 1000000000000ULL),
+                "\x1b\x00\x00\x00\xe8\xd4\xa5\x10\x00", "1000000000000");
+    EXPECT_CBOR(CborWriterInt(&cbor, -1), "\x20", "-1");
+    EXPECT_CBOR(CborWriterInt(&cbor, -100), "\x38\x63", "-100");
+    EXPECT_CBOR(CborWriterInt(&cbor, INT64_MIN),
+                "\x3b\x7f\xff\xff\xff\xff\xff\xff\xff", "INT64_MIN");
+    EXPECT_CBOR(CborWriterDouble(&cbor, 0.0), "\xf9\x00\x00", "0.0");
+    EXPECT_CBOR(CborWriterDouble(&cbor, -0.0), "\xf9\x80\x00", "-0.0");
+    EXPECT_CBOR(CborWriterDouble(&cbor, 1.5), "\xf9\x3e\x00", "1.5");
+    EXPECT_CBOR(CborWriterDouble(&cbor, 65504.0), "\xf9\x7b\xff", "65504.0");
+    EXPECT_CBOR(CborWriterDouble(&cbor, 5.960464477539063e-8), "\xf9\x00\x01",
+                "smallest subnormal half");
+    EXPECT_CBOR(CborWriterDouble(&cbor, -4.0), "\xf9\xc4\x00", "-4.0");
+    EXPECT_CBOR(CborWriterDouble(&cbor, 100000.0), "\xfa\x47\xc3\x50\x00",
+                "100000.0 is a single");
+    EXPECT_CBOR(CborWriterDouble(&cbor, 1.1),
+                "\xfb\x3f\xf1\x99\x99\x99\x99\x99\x9a", "1.1 is a double");
+    EXPECT_CBOR(CborWriterDouble(&cbor, INFINITY), "\xf9\x7c\x00", "infinity");
+    EXPECT_CBOR(CborWriterDouble(&cbor, NAN), "\xf9\x7e\x00", "NaN");
+    EXPECT_CBOR(CborWriterBool(&cbor, 1), "\xf5", "true");
+    EXPECT_CBOR(CborWriterBool(&cbor, 0), "\xf4", "false");
+    EXPECT_CBOR(CborWriterNull(&cbor), "\xf6", "null");
+    EXPECT_CBOR(CborWriterString(&cbor, "IETF"), "\x64IETF", "string");
+    EXPECT_CBOR(CborWriterString(&cbor, ""), "\x60", "empty string");
+    EXPECT_CBOR((CborWriterBeginMap(&cbor, 1), CborWriterString(&cbor, "a"),
+                 CborWriterBeginArray(&cbor, kCborIndefinite),
+                 CborWriterUint(&cbor, 1), CborWriterEnd(&cbor)),
+                "\xa1\x61\x61\x9f\x01\xff", "containers");
+
+    // Common refresh rates round-trip through the shortest encoding.
+    static const double kRates[] = {60.0, 59.94, 23.976, 119.88, 143.856, 0.5};
+    for (size_t i = 0; i < sizeof(kRates) / sizeof(kRates[0]); ++i) {
+        struct CborWriter cbor;
+        CborWriterInit(&cbor, NULL);
+        CborWriterDouble(&cbor, kRates[i]);
+        struct CborReader reader = {cbor.buffer, cbor.buffer + cbor.length, 0};
+        ASSERT(ReadDouble(&reader) == kRates[i] && !reader.error &&
+               reader.p == reader.end, "refresh rate round-trips");
+    }
+}
+
+// Writes fields with "write" as one CSV or TSV row and compares the text.
+#define EXPECT_CSV(separator, write, expected, msg) do { \
+    struct CsvWriter csv; \
+    CsvWriterInit(&csv, NULL, separator); \
+    write; \
+    CsvWriterEndRow(&csv); \
+    ASSERT(!csv.error && csv.length == strlen(expected) && \
+           memcmp(csv.buffer, expected, csv.length) == 0, msg); \
+} while (0)
+
+static void test_csv_values(void) {
+    EXPECT_CSV(',', (CsvWriterUint(&csv, 1), CsvWriterInt(&csv, -2),
+                     CsvWriterBool(&csv, 1), CsvWriterString(&csv, "x")),
+               "1,-2,1,x\n", "fields separated");
+    EXPECT_CSV(',', (CsvWriterString(&csv, "a,b"),
+                     CsvWriterString(&csv, "say \"hi\""),
+                     CsvWriterString(&csv, "two\nlines")),
+               "\"a,b\",\"say \"\"hi\"\"\",\"two\nlines\"\n", "CSV quoting");
+    EXPECT_CSV(',', (CsvWriterString(&csv, ""), CsvWriterString(&csv, "")),
+               ",\n", "empty fields");
+    EXPECT_CSV('\t', (CsvWriterString(&csv, "a,b"),
+                      CsvWriterString(&csv, "tab\there\nand\"quote")),
+               "a,b\ttab here and\"quote\n", "TSV replaces tabs and breaks");
+    EXPECT_CSV(',', (CsvWriterDouble(&csv, 60.0), CsvWriterDouble(&csv, 59.94),
+                     CsvWriterDouble(&csv, 0.1 + 0.2),
+                     CsvWriterDouble(&csv, -3.0)),
+               "60,59.94,0.30000000000000004,-3\n", "doubles round-trip");
+    EXPECT_CSV(',', (CsvWriterUint(&csv, UINT64_MAX),
+                     CsvWriterInt(&csv, INT64_MIN)),
+               "18446744073709551615,-9223372036854775808\n", "integer limits");
+}
+
+static void test_streams(void) {
+    char *text = NULL;
+    size_t length = 0;
+    FILE *out = open_memstream(&text, &length);
+    char *long_string = malloc(3 * kExportBufferSize);
+    memset(long_string, 'x', 3 * kExportBufferSize - 1);
+    long_string[3 * kExportBufferSize - 1] = '\0';
+
+    struct CborWriter *cbor = malloc(sizeof(*cbor));
+    CborWriterInit(cbor, out);
+    CborWriterBeginArray(cbor, kCborIndefinite);
+    for (int i = 0; i < 5000; ++i) {
+        CborWriterDouble(cbor, i + 0.1);
+    }
+    CborWriterString(cbor, long_string);
+    CborWriterEnd(cbor);
+    ASSERT(CborWriterFlush(cbor) == 0, "CBOR flush");
+    fflush(out);
+    ASSERT(length > 3 * kExportBufferSize, "CBOR larger than the buffer");
+    struct CborReader reader = {(const unsigned char *)text,
+                                (const unsigned char *)text + length, 0};
+    ASSERT(ReadContainer(&reader, 4) == kCborIndefinite, "array");
+    int values_ok = 1;
+    for (int i = 0; i < 5000; ++i) {
+        values_ok = values_ok && ReadDouble(&reader) == i + 0.1;
+    }
+    char *read_back = malloc(3 * kExportBufferSize);
+    ReadString(&reader, read_back, 3 * kExportBufferSize);
+    ASSERT(values_ok && !reader.error && strcmp(read_back, long_string) == 0 &&
+           AtBreak(&reader) && reader.p + 1 == reader.end,
+           "streamed CBOR reads back");
+    free(read_back);
+
+    // Without a stream, overflowing the buffer is an error.
+    CborWriterInit(cbor, NULL);
+    CborWriterString(cbor, long_string);
+    ASSERT(cbor->error, "CBOR overflow without a stream is an error");
+    free(cbor);
+
+    struct CsvWriter *csv = malloc(sizeof(*csv));
+    CsvWriterInit(csv, NULL, ',');
+    CsvWriterString(csv, long_string);
+    ASSERT(csv->error, "CSV overflow without a stream is an error");
+    free(csv);
+    free(long_string);
+    fclose(out);
+    free(text);
+}
+
+// Runs "d" with the given flag and returns its output and its length.
+static char *ListModes(struct FakeBackend *fake, const char *flag,
+                       size_t *length) {
+    char *text = NULL;
+    FILE *out = open_memstream(&text, length);
+    struct DisplayCatalog catalog;
+    DisplayCatalogInit(&catalog, &fake->backend);
+    const char *argv[] = {"displaymode", "d", flag, NULL};
+    const struct ParsedArgs parsed_args = ParseArgs(3, argv);
+    ASSERT(RunCommand(&catalog, &parsed_args, out, stderr) == 0, "d succeeds");
+    DisplayCatalogFree(&catalog);
+    fclose(out);
+    return text;
+}
+
+// Splits the CSV or TSV row at "*p" into "fields" and advances *p past it.
+// Returns the number of fields.
+static size_t ReadCsvRow(const char **p, char separator,
+                         char fields[][128], size_t max_fields) {
+    size_t count = 0;
+    const char *s = *p;
+    for (;;) {
+        char field[128];
+        size_t length = 0;
+        if (*s == '"') {
+            for (++s; *s != '\0'; ++s) {
+                if (*s == '"' && s[1] == '"') {
+                    ++s;
+                } else if (*s == '"') {
+                    ++s;
+                    break;
+                }
+                if (length < sizeof(field) - 1) {
+                    field[length++] = *s;
+                }
+            }
+        } else {
+            for (; *s != '\0' && *s != separator && *s != '\n'; ++s) {
+                if (length < sizeof(field) - 1) {
+                    field[length++] = *s;
+                }
+            }
+        }
+        field[length] = '\0';
+        if (count < max_fields) {
+            memcpy(fields[count], field, length + 1);
+        }
+        ++count;
+        if (*s == separator) {
+            ++s;
+            continue;
+        }
+        if (*s == '\n') {
+            ++s;
+        }
+        *p = s;
+        return count;
+    }
+}
+
+// The catalog as listed, to compare exports with.
+struct Reference {
+    struct DisplayCatalog catalog;
+    const struct DisplayModeTable *tables[2];
+};
+
+static void LoadReference(struct Reference *reference,
+                          struct FakeBackend *fake) {
+    DisplayCatalogInit(&reference->catalog, &fake->backend);
+    DisplayCatalogLoadDisplays(&reference->catalog);
+    for (uint32_t i = 0; i < 2; ++i) {
+        const struct DisplayModeList *list = NULL;
+        DisplayCatalogGetModes(&reference->catalog, i, &list);
+        DisplayCatalogGetTable(&reference->catalog, i, &reference->tables[i]);
+    }
+}
+
+// The refresh rate of the table's row "row" at full precision.
+static double RefreshRate(const struct DisplayModeList *list, size_t row) {
+    return row < list->count ? list->modes[row].refresh_rate
+                             : list->current.refresh_rate;
+}
+
+// Checks every CSV or TSV row of "text" against the reference.
+static void CheckCsv(const char *text, char separator,
+                     const struct Reference *reference,
+                     const struct EdidInfo *edid) {
+    const char *p = text;
+    char fields[kExportDisplayColumns + kExportModeColumns + 1][128];
+    ASSERT(ReadCsvRow(&p, separator, fields, kExportDisplayColumns + kExportModeColumns + 1) ==
+           kExportDisplayColumns + kExportModeColumns, "header width");
+    ASSERT(strcmp(fields[0], "display") == 0 &&
+           strcmp(fields[kExportDisplayColumns], "width") == 0 &&
+           strcmp(fields[kExportDisplayColumns + kExportModeColumns - 1],
+                  "current") == 0, "header names the columns");
+    int rows_ok = 1;
+    size_t rows = 0;
+    for (uint32_t i = 0; i < 2; ++i) {
+        const struct DisplayModeTable *table = reference->tables[i];
+        const struct DisplayModeList *list = &reference->catalog.modes[i];
+        for (size_t row = 0; row < table->count; ++row, ++rows) {
+            const size_t n = ReadCsvRow(&p, separator, fields, kExportDisplayColumns + kExportModeColumns + 1);
+            char **strings = table->strings;
+            char (*m)[128] = fields + kExportDisplayColumns;
+            const int display_ok =
+                n == kExportDisplayColumns + kExportModeColumns &&
+                strtoul(fields[0], NULL, 10) == i &&
+                strcmp(fields[1], i == 0 ? "1" : "0") == 0 &&
+                (i == 1 && edid != NULL
+                     ? strcmp(fields[2], edid->vendor_id) == 0 &&
+                       strtoul(fields[3], NULL, 10) == edid->vendor &&
+                       strtoul(fields[4], NULL, 10) == edid->model &&
+                       strtoul(fields[7], NULL, 10) == edid->width_mm
+                     : fields[2][0] == '\0' && fields[8][0] == '\0');
+            const uint8_t flags = table->flags[row];
+            const int mode_ok =
+                strtoul(m[0], NULL, 10) == table->resolution[row] >> 16 &&
+                strtoul(m[1], NULL, 10) == (table->resolution[row] & 0xffff) &&
+                strtod(m[2], NULL) == RefreshRate(list, row) &&
+                strtoul(m[3], NULL, 10) == table->aspect[row] >> 16 &&
+                strtoul(m[4], NULL, 10) == (table->aspect[row] & 0xffff) &&
+                strcmp(m[5], strings[table->encoding[row]]) == 0 &&
+                strtol(m[6], NULL, 10) == table->mode_id[row] &&
+                (m[7][0] == '1') == !!(flags & kModeFlagHiDPI) &&
+                strcmp(m[8], strings[table->display_name[row]]) == 0 &&
+                strcmp(m[9], strings[table->category[row]]) == 0 &&
+                (m[10][0] == '1') == !!(flags & kModeFlagUsable) &&
+                (m[11][0] == '1') == !!(flags & kModeFlagCurrent);
+            rows_ok = rows_ok && display_ok && mode_ok;
+        }
+    }
+    ASSERT(rows == 3003, "reference has every mode");
+    ASSERT(rows_ok, "every row reads back as listed");
+    ASSERT(*p == '\0', "nothing after the rows");
+}
+
+// Checks the CBOR document "data" against the reference.
+static void CheckCbor(const unsigned char *data, size_t length,
+                      const struct Reference *reference,
+                      const struct EdidInfo *edid) {
+    struct CborReader reader = {data, data + length, 0};
+    ASSERT(ReadContainer(&reader, 5) == 1 && ReadKey(&reader, "displays") &&
+           ReadContainer(&reader, 4) == 2, "document holds the displays");
+    int displays_ok = 1;
+    int rows_ok = 1;
+    for (uint32_t i = 0; i < 2; ++i) {
+        const struct DisplayModeTable *table = reference->tables[i];
+        const struct DisplayModeList *list = &reference->catalog.modes[i];
+        displays_ok = displays_ok &&
+            ReadContainer(&reader, 5) == kExportDisplayColumns + 3 &&
+            ReadKey(&reader, "display") && ReadUint(&reader) == i &&
+            ReadKey(&reader, "main") && ReadSimple(&reader) == (i == 0);
+        if (i == 1 && edid != NULL) {
+            char vendor_id[8];
+            displays_ok = displays_ok && ReadKey(&reader, "vendorId");
+            ReadString(&reader, vendor_id, sizeof(vendor_id));
+            displays_ok = displays_ok &&
+                strcmp(vendor_id, edid->vendor_id) == 0 &&
+                ReadKey(&reader, "vendor") && ReadUint(&reader) == edid->vendor &&
+                ReadKey(&reader, "model") && ReadUint(&reader) == edid->model &&
+                ReadKey(&reader, "serial") && ReadUint(&reader) == edid->serial &&
+                ReadKey(&reader, "serialString");
+            char serial[kEdidMaxString];
+            ReadString(&reader, serial, sizeof(serial));
+            displays_ok = displays_ok &&
+                strcmp(serial, edid->serial_string) == 0 &&
+                ReadKey(&reader, "widthMm") &&
+                ReadUint(&reader) == edid->width_mm &&
+                ReadKey(&reader, "heightMm") &&
+                ReadUint(&reader) == edid->height_mm;
+        } else {
+            for (size_t c = 2; c < kExportDisplayColumns; ++c) {
+                displays_ok = displays_ok &&
+                    ReadKey(&reader, kExportDisplayColumnNames[c]) &&
+                    ReadSimple(&reader) == -1;
+            }
+        }
+        displays_ok = displays_ok && ReadKey(&reader, "strings") &&
+            ReadContainer(&reader, 4) == table->num_strings;
+        char strings[kModeTableMaxStrings][128];
+        for (size_t s = 0; s < table->num_strings; ++s) {
+            ReadString(&reader, strings[s], sizeof(strings[s]));
+            displays_ok = displays_ok && strcmp(strings[s], table->strings[s]) == 0;
+        }
+        displays_ok = displays_ok && ReadKey(&reader, "columns") &&
+            ReadContainer(&reader, 4) == kExportModeColumns;
+        for (size_t c = 0; c < kExportModeColumns; ++c) {
+            displays_ok = displays_ok &&
+                ReadKey(&reader, kExportModeColumnNames[c]);
+        }
+        displays_ok = displays_ok && ReadKey(&reader, "modes") &&
+            ReadContainer(&reader, 4) == kCborIndefinite;
+        size_t row = 0;
+        for (; !reader.error && !AtBreak(&reader); ++row) {
+            if (row >= table->count ||
+                ReadContainer(&reader, 4) != kExportModeColumns) {
+                rows_ok = 0;
+                break;
+            }
+            const uint8_t flags = table->flags[row];
+            const uint64_t width = ReadUint(&reader);
+            const uint64_t height = ReadUint(&reader);
+            const double refresh_rate = ReadDouble(&reader);
+            const uint64_t aspect_w = ReadUint(&reader);
+            const uint64_t aspect_h = ReadUint(&reader);
+            const uint64_t encoding = ReadUint(&reader);
+            const int64_t mode_id = ReadInt(&reader);
+            const int hidpi = ReadSimple(&reader);
+            const uint64_t name = ReadUint(&reader);
+            const uint64_t category = ReadUint(&reader);
+            const int usable = ReadSimple(&reader);
+            const int current = ReadSimple(&reader);
+            rows_ok = rows_ok && !reader.error &&
+                width == table->resolution[row] >> 16 &&
+                height == (table->resolution[row] & 0xffff) &&
+                refresh_rate == RefreshRate(list, row) &&
+                aspect_w == table->aspect[row] >> 16 &&
+                aspect_h == (table->aspect[row] & 0xffff) &&
+                encoding < table->num_strings &&
+                strcmp(strings[encoding], table->strings[table->encoding[row]]) == 0 &&
+                mode_id == table->mode_id[row] &&
+                hidpi == !!(flags & kModeFlagHiDPI) &&
+                name == table->display_name[row] &&
+                category == table->category[row] &&
+                usable == !!(flags & kModeFlagUsable) &&
+                current == !!(flags & kModeFlagCurrent);
+        }
+        rows_ok = rows_ok && row == table->count;
+        // The break ending "modes".
+        ++reader.p;
+    }
+    ASSERT(displays_ok && !reader.error, "display metadata reads back");
+    ASSERT(rows_ok, "every row reads back as listed");
+    ASSERT(reader.p == reader.end, "nothing after the document");
+}
+
+static void test_catalog_round_trip(void) {
+    static const struct DisplayMode kModes[] = {
+        {1920, 1080, 60.0, 1, 1, NULL},
+        {640, 480, 59.94, 0, 4, NULL},
+        {3840, 2160, 23.976023976023978, 1, -7, NULL},
+    };
+    unsigned char dell[256];
+    FILE *f = fopen("tests/fixtures/edid/dell-u2723qe.bin", "rb");
+    const size_t dell_size = f != NULL ? fread(dell, 1, sizeof(dell), f) : 0;
+    if (f != NULL) {
+        fclose(f);
+    }
+    struct EdidInfo edid;
+    ASSERT(dell_size > 0 && EdidDecode(dell, dell_size, &edid) == 0,
+           "fixture decodes");
+
+    struct FakeBackend fake;
+    FakeBackendInit(&fake);
+    FakeBackendAddDisplay(&fake, 1, kModes, 3, 1);
+    FakeBackendAddSyntheticDisplay(&fake, 2, 3000);
+    FakeBackendSetEdid(&fake, 2, dell, dell_size);
+    struct Reference reference;
+    LoadReference(&reference, &fake);
+
+    size_t length;
+    char *csv = ListModes(&fake, "--csv", &length);
+    CheckCsv(csv, ',', &reference, &edid);
+    char *tsv = ListModes(&fake, "--tsv", &length);
+    CheckCsv(tsv, '\t', &reference, &edid);
+    // Nothing here needs quoting, so TSV is CSV with tabs.
+    for (char *p = tsv; *p != '\0'; ++p) {
+        if (*p == '\t') {
+            *p = ',';
+        }
+    }
+    ASSERT(strcmp(tsv, csv) == 0, "TSV matches CSV");
+    free(tsv);
+
+    char *cbor = ListModes(&fake, "--cbor", &length);
+    CheckCbor((const unsigned char *)cbor, length, &reference, &edid);
+    ASSERT(length < strlen(csv) / 3, "CBOR is smaller than CSV");
+    free(cbor);
+    free(csv);
+
+    // Filters apply as for the other formats.
+    char *text = NULL;
+    FILE *out = open_memstream(&text, &length);
+    struct DisplayCatalog catalog;
+    DisplayCatalogInit(&catalog, &fake.backend);
+    const char *argv[] = {"displaymode", "d", "--csv", "--min-width=3000", NULL};
+    const struct ParsedArgs parsed_args = ParseArgs(4, argv);
+    ASSERT(RunCommand(&catalog, &parsed_args, out, stderr) == 0, "d succeeds");
+    DisplayCatalogFree(&catalog);
+    fclose(out);
+    const char *p = text;
+    char fields[kExportDisplayColumns + kExportModeColumns][128];
+    ReadCsvRow(&p, ',', fields, kExportDisplayColumns + kExportModeColumns);
+    size_t rows = 0;
+    int wide = 1;
+    while (*p != '\0') {
+        ReadCsvRow(&p, ',', fields, kExportDisplayColumns + kExportModeColumns);
+        wide = wide && strtoul(fields[kExportDisplayColumns], NULL, 10) >= 3000;
+        ++rows;
+    }
+    ASSERT(rows > 0 && wide, "filter applies");
+    free(text);
+
+    DisplayCatalogFree(&reference.catalog);
+    FakeBackendFree(&fake);
+}
+
+int main(void) {
+    setLogLevel(LOG_LEVEL_ERROR);
+    test_cbor_values();
+    test_csv_values();
+    test_streams();
+    test_catalog_round_trip();
+
+    if (tests_failed == 0) {
+        printf("All %d export tests passed.\n", tests_run);
+        return EXIT_SUCCESS;
+    } else {
+        fprintf(stderr, "%d of %d export tests failed.\n", tests_failed, tests_run);
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,156 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "../displaymode_file.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static int tests_run = 0;
+static int tests_failed = 0;
+
+#define ASSERT(expr, msg) do { \
+    tests_run++; \
+    if (!(expr)) { \
+        fprintf(stderr, "FAIL: %s (test %d)\n", msg, tests_run); \
+        tests_failed++; \
+    } \
+} while (0)
+
+static const char kMagic[8] = {'D', 'M', 'T', 'E', 'S', 'T', '\0', '\0'};
+
+struct TestHeader {
+    struct DisplayFileHeader file;
+    uint32_t value;
+    uint32_t reserved;
+};
+
+static char root[64];
+static char path[128];
+
+// Replaces "path" with a header holding "value", then "extra" bytes.
+static int WriteTestFile(uint32_t version, uint32_t value, size_t extra) {
+    struct TestHeader header;
+    memset(&header, 0, sizeof(header));
+    DisplayFileHeaderInit(&header.file, kMagic, version);
+    header.value = value;
+    struct DisplayFileWriter writer;
+    if (DisplayFileCreate(&writer, path)) {
+        return -1;
+    }
+    DisplayFileWrite(&writer, &header, sizeof(header));
+    for (size_t i = 0; i < extra; ++i) {
+        DisplayFileWrite(&writer, "x", 1);
+    }
+    return DisplayFileReplace(&writer);
+}
+
+static uint32_t ReadValue(void) {
+    const unsigned char *data;
+    size_t size;
+    if (DisplayFileMap(path, kMagic, 1, sizeof(struct TestHeader), &data,
+                       &size)) {
+        return 0;
+    }
+    const uint32_t value = ((const struct TestHeader *)data)->value;
+    DisplayFileUnmap(&data, &size);
+    return value;
+}
+
+static void test_replace_creates_directories(void) {
+    // Neither the directory nor its parent exist, as for a new account.
+    struct stat st;
+    ASSERT(stat(root, &st) != 0, "root missing before the first write");
+    ASSERT(WriteTestFile(1, 7, 0) == 0, "first write");
+    ASSERT(stat(root, &st) == 0 && S_ISDIR(st.st_mode) &&
+           (st.st_mode & 0777) == 0700, "directory created private");
+    ASSERT(ReadValue() == 7, "written file maps");
+
+    ASSERT(WriteTestFile(1, 8, 0) == 0, "second write");
+    ASSERT(ReadValue() == 8, "file replaced");
+    char temp_path[sizeof(path) + 32];
+    snprintf(temp_path, sizeof(temp_path), "%s.%ld.tmp", path, (long)getpid());
+    ASSERT(access(temp_path, F_OK) != 0, "no temporary file left");
+}
+
+static void test_mapping_survives_replace(void) {
+    ASSERT(WriteTestFile(1, 9, 0) == 0, "write");
+    const unsigned char *data;
+    size_t size;
+    ASSERT(DisplayFileMap(path, kMagic, 1, sizeof(struct TestHeader), &data,
+                          &size) == 0, "map");
+    ASSERT(WriteTestFile(1, 10, 0) == 0, "replace while mapped");
+    ASSERT(data != NULL && ((const struct TestHeader *)data)->value == 9,
+           "old mapping unchanged");
+    DisplayFileUnmap(&data, &size);
+    ASSERT(data == NULL && size == 0, "unmap clears");
+    ASSERT(ReadValue() == 10, "new file seen");
+}
+
+static void test_map_rejects_other_files(void) {
+    const unsigned char *data = (const unsigned char *)"";
+    size_t size = 1;
+    unlink(path);
+    ASSERT(DisplayFileMap(path, kMagic, 1, sizeof(struct TestHeader), &data,
+                          &size) == -1 && data == NULL && size == 0,
+           "missing file");
+
+    ASSERT(WriteTestFile(2, 1, 0) == 0 && ReadValue() == 0, "other version");
+    ASSERT(WriteTestFile(1, 1, 0) == 0 && ReadValue() == 1, "same version");
+    const char other[8] = {'D', 'M', 'O', 'T', 'H', 'E', 'R', '\0'};
+    ASSERT(DisplayFileMap(path, other, 1, sizeof(struct TestHeader), &data,
+                          &size) == -1, "other magic");
+    ASSERT(DisplayFileMap(path, kMagic, 1, sizeof(struct TestHeader) + 1,
+                          &data, &size) == -1, "shorter than its header");
+
+    const uint32_t swapped = 0x04030201;
+    FILE *f = fopen(path, "r+b");
+    fseek(f, (long)offsetof(struct DisplayFileHeader, byte_order), SEEK_SET);
+    fwrite(&swapped, sizeof(swapped), 1, f);
+    fclose(f);
+    ASSERT(ReadValue() == 0, "other byte order");
+
+    ASSERT(truncate(path, 0) == 0 && ReadValue() == 0, "empty file");
+}
+
+static void test_create_fails_cleanly(void) {
+    struct DisplayFileWriter writer;
+    char too_long[kDisplayFileMaxPath + 8];
+    memset(too_long, 'a', sizeof(too_long) - 1);
+    too_long[sizeof(too_long) - 1] = '\0';
+    ASSERT(DisplayFileCreate(&writer, too_long) == -1, "path too long");
+
+    // A file where a directory should be.
+    char blocked[sizeof(path) + 16];
+    snprintf(blocked, sizeof(blocked), "%s/sub/file", path);
+    ASSERT(WriteTestFile(1, 1, 0) == 0, "write blocker");
+    ASSERT(DisplayFileCreate(&writer, blocked) == -1, "parent is a file");
+}
+
+int main(void) {
+    snprintf(root, sizeof(root), "/tmp/displaymode-test-file-%ld",
+             (long)getpid());
+    snprintf(path, sizeof(path), "%s/config/test.file", root);
+    test_replace_creates_directories();
+    test_mapping_survives_replace();
+    test_map_rejects_other_files();
+    test_create_fails_cleanly();
+
+    unlink(path);
+    char dir[sizeof(path)];
+    snprintf(dir, sizeof(dir), "%s/config", root);
+    rmdir(dir);
+    rmdir(root);
+
+    if (tests_failed == 0) {
+        printf("All %d file tests passed.\n", tests_run);
+        return EXIT_SUCCESS;
+    } else {
+        fprintf(stderr, "%d of %d file tests failed.\n", tests_failed,
+                tests_run);
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,199 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "../displaymode_catalog.h"
+#include "../displaymode_commands.h"
+#include "../displaymode_filter.h"
+#include "../displaymode_parse.h"
+#include "../logging.h"
+#include "fake_backend.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int tests_run = 0;
+static int tests_failed = 0;
+
+#define ASSERT(expr, msg) do { \
+    tests_run++; \
+    if (!(expr)) { \
+        fprintf(stderr, "FAIL: %s (test %d)\n", msg, tests_run); \
+        tests_failed++; \
+    } \
+} while (0)
+
+static struct ModeFilter NoFilter(void) {
+    struct ModeFilter filter;
+    memset(&filter, 0, sizeof(filter));
+    filter.active = 1;
+    filter.max_width = UINT32_MAX;
+    filter.max_height = UINT32_MAX;
+    filter.max_refresh_mhz = UINT32_MAX;
+    return filter;
+}
+
+// Whether "mode" passes "filter", computed directly from the mode.
+static int Passes(const struct ModeFilter *filter, const struct DisplayMode *mode) {
+    const uint32_t mhz = DisplayModeTableMillihertz(mode->refresh_rate);
+    if (mode->width < filter->min_width || mode->width > filter->max_width ||
+        mode->height < filter->min_height || mode->height > filter->max_height ||
+        mhz < filter->min_refresh_mhz || mhz > filter->max_refresh_mhz ||
+        (filter->usable_only && !mode->usable_for_desktop) ||
+        filter->hidpi_only) {
+        return 0;
+    }
+    // Same ratio: w * fh == h * fw.
+    return filter->aspect_w == 0 ||
+           (uint64_t)mode->width * filter->aspect_h ==
+           (uint64_t)mode->height * filter->aspect_w;
+}
+
+static void test_kernels_match_reference(void) {
+    static const size_t kCounts[] = {0, 1, 7, 8, 63, 64, 65, 200, 1001};
+    const enum FilterKernel kernels[] = {kFilterKernelScalar, kFilterKernelAvx2};
+    srand(11);
+    int all_match = 1;
+    int tail_clear = 1;
+    int kernels_run = 0;
+    for (size_t c = 0; c < sizeof(kCounts) / sizeof(kCounts[0]); ++c) {
+        struct FakeBackend fake;
+        FakeBackendInit(&fake);
+        FakeBackendAddSyntheticDisplay(&fake, 1, kCounts[c]);
+        const struct DisplayModeList list = {
+            .modes = fake.displays[0].modes, .count = kCounts[c],
+            .current_index = -1,
+        };
+        struct DisplayModeTable table;
+        DisplayModeTableBuild(&table, &list);
+        const size_t words = DisplayModeFilterWords(table.count);
+        uint64_t *bitmap = malloc((words + 1) * sizeof(*bitmap));
+
+        for (int trial = 0; trial < 50; ++trial) {
+            struct ModeFilter filter = NoFilter();
+            if (rand() % 2) filter.min_width = 640 + (uint32_t)(rand() % 2000);
+            if (rand() % 2) filter.max_width = 640 + (uint32_t)(rand() % 3000);
+            if (rand() % 2) filter.min_height = 480 + (uint32_t)(rand() % 1000);
+            if (rand() % 2) filter.max_height = 480 + (uint32_t)(rand() % 2000);
+            if (rand() % 2) filter.min_refresh_mhz = 59940;
+            if (rand() % 2) filter.max_refresh_mhz = 75000;
+            if (rand() % 4 == 0) {
+                filter.aspect_w = 32;
+                filter.aspect_h = 18;
+            }
+            filter.usable_only = rand() % 2;
+            filter.hidpi_only = trial == 49;
+            for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); ++k) {
+                if (DisplayModeFilterSelectWith(kernels[k], &filter, &table,
+                                                bitmap) != 0) {
+                    continue;
+                }
+                ++kernels_run;
+                for (size_t i = 0; i < table.count; ++i) {
+                    const int selected = (int)(bitmap[i / 64] >> (i % 64) & 1);
+                    all_match &= selected == Passes(&filter, &list.modes[i]);
+                }
+                if (table.count % 64 != 0) {
+                    tail_clear &= (bitmap[words - 1] >> (table.count % 64)) == 0;
+                }
+            }
+        }
+        free(bitmap);
+        DisplayModeTableFree(&table);
+        FakeBackendFree(&fake);
+    }
+    ASSERT(kernels_run >= 9 * 50, "every supported kernel ran");
+    ASSERT(all_match, "kernels select exactly the matching modes");
+    ASSERT(tail_clear, "bits past the last row are clear");
+    printf("Filter kernel: %s\n",
+           DisplayModeFilterKernelName(DisplayModeFilterBestKernel()));
+}
+
+// Runs "d" with the given arguments and returns its output (to be freed).
+static char *List(struct FakeBackend *fake, int argc, const char *argv[],
+                  int *status) {
+    char *buffer = NULL;
+    size_t len = 0;
+    FILE *out = open_memstream(&buffer, &len);
+    struct DisplayCatalog catalog;
+    DisplayCatalogInit(&catalog, &fake->backend);
+    const struct ParsedArgs parsed_args = ParseArgs(argc, argv);
+    *status = RunCommand(&catalog, &parsed_args, out, out);
+    DisplayCatalogFree(&catalog);
+    fclose(out);
+    return buffer;
+}
+
+static int CountLines(const char *text) {
+    int lines = 0;
+    for (; *text != '\0'; ++text) {
+        lines += *text == '\n';
+    }
+    return lines;
+}
+
+static void test_filtered_listing(void) {
+    static const struct DisplayMode kModes[] = {
+        {1920, 1080, 60.0, 1, 1, NULL},
+        {1920, 1080, 50.0, 1, 2, NULL},
+        {1280, 800, 60.0, 1, 3, NULL},
+        {1440, 900, 59.94, 0, 4, NULL},
+        {640, 480, 60.0, 1, 5, NULL},
+    };
+    struct FakeBackend fake;
+    FakeBackendInit(&fake);
+    FakeBackendAddDisplay(&fake, 1, kModes, 5, 0);
+    FakeBackendAddDisplay(&fake, 2, kModes, 5, 2);
+
+    int status;
+    const char *wide[] = {"prog", "d", "--min-width=1280", "--aspect=16:10",
+                          NULL};
+    char *text = List(&fake, 4, wide, &status);
+    ASSERT(status == EXIT_SUCCESS, "filtered d succeeds");
+    ASSERT(strcmp(text,
+                  "Display 0 (MAIN):\n"
+                  "1280 x 800 @60.0Hz AR:8:5 Enc:Unknown ModeID:3 Std Display Cat:Standard\n"
+                  "1440 x 900 @59.9Hz AR:8:5 Enc:Unknown ModeID:4 Std Display Cat:Standard !\n"
+                  "\n"
+                  "Display 1:\n"
+                  "1280 x 800 @60.0Hz AR:8:5 Enc:Unknown ModeID:3 Std Display Cat:Standard *\n"
+                  "1440 x 900 @59.9Hz AR:8:5 Enc:Unknown ModeID:4 Std Display Cat:Standard !\n") == 0,
+           "only 16:10 modes at least 1280 wide listed");
+    free(text);
+
+    const char *usable[] = {"prog", "d", "--ndjson", "--usable",
+                            "--min-refresh=59.9", "--max-refresh=60.1", NULL};
+    text = List(&fake, 6, usable, &status);
+    ASSERT(status == EXIT_SUCCESS && CountLines(text) == 6,
+           "NDJSON lists the usable 60 Hz modes of both displays");
+    ASSERT(strstr(text, "\"modeId\":4") == NULL &&
+           strstr(text, "\"modeId\":2") == NULL, "filtered modes left out");
+    free(text);
+
+    const char *none[] = {"prog", "d", "--json", "--hidpi", NULL};
+    text = List(&fake, 4, none, &status);
+    ASSERT(status == EXIT_SUCCESS &&
+           strstr(text, "\"modes\":[]") != NULL, "no HiDPI modes: empty lists");
+    free(text);
+
+    const char *bad[] = {"prog", "d", "--aspect=wide", NULL};
+    text = List(&fake, 3, bad, &status);
+    ASSERT(status == EXIT_FAILURE &&
+           strstr(text, "Invalid option: '--aspect=wide'") != NULL,
+           "invalid filter reported");
+    free(text);
+    FakeBackendFree(&fake);
+}
+
+int main(void) {
+    setLogLevel(LOG_LEVEL_ERROR);
+    test_kernels_match_reference();
+    test_filtered_listing();
+
+    if (tests_failed == 0) {
+        printf("All %d filter tests passed.\n", tests_run);
+        return EXIT_SUCCESS;
+    } else {
+        fprintf(stderr, "%d of %d filter tests failed.\n", tests_failed, tests_run);
+        return EXIT_FAILURE;
+    }
+}
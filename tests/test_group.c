@@ -0,0 +1,353 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "../displaymode_alloc.h"
+#include "../displaymode_catalog.h"
+#include "../displaymode_commands.h"
+#include "../displaymode_filter.h"
+#include "../displaymode_group.h"
+#include "../displaymode_parse.h"
+#include "../displaymode_table.h"
+#include "../logging.h"
+#include "fake_backend.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int tests_run = 0;
+static int tests_failed = 0;
+
+#define ASSERT(expr, msg) do { \
+    tests_run++; \
+    if (!(expr)) { \
+        fprintf(stderr, "FAIL: %s (test %d)\n", msg, tests_run); \
+        tests_failed++; \
+    } \
+} while (0)
+
+static struct DisplayMode Mode(size_t width, size_t height, double refresh_rate,
+                               int usable, int mode_id) {
+    struct DisplayMode mode = {width, height, refresh_rate, usable, mode_id,
+                               NULL};
+    return mode;
+}
+
+// Scaled variants and encodings of the same few modes, as CoreGraphics
+// lists them; 1280x720 is current.
+static const struct DisplayMode *DuplicatedModes(size_t *count) {
+    static struct DisplayMode modes[10];
+    modes[0] = Mode(1920, 1080, 60.0, 1, 1);
+    modes[1] = Mode(1920, 1080, 59.94, 1, 2);
+    modes[2] = Mode(1280, 720, 60.0, 1, 3);
+    modes[3] = Mode(1920, 1080, 60.0, 1, 4);
+    modes[4] = Mode(1920, 1080, 120.0, 1, 5);
+    modes[5] = Mode(2560, 1440, 60.0, 0, 6);
+    modes[6] = Mode(1920, 1080, 50.0, 1, 7);
+    modes[7] = Mode(1920, 1080, 59.94, 1, 8);
+    modes[8] = Mode(1280, 720, 60.0, 1, 9);
+    modes[9] = Mode(2560, 1440, 59.94, 0, 10);
+    *count = 10;
+    return modes;
+}
+
+static void BuildTable(struct DisplayModeTable *table,
+                       const struct DisplayMode *modes, size_t count,
+                       ptrdiff_t current_index) {
+    struct DisplayModeList list;
+    memset(&list, 0, sizeof(list));
+    list.modes = (struct DisplayMode *)modes;
+    list.count = count;
+    list.current_index = current_index;
+    if (current_index >= 0) {
+        list.current = modes[current_index];
+        list.has_current = 1;
+    }
+    DisplayModeTableBuild(table, &list);
+}
+
+static void test_groups(void) {
+    size_t count;
+    const struct DisplayMode *modes = DuplicatedModes(&count);
+    struct DisplayModeTable table;
+    BuildTable(&table, modes, count, 2);
+    struct DisplayModeGroups groups;
+    ASSERT(DisplayModeGroupsBuild(&groups, &table, NULL, NULL) == 0, "builds");
+    ASSERT(groups.count == 3, "one group per resolution");
+
+    const struct DisplayModeGroup *fhd = &groups.groups[0];
+    ASSERT(fhd->resolution == DisplayModeTablePackResolution(1920, 1080) &&
+           fhd->first_row == 0 && fhd->num_modes == 6 && fhd->num_rates == 4,
+           "1080p folds six modes into four rates");
+    const uint32_t *rates = &groups.refresh_mhz[fhd->first_rate];
+    ASSERT(rates[0] == 50000 && rates[1] == 59940 && rates[2] == 60000 &&
+           rates[3] == 120000, "rates ascending and distinct");
+    ASSERT(!(fhd->flags & kModeFlagCurrent) && (fhd->flags & kModeFlagUsable),
+           "1080p flags");
+
+    const struct DisplayModeGroup *hd = &groups.groups[1];
+    ASSERT(hd->first_row == 2 && hd->num_modes == 2 && hd->num_rates == 1 &&
+           (hd->flags & kModeFlagCurrent), "720p holds the current mode");
+    const struct DisplayModeGroup *qhd = &groups.groups[2];
+    ASSERT(qhd->first_row == 5 && !(qhd->flags & kModeFlagUsable) &&
+           groups.refresh_mhz[qhd->first_rate] == 59940,
+           "1440p not usable, rates sorted");
+    ASSERT(groups.num_rates == 7, "seven distinct rates in all");
+
+    char line[kModeTableMaxLine];
+    int length = DisplayModeGroupFormat(&groups, &table, 0, line, sizeof(line));
+    ASSERT(length == (int)strlen(line) &&
+           strncmp(line, "1920 x 1080 @ 50/59.94/60/120Hz AR:16:9 Cat:", 44) == 0 &&
+           strstr(line, " Modes:6") != NULL &&
+           line[length - 1] != '!', "1080p line");
+    DisplayModeGroupFormat(&groups, &table, 2, line, sizeof(line));
+    ASSERT(strncmp(line, "2560 x 1440 @ 59.94/60Hz", 24) == 0 &&
+           strcmp(line + strlen(line) - 2, " !") == 0, "unusable group marked");
+    // Truncated lines still report their full length.
+    char small[8];
+    ASSERT(DisplayModeGroupFormat(&groups, &table, 0, small, sizeof(small)) ==
+           length && strcmp(small, "1920 x ") == 0, "truncated line");
+    DisplayModeGroupsFree(&groups);
+
+    // Only the selected rows count.
+    uint64_t selected[1] = {1u << 1 | 1u << 7 | 1u << 8};
+    ASSERT(DisplayModeGroupsBuild(&groups, &table, selected, NULL) == 0 &&
+           groups.count == 2 && groups.groups[0].first_row == 1 &&
+           groups.groups[0].num_modes == 2 && groups.groups[0].num_rates == 1 &&
+           groups.groups[1].first_row == 8, "selected rows");
+    DisplayModeGroupsFree(&groups);
+
+    // Nothing selected.
+    selected[0] = 0;
+    ASSERT(DisplayModeGroupsBuild(&groups, &table, selected, NULL) == 0 &&
+           groups.count == 0 && groups.num_rates == 0, "no rows");
+    DisplayModeGroupsFree(&groups);
+
+    // In an arena.
+    struct Arena arena;
+    ArenaInit(&arena);
+    ASSERT(DisplayModeGroupsBuild(&groups, &table, NULL, &arena) == 0 &&
+           groups.count == 3, "builds in an arena");
+    DisplayModeGroupsFree(&groups);
+    ArenaFree(&arena);
+    DisplayModeTableFree(&table);
+}
+
+static void test_refresh_formatting(void) {
+    static const double kRates[] = {23.976, 24.0, 29.97, 59.9, 100.0, 143.856};
+    struct DisplayMode modes[6];
+    for (int i = 0; i < 6; ++i) {
+        modes[i] = Mode(3840, 2160, kRates[5 - i], 1, i);
+    }
+    struct DisplayModeTable table;
+    BuildTable(&table, modes, 6, -1);
+    struct DisplayModeGroups groups;
+    DisplayModeGroupsBuild(&groups, &table, NULL, NULL);
+    char line[kModeTableMaxLine];
+    DisplayModeGroupFormat(&groups, &table, 0, line, sizeof(line));
+    ASSERT(strncmp(line, "3840 x 2160 @ 23.976/24/29.97/59.9/100/143.856Hz",
+                   48) == 0, "rates with as few decimals as they need");
+    DisplayModeGroupsFree(&groups);
+    DisplayModeTableFree(&table);
+}
+
+// Compares the groups of a random catalog with a quadratic reference.
+static void test_random_catalog(void) {
+    enum { kModes = 5000 };
+    struct DisplayMode *modes = malloc(kModes * sizeof(*modes));
+    srand(7);
+    for (int i = 0; i < kModes; ++i) {
+        // Few resolutions and rates, so most modes are duplicates; rates
+        // span more than one byte of millihertz.
+        modes[i] = Mode(640 + 64 * (size_t)(rand() % 40),
+                        480 + 36 * (size_t)(rand() % 3),
+                        (double)(rand() % 300000) / 1000.0, rand() % 2, i);
+    }
+    struct DisplayModeTable table;
+    BuildTable(&table, modes, kModes, 17);
+    uint64_t *selected = calloc(DisplayModeFilterWords(table.count) + 1,
+                                sizeof(*selected));
+    for (size_t row = 0; row < table.count; ++row) {
+        if (rand() % 4 != 0) {
+            selected[row / 64] |= (uint64_t)1 << (row % 64);
+        }
+    }
+    struct DisplayModeGroups groups;
+    ASSERT(DisplayModeGroupsBuild(&groups, &table, selected, NULL) == 0,
+           "builds a random catalog");
+
+    int matches = 1;
+    size_t next_group = 0;
+    size_t total_rates = 0;
+    for (size_t row = 0; row < table.count && matches; ++row) {
+        if (!(selected[row / 64] >> (row % 64) & 1)) {
+            continue;
+        }
+        const uint32_t resolution = table.resolution[row];
+        int seen = 0;
+        for (size_t earlier = 0; earlier < row && !seen; ++earlier) {
+            seen = (selected[earlier / 64] >> (earlier % 64) & 1) &&
+                   table.resolution[earlier] == resolution;
+        }
+        if (seen) {
+            continue;
+        }
+        // "row" starts the next group; gather it by brute force.
+        const struct DisplayModeGroup *group = &groups.groups[next_group++];
+        uint32_t num_modes = 0;
+        uint8_t flags = 0;
+        uint32_t previous_rate = 0;
+        uint32_t num_rates = 0;
+        for (;;) {
+            // The smallest rate above "previous_rate", if any.
+            uint32_t rate = UINT32_MAX;
+            for (size_t r = row; r < table.count; ++r) {
+                if ((selected[r / 64] >> (r % 64) & 1) &&
+                    table.resolution[r] == resolution &&
+                    (num_rates == 0 || table.refresh_mhz[r] > previous_rate) &&
+                    table.refresh_mhz[r] < rate) {
+                    rate = table.refresh_mhz[r];
+                }
+            }
+            if (rate == UINT32_MAX) {
+                break;
+            }
+            matches = matches && num_rates < group->num_rates &&
+                      groups.refresh_mhz[group->first_rate + num_rates] == rate;
+            previous_rate = rate;
+            ++num_rates;
+        }
+        for (size_t r = row; r < table.count; ++r) {
+            if ((selected[r / 64] >> (r % 64) & 1) &&
+                table.resolution[r] == resolution) {
+                ++num_modes;
+                flags |= table.flags[r];
+            }
+        }
+        matches = matches && group->resolution == resolution &&
+                  group->first_row == row && group->num_modes == num_modes &&
+                  group->num_rates == num_rates && group->flags == flags;
+        total_rates += num_rates;
+    }
+    ASSERT(matches && next_group == groups.count &&
+           total_rates == groups.num_rates, "random catalog matches reference");
+    DisplayModeGroupsFree(&groups);
+    free(selected);
+    DisplayModeTableFree(&table);
+    free(modes);
+}
+
+// Runs "d" with the given flags (NULL-terminated) and returns its output.
+static char *List(struct FakeBackend *fake, const char *const *flags) {
+    const char *argv[8] = {"displaymode", "d"};
+    int argc = 2;
+    while (*flags != NULL) {
+        argv[argc++] = *flags++;
+    }
+    const struct ParsedArgs parsed_args = ParseArgs(argc, argv);
+    char *text = NULL;
+    size_t length = 0;
+    FILE *out = open_memstream(&text, &length);
+    struct DisplayCatalog catalog;
+    DisplayCatalogInit(&catalog, &fake->backend);
+    const int status = RunCommand(&catalog, &parsed_args, out, stderr);
+    ASSERT(status == 0, "d --grouped succeeds");
+    fclose(out);
+    DisplayCatalogFree(&catalog);
+    return text;
+}
+
+static void test_listing(void) {
+    struct FakeBackend fake;
+    FakeBackendInit(&fake);
+    size_t count;
+    const struct DisplayMode *modes = DuplicatedModes(&count);
+    FakeBackendAddDisplay(&fake, 1, modes, count, 2);
+    FakeBackendAddSyntheticDisplay(&fake, 2, 12);
+
+    const char *const text_flags[] = {"--grouped", NULL};
+    char *text = List(&fake, text_flags);
+    ASSERT(strncmp(text, "Display 0 (MAIN):\n1920 x 1080 @ 50/59.94/60/120Hz", 48) == 0,
+           "grouped text starts with 1080p");
+    ASSERT(strstr(text, "\n1280 x 720 @ 60Hz AR:16:9") != NULL &&
+           strstr(text, " Modes:2 *\n") != NULL, "current group marked");
+    ASSERT(strstr(text, "\nDisplay 1:\n640 x 480 @ 50/59.94/60/75/120/144Hz") != NULL,
+           "second display grouped");
+    size_t lines = 0;
+    for (const char *p = text; *p != '\0'; ++p) {
+        lines += *p == '\n';
+    }
+    ASSERT(lines == 2 + 1 + 3 + 2, "one line per resolution");
+    free(text);
+
+    const char *const json_flags[] = {"--grouped", "--json", NULL};
+    text = List(&fake, json_flags);
+    ASSERT(strstr(text, "{\"displays\":[{\"display\":0,\"main\":true,\"groups\":["
+                        "{\"width\":1920,\"height\":1080,\"refreshRates\":"
+                        "[50.0,59.94,60.0,120.0],") != NULL,
+           "grouped JSON");
+    ASSERT(strstr(text, "\"modes\":6,") != NULL && strstr(text, "\"current\":true") != NULL,
+           "grouped JSON members");
+    free(text);
+
+    const char *const ndjson_flags[] = {"--grouped", "--ndjson", "--usable", NULL};
+    text = List(&fake, ndjson_flags);
+    lines = 0;
+    for (const char *p = text; *p != '\0'; ++p) {
+        lines += *p == '\n';
+    }
+    ASSERT(lines == 2 + 2 && strncmp(text, "{\"display\":0,\"width\":1920", 25) == 0 &&
+           strstr(text, "2560") == NULL, "grouped NDJSON after filtering");
+    free(text);
+
+    FakeBackendFree(&fake);
+}
+
+// A resolution with more rates than fit kModeTableMaxLine is still listed
+// whole.
+static void test_long_line(void) {
+    enum { kRates = 120 };
+    struct DisplayMode modes[kRates];
+    for (int i = 0; i < kRates; ++i) {
+        modes[i] = Mode(1024, 768, 30.0 + i * 0.125, 1, i);
+    }
+    struct FakeBackend fake;
+    FakeBackendInit(&fake);
+    FakeBackendAddDisplay(&fake, 1, modes, kRates, 0);
+    const char *const flags[] = {"--grouped", NULL};
+    char *text = List(&fake, flags);
+    ASSERT(strlen(text) > kModeTableMaxLine &&
+           strstr(text, "/44.875Hz AR:4:3") != NULL &&
+           strstr(text, " Modes:120 *\n") != NULL, "long line listed whole");
+    free(text);
+    FakeBackendFree(&fake);
+}
+
+static void test_parse(void) {
+    const char *argv[] = {"prog", "d", "--grouped", "--csv", NULL};
+    struct ParsedArgs p = ParseArgs(2, argv);
+    ASSERT(!p.grouped, "not grouped by default");
+    p = ParseArgs(3, argv);
+    ASSERT(p.option == kOptionSupportedModes && p.grouped, "--grouped parsed");
+    p = ParseArgs(4, argv);
+    ASSERT(p.option == kOptionInvalid &&
+           strcmp(p.literal_option, "--grouped") == 0,
+           "--grouped isn't exported");
+}
+
+int main(void) {
+    setLogLevel(LOG_LEVEL_ERROR);
+    test_groups();
+    test_refresh_formatting();
+    test_random_catalog();
+    test_listing();
+    test_long_line();
+    test_parse();
+
+    if (tests_failed == 0) {
+        printf("All %d grouping tests passed.\n", tests_run);
+        return EXIT_SUCCESS;
+    } else {
+        fprintf(stderr, "%d of %d grouping tests failed.\n", tests_failed, tests_run);
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,505 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "../displaymode_catalog.h"
+#include "../displaymode_commands.h"
+#include "../displaymode_ids.h"
+#include "../displaymode_parse.h"
+#include "../logging.h"
+#include "fake_backend.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static int tests_run = 0;
+static int tests_failed = 0;
+
+#define ASSERT(expr, msg) do { \
+    tests_run++; \
+    if (!(expr)) { \
+        fprintf(stderr, "FAIL: %s (test %d)\n", msg, tests_run); \
+        tests_failed++; \
+    } \
+} while (0)
+
+static const struct DisplayMode kModes[] = {
+    {1920, 1080, 60.0, 1, 1, NULL},
+    {1280, 720, 60.0, 1, 2, NULL},
+    {640, 480, 60.0, 1, 3, NULL},
+};
+
+static char map_path[64];
+
+static struct DisplayIdentity Identity(uint32_t vendor, uint32_t model,
+                                       uint32_t serial) {
+    struct DisplayIdentity identity = {vendor, model, serial};
+    return identity;
+}
+
+static void test_map_round_trip(void) {
+    unlink(map_path);
+    struct DisplayIdMap map;
+    ASSERT(DisplayIdMapOpen(&map, map_path) == 0, "open missing file");
+    ASSERT(DisplayIdMapLookup(&map, "desk") == NULL, "empty map misses");
+    const struct DisplayIdentity desk = Identity(0x10ac, 0xa0c4, 0x4c4c3042);
+    ASSERT(DisplayIdMapPut(&map, "desk", &desk, 5, 1, kDisplayIdMapNamed) == 0,
+           "put");
+    ASSERT(DisplayIdMapRecord(&map, &desk, 5, 1) == 0, "record");
+    ASSERT(map.count == 2, "name and identity");
+    ASSERT(DisplayIdMapFlush(&map) == 0, "flush");
+    DisplayIdMapClose(&map);
+
+    ASSERT(DisplayIdMapOpen(&map, map_path) == 0, "reopen");
+    const struct DisplayIdMapEntry *entry = DisplayIdMapLookup(&map, "desk");
+    ASSERT(entry != NULL && DisplayIdentityEqual(&entry->identity, &desk) &&
+           entry->display == 5 && entry->index == 1 &&
+           entry->flags == kDisplayIdMapNamed, "name round-trips");
+    entry = DisplayIdMapLookup(&map, "10ac:a0c4:4c4c3042");
+    ASSERT(entry != NULL && entry->flags == 0, "identity round-trips");
+    ASSERT(!map.dirty && map.owned == NULL, "lookups read the mapped file");
+
+    // Moving the display moves its names too.
+    ASSERT(DisplayIdMapRecord(&map, &desk, 9, 0) == 0, "record move");
+    entry = DisplayIdMapLookup(&map, "desk");
+    ASSERT(entry != NULL && entry->display == 9 && entry->index == 0,
+           "name follows its display");
+    ASSERT(map.dirty, "move is written");
+    DisplayIdMapClose(&map);
+
+    // Grow well past the initial table.
+    ASSERT(DisplayIdMapOpen(&map, map_path) == 0, "reopen to grow");
+    char name[kDisplayIdMapMaxName];
+    for (uint32_t i = 0; i < 200; ++i) {
+        snprintf(name, sizeof(name), "display-%u", i);
+        const struct DisplayIdentity identity = Identity(1, 2, i);
+        DisplayIdMapPut(&map, name, &identity, i, i, kDisplayIdMapNamed);
+    }
+    ASSERT(map.count == 202 && 2 * map.count <= map.capacity &&
+           (map.capacity & (map.capacity - 1)) == 0, "table grows");
+    ASSERT(DisplayIdMapFlush(&map) == 0, "flush grown");
+    DisplayIdMapClose(&map);
+    ASSERT(DisplayIdMapOpen(&map, map_path) == 0, "reopen grown");
+    int all_found = map.count == 202;
+    for (uint32_t i = 0; i < 200; ++i) {
+        snprintf(name, sizeof(name), "display-%u", i);
+        entry = DisplayIdMapLookup(&map, name);
+        all_found = all_found && entry != NULL && entry->index == i &&
+                    entry->identity.serial == i;
+    }
+    ASSERT(all_found, "every name found after growing");
+    ASSERT(DisplayIdMapLookup(&map, "display-200") == NULL, "absent name misses");
+    DisplayIdMapClose(&map);
+}
+
+// Overwrites "size" bytes at "offset" in the map file.
+static void CorruptFile(long offset, const void *data, size_t size) {
+    FILE *f = fopen(map_path, "r+b");
+    fseek(f, offset, SEEK_SET);
+    fwrite(data, 1, size, f);
+    fclose(f);
+}
+
+static void test_map_rejects_invalid_files(void) {
+    unlink(map_path);
+    struct DisplayIdMap map;
+    DisplayIdMapOpen(&map, map_path);
+    const struct DisplayIdentity desk = Identity(1, 2, 3);
+    DisplayIdMapPut(&map, "desk", &desk, 1, 0, kDisplayIdMapNamed);
+    DisplayIdMapFlush(&map);
+    DisplayIdMapClose(&map);
+
+    const uint32_t version = kDisplayIdMapVersion + 1;
+    CorruptFile(offsetof(struct DisplayIdMapHeader, file.version), &version,
+                sizeof(version));
+    DisplayIdMapOpen(&map, map_path);
+    ASSERT(map.data == NULL && DisplayIdMapLookup(&map, "desk") == NULL,
+           "version mismatch ignored");
+    DisplayIdMapPut(&map, "desk", &desk, 1, 0, kDisplayIdMapNamed);
+    ASSERT(DisplayIdMapFlush(&map) == 0, "flush over invalid");
+    DisplayIdMapClose(&map);
+    DisplayIdMapOpen(&map, map_path);
+    ASSERT(DisplayIdMapLookup(&map, "desk") != NULL, "invalid file rewritten");
+    const uint32_t capacity = (uint32_t)map.capacity;
+    DisplayIdMapClose(&map);
+
+    // A name that doesn't hash to its key.
+    const size_t slot_size = sizeof(struct DisplayIdMapEntry);
+    const long slots = (long)sizeof(struct DisplayIdMapHeader);
+    const char renamed = 'x';
+    for (uint32_t i = 0; i < capacity; ++i) {
+        char name[2] = {0};
+        FILE *f = fopen(map_path, "rb");
+        fseek(f, slots + (long)(i * slot_size) +
+                 (long)offsetof(struct DisplayIdMapEntry, name), SEEK_SET);
+        ASSERT(fread(name, 1, 1, f) == 1, "read slot");
+        fclose(f);
+        if (name[0] == 'd') {
+            CorruptFile(slots + (long)(i * slot_size) +
+                        (long)offsetof(struct DisplayIdMapEntry, name),
+                        &renamed, 1);
+        }
+    }
+    DisplayIdMapOpen(&map, map_path);
+    ASSERT(map.data == NULL, "mismatched key ignored");
+    DisplayIdMapClose(&map);
+
+    ASSERT(truncate(map_path, sizeof(struct DisplayIdMapHeader) + slot_size) == 0,
+           "truncate");
+    DisplayIdMapOpen(&map, map_path);
+    ASSERT(map.data == NULL, "short table ignored");
+    DisplayIdMapClose(&map);
+}
+
+static void test_valid_names(void) {
+    ASSERT(DisplayIdMapValidName("desk"), "plain name");
+    ASSERT(DisplayIdMapValidName("2nd"), "name starting with a digit");
+    ASSERT(!DisplayIdMapValidName("2"), "index is not a name");
+    ASSERT(!DisplayIdMapValidName(""), "empty name");
+    ASSERT(!DisplayIdMapValidName("left desk"), "name with a space");
+    ASSERT(!DisplayIdMapValidName("610:a001:1eef"), "identity is not a name");
+    ASSERT(!DisplayIdMapValidName("@60"), "refresh rate is not a name");
+    ASSERT(!DisplayIdMapValidName("--json"), "flag is not a name");
+    char name[kDisplayIdMapMaxName + 1];
+    memset(name, 'a', sizeof(name));
+    name[kDisplayIdMapMaxName - 1] = '\0';
+    ASSERT(DisplayIdMapValidName(name), "longest name");
+    name[kDisplayIdMapMaxName - 1] = 'a';
+    name[kDisplayIdMapMaxName] = '\0';
+    ASSERT(!DisplayIdMapValidName(name), "name too long");
+}
+
+static void test_parse(void) {
+    const char *one[] = {"prog", "t", "1920", "1080", "desk", NULL};
+    struct ParsedArgs p = ParseArgs(5, one);
+    ASSERT(p.option == kOptionConfigureMode && p.num_specs == 1 &&
+           p.specs[0].display_name != NULL &&
+           strcmp(p.specs[0].display_name, "desk") == 0, "display by name");
+    const char *mixed[] = {"prog", "t", "4K", "@60", "610:a001:1eef", "1280",
+                           "720", "0", NULL};
+    p = ParseArgs(8, mixed);
+    ASSERT(p.num_specs == 2 && p.specs[0].width == 3840 &&
+           strcmp(p.specs[0].display_name, "610:a001:1eef") == 0 &&
+           p.specs[1].display_name == NULL && p.specs[1].display_index == 0,
+           "identity and index mixed");
+
+    const char *list[] = {"prog", "n", NULL};
+    p = ParseArgs(2, list);
+    ASSERT(p.option == kOptionName && p.name == NULL, "n lists");
+    const char *name[] = {"prog", "n", "0", "desk", NULL};
+    p = ParseArgs(4, name);
+    ASSERT(p.option == kOptionName && strcmp(p.display_name, "0") == 0 &&
+           strcmp(p.name, "desk") == 0, "n names");
+    const char *partial[] = {"prog", "n", "0", NULL};
+    ASSERT(ParseArgs(3, partial).option == kOptionInvalidMode,
+           "n needs both display and name");
+
+    // Names aren't NUL-terminated in a batch line, so ParseArgs handles them.
+    const char line[] = "t 640 480 desk";
+    ASSERT(ParseCommandLine(line, strlen(line), &p) == 1, "name deferred");
+    ASSERT(ParseCommandLine("n", 1, &p) == 1, "n deferred");
+}
+
+static void InitFake(struct FakeBackend *fake) {
+    FakeBackendInit(fake);
+    FakeBackendAddDisplay(fake, 1, kModes, 3, 0);
+    FakeBackendAddDisplay(fake, 2, kModes, 3, 0);
+    FakeBackendAddDisplay(fake, 3, kModes, 3, 0);
+}
+
+// Runs "argv" against a new catalog with the map file, as one invocation
+// of displaymode would, and returns its status.
+static int Run(struct FakeBackend *fake, int argc, const char **argv,
+               char **text) {
+    struct DisplayCatalog catalog;
+    DisplayCatalogInit(&catalog, &fake->backend);
+    struct DisplayIdMap map;
+    DisplayIdMapOpen(&map, map_path);
+    catalog.ids = &map;
+    size_t length = 0;
+    FILE *out = open_memstream(text, &length);
+    const struct ParsedArgs parsed_args = ParseArgs(argc, argv);
+    const int status = RunCommand(&catalog, &parsed_args, out, out);
+    fclose(out);
+    DisplayIdMapFlush(&map);
+    DisplayIdMapClose(&map);
+    DisplayCatalogFree(&catalog);
+    return status;
+}
+
+// Resolves "name" against a new catalog with the map file, counting the
+// backend calls it takes.  Returns the index, or -1.
+static long Find(struct FakeBackend *fake, const char *name) {
+    struct DisplayCatalog catalog;
+    DisplayCatalogInit(&catalog, &fake->backend);
+    struct DisplayIdMap map;
+    DisplayIdMapOpen(&map, map_path);
+    catalog.ids = &map;
+    fake->get_active_displays_calls = 0;
+    fake->get_display_identity_calls = 0;
+    uint32_t index = 0;
+    const int e = DisplayCatalogFindDisplay(&catalog, name, &index);
+    DisplayIdMapFlush(&map);
+    DisplayIdMapClose(&map);
+    DisplayCatalogFree(&catalog);
+    return e ? -1 : (long)index;
+}
+
+static void test_configure_by_name(void) {
+    unlink(map_path);
+    struct FakeBackend fake;
+    InitFake(&fake);
+    char *text = NULL;
+    const char *name[] = {"prog", "n", "1", "desk", NULL};
+    ASSERT(Run(&fake, 4, name, &text) == EXIT_SUCCESS &&
+           strstr(text, "Display 1 (610:a002:3dde) is now 'desk'") != NULL,
+           "n names display 1");
+    free(text);
+
+    const char *set[] = {"prog", "t", "1280", "720", "desk", NULL};
+    ASSERT(Run(&fake, 5, set, &text) == EXIT_SUCCESS,
+           "t by name succeeds");
+    free(text);
+    ASSERT(fake.displays[1].current_index == 1 &&
+           fake.displays[0].current_index == 0 &&
+           fake.displays[2].current_index == 0, "t by name sets its display");
+
+    const char *by_identity[] = {"prog", "t", "640", "480", "610:a003:5ccd",
+                                 NULL};
+    ASSERT(Run(&fake, 5, by_identity, &text) == EXIT_SUCCESS,
+           "t by identity succeeds");
+    free(text);
+    ASSERT(fake.displays[2].current_index == 2, "t by identity sets its display");
+
+    const char *rename[] = {"prog", "n", "desk", "left", NULL};
+    ASSERT(Run(&fake, 4, rename, &text) == EXIT_SUCCESS, "n renames by name");
+    free(text);
+    const char *list[] = {"prog", "n", NULL};
+    ASSERT(Run(&fake, 2, list, &text) == EXIT_SUCCESS &&
+           strstr(text, "Display 0: 610:a001:1eef\n") != NULL &&
+           (strstr(text, "Display 1: 610:a002:3dde desk left\n") != NULL ||
+            strstr(text, "Display 1: 610:a002:3dde left desk\n") != NULL),
+           "n lists identities and names");
+    free(text);
+
+    const char *unknown[] = {"prog", "t", "640", "480", "couch", NULL};
+    ASSERT(Run(&fake, 5, unknown, &text) == kDisplayErrorRangeCheck &&
+           strstr(text, "Unknown display 'couch'") != NULL,
+           "unknown name rejected");
+    free(text);
+    const char *invalid[] = {"prog", "n", "0", "a:b", NULL};
+    ASSERT(Run(&fake, 4, invalid, &text) == EXIT_FAILURE &&
+           strstr(text, "Invalid display name 'a:b'") != NULL,
+           "invalid name rejected");
+    free(text);
+    FakeBackendFree(&fake);
+}
+
+static void test_name_is_saved(void) {
+    struct FakeBackend fake;
+    InitFake(&fake);
+    const char *name[] = {"prog", "n", "0", "desk", NULL};
+    const struct ParsedArgs parsed_args = ParseArgs(4, name);
+
+    // As on a new account: the map's directory doesn't exist yet.
+    char dir[80];
+    char path[96];
+    snprintf(dir, sizeof(dir), "%s.dir", map_path);
+    snprintf(path, sizeof(path), "%s/displays", dir);
+    struct DisplayCatalog catalog;
+    DisplayCatalogInit(&catalog, &fake.backend);
+    struct DisplayIdMap map;
+    DisplayIdMapOpen(&map, path);
+    catalog.ids = &map;
+    char *text = NULL;
+    size_t length = 0;
+    FILE *out = open_memstream(&text, &length);
+    ASSERT(RunCommand(&catalog, &parsed_args, out, out) == EXIT_SUCCESS,
+           "n succeeds without a directory");
+    fclose(out);
+    ASSERT(access(path, F_OK) == 0, "n writes the map before returning");
+    free(text);
+    DisplayIdMapClose(&map);
+    DisplayCatalogFree(&catalog);
+    unlink(path);
+    rmdir(dir);
+
+    // A file where the directory should be.
+    FILE *blocker = fopen(dir, "w");
+    fclose(blocker);
+    DisplayCatalogInit(&catalog, &fake.backend);
+    DisplayIdMapOpen(&map, path);
+    catalog.ids = &map;
+    text = NULL;
+    out = open_memstream(&text, &length);
+    ASSERT(RunCommand(&catalog, &parsed_args, out, out) == EXIT_FAILURE,
+           "n fails if the map can't be written");
+    fclose(out);
+    ASSERT(strstr(text, "Could not write display map") != NULL &&
+           strstr(text, "is now") == NULL, "failed n reports the error only");
+    free(text);
+    DisplayIdMapClose(&map);
+    DisplayCatalogFree(&catalog);
+    unlink(dir);
+    FakeBackendFree(&fake);
+}
+
+static void test_hit_checks_one_display(void) {
+    unlink(map_path);
+    struct FakeBackend fake;
+    InitFake(&fake);
+    char *text = NULL;
+    const char *name[] = {"prog", "n", "1", "desk", NULL};
+    Run(&fake, 4, name, &text);
+    free(text);
+
+    ASSERT(Find(&fake, "desk") == 1, "name found");
+    ASSERT(fake.get_active_displays_calls == 1 &&
+           fake.get_display_identity_calls == 1,
+           "hit reads the display list once and one identity");
+    ASSERT(Find(&fake, "610:a002:3dde") == 1, "identity found");
+    ASSERT(fake.get_display_identity_calls == 1, "identity hit checks one display");
+    FakeBackendFree(&fake);
+}
+
+static void test_moved_display(void) {
+    unlink(map_path);
+    struct FakeBackend fake;
+    InitFake(&fake);
+    char *text = NULL;
+    const char *name[] = {"prog", "n", "1", "desk", NULL};
+    Run(&fake, 4, name, &text);
+    free(text);
+
+    // Unplugged and plugged in again: same ID, last in the list.
+    FakeBackendRemoveDisplay(&fake, 2);
+    FakeBackendAddDisplay(&fake, 2, kModes, 3, 0);
+    ASSERT(Find(&fake, "desk") == 2, "reordered display found");
+    ASSERT(fake.get_active_displays_calls == 1 &&
+           fake.get_display_identity_calls == 1,
+           "reordered display found without re-reading identities");
+    ASSERT(Find(&fake, "desk") == 2 && fake.get_display_identity_calls == 1,
+           "new position recorded");
+
+    // Plugged in again under a new ID.
+    const struct DisplayIdentity desk = Identity(0x610, 0xa002, 2 * 7919);
+    FakeBackendRemoveDisplay(&fake, 2);
+    FakeBackendAddDisplay(&fake, 9, kModes, 3, 0);
+    FakeBackendSetIdentity(&fake, 9, &desk);
+    ASSERT(Find(&fake, "desk") == 2, "display found under a new ID");
+    ASSERT(fake.get_display_identity_calls == 4,
+           "new ID found by reading every identity once");
+    ASSERT(Find(&fake, "desk") == 2 && fake.get_display_identity_calls == 1,
+           "new ID recorded");
+    FakeBackendFree(&fake);
+}
+
+static void test_reused_id(void) {
+    unlink(map_path);
+    struct FakeBackend fake;
+    InitFake(&fake);
+    char *text = NULL;
+    const char *name[] = {"prog", "n", "1", "desk", NULL};
+    Run(&fake, 4, name, &text);
+    free(text);
+
+    // Another monitor takes over the named one's ID and position.
+    const struct DisplayIdentity other = Identity(0x1e6d, 0x5b09, 42);
+    FakeBackendSetIdentity(&fake, 2, &other);
+    ASSERT(Find(&fake, "desk") == -1, "other monitor under the same ID rejected");
+    const char *set[] = {"prog", "t", "640", "480", "desk", NULL};
+    ASSERT(Run(&fake, 5, set, &text) == kDisplayErrorRangeCheck &&
+           fake.displays[1].current_index == 0, "t leaves the other monitor");
+    free(text);
+    ASSERT(Find(&fake, "1e6d:5b09:2a") == 1, "other monitor found by identity");
+
+    // Once the named monitor is back, the name finds it again.
+    const struct DisplayIdentity desk = Identity(0x610, 0xa002, 2 * 7919);
+    FakeBackendAddDisplay(&fake, 4, kModes, 3, 0);
+    FakeBackendSetIdentity(&fake, 4, &desk);
+    ASSERT(Find(&fake, "desk") == 3, "named monitor found again");
+    FakeBackendFree(&fake);
+}
+
+static void test_shared_identity(void) {
+    unlink(map_path);
+    struct FakeBackend fake;
+    InitFake(&fake);
+    char *text = NULL;
+    const char *name[] = {"prog", "n", "1", "desk", NULL};
+    Run(&fake, 4, name, &text);
+    free(text);
+
+    // A second monitor of the same model reports the same serial.
+    const struct DisplayIdentity desk = Identity(0x610, 0xa002, 2 * 7919);
+    FakeBackendAddDisplay(&fake, 9, kModes, 3, 0);
+    FakeBackendSetIdentity(&fake, 9, &desk);
+    const char *list[] = {"prog", "n", NULL};
+    ASSERT(Run(&fake, 2, list, &text) == EXIT_SUCCESS &&
+           strstr(text, "Display 1: 610:a002:3dde desk\n") != NULL &&
+           strstr(text, "Display 3: 610:a002:3dde\n") != NULL,
+           "n lists the name on its own display only");
+    free(text);
+    ASSERT(Find(&fake, "desk") == 1, "name stays on its display");
+
+    // The named one moves; the name follows its ID.
+    FakeBackendRemoveDisplay(&fake, 2);
+    FakeBackendAddDisplay(&fake, 2, kModes, 3, 0);
+    ASSERT(Find(&fake, "desk") == 3, "name follows its display");
+    ASSERT(Run(&fake, 2, list, &text) == EXIT_SUCCESS &&
+           strstr(text, "Display 2: 610:a002:3dde\n") != NULL &&
+           strstr(text, "Display 3: 610:a002:3dde desk\n") != NULL,
+           "n lists the name where its display moved");
+    free(text);
+    ASSERT(Find(&fake, "desk") == 3, "name stays after listing");
+
+    const char *twin[] = {"prog", "n", "2", "couch", NULL};
+    ASSERT(Run(&fake, 4, twin, &text) == EXIT_FAILURE &&
+           strstr(text, "another display has the same identity") != NULL,
+           "n refuses a shared identity");
+    free(text);
+    ASSERT(Find(&fake, "couch") == -1, "refused name not kept");
+    FakeBackendFree(&fake);
+}
+
+static void test_without_map(void) {
+    struct FakeBackend fake;
+    InitFake(&fake);
+    struct DisplayCatalog catalog;
+    DisplayCatalogInit(&catalog, &fake.backend);
+    uint32_t index = 0;
+    ASSERT(DisplayCatalogFindDisplay(&catalog, "610:a003:5ccd", &index) == 0 &&
+           index == 2, "identity found without a map");
+    ASSERT(DisplayCatalogFindDisplay(&catalog, "desk", &index) ==
+           kDisplayErrorRangeCheck, "names need a map");
+    DisplayCatalogFree(&catalog);
+    FakeBackendFree(&fake);
+}
+
+int main(void) {
+    setLogLevel(LOG_LEVEL_ERROR);
+    snprintf(map_path, sizeof(map_path), "/tmp/displaymode-test-%ld.displays",
+             (long)getpid());
+    test_map_round_trip();
+    test_map_rejects_invalid_files();
+    test_valid_names();
+    test_parse();
+    test_configure_by_name();
+    test_name_is_saved();
+    test_hit_checks_one_display();
+    test_moved_display();
+    test_reused_id();
+    test_shared_identity();
+    test_without_map();
+    unlink(map_path);
+
+    if (tests_failed == 0) {
+        printf("All %d display map tests passed.\n", tests_run);
+        return EXIT_SUCCESS;
+    } else {
+        fprintf(stderr, "%d of %d display map tests failed.\n", tests_failed,
+                tests_run);
+        return EXIT_FAILURE;
+    }
+}
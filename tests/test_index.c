@@ -0,0 +1,146 @@
+#include "../displaymode_catalog.h"
+#include "../displaymode_index.h"
+#include "../displaymode_parse.h"
+#include "../logging.h"
+#include "fake_backend.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static int tests_run = 0;
+static int tests_failed = 0;
+
+#define ASSERT(expr, msg) do { \
+    tests_run++; \
+    if (!(expr)) { \
+        fprintf(stderr, "FAIL: %s (test %d)\n", msg, tests_run); \
+        tests_failed++; \
+    } \
+} while (0)
+
+// The lookup the index replaces.
+static ptrdiff_t LinearFind(const struct DisplayMode *modes, size_t count,
+                            size_t width, size_t height, double refresh_rate) {
+    for (size_t i = 0; i < count; ++i) {
+        if (modes[i].width == width && modes[i].height == height &&
+            MatchesRefreshRate(refresh_rate, modes[i].refresh_rate)) {
+            return (ptrdiff_t)i;
+        }
+    }
+    return -1;
+}
+
+// Refresh rates around the tolerance boundaries of 60 Hz, plus common ones.
+static const double kRefreshRates[] = {
+    0.0, 60.0, 60.004, 60.005, 60.006, 59.996, 59.995, 59.994, 59.94,
+    59.9401, 50.0, 75.0, 120.0, 144.0, 143.998, 30.0, 24.0, 23.976,
+};
+enum { kNumRefreshRates = sizeof(kRefreshRates) / sizeof(kRefreshRates[0]) };
+
+static void test_index_basic(void) {
+    static const struct DisplayMode kModes[] = {
+        {1920, 1080, 60.0, 1, 1, NULL},
+        {1920, 1080, 50.0, 1, 2, NULL},
+        {1280, 720, 60.0, 1, 3, NULL},
+        {1920, 1080, 59.997, 1, 4, NULL},
+        {1920, 1080, 60.0, 0, 5, NULL},
+    };
+    struct DisplayModeIndex index;
+    ASSERT(DisplayModeIndexBuild(&index, kModes, 5) == 0, "build");
+    ASSERT(DisplayModeIndexFind(&index, 1920, 1080, 0.0) == 0, "any refresh rate");
+    ASSERT(DisplayModeIndexFind(&index, 1920, 1080, 50.0) == 1, "exact refresh rate");
+    ASSERT(DisplayModeIndexFind(&index, 1920, 1080, 59.996) == 0,
+           "first matching mode in list order");
+    ASSERT(DisplayModeIndexFind(&index, 1920, 1080, 59.993) == 3,
+           "tolerance applies");
+    ASSERT(DisplayModeIndexFind(&index, 1920, 1080, 75.0) == -1, "no refresh match");
+    ASSERT(DisplayModeIndexFind(&index, 1280, 720, 0.0) == 2, "second resolution");
+    ASSERT(DisplayModeIndexFind(&index, 720, 1280, 0.0) == -1, "unknown resolution");
+    const struct DisplayModeBucket *bucket =
+        DisplayModeIndexFindBucket(&index, 1920, 1080);
+    ASSERT(bucket != NULL && bucket->count == 4, "bucket holds all refresh rates");
+    DisplayModeIndexFree(&index);
+
+    ASSERT(DisplayModeIndexBuild(&index, NULL, 0) == 0, "build empty");
+    ASSERT(DisplayModeIndexFind(&index, 1920, 1080, 0.0) == -1, "empty index misses");
+    DisplayModeIndexFree(&index);
+}
+
+// Compares the index against a linear scan on random lists with many
+// duplicate resolutions and refresh rates near the tolerance.
+static void test_index_matches_linear_scan(void) {
+    srand(12345);
+    int mismatches = 0;
+    for (int round = 0; round < 50; ++round) {
+        const size_t count = (size_t)(rand() % 2000);
+        const size_t resolutions = 1 + (size_t)(rand() % 40);
+        struct DisplayMode *modes = calloc(count ? count : 1, sizeof(*modes));
+        for (size_t i = 0; i < count; ++i) {
+            const size_t r = (size_t)rand() % resolutions;
+            modes[i].width = 640 + 16 * r;
+            modes[i].height = 480 + 9 * (r % 7);
+            modes[i].refresh_rate = kRefreshRates[1 + rand() % (kNumRefreshRates - 1)];
+            modes[i].mode_id = (int)i;
+        }
+        struct DisplayModeIndex index;
+        DisplayModeIndexBuild(&index, modes, count);
+        for (size_t r = 0; r <= resolutions; ++r) {
+            const size_t width = 640 + 16 * r;
+            const size_t height = 480 + 9 * (r % 7);
+            for (int j = 0; j < kNumRefreshRates; ++j) {
+                const double rate = kRefreshRates[j];
+                if (DisplayModeIndexFind(&index, width, height, rate) !=
+                    LinearFind(modes, count, width, height, rate)) {
+                    ++mismatches;
+                }
+            }
+        }
+        DisplayModeIndexFree(&index);
+        free(modes);
+    }
+    ASSERT(mismatches == 0, "index agrees with linear scan");
+}
+
+static void test_catalog_find_mode(void) {
+    struct FakeBackend fake;
+    FakeBackendInit(&fake);
+    FakeBackendAddSyntheticDisplay(&fake, 1, 5000);
+    struct DisplayCatalog catalog;
+    DisplayCatalogInit(&catalog, &fake.backend);
+    const struct DisplayModeList *list = NULL;
+    DisplayCatalogLoadDisplays(&catalog);
+    DisplayCatalogGetModes(&catalog, 0, &list);
+    int mismatches = 0;
+    for (size_t i = 0; i < list->count; i += 37) {
+        const struct DisplayMode *mode = &list->modes[i];
+        for (int j = 0; j < kNumRefreshRates; ++j) {
+            if (DisplayCatalogFindMode(&catalog, 0, mode->width, mode->height,
+                                       kRefreshRates[j]) !=
+                LinearFind(list->modes, list->count, mode->width, mode->height,
+                           kRefreshRates[j])) {
+                ++mismatches;
+            }
+        }
+    }
+    ASSERT(mismatches == 0, "catalog lookup agrees with linear scan");
+    ASSERT(catalog.has_index[0], "index kept with the modes");
+    DisplayCatalogInvalidate(&catalog);
+    ASSERT(!catalog.has_index[0], "index released with the modes");
+    DisplayCatalogFree(&catalog);
+    FakeBackendFree(&fake);
+}
+
+int main(void) {
+    setLogLevel(LOG_LEVEL_ERROR);
+    test_index_basic();
+    test_index_matches_linear_scan();
+    test_catalog_find_mode();
+
+    if (tests_failed == 0) {
+        printf("All %d index tests passed.\n", tests_run);
+        return EXIT_SUCCESS;
+    } else {
+        fprintf(stderr, "%d of %d index tests failed.\n", tests_failed, tests_run);
+        return EXIT_FAILURE;
+    }
+}
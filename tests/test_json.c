@@ -0,0 +1,303 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "../displaymode_catalog.h"
+#include "../displaymode_commands.h"
+#include "../displaymode_json.h"
+#include "../displaymode_parse.h"
+#include "../logging.h"
+#include "fake_backend.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int tests_run = 0;
+static int tests_failed = 0;
+
+#define ASSERT(expr, msg) do { \
+    tests_run++; \
+    if (!(expr)) { \
+        fprintf(stderr, "FAIL: %s (test %d)\n", msg, tests_run); \
+        tests_failed++; \
+    } \
+} while (0)
+
+// A minimal JSON validator: returns the end of the value at "p", or NULL.
+static const char *SkipValue(const char *p);
+
+static const char *SkipSpace(const char *p) {
+    while (*p == ' ' || *p == '\n' || *p == '\t' || *p == '\r') {
+        ++p;
+    }
+    return p;
+}
+
+static const char *SkipString(const char *p) {
+    if (*p++ != '"') {
+        return NULL;
+    }
+    for (; *p != '"'; ++p) {
+        if ((unsigned char)*p < 0x20) {
+            return NULL;
+        }
+        if (*p == '\\') {
+            ++p;
+            if (*p == 'u') {
+                for (int i = 1; i <= 4; ++i) {
+                    if (strchr("0123456789abcdefABCDEF", p[i]) == NULL || p[i] == '\0') {
+                        return NULL;
+                    }
+                }
+                p += 4;
+            } else if (strchr("\"\\/bfnrt", *p) == NULL || *p == '\0') {
+                return NULL;
+            }
+        }
+    }
+    return p + 1;
+}
+
+static const char *SkipContainer(const char *p, char close, int is_object) {
+    p = SkipSpace(p + 1);
+    if (*p == close) {
+        return p + 1;
+    }
+    for (;;) {
+        if (is_object) {
+            if ((p = SkipString(SkipSpace(p))) == NULL) {
+                return NULL;
+            }
+            p = SkipSpace(p);
+            if (*p++ != ':') {
+                return NULL;
+            }
+        }
+        if ((p = SkipValue(p)) == NULL) {
+            return NULL;
+        }
+        p = SkipSpace(p);
+        if (*p == close) {
+            return p + 1;
+        }
+        if (*p++ != ',') {
+            return NULL;
+        }
+    }
+}
+
+static const char *SkipValue(const char *p) {
+    p = SkipSpace(p);
+    switch (*p) {
+        case '{': return SkipContainer(p, '}', 1);
+        case '[': return SkipContainer(p, ']', 0);
+        case '"': return SkipString(p);
+        case 't': return strncmp(p, "true", 4) == 0 ? p + 4 : NULL;
+        case 'f': return strncmp(p, "false", 5) == 0 ? p + 5 : NULL;
+        case 'n': return strncmp(p, "null", 4) == 0 ? p + 4 : NULL;
+        default: {
+            char *end = NULL;
+            strtod(p, &end);
+            return end == p ? NULL : end;
+        }
+    }
+}
+
+// Returns non-zero if "text" is exactly one JSON value and a newline.
+static int IsJsonLine(const char *text, size_t length) {
+    const char *end = SkipValue(text);
+    return end != NULL && (size_t)(end - text) + 1 == length && *end == '\n';
+}
+
+static void test_writer_structure(void) {
+    struct JsonWriter json;
+    JsonWriterInit(&json, NULL);
+    JsonWriterBeginObject(&json);
+    JsonWriterKey(&json, "a");
+    JsonWriterBeginArray(&json);
+    JsonWriterUint(&json, 1);
+    JsonWriterInt(&json, -2);
+    JsonWriterBool(&json, 1);
+    JsonWriterNull(&json);
+    JsonWriterBeginObject(&json);
+    JsonWriterEndObject(&json);
+    JsonWriterBeginArray(&json);
+    JsonWriterEndArray(&json);
+    JsonWriterEndArray(&json);
+    JsonWriterKey(&json, "b");
+    JsonWriterString(&json, "x");
+    JsonWriterEndObject(&json);
+    JsonWriterEndLine(&json);
+    ASSERT(!json.error, "no error");
+    ASSERT(json.length == strlen("{\"a\":[1,-2,true,null,{},[]],\"b\":\"x\"}\n") &&
+           memcmp(json.buffer, "{\"a\":[1,-2,true,null,{},[]],\"b\":\"x\"}\n",
+                  json.length) == 0, "commas and colons placed");
+
+    // NDJSON lines don't get commas between them.
+    JsonWriterInit(&json, NULL);
+    JsonWriterUint(&json, 1);
+    JsonWriterEndLine(&json);
+    JsonWriterUint(&json, 2);
+    JsonWriterEndLine(&json);
+    ASSERT(json.length == 4 && memcmp(json.buffer, "1\n2\n", 4) == 0, "lines");
+
+    JsonWriterInit(&json, NULL);
+    JsonWriterBeginObject(&json);
+    JsonWriterUint(&json, 1);
+    ASSERT(json.error, "value without key is an error");
+    JsonWriterInit(&json, NULL);
+    JsonWriterBeginArray(&json);
+    JsonWriterEndObject(&json);
+    ASSERT(json.error, "mismatched close is an error");
+    JsonWriterInit(&json, NULL);
+    for (int i = 0; i < kJsonMaxDepth; ++i) {
+        JsonWriterBeginArray(&json);
+    }
+    ASSERT(json.error, "too deep is an error");
+}
+
+// Writes "value" alone and returns the text.
+static const char *WriteDouble(struct JsonWriter *json, double value) {
+    JsonWriterInit(json, NULL);
+    JsonWriterDouble(json, value);
+    json->buffer[json->length] = '\0';
+    return json->buffer;
+}
+
+static void test_writer_values(void) {
+    struct JsonWriter json;
+    ASSERT(strcmp(WriteDouble(&json, 60.0), "60.0") == 0, "integral double");
+    ASSERT(strcmp(WriteDouble(&json, 59.94), "59.94") == 0, "short double");
+    ASSERT(strcmp(WriteDouble(&json, 0.1 + 0.2), "0.30000000000000004") == 0,
+           "double round-trips");
+    ASSERT(strcmp(WriteDouble(&json, -0.0), "-0.0") == 0, "negative zero");
+    ASSERT(strcmp(WriteDouble(&json, 1e300), "1.0000000000000001e+300") == 0 ||
+           strcmp(WriteDouble(&json, 1e300), "1e+300") == 0, "large double");
+    ASSERT(strcmp(WriteDouble(&json, NAN), "null") == 0, "NaN is null");
+    ASSERT(strcmp(WriteDouble(&json, INFINITY), "null") == 0, "infinity is null");
+
+    JsonWriterInit(&json, NULL);
+    JsonWriterInt(&json, INT64_MIN);
+    JsonWriterEndLine(&json);
+    JsonWriterUint(&json, UINT64_MAX);
+    JsonWriterEndLine(&json);
+    json.buffer[json.length] = '\0';
+    ASSERT(strcmp(json.buffer, "-9223372036854775808\n18446744073709551615\n") == 0,
+           "integer limits");
+
+    JsonWriterInit(&json, NULL);
+    JsonWriterString(&json, "q\"b\\n\n\t\x01\x1f\xc3\xa9");
+    json.buffer[json.length] = '\0';
+    ASSERT(strcmp(json.buffer, "\"q\\\"b\\\\n\\n\\t\\u0001\\u001f\xc3\xa9\"") == 0,
+           "strings escaped");
+}
+
+static void test_writer_streams(void) {
+    char *text = NULL;
+    size_t length = 0;
+    FILE *out = open_memstream(&text, &length);
+    struct JsonWriter json;
+    JsonWriterInit(&json, out);
+    char *long_string = malloc(3 * kJsonWriterBufferSize);
+    memset(long_string, 'x', 3 * kJsonWriterBufferSize - 1);
+    long_string[3 * kJsonWriterBufferSize - 1] = '\0';
+    JsonWriterBeginArray(&json);
+    for (int i = 0; i < 5000; ++i) {
+        JsonWriterDouble(&json, i + 0.5);
+    }
+    JsonWriterString(&json, long_string);
+    JsonWriterEndArray(&json);
+    JsonWriterEndLine(&json);
+    ASSERT(JsonWriterFlush(&json) == 0, "flush");
+    fclose(out);
+    ASSERT(length > 3 * kJsonWriterBufferSize, "output larger than the buffer");
+    ASSERT(IsJsonLine(text, length), "streamed output is valid");
+    free(text);
+
+    // Without a stream, overflowing the buffer is an error.
+    JsonWriterInit(&json, NULL);
+    JsonWriterString(&json, long_string);
+    ASSERT(json.error, "overflow without a stream is an error");
+    free(long_string);
+}
+
+// Runs "d" with the given flag and returns its output.
+static char *ListModes(struct FakeBackend *fake, const char *flag) {
+    char *text = NULL;
+    size_t length = 0;
+    FILE *out = open_memstream(&text, &length);
+    struct DisplayCatalog catalog;
+    DisplayCatalogInit(&catalog, &fake->backend);
+    const char *argv[] = {"displaymode", "d", flag, NULL};
+    const struct ParsedArgs parsed_args = ParseArgs(3, argv);
+    ASSERT(RunCommand(&catalog, &parsed_args, out, stderr) == 0, "d succeeds");
+    DisplayCatalogFree(&catalog);
+    fclose(out);
+    return text;
+}
+
+static size_t CountOccurrences(const char *text, const char *needle) {
+    size_t count = 0;
+    for (const char *p = text; (p = strstr(p, needle)) != NULL; ++p) {
+        ++count;
+    }
+    return count;
+}
+
+static void test_catalog_json(void) {
+    static const struct DisplayMode kModes[] = {
+        {1920, 1080, 60.0, 1, 1, NULL},
+        {640, 480, 59.94, 0, 4, NULL},
+    };
+    struct FakeBackend fake;
+    FakeBackendInit(&fake);
+    FakeBackendAddDisplay(&fake, 1, kModes, 2, 1);
+    FakeBackendAddSyntheticDisplay(&fake, 2, 3000);
+
+    char *text = ListModes(&fake, "--json");
+    ASSERT(IsJsonLine(text, strlen(text)), "document is valid JSON");
+    static const char kPrefix[] = "{\"displays\":[{\"display\":0,\"main\":true,\"modes\":[";
+    ASSERT(strncmp(text, kPrefix, sizeof(kPrefix) - 1) == 0,
+           "document starts with the displays");
+    ASSERT(strstr(text, "{\"width\":640,\"height\":480,\"refreshRate\":59.94,"
+                        "\"aspectWidth\":4,\"aspectHeight\":3,"
+                        "\"pixelEncoding\":\"Unknown\",\"modeId\":4,"
+                        "\"isHiDPI\":false,\"displayName\":\"Display\","
+                        "\"resCategory\":\"LowRes\",\"usableForDesktop\":false,"
+                        "\"current\":true}") != NULL, "every field written");
+    ASSERT(CountOccurrences(text, "\"width\"") == 3002, "every mode written");
+    ASSERT(CountOccurrences(text, "\"current\":true") == 2, "one current mode per display");
+    ASSERT(strstr(text, "{\"display\":1,\"main\":false,") != NULL, "second display");
+    free(text);
+
+    text = ListModes(&fake, "--ndjson");
+    size_t lines = 0;
+    int valid = 1;
+    for (const char *line = text; *line != '\0'; ++lines) {
+        const char *end = strchr(line, '\n');
+        valid = valid && end != NULL && IsJsonLine(line, (size_t)(end - line) + 1);
+        line = end != NULL ? end + 1 : line + strlen(line);
+    }
+    ASSERT(lines == 3002 && valid, "one valid line per mode");
+    static const char kLinePrefix[] = "{\"display\":0,\"width\":1920,";
+    ASSERT(strncmp(text, kLinePrefix, sizeof(kLinePrefix) - 1) == 0,
+           "lines name the display");
+    free(text);
+    FakeBackendFree(&fake);
+}
+
+int main(void) {
+    setLogLevel(LOG_LEVEL_ERROR);
+    test_writer_structure();
+    test_writer_values();
+    test_writer_streams();
+    test_catalog_json();
+
+    if (tests_failed == 0) {
+        printf("All %d JSON tests passed.\n", tests_run);
+        return EXIT_SUCCESS;
+    } else {
+        fprintf(stderr, "%d of %d JSON tests failed.\n", tests_failed, tests_run);
+        return EXIT_FAILURE;
+    }
+}
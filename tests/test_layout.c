@@ -0,0 +1,377 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "../displaymode_catalog.h"
+#include "../displaymode_commands.h"
+#include "../displaymode_ids.h"
+#include "../displaymode_layout.h"
+#include "../displaymode_parse.h"
+#include "../logging.h"
+#include "fake_backend.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static int tests_run = 0;
+static int tests_failed = 0;
+
+#define ASSERT(expr, msg) do { \
+    tests_run++; \
+    if (!(expr)) { \
+        fprintf(stderr, "FAIL: %s (test %d)\n", msg, tests_run); \
+        tests_failed++; \
+    } \
+} while (0)
+
+static const struct DisplayMode kModes[] = {
+    {1920, 1080, 60.0, 1, 1, NULL},
+    {1280, 720, 60.0, 1, 2, NULL},
+    {1280, 720, 50.0, 1, 3, NULL},
+    {640, 480, 60.0, 1, 4, NULL},
+};
+
+static char config_path[64];
+static char plan_path[64];
+static char ids_path[64];
+
+static void WriteConfig(const char *text) {
+    FILE *f = fopen(config_path, "w");
+    fputs(text, f);
+    fclose(f);
+}
+
+static void InitFake(struct FakeBackend *fake) {
+    FakeBackendInit(fake);
+    FakeBackendAddDisplay(fake, 1, kModes, 4, 0);
+    FakeBackendAddDisplay(fake, 2, kModes, 4, 0);
+    FakeBackendAddDisplay(fake, 3, kModes, 4, 0);
+}
+
+// The outcome of one invocation of displaymode.
+struct Result {
+    int status;
+    char *text;        // what it printed, to either stream
+    int rewrote;       // non-zero if it wrote the plans
+    int searched;      // non-zero if it searched any display's modes
+};
+
+// Runs "argv" against a new catalog with the layout and display map files,
+// as one invocation of displaymode would, counting backend calls from zero.
+static struct Result Run(struct FakeBackend *fake, int argc, const char **argv) {
+    struct DisplayCatalog catalog;
+    DisplayCatalogInit(&catalog, &fake->backend);
+    struct DisplayIdMap ids;
+    DisplayIdMapOpen(&ids, ids_path);
+    catalog.ids = &ids;
+    struct DisplayLayouts layouts;
+    DisplayLayoutsOpen(&layouts, config_path, plan_path);
+    catalog.layouts = &layouts;
+    fake->get_active_displays_calls = 0;
+    fake->copy_modes_calls = 0;
+    fake->get_display_identity_calls = 0;
+    fake->complete_calls = 0;
+
+    struct Result result;
+    memset(&result, 0, sizeof(result));
+    size_t length = 0;
+    FILE *out = open_memstream(&result.text, &length);
+    const struct ParsedArgs parsed_args = ParseArgs(argc, argv);
+    result.status = RunCommand(&catalog, &parsed_args, out, out);
+    fclose(out);
+    for (uint32_t i = 0; i < catalog.num_displays; ++i) {
+        result.searched = result.searched || catalog.has_index[i];
+    }
+    result.rewrote = layouts.dirty;
+    DisplayLayoutsFlush(&layouts);
+    DisplayLayoutsClose(&layouts);
+    DisplayIdMapFlush(&ids);
+    DisplayIdMapClose(&ids);
+    DisplayCatalogFree(&catalog);
+    return result;
+}
+
+static struct Result Apply(struct FakeBackend *fake, const char *name) {
+    const char *argv[] = {"displaymode", "l", name, NULL};
+    return Run(fake, name != NULL ? 3 : 2, argv);
+}
+
+static void test_parse(void) {
+    const char *all[] = {"prog", "l", NULL};
+    struct ParsedArgs p = ParseArgs(2, all);
+    ASSERT(p.option == kOptionLayout && p.name == NULL, "l compiles");
+    const char *one[] = {"prog", "l", "desk", NULL};
+    p = ParseArgs(3, one);
+    ASSERT(p.option == kOptionLayout && strcmp(p.name, "desk") == 0,
+           "l applies");
+    const char *extra[] = {"prog", "l", "desk", "kiosk", NULL};
+    ASSERT(ParseArgs(4, extra).option == kOptionInvalidMode,
+           "l takes one layout");
+    ASSERT(ParseCommandLine("l desk", 6, &p) == 1, "layout name deferred");
+}
+
+static void test_compile(void) {
+    unlink(plan_path);
+    WriteConfig("# Layouts\n"
+                "desk: 1280 720 @50 0 640 480 2\n"
+                "\n"
+                "presenter: 1080p 1  # projector\n"
+                "no colon here\n"
+                "kiosk: 800 600 0\n"
+                "2: 640 480 0\n"
+                "bad: 640 480 @60 0 640 480 0\n");
+    struct FakeBackend fake;
+    InitFake(&fake);
+    struct Result result = Apply(&fake, NULL);
+    ASSERT(result.status == EXIT_FAILURE, "l fails if any layout does");
+    ASSERT(strstr(result.text, "Layout 'desk': 2 displays\n") != NULL &&
+           strstr(result.text, "Layout 'presenter': 1 display\n") != NULL,
+           "valid layouts compiled");
+    ASSERT(strstr(result.text, ":5: Expected <name>: <modes>") != NULL,
+           "line without a name reported");
+    ASSERT(strstr(result.text, ":6: Could not find a mode for resolution "
+                               "800x600 on display 0") != NULL,
+           "missing mode reported");
+    ASSERT(strstr(result.text, ":7: Invalid layout name '2'") != NULL,
+           "index as a name reported");
+    ASSERT(strstr(result.text, ":8: Display 0 specified more than once") != NULL,
+           "repeated display reported");
+    ASSERT(fake.complete_calls == 0, "compiling sets no modes");
+    free(result.text);
+
+    struct DisplayLayouts layouts;
+    DisplayLayoutsOpen(&layouts, config_path, plan_path);
+    const struct DisplayLayoutPlan *plan = DisplayLayoutsFind(&layouts, "desk");
+    ASSERT(layouts.count == 2 && plan != NULL && plan->num_displays == 2 &&
+           plan->displays[0].index == 0 && plan->displays[0].mode_index == 2 &&
+           plan->displays[0].mode_id == 3 &&
+           plan->displays[0].refresh_mhz == 50000 &&
+           plan->displays[1].display == 3 &&
+           plan->displays[1].identity.model == 0xa003 &&
+           plan->displays[1].mode_index == 3, "plans written");
+    ASSERT(DisplayLayoutsFind(&layouts, "kiosk") == NULL, "invalid layout left out");
+    DisplayLayoutsClose(&layouts);
+
+    // Editing the config drops the plans.
+    WriteConfig("desk: 1280 720 @50 0 640 480 2\npresenter: 1080p 1\n");
+    DisplayLayoutsOpen(&layouts, config_path, plan_path);
+    ASSERT(layouts.count == 0, "plans of another config ignored");
+    DisplayLayoutsClose(&layouts);
+    FakeBackendFree(&fake);
+}
+
+static void test_apply_uses_plan(void) {
+    unlink(plan_path);
+    WriteConfig("desk: 1280 720 @50 0 640 480 2\npresenter: 1080p 1\n");
+    struct FakeBackend fake;
+    InitFake(&fake);
+    struct Result result = Apply(&fake, "desk");
+    ASSERT(result.status == EXIT_SUCCESS &&
+           strstr(result.text, "Applied layout 'desk' to 2 displays") != NULL,
+           "first apply compiles and applies");
+    ASSERT(result.searched && result.rewrote, "first apply searches and saves");
+    ASSERT(fake.displays[0].current_index == 2 &&
+           fake.displays[1].current_index == 0 &&
+           fake.displays[2].current_index == 3, "modes set");
+    free(result.text);
+
+    fake.displays[0].current_index = 0;
+    fake.displays[2].current_index = 0;
+    result = Apply(&fake, "desk");
+    ASSERT(result.status == EXIT_SUCCESS, "second apply succeeds");
+    ASSERT(!result.searched && !result.rewrote,
+           "second apply neither searches nor compiles");
+    ASSERT(fake.get_active_displays_calls == 1 &&
+           fake.get_display_identity_calls == 2 && fake.copy_modes_calls == 2 &&
+           fake.complete_calls == 1,
+           "second apply reads only the planned displays");
+    ASSERT(fake.displays[0].current_index == 2 &&
+           fake.displays[2].current_index == 3, "planned modes set");
+    free(result.text);
+
+    // A layout without a plan is compiled on its own.
+    result = Apply(&fake, "presenter");
+    ASSERT(result.status == EXIT_SUCCESS && result.rewrote &&
+           fake.displays[1].current_index == 0, "other layout compiled");
+    free(result.text);
+    result = Apply(&fake, "desk");
+    ASSERT(result.status == EXIT_SUCCESS && !result.searched,
+           "first plan kept");
+    free(result.text);
+
+    result = Apply(&fake, "couch");
+    ASSERT(result.status == kDisplayErrorRangeCheck &&
+           strstr(result.text, "Unknown layout 'couch'") != NULL,
+           "unknown layout rejected");
+    free(result.text);
+    FakeBackendFree(&fake);
+}
+
+static void test_stale_plan(void) {
+    unlink(plan_path);
+    unlink(ids_path);
+    WriteConfig("desk: 1280 720 610:a002:3dde 640 480 0\n");
+    struct FakeBackend fake;
+    InitFake(&fake);
+    struct Result result = Apply(&fake, "desk");
+    ASSERT(result.status == EXIT_SUCCESS &&
+           fake.displays[1].current_index == 1, "identity in a layout");
+    free(result.text);
+
+    // The display moves to the end of the list.
+    FakeBackendRemoveDisplay(&fake, 2);
+    FakeBackendAddDisplay(&fake, 2, kModes, 4, 0);
+    result = Apply(&fake, "desk");
+    ASSERT(result.status == EXIT_SUCCESS && result.searched && result.rewrote,
+           "moved display recompiles the plan");
+    ASSERT(fake.displays[2].id == 2 && fake.displays[2].current_index == 1 &&
+           fake.displays[1].current_index == 0, "moved display set");
+    free(result.text);
+    result = Apply(&fake, "desk");
+    ASSERT(result.status == EXIT_SUCCESS && !result.searched && !result.rewrote,
+           "recompiled plan holds");
+    free(result.text);
+
+    // Its modes change order, so the planned index holds another mode.
+    static const struct DisplayMode kReordered[] = {
+        {640, 480, 60.0, 1, 4, NULL},
+        {1920, 1080, 60.0, 1, 1, NULL},
+        {1280, 720, 50.0, 1, 3, NULL},
+        {1280, 720, 60.0, 1, 2, NULL},
+    };
+    FakeBackendRemoveDisplay(&fake, 1);
+    FakeBackendAddDisplay(&fake, 1, kReordered, 4, 1);
+    FakeBackendRemoveDisplay(&fake, 3);
+    FakeBackendAddDisplay(&fake, 3, kModes, 4, 0);
+    FakeBackendRemoveDisplay(&fake, 2);
+    FakeBackendAddDisplay(&fake, 2, kModes, 4, 0);
+    // Display 1 is first again, so only its modes differ from the plan.
+    ASSERT(fake.displays[0].id == 1, "display 1 first");
+    result = Apply(&fake, "desk");
+    ASSERT(result.status == EXIT_SUCCESS && result.rewrote &&
+           fake.displays[0].current_index == 0, "changed modes searched again");
+    free(result.text);
+
+    // The named monitor is replaced by another under the same ID.
+    const struct DisplayIdentity other = {0x1e6d, 0x5b09, 42};
+    FakeBackendSetIdentity(&fake, 2, &other);
+    result = Apply(&fake, "desk");
+    ASSERT(result.status == EXIT_FAILURE &&
+           strstr(result.text, "Unknown display '610:a002:3dde'") != NULL,
+           "plan of a missing display fails");
+    free(result.text);
+    FakeBackendFree(&fake);
+}
+
+static void test_edit_within_a_second(void) {
+    unlink(plan_path);
+    WriteConfig("desk: 1280 720 @50 0 640 480 2\n");
+    struct stat before;
+    stat(config_path, &before);
+    struct FakeBackend fake;
+    InitFake(&fake);
+    struct Result result = Apply(&fake, "desk");
+    ASSERT(result.status == EXIT_SUCCESS && fake.displays[0].current_index == 2,
+           "first config applied");
+    free(result.text);
+
+    // Edited in place to the same size, with its modification time in the
+    // same second as before.
+    FILE *f = fopen(config_path, "r+");
+    fputs("desk: 1280 720 @60 0 640 480 2\n", f);
+    fclose(f);
+    const struct timespec times[2] = {
+        {before.st_mtime, 0},
+        {before.st_mtime, 0},
+    };
+    ASSERT(utimensat(AT_FDCWD, config_path, times, 0) == 0, "set times");
+    struct stat after;
+    stat(config_path, &after);
+    ASSERT(after.st_size == before.st_size && after.st_ino == before.st_ino &&
+           after.st_mtime == before.st_mtime, "same size, inode and second");
+    result = Apply(&fake, "desk");
+    ASSERT(result.status == EXIT_SUCCESS && result.rewrote &&
+           fake.displays[0].current_index == 1, "edited config applied");
+    free(result.text);
+    FakeBackendFree(&fake);
+}
+
+static void test_edit_drops_other_plans(void) {
+    unlink(plan_path);
+    WriteConfig("desk: 1280 720 0\n"
+                "kiosk: 640 480 1\n");
+    struct FakeBackend fake;
+    InitFake(&fake);
+    struct Result result = Apply(&fake, NULL);
+    ASSERT(result.status == EXIT_SUCCESS, "both layouts compiled");
+    free(result.text);
+
+    // Edited while the plans are open; only "desk" is compiled again.
+    struct DisplayCatalog catalog;
+    DisplayCatalogInit(&catalog, &fake.backend);
+    struct DisplayLayouts layouts;
+    DisplayLayoutsOpen(&layouts, config_path, plan_path);
+    ASSERT(DisplayLayoutsFind(&layouts, "kiosk") != NULL, "plans mapped");
+    WriteConfig("desk: 1280 720 0\n"
+                "kiosk: 1920 1080 1\n");
+    ASSERT(DisplayLayoutsCompile(&layouts, &catalog, "desk", stdout,
+                                 stderr) == 0 &&
+           DisplayLayoutsFind(&layouts, "desk") != NULL,
+           "desk compiled from the edited config");
+    ASSERT(DisplayLayoutsFind(&layouts, "kiosk") == NULL,
+           "plan of the old config dropped");
+    DisplayLayoutsFlush(&layouts);
+    DisplayLayoutsClose(&layouts);
+    DisplayCatalogFree(&catalog);
+
+    result = Apply(&fake, "kiosk");
+    ASSERT(result.status == EXIT_SUCCESS && result.rewrote &&
+           fake.displays[1].current_index == 0, "edited kiosk applied");
+    free(result.text);
+    FakeBackendFree(&fake);
+}
+
+static void test_missing_config(void) {
+    unlink(config_path);
+    unlink(plan_path);
+    struct FakeBackend fake;
+    InitFake(&fake);
+    struct Result result = Apply(&fake, NULL);
+    ASSERT(result.status == EXIT_FAILURE &&
+           strstr(result.text, "Could not read layouts from") != NULL,
+           "missing config reported");
+    free(result.text);
+    FakeBackendFree(&fake);
+}
+
+int main(void) {
+    setLogLevel(LOG_LEVEL_ERROR);
+    const long pid = (long)getpid();
+    snprintf(config_path, sizeof(config_path),
+             "/tmp/displaymode-test-%ld.layouts", pid);
+    snprintf(plan_path, sizeof(plan_path), "/tmp/displaymode-test-%ld.plans",
+             pid);
+    snprintf(ids_path, sizeof(ids_path), "/tmp/displaymode-test-%ld.displays",
+             pid);
+    test_parse();
+    test_compile();
+    test_apply_uses_plan();
+    test_stale_plan();
+    test_edit_within_a_second();
+    test_edit_drops_other_plans();
+    test_missing_config();
+    unlink(config_path);
+    unlink(plan_path);
+    unlink(ids_path);
+
+    if (tests_failed == 0) {
+        printf("All %d layout tests passed.\n", tests_run);
+        return EXIT_SUCCESS;
+    } else {
+        fprintf(stderr, "%d of %d layout tests failed.\n", tests_failed,
+                tests_run);
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,165 @@
+#define _POSIX_C_SOURCE 200809L
+
+// Compile debug messages out, to check that the LOG_* macros remove them.
+#define LOG_MIN_LEVEL 1
+
+#include "../logging.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static int tests_run = 0;
+static int tests_failed = 0;
+
+#define ASSERT(expr, msg) do { \
+    tests_run++; \
+    if (!(expr)) { \
+        fprintf(stderr, "FAIL: %s (test %d)\n", msg, tests_run); \
+        tests_failed++; \
+    } \
+} while (0)
+
+enum {
+    kThreads = 8,
+    // Several times the queue size, so producers wait for the flusher.
+    kMessagesPerThread = 5000,
+};
+
+static char log_path[64];
+static int saved_stderr = -1;
+
+// Sends stderr (where log messages go) to the log file.
+static void CaptureStderr(void) {
+    fflush(stderr);
+    saved_stderr = dup(STDERR_FILENO);
+    const int fd = open(log_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    dup2(fd, STDERR_FILENO);
+    close(fd);
+}
+
+// Restores stderr and returns what was logged.
+static char *RestoreStderr(void) {
+    logFlush();
+    dup2(saved_stderr, STDERR_FILENO);
+    close(saved_stderr);
+    FILE *f = fopen(log_path, "rb");
+    fseek(f, 0, SEEK_END);
+    const long size = ftell(f);
+    rewind(f);
+    char *text = calloc(1, (size_t)size + 1);
+    if (fread(text, 1, (size_t)size, f) != (size_t)size) {
+        text[0] = '\0';
+    }
+    fclose(f);
+    unlink(log_path);
+    return text;
+}
+
+static int evaluated = 0;
+
+// Only referenced from a compiled-out LOG_DEBUG.
+__attribute__((unused)) static int Evaluate(void) {
+    return ++evaluated;
+}
+
+static void test_levels(void) {
+    setLogLevel(LOG_LEVEL_DEBUG);
+    CaptureStderr();
+    LOG_DEBUG("compiled out %d", Evaluate());
+    LOG_INFO("info %d", 1);
+    setLogLevel(LOG_LEVEL_WARN);
+    LOG_INFO("filtered %d", 2);
+    LOG_WARN("warning %s", "text");
+    LOG_ERROR("error");
+    char *text = RestoreStderr();
+
+    ASSERT(evaluated == 0, "compiled-out arguments aren't evaluated");
+    ASSERT(!LOG_ENABLED(LOG_LEVEL_DEBUG), "compiled-out level isn't enabled");
+    ASSERT(LOG_ENABLED(LOG_LEVEL_ERROR), "error level enabled");
+    ASSERT(strstr(text, "compiled out") == NULL, "debug message removed");
+    ASSERT(strstr(text, " [INFO] info 1\n") != NULL, "info logged");
+    ASSERT(strstr(text, "filtered") == NULL, "level filters at runtime");
+    ASSERT(strstr(text, " [WARN] warning text\n") != NULL, "warning logged");
+    ASSERT(strstr(text, " [ERROR] error\n") != NULL, "error logged");
+    // "YYYY-MM-DD HH:MM:SS [INFO] ..."
+    ASSERT(strlen(text) > 20 && text[4] == '-' && text[10] == ' ' &&
+           text[13] == ':' && text[19] == ' ', "timestamp prefix");
+    free(text);
+
+    char long_message[2000];
+    memset(long_message, 'z', sizeof(long_message) - 1);
+    long_message[sizeof(long_message) - 1] = '\0';
+    CaptureStderr();
+    LOG_ERROR("%s", long_message);
+    text = RestoreStderr();
+    const char *newline = strchr(text, '\n');
+    ASSERT(newline != NULL && newline[1] == '\0' && newline - text > 400 &&
+           newline - text < 600, "long message truncated to one line");
+    free(text);
+}
+
+static void *Producer(void *arg) {
+    const int thread = (int)(intptr_t)arg;
+    for (int i = 0; i < kMessagesPerThread; ++i) {
+        LOG_WARN("thread %d message %d", thread, i);
+    }
+    return NULL;
+}
+
+static void test_concurrent_producers(void) {
+    setLogLevel(LOG_LEVEL_WARN);
+    CaptureStderr();
+    pthread_t threads[kThreads];
+    for (int i = 0; i < kThreads; ++i) {
+        pthread_create(&threads[i], NULL, Producer, (void *)(intptr_t)i);
+    }
+    for (int i = 0; i < kThreads; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    char *text = RestoreStderr();
+
+    // Every message appears exactly once, whole, and in order per thread.
+    int next[kThreads] = {0};
+    int lines = 0;
+    int well_formed = 1;
+    int in_order = 1;
+    for (char *line = strtok(text, "\n"); line != NULL; line = strtok(NULL, "\n")) {
+        int thread = -1;
+        int message = -1;
+        const char *body = strstr(line, " [WARN] ");
+        if (body == NULL ||
+            sscanf(body, " [WARN] thread %d message %d", &thread, &message) != 2 ||
+            thread < 0 || thread >= kThreads) {
+            well_formed = 0;
+            continue;
+        }
+        if (message != next[thread]) {
+            in_order = 0;
+        }
+        next[thread] = message + 1;
+        ++lines;
+    }
+    ASSERT(well_formed, "no torn or interleaved lines");
+    ASSERT(lines == kThreads * kMessagesPerThread, "no message lost or repeated");
+    ASSERT(in_order, "each thread's messages in order");
+    free(text);
+}
+
+int main(void) {
+    snprintf(log_path, sizeof(log_path), "/tmp/displaymode-log-%ld",
+             (long)getpid());
+    test_levels();
+    test_concurrent_producers();
+
+    if (tests_failed == 0) {
+        printf("All %d logging tests passed.\n", tests_run);
+        return EXIT_SUCCESS;
+    } else {
+        fprintf(stderr, "%d of %d logging tests failed.\n", tests_failed, tests_run);
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,125 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "../displaymode_catalog.h"
+#include "../displaymode_commands.h"
+#include "../displaymode_output.h"
+#include "../logging.h"
+#include "fake_backend.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static int tests_run = 0;
+static int tests_failed = 0;
+
+#define ASSERT(expr, msg) do { \
+    tests_run++; \
+    if (!(expr)) { \
+        fprintf(stderr, "FAIL: %s (test %d)\n", msg, tests_run); \
+        tests_failed++; \
+    } \
+} while (0)
+
+static void test_buffer_grows(void) {
+    struct OutputBuffer output;
+    OutputBufferInit(&output);
+    for (int i = 0; i < 10000; ++i) {
+        OutputBufferPrintf(&output, "%d,", i);
+    }
+    char long_text[1000];
+    memset(long_text, 'y', sizeof(long_text) - 1);
+    long_text[sizeof(long_text) - 1] = '\0';
+    OutputBufferPrintf(&output, "%s", long_text);
+    OutputBufferAppend(&output, "end", 3);
+    ASSERT(!output.error, "no error");
+    ASSERT(output.length == 48890 + 999 + 3, "length accounts for every append");
+    ASSERT(memcmp(output.data, "0,1,2,", 6) == 0, "start kept");
+    ASSERT(memcmp(output.data + 48890, long_text, 999) == 0,
+           "long printf retried with room");
+
+    char *text = NULL;
+    size_t length = 0;
+    FILE *out = open_memstream(&text, &length);
+    ASSERT(OutputBufferWrite(&output, out) == 0, "write to memory stream");
+    fclose(out);
+    ASSERT(length == 48890 + 999 + 3 && memcmp(text + length - 3, "end", 3) == 0,
+           "memory stream gets everything");
+    ASSERT(output.length == 0, "write empties the buffer");
+    free(text);
+    OutputBufferFree(&output);
+}
+
+// Returns the number of write system calls made so far, or -1 if the
+// kernel doesn't say.
+static long WriteSyscalls(void) {
+    FILE *io = fopen("/proc/self/io", "r");
+    if (io == NULL) {
+        return -1;
+    }
+    char line[128];
+    long count = -1;
+    while (fgets(line, sizeof(line), io) != NULL) {
+        if (sscanf(line, "syscw: %ld", &count) == 1) {
+            break;
+        }
+    }
+    fclose(io);
+    return count;
+}
+
+static void test_listing_written_at_once(void) {
+    static const struct DisplayMode kModes[] = {
+        {1920, 1080, 60.0, 1, 1, NULL},
+        {640, 480, 59.94, 0, 4, NULL},
+    };
+    struct FakeBackend fake;
+    FakeBackendInit(&fake);
+    FakeBackendAddDisplay(&fake, 1, kModes, 2, 0);
+    FakeBackendAddSyntheticDisplay(&fake, 2, 10000);
+    struct DisplayCatalog catalog;
+    DisplayCatalogInit(&catalog, &fake.backend);
+
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/displaymode-output-%ld", (long)getpid());
+    FILE *out = fopen(path, "w+");
+    // Load the modes first, so only the listing's own writes are counted.
+    DisplayCatalogLoadDisplays(&catalog);
+    const struct DisplayModeList *list = NULL;
+    DisplayCatalogGetModes(&catalog, 0, &list);
+    DisplayCatalogGetModes(&catalog, 1, &list);
+    const long before = WriteSyscalls();
+    ASSERT(PrintModesForAllDisplays(&catalog, out, stderr) == 0, "d succeeds");
+    const long after = WriteSyscalls();
+    if (before >= 0) {
+        ASSERT(after - before == 1, "listing written with one system call");
+    }
+
+    rewind(out);
+    char head[128] = {0};
+    fread(head, 1, sizeof(head) - 1, out);
+    ASSERT(strncmp(head,
+                   "Display 0 (MAIN):\n"
+                   "1920 x 1080 @60.0Hz AR:16:9 Enc:Unknown ModeID:1 Std Display Cat:1080p *\n"
+                   "640 x 480 @59.9Hz AR:4:3 Enc:Unknown ModeID:4 Std Display Cat:LowRes !\n"
+                   "\nDisplay 1:\n", 127) == 0, "listing format unchanged");
+    fclose(out);
+    unlink(path);
+    DisplayCatalogFree(&catalog);
+    FakeBackendFree(&fake);
+}
+
+int main(void) {
+    setLogLevel(LOG_LEVEL_ERROR);
+    test_buffer_grows();
+    test_listing_written_at_once();
+
+    if (tests_failed == 0) {
+        printf("All %d output tests passed.\n", tests_run);
+        return EXIT_SUCCESS;
+    } else {
+        fprintf(stderr, "%d of %d output tests failed.\n", tests_failed, tests_run);
+        return EXIT_FAILURE;
+    }
+}
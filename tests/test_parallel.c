@@ -0,0 +1,179 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "../displaymode_catalog.h"
+#include "../displaymode_commands.h"
+#include "../displaymode_parse.h"
+#include "../displaymode_pool.h"
+#include "../logging.h"
+#include "fake_backend.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static int tests_run = 0;
+static int tests_failed = 0;
+
+#define ASSERT(expr, msg) do { \
+    tests_run++; \
+    if (!(expr)) { \
+        fprintf(stderr, "FAIL: %s (test %d)\n", msg, tests_run); \
+        tests_failed++; \
+    } \
+} while (0)
+
+static double NowMs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void CountTask(void *context, size_t index) {
+    unsigned *counts = context;
+    __atomic_add_fetch(&counts[index], 1, __ATOMIC_RELAXED);
+}
+
+static void test_pool_runs_every_task_once(void) {
+    static const unsigned kThreads[] = {0, 1, 4, 100};
+    for (size_t t = 0; t < sizeof(kThreads) / sizeof(kThreads[0]); ++t) {
+        unsigned counts[1000] = {0};
+        WorkerPoolRun(1000, kThreads[t], CountTask, counts);
+        int once = 1;
+        for (size_t i = 0; i < 1000; ++i) {
+            once &= counts[i] == 1;
+        }
+        ASSERT(once, "every task runs exactly once");
+    }
+    WorkerPoolRun(0, 4, CountTask, NULL);
+    ASSERT(1, "no tasks is fine");
+}
+
+// Runs a command against "fake" with the catalog limited to "max_threads"
+// and returns its output (to be freed).
+static char *Run(struct FakeBackend *fake, unsigned max_threads, int argc,
+                 const char *argv[], int *status) {
+    char *buffer = NULL;
+    size_t len = 0;
+    FILE *out = open_memstream(&buffer, &len);
+    struct DisplayCatalog catalog;
+    DisplayCatalogInit(&catalog, &fake->backend);
+    catalog.max_threads = max_threads;
+    const struct ParsedArgs parsed_args = ParseArgs(argc, argv);
+    *status = RunCommand(&catalog, &parsed_args, out, out);
+    DisplayCatalogFree(&catalog);
+    fclose(out);
+    return buffer;
+}
+
+static void test_output_matches_serial(void) {
+    struct FakeBackend fake;
+    FakeBackendInit(&fake);
+    for (uint32_t i = 0; i < 9; ++i) {
+        FakeBackendAddSyntheticDisplay(&fake, 10 + i, 5 + 37 * i);
+        // Later displays finish first.
+        fake.displays[i].copy_modes_delay_us = (9 - i) * 500;
+    }
+    const char *text[] = {"prog", "d", NULL};
+    const char *filtered[] = {"prog", "d", "--usable", "--min-width=700", NULL};
+    const char *json[] = {"prog", "d", "--json", NULL};
+    const char *ndjson[] = {"prog", "d", "--ndjson", NULL};
+    const char **commands[] = {text, filtered, json, ndjson};
+    const int argcs[] = {2, 4, 3, 3};
+    for (size_t c = 0; c < 4; ++c) {
+        int serial_status;
+        int parallel_status;
+        char *serial = Run(&fake, 1, argcs[c], commands[c], &serial_status);
+        fake.copy_modes_calls = 0;
+        char *parallel = Run(&fake, 4, argcs[c], commands[c], &parallel_status);
+        ASSERT(serial_status == EXIT_SUCCESS &&
+               parallel_status == EXIT_SUCCESS, "both listings succeed");
+        ASSERT(strcmp(serial, parallel) == 0,
+               "parallel listing is byte-identical to the serial one");
+        ASSERT(fake.copy_modes_calls == 9, "each display enumerated once");
+        free(serial);
+        free(parallel);
+    }
+    FakeBackendFree(&fake);
+}
+
+static void test_wall_time_tracks_slowest_display(void) {
+    static const unsigned kDelaysMs[] = {20, 40, 60, 120};
+    struct FakeBackend fake;
+    FakeBackendInit(&fake);
+    unsigned sum_ms = 0;
+    for (uint32_t i = 0; i < 4; ++i) {
+        FakeBackendAddSyntheticDisplay(&fake, 1 + i, 50);
+        fake.displays[i].copy_modes_delay_us = kDelaysMs[i] * 1000;
+        sum_ms += kDelaysMs[i];
+    }
+    const char *argv[] = {"prog", "d", NULL};
+    int status;
+
+    double start = NowMs();
+    free(Run(&fake, 1, 2, argv, &status));
+    const double serial_ms = NowMs() - start;
+
+    start = NowMs();
+    free(Run(&fake, 4, 2, argv, &status));
+    const double parallel_ms = NowMs() - start;
+
+    printf("Serial listing: %.1f ms, parallel: %.1f ms "
+           "(slowest display %u ms, sum %u ms)\n",
+           serial_ms, parallel_ms, kDelaysMs[3], sum_ms);
+    ASSERT(serial_ms >= sum_ms, "serial listing waits for every display");
+    ASSERT(parallel_ms >= kDelaysMs[3], "parallel listing waits for the slowest");
+    // Leave plenty of room for a loaded machine, but well below the sum.
+    ASSERT(parallel_ms < kDelaysMs[3] + (sum_ms - kDelaysMs[3]) / 2,
+           "parallel listing takes about as long as the slowest display");
+    FakeBackendFree(&fake);
+}
+
+static void test_more_displays_than_threads(void) {
+    struct FakeBackend fake;
+    FakeBackendInit(&fake);
+    for (uint32_t i = 0; i < 8; ++i) {
+        FakeBackendAddSyntheticDisplay(&fake, 1 + i, 10);
+        fake.displays[i].copy_modes_delay_us = 20000;
+    }
+    struct DisplayCatalog catalog;
+    DisplayCatalogInit(&catalog, &fake.backend);
+    catalog.max_threads = 2;
+    int errors[8];
+    const double start = NowMs();
+    const int e = DisplayCatalogLoadDisplays(&catalog) ||
+        DisplayCatalogLoadAllModes(&catalog, errors);
+    const double elapsed_ms = NowMs() - start;
+    ASSERT(e == 0, "all modes load");
+    int all_loaded = 1;
+    for (uint32_t i = 0; i < 8; ++i) {
+        all_loaded &= errors[i] == 0 && catalog.has_modes[i] &&
+            catalog.modes[i].count == 10;
+    }
+    ASSERT(all_loaded, "every display has its modes");
+    ASSERT(elapsed_ms >= 80 && elapsed_ms < 150,
+           "two threads take about half the serial time");
+
+    fake.copy_modes_calls = 0;
+    ASSERT(DisplayCatalogLoadAllModes(&catalog, errors) == 0 &&
+           fake.copy_modes_calls == 0, "loaded displays aren't re-enumerated");
+    DisplayCatalogFree(&catalog);
+    FakeBackendFree(&fake);
+}
+
+int main(void) {
+    setLogLevel(LOG_LEVEL_ERROR);
+    test_pool_runs_every_task_once();
+    test_output_matches_serial();
+    test_wall_time_tracks_slowest_display();
+    test_more_displays_than_threads();
+
+    if (tests_failed == 0) {
+        printf("All %d parallel tests passed.\n", tests_run);
+        return EXIT_SUCCESS;
+    } else {
+        fprintf(stderr, "%d of %d parallel tests failed.\n", tests_failed,
+                tests_run);
+        return EXIT_FAILURE;
+    }
+}
@@ -74,6 +74,222 @@ static void test_parse_args_missing_args(void) {
     ASSERT(p.option == kOptionInvalidMode, "missing width/height -> invalid mode");
 }
 
+static void test_parse_args_server(void) {
+    const char *argv1[] = { "prog", "s", NULL };
+    struct ParsedArgs p1 = ParseArgs(2, argv1);
+    ASSERT(p1.option == kOptionServer, "option == s");
+    ASSERT(p1.socket_path == NULL, "default socket path");
+
+    const char *argv2[] = { "prog", "s", "/tmp/dm.sock", NULL };
+    struct ParsedArgs p2 = ParseArgs(3, argv2);
+    ASSERT(p2.option == kOptionServer, "option == s with path");
+    ASSERT(p2.socket_path != NULL && strcmp(p2.socket_path, "/tmp/dm.sock") == 0,
+           "server socket path parsed");
+}
+
+static void test_parse_args_socket_flag(void) {
+    const char *argv[] = { "prog", "--socket=/tmp/dm.sock", "t", "800", "600", NULL };
+    struct ParsedArgs p = ParseArgs(5, argv);
+    ASSERT(p.option == kOptionConfigureMode, "option == t with --socket");
+    ASSERT(p.width == 800UL && p.height == 600UL, "mode parsed with --socket");
+    ASSERT(p.socket_path != NULL && strcmp(p.socket_path, "/tmp/dm.sock") == 0,
+           "--socket path parsed");
+}
+
+static void test_parse_args_quiet_flag(void) {
+    const char *argv[] = { "prog", "d", "--quiet", NULL };
+    struct ParsedArgs p = ParseArgs(3, argv);
+    ASSERT(p.option == kOptionSupportedModes, "option == d with --quiet");
+    ASSERT(p.quiet == 1, "--quiet parsed");
+}
+
+static void test_parse_args_stats_flag(void) {
+    const char *argv[] = { "prog", "d", "--stats", NULL };
+    struct ParsedArgs p = ParseArgs(3, argv);
+    ASSERT(p.option == kOptionSupportedModes, "option == d with --stats");
+    ASSERT(p.stats == 1, "--stats parsed");
+}
+
+static void test_parse_args_trace_flag(void) {
+    const char *argv[] = { "prog", "t", "--trace=out.json", "640", "480", NULL };
+    struct ParsedArgs p = ParseArgs(5, argv);
+    ASSERT(p.option == kOptionConfigureMode, "option == t with --trace");
+    ASSERT(p.width == 640 && p.height == 480, "mode parsed around --trace");
+    ASSERT(p.trace_path != NULL && strcmp(p.trace_path, "out.json") == 0,
+           "--trace path parsed");
+}
+
+static void test_parse_args_filter_flags(void) {
+    const char *argv[] = { "prog", "d", "--min-width=1280", "--max-height=1200",
+                           "--min-refresh=59.94", "--aspect=16:10", "--usable",
+                           NULL };
+    struct ParsedArgs p = ParseArgs(7, argv);
+    ASSERT(p.option == kOptionSupportedModes, "option == d with filters");
+    ASSERT(p.filter.active, "filter active");
+    ASSERT(p.filter.min_width == 1280 && p.filter.max_width == UINT32_MAX,
+           "width bounds parsed");
+    ASSERT(p.filter.min_height == 0 && p.filter.max_height == 1200,
+           "height bounds parsed");
+    ASSERT(p.filter.min_refresh_mhz == 59940 &&
+           p.filter.max_refresh_mhz == UINT32_MAX, "refresh bound in mHz");
+    ASSERT(p.filter.aspect_w == 16 && p.filter.aspect_h == 10, "aspect parsed");
+    ASSERT(p.filter.usable_only && !p.filter.hidpi_only, "flags parsed");
+
+    const char *plain[] = { "prog", "d", NULL };
+    p = ParseArgs(2, plain);
+    ASSERT(!p.filter.active, "no filter by default");
+
+    static const char *const kInvalid[] = {
+        "--min-width=wide", "--max-width=-1", "--min-refresh=fast",
+        "--aspect=16", "--aspect=16:0", "--aspect=:9", "--max-height=",
+    };
+    for (size_t i = 0; i < sizeof(kInvalid) / sizeof(kInvalid[0]); ++i) {
+        const char *bad[] = { "prog", "d", kInvalid[i], NULL };
+        p = ParseArgs(3, bad);
+        ASSERT(p.option == kOptionInvalid &&
+               strcmp(p.literal_option, kInvalid[i]) == 0,
+               "invalid filter value rejected");
+    }
+}
+
+// Splits "line" into words and parses them with ParseArgs.
+static struct ParsedArgs ParseWords(const char *line) {
+    static char copy[256];
+    const char *argv[64];
+    int argc = 0;
+    argv[argc++] = "prog";
+    snprintf(copy, sizeof(copy), "%s", line);
+    for (char *word = strtok(copy, " \t"); word != NULL;
+         word = strtok(NULL, " \t")) {
+        argv[argc++] = word;
+    }
+    argv[argc] = NULL;
+    return ParseArgs(argc, argv);
+}
+
+static int SameParse(const struct ParsedArgs *a, const struct ParsedArgs *b) {
+    if (a->option != b->option) {
+        return 0;
+    }
+    if (a->option != kOptionConfigureMode && a->option != kOptionProfile) {
+        return 1;
+    }
+    if (a->num_specs != b->num_specs || a->width != b->width ||
+        a->height != b->height || a->refresh_rate != b->refresh_rate ||
+        a->display_index != b->display_index) {
+        return 0;
+    }
+    for (size_t i = 0; i < a->num_specs; ++i) {
+        if (a->specs[i].width != b->specs[i].width ||
+            a->specs[i].height != b->specs[i].height ||
+            a->specs[i].refresh_rate != b->specs[i].refresh_rate ||
+            a->specs[i].display_index != b->specs[i].display_index) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void test_parse_command_line_matches_parse_args(void) {
+    static const char *const kLines[] = {
+        "t 1920 1080", "t 1920 1080 @60 1", "t 800 600 @59.94 2",
+        "  t\t1440 900  @120.0  0 ", "t 1 2 @60 0 3 4 @75 1",
+        "t 640 480 @60. 1", "t 640 480 @.5 1", "t 640 480 @0.016666 1",
+        "t 1920 1080 3 640 480", "t 1 2 3 4 5", "t 0 600", "t 640", "t",
+        "d", "h", "v", "w", "x", "foo 1 2", "",
+        "p 640 480 0 800 600 @60 0", "p 640 480 0", "p 640 480",
+        "p 4K 0 1080p 1",
+        "t 1 1 0 1 1 1 1 1 2 1 1 3 1 1 4 1 1 5 1 1 6 1 1 7 1 1 8 1 1 9 "
+        "1 1 10 1 1 11 1 1 12 1 1 13 1 1 14 1 1 15 1 1 16",
+    };
+    for (size_t i = 0; i < sizeof(kLines) / sizeof(kLines[0]); ++i) {
+        struct ParsedArgs fast;
+        const int e = ParseCommandLine(kLines[i], strlen(kLines[i]), &fast);
+        const struct ParsedArgs slow = ParseWords(kLines[i]);
+        ASSERT(e == 0, "line parsed without ParseArgs");
+        ASSERT(SameParse(&fast, &slow), "same result as ParseArgs");
+    }
+}
+
+static void test_parse_command_line_defers_to_parse_args(void) {
+    static const char *const kLines[] = {
+        "d --json", "t 640 480 --verbose", "t 1920x 1080", "t +5 6",
+        "t 1 2 @6e1", "t 1 2 @", "t 1234567890 1", "s /tmp/sock", "- file",
+    };
+    for (size_t i = 0; i < sizeof(kLines) / sizeof(kLines[0]); ++i) {
+        struct ParsedArgs fast;
+        ASSERT(ParseCommandLine(kLines[i], strlen(kLines[i]), &fast) == 1,
+               "unusual line left to ParseArgs");
+    }
+}
+
+static void test_parse_command_line_many_digit_rates(void) {
+    // Digits beyond what a double holds exactly round twice if scaled.
+    static const char *const kLines[] = {
+        "t 640 480 @189641421.927994705 1", "t 640 480 @59961393.565328075 1",
+        "t 640 480 @59.940059940 1",        "t 640 480 @60.000000001 1",
+        "t 640 480 @0.123456789 1",         "t 640 480 @123456.123456789 1",
+    };
+    for (size_t i = 0; i < sizeof(kLines) / sizeof(kLines[0]); ++i) {
+        struct ParsedArgs fast;
+        const int e = ParseCommandLine(kLines[i], strlen(kLines[i]), &fast);
+        const struct ParsedArgs slow = ParseWords(kLines[i]);
+        ASSERT(slow.refresh_rate == strtod(strchr(kLines[i], '@') + 1, NULL),
+               "ParseArgs rate is strtod's");
+        ASSERT(e == 1 || SameParse(&fast, &slow),
+               "many-digit rate parsed as strtod would");
+    }
+}
+
+static void test_parse_command_line_stays_in_bounds(void) {
+    // Only the first 13 bytes are the line.
+    const char line[] = "t 640 480 @60 19";
+    struct ParsedArgs p;
+    ASSERT(ParseCommandLine(line, 13, &p) == 0 &&
+           p.option == kOptionConfigureMode && p.num_specs == 1 &&
+           p.refresh_rate == 60.0 && p.display_index == 0,
+           "parsing stops at the given length");
+    ASSERT(ParseCommandLine(line, 4, &p) == 0 &&
+           p.option == kOptionInvalidMode, "truncated width and no height");
+}
+
+static void test_parse_args_batch(void) {
+    const char *argv[] = { "prog", "-", "commands.txt", NULL };
+    struct ParsedArgs p = ParseArgs(3, argv);
+    ASSERT(p.option == kOptionBatch, "option == -");
+    ASSERT(p.input_path != NULL && strcmp(p.input_path, "commands.txt") == 0,
+           "batch input path parsed");
+    p = ParseArgs(2, argv);
+    ASSERT(p.option == kOptionBatch && p.input_path == NULL,
+           "batch reads stdin by default");
+}
+
+static void test_parse_args_profile(void) {
+    const char *argv[] = {"prog", "p", "1920", "1080", "0", "640", "480", "1",
+                          "--iterations=250", NULL};
+    struct ParsedArgs p = ParseArgs(8, argv);
+    ASSERT(p.option == kOptionProfile && p.num_specs == 2 &&
+           p.specs[1].width == 640 && p.specs[1].display_index == 1,
+           "option == p with two modes");
+    ASSERT(p.iterations == kDefaultProfileIterations, "default iterations");
+    p = ParseArgs(9, argv);
+    ASSERT(p.option == kOptionProfile && p.iterations == 250,
+           "--iterations parsed");
+    p = ParseArgs(5, argv);
+    ASSERT(p.option == kOptionInvalidMode, "p needs two modes");
+    static const char *const kInvalid[] = {
+        "--iterations=0", "--iterations=100001", "--iterations=x",
+        "--iterations=",
+    };
+    for (size_t i = 0; i < sizeof(kInvalid) / sizeof(kInvalid[0]); ++i) {
+        argv[8] = kInvalid[i];
+        p = ParseArgs(9, argv);
+        ASSERT(p.option == kOptionInvalid &&
+               strcmp(p.literal_option, kInvalid[i]) == 0,
+               "invalid --iterations rejected");
+    }
+}
+
 int main(void) {
     test_matches_refresh_rate();
     test_parse_args_simple();
@@ -83,6 +299,18 @@ int main(void) {
     test_parse_args_version_flag();
     test_parse_args_verbose_flag();
     test_parse_args_missing_args();
+    test_parse_args_server();
+    test_parse_args_socket_flag();
+    test_parse_args_quiet_flag();
+    test_parse_args_stats_flag();
+    test_parse_args_trace_flag();
+    test_parse_args_filter_flags();
+    test_parse_command_line_matches_parse_args();
+    test_parse_command_line_defers_to_parse_args();
+    test_parse_command_line_many_digit_rates();
+    test_parse_command_line_stays_in_bounds();
+    test_parse_args_batch();
+    test_parse_args_profile();
 
     if (tests_failed == 0) {
         printf("All %d tests passed.\n", tests_run);
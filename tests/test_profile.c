@@ -0,0 +1,248 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "../displaymode_catalog.h"
+#include "../displaymode_commands.h"
+#include "../displaymode_parse.h"
+#include "../displaymode_profile.h"
+#include "../logging.h"
+#include "fake_backend.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int tests_run = 0;
+static int tests_failed = 0;
+
+#define ASSERT(expr, msg) do { \
+    tests_run++; \
+    if (!(expr)) { \
+        fprintf(stderr, "FAIL: %s (test %d)\n", msg, tests_run); \
+        tests_failed++; \
+    } \
+} while (0)
+
+// Two displays of 24 modes whose calls take fixed virtual times: 640x480 is
+// modes[0] (current), 656x489 modes[6] and 672x498 modes[12], all at 60Hz.
+static void InitFake(struct FakeBackend *fake) {
+    FakeBackendInit(fake);
+    FakeBackendAddSyntheticDisplay(fake, 1, 24);
+    FakeBackendAddSyntheticDisplay(fake, 2, 24);
+    fake->use_virtual_time = 1;
+    fake->begin_delay_us = 100;
+    fake->configure_delay_us = 2000;
+    fake->complete_delay_us = 50000;
+    fake->copy_current_mode_delay_us = 300;
+    // Two reads after each switch still see the old mode.
+    fake->current_mode_lag = 2;
+}
+
+static struct ModeSpec Spec(unsigned long width, unsigned long height,
+                            uint32_t display_index) {
+    struct ModeSpec spec = {width, height, 60.0, display_index, NULL};
+    return spec;
+}
+
+static int StatsAre(const struct ProfileStats *stats, uint64_t min_ns,
+                    uint64_t p50_ns, uint64_t p99_ns, uint64_t max_ns) {
+    return stats->min_ns == min_ns && stats->p50_ns == p50_ns &&
+           stats->p99_ns == p99_ns && stats->max_ns == max_ns;
+}
+
+static void test_stats(void) {
+    uint64_t samples[100];
+    for (size_t i = 0; i < 100; ++i) {
+        samples[i] = (i * 37) % 100 + 1;  // 1..100, shuffled
+    }
+    struct ProfileStats stats;
+    ProfileStatsCompute(samples, 100, &stats);
+    ASSERT(stats.count == 100 && StatsAre(&stats, 1, 50, 99, 100),
+           "nearest-rank percentiles of 1..100");
+
+    uint64_t one = 42;
+    ProfileStatsCompute(&one, 1, &stats);
+    ASSERT(stats.count == 1 && StatsAre(&stats, 42, 42, 42, 42),
+           "one sample");
+    ProfileStatsCompute(NULL, 0, &stats);
+    ASSERT(stats.count == 0 && StatsAre(&stats, 0, 0, 0, 0), "no samples");
+}
+
+static void test_phase_timings(void) {
+    struct FakeBackend fake;
+    InitFake(&fake);
+    struct DisplayCatalog catalog;
+    DisplayCatalogInit(&catalog, &fake.backend);
+    const struct ModeSpec specs[] = {Spec(656, 489, 1), Spec(672, 498, 1)};
+    const struct ProfileClock clock = {&fake, FakeBackendNow};
+    struct ProfileReport report;
+    const int e = DisplayProfileRun(&catalog, specs, 2, 5, &clock, &report,
+                                    stderr);
+    ASSERT(e == 0, "profile succeeds");
+    ASSERT(report.switches == 10 && report.num_modes == 2 &&
+           report.iterations == 5, "every switch made");
+    ASSERT(StatsAre(&report.phases[kProfilePhaseBegin], 100000, 100000,
+                    100000, 100000), "begin timed");
+    ASSERT(StatsAre(&report.phases[kProfilePhaseConfigure], 2000000, 2000000,
+                    2000000, 2000000), "configure timed");
+    ASSERT(StatsAre(&report.phases[kProfilePhaseComplete], 50000000, 50000000,
+                    50000000, 50000000), "complete timed");
+    ASSERT(StatsAre(&report.phases[kProfilePhaseReadback], 900000, 900000,
+                    900000, 900000), "readback waits out the lag");
+    ASSERT(StatsAre(&report.phases[kProfilePhaseTotal], 53000000, 53000000,
+                    53000000, 53000000), "total of the phases");
+    ASSERT(fake.displays[1].current_index == 0 &&
+           fake.displays[0].current_index == 0, "original mode restored");
+    ASSERT(fake.begin_calls == 11 && fake.complete_calls == 11,
+           "one transaction per switch, plus the restore");
+    DisplayCatalogFree(&catalog);
+    FakeBackendFree(&fake);
+}
+
+static void test_percentiles_differ(void) {
+    struct FakeBackend fake;
+    InitFake(&fake);
+    struct DisplayCatalog catalog;
+    DisplayCatalogInit(&catalog, &fake.backend);
+    // Switching to the current mode first: only that switch reads the new
+    // mode back at once.
+    const struct ModeSpec specs[] = {Spec(640, 480, 0), Spec(656, 489, 0)};
+    const struct ProfileClock clock = {&fake, FakeBackendNow};
+    struct ProfileReport report;
+    ASSERT(DisplayProfileRun(&catalog, specs, 2, 50, &clock, &report,
+                             stderr) == 0, "profile succeeds");
+    ASSERT(report.switches == 100, "100 switches");
+    ASSERT(StatsAre(&report.phases[kProfilePhaseReadback], 300000, 900000,
+                    900000, 900000), "one fast readback");
+    ASSERT(report.phases[kProfilePhaseTotal].min_ns == 52400000 &&
+           report.phases[kProfilePhaseTotal].max_ns == 53000000,
+           "total follows the readback");
+    DisplayCatalogFree(&catalog);
+    FakeBackendFree(&fake);
+}
+
+static void test_failures_restore(void) {
+    struct FakeBackend fake;
+    InitFake(&fake);
+    // The display never reports the new mode.
+    fake.current_mode_lag = 1u << 30;
+    struct DisplayCatalog catalog;
+    DisplayCatalogInit(&catalog, &fake.backend);
+    const struct ModeSpec specs[] = {Spec(656, 489, 1), Spec(672, 498, 1)};
+    const struct ProfileClock clock = {&fake, FakeBackendNow};
+    struct ProfileReport report;
+    char *errors = NULL;
+    size_t length = 0;
+    FILE *err = open_memstream(&errors, &length);
+    const int e = DisplayProfileRun(&catalog, specs, 2, 5, &clock, &report,
+                                    err);
+    fclose(err);
+    ASSERT(e != 0 && report.switches == 0, "readback timeout fails");
+    ASSERT(strstr(errors, "did not report the new mode") != NULL,
+           "timeout reported");
+    ASSERT(fake.displays[1].current_index == 0 && fake.complete_calls == 2,
+           "original mode restored after the failure");
+    free(errors);
+
+    // A mode that doesn't exist: nothing is switched.
+    const struct ModeSpec missing[] = {Spec(656, 489, 1), Spec(1, 1, 1)};
+    fake.complete_calls = 0;
+    err = open_memstream(&errors, &length);
+    ASSERT(DisplayProfileRun(&catalog, missing, 2, 5, &clock, &report,
+                             err) != 0, "unknown mode fails");
+    fclose(err);
+    ASSERT(strstr(errors, "Could not find a mode for resolution 1x1") != NULL,
+           "unknown mode reported");
+    ASSERT(fake.complete_calls == 0, "no display touched");
+    free(errors);
+    DisplayCatalogFree(&catalog);
+    FakeBackendFree(&fake);
+}
+
+static void test_report_formats(void) {
+    struct ProfileReport report;
+    memset(&report, 0, sizeof(report));
+    report.num_modes = 2;
+    report.iterations = 3;
+    report.switches = 6;
+    for (int phase = 0; phase < kProfileNumPhases; ++phase) {
+        report.phases[phase] = (struct ProfileStats){
+            6, 1000000u * (phase + 1), 1500000u * (phase + 1),
+            2000000u * (phase + 1), 2500000u * (phase + 1),
+        };
+    }
+    char *text = NULL;
+    size_t length = 0;
+    FILE *out = open_memstream(&text, &length);
+    ASSERT(DisplayProfileWrite(&report, kOutputText, out) == 0, "text written");
+    fclose(out);
+    ASSERT(strcmp(text,
+                  "6 switches (3 iterations of 2 modes)\n"
+                  "phase          min ms     p50 ms     p99 ms     max ms\n"
+                  "begin           1.000      1.500      2.000      2.500\n"
+                  "configure       2.000      3.000      4.000      5.000\n"
+                  "complete        3.000      4.500      6.000      7.500\n"
+                  "readback        4.000      6.000      8.000     10.000\n"
+                  "total           5.000      7.500     10.000     12.500\n")
+           == 0, "text table");
+    free(text);
+
+    out = open_memstream(&text, &length);
+    ASSERT(DisplayProfileWrite(&report, kOutputJson, out) == 0, "JSON written");
+    fclose(out);
+    static const char kPrefix[] =
+        "{\"modes\":2,\"iterations\":3,\"switches\":6,\"phases\":"
+        "{\"begin\":{\"min_ns\":1000000,\"p50_ns\":1500000,"
+        "\"p99_ns\":2000000,\"max_ns\":2500000},\"configure\":";
+    ASSERT(strncmp(text, kPrefix, sizeof(kPrefix) - 1) == 0 &&
+           strstr(text, "\"total\":{\"min_ns\":5000000,") != NULL &&
+           text[length - 1] == '\n' && strchr(text, '\n') == text + length - 1,
+           "JSON on one line");
+    free(text);
+}
+
+static void test_command(void) {
+    struct FakeBackend fake;
+    InitFake(&fake);
+    struct DisplayCatalog catalog;
+    DisplayCatalogInit(&catalog, &fake.backend);
+    const char *argv[] = {"displaymode", "p", "656", "489", "1", "VGA", "1",
+                          "--iterations=3", "--json", NULL};
+    struct ParsedArgs parsed_args = ParseArgs(9, argv);
+    ASSERT(parsed_args.option == kOptionInvalidMode, "unknown name rejected");
+    const char *args[] = {"displaymode", "p", "656", "489", "1", "640", "480",
+                          "1", "--iterations=3", "--json", NULL};
+    parsed_args = ParseArgs(10, args);
+    ASSERT(parsed_args.option == kOptionProfile && parsed_args.num_specs == 2 &&
+           parsed_args.iterations == 3, "p parsed");
+    char *text = NULL;
+    size_t length = 0;
+    FILE *out = open_memstream(&text, &length);
+    ASSERT(RunCommand(&catalog, &parsed_args, out, stderr) == EXIT_SUCCESS,
+           "p runs");
+    fclose(out);
+    ASSERT(strncmp(text, "{\"modes\":2,\"iterations\":3,\"switches\":6,", 39)
+           == 0, "report printed");
+    ASSERT(fake.displays[1].current_index == 0, "mode restored");
+    free(text);
+    DisplayCatalogFree(&catalog);
+    FakeBackendFree(&fake);
+}
+
+int main(void) {
+    setLogLevel(LOG_LEVEL_ERROR);
+    test_stats();
+    test_phase_timings();
+    test_percentiles_differ();
+    test_failures_restore();
+    test_report_formats();
+    test_command();
+
+    if (tests_failed == 0) {
+        printf("All %d profile tests passed.\n", tests_run);
+        return EXIT_SUCCESS;
+    } else {
+        fprintf(stderr, "%d of %d profile tests failed.\n", tests_failed,
+                tests_run);
+        return EXIT_FAILURE;
+    }
+}
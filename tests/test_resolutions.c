@@ -0,0 +1,213 @@
+#include "../displaymode_parse.h"
+#include "../displaymode_resolutions.h"
+#include "../displaymode_table.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int tests_run = 0;
+static int tests_failed = 0;
+
+#define ASSERT(expr, msg) do { \
+    tests_run++; \
+    if (!(expr)) { \
+        fprintf(stderr, "FAIL: %s (test %d)\n", msg, tests_run); \
+        tests_failed++; \
+    } \
+} while (0)
+
+static void test_no_collisions(void) {
+    // Every slot in use points at an entry that hashes to it, and there is
+    // one slot per entry: no two share a slot.
+    size_t used = 0;
+    int consistent = 1;
+    for (uint32_t slot = 0; slot < kResolutionSlots; ++slot) {
+        const uint8_t entry = kResolutionSlotTable[slot];
+        if (entry == 0) {
+            continue;
+        }
+        ++used;
+        const struct StandardResolution *resolution =
+            &kStandardResolutions[entry - 1];
+        consistent &= entry <= kNumStandardResolutions &&
+                      ResolutionHash(resolution->width, resolution->height,
+                                     kResolutionHashSeed) == slot;
+    }
+    ASSERT(consistent, "resolution slots hash to their entries");
+    ASSERT(used == kNumStandardResolutions, "one slot per resolution");
+
+    used = 0;
+    consistent = 1;
+    for (uint32_t slot = 0; slot < kResolutionNameSlots; ++slot) {
+        const uint8_t entry = kResolutionNameSlotTable[slot];
+        if (entry == 0) {
+            continue;
+        }
+        ++used;
+        const struct ResolutionName *name = &kResolutionNames[entry - 1];
+        consistent &= entry <= kNumResolutionNames &&
+                      ResolutionNameHash(name->name, name->length,
+                                         kResolutionNameHashSeed) == slot;
+    }
+    ASSERT(consistent, "name slots hash to their entries");
+    ASSERT(used == kNumResolutionNames, "one slot per name");
+}
+
+static void test_lookups(void) {
+    int found = 1;
+    for (size_t i = 0; i < kNumStandardResolutions; ++i) {
+        const struct StandardResolution *resolution = &kStandardResolutions[i];
+        found &= StandardResolutionFind(resolution->width,
+                                        resolution->height) == resolution;
+        found &= StandardResolutionLookup(resolution->name,
+                                          strlen(resolution->name)) ==
+                 resolution;
+    }
+    ASSERT(found, "every resolution found by size and name");
+
+    found = 1;
+    for (size_t i = 0; i < kNumResolutionNames; ++i) {
+        const struct ResolutionName *name = &kResolutionNames[i];
+        found &= name->length == strlen(name->name) &&
+                 StandardResolutionLookup(name->name, name->length) ==
+                     &kStandardResolutions[name->resolution];
+    }
+    ASSERT(found, "every alias found");
+
+    int reduced = 1;
+    for (size_t i = 0; i < kNumStandardResolutions; ++i) {
+        const struct StandardResolution *r = &kStandardResolutions[i];
+        reduced &= (uint32_t)r->width * r->aspect_h ==
+                   (uint32_t)r->height * r->aspect_w;
+        for (uint16_t d = 2; d <= r->aspect_h; ++d) {
+            reduced &= r->aspect_w % d != 0 || r->aspect_h % d != 0;
+        }
+    }
+    ASSERT(reduced, "aspect ratios in lowest terms");
+
+    ASSERT(StandardResolutionLookup("uhd", 3) ==
+           StandardResolutionFind(3840, 2160), "names ignore case");
+    ASSERT(StandardResolutionLookup("fullhd", 6) ==
+           StandardResolutionLookup("FULLHD", 6), "aliases ignore case");
+    ASSERT(StandardResolutionLookup("4Kx", 2) != NULL &&
+           StandardResolutionLookup("4Kx", 3) == NULL,
+           "only the given length is compared");
+    ASSERT(StandardResolutionLookup("8K", 2) == NULL &&
+           StandardResolutionLookup("", 0) == NULL &&
+           StandardResolutionLookup("1080", 4) == NULL &&
+           StandardResolutionLookup("1080p\r", 6) == NULL &&
+           StandardResolutionLookup("a long name indeed", 18) == NULL,
+           "unknown names not found");
+    ASSERT(StandardResolutionFind(1920, 1200) == NULL &&
+           StandardResolutionFind(1080, 1920) == NULL &&
+           StandardResolutionFind(0, 0) == NULL &&
+           StandardResolutionFind((size_t)1920 << 32, 1080) == NULL,
+           "other sizes not found");
+}
+
+static void test_table_categories(void) {
+    static const struct DisplayMode kModes[] = {
+        {3840, 2160, 60.0, 1, 1, NULL},
+        {3840, 2160, 30.0, 1, 2, NULL},
+        {2560, 1080, 60.0, 1, 3, NULL},
+        {1920, 1200, 60.0, 1, 4, NULL},
+        {800, 600, 60.0, 1, 5, NULL},
+        {1280, 720, 60.0, 1, 6, NULL},
+    };
+    struct DisplayModeList list;
+    memset(&list, 0, sizeof(list));
+    list.modes = (struct DisplayMode *)kModes;
+    list.count = sizeof(kModes) / sizeof(kModes[0]);
+    list.current_index = -1;
+    struct DisplayModeTable table;
+    ASSERT(DisplayModeTableBuild(&table, &list) == 0, "table built");
+    static const char *const kCategories[] = {
+        "4K", "4K", "UWFHD", "Standard", "LowRes", "720p",
+    };
+    int named = 1;
+    for (size_t i = 0; i < list.count; ++i) {
+        named &= strcmp(table.strings[table.category[i]], kCategories[i]) == 0;
+    }
+    ASSERT(named, "modes categorized by standard name");
+    ASSERT(table.aspect[2] == (64u << 16 | 27u) &&
+           table.aspect[3] == (8u << 16 | 5u), "aspect ratios");
+    char line[kModeTableMaxLine];
+    DisplayModeTableFormatRow(&table, 0, line, sizeof(line));
+    ASSERT(strstr(line, " AR:16:9 ") != NULL && strstr(line, "Cat:4K") != NULL,
+           "listed with its name");
+    DisplayModeTableFree(&table);
+}
+
+static int SameSpecs(const struct ParsedArgs *a, const struct ParsedArgs *b) {
+    if (a->option != b->option || a->num_specs != b->num_specs) {
+        return 0;
+    }
+    for (size_t i = 0; i < a->num_specs; ++i) {
+        if (a->specs[i].width != b->specs[i].width ||
+            a->specs[i].height != b->specs[i].height ||
+            a->specs[i].refresh_rate != b->specs[i].refresh_rate ||
+            a->specs[i].display_index != b->specs[i].display_index) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Parses "line" with ParseArgs and, if it takes it, ParseCommandLine, and
+// checks that both agree.
+static struct ParsedArgs ParseBoth(const char *line, int expect_fast) {
+    char copy[256];
+    snprintf(copy, sizeof(copy), "%s", line);
+    const char *argv[32] = {"displaymode"};
+    int argc = 1;
+    for (char *word = strtok(copy, " "); word != NULL;
+         word = strtok(NULL, " ")) {
+        argv[argc++] = word;
+    }
+    const struct ParsedArgs slow = ParseArgs(argc, argv);
+    struct ParsedArgs fast;
+    const int deferred = ParseCommandLine(line, strlen(line), &fast);
+    ASSERT(deferred == !expect_fast, line);
+    ASSERT(deferred || SameSpecs(&slow, &fast), line);
+    return slow;
+}
+
+static void test_parse_names(void) {
+    struct ParsedArgs parsed = ParseBoth("t 4K @60 1", 1);
+    ASSERT(parsed.option == kOptionConfigureMode && parsed.num_specs == 1 &&
+           parsed.width == 3840 && parsed.height == 2160 &&
+           parsed.refresh_rate == 60.0 && parsed.display_index == 1,
+           "t 4K @60 1");
+    parsed = ParseBoth("t 1080p 0 WQHD @144 1 1440 900 2", 1);
+    ASSERT(parsed.num_specs == 3 && parsed.specs[0].width == 1920 &&
+           parsed.specs[1].height == 1440 && parsed.specs[1].display_index == 1 &&
+           parsed.specs[2].width == 1440 && parsed.specs[2].height == 900,
+           "names mixed with sizes");
+    parsed = ParseBoth("t 1440p", 1);
+    ASSERT(parsed.num_specs == 1 && parsed.width == 2560 &&
+           parsed.height == 1440, "a name that starts with digits");
+    parsed = ParseBoth("t uwqhd+ 0", 1);
+    ASSERT(parsed.width == 3840 && parsed.height == 1600, "lowercase name");
+    parsed = ParseBoth("t 8K 0", 0);
+    ASSERT(parsed.option == kOptionInvalidMode, "unknown name rejected");
+    parsed = ParseBoth("t 4K 2160 0", 1);
+    ASSERT(parsed.option == kOptionInvalidMode,
+           "a name is not followed by a height");
+}
+
+int main(void) {
+    test_no_collisions();
+    test_lookups();
+    test_table_categories();
+    test_parse_names();
+
+    if (tests_failed == 0) {
+        printf("All %d resolution tests passed.\n", tests_run);
+        return EXIT_SUCCESS;
+    } else {
+        fprintf(stderr, "%d of %d resolution tests failed.\n", tests_failed,
+                tests_run);
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,218 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "../displaymode_cache.h"
+#include "../displaymode_catalog.h"
+#include "../displaymode_commands.h"
+#include "../displaymode_parse.h"
+#include "../logging.h"
+#include "bench_util.h"
+#include "fake_backend.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static int tests_run = 0;
+static int tests_failed = 0;
+
+#define ASSERT(expr, msg) do { \
+    tests_run++; \
+    if (!(expr)) { \
+        fprintf(stderr, "FAIL: %s (test %d)\n", msg, tests_run); \
+        tests_failed++; \
+    } \
+} while (0)
+
+static void AddDisplays(struct FakeBackend *fake, uint32_t first,
+                        uint32_t count) {
+    for (uint32_t i = 0; i < count; ++i) {
+        FakeBackendAddSyntheticDisplay(fake, first + i, 12);
+    }
+}
+
+// Runs a command on "catalog" and returns its output (to be freed).
+static char *Run(struct DisplayCatalog *catalog, int argc, const char *argv[],
+                 int *status) {
+    char *buffer = NULL;
+    size_t len = 0;
+    FILE *out = open_memstream(&buffer, &len);
+    const struct ParsedArgs parsed_args = ParseArgs(argc, argv);
+    *status = RunCommand(catalog, &parsed_args, out, out);
+    fclose(out);
+    return buffer;
+}
+
+static size_t Count(const char *text, const char *needle) {
+    size_t n = 0;
+    for (const char *p = strstr(text, needle); p != NULL;
+         p = strstr(p + 1, needle)) {
+        ++n;
+    }
+    return n;
+}
+
+static void test_hundreds_of_displays(void) {
+    struct FakeBackend fake;
+    FakeBackendInit(&fake);
+    AddDisplays(&fake, 1, 300);
+    struct DisplayCatalog catalog;
+    DisplayCatalogInit(&catalog, &fake.backend);
+
+    int status;
+    const char *list[] = {"prog", "d", NULL};
+    char *text = Run(&catalog, 2, list, &status);
+    ASSERT(status == EXIT_SUCCESS, "d succeeds with 300 displays");
+    ASSERT(catalog.num_displays == 300, "no display dropped");
+    ASSERT(Count(text, "\nDisplay ") == 299 &&
+           strstr(text, "\nDisplay 299:\n") != NULL, "every display listed");
+    ASSERT(fake.get_active_displays_calls == 1, "display list read once");
+    free(text);
+
+    const char *json[] = {"prog", "d", "--ndjson", NULL};
+    text = Run(&catalog, 3, json, &status);
+    ASSERT(status == EXIT_SUCCESS && Count(text, "\n") == 300 * 12,
+           "NDJSON has every mode of every display");
+    ASSERT(strstr(text, "{\"display\":299,") != NULL, "last display in NDJSON");
+    free(text);
+
+    const char *set[] = {"prog", "t", "656", "489", "@60", "299", NULL};
+    text = Run(&catalog, 6, set, &status);
+    ASSERT(status == EXIT_SUCCESS && fake.displays[299].current_index == 6,
+           "t sets the mode of display 299");
+    free(text);
+
+    const char *out_of_range[] = {"prog", "t", "640", "480", "300", NULL};
+    text = Run(&catalog, 5, out_of_range, &status);
+    ASSERT(status != EXIT_SUCCESS, "display 300 is out of range");
+    free(text);
+    DisplayCatalogFree(&catalog);
+    FakeBackendFree(&fake);
+}
+
+static void test_display_list_grows_and_shrinks(void) {
+    struct FakeBackend fake;
+    FakeBackendInit(&fake);
+    AddDisplays(&fake, 1, 3);
+    struct DisplayCatalog catalog;
+    DisplayCatalogInit(&catalog, &fake.backend);
+    const struct DisplayModeList *list = NULL;
+    ASSERT(DisplayCatalogLoadDisplays(&catalog) == 0 &&
+           catalog.num_displays == 3, "three displays");
+    DisplayCatalogGetModes(&catalog, 2, &list);
+
+    // Hot-plug far more displays than the catalog has room for.
+    AddDisplays(&fake, 4, 397);
+    ASSERT(DisplayCatalogRevalidate(&catalog) == 0 &&
+           catalog.num_displays == 400, "revalidation picks up 397 more");
+    ASSERT(!catalog.has_modes[2], "modes dropped with the old arrangement");
+    ASSERT(DisplayCatalogGetModes(&catalog, 399, &list) == 0 &&
+           list->count == 12, "new last display has its modes");
+
+    FakeBackendFree(&fake);
+    AddDisplays(&fake, 1, 2);
+    ASSERT(DisplayCatalogRevalidate(&catalog) == 0 &&
+           catalog.num_displays == 2, "unplugging shrinks the list");
+
+    FakeBackendFree(&fake);
+    ASSERT(DisplayCatalogRevalidate(&catalog) == 0 &&
+           catalog.num_displays == 0, "no displays at all");
+    DisplayCatalogFree(&catalog);
+}
+
+static void test_cache_with_hundreds_of_displays(void) {
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/test_scaling.%d.cache", (int)getpid());
+    unlink(path);
+    struct FakeBackend fake;
+    FakeBackendInit(&fake);
+    AddDisplays(&fake, 1, 260);
+
+    struct DisplayCache cache;
+    DisplayCacheOpen(&cache, path);
+    struct DisplayCatalog catalog;
+    DisplayCatalogInit(&catalog, &fake.backend);
+    DisplayCatalogSetCache(&catalog, &cache);
+    int errors[260];
+    DisplayCatalogLoadDisplays(&catalog);
+    ASSERT(DisplayCatalogLoadAllModes(&catalog, errors) == 0 &&
+           fake.copy_modes_calls == 260, "first run enumerates every display");
+    // Enumerating again before the flush stores every display twice; the
+    // later entries win.
+    DisplayCatalogInvalidate(&catalog);
+    DisplayCatalogLoadDisplays(&catalog);
+    DisplayCatalogLoadAllModes(&catalog, errors);
+    ASSERT(cache.num_pending == 520, "both enumerations queued");
+    ASSERT(DisplayCatalogFlushCache(&catalog) == 0 &&
+           cache.header != NULL && cache.header->num_entries == 260,
+           "one cache entry per display");
+    DisplayCatalogFree(&catalog);
+
+    fake.copy_modes_calls = 0;
+    DisplayCatalogInit(&catalog, &fake.backend);
+    DisplayCatalogSetCache(&catalog, &cache);
+    DisplayCatalogLoadDisplays(&catalog);
+    DisplayCatalogLoadAllModes(&catalog, errors);
+    int all_cached = 1;
+    for (uint32_t i = 0; i < 260; ++i) {
+        all_cached &= catalog.from_cache[i] && catalog.modes[i].count == 12;
+    }
+    ASSERT(all_cached && fake.copy_modes_calls == 0,
+           "second run reads every display from the cache");
+    DisplayCatalogFree(&catalog);
+    DisplayCacheClose(&cache);
+    FakeBackendFree(&fake);
+    unlink(path);
+}
+
+// Returns the best time, over a few runs, to enumerate "n" displays and all
+// their modes, per display.
+static double EnumerateNsPerDisplay(uint32_t n) {
+    struct FakeBackend fake;
+    FakeBackendInit(&fake);
+    AddDisplays(&fake, 1, n);
+    int *errors = malloc(n * sizeof(*errors));
+    double best = 1e18;
+    for (int run = 0; run < 5; ++run) {
+        struct DisplayCatalog catalog;
+        DisplayCatalogInit(&catalog, &fake.backend);
+        catalog.max_threads = 1;
+        const double start = NowNs();
+        DisplayCatalogLoadDisplays(&catalog);
+        DisplayCatalogLoadAllModes(&catalog, errors);
+        const double elapsed = NowNs() - start;
+        if (elapsed < best) {
+            best = elapsed;
+        }
+        DisplayCatalogFree(&catalog);
+    }
+    free(errors);
+    FakeBackendFree(&fake);
+    return best / n;
+}
+
+static void test_enumeration_stays_linear(void) {
+    const double small = EnumerateNsPerDisplay(32);
+    const double large = EnumerateNsPerDisplay(1024);
+    printf("Enumeration: %.0f ns/display at 32 displays, %.0f at 1024\n",
+           small, large);
+    // Quadratic growth would make the large catalog 32x slower per display.
+    ASSERT(large < small * 4, "per-display enumeration cost doesn't grow");
+}
+
+int main(void) {
+    setLogLevel(LOG_LEVEL_ERROR);
+    test_hundreds_of_displays();
+    test_display_list_grows_and_shrinks();
+    test_cache_with_hundreds_of_displays();
+    test_enumeration_stays_linear();
+
+    if (tests_failed == 0) {
+        printf("All %d scaling tests passed.\n", tests_run);
+        return EXIT_SUCCESS;
+    } else {
+        fprintf(stderr, "%d of %d scaling tests failed.\n", tests_failed,
+                tests_run);
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,355 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "../displaymode_parse.h"
+#include "../displaymode_server.h"
+#include "../displaymode_shm.h"
+#include "../logging.h"
+#include "fake_backend.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+static int tests_run = 0;
+static int tests_failed = 0;
+
+#define ASSERT(expr, msg) do { \
+    tests_run++; \
+    if (!(expr)) { \
+        fprintf(stderr, "FAIL: %s (test %d)\n", msg, tests_run); \
+        tests_failed++; \
+    } \
+} while (0)
+
+static const struct DisplayMode kMainModes[] = {
+    {2560, 1600, 60.0, 1, 1, NULL},
+    {1280, 800, 60.0, 1, 2, NULL},
+    {640, 480, 60.0, 0, 3, NULL},
+};
+
+static const struct DisplayMode kSecondModes[] = {
+    {800, 600, 75.0, 1, 10, NULL},
+    {1024, 768, 60.0, 1, 11, NULL},
+};
+
+static void *ServeThread(void *arg) {
+    DisplayServerRun(arg);
+    return NULL;
+}
+
+// Counts the lines of "text" that end with " *".
+static int CountCurrent(const char *text) {
+    int n = 0;
+    for (const char *p = text; (p = strstr(p, " *\n")) != NULL; p += 3) {
+        ++n;
+    }
+    return n;
+}
+
+// Returns non-zero if the line starting with "mode" is marked current.
+static int IsCurrent(const char *text, const char *mode) {
+    const char *line = strstr(text, mode);
+    if (line == NULL) {
+        return 0;
+    }
+    const char *end = strchr(line, '\n');
+    return end != NULL && end - line >= 2 && end[-2] == ' ' && end[-1] == '*';
+}
+
+static void test_server_reuses_catalog(struct DisplayClient *client,
+                                       struct FakeBackend *fake) {
+    struct DisplayReply reply;
+    ASSERT(DisplayClientRequest(client, "d", &reply) == 0, "d request succeeds");
+    ASSERT(reply.status == 0, "d status 0");
+    ASSERT(strstr(reply.out, "Display 0 (MAIN):\n2560 x 1600") == reply.out,
+           "d lists main display first");
+    ASSERT(strstr(reply.out, "\nDisplay 1:\n800 x 600") != NULL,
+           "d lists second display");
+    ASSERT(strstr(reply.out, "640 x 480 @60.0Hz") != NULL, "d lists all modes");
+    ASSERT(CountCurrent(reply.out) == 2, "one current mode per display");
+    DisplayReplyFree(&reply);
+
+    const unsigned copies = fake->copy_modes_calls;
+    ASSERT(copies == 2, "modes enumerated once per display");
+    for (int i = 0; i < 5; ++i) {
+        ASSERT(DisplayClientRequest(client, "d", &reply) == 0, "repeated d");
+        DisplayReplyFree(&reply);
+    }
+    ASSERT(fake->copy_modes_calls == copies, "repeated d reuses modes");
+}
+
+static void test_server_configures(struct DisplayClient *client,
+                                   struct FakeBackend *fake) {
+    struct DisplayReply reply;
+    const unsigned copies = fake->copy_modes_calls;
+    ASSERT(DisplayClientRequest(client, "t 1024 768 @60 1", &reply) == 0,
+           "t request succeeds");
+    ASSERT(reply.status == 0, "t status 0");
+    ASSERT(strstr(reply.out, "Changed display resolution from 800x600") != NULL,
+           "t reports change");
+    DisplayReplyFree(&reply);
+    ASSERT(fake->complete_calls == 1, "one configuration completed");
+    ASSERT(fake->displays[1].current_index == 1, "fake display switched");
+
+    ASSERT(DisplayClientRequest(client, "d", &reply) == 0, "d after t");
+    ASSERT(IsCurrent(reply.out, "1024 x 768 @60.0Hz"),
+           "current mode updated without re-enumeration");
+    ASSERT(!IsCurrent(reply.out, "800 x 600 @75.0Hz"), "old mode not current");
+    DisplayReplyFree(&reply);
+    ASSERT(fake->copy_modes_calls == copies, "t reuses modes");
+
+    ASSERT(DisplayClientRequest(client, "t 123 456", &reply) == 0,
+           "unknown mode request succeeds");
+    ASSERT(reply.status != 0, "unknown mode fails");
+    ASSERT(strstr(reply.err, "Could not find a mode for resolution 123x456") != NULL,
+           "unknown mode error message");
+    DisplayReplyFree(&reply);
+
+    ASSERT(DisplayClientRequest(client, "t 800 600 5", &reply) == 0,
+           "bad display request succeeds");
+    ASSERT(strstr(reply.err, "Display 5 not supported") != NULL,
+           "bad display error message");
+    DisplayReplyFree(&reply);
+}
+
+static void test_server_replug(struct DisplayClient *client,
+                               struct FakeBackend *fake) {
+    struct DisplayReply reply;
+    FakeBackendAddDisplay(fake, 30, kSecondModes, 1, 0);
+    const unsigned copies = fake->copy_modes_calls;
+    ASSERT(DisplayClientRequest(client, "d", &reply) == 0, "d after replug");
+    ASSERT(strstr(reply.out, "\nDisplay 2:\n") != NULL, "new display listed");
+    DisplayReplyFree(&reply);
+    ASSERT(fake->copy_modes_calls == copies + 3, "replug re-enumerates modes");
+}
+
+static void test_server_other_commands(struct DisplayClient *client) {
+    struct DisplayReply reply;
+    ASSERT(DisplayClientRequest(client, "v", &reply) == 0, "v request");
+    ASSERT(strstr(reply.out, "displaymode ") == reply.out, "v prints version");
+    DisplayReplyFree(&reply);
+
+    ASSERT(DisplayClientRequest(client, "s", &reply) == 0, "s request");
+    ASSERT(reply.status != 0, "nested server refused");
+    DisplayReplyFree(&reply);
+
+    ASSERT(DisplayClientRequest(client, "t x 600", &reply) == 0, "bad t request");
+    ASSERT(strstr(reply.err, "Invalid mode") != NULL, "invalid mode reported");
+    DisplayReplyFree(&reply);
+
+    // Every word of a "t" for kMaxModeSpecs displays reaches the parser:
+    // the specs parse, and the first display that doesn't exist is refused.
+    char line[1024];
+    size_t length = (size_t)snprintf(line, sizeof(line), "t");
+    for (int i = kMaxModeSpecs - 1; i >= 0; --i) {
+        length += (size_t)snprintf(line + length, sizeof(line) - length,
+                                   " 800 600 @75 %d", i);
+    }
+    ASSERT(DisplayClientRequest(client, line, &reply) == 0 &&
+           reply.status != 0 &&
+           strstr(reply.err, "Display 15 not supported") != NULL,
+           "long t parsed whole");
+    DisplayReplyFree(&reply);
+    // One spec more than that is refused as such.
+    length += (size_t)snprintf(line + length, sizeof(line) - length,
+                               " 800 600 @75 %d", kMaxModeSpecs);
+    ASSERT(DisplayClientRequest(client, line, &reply) == 0 &&
+           reply.status != 0 && strstr(reply.err, "Invalid mode") != NULL,
+           "too many specs refused");
+    DisplayReplyFree(&reply);
+
+    length = (size_t)snprintf(line, sizeof(line), "d");
+    for (int i = 0; i < 200; ++i) {
+        length += (size_t)snprintf(line + length, sizeof(line) - length, " x");
+    }
+    ASSERT(DisplayClientRequest(client, line, &reply) == 0 &&
+           reply.status != 0 && strstr(reply.err, "Too many words") != NULL,
+           "too many words refused");
+    DisplayReplyFree(&reply);
+}
+
+static void test_server_empties_shared_catalog(struct DisplayClient *client,
+                                               struct DisplayCatalog *catalog,
+                                               struct DisplayShm *shm) {
+    struct DisplayReply reply;
+    ASSERT(DisplayClientRequest(client, "d", &reply) == 0, "d before publishing");
+    DisplayReplyFree(&reply);
+    const int64_t now = DisplayShmNow();
+    ASSERT(DisplayShmPublish(shm, catalog, DisplayShmSequence(shm), now) == 0,
+           "catalog published");
+    struct DisplayShmSnapshot snapshot;
+    DisplayShmSnapshotInit(&snapshot);
+
+    ASSERT(DisplayClientRequest(client, "d", &reply) == 0, "d from the server");
+    DisplayReplyFree(&reply);
+    ASSERT(DisplayShmRead(shm, now, kDisplayShmMaxAge, &snapshot) ==
+           kDisplayShmOk, "listing keeps the shared catalog");
+
+    ASSERT(DisplayClientRequest(client, "t 1280 800 0", &reply) == 0 &&
+           reply.status == 0, "t from the server");
+    DisplayReplyFree(&reply);
+    ASSERT(DisplayShmRead(shm, now, kDisplayShmMaxAge, &snapshot) ==
+           kDisplayShmEmpty, "configuring empties the shared catalog");
+    DisplayShmSnapshotFree(&snapshot);
+}
+
+// Sends "count" lines of "command" in one write, without reading the
+// replies.
+static int SendRepeated(int fd, const char *command, int count) {
+    const size_t len = strlen(command);
+    const size_t total = (len + 1) * (size_t)count;
+    char *lines = malloc(total);
+    for (int i = 0; i < count; ++i) {
+        memcpy(lines + i * (len + 1), command, len);
+        lines[i * (len + 1) + len] = '\n';
+    }
+    const int e = write(fd, lines, total) == (ssize_t)total ? 0 : -1;
+    free(lines);
+    return e;
+}
+
+static void SetReceiveTimeout(int fd, int seconds) {
+    struct timeval timeout = {seconds, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+}
+
+static void test_server_slow_client(struct DisplayClient *client,
+                                    const char *socket_path) {
+    // A client that stops reading gets more replies than the socket holds.
+    enum { kSlowRequests = 4000 };
+    struct DisplayReply reply;
+    ASSERT(DisplayClientRequest(client, "d", &reply) == 0, "d for reference");
+    char header[64];
+    const int header_len = snprintf(header, sizeof(header), "%d %zu %zu\n",
+                                    reply.status, reply.out_len, reply.err_len);
+    const size_t reply_len = (size_t)header_len + reply.out_len + reply.err_len;
+    char *expected = malloc(reply_len);
+    memcpy(expected, header, (size_t)header_len);
+    memcpy(expected + header_len, reply.out, reply.out_len);
+    memcpy(expected + header_len + reply.out_len, reply.err, reply.err_len);
+    DisplayReplyFree(&reply);
+
+    struct DisplayClient slow;
+    ASSERT(DisplayClientConnect(&slow, socket_path) == 0, "slow client connects");
+    ASSERT(SendRepeated(slow.fd, "d", kSlowRequests) == 0,
+           "slow client sends its requests");
+    struct DisplayClient gone;
+    ASSERT(DisplayClientConnect(&gone, socket_path) == 0,
+           "vanishing client connects");
+    ASSERT(SendRepeated(gone.fd, "d", kSlowRequests) == 0,
+           "vanishing client sends its requests");
+
+    // The server answers others meanwhile instead of waiting on the socket.
+    SetReceiveTimeout(client->fd, 5);
+    ASSERT(DisplayClientRequest(client, "v", &reply) == 0 && reply.status == 0,
+           "server answers while a client isn't reading");
+    DisplayReplyFree(&reply);
+    DisplayClientClose(&gone);
+    ASSERT(DisplayClientRequest(client, "v", &reply) == 0 && reply.status == 0,
+           "server answers after a client left without reading");
+    DisplayReplyFree(&reply);
+    SetReceiveTimeout(client->fd, 0);
+
+    // The slow client still gets every reply, in order.
+    SetReceiveTimeout(slow.fd, 5);
+    char *received = malloc(reply_len);
+    int intact = 0;
+    for (int i = 0; i < kSlowRequests; ++i) {
+        size_t len = 0;
+        while (len < reply_len) {
+            const ssize_t n = recv(slow.fd, received + len, reply_len - len, 0);
+            if (n <= 0) {
+                break;
+            }
+            len += (size_t)n;
+        }
+        if (len < reply_len || memcmp(received, expected, reply_len) != 0) {
+            break;
+        }
+        ++intact;
+    }
+    ASSERT(intact == kSlowRequests, "slow client gets every reply");
+    free(received);
+    free(expected);
+    DisplayClientClose(&slow);
+}
+
+static void test_client_run(const char *socket_path) {
+    const char *argv[] = {"displaymode", "--socket=ignored", "d", NULL};
+    char *text = NULL;
+    size_t len = 0;
+    FILE *out = open_memstream(&text, &len);
+    FILE *err = fopen("/dev/null", "w");
+    int status = -1;
+    ASSERT(DisplayClientRun(socket_path, 3, argv, out, err, &status) == 0,
+           "client run forwards command");
+    fclose(out);
+    fclose(err);
+    ASSERT(status == 0 && strstr(text, "Display 1:") != NULL,
+           "client run copies output");
+    free(text);
+
+    ASSERT(DisplayClientRun("/nonexistent/displaymode.sock", 3, argv, stdout,
+                            stderr, &status) == -1,
+           "client run falls back without a server");
+}
+
+int main(void) {
+    setLogLevel(LOG_LEVEL_ERROR);
+    struct FakeBackend fake;
+    FakeBackendInit(&fake);
+    FakeBackendAddDisplay(&fake, 10, kMainModes, 3, 0);
+    FakeBackendAddDisplay(&fake, 20, kSecondModes, 2, 0);
+    struct DisplayCatalog catalog;
+    DisplayCatalogInit(&catalog, &fake.backend);
+
+    char socket_path[64];
+    snprintf(socket_path, sizeof(socket_path), "/tmp/displaymode-test-%ld.sock",
+             (long)getpid());
+    struct DisplayServer server;
+    if (DisplayServerOpen(&server, socket_path, &catalog)) {
+        perror("DisplayServerOpen");
+        return EXIT_FAILURE;
+    }
+    char shm_name[64];
+    snprintf(shm_name, sizeof(shm_name), "/displaymode-test-server.%ld",
+             (long)getpid());
+    struct DisplayShm shm;
+    ASSERT(DisplayShmOpen(&shm, shm_name, kDisplayShmDefaultSize) == 0,
+           "shared catalog opened");
+    server.shm = &shm;
+    pthread_t thread;
+    pthread_create(&thread, NULL, ServeThread, &server);
+
+    struct DisplayClient client;
+    ASSERT(DisplayClientConnect(&client, socket_path) == 0, "client connects");
+    test_server_reuses_catalog(&client, &fake);
+    test_server_slow_client(&client, socket_path);
+    test_server_configures(&client, &fake);
+    test_server_replug(&client, &fake);
+    test_server_other_commands(&client);
+    test_server_empties_shared_catalog(&client, &catalog, &shm);
+    DisplayClientClose(&client);
+    test_client_run(socket_path);
+
+    DisplayServerStop(&server);
+    pthread_join(thread, NULL);
+    DisplayServerClose(&server);
+    ASSERT(access(socket_path, F_OK) != 0, "socket file removed");
+    DisplayShmClose(&shm);
+    DisplayShmUnlink(shm_name);
+    DisplayCatalogFree(&catalog);
+    FakeBackendFree(&fake);
+
+    if (tests_failed == 0) {
+        printf("All %d server tests passed.\n", tests_run);
+        return EXIT_SUCCESS;
+    } else {
+        fprintf(stderr, "%d of %d server tests failed.\n", tests_failed, tests_run);
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,505 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "../displaymode_catalog.h"
+#include "../displaymode_commands.h"
+#include "../displaymode_parse.h"
+#include "../displaymode_shm.h"
+#include "../logging.h"
+#include "fake_backend.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+static int tests_run = 0;
+static int tests_failed = 0;
+
+#define ASSERT(expr, msg) do { \
+    tests_run++; \
+    if (!(expr)) { \
+        fprintf(stderr, "FAIL: %s (test %d)\n", msg, tests_run); \
+        tests_failed++; \
+    } \
+} while (0)
+
+static char shm_name[64];
+
+// Opens a new, empty segment of "size" bytes.
+static void OpenFresh(struct DisplayShm *shm, size_t size) {
+    DisplayShmUnlink(shm_name);
+    ASSERT(DisplayShmOpen(shm, shm_name, size) == 0, "segment opened");
+}
+
+// Runs "d" against "catalog" and returns what it printed (to be freed).
+static char *List(struct DisplayCatalog *catalog) {
+    const char *argv[] = {"displaymode", "d", NULL};
+    const struct ParsedArgs parsed_args = ParseArgs(2, argv);
+    char *text = NULL;
+    size_t length = 0;
+    FILE *out = open_memstream(&text, &length);
+    RunCommand(catalog, &parsed_args, out, stderr);
+    fclose(out);
+    return text;
+}
+
+static void test_round_trip(void) {
+    struct FakeBackend fake;
+    FakeBackendInit(&fake);
+    FakeBackendAddSyntheticDisplay(&fake, 1, 24);
+    FakeBackendAddSyntheticDisplay(&fake, 2, 10);
+    fake.displays[1].current_index = 3;
+    unsigned char edid[kDisplayShmMaxEdid];
+    FILE *f = fopen("tests/fixtures/edid/dell-u2723qe.bin", "rb");
+    const size_t edid_size = f != NULL ? fread(edid, 1, sizeof(edid), f) : 0;
+    if (f != NULL) {
+        fclose(f);
+    }
+    FakeBackendSetEdid(&fake, 2, edid, edid_size);
+    struct DisplayCatalog catalog;
+    DisplayCatalogInit(&catalog, &fake.backend);
+    char *direct = List(&catalog);
+    ASSERT(strstr(direct, "DELL U2723QE") != NULL, "display named");
+
+    struct DisplayShm shm;
+    OpenFresh(&shm, kDisplayShmDefaultSize);
+    struct DisplayShmSnapshot snapshot;
+    DisplayShmSnapshotInit(&snapshot);
+    ASSERT(DisplayShmRead(&shm, 1000, kDisplayShmMaxAge, &snapshot) ==
+           kDisplayShmEmpty, "nothing published yet");
+    const uint64_t sequence = DisplayShmSequence(&shm);
+    ASSERT(DisplayShmPublish(&shm, &catalog, sequence, 1000) == 0, "published");
+    ASSERT(DisplayShmSequence(&shm) == sequence + 2, "sequence advanced");
+
+    // Another process maps the same segment.
+    struct DisplayShm reader;
+    ASSERT(DisplayShmOpen(&reader, shm_name, kDisplayShmDefaultSize) == 0,
+           "second mapping");
+    ASSERT(DisplayShmRead(&reader, 2000, kDisplayShmMaxAge, &snapshot) ==
+           kDisplayShmOk, "read back");
+    ASSERT(snapshot.num_displays == 2 && snapshot.num_modes == 34 &&
+           snapshot.published_ns == 1000 && snapshot.retries == 0,
+           "whole catalog copied");
+    ASSERT(snapshot.displays[1].id == 2 &&
+           snapshot.displays[1].first_mode == 24 &&
+           snapshot.displays[1].current_index == 3 &&
+           snapshot.modes[24 + 3].width == fake.displays[1].modes[3].width,
+           "display entries");
+    ASSERT(snapshot.displays[0].edid_size == 0 &&
+           snapshot.displays[1].edid_size == edid_size &&
+           memcmp(snapshot.displays[1].edid, edid, edid_size) == 0,
+           "EDIDs shared");
+
+    const unsigned copies = fake.copy_modes_calls;
+    struct DisplayCatalog shared;
+    DisplayCatalogInit(&shared, &snapshot.backend);
+    char *listed = List(&shared);
+    ASSERT(strcmp(direct, listed) == 0,
+           "snapshot lists the same modes and names");
+    ASSERT(fake.copy_modes_calls == copies, "no display queried");
+    void *config = NULL;
+    ASSERT(snapshot.backend.begin_configuration(snapshot.backend.context,
+                                                &config) != 0,
+           "snapshot can't configure");
+    DisplayCatalogFree(&shared);
+    free(listed);
+    free(direct);
+
+    DisplayShmSnapshotFree(&snapshot);
+    DisplayShmClose(&reader);
+    DisplayShmClose(&shm);
+    DisplayCatalogFree(&catalog);
+    FakeBackendFree(&fake);
+}
+
+static void test_stale_and_invalidated(void) {
+    struct FakeBackend fake;
+    FakeBackendInit(&fake);
+    FakeBackendAddSyntheticDisplay(&fake, 1, 8);
+    struct DisplayCatalog catalog;
+    DisplayCatalogInit(&catalog, &fake.backend);
+    free(List(&catalog));
+
+    struct DisplayShm shm;
+    OpenFresh(&shm, kDisplayShmDefaultSize);
+    const int64_t now = DisplayShmNow();
+    ASSERT(DisplayShmPublish(&shm, &catalog, DisplayShmSequence(&shm), now) == 0,
+           "published");
+    struct DisplayShmSnapshot snapshot;
+    DisplayShmSnapshotInit(&snapshot);
+    ASSERT(DisplayShmRead(&shm, now + kDisplayShmMaxAge, kDisplayShmMaxAge,
+                          &snapshot) == kDisplayShmOk, "fresh at the limit");
+    ASSERT(DisplayShmRead(&shm, now + kDisplayShmMaxAge + 1, kDisplayShmMaxAge,
+                          &snapshot) == kDisplayShmStale, "too old");
+    ASSERT(DisplayShmRead(&shm, now - kDisplayShmMaxAge - 1, kDisplayShmMaxAge,
+                          &snapshot) == kDisplayShmStale, "from the future");
+
+    // Modes enumerated before someone else published aren't published.
+    const uint64_t before = DisplayShmSequence(&shm);
+    ASSERT(DisplayShmInvalidate(&shm) == 0, "invalidated");
+    ASSERT(DisplayShmRead(&shm, now, kDisplayShmMaxAge, &snapshot) ==
+           kDisplayShmEmpty, "invalidated catalog not used");
+    ASSERT(DisplayShmPublish(&shm, &catalog, before, now) != 0,
+           "outdated modes not published");
+    ASSERT(DisplayShmRead(&shm, now, kDisplayShmMaxAge, &snapshot) ==
+           kDisplayShmEmpty, "still invalidated");
+
+    // Displays without loaded modes aren't published.
+    struct DisplayCatalog unloaded;
+    DisplayCatalogInit(&unloaded, &fake.backend);
+    DisplayCatalogLoadDisplays(&unloaded);
+    ASSERT(DisplayShmPublish(&shm, &unloaded, DisplayShmSequence(&shm), now)
+           != 0, "modes must be loaded");
+    DisplayCatalogFree(&unloaded);
+    DisplayShmClose(&shm);
+
+    // Nor catalogs that don't fit.
+    OpenFresh(&shm, sizeof(struct DisplayShmHeader) + 100);
+    ASSERT(DisplayShmPublish(&shm, &catalog, DisplayShmSequence(&shm), now)
+           != 0, "too big for the segment");
+    ASSERT(DisplayShmRead(&shm, now, kDisplayShmMaxAge, &snapshot) ==
+           kDisplayShmEmpty, "nothing published");
+    DisplayShmClose(&shm);
+
+    DisplayShmSnapshotFree(&snapshot);
+    DisplayCatalogFree(&catalog);
+    FakeBackendFree(&fake);
+}
+
+static void test_busy_and_dead_writers(void) {
+    struct FakeBackend fake;
+    FakeBackendInit(&fake);
+    FakeBackendAddSyntheticDisplay(&fake, 1, 8);
+    struct DisplayCatalog catalog;
+    DisplayCatalogInit(&catalog, &fake.backend);
+    free(List(&catalog));
+    struct DisplayShm shm;
+    OpenFresh(&shm, kDisplayShmDefaultSize);
+    const int64_t now = DisplayShmNow();
+    ASSERT(DisplayShmPublish(&shm, &catalog, DisplayShmSequence(&shm), now) == 0,
+           "published");
+
+    // A live writer in the middle of an update.
+    shm.header->sequence += 1;
+    shm.header->writer_pid = getpid();
+    struct DisplayShmSnapshot snapshot;
+    DisplayShmSnapshotInit(&snapshot);
+    ASSERT(DisplayShmRead(&shm, now, kDisplayShmMaxAge, &snapshot) ==
+           kDisplayShmBusy, "reader gives up on a busy writer");
+    ASSERT(snapshot.retries == kDisplayShmReadAttempts - 1, "retried");
+    ASSERT(DisplayShmPublish(&shm, &catalog, DisplayShmSequence(&shm), now)
+           != 0, "second writer refused");
+    ASSERT(DisplayShmInvalidate(&shm) != 0, "invalidation refused");
+
+    // The writer died: the next one takes over.
+    const pid_t child = fork();
+    if (child == 0) {
+        _exit(0);
+    }
+    waitpid(child, NULL, 0);
+    shm.header->writer_pid = child;
+    ASSERT(DisplayShmPublish(&shm, &catalog, DisplayShmSequence(&shm), now) == 0,
+           "dead writer overtaken");
+    ASSERT((DisplayShmSequence(&shm) & 1) == 0, "sequence even again");
+    ASSERT(DisplayShmRead(&shm, now, kDisplayShmMaxAge, &snapshot) ==
+           kDisplayShmOk, "readable again");
+    ASSERT(shm.header->writer_pid == 0, "owner released");
+
+    // A writer that died after claiming the segment, before updating it.
+    shm.header->writer_pid = child;
+    ASSERT(DisplayShmPublish(&shm, &catalog, DisplayShmSequence(&shm), now) == 0,
+           "dead owner overtaken");
+
+    // An odd sequence with no owner isn't taken for a dead writer.
+    shm.header->sequence += 1;
+    ASSERT(DisplayShmPublish(&shm, &catalog, DisplayShmSequence(&shm), now)
+           != 0, "ownerless update treated as busy");
+    ASSERT(shm.header->writer_pid == 0 && (DisplayShmSequence(&shm) & 1),
+           "left as it was");
+    shm.header->sequence += 1;
+
+    // A corrupt catalog is rejected even when read consistently.
+    struct DisplayShmDisplay *display =
+        (struct DisplayShmDisplay *)(shm.header + 1);
+    display->mode_count = 1000;
+    ASSERT(DisplayShmRead(&shm, now, kDisplayShmMaxAge, &snapshot) ==
+           kDisplayShmFailed, "out-of-range modes rejected");
+
+    DisplayShmSnapshotFree(&snapshot);
+    DisplayShmClose(&shm);
+    DisplayCatalogFree(&catalog);
+    FakeBackendFree(&fake);
+}
+
+static void test_incompatible_segment(void) {
+    struct DisplayShm shm;
+    OpenFresh(&shm, kDisplayShmDefaultSize);
+    shm.header->version = kDisplayShmVersion + 1;
+    shm.header->sequence = 42;
+    DisplayShmClose(&shm);
+    ASSERT(DisplayShmOpen(&shm, shm_name, kDisplayShmDefaultSize) == 0,
+           "reopened");
+    ASSERT(shm.header->version == kDisplayShmVersion &&
+           DisplayShmSequence(&shm) == 0, "recreated for this version");
+    DisplayShmClose(&shm);
+}
+
+// The stress test's two catalogs differ in every mode: one display whose
+// modes are all 1000 wide, or three whose modes are all 3000 wide.  A
+// snapshot mixing them has modes of both widths, or the wrong counts.
+enum {
+    kStressReaders = 4,
+    kStressModes = 300,
+    kStressMinPublishes = 1000,
+    kStressMillis = 300,
+    // How long the writer keeps going for readers that haven't seen both
+    // catalogs yet (say, on a busy single-CPU machine).
+    kStressMaxMillis = 10000,
+    // Writers per wave of the concurrent writer test, and their work.
+    kStressWriters = 4,
+    kStressWaves = 50,
+    kStressPublishesPerWriter = 200,
+};
+
+static void AddStressDisplays(struct FakeBackend *fake, uint32_t count) {
+    struct DisplayMode modes[kStressModes];
+    for (size_t i = 0; i < kStressModes; ++i) {
+        modes[i] = (struct DisplayMode){
+            1000 * count, 480 + i, 60.0, 1, (int)i + 1, NULL,
+        };
+    }
+    for (uint32_t id = 1; id <= count; ++id) {
+        FakeBackendAddDisplay(fake, id, modes, kStressModes / count, 0);
+    }
+}
+
+static int Consistent(const struct DisplayShmSnapshot *snapshot) {
+    const uint32_t displays = snapshot->num_displays;
+    if ((displays != 1 && displays != 3) || snapshot->num_modes != kStressModes) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < displays; ++i) {
+        if (snapshot->displays[i].id != i + 1 ||
+            snapshot->displays[i].mode_count != kStressModes / displays ||
+            snapshot->displays[i].current.width != 1000 * displays) {
+            return 0;
+        }
+    }
+    for (uint32_t i = 0; i < snapshot->num_modes; ++i) {
+        if (snapshot->modes[i].width != 1000 * displays) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int64_t Millis(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Publishes the two catalogs in turn for kStressMillis, and then until every
+// reader has written a byte to "ready" (or kStressMaxMillis have passed).
+// Exits 0 if every publication succeeded.
+static void RunStressWriter(int ready) {
+    struct FakeBackend fakes[2];
+    struct DisplayCatalog catalogs[2];
+    for (int i = 0; i < 2; ++i) {
+        FakeBackendInit(&fakes[i]);
+        AddStressDisplays(&fakes[i], i == 0 ? 1 : 3);
+        DisplayCatalogInit(&catalogs[i], &fakes[i].backend);
+        free(List(&catalogs[i]));
+    }
+    struct DisplayShm shm;
+    int failed = DisplayShmOpen(&shm, shm_name, kDisplayShmDefaultSize) != 0;
+    const int64_t start = Millis();
+    int num_ready = 0;
+    char byte;
+    for (unsigned n = 0; !failed; ++n) {
+        if ((n & 63) == 0) {
+            while (read(ready, &byte, 1) == 1) {
+                ++num_ready;
+            }
+            const int64_t elapsed = Millis() - start;
+            if (n >= kStressMinPublishes && elapsed >= kStressMillis &&
+                (num_ready == kStressReaders || elapsed >= kStressMaxMillis)) {
+                break;
+            }
+        }
+        failed = DisplayShmPublish(&shm, &catalogs[n & 1],
+                                   DisplayShmSequence(&shm),
+                                   DisplayShmNow()) != 0;
+    }
+    _exit(failed);
+}
+
+// Reads until "done" reaches end of file, writing a byte to "ready" once it
+// has seen both catalogs.  Exits 0 if every snapshot was consistent and both
+// catalogs were seen.
+static void RunStressReader(int done, int ready) {
+    struct DisplayShm shm;
+    if (DisplayShmOpen(&shm, shm_name, kDisplayShmDefaultSize)) {
+        _exit(1);
+    }
+    struct DisplayShmSnapshot snapshot;
+    DisplayShmSnapshotInit(&snapshot);
+    unsigned seen = 0;
+    int consistent = 1;
+    char byte;
+    for (unsigned n = 0;; ++n) {
+        if ((n & 63) == 0 && read(done, &byte, 1) == 0) {
+            break;
+        }
+        if (DisplayShmRead(&shm, DisplayShmNow(), kDisplayShmMaxAge,
+                           &snapshot) == kDisplayShmOk) {
+            consistent &= Consistent(&snapshot);
+            const unsigned was_seen = seen;
+            seen |= snapshot.num_displays == 1 ? 1u : 2u;
+            if (seen == 3 && was_seen != 3 && write(ready, "", 1) != 1) {
+                _exit(1);
+            }
+        }
+    }
+    _exit(!(consistent && seen == 3));
+}
+
+// Runs waves of kStressWriters short-lived writers, each publishing one of
+// the two catalogs as fast as it can, so that writers keep overlapping each
+// other and the ones that just exited.
+static void RunConcurrentWriters(void) {
+    struct FakeBackend fakes[2];
+    struct DisplayCatalog catalogs[2];
+    for (int i = 0; i < 2; ++i) {
+        FakeBackendInit(&fakes[i]);
+        AddStressDisplays(&fakes[i], i == 0 ? 1 : 3);
+        DisplayCatalogInit(&catalogs[i], &fakes[i].backend);
+        free(List(&catalogs[i]));
+    }
+    for (int wave = 0; wave < kStressWaves; ++wave) {
+        pid_t writers[kStressWriters];
+        for (int i = 0; i < kStressWriters; ++i) {
+            if ((writers[i] = fork()) == 0) {
+                struct DisplayShm shm;
+                if (DisplayShmOpen(&shm, shm_name, kDisplayShmDefaultSize)) {
+                    _exit(1);
+                }
+                for (int n = 0; n < kStressPublishesPerWriter; ++n) {
+                    DisplayShmPublish(&shm, &catalogs[i & 1],
+                                      DisplayShmSequence(&shm),
+                                      DisplayShmNow());
+                }
+                _exit(0);
+            }
+        }
+        for (int i = 0; i < kStressWriters; ++i) {
+            waitpid(writers[i], NULL, 0);
+        }
+    }
+    for (int i = 0; i < 2; ++i) {
+        DisplayCatalogFree(&catalogs[i]);
+        FakeBackendFree(&fakes[i]);
+    }
+}
+
+static void test_concurrent_writers(void) {
+    struct DisplayShm shm;
+    OpenFresh(&shm, kDisplayShmDefaultSize);
+    int done[2];
+    int ready[2];
+    ASSERT(pipe(done) == 0 && pipe(ready) == 0, "pipes");
+    fcntl(done[0], F_SETFL, O_NONBLOCK);
+    pid_t readers[kStressReaders];
+    for (int i = 0; i < kStressReaders; ++i) {
+        if ((readers[i] = fork()) == 0) {
+            close(done[1]);
+            close(ready[0]);
+            RunStressReader(done[0], ready[1]);
+        }
+    }
+    // The read end stays open for the readers' (unread) ready bytes.
+    close(ready[1]);
+    RunConcurrentWriters();
+    close(done[1]);
+    int readers_ok = 1;
+    for (int i = 0; i < kStressReaders; ++i) {
+        int status = -1;
+        waitpid(readers[i], &status, 0);
+        readers_ok &= WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+    close(done[0]);
+    close(ready[0]);
+    ASSERT(readers_ok, "concurrent writers never mix their catalogs");
+    ASSERT((DisplayShmSequence(&shm) & 1) == 0 && shm.header->writer_pid == 0,
+           "no writer left behind");
+    DisplayShmClose(&shm);
+}
+
+static void test_multiprocess_stress(void) {
+    struct DisplayShm shm;
+    OpenFresh(&shm, kDisplayShmDefaultSize);
+    int done[2];
+    int ready[2];
+    ASSERT(pipe(done) == 0 && pipe(ready) == 0, "pipes");
+    fcntl(done[0], F_SETFL, O_NONBLOCK);
+    fcntl(ready[0], F_SETFL, O_NONBLOCK);
+    pid_t readers[kStressReaders];
+    for (int i = 0; i < kStressReaders; ++i) {
+        if ((readers[i] = fork()) == 0) {
+            close(done[1]);
+            close(ready[0]);
+            RunStressReader(done[0], ready[1]);
+        }
+    }
+    const pid_t writer = fork();
+    if (writer == 0) {
+        close(done[0]);
+        close(done[1]);
+        close(ready[1]);
+        RunStressWriter(ready[0]);
+    }
+    close(ready[0]);
+    close(ready[1]);
+    int status = -1;
+    waitpid(writer, &status, 0);
+    ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 0,
+           "writer published every time");
+    // Readers see end of file once no process holds the write end.
+    close(done[1]);
+    int readers_ok = 1;
+    for (int i = 0; i < kStressReaders; ++i) {
+        status = -1;
+        waitpid(readers[i], &status, 0);
+        readers_ok &= WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+    close(done[0]);
+    ASSERT(readers_ok, "readers saw only whole catalogs, of both kinds");
+    ASSERT((DisplayShmSequence(&shm) & 1) == 0, "no writer left behind");
+    DisplayShmClose(&shm);
+}
+
+int main(void) {
+    setLogLevel(LOG_LEVEL_ERROR);
+    snprintf(shm_name, sizeof(shm_name), "/displaymode-test.%ld",
+             (long)getpid());
+    test_round_trip();
+    test_stale_and_invalidated();
+    test_busy_and_dead_writers();
+    test_incompatible_segment();
+    test_multiprocess_stress();
+    test_concurrent_writers();
+    DisplayShmUnlink(shm_name);
+
+    if (tests_failed == 0) {
+        printf("All %d shared catalog tests passed.\n", tests_run);
+        return EXIT_SUCCESS;
+    } else {
+        fprintf(stderr, "%d of %d shared catalog tests failed.\n",
+                tests_failed, tests_run);
+        return EXIT_FAILURE;
+    }
+}
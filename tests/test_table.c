@@ -0,0 +1,255 @@
+#include "../displaymode_format.h"
+#include "../displaymode_parse.h"
+#include "../displaymode_resolutions.h"
+#include "../displaymode_table.h"
+#include "fake_backend.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int tests_run = 0;
+static int tests_failed = 0;
+
+#define ASSERT(expr, msg) do { \
+    tests_run++; \
+    if (!(expr)) { \
+        fprintf(stderr, "FAIL: %s (test %d)\n", msg, tests_run); \
+        tests_failed++; \
+    } \
+} while (0)
+
+static const struct DisplayMode kModes[] = {
+    {1920, 1080, 60.0, 1, 1, NULL},
+    {1920, 1080, 59.94005994005994, 1, 2, NULL},
+    {1280, 800, 75.0, 0, 3, NULL},
+    {640, 480, 59.95, 1, -4, NULL},
+    {1366, 768, 60.25, 1, 5, NULL},
+    {5120, 2880, 0.0, 1, 6, NULL},
+    {1024, 767, 143.856, 0, 7, NULL},
+};
+enum { kNumModes = sizeof(kModes) / sizeof(kModes[0]) };
+
+// The line the "d" listing printed for "mode" before the table existed.
+static void FormatExpected(const struct DisplayMode *mode, char *out,
+                           size_t size) {
+    struct DisplayModeInfo info;
+    memset(&info, 0, sizeof(info));
+    info.width = mode->width;
+    info.height = mode->height;
+    info.refresh_rate = mode->refresh_rate;
+    info.usable_for_desktop = mode->usable_for_desktop;
+    info.mode_id = mode->mode_id;
+    int a = (int)info.width, b = (int)info.height;
+    while (b != 0) {
+        int t = b;
+        b = a % b;
+        a = t;
+    }
+    info.aspect_w = a ? (int)info.width / a : 0;
+    info.aspect_h = a ? (int)info.height / a : 0;
+    strcpy(info.pixelEncodingStr, "Unknown");
+    strcpy(info.displayName, "Display");
+    const struct StandardResolution *standard =
+        StandardResolutionFind(info.width, info.height);
+    strcpy(info.resCategory,
+           standard != NULL ? standard->name
+           : info.width < 1024 || info.height < 768 ? "LowRes" : "Standard");
+    FormatDisplayModeInfo(&info, out, size);
+}
+
+static struct DisplayModeList MakeList(const struct DisplayMode *modes,
+                                       size_t count, ptrdiff_t current_index) {
+    struct DisplayModeList list;
+    memset(&list, 0, sizeof(list));
+    list.modes = (struct DisplayMode *)modes;
+    list.count = count;
+    list.current_index = current_index;
+    if (current_index >= 0) {
+        list.current = modes[current_index];
+        list.has_current = 1;
+    }
+    return list;
+}
+
+static void test_columns(void) {
+    struct DisplayModeList list = MakeList(kModes, kNumModes, 1);
+    struct DisplayModeTable table;
+    ASSERT(DisplayModeTableBuild(&table, &list) == 0, "table built");
+    ASSERT(table.count == kNumModes && table.num_listed == kNumModes,
+           "one row per mode");
+    ASSERT(table.resolution[0] == (1920u << 16 | 1080u), "packed resolution");
+    ASSERT(table.refresh_mhz[1] == 59940, "refresh in millihertz");
+    ASSERT(table.aspect[4] == (683u << 16 | 384u), "aspect in lowest terms");
+    ASSERT(table.mode_id[3] == -4, "mode ID kept");
+    ASSERT(table.flags[1] == (kModeFlagUsable | kModeFlagCurrent),
+           "current and usable flags");
+    ASSERT(table.flags[2] == 0, "unusable mode flagged");
+    ASSERT(table.category[3] != table.category[0], "categories differ");
+    ASSERT(table.encoding[0] == table.encoding[6] &&
+           table.display_name[0] == table.display_name[6],
+           "repeated strings share an ID");
+    ASSERT(table.category[0] == table.category[1] &&
+           strcmp(table.strings[table.category[0]], "1080p") == 0,
+           "standard resolutions categorized by name");
+    // Unknown, Display, Standard, LowRes, 1080p and 5K.
+    ASSERT(table.num_strings == 6, "strings interned once");
+    DisplayModeTableFree(&table);
+}
+
+// Rates whose tenth is easy to get wrong from millihertz or a rounded
+// product: printf rounds the exact double, so 59.85 (just below) gives
+// "59.8" and 60.15 (just above) gives "60.2".
+static const struct DisplayMode kEdgeModes[] = {
+    {1920, 1080, 59.85, 1, 1, NULL},
+    {1920, 1080, 29.95, 1, 2, NULL},
+    {1920, 1080, 47.45, 1, 3, NULL},
+    {1920, 1080, 60.15, 1, 4, NULL},
+    {1920, 1080, 59.9496, 1, 5, NULL},
+    {1920, 1080, 0.25, 1, 6, NULL},
+    {1920, 1080, 119.95000000000002, 1, 7, NULL},
+    {1920, 1080, 23.976023976023978, 1, 8, NULL},
+    {1920, 1080, 1e12, 1, 9, NULL},
+};
+
+static void test_format_matches_info(void) {
+    struct DisplayModeList list = MakeList(kModes, kNumModes, -1);
+    struct DisplayModeTable table;
+    DisplayModeTableBuild(&table, &list);
+    int all_equal = 1;
+    for (size_t i = 0; i < kNumModes; ++i) {
+        char expected[256];
+        char actual[kModeTableMaxLine];
+        FormatExpected(&kModes[i], expected, sizeof(expected));
+        const int length = DisplayModeTableFormatRow(&table, i, actual,
+                                                     sizeof(actual));
+        if (strcmp(expected, actual) != 0 || length != (int)strlen(expected)) {
+            fprintf(stderr, "  expected \"%s\"\n  actual   \"%s\"\n", expected,
+                    actual);
+            all_equal = 0;
+        }
+    }
+    ASSERT(all_equal, "rows format like FormatDisplayModeInfo");
+    DisplayModeTableFree(&table);
+
+    enum { kNumEdgeModes = sizeof(kEdgeModes) / sizeof(kEdgeModes[0]) };
+    list = MakeList(kEdgeModes, kNumEdgeModes, -1);
+    DisplayModeTableBuild(&table, &list);
+    all_equal = 1;
+    for (size_t i = 0; i < kNumEdgeModes; ++i) {
+        char expected[256];
+        char actual[kModeTableMaxLine];
+        FormatExpected(&kEdgeModes[i], expected, sizeof(expected));
+        DisplayModeTableFormatRow(&table, i, actual, sizeof(actual));
+        if (strcmp(expected, actual) != 0) {
+            fprintf(stderr, "  expected \"%s\"\n  actual   \"%s\"\n", expected,
+                    actual);
+            all_equal = 0;
+        }
+    }
+    ASSERT(all_equal, "edge rates round like FormatDisplayModeInfo");
+    DisplayModeTableFree(&table);
+    list = MakeList(kModes, kNumModes, -1);
+    DisplayModeTableBuild(&table, &list);
+
+    char small[10];
+    const int length = DisplayModeTableFormatRow(&table, 0, small, sizeof(small));
+    ASSERT(length > 10 && strlen(small) == 9 &&
+           strncmp(small, "1920 x 10", 9) == 0,
+           "truncated like snprintf");
+    DisplayModeTableFree(&table);
+
+    // A large synthetic catalog formats identically too.
+    struct FakeBackend fake;
+    FakeBackendInit(&fake);
+    FakeBackendAddSyntheticDisplay(&fake, 1, 5000);
+    list = MakeList(fake.displays[0].modes, 5000, 0);
+    DisplayModeTableBuild(&table, &list);
+    all_equal = 1;
+    for (size_t i = 0; i < 5000; ++i) {
+        char expected[256];
+        char actual[kModeTableMaxLine];
+        FormatExpected(&list.modes[i], expected, sizeof(expected));
+        DisplayModeTableFormatRow(&table, i, actual, sizeof(actual));
+        all_equal &= strcmp(expected, actual) == 0;
+    }
+    ASSERT(all_equal, "synthetic rows format like FormatDisplayModeInfo");
+
+    // And the scan agrees with a linear MatchesRefreshRate scan.
+    int all_found = 1;
+    static const double kQueries[] = {0.0, 60.0, 59.94, 75.0, 61.0};
+    for (size_t i = 0; i < 5000; i += 37) {
+        for (size_t q = 0; q < sizeof(kQueries) / sizeof(kQueries[0]); ++q) {
+            ptrdiff_t expected = -1;
+            for (size_t j = 0; j < 5000 && expected < 0; ++j) {
+                if (list.modes[j].width == list.modes[i].width &&
+                    list.modes[j].height == list.modes[i].height &&
+                    MatchesRefreshRate(kQueries[q], list.modes[j].refresh_rate)) {
+                    expected = (ptrdiff_t)j;
+                }
+            }
+            all_found &= DisplayModeTableFind(&table, list.modes[i].width,
+                                              list.modes[i].height,
+                                              kQueries[q]) == expected;
+        }
+    }
+    ASSERT(all_found, "table scan matches a linear scan");
+    ASSERT(DisplayModeTableBytes(&table) < 32 * 5000, "about 28 bytes per mode");
+    DisplayModeTableFree(&table);
+    FakeBackendFree(&fake);
+}
+
+static void test_unlisted_current(void) {
+    struct DisplayModeList list = MakeList(kModes, 2, -1);
+    list.current = kModes[4];
+    list.has_current = 1;
+    struct DisplayModeTable table;
+    DisplayModeTableBuild(&table, &list);
+    ASSERT(table.count == 3 && table.num_listed == 2,
+           "unlisted current mode appended");
+    ASSERT(table.flags[2] & kModeFlagCurrent, "appended row is current");
+    ASSERT(DisplayModeTableFind(&table, 1366, 768, 0.0) == -1,
+           "appended row isn't searched");
+    ASSERT(DisplayModeTableFind(&table, 1920, 1080, 59.94) == 1,
+           "listed rows are searched");
+    DisplayModeTableFree(&table);
+
+    struct DisplayModeList empty = MakeList(NULL, 0, -1);
+    ASSERT(DisplayModeTableBuild(&table, &empty) == 0 && table.count == 0,
+           "empty list gives an empty table");
+    DisplayModeTableFree(&table);
+}
+
+static void test_intern(void) {
+    struct DisplayModeList list = MakeList(kModes, 1, -1);
+    struct DisplayModeTable table;
+    DisplayModeTableBuild(&table, &list);
+    const uint8_t id = DisplayModeTableIntern(&table, "Built-in Retina Display");
+    ASSERT(id == table.num_strings - 1, "new string added");
+    ASSERT(DisplayModeTableIntern(&table, "Built-in Retina Display") == id,
+           "same string, same ID");
+    char name[32];
+    for (int i = 0; i < 300; ++i) {
+        snprintf(name, sizeof(name), "display %d", i);
+        DisplayModeTableIntern(&table, name);
+    }
+    ASSERT(table.num_strings == kModeTableMaxStrings, "string IDs are bounded");
+    ASSERT(strcmp(table.strings[DisplayModeTableIntern(&table, "overflow")],
+                  "Unknown") == 0, "overflowing strings become Unknown");
+    DisplayModeTableFree(&table);
+}
+
+int main(void) {
+    test_columns();
+    test_format_matches_info();
+    test_unlisted_current();
+    test_intern();
+
+    if (tests_failed == 0) {
+        printf("All %d table tests passed.\n", tests_run);
+        return EXIT_SUCCESS;
+    } else {
+        fprintf(stderr, "%d of %d table tests failed.\n", tests_failed, tests_run);
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,197 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "../displaymode_catalog.h"
+#include "../displaymode_commands.h"
+#include "../displaymode_parse.h"
+#include "../displaymode_trace.h"
+#include "../logging.h"
+#include "fake_backend.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static int tests_run = 0;
+static int tests_failed = 0;
+
+#define ASSERT(expr, msg) do { \
+    tests_run++; \
+    if (!(expr)) { \
+        fprintf(stderr, "FAIL: %s (test %d)\n", msg, tests_run); \
+        tests_failed++; \
+    } \
+} while (0)
+
+static const struct DisplayMode kModes[] = {
+    {1920, 1080, 60.0, 1, 1, NULL},
+    {1280, 720, 60.0, 1, 2, NULL},
+};
+
+static char trace_path[64];
+
+// Returns the trace file's contents (to be freed), or NULL.
+static char *ReadTrace(void) {
+    FILE *file = fopen(trace_path, "r");
+    if (file == NULL) {
+        return NULL;
+    }
+    char *text = calloc(1, 1 << 20);
+    fread(text, 1, (1 << 20) - 1, file);
+    fclose(file);
+    return text;
+}
+
+// Reads the number after "key" in the event named "name".  Returns 0 or -1.
+static int EventNumber(const char *trace, const char *name, const char *key,
+                       double *value) {
+    char pattern[64];
+    snprintf(pattern, sizeof(pattern), "{\"name\":\"%s\"", name);
+    const char *event = strstr(trace, pattern);
+    if (event == NULL) {
+        return -1;
+    }
+    const char *end = strchr(event, '}');
+    snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+    const char *p = strstr(event, pattern);
+    if (p == NULL || p > end) {
+        return -1;
+    }
+    *value = strtod(p + strlen(pattern), NULL);
+    return 0;
+}
+
+// Runs a command against the fake backend, traced.
+static int RunTraced(struct FakeBackend *fake, int argc, const char *argv[]) {
+    struct TraceBackend traced;
+    struct DisplayCatalog catalog;
+    DisplayCatalogInit(&catalog, TraceBackendWrap(&traced, &fake->backend));
+    const struct ParsedArgs parsed_args = ParseArgs(argc, argv);
+    FILE *out = fopen("/dev/null", "w");
+    const int e = RunCommand(&catalog, &parsed_args, out, out);
+    fclose(out);
+    DisplayCatalogFree(&catalog);
+    return e;
+}
+
+static void test_disabled_records_nothing(void) {
+    ASSERT(!trace_enabled, "tracing is off by default");
+    struct TraceSpan span;
+    TraceSpanBegin(&span, "idle", "test");
+    ASSERT(span.start_ns == 0, "disabled span isn't timed");
+    TraceSpanEnd(&span);
+    ASSERT(TraceEventCount() == 0, "disabled span isn't recorded");
+    ASSERT(TraceStop() == 0, "stopping without a trace is harmless");
+}
+
+static void test_start_fails_on_bad_path(void) {
+    ASSERT(TraceStart("/nonexistent-dir/trace.json") == -1,
+           "unwritable trace path is reported");
+    ASSERT(!trace_enabled, "tracing stays off after a failed start");
+}
+
+static void test_configure_trace(void) {
+    struct FakeBackend fake;
+    FakeBackendInit(&fake);
+    FakeBackendAddDisplay(&fake, 5, kModes, 2, 0);
+    fake.copy_modes_delay_us = 2000;
+    fake.complete_delay_us = 20000;
+
+    ASSERT(TraceStart(trace_path) == 0, "trace started");
+    const char *argv[] = {"prog", "t", "1280", "720", "0", NULL};
+    ASSERT(RunTraced(&fake, 5, argv) == EXIT_SUCCESS, "traced t succeeds");
+    ASSERT(TraceEventCount() > 0, "spans recorded");
+    ASSERT(TraceStop() == 0, "trace written");
+    ASSERT(!trace_enabled, "tracing stopped");
+
+    char *trace = ReadTrace();
+    ASSERT(trace != NULL, "trace file readable");
+    if (trace == NULL) {
+        return;
+    }
+    ASSERT(strncmp(trace, "{\"traceEvents\":[", 16) == 0, "trace-event JSON");
+    ASSERT(strstr(trace, "\"displayTimeUnit\":\"ns\"}\n") != NULL,
+           "trace document complete");
+    ASSERT(strstr(trace, "\"ph\":\"M\"") != NULL, "process name metadata");
+
+    static const char *const kSpans[] = {
+        "get_active_displays", "copy_modes", "begin_configuration",
+        "configure_display", "complete_configuration", "enumerate displays",
+        "enumerate modes", "match", "apply",
+    };
+    for (size_t i = 0; i < sizeof(kSpans) / sizeof(kSpans[0]); ++i) {
+        double dur;
+        char msg[80];
+        snprintf(msg, sizeof(msg), "span %s present", kSpans[i]);
+        ASSERT(EventNumber(trace, kSpans[i], "dur", &dur) == 0, msg);
+    }
+
+    // The injected latencies show up in the spans of their calls.
+    double dur = 0.0;
+    EventNumber(trace, "complete_configuration", "dur", &dur);
+    ASSERT(dur >= 20000.0, "complete_configuration covers its latency");
+    EventNumber(trace, "copy_modes", "dur", &dur);
+    ASSERT(dur >= 2000.0 && dur < 20000.0, "copy_modes covers its latency");
+
+    // Backend calls nest inside their phase.
+    double apply_ts = 0.0, apply_dur = 0.0, complete_ts = 0.0;
+    EventNumber(trace, "apply", "ts", &apply_ts);
+    EventNumber(trace, "apply", "dur", &apply_dur);
+    EventNumber(trace, "complete_configuration", "ts", &complete_ts);
+    EventNumber(trace, "complete_configuration", "dur", &dur);
+    ASSERT(apply_ts <= complete_ts &&
+           complete_ts + dur <= apply_ts + apply_dur + 0.001,
+           "complete_configuration nests in apply");
+
+    double display = 0.0;
+    ASSERT(EventNumber(trace, "configure_display", "display", &display) == 0 &&
+           display == 5.0, "configure_display records the display ID");
+    free(trace);
+    FakeBackendFree(&fake);
+}
+
+static void test_list_trace(void) {
+    struct FakeBackend fake;
+    FakeBackendInit(&fake);
+    FakeBackendAddSyntheticDisplay(&fake, 1, 100);
+    FakeBackendAddSyntheticDisplay(&fake, 2, 100);
+
+    ASSERT(TraceStart(trace_path) == 0, "trace restarted");
+    TraceRecord("parse", "phase", TraceNow(), TraceNow(), -1);
+    const char *argv[] = {"prog", "d", "--json", NULL};
+    ASSERT(RunTraced(&fake, 3, argv) == EXIT_SUCCESS, "traced d succeeds");
+    // Parse; the display list (a phase, then backend calls for the count and
+    // the list); each display's modes (a phase and a backend call) and EDID;
+    // format; and releasing the two mode lists.
+    ASSERT(TraceEventCount() == 1 + 3 + 2 * 3 + 1 + 2, "one span per step");
+    ASSERT(TraceStop() == 0, "second trace written");
+
+    char *trace = ReadTrace();
+    ASSERT(trace != NULL && strstr(trace, "\"name\":\"format\"") != NULL &&
+           strstr(trace, "\"name\":\"parse\"") != NULL,
+           "listing traced with the parse phase");
+    ASSERT(trace != NULL && strstr(trace, "\"name\":\"apply\"") == NULL,
+           "restarted trace drops earlier spans");
+    free(trace);
+    FakeBackendFree(&fake);
+}
+
+int main(void) {
+    setLogLevel(LOG_LEVEL_ERROR);
+    snprintf(trace_path, sizeof(trace_path), "/tmp/test_trace.%d.json",
+             (int)getpid());
+
+    test_disabled_records_nothing();
+    test_start_fails_on_bad_path();
+    test_configure_trace();
+    test_list_trace();
+    unlink(trace_path);
+
+    if (tests_failed == 0) {
+        printf("All %d trace tests passed.\n", tests_run);
+        return EXIT_SUCCESS;
+    } else {
+        fprintf(stderr, "%d of %d trace tests failed.\n", tests_failed, tests_run);
+        return EXIT_FAILURE;
+    }
+}
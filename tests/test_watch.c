@@ -0,0 +1,337 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "../displaymode_catalog.h"
+#include "../displaymode_parse.h"
+#include "../displaymode_watch.h"
+#include "../logging.h"
+#include "fake_backend.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int tests_run = 0;
+static int tests_failed = 0;
+
+#define ASSERT(expr, msg) do { \
+    tests_run++; \
+    if (!(expr)) { \
+        fprintf(stderr, "FAIL: %s (test %d)\n", msg, tests_run); \
+        tests_failed++; \
+    } \
+} while (0)
+
+// One step of a scripted event stream.
+enum StepKind {
+    kStepEvent,   // delivers an event
+    kStepGap,     // no events for "value" milliseconds
+    kStepPlug,    // adds display "display" to the fake backend
+    kStepUnplug,  // removes display "display"
+    kStepSetMode, // makes modes["value"] current on display "display"
+};
+
+struct Step {
+    enum StepKind kind;
+    uint32_t display;
+    uint32_t value;  // event flags, a gap or a mode index
+};
+
+// A gap longer than the coalescing interval, ending the burst.
+#define QUIET {kStepGap, 0, 1000}
+
+// Plays a script against a fake backend: backend changes happen as the
+// stream reaches them, as they would between callbacks.
+struct Script {
+    const struct Step *steps;
+    size_t count;
+    size_t next;
+    struct FakeBackend *fake;
+};
+
+static void RunAction(struct FakeBackend *fake, const struct Step *step) {
+    switch (step->kind) {
+        case kStepPlug:
+            FakeBackendAddSyntheticDisplay(fake, step->display, 12);
+            break;
+        case kStepUnplug:
+            FakeBackendRemoveDisplay(fake, step->display);
+            break;
+        case kStepSetMode:
+            for (uint32_t i = 0; i < fake->num_displays; ++i) {
+                if (fake->displays[i].id == step->display) {
+                    fake->displays[i].current_index = step->value;
+                }
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+static int ScriptWait(void *context, int timeout_ms,
+                      struct DisplayEvent *events, size_t max_events) {
+    struct Script *script = context;
+    size_t n = 0;
+    while (script->next < script->count) {
+        const struct Step *step = &script->steps[script->next];
+        if (step->kind == kStepGap) {
+            if (n > 0) {
+                return (int)n;
+            }
+            ++script->next;
+            if (timeout_ms >= 0 && step->value >= (uint32_t)timeout_ms) {
+                return 0;
+            }
+            // The wait outlasts the gap.
+            continue;
+        }
+        if (step->kind == kStepEvent) {
+            if (n == max_events) {
+                return (int)n;
+            }
+            events[n].display = step->display;
+            events[n].flags = step->value;
+            ++n;
+        } else {
+            RunAction(script->fake, step);
+        }
+        ++script->next;
+    }
+    return n > 0 ? (int)n : -1;
+}
+
+struct Fixture {
+    struct FakeBackend fake;
+    struct DisplayCatalog catalog;
+    struct DisplayWatch watch;
+    char *buffer;
+    size_t length;
+    FILE *out;
+};
+
+// Starts watching displays 1 and 2 (12 modes each, the first current).
+static void FixtureInit(struct Fixture *f, int ndjson) {
+    FakeBackendInit(&f->fake);
+    FakeBackendAddSyntheticDisplay(&f->fake, 1, 12);
+    FakeBackendAddSyntheticDisplay(&f->fake, 2, 12);
+    DisplayCatalogInit(&f->catalog, &f->fake.backend);
+    f->buffer = NULL;
+    f->length = 0;
+    f->out = open_memstream(&f->buffer, &f->length);
+    DisplayWatchInit(&f->watch, &f->catalog, ndjson, f->out, f->out);
+    fflush(f->out);
+}
+
+// Plays "steps" and returns the output since the last call.
+static const char *Play(struct Fixture *f, const struct Step *steps,
+                        size_t count, int *status) {
+    struct Script script = {steps, count, 0, &f->fake};
+    const struct DisplayEventSource source = {&script, ScriptWait};
+    const size_t start = f->length;
+    *status = DisplayWatchRun(&f->watch, &source, 50, f->out, f->out);
+    fflush(f->out);
+    return f->buffer + start;
+}
+
+static void FixtureFree(struct Fixture *f) {
+    fclose(f->out);
+    free(f->buffer);
+    DisplayWatchFree(&f->watch);
+    DisplayCatalogFree(&f->catalog);
+    FakeBackendFree(&f->fake);
+}
+
+static void test_initial_displays_reported(void) {
+    struct Fixture f;
+    FixtureInit(&f, 0);
+    ASSERT(strcmp(f.buffer,
+                  "+ display 0 (id 1): 640 x 480 @60.0Hz\n"
+                  "+ display 1 (id 2): 640 x 480 @60.0Hz\n") == 0,
+           "every display starts as added");
+    ASSERT(f.watch.num_known == 2, "both displays known");
+
+    int status;
+    const char *output = Play(&f, NULL, 0, &status);
+    ASSERT(status == EXIT_SUCCESS && output[0] == '\0',
+           "an empty stream ends the watch quietly");
+    FixtureFree(&f);
+}
+
+static void test_mode_change_burst_coalesced(void) {
+    struct Fixture f;
+    FixtureInit(&f, 0);
+    const unsigned copy_modes_calls = f.fake.copy_modes_calls;
+    const unsigned list_calls = f.fake.get_active_displays_calls;
+    // CoreGraphics reports a mode change several times over.
+    const struct Step steps[] = {
+        {kStepSetMode, 2, 6},
+        {kStepEvent, 2, kDisplayEventModeChanged},
+        {kStepEvent, 2, kDisplayEventModeChanged},
+        {kStepGap, 0, 10},
+        {kStepEvent, 2, kDisplayEventModeChanged},
+        QUIET,
+    };
+    int status;
+    const char *output = Play(&f, steps, sizeof(steps) / sizeof(steps[0]),
+                              &status);
+    ASSERT(status == EXIT_SUCCESS, "watch ends with the stream");
+    ASSERT(strcmp(output, "~ display 1 (id 2): 640 x 480 @60.0Hz -> "
+                  "656 x 489 @60.0Hz\n") == 0, "one line for the burst");
+    ASSERT(f.watch.bursts == 1, "events within the gap form one burst");
+    ASSERT(f.fake.copy_modes_calls == copy_modes_calls + 1,
+           "only the changed display is re-read");
+    ASSERT(f.fake.get_active_displays_calls == list_calls,
+           "a mode change doesn't re-read the display list");
+    const struct DisplayModeList *list = NULL;
+    ASSERT(DisplayCatalogGetModes(&f.catalog, 1, &list) == 0 &&
+           list->current_index == 6, "catalog has the new current mode");
+    FixtureFree(&f);
+}
+
+static void test_hot_plug(void) {
+    struct Fixture f;
+    FixtureInit(&f, 0);
+    const struct Step steps[] = {
+        {kStepPlug, 3, 0},
+        {kStepEvent, 3, kDisplayEventAdded},
+        QUIET,
+        {kStepUnplug, 1, 0},
+        {kStepEvent, 1, kDisplayEventRemoved},
+        QUIET,
+    };
+    int status;
+    const char *output = Play(&f, steps, sizeof(steps) / sizeof(steps[0]),
+                              &status);
+    ASSERT(strcmp(output,
+                  "+ display 2 (id 3): 640 x 480 @60.0Hz\n"
+                  "- display 0 (id 1)\n") == 0, "plug and unplug reported");
+    ASSERT(f.watch.bursts == 2, "two bursts");
+    ASSERT(f.catalog.num_displays == 2 && f.catalog.displays[0] == 2 &&
+           f.catalog.displays[1] == 3, "catalog follows the display list");
+    ASSERT(f.watch.num_known == 2 && f.watch.known[0].id == 2,
+           "watch follows the display list");
+    FixtureFree(&f);
+}
+
+static void test_unannounced_display_found(void) {
+    struct Fixture f;
+    FixtureInit(&f, 0);
+    // A mode change for a display the watch hasn't seen yet.
+    const struct Step steps[] = {
+        {kStepPlug, 7, 0},
+        {kStepSetMode, 7, 1},
+        {kStepEvent, 7, kDisplayEventModeChanged},
+    };
+    int status;
+    const char *output = Play(&f, steps, sizeof(steps) / sizeof(steps[0]),
+                              &status);
+    ASSERT(strcmp(output, "+ display 2 (id 7): 640 x 480 @59.9Hz\n") == 0,
+           "unknown display is listed as added");
+    FixtureFree(&f);
+}
+
+static void test_burst_without_net_change(void) {
+    struct Fixture f;
+    FixtureInit(&f, 0);
+    const struct Step steps[] = {
+        {kStepSetMode, 1, 6},
+        {kStepEvent, 1, kDisplayEventModeChanged},
+        {kStepSetMode, 1, 0},
+        {kStepEvent, 1, kDisplayEventModeChanged},
+        {kStepPlug, 9, 0},
+        {kStepEvent, 9, kDisplayEventAdded},
+        {kStepUnplug, 9, 0},
+        {kStepEvent, 9, kDisplayEventRemoved},
+        QUIET,
+    };
+    int status;
+    const char *output = Play(&f, steps, sizeof(steps) / sizeof(steps[0]),
+                              &status);
+    ASSERT(f.watch.bursts == 1 && output[0] == '\0',
+           "changes undone within a burst print nothing");
+    FixtureFree(&f);
+}
+
+static void test_rescan_rereads_every_display(void) {
+    struct Fixture f;
+    FixtureInit(&f, 0);
+    const unsigned copy_modes_calls = f.fake.copy_modes_calls;
+    const struct Step steps[] = {
+        {kStepSetMode, 1, 2},
+        {kStepSetMode, 2, 3},
+        {kStepEvent, 0, kDisplayEventRescan},
+    };
+    int status;
+    const char *output = Play(&f, steps, sizeof(steps) / sizeof(steps[0]),
+                              &status);
+    ASSERT(strcmp(output,
+                  "~ display 0 (id 1): 640 x 480 @60.0Hz -> 640 x 480 @50.0Hz\n"
+                  "~ display 1 (id 2): 640 x 480 @60.0Hz -> 640 x 480 @75.0Hz\n")
+           == 0, "lost events still find every change");
+    ASSERT(f.fake.copy_modes_calls == copy_modes_calls + 2,
+           "every display re-read");
+    FixtureFree(&f);
+}
+
+static void test_ndjson(void) {
+    struct Fixture f;
+    FixtureInit(&f, 1);
+    ASSERT(strcmp(f.buffer,
+                  "{\"event\":\"added\",\"display\":0,\"id\":1,\"width\":640,"
+                  "\"height\":480,\"refreshRate\":60.0}\n"
+                  "{\"event\":\"added\",\"display\":1,\"id\":2,\"width\":640,"
+                  "\"height\":480,\"refreshRate\":60.0}\n") == 0,
+           "NDJSON additions");
+    const struct Step steps[] = {
+        {kStepSetMode, 2, 6},
+        {kStepEvent, 2, kDisplayEventModeChanged},
+        QUIET,
+        {kStepUnplug, 1, 0},
+        {kStepEvent, 1, kDisplayEventRemoved},
+    };
+    int status;
+    const char *output = Play(&f, steps, sizeof(steps) / sizeof(steps[0]),
+                              &status);
+    ASSERT(strcmp(output,
+                  "{\"event\":\"modeChanged\",\"display\":1,\"id\":2,"
+                  "\"width\":656,\"height\":489,\"refreshRate\":60.0,"
+                  "\"from\":{\"width\":640,\"height\":480,"
+                  "\"refreshRate\":60.0}}\n"
+                  "{\"event\":\"removed\",\"display\":0,\"id\":1}\n") == 0,
+           "NDJSON mode change and removal");
+    FixtureFree(&f);
+}
+
+static void test_parse_watch(void) {
+    const char *argv[] = {"prog", "w", "--coalesce=50", "--ndjson", NULL};
+    struct ParsedArgs args = ParseArgs(4, argv);
+    ASSERT(args.option == kOptionWatch && args.coalesce_ms == 50 &&
+           args.output_format == kOutputNdjson, "w with flags parses");
+    args = ParseArgs(2, argv);
+    ASSERT(args.option == kOptionWatch && args.coalesce_ms == -1,
+           "coalescing defaults");
+    const char *bad[] = {"prog", "w", "--coalesce=soon", NULL};
+    args = ParseArgs(3, bad);
+    ASSERT(args.option == kOptionInvalid, "invalid coalesce interval");
+}
+
+int main(void) {
+    setLogLevel(LOG_LEVEL_ERROR);
+    test_initial_displays_reported();
+    test_mode_change_burst_coalesced();
+    test_hot_plug();
+    test_unannounced_display_found();
+    test_burst_without_net_change();
+    test_rescan_rereads_every_display();
+    test_ndjson();
+    test_parse_watch();
+
+    if (tests_failed == 0) {
+        printf("All %d watch tests passed.\n", tests_run);
+        return EXIT_SUCCESS;
+    } else {
+        fprintf(stderr, "%d of %d watch tests failed.\n", tests_failed,
+                tests_run);
+        return EXIT_FAILURE;
+    }
+}
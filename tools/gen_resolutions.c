@@ -0,0 +1,164 @@
+// Generates displaymode_resolutions_table.h from displaymode_resolutions.def:
+// the resolutions with their aspect ratios, the names "t" accepts, and the
+// seeds and slots of two perfect hash tables, found by trying seeds until
+// no two keys share a slot.
+//
+// Usage: gen_resolutions > displaymode_resolutions_table.h
+
+#include "../displaymode_resolutions.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct Entry {
+    const char *name;
+    uint32_t width;
+    uint32_t height;
+    int is_alias;
+};
+
+static const struct Entry kEntries[] = {
+#define RESOLUTION(name, width, height) {name, width, height, 0},
+#define ALIAS(name, width, height) {name, width, height, 1},
+#include "../displaymode_resolutions.def"
+#undef RESOLUTION
+#undef ALIAS
+};
+
+#define kNumEntries (sizeof(kEntries) / sizeof(kEntries[0]))
+
+// Seeds are tried in the same order on every run, so the output only
+// changes when the list does.
+static uint32_t NextSeed(uint32_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state | 1;
+}
+
+static int Fail(const char *message, const char *name) {
+    fprintf(stderr, "gen_resolutions: %s: %s\n", message, name);
+    return EXIT_FAILURE;
+}
+
+static int SameName(const char *a, const char *b) {
+    for (;; ++a, ++b) {
+        const int x = *a >= 'A' && *a <= 'Z' ? *a + 32 : *a;
+        const int y = *b >= 'A' && *b <= 'Z' ? *b + 32 : *b;
+        if (x != y) {
+            return 0;
+        }
+        if (x == '\0') {
+            return 1;
+        }
+    }
+}
+
+int main(void) {
+    // Resolution index of each entry.
+    size_t resolution_of[kNumEntries];
+    size_t resolutions[kNumEntries];
+    size_t num_resolutions = 0;
+    for (size_t i = 0; i < kNumEntries; ++i) {
+        const struct Entry *entry = &kEntries[i];
+        const size_t length = strlen(entry->name);
+        if (length == 0 || length > kMaxResolutionName ||
+            strspn(entry->name, "0123456789") == length) {
+            return Fail("invalid name", entry->name);
+        }
+        for (size_t j = 0; j < i; ++j) {
+            if (SameName(kEntries[j].name, entry->name)) {
+                return Fail("duplicate name", entry->name);
+            }
+        }
+        size_t found = num_resolutions;
+        for (size_t r = 0; r < num_resolutions; ++r) {
+            if (kEntries[resolutions[r]].width == entry->width &&
+                kEntries[resolutions[r]].height == entry->height) {
+                found = r;
+            }
+        }
+        if (entry->is_alias == (found == num_resolutions)) {
+            return Fail(entry->is_alias ? "alias of an unlisted resolution"
+                                        : "resolution listed twice",
+                        entry->name);
+        }
+        if (!entry->is_alias) {
+            resolutions[num_resolutions++] = i;
+        }
+        resolution_of[i] = found;
+    }
+    if (num_resolutions > kResolutionSlots / 2 ||
+        kNumEntries > kResolutionNameSlots / 2) {
+        return Fail("too many entries for the tables", "");
+    }
+
+    uint8_t slots[kResolutionSlots];
+    uint8_t name_slots[kResolutionNameSlots];
+    uint32_t state = 0x9e3779b9u;
+    uint32_t seed = 0;
+    for (int found = 0; !found;) {
+        seed = NextSeed(&state);
+        memset(slots, 0, sizeof(slots));
+        found = 1;
+        for (size_t r = 0; r < num_resolutions && found; ++r) {
+            const struct Entry *entry = &kEntries[resolutions[r]];
+            const uint32_t slot =
+                ResolutionHash(entry->width, entry->height, seed);
+            found = slots[slot] == 0;
+            slots[slot] = (uint8_t)(r + 1);
+        }
+    }
+    uint32_t name_seed = 0;
+    for (int found = 0; !found;) {
+        name_seed = NextSeed(&state);
+        memset(name_slots, 0, sizeof(name_slots));
+        found = 1;
+        for (size_t i = 0; i < kNumEntries && found; ++i) {
+            const uint32_t slot = ResolutionNameHash(
+                kEntries[i].name, strlen(kEntries[i].name), name_seed);
+            found = name_slots[slot] == 0;
+            name_slots[slot] = (uint8_t)(i + 1);
+        }
+    }
+
+    printf("// Generated by tools/gen_resolutions.c from "
+           "displaymode_resolutions.def;\n"
+           "// do not edit.  Regenerate with \"make resolutions\".\n\n");
+    printf("const uint32_t kResolutionHashSeed = 0x%08xu;\n", seed);
+    printf("const uint32_t kResolutionNameHashSeed = 0x%08xu;\n\n", name_seed);
+    printf("const struct StandardResolution kStandardResolutions[] = {\n");
+    for (size_t r = 0; r < num_resolutions; ++r) {
+        const struct Entry *entry = &kEntries[resolutions[r]];
+        uint32_t a = entry->width;
+        uint32_t b = entry->height;
+        while (b != 0) {
+            const uint32_t t = b;
+            b = a % b;
+            a = t;
+        }
+        printf("    {\"%s\", %u, %u, %u, %u},\n", entry->name, entry->width,
+               entry->height, entry->width / a, entry->height / a);
+    }
+    printf("};\nconst size_t kNumStandardResolutions = %zu;\n\n",
+           num_resolutions);
+    printf("const struct ResolutionName kResolutionNames[] = {\n");
+    for (size_t i = 0; i < kNumEntries; ++i) {
+        printf("    {\"%s\", %zu, %zu},\n", kEntries[i].name,
+               strlen(kEntries[i].name), resolution_of[i]);
+    }
+    printf("};\nconst size_t kNumResolutionNames = %zu;\n\n",
+           (size_t)kNumEntries);
+    printf("const uint8_t kResolutionSlotTable[kResolutionSlots] = {");
+    for (size_t s = 0; s < kResolutionSlots; ++s) {
+        printf("%s%u,", s % 16 == 0 ? "\n    " : " ", slots[s]);
+    }
+    printf("\n};\n\nconst uint8_t kResolutionNameSlotTable[kResolutionNameSlots]"
+           " = {");
+    for (size_t s = 0; s < kResolutionNameSlots; ++s) {
+        printf("%s%u,", s % 16 == 0 ? "\n    " : " ", name_slots[s]);
+    }
+    printf("\n};\n");
+    return EXIT_SUCCESS;
+}